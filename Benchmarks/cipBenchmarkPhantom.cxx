@@ -0,0 +1,507 @@
+#include "cipBenchmarkPhantom.h"
+#include "vtkFloatArray.h"
+#include "vtkPointData.h"
+#include "vtkPoints.h"
+#include "vnl/vnl_math.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+  // Physical extent of every phantom, in mm
+  const double PHANTOMEXTENT[3] = { 340.0, 300.0, 300.0 };
+
+  const short AIRINTENSITY    = -1000;
+  const short LUNGINTENSITY   = -850;
+  const short TISSUEINTENSITY = 40;
+  const double NOISESIGMA     = 15.0;
+
+  struct ELLIPSOID
+  {
+    double center[3];
+    double radii[3];
+  };
+
+  struct SEGMENT
+  {
+    double start[3];
+    double end[3];
+    double radius;
+  };
+
+  // A small linear congruential generator: the phantoms must not depend
+  // on the platform's rand()
+  class RandomNumbers
+  {
+  public:
+    RandomNumbers( unsigned int seed ) : m_State( seed ) {}
+
+    /** Uniformly distributed in (0, 1] */
+    double GetUniform()
+    {
+      m_State = 1664525u*m_State + 1013904223u;
+      return ( static_cast< double >( m_State ) + 1.0 )/4294967296.0;
+    }
+
+    double GetNormal()
+    {
+      double u = this->GetUniform();
+      double v = this->GetUniform();
+
+      return std::sqrt( -2.0*std::log( u ) )*std::cos( 2.0*vnl_math::pi*v );
+    }
+
+  private:
+    unsigned int m_State;
+  };
+
+
+  bool IsInsideEllipsoid( const ELLIPSOID& ellipsoid, const double point[3], double scale )
+  {
+    double sum = 0.0;
+    for ( unsigned int i = 0; i < 3; i++ )
+      {
+      double d = ( point[i] - ellipsoid.center[i] )/( scale*ellipsoid.radii[i] );
+      sum += d*d;
+      }
+
+    return sum <= 1.0;
+  }
+
+
+  void GetRandomPointInEllipsoid( const ELLIPSOID& ellipsoid, double scale, RandomNumbers& random, double point[3] )
+  {
+    do
+      {
+      for ( unsigned int i = 0; i < 3; i++ )
+        {
+        point[i] = ellipsoid.center[i] + scale*ellipsoid.radii[i]*( 2.0*random.GetUniform() - 1.0 );
+        }
+      }
+    while ( !IsInsideEllipsoid( ellipsoid, point, scale ) );
+  }
+
+
+  double GetDistanceToSegment( const SEGMENT& segment, const double point[3] )
+  {
+    double direction[3];
+    double offset[3];
+    double lengthSquared = 0.0;
+    double projection    = 0.0;
+    for ( unsigned int i = 0; i < 3; i++ )
+      {
+      direction[i] = segment.end[i] - segment.start[i];
+      offset[i]    = point[i] - segment.start[i];
+      lengthSquared += direction[i]*direction[i];
+      projection    += direction[i]*offset[i];
+      }
+
+    double t = ( lengthSquared > 0.0 ) ? std::max( 0.0, std::min( 1.0, projection/lengthSquared ) ) : 0.0;
+
+    double distanceSquared = 0.0;
+    for ( unsigned int i = 0; i < 3; i++ )
+      {
+      double d = offset[i] - t*direction[i];
+      distanceSquared += d*d;
+      }
+
+    return std::sqrt( distanceSquared );
+  }
+
+
+  // Set the intensity of every voxel within 'radius' of the segment and,
+  // if 'type' is not UNDEFINEDTYPE, its chest type (keeping its chest
+  // region). With 'lungOnly', voxels outside the lungs, and voxels
+  // already labeled as airway, are left alone.
+  void PaintSegment( cip::BenchmarkPhantom& phantom, const SEGMENT& segment, double radius, short intensity,
+                     unsigned char type, bool lungOnly )
+  {
+    cip::ChestConventions conventions;
+
+    const cip::CTType::SpacingType& spacing = phantom.ct->GetSpacing();
+    const cip::CTType::SizeType&    size    = phantom.ct->GetBufferedRegion().GetSize();
+
+    int lower[3];
+    int upper[3];
+    for ( unsigned int i = 0; i < 3; i++ )
+      {
+      double low  = std::min( segment.start[i], segment.end[i] ) - radius;
+      double high = std::max( segment.start[i], segment.end[i] ) + radius;
+
+      lower[i] = std::max( 0, static_cast< int >( std::floor( low/spacing[i] ) ) );
+      upper[i] = std::min( static_cast< int >( size[i] ) - 1, static_cast< int >( std::ceil( high/spacing[i] ) ) );
+      }
+
+    short*          ct       = phantom.ct->GetBufferPointer();
+    unsigned short* labelMap = phantom.labelMap->GetBufferPointer();
+
+    double point[3];
+    for ( int z = lower[2]; z <= upper[2]; z++ )
+      {
+      point[2] = z*spacing[2];
+      for ( int y = lower[1]; y <= upper[1]; y++ )
+        {
+        point[1] = y*spacing[1];
+        for ( int x = lower[0]; x <= upper[0]; x++ )
+          {
+          point[0] = x*spacing[0];
+          if ( GetDistanceToSegment( segment, point ) > radius )
+            {
+            continue;
+            }
+
+          unsigned int index = static_cast< unsigned int >( ( z*size[1] + y )*size[0] + x );
+
+          unsigned char region = conventions.GetChestRegionFromValue( labelMap[index] );
+          if ( lungOnly && ( region == static_cast< unsigned char >( cip::UNDEFINEDREGION ) ||
+                             conventions.GetChestTypeFromValue( labelMap[index] ) ==
+                             static_cast< unsigned char >( cip::AIRWAY ) ) )
+            {
+            continue;
+            }
+
+          ct[index] = intensity;
+          if ( type != static_cast< unsigned char >( cip::UNDEFINEDTYPE ) )
+            {
+            labelMap[index] = conventions.GetValueFromChestRegionAndType( region, type );
+            }
+          }
+        }
+      }
+  }
+
+
+  // Particles every 'spacing' mm along a segment. The segment direction
+  // goes in eigenvector array "hevec<directionAxis>".
+  void AddSegmentParticles( const SEGMENT& segment, double spacing, unsigned int directionAxis,
+                            RandomNumbers& random, vtkPolyData* particles )
+  {
+    double direction[3];
+    double length = 0.0;
+    for ( unsigned int i = 0; i < 3; i++ )
+      {
+      direction[i] = segment.end[i] - segment.start[i];
+      length += direction[i]*direction[i];
+      }
+    length = std::sqrt( length );
+    for ( unsigned int i = 0; i < 3; i++ )
+      {
+      direction[i] /= length;
+      }
+
+    // Two unit vectors perpendicular to the segment
+    double u[3];
+    double v[3];
+    double helper[3] = { 1.0, 0.0, 0.0 };
+    if ( std::fabs( direction[0] ) > 0.9 )
+      {
+      helper[0] = 0.0;
+      helper[1] = 1.0;
+      }
+    u[0] = direction[1]*helper[2] - direction[2]*helper[1];
+    u[1] = direction[2]*helper[0] - direction[0]*helper[2];
+    u[2] = direction[0]*helper[1] - direction[1]*helper[0];
+    double uNorm = std::sqrt( u[0]*u[0] + u[1]*u[1] + u[2]*u[2] );
+    for ( unsigned int i = 0; i < 3; i++ )
+      {
+      u[i] /= uNorm;
+      }
+    v[0] = direction[1]*u[2] - direction[2]*u[1];
+    v[1] = direction[2]*u[0] - direction[0]*u[2];
+    v[2] = direction[0]*u[1] - direction[1]*u[0];
+
+    const char* arrayNames[3] = { "hevec0", "hevec1", "hevec2" };
+    double* vectors[3] = { u, v, direction };
+    std::swap( vectors[directionAxis], vectors[2] );
+
+    unsigned int numberOfParticles = static_cast< unsigned int >( length/spacing ) + 1;
+    for ( unsigned int p = 0; p < numberOfParticles; p++ )
+      {
+      double point[3];
+      for ( unsigned int i = 0; i < 3; i++ )
+        {
+        point[i] = segment.start[i] + p*spacing*direction[i] + 0.1*spacing*random.GetNormal();
+        }
+      particles->GetPoints()->InsertNextPoint( point );
+
+      float scale = static_cast< float >( segment.radius );
+      particles->GetPointData()->GetArray( "scale" )->InsertNextTuple( &scale );
+      for ( unsigned int a = 0; a < 3; a++ )
+        {
+        particles->GetPointData()->GetArray( arrayNames[a] )->InsertNextTuple( vectors[a] );
+        }
+      }
+  }
+
+
+  vtkSmartPointer< vtkPolyData > NewParticles()
+  {
+    vtkSmartPointer< vtkPolyData > particles = vtkSmartPointer< vtkPolyData >::New();
+    vtkSmartPointer< vtkPoints > points = vtkSmartPointer< vtkPoints >::New();
+    particles->SetPoints( points );
+
+    vtkSmartPointer< vtkFloatArray > scale = vtkSmartPointer< vtkFloatArray >::New();
+      scale->SetName( "scale" );
+      scale->SetNumberOfComponents( 1 );
+    particles->GetPointData()->AddArray( scale );
+
+    const char* arrayNames[3] = { "hevec0", "hevec1", "hevec2" };
+    for ( unsigned int a = 0; a < 3; a++ )
+      {
+      vtkSmartPointer< vtkFloatArray > vectors = vtkSmartPointer< vtkFloatArray >::New();
+        vectors->SetName( arrayNames[a] );
+        vectors->SetNumberOfComponents( 3 );
+      particles->GetPointData()->AddArray( vectors );
+      }
+
+    return particles;
+  }
+
+
+  // Oblique fissures run from low and anterior to high and posterior;
+  // the horizontal fissure is nearly flat
+  double GetObliqueFissureHeight( double y )
+  {
+    return 150.0 + 0.9*( y - 150.0 );
+  }
+
+  double GetHorizontalFissureHeight( double x )
+  {
+    return 175.0 + 0.05*( x - 100.0 );
+  }
+
+
+  // Sample a fissure surface z = height(x, y) inside a lung on a grid
+  // with the given spacing. The particles' "hevec2" is the surface
+  // normal.
+  void AddFissureParticles( const ELLIPSOID& lung, bool horizontal, double spacing, RandomNumbers& random,
+                            vtkPolyData* particles, std::vector< cip::PointType >& fissurePoints )
+  {
+    for ( double y = lung.center[1] - lung.radii[1]; y <= lung.center[1] + lung.radii[1]; y += spacing )
+      {
+      for ( double x = lung.center[0] - lung.radii[0]; x <= lung.center[0] + lung.radii[0]; x += spacing )
+        {
+        double point[3];
+          point[0] = x + 0.1*spacing*random.GetNormal();
+          point[1] = y + 0.1*spacing*random.GetNormal();
+
+        double normal[3] = { 0.0, 0.0, 1.0 };
+        if ( horizontal )
+          {
+          point[2] = GetHorizontalFissureHeight( point[0] );
+          normal[0] = -0.05;
+          if ( point[2] < GetObliqueFissureHeight( point[1] ) )
+            {
+            continue;
+            }
+          }
+        else
+          {
+          point[2] = GetObliqueFissureHeight( point[1] );
+          normal[1] = -0.9;
+          }
+        if ( !IsInsideEllipsoid( lung, point, 1.0 ) )
+          {
+          continue;
+          }
+
+        double norm = std::sqrt( normal[0]*normal[0] + normal[1]*normal[1] + normal[2]*normal[2] );
+        for ( unsigned int i = 0; i < 3; i++ )
+          {
+          normal[i] /= norm;
+          }
+
+        // Any two vectors in the surface will do for the other axes
+        double uNorm = std::sqrt( normal[0]*normal[0] + normal[2]*normal[2] );
+        double u[3] = { normal[2]/uNorm, 0.0, -normal[0]/uNorm };
+        double v[3] = { normal[1]*u[2] - normal[2]*u[1], normal[2]*u[0] - normal[0]*u[2], normal[0]*u[1] - normal[1]*u[0] };
+        float  scale = 1.0f;
+
+        particles->GetPoints()->InsertNextPoint( point );
+        particles->GetPointData()->GetArray( "scale" )->InsertNextTuple( &scale );
+        particles->GetPointData()->GetArray( "hevec0" )->InsertNextTuple( u );
+        particles->GetPointData()->GetArray( "hevec1" )->InsertNextTuple( v );
+        particles->GetPointData()->GetArray( "hevec2" )->InsertNextTuple( normal );
+
+        cip::PointType fissurePoint( point, point + 3 );
+        fissurePoints.push_back( fissurePoint );
+        }
+      }
+  }
+}
+
+
+void cip::GenerateBenchmarkPhantom( const unsigned int size[3], unsigned int numberOfVesselBranches,
+                                    double particleSpacing, BenchmarkPhantom& phantom )
+{
+  cip::ChestConventions conventions;
+
+  RandomNumbers random( 20140601u );
+
+  cip::CTType::SizeType    imageSize;
+  cip::CTType::SpacingType spacing;
+  cip::CTType::PointType   origin;
+  for ( unsigned int i = 0; i < 3; i++ )
+    {
+    imageSize[i] = size[i];
+    spacing[i]   = PHANTOMEXTENT[i]/static_cast< double >( size[i] );
+    origin[i]    = 0.0;
+    }
+
+  phantom.ct = cip::CTType::New();
+    phantom.ct->SetRegions( imageSize );
+    phantom.ct->SetSpacing( spacing );
+    phantom.ct->SetOrigin( origin );
+    phantom.ct->Allocate();
+
+  phantom.labelMap = cip::LabelMapType::New();
+    phantom.labelMap->SetRegions( imageSize );
+    phantom.labelMap->SetSpacing( spacing );
+    phantom.labelMap->SetOrigin( origin );
+    phantom.labelMap->Allocate();
+
+  // The patient's right lung is on the image's left (LPS)
+  ELLIPSOID lungs[2] = { { { 100.0, 150.0, 150.0 }, { 55.0, 85.0, 125.0 } },
+                         { { 240.0, 150.0, 150.0 }, { 50.0, 80.0, 120.0 } } };
+  unsigned short lungValues[2];
+    lungValues[0] = conventions.GetValueFromChestRegionAndType( static_cast< unsigned char >( cip::RIGHTLUNG ),
+                                                                static_cast< unsigned char >( cip::UNDEFINEDTYPE ) );
+    lungValues[1] = conventions.GetValueFromChestRegionAndType( static_cast< unsigned char >( cip::LEFTLUNG ),
+                                                                static_cast< unsigned char >( cip::UNDEFINEDTYPE ) );
+
+  short*          ct       = phantom.ct->GetBufferPointer();
+  unsigned short* labelMap = phantom.labelMap->GetBufferPointer();
+
+  unsigned int index = 0;
+  double point[3];
+  for ( unsigned int z = 0; z < size[2]; z++ )
+    {
+    point[2] = z*spacing[2];
+    for ( unsigned int y = 0; y < size[1]; y++ )
+      {
+      point[1] = y*spacing[1];
+      for ( unsigned int x = 0; x < size[0]; x++, index++ )
+        {
+        point[0] = x*spacing[0];
+
+        double bx = ( point[0] - 170.0 )/160.0;
+        double by = ( point[1] - 150.0 )/125.0;
+
+        ct[index]       = ( bx*bx + by*by <= 1.0 ) ? TISSUEINTENSITY : AIRINTENSITY;
+        labelMap[index] = 0;
+        for ( unsigned int l = 0; l < 2; l++ )
+          {
+          if ( IsInsideEllipsoid( lungs[l], point, 1.0 ) )
+            {
+            ct[index]       = LUNGINTENSITY;
+            labelMap[index] = lungValues[l];
+            }
+          }
+        }
+      }
+    }
+
+  // The airway tree: trachea, main bronchi and a few branches per lung
+  std::vector< SEGMENT > airways;
+
+  SEGMENT trachea = { { 170.0, 150.0, PHANTOMEXTENT[2] }, { 170.0, 150.0, 200.0 }, 9.0 };
+  airways.push_back( trachea );
+
+  for ( unsigned int l = 0; l < 2; l++ )
+    {
+    double side = ( l == 0 ) ? 1.0 : -1.0;
+
+    SEGMENT bronchus = { { 170.0, 150.0, 200.0 },
+                         { lungs[l].center[0] + side*0.4*lungs[l].radii[0], 150.0, 170.0 }, 6.0 };
+    airways.push_back( bronchus );
+
+    for ( unsigned int b = 0; b < 4; b++ )
+      {
+      SEGMENT branch;
+        std::copy( bronchus.end, bronchus.end + 3, branch.start );
+        GetRandomPointInEllipsoid( lungs[l], 0.7, random, branch.end );
+        branch.radius = 3.0;
+      airways.push_back( branch );
+      }
+    }
+
+  // Vessels branch from each hilum; every branch has one child
+  std::vector< SEGMENT > vessels;
+  for ( unsigned int l = 0; l < 2; l++ )
+    {
+    double side = ( l == 0 ) ? 1.0 : -1.0;
+    double hilum[3] = { lungs[l].center[0] + side*0.6*lungs[l].radii[0], 160.0, 160.0 };
+
+    for ( unsigned int b = 0; b < numberOfVesselBranches; b++ )
+      {
+      SEGMENT vessel;
+        std::copy( hilum, hilum + 3, vessel.start );
+        GetRandomPointInEllipsoid( lungs[l], 0.85, random, vessel.end );
+        vessel.radius = 1.5 + 2.5*random.GetUniform();
+      vessels.push_back( vessel );
+
+      double t = 0.4 + 0.4*random.GetUniform();
+
+      SEGMENT child;
+      for ( unsigned int i = 0; i < 3; i++ )
+        {
+        child.start[i] = vessel.start[i] + t*( vessel.end[i] - vessel.start[i] );
+        }
+      GetRandomPointInEllipsoid( lungs[l], 0.85, random, child.end );
+      child.radius = 0.6*vessel.radius;
+      vessels.push_back( child );
+      }
+    }
+
+  // Airway walls go in first so that no wall covers another airway's
+  // lumen
+  for ( unsigned int i = 0; i < airways.size(); i++ )
+    {
+    PaintSegment( phantom, airways[i], 1.5*airways[i].radius, TISSUEINTENSITY,
+                  static_cast< unsigned char >( cip::UNDEFINEDTYPE ), true );
+    }
+  for ( unsigned int i = 0; i < airways.size(); i++ )
+    {
+    PaintSegment( phantom, airways[i], airways[i].radius, AIRINTENSITY,
+                  static_cast< unsigned char >( cip::AIRWAY ), false );
+    }
+  for ( unsigned int i = 0; i < vessels.size(); i++ )
+    {
+    PaintSegment( phantom, vessels[i], vessels[i].radius, TISSUEINTENSITY,
+                  static_cast< unsigned char >( cip::VESSEL ), true );
+    }
+
+  for ( unsigned int i = 0; i < phantom.ct->GetBufferedRegion().GetNumberOfPixels(); i++ )
+    {
+    double value = static_cast< double >( ct[i] ) + NOISESIGMA*random.GetNormal();
+    ct[i] = static_cast< short >( std::max( -1024.0, std::min( 3071.0, value ) ) );
+    }
+
+  cip::CTType::PointType seedPoint;
+    seedPoint[0] = 170.0;
+    seedPoint[1] = 150.0;
+    seedPoint[2] = PHANTOMEXTENT[2] - 20.0;
+  phantom.ct->TransformPhysicalPointToIndex( seedPoint, phantom.tracheaSeed );
+
+  phantom.airwayParticles = NewParticles();
+  for ( unsigned int i = 0; i < airways.size(); i++ )
+    {
+    AddSegmentParticles( airways[i], particleSpacing, 2, random, phantom.airwayParticles );
+    }
+
+  phantom.vesselParticles = NewParticles();
+  for ( unsigned int i = 0; i < vessels.size(); i++ )
+    {
+    AddSegmentParticles( vessels[i], particleSpacing, 0, random, phantom.vesselParticles );
+    }
+
+  phantom.leftObliqueFissurePoints.clear();
+  phantom.rightObliqueFissurePoints.clear();
+  phantom.rightHorizontalFissurePoints.clear();
+
+  phantom.fissureParticles = NewParticles();
+  AddFissureParticles( lungs[1], false, particleSpacing, random, phantom.fissureParticles, phantom.leftObliqueFissurePoints );
+  AddFissureParticles( lungs[0], false, particleSpacing, random, phantom.fissureParticles, phantom.rightObliqueFissurePoints );
+  AddFissureParticles( lungs[0], true,  particleSpacing, random, phantom.fissureParticles, phantom.rightHorizontalFissurePoints );
+}
@@ -0,0 +1,52 @@
+/**
+ *  \file cipBenchmarkPhantom
+ *  \ingroup benchmarks
+ *  \brief Synthetic chest CT phantoms used by cip_benchmarks.
+ *
+ *  A phantom has the same physical extent (340 x 300 x 300 mm) at every
+ *  size; only the number of voxels and the number of vessel branches
+ *  change. It contains an elliptical body, two ellipsoidal lungs, a
+ *  trachea branching into both lungs and a tree of vessels in each
+ *  lung, with Gaussian noise added to the CT. The label map labels the
+ *  left and right lungs and the airways and vessels inside them. The
+ *  particle data sets are sampled along the airway and vessel
+ *  centerlines and on the three fissures, with the point data arrays
+ *  the particle filters expect ("scale", "hevec0", "hevec1", "hevec2").
+ *
+ *  Everything is generated from a fixed random seed, so a given size
+ *  always produces exactly the same phantom.
+ */
+
+#ifndef __cipBenchmarkPhantom_h
+#define __cipBenchmarkPhantom_h
+
+#include "cipChestConventions.h"
+#include "cipHelper.h"
+#include "vtkPolyData.h"
+#include "vtkSmartPointer.h"
+
+#include <vector>
+
+namespace cip
+{
+  struct BenchmarkPhantom
+  {
+    cip::CTType::Pointer                   ct;
+    cip::LabelMapType::Pointer             labelMap;
+    cip::LabelMapType::IndexType           tracheaSeed;
+    vtkSmartPointer< vtkPolyData >         airwayParticles;
+    vtkSmartPointer< vtkPolyData >         vesselParticles;
+    vtkSmartPointer< vtkPolyData >         fissureParticles;
+    std::vector< cip::PointType >          leftObliqueFissurePoints;
+    std::vector< cip::PointType >          rightObliqueFissurePoints;
+    std::vector< cip::PointType >          rightHorizontalFissurePoints;
+  };
+
+  /** Generate a phantom with the given number of voxels along each axis
+   *  and the given number of vessel branches per lung. 'particleSpacing'
+   *  is the distance between consecutive particles, in mm. */
+  void GenerateBenchmarkPhantom( const unsigned int size[3], unsigned int numberOfVesselBranches,
+                                 double particleSpacing, BenchmarkPhantom& phantom );
+}
+
+#endif
@@ -0,0 +1,705 @@
+/** \file
+ *  \ingroup benchmarks
+ *  \details This program times the computationally heavy parts of CIP
+ *  on synthetic lung phantoms (see cipBenchmarkPhantom.h) of one or
+ *  more sizes and writes the results as JSON. Each benchmark is run
+ *  several times and the median and minimum wall clock times are
+ *  reported. Phantom generation is not timed, and neither is file IO,
+ *  except in the phenotype benchmark (see below).
+ *
+ *  When a baseline (the JSON written by an earlier run) is given with
+ *  --compare, every benchmark is compared with its baseline median and
+ *  the program exits with a non-zero code if any of them is slower by
+ *  more than the tolerance, or if a baseline benchmark of the sizes and
+ *  filter that were run has no result. The baseline should come from the
+ *  same machine and number of threads.
+ *
+ *  The phenotype benchmark times a whole run of the
+ *  GenerateRegionHistogramsAndParenchymaPhenotypes executable, including
+ *  process startup and the reading and writing of its files. It is
+ *  skipped if that tool has not been built, and the program exits with a
+ *  non-zero code if the tool fails (as it does if any benchmark fails).
+ *
+ *  USAGE:
+ *
+ *  cip_benchmarks [--sizes small,medium,large] [--repetitions <int>]
+ *                 [--filter <string>] [--threads <int>]
+ *                 [--output <json file>] [--compare <json file>]
+ *                 [--tolerance <double>] [--scratchDir <directory>]
+ *                 [--list]
+ */
+
+#include "cipBenchmarkPhantom.h"
+#include "cipChestConventions.h"
+#include "cipHelper.h"
+#include "cipThinPlateSplineSurface.h"
+#include "cipAirwayParticleConnectedComponentFilter.h"
+#include "cipVesselParticleConnectedComponentFilter.h"
+#include "cipFissureParticleConnectedComponentFilter.h"
+#include "cipLabelMapToLungLobeLabelMapImageFilter.h"
+#include "itkCIPAutoThresholdAirwaySegmentationImageFilter.h"
+#include "itkCIPPartialLungLabelMapImageFilter.h"
+#include "itkMultiScaleGaussianEnhancementImageFilter.h"
+#include "itkFrangiVesselnessFunctor.h"
+#include "itkPFNLMFilter.h"
+#include "itkMultiThreader.h"
+#include "itkTimeProbe.h"
+#include <itksys/SystemTools.hxx>
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+namespace
+{
+  struct BENCHMARKSIZE
+  {
+    const char*   name;
+    unsigned int  size[3];
+    unsigned int  numberOfVesselBranches;
+    double        particleSpacing;
+  };
+
+  const BENCHMARKSIZE BENCHMARKSIZES[] = {
+    { "small",  { 128, 128, 112 },  8, 3.0 },
+    { "medium", { 256, 256, 224 }, 24, 2.0 },
+    { "large",  { 512, 512, 448 }, 64, 1.5 } };
+
+  const unsigned int NUMBEROFBENCHMARKSIZES = 3;
+
+  struct BENCHMARKCONTEXT
+  {
+    const cip::BenchmarkPhantom*  phantom;
+    const BENCHMARKSIZE*          size;
+    std::string                   scratchPrefix;
+  };
+
+  // A benchmark returns the time taken by its timed part, in seconds,
+  // BENCHMARKSKIPPED if it cannot be run in this build, or
+  // BENCHMARKFAILED if it was run and failed
+  typedef double (*BenchmarkFunctionType)( const BENCHMARKCONTEXT& );
+
+  const double BENCHMARKSKIPPED = -1.0;
+  const double BENCHMARKFAILED  = -2.0;
+
+  struct BENCHMARK
+  {
+    const char*            name;
+    BenchmarkFunctionType  function;
+  };
+
+  struct BENCHMARKRESULT
+  {
+    std::string   name;
+    std::string   size;
+    unsigned int  numberOfVoxels;
+    unsigned int  repetitions;
+    double        median;
+    double        minimum;
+  };
+
+
+  double TimeAutoThresholdAirwaySegmentation( const BENCHMARKCONTEXT& context )
+  {
+    typedef itk::CIPAutoThresholdAirwaySegmentationImageFilter< cip::CTType > SegmentationType;
+
+    SegmentationType::Pointer segmenter = SegmentationType::New();
+      segmenter->SetInput( context.phantom->ct );
+      segmenter->AddSeed( context.phantom->tracheaSeed );
+      segmenter->SetMinIntensityThreshold( -1024 );
+      segmenter->SetMaxIntensityThreshold( -800 );
+
+    itk::TimeProbe probe;
+    probe.Start();
+    segmenter->Update();
+    probe.Stop();
+
+    return probe.GetTotal();
+  }
+
+
+  double TimePartialLungLabelMap( const BENCHMARKCONTEXT& context )
+  {
+    typedef itk::CIPPartialLungLabelMapImageFilter< cip::CTType > PartialLungType;
+
+    PartialLungType::Pointer partialLung = PartialLungType::New();
+      partialLung->SetInput( context.phantom->ct );
+      partialLung->SetAirwayMinIntensityThreshold( -1024 );
+      partialLung->SetAirwayMaxIntensityThreshold( -800 );
+
+    itk::TimeProbe probe;
+    probe.Start();
+    partialLung->Update();
+    probe.Stop();
+
+    return probe.GetTotal();
+  }
+
+
+  double TimeLungLobeLabelMap( const BENCHMARKCONTEXT& context )
+  {
+    cipLabelMapToLungLobeLabelMapImageFilter::Pointer lobeSegmenter = cipLabelMapToLungLobeLabelMapImageFilter::New();
+      lobeSegmenter->SetInput( context.phantom->labelMap );
+      lobeSegmenter->SetLeftObliqueFissurePoints( context.phantom->leftObliqueFissurePoints );
+      lobeSegmenter->SetRightObliqueFissurePoints( context.phantom->rightObliqueFissurePoints );
+      lobeSegmenter->SetRightHorizontalFissurePoints( context.phantom->rightHorizontalFissurePoints );
+
+    itk::TimeProbe probe;
+    probe.Start();
+    lobeSegmenter->Update();
+    probe.Stop();
+
+    return probe.GetTotal();
+  }
+
+
+  double TimeAirwayParticleConnectedComponents( const BENCHMARKCONTEXT& context )
+  {
+    cipAirwayParticleConnectedComponentFilter filter;
+      filter.SetInterParticleSpacing( context.size->particleSpacing );
+      filter.SetParticleDistanceThreshold( 2.0*context.size->particleSpacing );
+      filter.SetParticleAngleThreshold( 20.0 );
+      filter.SetComponentSizeThreshold( 0 );
+      filter.SetInput( context.phantom->airwayParticles );
+
+    itk::TimeProbe probe;
+    probe.Start();
+    filter.Update();
+    probe.Stop();
+
+    return probe.GetTotal();
+  }
+
+
+  double TimeVesselParticleConnectedComponents( const BENCHMARKCONTEXT& context )
+  {
+    cipVesselParticleConnectedComponentFilter filter;
+      filter.SetInterParticleSpacing( context.size->particleSpacing );
+      filter.SetParticleDistanceThreshold( 2.0*context.size->particleSpacing );
+      filter.SetParticleAngleThreshold( 20.0 );
+      filter.SetComponentSizeThreshold( 0 );
+      filter.SetInput( context.phantom->vesselParticles );
+
+    itk::TimeProbe probe;
+    probe.Start();
+    filter.Update();
+    probe.Stop();
+
+    return probe.GetTotal();
+  }
+
+
+  double TimeFissureParticleConnectedComponents( const BENCHMARKCONTEXT& context )
+  {
+    cipFissureParticleConnectedComponentFilter filter;
+      filter.SetInterParticleSpacing( context.size->particleSpacing );
+      filter.SetParticleDistanceThreshold( 2.0*context.size->particleSpacing );
+      filter.SetParticleAngleThreshold( 70.0 );
+      filter.SetComponentSizeThreshold( 10 );
+      filter.SetInput( context.phantom->fissureParticles );
+
+    itk::TimeProbe probe;
+    probe.Start();
+    filter.Update();
+    probe.Stop();
+
+    return probe.GetTotal();
+  }
+
+
+  double TimeMultiScaleGaussianEnhancement( const BENCHMARKCONTEXT& context )
+  {
+    typedef itk::Image< double, 3 >                                                            OutputImageType;
+    typedef itk::MultiScaleGaussianEnhancementImageFilter< cip::CTType, OutputImageType >     MultiScaleFilterType;
+    typedef itk::Functor::FrangiVesselnessFunctor< MultiScaleFilterType::EigenValueArrayType,
+                                                   OutputImageType::PixelType >               FunctorType;
+
+    FunctorType::Pointer functor = FunctorType::New();
+      functor->SetAlpha( 0.5 );
+      functor->SetBeta( 0.5 );
+      functor->SetC( 0.5 );
+      functor->SetBrightObject( true );
+
+    MultiScaleFilterType::Pointer multiScaleFilter = MultiScaleFilterType::New();
+      multiScaleFilter->SetInput( context.phantom->ct );
+      multiScaleFilter->SetUnaryFunctor( functor );
+      multiScaleFilter->SetSigmaMinimum( 1.0 );
+      multiScaleFilter->SetSigmaMaximum( 3.0 );
+      multiScaleFilter->SetNumberOfSigmaSteps( 3 );
+      multiScaleFilter->SetSigmaStepMethodToEquispaced();
+
+    itk::TimeProbe probe;
+    probe.Start();
+    multiScaleFilter->Update();
+    probe.Stop();
+
+    return probe.GetTotal();
+  }
+
+
+  double TimePFNLMFilter( const BENCHMARKCONTEXT& context )
+  {
+    typedef itk::PFNLMFilter< cip::CTType, cip::CTType > FilterType;
+
+    // A smaller search radius than GenerateNLMFilteredImage's default
+    // (3, 3, 3) keeps the larger phantoms within minutes
+    FilterType::InputImageSizeType searchRadius;
+    FilterType::InputImageSizeType comparisonRadius;
+    searchRadius.Fill( 2 );
+    comparisonRadius.Fill( 1 );
+
+    FilterType::Pointer filter = FilterType::New();
+      filter->SetInput( context.phantom->ct );
+      filter->SetSigma( 5.0 );
+      filter->SetRSearch( searchRadius );
+      filter->SetRComp( comparisonRadius );
+      filter->SetH( 1.0 );
+      filter->SetPSTh( 2.0 );
+
+    itk::TimeProbe probe;
+    probe.Start();
+    filter->Update();
+    probe.Stop();
+
+    return probe.GetTotal();
+  }
+
+
+  double TimeThinPlateSplineFit( const BENCHMARKCONTEXT& context )
+  {
+    std::vector< cip::PointType > points = context.phantom->leftObliqueFissurePoints;
+    points.insert( points.end(), context.phantom->rightObliqueFissurePoints.begin(),
+                   context.phantom->rightObliqueFissurePoints.end() );
+
+    itk::TimeProbe probe;
+    probe.Start();
+
+    cipThinPlateSplineSurface tps;
+      tps.SetLambda( 0.1 );
+      tps.SetSurfacePoints( points );
+
+    // Evaluate the fitted surface on a 1 mm grid, as the lobe
+    // segmentation does for every voxel column
+    double sum = 0.0;
+    for ( double y = 60.0; y < 240.0; y += 1.0 )
+      {
+      for ( double x = 40.0; x < 300.0; x += 1.0 )
+        {
+        sum += tps.GetSurfaceHeight( x, y );
+        }
+      }
+    probe.Stop();
+
+    // Keep the evaluation from being optimized away
+    if ( sum != sum )
+      {
+      std::cerr << "Invalid thin plate spline surface" << std::endl;
+      }
+
+    return probe.GetTotal();
+  }
+
+
+  double TimeParenchymaPhenotypes( const BENCHMARKCONTEXT& context )
+  {
+    std::string toolName = std::string( CIP_BENCHMARKS_TOOLS_DIRECTORY ) +
+      "/GenerateRegionHistogramsAndParenchymaPhenotypes";
+    std::string toolPath = itksys::SystemTools::FindProgram( toolName.c_str() );
+    if ( toolPath.empty() )
+      {
+      return BENCHMARKSKIPPED;
+      }
+
+    std::string ctFileName        = context.scratchPrefix + "ct.nrrd";
+    std::string labelMapFileName  = context.scratchPrefix + "lm.nrrd";
+    std::string histogramFileName = context.scratchPrefix + "histograms.csv";
+    std::string phenotypeFileName = context.scratchPrefix + "phenotypes.csv";
+
+    if ( !itksys::SystemTools::FileExists( ctFileName.c_str() ) )
+      {
+      cip::CTWriterType::Pointer ctWriter = cip::CTWriterType::New();
+        ctWriter->SetFileName( ctFileName );
+        ctWriter->SetInput( context.phantom->ct );
+        ctWriter->Update();
+
+      cip::LabelMapWriterType::Pointer labelMapWriter = cip::LabelMapWriterType::New();
+        labelMapWriter->SetFileName( labelMapFileName );
+        labelMapWriter->SetInput( context.phantom->labelMap );
+        labelMapWriter->Update();
+      }
+
+    std::string command = "\"" + toolPath + "\" --ic \"" + ctFileName + "\" --ipl \"" + labelMapFileName +
+      "\" --oh \"" + histogramFileName + "\" --op \"" + phenotypeFileName + "\"";
+
+    itk::TimeProbe probe;
+    probe.Start();
+    int returnCode = std::system( command.c_str() );
+    probe.Stop();
+
+    itksys::SystemTools::RemoveFile( histogramFileName.c_str() );
+    itksys::SystemTools::RemoveFile( phenotypeFileName.c_str() );
+
+    if ( returnCode != 0 )
+      {
+      std::cerr << "Command failed with code " << returnCode << ": " << command << std::endl;
+      return BENCHMARKFAILED;
+      }
+
+    return probe.GetTotal();
+  }
+
+
+  const BENCHMARK BENCHMARKS[] = {
+    { "AutoThresholdAirwaySegmentation",     TimeAutoThresholdAirwaySegmentation },
+    { "PartialLungLabelMap",                 TimePartialLungLabelMap },
+    { "LungLobeLabelMap",                    TimeLungLobeLabelMap },
+    { "AirwayParticleConnectedComponents",   TimeAirwayParticleConnectedComponents },
+    { "VesselParticleConnectedComponents",   TimeVesselParticleConnectedComponents },
+    { "FissureParticleConnectedComponents",  TimeFissureParticleConnectedComponents },
+    { "MultiScaleGaussianEnhancement",       TimeMultiScaleGaussianEnhancement },
+    { "PFNLMFilter",                         TimePFNLMFilter },
+    { "ThinPlateSplineFit",                  TimeThinPlateSplineFit },
+    { "ParenchymaPhenotypes",                TimeParenchymaPhenotypes } };
+
+  const unsigned int NUMBEROFBENCHMARKS = sizeof( BENCHMARKS )/sizeof( BENCHMARK );
+
+
+  void WriteResults( std::ostream& os, const std::vector< BENCHMARKRESULT >& results, unsigned int numberOfThreads )
+  {
+    os << "{" << std::endl;
+    os << "  \"version\": 1," << std::endl;
+    os << "  \"threads\": " << numberOfThreads << "," << std::endl;
+    os << "  \"benchmarks\": [" << std::endl;
+    for ( unsigned int i = 0; i < results.size(); i++ )
+      {
+      os << "    { \"name\": \"" << results[i].name << "\", \"size\": \"" << results[i].size
+         << "\", \"voxels\": " << results[i].numberOfVoxels << ", \"repetitions\": " << results[i].repetitions
+         << ", \"median\": " << std::setprecision( 6 ) << results[i].median
+         << ", \"min\": " << results[i].minimum << " }" << ( i + 1 < results.size() ? "," : "" ) << std::endl;
+      }
+    os << "  ]" << std::endl;
+    os << "}" << std::endl;
+  }
+
+
+  // Reads the "name", "size" and "median" of every benchmark in a file
+  // written by WriteResults. This is not a general JSON parser.
+  bool ReadBaseline( const std::string& fileName, std::map< std::string, double >& medians )
+  {
+    std::ifstream file( fileName.c_str() );
+    if ( !file )
+      {
+      std::cerr << "Could not open baseline " << fileName << std::endl;
+      return false;
+      }
+
+    std::stringstream contents;
+    contents << file.rdbuf();
+    std::string json = contents.str();
+
+    std::string::size_type start = json.find( "\"benchmarks\"" );
+    while ( start != std::string::npos && ( start = json.find( '{', start ) ) != std::string::npos )
+      {
+      std::string::size_type end = json.find( '}', start );
+      if ( end == std::string::npos )
+        {
+        break;
+        }
+      std::string object = json.substr( start, end - start );
+
+      std::map< std::string, std::string > fields;
+      const char* keys[3] = { "name", "size", "median" };
+      for ( unsigned int k = 0; k < 3; k++ )
+        {
+        std::string::size_type key = object.find( std::string( "\"" ) + keys[k] + "\"" );
+        if ( key == std::string::npos )
+          {
+          continue;
+          }
+        std::string::size_type value = object.find( ':', key ) + 1;
+        std::string::size_type valueEnd = object.find_first_of( ",}", value );
+        std::string text = object.substr( value, valueEnd == std::string::npos ? std::string::npos : valueEnd - value );
+
+        std::string::size_type first = text.find_first_not_of( " \t\r\n\"" );
+        std::string::size_type last  = text.find_last_not_of( " \t\r\n\"" );
+        fields[keys[k]] = ( first == std::string::npos ) ? "" : text.substr( first, last - first + 1 );
+        }
+
+      if ( fields.size() == 3 )
+        {
+        medians[fields["name"] + "/" + fields["size"]] = std::atof( fields["median"].c_str() );
+        }
+
+      start = end;
+      }
+
+    return true;
+  }
+
+
+  // Prints how each result compares with its baseline. Returns false if
+  // any benchmark is slower by more than 'tolerance' (a fraction), or if
+  // a baseline benchmark of the sizes and filter that were run has no
+  // result.
+  bool CompareWithBaseline( const std::vector< BENCHMARKRESULT >& results,
+                            const std::map< std::string, double >& baseline, double tolerance,
+                            const std::vector< std::string >& sizesRun, const std::string& filter )
+  {
+    bool passed = true;
+
+    std::cout << std::endl;
+    std::cout << std::left << std::setw( 48 ) << "Benchmark" << std::right << std::setw( 12 ) << "Baseline (s)"
+              << std::setw( 12 ) << "Current (s)" << std::setw( 10 ) << "Ratio" << "  Status" << std::endl;
+    for ( unsigned int i = 0; i < results.size(); i++ )
+      {
+      std::string key = results[i].name + "/" + results[i].size;
+
+      std::cout << std::left << std::setw( 48 ) << key << std::right << std::fixed << std::setprecision( 3 );
+
+      std::map< std::string, double >::const_iterator it = baseline.find( key );
+      if ( it == baseline.end() || it->second <= 0.0 )
+        {
+        std::cout << std::setw( 12 ) << "-" << std::setw( 12 ) << results[i].median << std::setw( 10 ) << "-"
+                  << "  new" << std::endl;
+        continue;
+        }
+
+      double ratio = results[i].median/it->second;
+
+      std::string status = "ok";
+      if ( ratio > 1.0 + tolerance )
+        {
+        status = "REGRESSION";
+        passed = false;
+        }
+      else if ( ratio < 1.0 - tolerance )
+        {
+        status = "faster";
+        }
+
+      std::cout << std::setw( 12 ) << it->second << std::setw( 12 ) << results[i].median
+                << std::setw( 10 ) << ratio << "  " << status << std::endl;
+      }
+
+    std::map< std::string, double >::const_iterator it;
+    for ( it = baseline.begin(); it != baseline.end(); ++it )
+      {
+      std::string::size_type slash = it->first.rfind( '/' );
+      std::string name = it->first.substr( 0, slash );
+      std::string size = ( slash == std::string::npos ) ? "" : it->first.substr( slash + 1 );
+      if ( std::find( sizesRun.begin(), sizesRun.end(), size ) == sizesRun.end() ||
+           name.find( filter ) == std::string::npos )
+        {
+        continue;
+        }
+
+      bool found = false;
+      for ( unsigned int i = 0; i < results.size() && !found; i++ )
+        {
+        found = ( results[i].name + "/" + results[i].size == it->first );
+        }
+      if ( !found )
+        {
+        std::cout << std::left << std::setw( 48 ) << it->first << std::right << std::setw( 12 ) << it->second
+                  << std::setw( 12 ) << "-" << std::setw( 10 ) << "-" << "  MISSING" << std::endl;
+        passed = false;
+        }
+      }
+    std::cout.unsetf( std::ios::fixed );
+
+    return passed;
+  }
+
+
+  void PrintUsage()
+  {
+    std::cout << "Usage: cip_benchmarks [--sizes small,medium,large] [--repetitions <int>]" << std::endl;
+    std::cout << "                      [--filter <string>] [--threads <int>]" << std::endl;
+    std::cout << "                      [--output <json file>] [--compare <json file>]" << std::endl;
+    std::cout << "                      [--tolerance <double>] [--scratchDir <directory>] [--list]" << std::endl;
+  }
+}
+
+
+int main( int argc, char* argv[] )
+{
+  std::string  sizes            = "small,medium";
+  unsigned int repetitions      = 3;
+  std::string  filter           = "";
+  unsigned int numberOfThreads  = 0;
+  std::string  outputFileName   = "";
+  std::string  baselineFileName = "";
+  double       tolerance        = 0.15;
+  std::string  scratchDirectory = ".";
+
+  for ( int i = 1; i < argc; i++ )
+    {
+    std::string argument = argv[i];
+    if ( argument == "--list" )
+      {
+      for ( unsigned int b = 0; b < NUMBEROFBENCHMARKS; b++ )
+        {
+        std::cout << BENCHMARKS[b].name << std::endl;
+        }
+      return cip::EXITSUCCESS;
+      }
+    if ( argument == "-h" || argument == "--help" || i + 1 >= argc )
+      {
+      PrintUsage();
+      return ( argument == "-h" || argument == "--help" ) ? cip::EXITSUCCESS : cip::EXITFAILURE;
+      }
+
+    std::string value = argv[++i];
+    if ( argument == "--sizes" )
+      {
+      sizes = value;
+      }
+    else if ( argument == "--repetitions" )
+      {
+      repetitions = std::max( 1, std::atoi( value.c_str() ) );
+      }
+    else if ( argument == "--filter" )
+      {
+      filter = value;
+      }
+    else if ( argument == "--threads" )
+      {
+      numberOfThreads = std::max( 0, std::atoi( value.c_str() ) );
+      }
+    else if ( argument == "--output" )
+      {
+      outputFileName = value;
+      }
+    else if ( argument == "--compare" )
+      {
+      baselineFileName = value;
+      }
+    else if ( argument == "--tolerance" )
+      {
+      tolerance = std::atof( value.c_str() );
+      }
+    else if ( argument == "--scratchDir" )
+      {
+      scratchDirectory = value;
+      }
+    else
+      {
+      PrintUsage();
+      return cip::EXITFAILURE;
+      }
+    }
+
+  if ( numberOfThreads > 0 )
+    {
+    itk::MultiThreader::SetGlobalDefaultNumberOfThreads( numberOfThreads );
+    }
+  numberOfThreads = itk::MultiThreader::GetGlobalDefaultNumberOfThreads();
+
+  std::map< std::string, double > baseline;
+  if ( !baselineFileName.empty() && !ReadBaseline( baselineFileName, baseline ) )
+    {
+    return cip::EXITFAILURE;
+    }
+
+  std::vector< BENCHMARKRESULT > results;
+  std::vector< std::string >     sizesRun;
+  bool                           failed = false;
+
+  for ( unsigned int s = 0; s < NUMBEROFBENCHMARKSIZES; s++ )
+    {
+    const BENCHMARKSIZE& size = BENCHMARKSIZES[s];
+    if ( ( "," + sizes + "," ).find( std::string( "," ) + size.name + "," ) == std::string::npos )
+      {
+      continue;
+      }
+
+    sizesRun.push_back( size.name );
+
+    std::cout << "Generating " << size.name << " phantom (" << size.size[0] << " x " << size.size[1]
+              << " x " << size.size[2] << ")..." << std::endl;
+    cip::BenchmarkPhantom phantom;
+    cip::GenerateBenchmarkPhantom( size.size, size.numberOfVesselBranches, size.particleSpacing, phantom );
+
+    BENCHMARKCONTEXT context;
+      context.phantom       = &phantom;
+      context.size          = &size;
+      context.scratchPrefix = scratchDirectory + "/cip_benchmarks_" + size.name + "_";
+
+    for ( unsigned int b = 0; b < NUMBEROFBENCHMARKS; b++ )
+      {
+      if ( std::string( BENCHMARKS[b].name ).find( filter ) == std::string::npos )
+        {
+        continue;
+        }
+
+      std::vector< double > times;
+      double                time = 0.0;
+      for ( unsigned int r = 0; r < repetitions && time >= 0.0; r++ )
+        {
+        time = BENCHMARKS[b].function( context );
+        if ( time >= 0.0 )
+          {
+          times.push_back( time );
+          }
+        }
+
+      if ( time == BENCHMARKFAILED )
+        {
+        std::cout << "  " << BENCHMARKS[b].name << ": FAILED" << std::endl;
+        failed = true;
+        continue;
+        }
+      if ( times.empty() )
+        {
+        std::cout << "  " << BENCHMARKS[b].name << ": skipped" << std::endl;
+        continue;
+        }
+
+      std::sort( times.begin(), times.end() );
+
+      BENCHMARKRESULT result;
+        result.name           = BENCHMARKS[b].name;
+        result.size           = size.name;
+        result.numberOfVoxels = size.size[0]*size.size[1]*size.size[2];
+        result.repetitions    = static_cast< unsigned int >( times.size() );
+        result.median         = times[times.size()/2];
+        result.minimum        = times[0];
+      results.push_back( result );
+
+      std::cout << "  " << result.name << ": " << result.median << " s (min " << result.minimum << " s)" << std::endl;
+      }
+
+    itksys::SystemTools::RemoveFile( ( context.scratchPrefix + "ct.nrrd" ).c_str() );
+    itksys::SystemTools::RemoveFile( ( context.scratchPrefix + "lm.nrrd" ).c_str() );
+    }
+
+  if ( outputFileName.empty() )
+    {
+    WriteResults( std::cout, results, numberOfThreads );
+    }
+  else
+    {
+    std::ofstream file( outputFileName.c_str() );
+    WriteResults( file, results, numberOfThreads );
+    std::cout << "Results written to " << outputFileName << std::endl;
+    }
+
+  if ( !baselineFileName.empty() && !CompareWithBaseline( results, baseline, tolerance, sizesRun, filter ) )
+    {
+    std::cout << "Performance regression: at least one benchmark is more than " << 100.0*tolerance
+              << "% slower than the baseline, or has no result" << std::endl;
+    return cip::EXITFAILURE;
+    }
+
+  if ( failed )
+    {
+    std::cout << "At least one benchmark failed" << std::endl;
+    return cip::EXITFAILURE;
+    }
+
+  return cip::EXITSUCCESS;
+}
@@ -223,6 +223,11 @@ if(BUILD_INTERACTIVETOOLS)
   SUBDIRS (InteractiveTools)
 endif(BUILD_INTERACTIVETOOLS)
 
+SET(BUILD_BENCHMARKS OFF CACHE BOOL "BUILD_BENCHMARKS")
+if(BUILD_BENCHMARKS)
+  SUBDIRS (Benchmarks)
+endif(BUILD_BENCHMARKS)
+
 SET(BUILD_SANDBOX OFF CACHE BOOL "BUILD_SANDBOX")
 if(BUILD_SANDBOX)
   SUBDIRS (Sandbox)
@@ -41,6 +41,15 @@ macro(cipMacroBuildCLI)
   )
 
   
+  # Registers the block compressed NRRD image IO, and times the whole tool
+  # when CIP_INSTRUMENTATION is set (see cipInstrumentation.h)
+  set(MODULE_INITIALIZATION_SRC ${CMAKE_CURRENT_BINARY_DIR}/${MODULE_NAME}Initialization.cxx)
+  configure_file(
+    ${CIP_SOURCE_DIR}/CMake/cipModuleInitialization.cxx.in
+    ${MODULE_INITIALIZATION_SRC}
+    @ONLY
+    )
+
   if(${CIP_BUILD_CLI_EXECUTABLEONLY})
        set(PASS_EXECUTABLE_ONLY EXECUTABLE_ONLY)
   endif()
@@ -50,7 +59,7 @@ macro(cipMacroBuildCLI)
        LOGO_HEADER ${MY_CIP_LOGO_HEADER}
        TARGET_LIBRARIES ${TARGET_LIBRARIES}
        INCLUDE_DIRECTORIES ${INCLUDE_DIRECTORIES}
-       ADDITIONAL_SRCS ${SRCS}
+       ADDITIONAL_SRCS ${SRCS} ${MODULE_INITIALIZATION_SRC}
        LIBRARY_OUTPUT_DIRECTORY "${CMAKE_BINARY_DIR}/bin"
        RUNTIME_OUTPUT_DIRECTORY "${CMAKE_BINARY_DIR}/bin"
        ARCHIVE_OUTPUT_DIRECTORY "${CMAKE_BINARY_DIR}/bin"
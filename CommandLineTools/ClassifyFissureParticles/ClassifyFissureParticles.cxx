@@ -27,6 +27,7 @@
 #include "vtkPolyData.h"
 #include "cipNewtonOptimizer.h"
 #include "cipThinPlateSplineSurface.h"
+#include "cipThinPlateSplineSurfaceDistanceCalculator.h"
 #include "cipNelderMeadSimplexOptimizer.h"
 #include "cipThinPlateSplineSurfaceModelToParticlesMetric.h"
 #include "cipHelper.h"
@@ -40,8 +41,9 @@ struct PARTICLEINFO
   unsigned char         cipType;
 };
 
-void GetParticleDistanceAndAngle( vtkPolyData*, unsigned int, const cipThinPlateSplineSurface&, double*, double* );
-void TallyParticleInfo( vtkPolyData*, std::vector< cipThinPlateSplineSurface >, std::map< unsigned int, PARTICLEINFO >* );
+void GetParticleDistancesAndAngles( vtkPolyData*, const std::vector< unsigned int >&, const cipThinPlateSplineSurface&,
+                                    std::vector< double >*, std::vector< double >* );
+void TallyParticleInfo( vtkPolyData*, const std::vector< cipThinPlateSplineSurface >&, std::map< unsigned int, PARTICLEINFO >* );
 void ClassifyParticles( std::map< unsigned int, PARTICLEINFO >*, std::vector< cipThinPlateSplineSurface >, double, double, double );
 void WriteParticlesToFile( vtkSmartPointer< vtkPolyData >, std::map< unsigned int, PARTICLEINFO >, std::string, unsigned char );
 
@@ -138,106 +140,93 @@ int main( int argc, char *argv[] )
   return 0;
 }
 
-void GetParticleDistanceAndAngle( vtkPolyData* particles, unsigned int whichParticle, const cipThinPlateSplineSurface& tps,
-                                  double* distance, double* angle ) 
+// Computes the distance of each of the particles 'whichParticles' to
+// 'tps', and the angle between the particle's 'hevec2' and the surface
+// normal at the closest point on the surface. All the particles are
+// handled in one call to the distance calculator.
+void GetParticleDistancesAndAngles( vtkPolyData* particles, const std::vector< unsigned int >& whichParticles,
+                                    const cipThinPlateSplineSurface& tps, std::vector< double >* distances,
+                                    std::vector< double >* angles )
 {
-  cipParticleToThinPlateSplineSurfaceMetric particleToTPSMetric;
-    particleToTPSMetric.SetThinPlateSplineSurface( tps );
+  std::vector< cip::PointType > positions( whichParticles.size(), cip::PointType(3) );
+  for ( unsigned int i=0; i<whichParticles.size(); i++ )
+    {
+    positions[i][0] = particles->GetPoint(whichParticles[i])[0];
+    positions[i][1] = particles->GetPoint(whichParticles[i])[1];
+    positions[i][2] = particles->GetPoint(whichParticles[i])[2];
+    }
 
-  cipNewtonOptimizer< 2 >* newtonOptimizer = new cipNewtonOptimizer< 2 >();
-    newtonOptimizer->SetMetric( particleToTPSMetric );
+  std::vector< cip::PointType > closestPoints;
+
+  cipThinPlateSplineSurfaceDistanceCalculator calculator( tps );
+    calculator.ComputeDistances( positions, *distances, &closestPoints );
 
-  cip::PointType position(3);
   cip::VectorType normal(3);
   cip::VectorType orientation(3);
 
-  cipNewtonOptimizer< 2 >::PointType* domainParams  = new cipNewtonOptimizer< 2 >::PointType( 2, 2 );
-  cipNewtonOptimizer< 2 >::PointType* optimalParams = new cipNewtonOptimizer< 2 >::PointType( 2, 2 );
-
-  position[0] = particles->GetPoint(whichParticle)[0];
-  position[1] = particles->GetPoint(whichParticle)[1];
-  position[2] = particles->GetPoint(whichParticle)[2];
-
-  orientation[0] = particles->GetPointData()->GetArray( "hevec2" )->GetTuple(whichParticle)[0];
-  orientation[1] = particles->GetPointData()->GetArray( "hevec2" )->GetTuple(whichParticle)[1];
-  orientation[2] = particles->GetPointData()->GetArray( "hevec2" )->GetTuple(whichParticle)[2];
-
-  particleToTPSMetric.SetParticle( position );
-
-  (*domainParams)[0] = position[0];
-  (*domainParams)[1] = position[1];
-
-  newtonOptimizer->SetInitialParameters( domainParams );
-  newtonOptimizer->Update();
-  newtonOptimizer->GetOptimalParameters( optimalParams );
+  vtkDataArray* hevec2 = particles->GetPointData()->GetArray( "hevec2" );
 
-  *distance = vcl_sqrt( newtonOptimizer->GetOptimalValue() );
+  angles->resize( whichParticles.size() );
+  for ( unsigned int i=0; i<whichParticles.size(); i++ )
+    {
+    orientation[0] = hevec2->GetTuple(whichParticles[i])[0];
+    orientation[1] = hevec2->GetTuple(whichParticles[i])[1];
+    orientation[2] = hevec2->GetTuple(whichParticles[i])[2];
 
-  tps.GetSurfaceNormal( (*optimalParams)[0], (*optimalParams)[1], normal );
+    tps.GetSurfaceNormal( closestPoints[i][0], closestPoints[i][1], normal );
 
-  *angle = cip::GetAngleBetweenVectors( normal, orientation, true );
+    (*angles)[i] = cip::GetAngleBetweenVectors( normal, orientation, true );
+    }
 }
 
 // 'tpsVec' has either one (left) or two (right) elements. The
 // convention is that if the 'tpsVec' contains surfaces for the right
 // lung, the first element of the vector corresponds to the oblique,
 // and the second element corresponds to the horizontal.
-void TallyParticleInfo( vtkPolyData* particles, std::vector< cipThinPlateSplineSurface > tpsVec, 
+void TallyParticleInfo( vtkPolyData* particles, const std::vector< cipThinPlateSplineSurface >& tpsVec, 
 			std::map< unsigned int, PARTICLEINFO >* particleToInfoMap )
 {
-  if ( tpsVec.size() == 1 )
+  // Every particle is compared to the first surface. In the right
+  // lung, particles below the oblique surface's height are also
+  // compared to the horizontal surface.
+  std::vector< unsigned int > allParticles;
+  std::vector< unsigned int > rhParticles;
+  for ( unsigned int i=0; i<particles->GetNumberOfPoints(); i++ )
     {
-    // Dealing with the left lung
-    for ( unsigned int i=0; i<particles->GetNumberOfPoints(); i++ )
-      {
-      PARTICLEINFO pInfo;
+    allParticles.push_back( i );
 
-      double distance, angle;
-      GetParticleDistanceAndAngle( particles, i, tpsVec[0], &distance, &angle );
-
-      pInfo.distance.push_back( distance );
-      pInfo.angle.push_back( angle );
-
-      (*particleToInfoMap)[i] = pInfo;
-      }
-    }
-  else
-    {
-    // Dealing with the right lung
-    double roSurfaceHeight, rhSurfaceHeight;
-    for ( unsigned int i=0; i<particles->GetNumberOfPoints(); i++ )
+    if ( tpsVec.size() > 1 )
       {
-      PARTICLEINFO pInfo;
+      double roSurfaceHeight = tpsVec[0].GetSurfaceHeight( particles->GetPoint(i)[0], particles->GetPoint(i)[1] );
+      double rhSurfaceHeight = tpsVec[1].GetSurfaceHeight( particles->GetPoint(i)[0], particles->GetPoint(i)[1] ); 
 
-      roSurfaceHeight = tpsVec[0].GetSurfaceHeight( particles->GetPoint(i)[0], particles->GetPoint(i)[1] );
-      rhSurfaceHeight = tpsVec[1].GetSurfaceHeight( particles->GetPoint(i)[0], particles->GetPoint(i)[1] ); 
-
-      if ( roSurfaceHeight > rhSurfaceHeight )
+      if ( !(roSurfaceHeight > rhSurfaceHeight) )
         {
-        double distance, angle;
-        GetParticleDistanceAndAngle( particles, i, tpsVec[0], &distance, &angle );
-
-        pInfo.distance.push_back( distance );
-        pInfo.angle.push_back( angle );
-
-        (*particleToInfoMap)[i] = pInfo;
+        rhParticles.push_back( i );
         }
-      else
-        {
-        double roDistance, roAngle;
-        GetParticleDistanceAndAngle( particles, i, tpsVec[0], &roDistance, &roAngle );
+      }
+    }
 
-        pInfo.distance.push_back( roDistance );
-        pInfo.angle.push_back( roAngle );
+  std::vector< double > distances, angles;
+  GetParticleDistancesAndAngles( particles, allParticles, tpsVec[0], &distances, &angles );
 
-        double rhDistance, rhAngle;
-        GetParticleDistanceAndAngle( particles, i, tpsVec[1], &rhDistance, &rhAngle );
+  for ( unsigned int i=0; i<allParticles.size(); i++ )
+    {
+    PARTICLEINFO pInfo;
+      pInfo.distance.push_back( distances[i] );
+      pInfo.angle.push_back( angles[i] );
 
-        pInfo.distance.push_back( rhDistance );
-        pInfo.angle.push_back( rhAngle );
+    (*particleToInfoMap)[allParticles[i]] = pInfo;
+    }
 
-        (*particleToInfoMap)[i] = pInfo;
-        }
+  if ( rhParticles.size() > 0 )
+    {
+    GetParticleDistancesAndAngles( particles, rhParticles, tpsVec[1], &distances, &angles );
+
+    for ( unsigned int i=0; i<rhParticles.size(); i++ )
+      {
+      (*particleToInfoMap)[rhParticles[i]].distance.push_back( distances[i] );
+      (*particleToInfoMap)[rhParticles[i]].angle.push_back( angles[i] );
       }
     }
 }
@@ -72,7 +72,7 @@ typedef itk::Functor::DescoteauxXiaoSheetnessFunctor< GradientMagnitudePixelType
 int main( int argc, char *argv[] )
 {
   PARSE_ARGS;
-  
+
   // Parse all arguments
   if (ctFileName.length() == 0 )
     {
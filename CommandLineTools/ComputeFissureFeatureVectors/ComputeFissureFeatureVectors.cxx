@@ -4,6 +4,7 @@
 #include <cmath>
 #include "cipChestConventions.h"
 #include "cipHelper.h"
+#include "cipThinPlateSplineSurfaceDistanceCalculator.h"
 #include "vtkPolyData.h"
 #include "vtkFloatArray.h"
 #include "vtkPolyDataReader.h"
@@ -34,6 +35,7 @@ typedef itk::DiscreteGaussianDerivativeImageFunction< cip::CTType >
 struct FEATUREVECTOR
 {
   double eigenVector[3];
+  double location[3];
   short  intensity;
   double distanceToVessel;
   double distanceToLobeSurface;
@@ -52,10 +54,10 @@ struct FEATUREVECTOR
 DistanceImageType::Pointer GetVesselDistanceMap( cip::CTType::SpacingType, cip::CTType::SizeType, 
 						 cip::CTType::PointType, vtkSmartPointer< vtkPolyData > );
 FEATUREVECTOR ComputeFissureFeatureVector( vtkSmartPointer< vtkPolyData >, cip::CTType::Pointer, 
-					   DistanceImageType::Pointer, const cipThinPlateSplineSurface& ,  
-					   const cipThinPlateSplineSurface&,  const cipThinPlateSplineSurface&,
-					   DerivativeFunctionType::Pointer, HessianImageFunctionType::Pointer, 
-					   cip::CTType::IndexType );
+					   DistanceImageType::Pointer, DerivativeFunctionType::Pointer, 
+					   HessianImageFunctionType::Pointer, cip::CTType::IndexType );
+void ComputeLobeSurfaceFeatures( std::vector< FEATUREVECTOR >&, const cipThinPlateSplineSurface&,  
+				 const cipThinPlateSplineSurface&,  const cipThinPlateSplineSurface& );
 
 int main( int argc, char *argv[] )
 {
@@ -238,8 +240,7 @@ int main( int argc, char *argv[] )
       ctReader->GetOutput()->TransformPhysicalPointToIndex( point, index );
 
       FEATUREVECTOR vec = ComputeFissureFeatureVector( pointsParticlesReader->GetOutput(), ctReader->GetOutput(), 
-  						       vesselDistanceMap, rhTPS, roTPS, loTPS, derivativeFunction, 
-  						       hessianFunction, index );
+  						       vesselDistanceMap, derivativeFunction, hessianFunction, index );
       if ( *vec.eigenValues.begin() < 0 )
   	{
   	  trueFeatureVectors.push_back( vec );
@@ -269,8 +270,8 @@ int main( int argc, char *argv[] )
   	      if ( rand() % 10000 < 3 && std::abs(dIt.Get()) > 2 )
   		{
   		  FEATUREVECTOR vec = ComputeFissureFeatureVector( pointsParticlesReader->GetOutput(), ctReader->GetOutput(), 
-  								   vesselDistanceMap, rhTPS, roTPS, loTPS, derivativeFunction, 
-  								   hessianFunction, cIt.GetIndex() );
+  								   vesselDistanceMap, derivativeFunction, hessianFunction, 
+  								   cIt.GetIndex() );
   		  if ( *vec.eigenValues.begin() < 0 )
   		    {
   		      falseFeatureVectors.push_back( vec );
@@ -284,6 +285,12 @@ int main( int argc, char *argv[] )
       ++dIt;
     }
 
+  // The distances to the lobe boundary surfaces are computed for all the
+  // kept feature vectors at once
+  std::cout << "Computing lobe surface features..." << std::endl;
+  ComputeLobeSurfaceFeatures( trueFeatureVectors, rhTPS, roTPS, loTPS );
+  ComputeLobeSurfaceFeatures( falseFeatureVectors, rhTPS, roTPS, loTPS );
+
   std::cout << "Writing true feature vectors to file..." << std::endl;
   std::ofstream trueFile( trueOutFileName.c_str() );
 
@@ -421,9 +428,7 @@ DistanceImageType::Pointer GetVesselDistanceMap( cip::CTType::SpacingType spacin
 }
 
 FEATUREVECTOR ComputeFissureFeatureVector( vtkSmartPointer< vtkPolyData > pointsParticles, cip::CTType::Pointer ct, 
-					   DistanceImageType::Pointer distanceMap, const cipThinPlateSplineSurface& rhTPS,  
-					   const cipThinPlateSplineSurface& roTPS,  const cipThinPlateSplineSurface& loTPS,
-					   DerivativeFunctionType::Pointer derivativeFunction, 
+					   DistanceImageType::Pointer distanceMap, DerivativeFunctionType::Pointer derivativeFunction, 
 					   HessianImageFunctionType::Pointer hessianFunction, cip::CTType::IndexType index )
 {
   FEATUREVECTOR vec;
@@ -438,13 +443,12 @@ FEATUREVECTOR ComputeFissureFeatureVector( vtkSmartPointer< vtkPolyData > points
   HessianImageFunctionType::TensorType hessian;
 
   cip::CTType::PointType imPoint;
-  cip::PointType point(3);
 
   ct->TransformIndexToPhysicalPoint( index, imPoint );
 
-  point[0] = imPoint[0];
-  point[1] = imPoint[1];
-  point[2] = imPoint[2];
+  vec.location[0] = imPoint[0];
+  vec.location[1] = imPoint[1];
+  vec.location[2] = imPoint[2];
 
   vec.intensity = ct->GetPixel( index );
   vec.distanceToVessel = std::abs( distanceMap->GetPixel( index ) );
@@ -496,70 +500,6 @@ FEATUREVECTOR ComputeFissureFeatureVector( vtkSmartPointer< vtkPolyData > points
   vec.eigenValueMags.push_back( std::abs(eigenValues[2]) );
   vec.eigenValueMags.sort();
   
-  if ( loTPS.GetNumberSurfacePoints() > 0 )
-    {
-      vec.distanceToLobeSurface = cip::GetDistanceToThinPlateSplineSurface( loTPS, point );
-      
-      cip::VectorType normal(3);
-      cip::PointType tpsPoint(3);
-      
-      cip::GetClosestPointOnThinPlateSplineSurface( loTPS, point, tpsPoint );
-      loTPS.GetSurfaceNormal( tpsPoint[0], tpsPoint[1], normal );
-      
-      cip::VectorType tmpVec(3);
-      tmpVec[0] = vec.eigenVector[0];
-      tmpVec[1] = vec.eigenVector[1];
-      tmpVec[2] = vec.eigenVector[2];
-      vec.angleWithLobeSurfaceNormal = cip::GetAngleBetweenVectors(normal, tmpVec, true);
-    }
-  else if ( roTPS.GetNumberSurfacePoints() > 0 && rhTPS.GetNumberSurfacePoints() > 0 )
-    {
-      double roDist = cip::GetDistanceToThinPlateSplineSurface( roTPS, point );
-      double rhDist = cip::GetDistanceToThinPlateSplineSurface( rhTPS, point );
-      
-      double roHeight = roTPS.GetSurfaceHeight( point[0], point[1] );
-      double rhHeight = rhTPS.GetSurfaceHeight( point[0], point[1] );
-      
-      if ( rhDist < roDist && rhHeight > roHeight )
-	{
-	  vec.distanceToLobeSurface = rhDist;
-	  
-	  cip::VectorType normal(3);
-	  cip::PointType tpsPoint(3);
-	  
-	  cip::GetClosestPointOnThinPlateSplineSurface( rhTPS, point, tpsPoint );
-	  rhTPS.GetSurfaceNormal( tpsPoint[0], tpsPoint[1], normal );
-	  
-	  cip::VectorType tmpVec(3);
-	  tmpVec[0] = vec.eigenVector[0];
-	  tmpVec[1] = vec.eigenVector[1];
-	  tmpVec[2] = vec.eigenVector[2];
-	  
-	  vec.angleWithLobeSurfaceNormal = cip::GetAngleBetweenVectors(normal, tmpVec, true);
-	}
-      else
-	{
-	  vec.distanceToLobeSurface = roDist;
-	  
-	  cip::VectorType normal(3);
-	  cip::PointType tpsPoint(3);
-	  
-	  cip::GetClosestPointOnThinPlateSplineSurface( roTPS, point, tpsPoint );
-	  roTPS.GetSurfaceNormal( tpsPoint[0], tpsPoint[1], normal );
-	  
-	  cip::VectorType tmpVec(3);
-	  tmpVec[0] = vec.eigenVector[0];
-	  tmpVec[1] = vec.eigenVector[1];
-	  tmpVec[2] = vec.eigenVector[2];
-	  
-	  vec.angleWithLobeSurfaceNormal = cip::GetAngleBetweenVectors(normal, tmpVec, true);
-	}
-    }
-  else
-    {
-      std::cerr << "Insufficient lobe boundary surface points." << std::endl;
-    }
-  
   // Compute the pMeasaure, as given by equations 2 and 3 in 'Supervised Enhancement Filters : 
   // Application to Fissure Detection in Chest CT Scans' (van Rikxoort):
   if ( *vec.eigenValues.begin() < 0 )
@@ -579,4 +519,79 @@ FEATUREVECTOR ComputeFissureFeatureVector( vtkSmartPointer< vtkPolyData > points
   return vec;
 }
 
+// Set the distance to the closest lobe boundary surface and the angle between the
+// surface normal there and the feature vector's eigenvector
+void ComputeLobeSurfaceFeatures( std::vector< FEATUREVECTOR >& vecs, const cipThinPlateSplineSurface& rhTPS,  
+				 const cipThinPlateSplineSurface& roTPS,  const cipThinPlateSplineSurface& loTPS )
+{
+  if ( vecs.size() == 0 )
+    {
+      return;
+    }
+
+  std::vector< cip::PointType > points( vecs.size(), cip::PointType(3) );
+  for ( unsigned int i=0; i<vecs.size(); i++ )
+    {
+      points[i][0] = vecs[i].location[0];
+      points[i][1] = vecs[i].location[1];
+      points[i][2] = vecs[i].location[2];
+    }
+
+  std::vector< double > loDists, roDists, rhDists;
+  std::vector< cip::PointType > loPoints, roPoints, rhPoints;
+
+  if ( loTPS.GetNumberSurfacePoints() > 0 )
+    {
+      cipThinPlateSplineSurfaceDistanceCalculator loCalculator( loTPS );
+        loCalculator.ComputeDistances( points, loDists, &loPoints );
+    }
+  else if ( roTPS.GetNumberSurfacePoints() > 0 && rhTPS.GetNumberSurfacePoints() > 0 )
+    {
+      cipThinPlateSplineSurfaceDistanceCalculator roCalculator( roTPS );
+        roCalculator.ComputeDistances( points, roDists, &roPoints );
+
+      cipThinPlateSplineSurfaceDistanceCalculator rhCalculator( rhTPS );
+        rhCalculator.ComputeDistances( points, rhDists, &rhPoints );
+    }
+  else
+    {
+      std::cerr << "Insufficient lobe boundary surface points." << std::endl;
+      return;
+    }
+
+  cip::VectorType normal(3);
+  cip::VectorType tmpVec(3);
+
+  for ( unsigned int i=0; i<vecs.size(); i++ )
+    {
+      tmpVec[0] = vecs[i].eigenVector[0];
+      tmpVec[1] = vecs[i].eigenVector[1];
+      tmpVec[2] = vecs[i].eigenVector[2];
+
+      if ( loTPS.GetNumberSurfacePoints() > 0 )
+	{
+	  vecs[i].distanceToLobeSurface = loDists[i];
+	  loTPS.GetSurfaceNormal( loPoints[i][0], loPoints[i][1], normal );
+	}
+      else
+	{
+	  double roHeight = roTPS.GetSurfaceHeight( points[i][0], points[i][1] );
+	  double rhHeight = rhTPS.GetSurfaceHeight( points[i][0], points[i][1] );
+
+	  if ( rhDists[i] < roDists[i] && rhHeight > roHeight )
+	    {
+	      vecs[i].distanceToLobeSurface = rhDists[i];
+	      rhTPS.GetSurfaceNormal( rhPoints[i][0], rhPoints[i][1], normal );
+	    }
+	  else
+	    {
+	      vecs[i].distanceToLobeSurface = roDists[i];
+	      roTPS.GetSurfaceNormal( roPoints[i][0], roPoints[i][1], normal );
+	    }
+	}
+
+      vecs[i].angleWithLobeSurfaceNormal = cip::GetAngleBetweenVectors(normal, tmpVec, true);
+    }
+}
+
 #endif
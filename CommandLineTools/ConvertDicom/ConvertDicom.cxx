@@ -17,6 +17,9 @@
  *  -i \<string\>,  --dicomDir \<string\>
  *    (required)  Input dicom directory
  *
+ *  --threads \<int\>
+ *    Number of threads used to read the slices (0 uses all cores)
+ *
  *  --,  --ignore_rest
  *    Ignores the rest of the labeled arguments following this flag.
  *
@@ -36,17 +39,13 @@
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
 
 #include "cipChestConventions.h"
+#include "cipDICOMSeriesReader.h"
+#include "cipExceptionObject.h"
 #include "itkImage.h"
 #include "itkImageFileWriter.h"
-#include "itkImageSeriesReader.h"
-#include "itkGDCMImageIO.h"
-#include "itkGDCMSeriesFileNames.h"
 #include "ConvertDicomCLP.h"
 
 typedef itk::Image< short, 3 >                ImageType;
-typedef itk::GDCMImageIO                      ImageIOType;
-typedef itk::GDCMSeriesFileNames              NamesGeneratorType;
-typedef itk::ImageSeriesReader< ImageType >   ReaderType;
 typedef itk::ImageFileWriter< ImageType >     WriterType;
 
 int main( int argc, char *argv[] )
@@ -55,37 +54,36 @@ int main( int argc, char *argv[] )
   PARSE_ARGS;  
 
   //
-  // Read the DICOM data
-  //
-  ImageIOType::Pointer gdcmIO = ImageIOType::New();
-
-  std::cout << "Getting file names..." << std::endl;
-  NamesGeneratorType::Pointer namesGenerator = NamesGeneratorType::New();
-    namesGenerator->SetInputDirectory( dicomDir );
-
-  const ReaderType::FileNamesContainer & filenames = namesGenerator->GetInputFileNames();
-
-  //
-  // Write the DICOM data
+  // Read the DICOM data. The headers are scanned and the slices are
+  // decoded on 'numberOfThreads' threads
   //
   std::cout << "Reading DICOM image..." << std::endl;
-  ReaderType::Pointer dicomReader = ReaderType::New();
-    dicomReader->SetImageIO( gdcmIO );
-    dicomReader->SetFileNames( filenames );
+  cip::DICOMSeriesReader dicomReader;
+    dicomReader.SetDirectory( dicomDir );
+    dicomReader.SetNumberOfThreads( numberOfThreads );
   try
     {
-    dicomReader->Update();
+    dicomReader.Update();
+    }
+  catch ( cip::ExceptionObject &excp )
+    {
+    std::cerr << "Exception caught while reading dicom:";
+    std::cerr << excp << std::endl;
+    return cip::DICOMREADFAILURE;
     }
-  catch (itk::ExceptionObject &excp)
+  catch ( itk::ExceptionObject &excp )
     {
     std::cerr << "Exception caught while reading dicom:";
     std::cerr << excp << std::endl;
     return cip::DICOMREADFAILURE;
     }
   
+  //
+  // Write the DICOM data
+  //
   std::cout << "Writing converted image..." << std::endl;
   WriterType::Pointer writer = WriterType::New();  
-    writer->SetInput( dicomReader->GetOutput() );
+    writer->SetInput( dicomReader.GetOutput() );
     writer->UseCompressionOn();
     writer->SetFileName( outputImageFileName );
   try
@@ -344,6 +344,8 @@ void UpdateFeatureVectorWithHessianInfo( cip::CTType::IndexType index, cip::CTTy
   vec.eigenValueMags.push_back( std::abs(eigenValues[2]) );
   vec.eigenValueMags.sort();
 
+  // The lobe surface normal is taken at the point of the surface closest
+  // to the voxel
   cip::VectorType normal(3);
   cip::PointType tpsPoint(3);
   if ( vec.matchesLO )
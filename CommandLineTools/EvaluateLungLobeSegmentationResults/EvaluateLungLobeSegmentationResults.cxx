@@ -24,9 +24,9 @@
 #include "cipHelper.h"
 #include "cipChestRegionChestTypeLocationsIO.h"
 #include "cipLobeSurfaceModelIO.h"
-#include "cipParticleToThinPlateSplineSurfaceMetric.h"
 #include "cipThinPlateSplineSurface.h"
-#include "cipNewtonOptimizer.h"
+#include "cipThinPlateSplineSurfaceDistanceCalculator.h"
+#include "cipThinPlateSplineSurfaceDistanceMap.h"
 #include "vtkPolyDataReader.h"
 #include "vtkSmartPointer.h"
 #include "itkImage.h"
@@ -35,12 +35,15 @@
 
 typedef itk::ImageRegionIterator< cip::LabelMapType > LabelMapIteratorType;
 
-double GetDistanceFromPointToThinPlateSplineSurface( double, double, double, const cipThinPlateSplineSurface& );
+std::vector< double > GetDistancesFromPointsToThinPlateSplineSurface( const std::vector< cip::PointType >&, const cipThinPlateSplineSurface& );
+std::vector< double > GetDistancesFromPointsToThinPlateSplineSurface( const std::vector< cip::PointType >&, const cipThinPlateSplineSurface&,
+								      cip::LabelMapType::Pointer, bool );
+std::vector< cip::PointType > GetParticlePoints( vtkSmartPointer< vtkPolyData > );
 void PrintAndComputeDiceScores( cip::LabelMapType::Pointer, cip::LabelMapType::Pointer );
 void PrintStats( std::vector< double > );
 void ComputeAndPrintFullSurfaceDiscrepancies( const cipThinPlateSplineSurface&, const cipThinPlateSplineSurface&, const cipThinPlateSplineSurface&, 
 					      const cipThinPlateSplineSurface&, const cipThinPlateSplineSurface&, const cipThinPlateSplineSurface&, 
-					      cip::LabelMapType::Pointer );
+					      cip::LabelMapType::Pointer, bool );
 void ComputeAndPrintPointWiseSurfaceDiscrepancies( const cipThinPlateSplineSurface&, const cipThinPlateSplineSurface&, const cipThinPlateSplineSurface&, 
 						   vtkSmartPointer< vtkPolyData >, vtkSmartPointer< vtkPolyData >, 
 						   vtkSmartPointer< vtkPolyData >, cip::LabelMapType::Pointer );
@@ -283,7 +286,7 @@ int main( int argc, char *argv[] )
   // points.
   //
   ComputeAndPrintFullSurfaceDiscrepancies( roTPS, rhTPS, loTPS, roGTTPS, 
-  					   rhGTTPS, loGTTPS, autoReader->GetOutput() );
+  					   rhGTTPS, loGTTPS, autoReader->GetOutput(), refineDistances );
 
   ComputeAndPrintPointWiseSurfaceDiscrepancies( roTPS, rhTPS, loTPS, 
   						roGTParticlesReader->GetOutput(), 
@@ -424,53 +427,84 @@ void PrintStats( std::vector< double > distances )
 }
 
 
-double GetDistanceFromPointToThinPlateSplineSurface( double x, double y, double z, const cipThinPlateSplineSurface& tps )
+std::vector< double > GetDistancesFromPointsToThinPlateSplineSurface( const std::vector< cip::PointType >& points, 
+								      const cipThinPlateSplineSurface& tps )
 {
-  cipParticleToThinPlateSplineSurfaceMetric particleToTPSMetric;
-    particleToTPSMetric.SetThinPlateSplineSurface( tps );
+  std::vector< double > distances;
 
-  cipNewtonOptimizer< 2 >* optimizer = new cipNewtonOptimizer< 2 >();
-    optimizer->SetMetric( particleToTPSMetric );
+  cipThinPlateSplineSurfaceDistanceCalculator calculator( tps );
+    calculator.ComputeDistances( points, distances );
 
-  cipNewtonOptimizer< 2 >::PointType* domainParams  = new cipNewtonOptimizer< 2 >::PointType( 2 );
+  return distances;
+}
 
-  cip::PointType position(3);
-    position[0] = x;
-    position[1] = y;
-    position[2] = z;
 
-  //
-  // Determine the domain location for which the particle is closest
-  // to the TPS surface
-  //
-  particleToTPSMetric.SetParticle( position );
+// The distances of 'points' are looked up in a distance map of 'tps' on
+// the grid of 'labelMap', one lookup per point, and are refined with a
+// Newton search if 'refine' is true. Points outside the map's band are
+// handed to the bulk calculator. The map does not handle rotated grids, so
+// for those the calculator alone is used.
+std::vector< double > GetDistancesFromPointsToThinPlateSplineSurface( const std::vector< cip::PointType >& points, 
+								      const cipThinPlateSplineSurface& tps,
+								      cip::LabelMapType::Pointer labelMap, bool refine )
+{
+  cip::LabelMapType::DirectionType identity;
+    identity.SetIdentity();
 
-  //
-  // The particle's x, and y location are a good place to initialize
-  // the search for the domain locations that result in the smallest
-  // distance between the particle and the TPS surface
-  //
-  (*domainParams)[0] = position[0]; 
-  (*domainParams)[1] = position[1]; 
+  if ( points.size() == 0 || tps.GetNumberSurfacePoints() == 0 || labelMap->GetDirection() != identity )
+    {
+      return GetDistancesFromPointsToThinPlateSplineSurface( points, tps );
+    }
 
-  //
-  // Perform Newton line search to determine the closest point on
-  // the current TPS surface
-  //
-  optimizer->SetInitialParameters( domainParams );
-  optimizer->Update();
+  cipThinPlateSplineSurfaceDistanceMap distanceMap( tps );
+    distanceMap.SetReferenceImage( labelMap.GetPointer() );
+    distanceMap.SetRefineWithNewton( refine );
+    distanceMap.Update();
 
-  //
-  // Get the distance between the particle and the TPS surface. This
-  // is just the square root of the objective function value
-  // optimized by the Newton method.
-  //
-  double distance = vcl_sqrt( optimizer->GetOptimalValue() );
+  std::vector< double > distances( points.size() );
+
+  std::vector< unsigned int >   outsideIndices;
+  std::vector< cip::PointType > outsidePoints;
+
+  double distance;
+  for ( unsigned int i=0; i<points.size(); i++ )
+    {
+      if ( distanceMap.GetSignedDistance( points[i], distance ) )
+	{
+	  distances[i] = vcl_fabs( distance );
+	}
+      else
+	{
+	  outsideIndices.push_back( i );
+	  outsidePoints.push_back( points[i] );
+	}
+    }
+
+  if ( outsidePoints.size() > 0 )
+    {
+      std::vector< double > outsideDistances = GetDistancesFromPointsToThinPlateSplineSurface( outsidePoints, tps );
+      for ( unsigned int i=0; i<outsideIndices.size(); i++ )
+	{
+	  distances[outsideIndices[i]] = outsideDistances[i];
+	}
+    }
+
+  return distances;
+}
+
+
+std::vector< cip::PointType > GetParticlePoints( vtkSmartPointer< vtkPolyData > particles )
+{
+  std::vector< cip::PointType > points( particles->GetNumberOfPoints(), cip::PointType(3) );
 
-//  delete particleToTPSMetric;  
-  delete optimizer;
+  for ( unsigned int i=0; i<particles->GetNumberOfPoints(); i++ )
+    {
+      points[i][0] = particles->GetPoint(i)[0];
+      points[i][1] = particles->GetPoint(i)[1];
+      points[i][2] = particles->GetPoint(i)[2];
+    }
 
-  return distance;
+  return points;
 }
 
 
@@ -578,7 +612,7 @@ void PrintAndComputeDiceScores( cip::LabelMapType::Pointer gtLabelMap, cip::Labe
 
 void ComputeAndPrintFullSurfaceDiscrepancies( const cipThinPlateSplineSurface& roTPS, const cipThinPlateSplineSurface& rhTPS, const cipThinPlateSplineSurface& loTPS, 
 					      const cipThinPlateSplineSurface& roGTTPS, const cipThinPlateSplineSurface& rhGTTPS, const cipThinPlateSplineSurface& loGTTPS, 
-					      cip::LabelMapType::Pointer labelMap )
+					      cip::LabelMapType::Pointer labelMap, bool refineDistances )
 {
   cip::ChestConventions conventions;
 
@@ -592,12 +626,15 @@ void ComputeAndPrintFullSurfaceDiscrepancies( const cipThinPlateSplineSurface& r
   double loHeight, roHeight, rhHeight;
   double loGTHeight, roGTHeight, rhGTHeight;
 
-  std::vector< double > loDistances;
-  std::vector< double > roDistances;
-  std::vector< double > rhDistances;
+  // The surface points inside the lungs are gathered first, and their
+  // distances computed in bulk afterwards
+  std::vector< cip::PointType > loPoints;
+  std::vector< cip::PointType > roPoints;
+  std::vector< cip::PointType > rhPoints;
+
+  cip::PointType surfacePoint(3);
 
   unsigned char cipRegion;
-  double dist;
 
   for ( unsigned int x=0; x<size[0]; x++ )
     {
@@ -618,8 +655,10 @@ void ComputeAndPrintFullSurfaceDiscrepancies( const cipThinPlateSplineSurface& r
 	      cipRegion = conventions.GetChestRegionFromValue( labelMap->GetPixel( index ) );
 	      if ( conventions.CheckSubordinateSuperiorChestRegionRelationship( cipRegion, static_cast< unsigned char >( cip::LEFTLUNG ) ) )
 		{
-		  dist = GetDistanceFromPointToThinPlateSplineSurface( point[0], point[1], point[2], loGTTPS );
-		  loDistances.push_back( dist );
+		  surfacePoint[0] = point[0];
+		  surfacePoint[1] = point[1];
+		  surfacePoint[2] = point[2];
+		  loPoints.push_back( surfacePoint );
 		}
 	    }
 
@@ -630,8 +669,10 @@ void ComputeAndPrintFullSurfaceDiscrepancies( const cipThinPlateSplineSurface& r
 	      cipRegion = conventions.GetChestRegionFromValue( labelMap->GetPixel( index ) );
 	      if ( conventions.CheckSubordinateSuperiorChestRegionRelationship( cipRegion, static_cast< unsigned char >( cip::RIGHTLUNG ) ) )
 		{
-		  dist = GetDistanceFromPointToThinPlateSplineSurface( point[0], point[1], point[2], roGTTPS );
-		  roDistances.push_back( dist );
+		  surfacePoint[0] = point[0];
+		  surfacePoint[1] = point[1];
+		  surfacePoint[2] = point[2];
+		  roPoints.push_back( surfacePoint );
 		}
 	    }
 
@@ -645,14 +686,28 @@ void ComputeAndPrintFullSurfaceDiscrepancies( const cipThinPlateSplineSurface& r
 		  cipRegion = conventions.GetChestRegionFromValue( labelMap->GetPixel( index ) );
 		  if ( conventions.CheckSubordinateSuperiorChestRegionRelationship( cipRegion, static_cast< unsigned char >( cip::RIGHTLUNG ) ) )
 		    {
-		      dist = GetDistanceFromPointToThinPlateSplineSurface( point[0], point[1], point[2], roGTTPS );
-		      rhDistances.push_back( dist );
+		      surfacePoint[0] = point[0];
+		      surfacePoint[1] = point[1];
+		      surfacePoint[2] = point[2];
+		      rhPoints.push_back( surfacePoint );
 		    }
 		}
 	    }
 	}
     }
 
+  // There is a query for nearly every (x,y) of the grid, so the surfaces
+  // are rasterized into distance maps first and the distances are looked
+  // up. The RO and RH points are both compared to the RO surface, so they
+  // share its map.
+  std::vector< double > loDistances = GetDistancesFromPointsToThinPlateSplineSurface( loPoints, loGTTPS, labelMap, refineDistances );
+
+  unsigned int numROPoints = roPoints.size();
+  roPoints.insert( roPoints.end(), rhPoints.begin(), rhPoints.end() );
+  std::vector< double > roDistances = GetDistancesFromPointsToThinPlateSplineSurface( roPoints, roGTTPS, labelMap, refineDistances );
+  std::vector< double > rhDistances( roDistances.begin() + numROPoints, roDistances.end() );
+  roDistances.resize( numROPoints );
+
   std::cout << "--------------------------------------------------------" << std::endl;
   std::cout << "LO Full Surface Distances:" << std::endl;
   PrintStats( loDistances );
@@ -669,37 +724,9 @@ void ComputeAndPrintPointWiseSurfaceDiscrepancies( const cipThinPlateSplineSurfa
 						   vtkSmartPointer< vtkPolyData > roParticles, vtkSmartPointer< vtkPolyData > rhParticles, 
 						   vtkSmartPointer< vtkPolyData > loParticles, cip::LabelMapType::Pointer labelMap )
 {
-  std::vector< double > loDistances;
-  std::vector< double > roDistances;
-  std::vector< double > rhDistances;
-
-  double point[3];
-  double dist;
-  
-  for ( unsigned int i=0; i<roParticles->GetNumberOfPoints(); i++ )
-    {
-      point[0] = roParticles->GetPoint(i)[0];
-      point[1] = roParticles->GetPoint(i)[1];
-      point[2] = roParticles->GetPoint(i)[2];
-      dist = GetDistanceFromPointToThinPlateSplineSurface( point[0], point[1], point[2], roTPS );
-      roDistances.push_back(dist);
-    }
-  for ( unsigned int i=0; i<rhParticles->GetNumberOfPoints(); i++ )
-    {
-      point[0] = rhParticles->GetPoint(i)[0];
-      point[1] = rhParticles->GetPoint(i)[1];
-      point[2] = rhParticles->GetPoint(i)[2];
-      dist = GetDistanceFromPointToThinPlateSplineSurface( point[0], point[1], point[2], rhTPS );
-      rhDistances.push_back(dist);
-    }
-  for ( unsigned int i=0; i<loParticles->GetNumberOfPoints(); i++ )
-    {
-      point[0] = loParticles->GetPoint(i)[0];
-      point[1] = loParticles->GetPoint(i)[1];
-      point[2] = loParticles->GetPoint(i)[2];
-      dist = GetDistanceFromPointToThinPlateSplineSurface( point[0], point[1], point[2], loTPS );
-      loDistances.push_back(dist);
-    }
+  std::vector< double > roDistances = GetDistancesFromPointsToThinPlateSplineSurface( GetParticlePoints( roParticles ), roTPS );
+  std::vector< double > rhDistances = GetDistancesFromPointsToThinPlateSplineSurface( GetParticlePoints( rhParticles ), rhTPS );
+  std::vector< double > loDistances = GetDistancesFromPointsToThinPlateSplineSurface( GetParticlePoints( loParticles ), loTPS );
 
   std::cout << "--------------------------------------------------------" << std::endl;
   std::cout << "LO Points Distances:" << std::endl;
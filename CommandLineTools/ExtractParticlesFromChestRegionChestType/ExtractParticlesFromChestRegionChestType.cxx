@@ -125,7 +125,7 @@ void GetOutputParticlesUsingLabelMap( std::string fileName, std::vector< std::st
     labelMapReader->SetFileName( fileName );
   try
     {
-    labelMapReader->Update();
+    labelMapReader->UpdateOutputInformation();
     }
   catch ( itk::ExceptionObject &excp )
     {
@@ -133,6 +133,22 @@ void GetOutputParticlesUsingLabelMap( std::string fileName, std::vector< std::st
     std::cerr << excp << std::endl;
     }
 
+  // Only the part of the label map that the particles span is read
+  double bounds[6];
+  inParticles->GetBounds( bounds );
+
+  double lower[3] = { bounds[0], bounds[2], bounds[4] };
+  double upper[3] = { bounds[1], bounds[3], bounds[5] };
+
+  cip::LabelMapType::RegionType region =
+    cip::GetRegionFromPhysicalBounds( labelMapReader->GetOutput(), lower, upper, 1 );
+
+  cip::LabelMapType::Pointer labelMap;
+  if ( inParticles->GetNumberOfPoints() > 0 && region.GetNumberOfPixels() > 0 )
+    {
+    labelMap = cip::ReadLabelMapFromFile( fileName, region );
+    }
+
   unsigned int numberPointDataArrays = inParticles->GetPointData()->GetNumberOfArrays();
   unsigned int numberParticles       = inParticles->GetNumberOfPoints();
 
@@ -159,9 +175,12 @@ void GetOutputParticlesUsingLabelMap( std::string fileName, std::vector< std::st
     point[1] = inParticles->GetPoint(i)[1];
     point[2] = inParticles->GetPoint(i)[2];
 
-    labelMapReader->GetOutput()->TransformPhysicalPointToIndex( point, index );
+    if ( labelMap.IsNull() || !labelMap->TransformPhysicalPointToIndex( point, index ) )
+      {
+      continue;
+      }
 
-    unsigned short labelValue   = labelMapReader->GetOutput()->GetPixel( index );
+    unsigned short labelValue   = labelMap->GetPixel( index );
     unsigned char  labelRegion  = conventions.GetChestRegionFromValue( labelValue );
 
     if ( labelValue > 0 )
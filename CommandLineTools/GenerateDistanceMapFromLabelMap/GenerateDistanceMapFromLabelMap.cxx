@@ -12,14 +12,15 @@
 #include "itkImageFileWriter.h"
 #include "itkSignedMaurerDistanceMapImageFilter.h"
 #include "itkCIPExtractChestLabelMapImageFilter.h"
-#include "itkDanielssonDistanceMapImageFilter.h"
+#include "cipLabelMapDistanceTransform.h"
+#include "cipExceptionObject.h"
 
 namespace{
     typedef itk::Image< short, 3 >                                                        DistanceMapType;
     typedef itk::ImageFileWriter< DistanceMapType >                                       WriterType;
+    typedef itk::ImageFileWriter< cip::LabelMapType >                                     LabelMapWriterType;
     typedef itk::ImageFileWriter< cip::LabelMapType >                                     DEBWriterType;
     typedef itk::SignedMaurerDistanceMapImageFilter< cip::LabelMapType, DistanceMapType > SignedMaurerType;
-    typedef itk::DanielssonDistanceMapImageFilter< cip::LabelMapType, DistanceMapType >   DanielssonType;
     typedef itk::NearestNeighborInterpolateImageFunction< cip::LabelMapType, double >     NearestNeighborInterpolatorType;
     typedef itk::LinearInterpolateImageFunction< DistanceMapType, double >                LinearInterpolatorType;
     typedef itk::ResampleImageFilter< cip::LabelMapType, cip::LabelMapType >              LabelMapResampleType;
@@ -146,12 +147,7 @@ int main( int argc, char *argv[] )
   //
      
     
-    //parse args
-    
-    unsigned int cipRegion = (unsigned int) cipRegionTemp;
-    unsigned int cipType = (unsigned int) cipTypeTemp;
-
-  if ( cipType == cip::UNDEFINEDTYPE && cipRegion == cip::UNDEFINEDREGION )
+  if ( cipRegions.size() == 0 && cipTypes.size() == 0 )
     {
       std::cout << "Must specify a chest region or chest type" << std::endl;
       return cip::ARGUMENTPARSINGERROR;
@@ -178,56 +174,46 @@ int main( int argc, char *argv[] )
     return cip::LABELMAPREADFAILURE;
     }
 
-  std::cout << "Isolationg region and type of interest..." << std::endl;
+  // Only the requested structures are kept, with their own labels, so
+  // that a single transform gives the distance to the closest of them and
+  // which one it is
+  std::cout << "Isolationg regions and types of interest..." << std::endl;
   LabelMapExtractorType::Pointer extractLabelMap = LabelMapExtractorType::New();
     extractLabelMap->SetInput(reader->GetOutput());
-  if ( cipRegion != 0 )
+  for ( unsigned int i=0; i<cipRegions.size(); i++ )
     {
-    extractLabelMap->SetChestRegion((unsigned char)cipRegion);
+    extractLabelMap->SetChestRegion((unsigned char)cipRegions[i]);
     }
-  if ( cipType != 0 )
+  for ( unsigned int i=0; i<cipTypes.size(); i++ )
     {
-    extractLabelMap->SetChestType((unsigned char)cipType);
+    extractLabelMap->SetChestType((unsigned char)cipTypes[i]);
     }
     extractLabelMap->Update();
-  
-  LabelMapIteratorType it( extractLabelMap->GetOutput(), extractLabelMap->GetOutput()->GetBufferedRegion() );
 
-  it.GoToBegin();
-  while ( !it.IsAtEnd() )
+  cip::LabelMapType::Pointer subSampledLabelMap = extractLabelMap->GetOutput();
+  if ( downsampleFactor != 1.0 )
     {
-    if ( it.Get() != 0 )
-      {
-	if ( it.Get() != 0 )
-	  {
-	    it.Set( 1 );
-	  }
-	else
-	  {
-	    it.Set( 0 );
-	  }
-      }
-    
-    ++it;
+    std::cout << "Downsampling label map..." << std::endl;
+    subSampledLabelMap = ResampleImage( extractLabelMap->GetOutput(), downsampleFactor );
     }
 
-  cip::LabelMapType::Pointer subSampledLabelMap;
-
-  std::cout << "Downsampling label map..." << std::endl;
-  subSampledLabelMap = ResampleImage( reader->GetOutput(), downsampleFactor );
-  
   std::cout << "Generating distance map..." << std::endl;
-  DanielssonType::Pointer distanceMap = DanielssonType::New();
-    distanceMap->SetInput( subSampledLabelMap );
-    distanceMap->InputIsBinaryOn();
-    // distanceMap->SetSquaredDistance( 0 );
-    // distanceMap->SetUseImageSpacing( 1 );
-    // distanceMap->SetInsideIsPositive( interiorIsPositive );
+  cipLabelMapDistanceTransform distanceTransform;
+    distanceTransform.SetInput( subSampledLabelMap );
+    distanceTransform.SetBandWidth( bandWidth );
+
+  DistanceMapType::Pointer distanceMap;
+  cip::LabelMapType::Pointer nearestLabelMap;
   try
     {
-    distanceMap->Update();
+    distanceTransform.Update();
+    distanceMap = distanceTransform.GetQuantizedDistanceImage( resolution );
+    if ( nearestLabelMapFileName.compare( "NA" ) != 0 )
+      {
+      nearestLabelMap = distanceTransform.GetNearestLabelMap();
+      }
     }
-  catch ( itk::ExceptionObject &excp )
+  catch ( cip::ExceptionObject &excp )
     {
     std::cerr << "Exception caught generating distance map:";
     std::cerr << excp << std::endl;
@@ -235,10 +221,27 @@ int main( int argc, char *argv[] )
     return cip::GENERATEDISTANCEMAPFAILURE;
     }
 
-  DistanceMapType::Pointer upSampledDistanceMap;
+  // The structures are at distance 0, so with their interior positive the
+  // distances outside them are negative
+  if ( interiorIsPositive )
+    {
+    DistanceMapIteratorType dIt( distanceMap, distanceMap->GetBufferedRegion() );
+    for ( dIt.GoToBegin(); !dIt.IsAtEnd(); ++dIt )
+      {
+      dIt.Set( -dIt.Get() );
+      }
+    }
 
-  std::cout << "Upsampling distance map..." << std::endl;
-  upSampledDistanceMap = ResampleImage( distanceMap->GetOutput(), 1.0/downsampleFactor );
+  DistanceMapType::Pointer upSampledDistanceMap = distanceMap;
+  if ( downsampleFactor != 1.0 )
+    {
+    std::cout << "Upsampling distance map..." << std::endl;
+    upSampledDistanceMap = ResampleImage( distanceMap, 1.0/downsampleFactor );
+    if ( nearestLabelMap.GetPointer() != NULL )
+      {
+      nearestLabelMap = ResampleImage( nearestLabelMap, 1.0/downsampleFactor );
+      }
+    }
 
   std::cout << "Writing to file..." << std::endl;
   WriterType::Pointer writer = WriterType::New();
@@ -257,6 +260,26 @@ int main( int argc, char *argv[] )
     return cip::LABELMAPWRITEFAILURE;
     }
 
+  if ( nearestLabelMap.GetPointer() != NULL )
+    {
+    std::cout << "Writing nearest label map..." << std::endl;
+    LabelMapWriterType::Pointer labelMapWriter = LabelMapWriterType::New();
+      labelMapWriter->SetInput( nearestLabelMap );
+      labelMapWriter->SetFileName( nearestLabelMapFileName );
+      labelMapWriter->UseCompressionOn();
+    try
+      {
+      labelMapWriter->Update();
+      }
+    catch ( itk::ExceptionObject &excp )
+      {
+      std::cerr << "Exception caught writing nearest label map:";
+      std::cerr << excp << std::endl;
+
+      return cip::LABELMAPWRITEFAILURE;
+      }
+    }
+
   std::cout << "DONE." << std::endl;
 
   return cip::EXITSUCCESS;
@@ -74,6 +74,7 @@
 #include "itkRegionOfInterestImageFilter.h"
 #include "itkExtractImageFilter.h"
 #include <sstream>
+#include <algorithm>
 #include "GenerateImageSubVolumesCLP.h"
 
 typedef itk::ImageRegionIteratorWithIndex< cip::LabelMapType >          LabelMapIteratorType;
@@ -91,22 +92,6 @@ int main( int argc, char *argv[] )
   unsigned int  roiLength  = (unsigned int) roiLengthInt; 
   unsigned int  overlap    = (unsigned int) overlapInt;
   
-  // Read the CT image
-  std::cout << "Reading CT from file..." << std::endl;
-  cip::CTReaderType::Pointer ctReader = cip::CTReaderType::New();
-    ctReader->SetFileName( ctFileName );
-  try
-    {
-    ctReader->Update();
-    }
-  catch ( itk::ExceptionObject &excp )
-    {
-    std::cerr << "Exception caught reading CT image:";
-    std::cerr << excp << std::endl;
-      
-    return cip::NRRDREADFAILURE;
-    }
-
   // Read the label map (if required)
   std::cout << "Reading label map image..." << std::endl;
   cip::LabelMapReaderType::Pointer labelMapReader = cip::LabelMapReaderType::New();
@@ -123,7 +108,7 @@ int main( int argc, char *argv[] )
     return cip::LABELMAPREADFAILURE;
     }
 
-  cip::CTType::SizeType size = ctReader->GetOutput()->GetBufferedRegion().GetSize();
+  cip::CTType::SizeType size = labelMapReader->GetOutput()->GetBufferedRegion().GetSize();
 
   // Now iterate over the label map image to determine
   // the bounding box. Anything in the foreground will
@@ -131,9 +116,9 @@ int main( int argc, char *argv[] )
   unsigned int xMax = 0;
   unsigned int yMax = 0;
   unsigned int zMax = 0;
-  unsigned int xMin = ctReader->GetOutput()->GetBufferedRegion().GetSize()[0];
-  unsigned int yMin = ctReader->GetOutput()->GetBufferedRegion().GetSize()[1];
-  unsigned int zMin = ctReader->GetOutput()->GetBufferedRegion().GetSize()[2];
+  unsigned int xMin = size[0];
+  unsigned int yMin = size[1];
+  unsigned int zMin = size[2];
 
   LabelMapIteratorType lIt( labelMapReader->GetOutput(), labelMapReader->GetOutput()->GetBufferedRegion() );
   
@@ -183,6 +168,35 @@ int main( int argc, char *argv[] )
 
   int radius = (roiLength-1)/2;
 
+  if ( xMin > xMax )
+    {
+    std::cout << "Label map has no foreground voxels. No sub-volumes to write." << std::endl;
+    std::cout << "DONE." << std::endl;
+
+    return cip::EXITSUCCESS;
+    }
+
+  // Only the part of the CT image that the sub-volumes can cover is read
+  cip::CTType::RegionType ctRegion;
+  for ( unsigned int d=0; d<3; d++ )
+    {
+    unsigned int dMin = (d == 0) ? xMin : (d == 1) ? yMin : zMin;
+    unsigned int dMax = (d == 0) ? xMax : (d == 1) ? yMax : zMax;
+
+    long first = std::max( long(dMin) - radius, 0L );
+    long last  = long(dMax) - radius + long(roiLength) - 1;
+
+    ctRegion.SetIndex( d, first );
+    ctRegion.SetSize( d, last - first + 1 );
+    }
+
+  std::cout << "Reading CT from file..." << std::endl;
+  cip::CTType::Pointer ctImage = cip::ReadCTFromFile( ctFileName, ctRegion );
+  if ( ctImage.IsNull() )
+    {
+    return cip::NRRDREADFAILURE;
+    }
+
   unsigned int fileNameIncrement = 0;
 
   int i, j, k;
@@ -250,7 +264,7 @@ int main( int argc, char *argv[] )
 		}
 	      
 	      roiRegion.SetSize( tmpSize );       
-  	      WriteSubVolume( ctReader->GetOutput(), labelMapReader->GetOutput(), roiRegion, ctSubVolumeFileNamePrefix,
+  	      WriteSubVolume( ctImage, labelMapReader->GetOutput(), roiRegion, ctSubVolumeFileNamePrefix,
   			      labelMapSubVolumeFileNamePrefix, writeLabelMapSubVolumes, &fileNameIncrement );
   	    }
   	}
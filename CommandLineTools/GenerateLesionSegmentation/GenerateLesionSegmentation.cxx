@@ -5,6 +5,17 @@
 #include "itkOrientImageFilter.h"
 #include "itkFixedArray.h"
 #include "itkLandmarkSpatialObject.h"
+#include "itkMultiThreader.h"
+#include "itkSimpleMutexLock.h"
+#include "itkImageRegionConstIterator.h"
+#include "itkImageRegionIterator.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include "itkLinearInterpolateImageFunction.h"
+#include "itksys/SystemTools.hxx"
+#include "cipHelper.h"
+
+#include <algorithm>
+#include <exception>
 
 // This needs to come after the other includes to prevent the global definitions
 // of PixelType to be shadowed by other declarations.
@@ -27,6 +38,27 @@ typedef itk::ImageFileReader< InputImageType > InputReaderType;
 typedef itk::ImageFileWriter< RealImageType > OutputWriterType;
 typedef itk::LesionSegmentationImageFilter8< InputImageType, RealImageType > SegmentationFilterType;
 
+typedef itk::LungWallFeatureGenerator< ImageDimension > LungWallGeneratorType;
+typedef itk::ImageSpatialObject< ImageDimension, PixelType > InputImageSpatialObjectType;
+typedef SegmentationFilterType::LungWallFeatureImageType LungWallFeatureImageType;
+typedef itk::ImageSpatialObject< ImageDimension, float > LungWallFeatureSpatialObjectType;
+
+// Shared by the threads that segment the lesions of the separate seeds. Each
+// thread takes the next seed that has not been segmented yet.
+struct LESIONTHREADSTRUCT
+{
+  InputImageType::ConstPointer                  image;
+  LungWallFeatureImageType::ConstPointer        lungWallFeature;
+  std::vector< std::vector< float > >           seeds;
+  float                                         maximumRadius;
+  std::vector< float >                          sigma;
+  bool                                          partSolid;
+  unsigned int                                  numberOfThreadsPerLesion;
+  std::vector< RealImageType::Pointer >         levelSets;
+  unsigned int                                  nextSeed;
+  itk::SimpleMutexLock                          mutex;
+};
+
 PointListType GetSeeds(std::vector<std::vector<float> > seeds,InputImageType *image)
 {
   
@@ -59,33 +91,184 @@ PointListType GetSeeds(std::vector<std::vector<float> > seeds,InputImageType *im
 }
 
 
-// --------------------------------------------------------------------------
-int main( int argc, char * argv[] )
+void SetSegmentationParameters( SegmentationFilterType* seg, const std::vector< float >& sigma, bool partSolid )
 {
+  if (sigma[0]>0 && sigma[1] >0 && sigma[2]>0)
+    {
+    itk::FixedArray< double, 3 > sigVector;
+    sigVector[0]=sigma[0];
+    sigVector[1]=sigma[1];
+    sigVector[2]=sigma[2];
+    seg->SetSigma(sigVector);
+    }
+  seg->SetSigmoidBeta(partSolid ? -500 : -200 );
+}
 
-  PARSE_ARGS;
 
+// Segment the lesion of seed 'i' within 'maximumRadius' of it. The filter
+// gets a copy of the region, so that pipelines running in several threads
+// never update the shared image.
+void SegmentLesion( LESIONTHREADSTRUCT* str, unsigned int i )
+{
+  double lower[3], upper[3];
+  for (unsigned int d = 0; d < ImageDimension; d++)
+    {
+    lower[d] = str->seeds[i][d] - str->maximumRadius;
+    upper[d] = str->seeds[i][d] + str->maximumRadius;
+    }
 
-  // Read the volume
-  InputReaderType::Pointer reader = InputReaderType::New();
-  InputImageType::Pointer image;
+  InputImageType::RegionType region =
+    cip::GetRegionFromPhysicalBounds(str->image, lower, upper, 0);
 
+  InputImageType::PointType pointSeed;
+  IndexType indexSeed;
+  for (unsigned int d = 0; d < ImageDimension; d++)
+    {
+    pointSeed[d] = str->seeds[i][d];
+    }
+  str->image->TransformPhysicalPointToIndex(pointSeed, indexSeed);
+  if (!region.IsInside(indexSeed))
+    {
+    str->mutex.Lock();
+    std::cerr << "Seed " << i+1 << " with pixel units of index: " << indexSeed
+              << " does not lie within the image. The images extents are"
+              << str->image->GetBufferedRegion() << std::endl;
+    str->mutex.Unlock();
+    return;
+    }
+
+  InputImageType::Pointer roiImage = InputImageType::New();
+  roiImage->CopyInformation(str->image);
+  roiImage->SetRegions(region);
+  roiImage->Allocate();
+
+  itk::ImageRegionConstIterator< InputImageType > iti(str->image, region);
+  itk::ImageRegionIterator< InputImageType >      ito(roiImage, region);
+  for (iti.GoToBegin(), ito.GoToBegin(); !ito.IsAtEnd(); ++iti, ++ito)
+    {
+    ito.Set(iti.Get());
+    }
+
+  PointListType seedsList(1);
+  seedsList[0].SetPosition(str->seeds[i][0], str->seeds[i][1], str->seeds[i][2]);
+
+  SegmentationFilterType::Pointer seg = SegmentationFilterType::New();
+  seg->SetInput(roiImage);
+  seg->SetSeeds(seedsList);
+  seg->SetRegionOfInterest(region);
+  seg->SetLungWallFeature(str->lungWallFeature);
+  SetSegmentationParameters(seg, str->sigma, str->partSolid);
+  seg->SetNumberOfThreads(str->numberOfThreadsPerLesion);
+
+  double startTime = itksys::SystemTools::GetTime();
+  seg->Update();
+
+  RealImageType::Pointer levelSet = seg->GetOutput();
+  levelSet->DisconnectPipeline();
+
+  str->mutex.Lock();
+  str->levelSets[i] = levelSet;
+  std::cout << "Lesion " << i+1 << " segmented in "
+            << itksys::SystemTools::GetTime() - startTime << " s" << std::endl;
+  str->mutex.Unlock();
+}
+
+
+ITK_THREAD_RETURN_TYPE SegmentLesionsThreaderCallback( void* arg )
+{
+  LESIONTHREADSTRUCT* str = static_cast< LESIONTHREADSTRUCT* >(
+    static_cast< itk::MultiThreader::ThreadInfoStruct* >( arg )->UserData );
+
+  while ( true )
+    {
+    str->mutex.Lock();
+    unsigned int i = str->nextSeed++;
+    str->mutex.Unlock();
+
+    if ( i >= str->seeds.size() )
+      {
+      break;
+      }
+
+    try
+      {
+      SegmentLesion( str, i );
+      }
+    catch ( itk::ExceptionObject& excp )
+      {
+      str->mutex.Lock();
+      std::cerr << "Exception caught while segmenting lesion " << i+1 << ":";
+      std::cerr << excp << std::endl;
+      str->mutex.Unlock();
+      }
+    catch ( std::exception& excp )
+      {
+      // E.g. std::bad_alloc, which must not take down the other lesions
+      str->mutex.Lock();
+      std::cerr << "Exception caught while segmenting lesion " << i+1 << ": ";
+      std::cerr << excp.what() << std::endl;
+      str->mutex.Unlock();
+      }
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+
+// Segment each seed as a separate lesion. The part of the scan around the
+// seeds is read, oriented and has its lung wall feature computed once, and
+// the lesions are then segmented concurrently. Lesion i is written to the
+// label map with label i+1; where lesions overlap, the first seed wins. The
+// label map has the grid of the input scan.
+int SegmentSeparateLesions( const std::string& inputImage, const std::vector< std::vector< float > >& seeds,
+                            float maximumRadius, const std::vector< float >& sigma, bool partSolid,
+                            int numberOfThreads, const std::string& outputLabelMap )
+{
+  if (seeds.empty())
+    {
+    std::cerr << "At least one seed is required" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  InputReaderType::Pointer reader = InputReaderType::New();
   reader->SetFileName(inputImage);
-  
   try {
-    reader->Update();
+    reader->UpdateOutputInformation();
   } catch (itk::ExceptionObject &excp) {
     std::cerr << "Exception caught while reading image:";
     std::cerr << excp << std::endl;
     return EXIT_FAILURE;
   }
 
-  image=reader->GetOutput();
+  // Only the bounding box of all the lesions' regions is read
+  double lower[3], upper[3];
+  for (unsigned int d = 0; d < ImageDimension; d++)
+    {
+    lower[d] = itk::NumericTraits< double >::max();
+    upper[d] = itk::NumericTraits< double >::NonpositiveMin();
+    for (unsigned int i = 0; i < seeds.size(); i++)
+      {
+      lower[d] = std::min(lower[d], double(seeds[i][d] - maximumRadius));
+      upper[d] = std::max(upper[d], double(seeds[i][d] + maximumRadius));
+      }
+    }
 
-  //To make sure the tumor polydata aligns with the image volume during
-  //vtk rendering in ViewImageAndSegmentationSurface(),
-  //reorient image so that the direction matrix is an identity matrix.
-  typedef itk::ImageFileReader< InputImageType > InputReaderType;
+  InputImageType::RegionType readRegion =
+    cip::GetRegionFromPhysicalBounds(reader->GetOutput(), lower, upper, 2);
+  if (readRegion.GetNumberOfPixels() == 0)
+    {
+    std::cerr << "The seeds' regions have no overlap with the image region of"
+              << reader->GetOutput()->GetLargestPossibleRegion() << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  InputImageType::Pointer image = cip::ReadCTFromFile(inputImage, readRegion);
+  if (image.IsNull())
+    {
+    return EXIT_FAILURE;
+    }
+
+  // See the single lesion case for why the image is reoriented
   itk::OrientImageFilter<InputImageType,InputImageType>::Pointer orienter =
   itk::OrientImageFilter<InputImageType,InputImageType>::New();
   orienter->UseImageDirectionOn();
@@ -95,28 +278,235 @@ int main( int argc, char * argv[] )
   orienter->SetInput(image);
   orienter->Update();
   image = orienter->GetOutput();
+  image->DisconnectPipeline();
+
+  std::cout << "Computing the lung wall feature." << std::endl;
+  InputImageSpatialObjectType::Pointer imageObject = InputImageSpatialObjectType::New();
+  imageObject->SetImage(image);
+
+  LungWallGeneratorType::Pointer lungWall = LungWallGeneratorType::New();
+  lungWall->SetInput(imageObject);
+  lungWall->SetLungThreshold(-400);
+  lungWall->Update();
+
+  const LungWallFeatureSpatialObjectType* lungWallObject =
+    dynamic_cast< const LungWallFeatureSpatialObjectType* >(lungWall->GetFeature());
+
+  LESIONTHREADSTRUCT str;
+  str.image           = image;
+  str.lungWallFeature = lungWallObject->GetImage();
+  str.seeds           = seeds;
+  str.maximumRadius   = maximumRadius;
+  str.sigma           = sigma;
+  str.partSolid       = partSolid;
+  str.levelSets.resize(seeds.size());
+  str.nextSeed        = 0;
+
+  unsigned int numberOfSeeds = static_cast< unsigned int >( seeds.size() );
+  if ( numberOfThreads <= 0 )
+    {
+    numberOfThreads = itk::MultiThreader::GetGlobalDefaultNumberOfThreads();
+    }
+  if ( static_cast< unsigned int >( numberOfThreads ) > numberOfSeeds )
+    {
+    numberOfThreads = numberOfSeeds;
+    }
+
+  std::cout << "\n Segmenting " << numberOfSeeds << " lesions, "
+            << numberOfThreads << " at a time." << std::endl;
+
+  // The cores are shared between the lesions segmented at the same time
+  // rather than each of them using all the cores
+  str.numberOfThreadsPerLesion = static_cast< unsigned int >(
+    std::max( 1, int(itk::MultiThreader::GetGlobalDefaultNumberOfThreads())/numberOfThreads ) );
+
+  itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+    threader->SetNumberOfThreads( numberOfThreads );
+    threader->SetSingleMethod( SegmentLesionsThreaderCallback, &str );
+    threader->SingleMethodExecute();
+
+  // Label the voxels of the scan that are inside each level set. The
+  // label map has the grid of the whole input scan (not of the reoriented
+  // part of it that was read), and each lesion is pasted into it by
+  // sampling its level set at the scan's voxels around the lesion's seed.
+  const InputImageType* scanInformation = reader->GetOutput();
 
+  cip::LabelMapType::Pointer labelMap = cip::LabelMapType::New();
+  labelMap->CopyInformation(scanInformation);
+  labelMap->SetRegions(scanInformation->GetLargestPossibleRegion());
+  labelMap->Allocate();
+  labelMap->FillBuffer(0);
+
+  typedef itk::LinearInterpolateImageFunction< RealImageType, double > InterpolatorType;
+  InterpolatorType::Pointer interpolator = InterpolatorType::New();
+
+  bool failed = false;
+  for (unsigned int i = 0; i < numberOfSeeds; i++)
+    {
+    if (str.levelSets[i].IsNull())
+      {
+      failed = true;
+      continue;
+      }
 
-  // Compute the ROI region
-  InputImageType::RegionType region = image->GetLargestPossibleRegion();
+    interpolator->SetInputImage(str.levelSets[i]);
+
+    double lesionLower[3], lesionUpper[3];
+    for (unsigned int d = 0; d < ImageDimension; d++)
+      {
+      lesionLower[d] = seeds[i][d] - maximumRadius;
+      lesionUpper[d] = seeds[i][d] + maximumRadius;
+      }
+    cip::LabelMapType::RegionType lesionRegion =
+      cip::GetRegionFromPhysicalBounds(labelMap.GetPointer(), lesionLower, lesionUpper, 1);
+
+    InputImageType::PointType point;
+    InterpolatorType::ContinuousIndexType index;
+    itk::ImageRegionIteratorWithIndex< cip::LabelMapType > it(labelMap, lesionRegion);
+    for (it.GoToBegin(); !it.IsAtEnd(); ++it)
+      {
+      if (it.Get() != 0)
+        {
+        continue;
+        }
+      labelMap->TransformIndexToPhysicalPoint(it.GetIndex(), point);
+      str.levelSets[i]->TransformPhysicalPointToContinuousIndex(point, index);
+
+      // The lesion's boundary is the -0.5 isosurface, with negative
+      // values inside
+      if (interpolator->IsInsideBuffer(index) &&
+          interpolator->EvaluateAtContinuousIndex(index) < -0.5)
+        {
+        it.Set(static_cast< unsigned short >(i + 1));
+        }
+      }
+    }
+
+  std::cout << "Writing the output label map " << outputLabelMap << std::endl;
+  typedef itk::ImageFileWriter< cip::LabelMapType > LabelMapWriterType;
+  LabelMapWriterType::Pointer writer = LabelMapWriterType::New();
+  writer->SetFileName(outputLabelMap);
+  writer->SetInput(labelMap);
+  writer->UseCompressionOn();
+  try {
+    writer->Update();
+  } catch (itk::ExceptionObject &excp) {
+    std::cerr << "Exception caught while writing label map:";
+    std::cerr << excp << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+
+// --------------------------------------------------------------------------
+int main( int argc, char * argv[] )
+{
+
+  PARSE_ARGS;
+
+  if (separateSeeds)
+    {
+    if (outputLabelMap.empty() || outputLabelMap.compare("NA") == 0)
+      {
+      std::cerr << "An output label map is required to segment separate lesions" << std::endl;
+      return EXIT_FAILURE;
+      }
+    return SegmentSeparateLesions(inputImage, seedsFiducials, maximumRadius, sigma, partSolid,
+                                  numberOfThreads, outputLabelMap);
+    }
 
   if (roi.size()!=6) {
     std::cerr <<"ROI should have six elements"<<std::endl;
     return EXIT_FAILURE;
   }
-  
-  if (roi[0] == 0 && roi[1] == 0 && roi[2]==0 &&
-      roi[3] == 0 && roi[4] ==0 && roi[5]==0){
+
+  bool roiFromSeed = (roi[0] == 0 && roi[1] == 0 && roi[2]==0 &&
+                      roi[3] == 0 && roi[4] ==0 && roi[5]==0);
+  if (roiFromSeed){
     //Compute ROI from seed and maximum Radius
-    PointListType seeds=GetSeeds(seedsFiducials,image);
-    seeds[0];
+    if (seedsFiducials.empty()) {
+      std::cerr <<"A seed is required when no ROI is given"<<std::endl;
+      return EXIT_FAILURE;
+    }
     for (int i=0; i < 3; i++)
     {
-      roi[2*i]= seeds[0].GetPosition()[i] - maximumRadius;
-      roi[2*i+1]= seeds[0].GetPosition()[i] + maximumRadius;
+      roi[2*i]= seedsFiducials[0][i] - maximumRadius;
+      roi[2*i+1]= seedsFiducials[0][i] + maximumRadius;
     }
   }
-  
+
+  // Read the volume. Only the part of it around the ROI is loaded,
+  // with a margin of a couple of voxels for rounding.
+  InputReaderType::Pointer reader = InputReaderType::New();
+  InputImageType::Pointer image;
+
+  reader->SetFileName(inputImage);
+
+  try {
+    reader->UpdateOutputInformation();
+  } catch (itk::ExceptionObject &excp) {
+    std::cerr << "Exception caught while reading image:";
+    std::cerr << excp << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // The ROI around a seed outside the volume would be empty or clipped
+  if (roiFromSeed)
+    {
+    InputImageType::PointType pointSeed;
+    pointSeed[0] = seedsFiducials[0][0];
+    pointSeed[1] = seedsFiducials[0][1];
+    pointSeed[2] = seedsFiducials[0][2];
+    IndexType indexSeed;
+    reader->GetOutput()->TransformPhysicalPointToIndex(pointSeed, indexSeed);
+    if (!reader->GetOutput()->GetLargestPossibleRegion().IsInside(indexSeed))
+      {
+      std::cerr << "Seed " << pointSeed << " (index " << indexSeed
+                << ") does not lie within the image. The image's extents are "
+                << reader->GetOutput()->GetLargestPossibleRegion() << std::endl;
+      return EXIT_FAILURE;
+      }
+    }
+
+  double lower[3], upper[3];
+  for (unsigned int i = 0; i < ImageDimension; i++)
+    {
+    lower[i] = std::min(roi[2*i], roi[2*i+1]);
+    upper[i] = std::max(roi[2*i], roi[2*i+1]);
+    }
+
+  InputImageType::RegionType readRegion =
+    cip::GetRegionFromPhysicalBounds(reader->GetOutput(), lower, upper, 2);
+  if (readRegion.GetNumberOfPixels() == 0)
+    {
+    std::cerr << "ROI region has no overlap with the image region of"
+              << reader->GetOutput()->GetLargestPossibleRegion() << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  image = cip::ReadCTFromFile(inputImage, readRegion);
+  if (image.IsNull())
+    {
+    return EXIT_FAILURE;
+    }
+
+  //To make sure the tumor polydata aligns with the image volume during
+  //vtk rendering in ViewImageAndSegmentationSurface(),
+  //reorient image so that the direction matrix is an identity matrix.
+  typedef itk::ImageFileReader< InputImageType > InputReaderType;
+  itk::OrientImageFilter<InputImageType,InputImageType>::Pointer orienter =
+  itk::OrientImageFilter<InputImageType,InputImageType>::New();
+  orienter->UseImageDirectionOn();
+  InputImageType::DirectionType direction;
+  direction.SetIdentity();
+  orienter->SetDesiredCoordinateDirection (direction);
+  orienter->SetInput(image);
+  orienter->Update();
+  image = orienter->GetOutput();
+
+
   // convert bounds into region indices
   InputImageType::PointType p1, p2;
   InputImageType::IndexType pi1, pi2;
@@ -195,15 +585,7 @@ int main( int argc, char * argv[] )
   //  ProgressReporterType::New();
   //seg->AddObserver( itk::ProgressEvent(), progressCommand );
   
-  if (sigma[0]>0 && sigma[1] >0 && sigma[2]>0)
-    {
-    itk::FixedArray< double, 3 > sigVector;
-    sigVector[0]=sigma[0];
-    sigVector[1]=sigma[1];
-    sigVector[2]=sigma[2];
-    seg->SetSigma(sigVector);
-    }
-  seg->SetSigmoidBeta(partSolid ? -500 : -200 );
+  SetSegmentationParameters(seg, sigma, partSolid);
   seg->Update();
 
 
@@ -1,4 +1,10 @@
 #include "itkTestMain.h"
+#include "itkImage.h"
+#include "itkImageFileReader.h"
+#include "itkImageFileWriter.h"
+#include "itkImageRegionIteratorWithIndex.h"
+
+#include <sstream>
 
 #if defined(WIN32) && !defined(USE_STATIC_CIP_LIBS)
 #define MODULE_IMPORT __declspec(dllimport)
@@ -9,8 +15,149 @@
 // Comment copied from ThesholdTest.cxx; This will be linked against the ModuleEntryPoint in RealignLib
 extern "C" MODULE_IMPORT int ModuleEntryPoint(int, char * []);
 
+// Segments two synthetic nodules with --separateSeeds and checks that each
+// nodule is labeled with its seed's index plus one. The only argument is the
+// directory the synthetic scan and the label map are written to.
+int SeparateSeedsEntryPoint( int argc, char* argv[] )
+{
+  if ( argc < 2 )
+    {
+    std::cerr << "Usage: " << argv[0] << " outputDirectory" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  typedef itk::Image< short, 3 >           CTType;
+  typedef itk::Image< unsigned short, 3 >  LabelMapType;
+
+  const std::string ctFileName = std::string( argv[1] ) + "/GenerateLesionSegmentation_SeparateSeeds_ct.nrrd";
+  const std::string labelMapFileName = std::string( argv[1] ) + "/GenerateLesionSegmentation_SeparateSeeds_lm.nrrd";
+
+  // Lung parenchyma with two solid nodules of radius 5 mm, 20 mm apart
+  const double center[2][3] = { {14.0, 24.0, 24.0}, {34.0, 24.0, 24.0} };
+  const double radius = 5.0;
+
+  CTType::SizeType size;
+    size.Fill( 48 );
+
+  CTType::Pointer ct = CTType::New();
+    ct->SetRegions( size );
+    ct->Allocate();
+
+  itk::ImageRegionIteratorWithIndex< CTType > it( ct, ct->GetBufferedRegion() );
+  for ( it.GoToBegin(); !it.IsAtEnd(); ++it )
+    {
+    short value = -850;
+    for ( unsigned int n=0; n<2; n++ )
+      {
+      double distance2 = 0.0;
+      for ( unsigned int d=0; d<3; d++ )
+        {
+        distance2 += (it.GetIndex()[d] - center[n][d])*(it.GetIndex()[d] - center[n][d]);
+        }
+      if ( distance2 <= radius*radius )
+        {
+        value = 30;
+        }
+      }
+    it.Set( value );
+    }
+
+  itk::ImageFileWriter< CTType >::Pointer writer = itk::ImageFileWriter< CTType >::New();
+    writer->SetFileName( ctFileName );
+    writer->SetInput( ct );
+    writer->Update();
+
+  std::vector< std::string > arguments;
+  arguments.push_back( argv[0] );
+  arguments.push_back( "-i" );
+  arguments.push_back( ctFileName );
+  arguments.push_back( "--outLabelMap" );
+  arguments.push_back( labelMapFileName );
+  for ( unsigned int n=0; n<2; n++ )
+    {
+    std::stringstream seed;
+    seed << center[n][0] << "," << center[n][1] << "," << center[n][2];
+    arguments.push_back( "--seeds" );
+    arguments.push_back( seed.str() );
+    }
+  arguments.push_back( "--maximumRadius" );
+  arguments.push_back( "9" );
+  arguments.push_back( "--separateSeeds" );
+  arguments.push_back( "--threads" );
+  arguments.push_back( "2" );
+
+  std::vector< char* > moduleArgv;
+  for ( unsigned int i=0; i<arguments.size(); i++ )
+    {
+    moduleArgv.push_back( const_cast< char* >( arguments[i].c_str() ) );
+    }
+  moduleArgv.push_back( NULL );
+
+  if ( ModuleEntryPoint( int(arguments.size()), &moduleArgv[0] ) != EXIT_SUCCESS )
+    {
+    std::cout << "FAILED" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  itk::ImageFileReader< LabelMapType >::Pointer reader = itk::ImageFileReader< LabelMapType >::New();
+    reader->SetFileName( labelMapFileName );
+    reader->Update();
+
+  // Every labeled voxel must be within its nodule's search radius, and the
+  // center of each nodule must carry its seed's label
+  unsigned int numMislabeled = 0;
+  itk::ImageRegionIteratorWithIndex< LabelMapType > lIt( reader->GetOutput(), reader->GetOutput()->GetBufferedRegion() );
+  for ( lIt.GoToBegin(); !lIt.IsAtEnd(); ++lIt )
+    {
+    unsigned short label = lIt.Get();
+    if ( label == 0 )
+      {
+      continue;
+      }
+    if ( label > 2 )
+      {
+      numMislabeled++;
+      continue;
+      }
+
+    double distance2 = 0.0;
+    for ( unsigned int d=0; d<3; d++ )
+      {
+      distance2 += (lIt.GetIndex()[d] - center[label-1][d])*(lIt.GetIndex()[d] - center[label-1][d]);
+      }
+    if ( distance2 > 9.0*9.0 )
+      {
+      numMislabeled++;
+      }
+    }
+
+  for ( unsigned int n=0; n<2; n++ )
+    {
+    LabelMapType::IndexType index;
+    for ( unsigned int d=0; d<3; d++ )
+      {
+      index[d] = static_cast< LabelMapType::IndexValueType >( center[n][d] );
+      }
+    if ( reader->GetOutput()->GetPixel( index ) != n + 1 )
+      {
+      numMislabeled++;
+      }
+    }
+  std::cout << "Mislabeled voxels: " << numMislabeled << std::endl;
+
+  if ( numMislabeled > 0 )
+    {
+    std::cout << "FAILED" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  std::cout << "PASSED" << std::endl;
+  return EXIT_SUCCESS;
+}
+
 
 void RegisterTests()
 {
   StringToTestFunctionMap["ModuleEntryPoint"] = ModuleEntryPoint;
+  StringToTestFunctionMap["SeparateSeedsEntryPoint"] = SeparateSeedsEntryPoint;
 }
@@ -47,6 +47,8 @@
 #include "GenerateLobeSurfaceModelsCLP.h"
 #include "cipMacro.h"
 #include "itksys/Directory.hxx"
+#include "itksys/SystemTools.hxx"
+#include <sstream>
 
 void GetResourceFiles( std::string, std::vector< std::string >*, std::vector< std::string >* );
 
@@ -76,8 +78,6 @@ int main( int argc, char *argv[] )
   // training data to the reference dataset and the files for the training
   // data can be found in ~/Processed/Atlases/LungLobeAtlases
 
-  unsigned int numTrainingSets = trainTransformFileVec.size();
-
   std::cout << "Reading fixed image..." << std::endl;
   ImageReaderType::Pointer fixedReader = ImageReaderType::New();
     fixedReader->SetFileName( inputFileName );
@@ -139,46 +139,86 @@ int main( int argc, char *argv[] )
   // coordinate frame
   TransformType::Pointer refToInputTransform = TransformType::New();
 
-  ImageType::Pointer subSampledFixedImage = ImageType::New();
+  // The registration is cached (when a cache directory is given) under a
+  // name derived from the two label maps and the registration parameters
+  std::string cacheFileName;
+  if ( cacheDir.compare( "NA" ) != 0 )
+    {
+    std::vector< std::string > registeredFiles;
+      registeredFiles.push_back( inputFileName );
+      registeredFiles.push_back( refImageFileName );
 
-  std::cout << "Subsampling fixed image..." << std::endl;
-  ResampleImage( fixedReader->GetOutput(), subSampledFixedImage, downsampleFactor );
+    std::stringstream parameters;
+      parameters << downsampleFactor << " " << maxStepLength << " " << minStepLength << " "
+		 << translationScale << " " << numberOfIterations << " " << multiResolution << " "
+		 << numberOfLevels << " " << numberOfSamples;
 
-  ImageType::Pointer subSampledMovingImage = ImageType::New();
+    cacheFileName = GetRegistrationCacheFileName( cacheDir, registeredFiles, parameters.str() );
+    }
 
-  std::cout << "Reading moving image..." << std::endl;
-  ImageReaderType::Pointer movingReader = ImageReaderType::New();
-    movingReader->SetFileName( refImageFileName );
-  try
+  if ( !cacheFileName.empty() && itksys::SystemTools::FileExists( cacheFileName.c_str(), true ) )
     {
-      movingReader->Update();
+    std::cout << "Reading cached reference to input transform " << cacheFileName << "..." << std::endl;
+    refToInputTransform = ReadTransformFromFile( cacheFileName.c_str() );
     }
-  catch ( itk::ExceptionObject &excp )
+  else
     {
-      std::cerr << "Exception caught while updating moving reader:";
-      std::cerr << excp << std::endl;
-    }
+    ImageType::Pointer subSampledFixedImage = ImageType::New();
+
+    std::cout << "Subsampling fixed image..." << std::endl;
+    ResampleImage( fixedReader->GetOutput(), subSampledFixedImage, downsampleFactor );
+
+    ImageType::Pointer subSampledMovingImage = ImageType::New();
+
+    std::cout << "Reading moving image..." << std::endl;
+    ImageReaderType::Pointer movingReader = ImageReaderType::New();
+      movingReader->SetFileName( refImageFileName );
+    try
+      {
+        movingReader->Update();
+      }
+    catch ( itk::ExceptionObject &excp )
+      {
+        std::cerr << "Exception caught while updating moving reader:";
+        std::cerr << excp << std::endl;
+      }
     
-  std::cout << "Subsampling moving image..." << std::endl;
-  ResampleImage( movingReader->GetOutput(), subSampledMovingImage, downsampleFactor );
-
-  // Now extract the whole lung region from the resized fixed and
-  // moving images
-  std::cout << "Extracting whole lung region from down sampled fixed image..." << std::endl;
-  LabelMapExtractorType::Pointer fixedExtractor = LabelMapExtractorType::New();
-    fixedExtractor->SetInput( subSampledFixedImage );
-    fixedExtractor->SetChestRegion( static_cast< unsigned char >( cip::WHOLELUNG ) );
-    fixedExtractor->Update();
-
-  std::cout << "Extracting whole lung region from down sampled moving image..." << std::endl;
-  LabelMapExtractorType::Pointer movingExtractor = LabelMapExtractorType::New();
-    movingExtractor->SetInput( subSampledMovingImage );
-    movingExtractor->SetChestRegion( static_cast< unsigned char >( cip::WHOLELUNG ) );
-    movingExtractor->Update();
-
-  std::cout << "Registering reference image to input image..." << std::endl;
-  refToInputTransform = RegisterLungs( fixedExtractor->GetOutput(), movingExtractor->GetOutput(), 
-  				       maxStepLength, minStepLength, translationScale, numberOfIterations );
+    std::cout << "Subsampling moving image..." << std::endl;
+    ResampleImage( movingReader->GetOutput(), subSampledMovingImage, downsampleFactor );
+
+    // Now extract the whole lung region from the resized fixed and
+    // moving images
+    std::cout << "Extracting whole lung region from down sampled fixed image..." << std::endl;
+    LabelMapExtractorType::Pointer fixedExtractor = LabelMapExtractorType::New();
+      fixedExtractor->SetInput( subSampledFixedImage );
+      fixedExtractor->SetChestRegion( static_cast< unsigned char >( cip::WHOLELUNG ) );
+      fixedExtractor->Update();
+
+    std::cout << "Extracting whole lung region from down sampled moving image..." << std::endl;
+    LabelMapExtractorType::Pointer movingExtractor = LabelMapExtractorType::New();
+      movingExtractor->SetInput( subSampledMovingImage );
+      movingExtractor->SetChestRegion( static_cast< unsigned char >( cip::WHOLELUNG ) );
+      movingExtractor->Update();
+
+    std::cout << "Registering reference image to input image..." << std::endl;
+    refToInputTransform = RegisterLungs( fixedExtractor->GetOutput(), movingExtractor->GetOutput(), 
+    				       maxStepLength, minStepLength, translationScale, numberOfIterations,
+	  			       multiResolution, numberOfLevels, numberOfSamples );
+
+    // The cache is optional: the run goes on if it cannot be written
+    if ( !cacheFileName.empty() )
+      {
+      if ( !itksys::SystemTools::MakeDirectory( cacheDir.c_str() ) )
+	{
+	std::cerr << "Could not create the cache directory " << cacheDir << std::endl;
+	}
+      else
+	{
+	std::cout << "Caching reference to input transform..." << std::endl;
+	WriteTransformToFile( refToInputTransform, cacheFileName );
+	}
+      }
+    }
 
   if ( outRefToInputTransformFileName.compare( "NA" ) != 0 )
     {
@@ -189,86 +229,18 @@ int main( int argc, char *argv[] )
   // Now that we have the transform that maps the reference image to
   // the input image, we need to read in and map all the training
   // points so that they are in the input image's coordinate frame.
-  // The following three vectors of vectors will contain all the
-  // points from the training set (transformed to be in the input
-  // image's coordinate frame)
-  std::vector< std::vector< ImageType::PointType > > loTransPointsVecVec;
-  std::vector< std::vector< ImageType::PointType > > roTransPointsVecVec;
-  std::vector< std::vector< ImageType::PointType > > rhTransPointsVecVec;
-
-  for ( unsigned int i=0; i<numTrainingSets; i++ )
-    {
-    // First read the transform
-    std::cout << "Reading transform from file..." << std::endl;
-    TransformType::Pointer transform = GetTransformFromFile( trainTransformFileVec[i].c_str() );
-
-    // Now read in the points
-    std::vector< ImageType::PointType > loPointsVec;
-    std::vector< ImageType::PointType > roPointsVec;
-    std::vector< ImageType::PointType > rhPointsVec;
-    std::cout << "Reading fissure points from file..." << std::endl;
-    ReadFissurePointsFromFile( trainPointsFileVec[i].c_str(), &loPointsVec, &roPointsVec, &rhPointsVec );    
-
-    // Now that the points have been read in, we must transform them
-    // so that they are in the coordinate frame of the input
-    // image. To do this, we must first transform them so that they
-    // are in the reference image's coordinate frame, and then
-    // transform them so that they wind up in the input image's
-    // coordinate frame
-    for ( unsigned lo=0; lo<loPointsVec.size(); lo++ )
-      {
-      loPointsVec[lo] = transform->TransformPoint( loPointsVec[lo] );
-      loPointsVec[lo] = refToInputTransform->TransformPoint( loPointsVec[lo] );
-      }
-    loTransPointsVecVec.push_back( loPointsVec );
-
-    for ( unsigned ro=0; ro<roPointsVec.size(); ro++ )
-      {
-      roPointsVec[ro] = transform->TransformPoint( roPointsVec[ro] );
-      roPointsVec[ro] = refToInputTransform->TransformPoint( roPointsVec[ro] );
-      }
-    roTransPointsVecVec.push_back( roPointsVec );
-
-    for ( unsigned rh=0; rh<rhPointsVec.size(); rh++ )
-      {
-      rhPointsVec[rh] = transform->TransformPoint( rhPointsVec[rh] );
-      rhPointsVec[rh] = refToInputTransform->TransformPoint( rhPointsVec[rh] );
-      }
-    rhTransPointsVecVec.push_back( rhPointsVec );
-    }
-
-  // Now we have the domain locations for each of our three
-  // boundaries. To build our PCA model, we need to evaluate the z
-  // values at the domain locations for each of our training 
-  // datasets. THe right oblique ('ro') and right horizontal ('rh')
-  // are evaluated separately, but then collected ('right').
+  // We then need to evaluate the z values at the domain locations
+  // for each of our training datasets to build our PCA model. The
+  // right oblique ('ro') and right horizontal ('rh') are evaluated
+  // separately, but then collected ('right'). The training cases are
+  // evaluated concurrently.
   std::cout << "Getting range locations..." << std::endl;
   std::vector< std::vector< double > > loRangeValuesVecVec;
   std::vector< std::vector< double > > rightRangeValuesVecVec;
 
-  for ( unsigned int i=0; i<numTrainingSets; i++ )
-    {
-    std::vector< double > roRangeValuesVec;
-    std::vector< double > rhRangeValuesVec;
-    std::vector< double > loRangeValuesVec;
-    std::vector< double > rightRangeValuesVec;
-
-    GetZValuesFromTPS( rightDomainPatternPoints, &roRangeValuesVec, roTransPointsVecVec[i], fixedReader->GetOutput() );
-    GetZValuesFromTPS( rightDomainPatternPoints, &rhRangeValuesVec, rhTransPointsVecVec[i], fixedReader->GetOutput() );
-    GetZValuesFromTPS( leftDomainPatternPoints, &loRangeValuesVec, loTransPointsVecVec[i], fixedReader->GetOutput() );
-
-    for ( unsigned int j=0; j<roRangeValuesVec.size(); j++ )
-      {
-	rightRangeValuesVec.push_back( roRangeValuesVec[j] );
-      }
-    for ( unsigned int j=0; j<rhRangeValuesVec.size(); j++ )
-      {
-	rightRangeValuesVec.push_back( rhRangeValuesVec[j] );
-      }
-
-    rightRangeValuesVecVec.push_back( rightRangeValuesVec );
-    loRangeValuesVecVec.push_back( loRangeValuesVec );
-    }
+  GetTrainingRangeValues( trainTransformFileVec, trainPointsFileVec, refToInputTransform, leftDomainPatternPoints,
+			  rightDomainPatternPoints, fixedReader->GetOutput(), &loRangeValuesVecVec, 
+			  &rightRangeValuesVecVec, numberOfThreads );
 
   // Now we have all the training information needed for building the
   // PCA-based fissure models for this case. 
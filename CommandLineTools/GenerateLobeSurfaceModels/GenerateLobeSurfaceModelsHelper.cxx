@@ -1,4 +1,27 @@
 #include "GenerateLobeSurfaceModelsHelper.h"
+#include "vnl/algo/vnl_svd.h"
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+
+// Work shared by the threads of GetTrainingRangeValues. Training cases
+// are handed out one at a time, so each thread only ever holds the
+// points of the case it is currently evaluating.
+struct TRAININGTHREADSTRUCT
+{
+  std::vector< TransformType::Pointer >*   trainTransforms;
+  std::vector< std::string >*              trainPointsFiles;
+  TransformType::Pointer                   refToInputTransform;
+  std::vector< ImageType::PointType >*     leftDomainPoints;
+  std::vector< ImageType::PointType >*     rightDomainPoints;
+  ImageType::Pointer                       image;
+  std::vector< std::vector< double > >*    loRangeValuesVecVec;
+  std::vector< std::vector< double > >*    rightRangeValuesVecVec;
+  unsigned int                             nextCase;
+  itk::SimpleFastMutexLock                 mutex;
+};
 
 void WriteTransformToFile( TransformType::Pointer transform, std::string fileName )
 {
@@ -75,8 +98,37 @@ void ResampleImage( ImageType::Pointer image, ImageType::Pointer subsampledROIIm
 } 
 
 TransformType::Pointer RegisterLungs( ImageType::Pointer fixedImage, ImageType::Pointer movingImage, 
-                                      float maxStepLength, float minStepLength, float translationScale, int numberOfIterations )
+                                      float maxStepLength, float minStepLength, float translationScale, int numberOfIterations,
+                                      bool multiResolution, unsigned int numberOfLevels, unsigned int numberOfSamples )
 {
+  if ( multiResolution )
+    {
+    MultiResolutionRegistrationType::Pointer registration = MultiResolutionRegistrationType::New();
+      registration->SetFixedImage( fixedImage );
+      registration->SetMovingImage( movingImage );
+      registration->BinarizeOn();
+      registration->SetNumberOfLevels( numberOfLevels );
+      registration->SetNumberOfSamples( numberOfSamples );
+      registration->SetMaximumStepLength( maxStepLength );
+      registration->SetMinimumStepLength( minStepLength );
+      registration->SetNumberOfIterations( numberOfIterations );
+      registration->SetTranslationScale( translationScale );
+    try 
+      { 
+      registration->Update(); 
+      } 
+    catch( itk::ExceptionObject &excp ) 
+      { 
+      std::cerr << "ExceptionObject caught while executing registration" << std::endl; 
+      std::cerr << excp << std::endl; 
+      } 
+
+    TransformType::Pointer finalTransform = registration->GetTransform();
+      finalTransform->GetInverse( finalTransform );
+
+    return finalTransform;
+    }
+
   cip::ChestConventions conventions;
   
   unsigned short foregroundValue = conventions.GetValueFromChestRegionAndType( static_cast< unsigned char >( cip::WHOLELUNG ), 
@@ -140,7 +192,7 @@ TransformType::Pointer RegisterLungs( ImageType::Pointer fixedImage, ImageType::
   return finalTransform;
 }
 
-TransformType::Pointer GetTransformFromFile( const char* fileName )
+TransformType::Pointer ReadTransformFromFile( const char* fileName )
 {
   itk::TransformFileReader::Pointer transformReader = itk::TransformFileReader::New();
     transformReader->SetFileName( fileName );
@@ -162,11 +214,65 @@ TransformType::Pointer GetTransformFromFile( const char* fileName )
 
   TransformType::Pointer transform = static_cast< TransformType* >( (*it).GetPointer() ); 
 
+  return transform;
+}
+
+// The training transform files map the reference image to the training
+// images, so the transform read from file is inverted
+TransformType::Pointer GetTransformFromFile( const char* fileName )
+{
+  TransformType::Pointer transform = ReadTransformFromFile( fileName );
+
   transform->GetInverse( transform );
 
   return transform;
 }
 
+// Registrations are cached under a name derived from the contents of the
+// images that were registered and from the registration parameters (a
+// 64-bit FNV-1a hash), so that changing any of them triggers a new
+// registration. An empty string is returned if a file can't be read.
+std::string GetRegistrationCacheFileName( std::string cacheDir, std::vector< std::string > fileNames,
+					  std::string parameters )
+{
+  const unsigned long long prime = 1099511628211ULL;
+  unsigned long long hash = 14695981039346656037ULL;
+
+  std::vector< char > buffer( 1 << 16 );
+
+  for ( unsigned int i=0; i<fileNames.size(); i++ )
+    {
+    std::ifstream file( fileNames[i].c_str(), std::ios::in | std::ios::binary );
+    if ( !file )
+      {
+      return std::string();
+      }
+
+    while ( file )
+      {
+      file.read( &buffer[0], buffer.size() );
+
+      std::streamsize numRead = file.gcount();
+      for ( std::streamsize b=0; b<numRead; b++ )
+	{
+	hash ^= static_cast< unsigned char >( buffer[b] );
+	hash *= prime;
+	}
+      }
+    }
+
+  for ( unsigned int c=0; c<parameters.size(); c++ )
+    {
+    hash ^= static_cast< unsigned char >( parameters[c] );
+    hash *= prime;
+    }
+
+  std::stringstream stream;
+  stream << cacheDir << "/refToInput_" << std::hex << std::setw( 16 ) << std::setfill( '0' ) << hash << ".tfm";
+
+  return stream.str();
+}
+
 void ReadFissurePointsFromFile( const std::string fileName, 
                                 std::vector< ImageType::PointType >* leftObliquePointsVec, 
                                 std::vector< ImageType::PointType >* rightObliquePointsVec, 
@@ -477,14 +583,125 @@ void GetZValuesFromTPS( std::vector< ImageType::PointType > domainPointsVec, std
     }
 }
 
-PCA GetLowDimensionPCA( std::vector< std::vector< double > > valuesVecVec )
+ITK_THREAD_RETURN_TYPE TrainingThreaderCallback( void* arg )
 {
-  PCA pcaModel;
+  TRAININGTHREADSTRUCT* str = static_cast< TRAININGTHREADSTRUCT* >
+    ( static_cast< itk::MultiThreader::ThreadInfoStruct* >( arg )->UserData );
 
-  pcaModel.numModes = 0;
+  unsigned int numCases = str->trainPointsFiles->size();
 
-  unsigned int numSamples  = valuesVecVec.size();
-  unsigned int dimension = (valuesVecVec[0]).size();
+  while ( true )
+    {
+    str->mutex.Lock();
+    unsigned int i = str->nextCase++;
+    str->mutex.Unlock();
+
+    if ( i >= numCases )
+      {
+      break;
+      }
+
+    std::vector< ImageType::PointType > loPointsVec;
+    std::vector< ImageType::PointType > roPointsVec;
+    std::vector< ImageType::PointType > rhPointsVec;
+    ReadFissurePointsFromFile( (*str->trainPointsFiles)[i], &loPointsVec, &roPointsVec, &rhPointsVec );
+
+    // Map the points to the reference image's coordinate frame and from
+    // there to the input image's coordinate frame
+    TransformType::Pointer transform = (*str->trainTransforms)[i];
+    for ( unsigned int lo=0; lo<loPointsVec.size(); lo++ )
+      {
+      loPointsVec[lo] = str->refToInputTransform->TransformPoint( transform->TransformPoint( loPointsVec[lo] ) );
+      }
+    for ( unsigned int ro=0; ro<roPointsVec.size(); ro++ )
+      {
+      roPointsVec[ro] = str->refToInputTransform->TransformPoint( transform->TransformPoint( roPointsVec[ro] ) );
+      }
+    for ( unsigned int rh=0; rh<rhPointsVec.size(); rh++ )
+      {
+      rhPointsVec[rh] = str->refToInputTransform->TransformPoint( transform->TransformPoint( rhPointsVec[rh] ) );
+      }
+
+    // The right oblique and right horizontal values are collected in a
+    // single vector
+    std::vector< double > rhRangeValuesVec;
+    std::vector< double >& rightRangeValuesVec = (*str->rightRangeValuesVecVec)[i];
+
+    GetZValuesFromTPS( *str->rightDomainPoints, &rightRangeValuesVec, roPointsVec, str->image );
+    GetZValuesFromTPS( *str->rightDomainPoints, &rhRangeValuesVec, rhPointsVec, str->image );
+    GetZValuesFromTPS( *str->leftDomainPoints, &(*str->loRangeValuesVecVec)[i], loPointsVec, str->image );
+
+    rightRangeValuesVec.insert( rightRangeValuesVec.end(), rhRangeValuesVec.begin(), rhRangeValuesVec.end() );
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+// Evaluate the TPS surfaces of all training cases at the domain
+// points. Cases are processed concurrently on 'numberOfThreads' threads
+// (0 uses the default number of threads); the results are stored in
+// training case order.
+void GetTrainingRangeValues( std::vector< std::string > trainTransformFileVec, std::vector< std::string > trainPointsFileVec,
+			     TransformType::Pointer refToInputTransform, std::vector< ImageType::PointType > leftDomainPoints,
+			     std::vector< ImageType::PointType > rightDomainPoints, ImageType::Pointer image,
+			     std::vector< std::vector< double > >* loRangeValuesVecVec,
+			     std::vector< std::vector< double > >* rightRangeValuesVecVec, unsigned int numberOfThreads )
+{
+  unsigned int numCases = trainPointsFileVec.size();
+
+  // The transforms are small; read them up front so that the threads
+  // only do file and point I/O that doesn't go through the ITK factories
+  std::vector< TransformType::Pointer > trainTransforms;
+  for ( unsigned int i=0; i<numCases; i++ )
+    {
+    trainTransforms.push_back( GetTransformFromFile( trainTransformFileVec[i].c_str() ) );
+    }
+
+  loRangeValuesVecVec->clear();
+  loRangeValuesVecVec->resize( numCases );
+  rightRangeValuesVecVec->clear();
+  rightRangeValuesVecVec->resize( numCases );
+
+  TRAININGTHREADSTRUCT str;
+    str.trainTransforms        = &trainTransforms;
+    str.trainPointsFiles       = &trainPointsFileVec;
+    str.refToInputTransform    = refToInputTransform;
+    str.leftDomainPoints       = &leftDomainPoints;
+    str.rightDomainPoints      = &rightDomainPoints;
+    str.image                  = image;
+    str.loRangeValuesVecVec    = loRangeValuesVecVec;
+    str.rightRangeValuesVecVec = rightRangeValuesVecVec;
+    str.nextCase               = 0;
+
+  if ( numberOfThreads == 0 )
+    {
+    numberOfThreads = itk::MultiThreader::GetGlobalDefaultNumberOfThreads();
+    }
+  if ( numberOfThreads > numCases )
+    {
+    numberOfThreads = numCases;
+    }
+
+  itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+    threader->SetNumberOfThreads( numberOfThreads );
+    threader->SetSingleMethod( TrainingThreaderCallback, &str );
+    threader->SingleMethodExecute();
+}
+
+// Both PCA variants below work on the SVD of the mean-centered (samples
+// x dimension) data matrix X = U S V^t rather than forming the
+// (dimension x dimension) covariance or the (samples x samples) snapshot
+// matrix XXt: the covariance eigenvectors are the right singular vectors
+// of X and the eigenvalues of XXt are the squared singular values. The
+// SVD is taken of whichever of X and X^t is taller, so its cost is
+// linear in the larger of the two sizes. The singular values and the
+// corresponding (dimension)-D singular vectors are returned in
+// decreasing order.
+void GetCenteredDataSVD( const std::vector< std::vector< double > >& valuesVecVec, std::vector< double >* meanVec,
+			 std::vector< double >* singularValues, std::vector< std::vector< double > >* singularVectors )
+{
+  unsigned int numSamples = valuesVecVec.size();
+  unsigned int dimension  = (valuesVecVec[0]).size();
 
   // First compute the mean
   for ( unsigned int d=0; d<dimension; d++ )
@@ -496,120 +713,150 @@ PCA GetLowDimensionPCA( std::vector< std::vector< double > > valuesVecVec )
       counter += (valuesVecVec[s])[d];
       }
 
-    double meanVal = counter/double( numSamples );
-
-    pcaModel.meanVec.push_back( meanVal );
+    (*meanVec).push_back( counter/static_cast< double >( numSamples ) );
     }
 
-  // Now construct the covariance S, which is a (dimension) X (dimension)
-  // matrix, each row of which contains a mean-centered training
-  // sample entry 
-  vnl_matrix< double > S( dimension, dimension );
-
-  for ( unsigned int r=0; r<dimension; r++ )
+  vnl_matrix< double > X( numSamples, dimension );
+  for ( unsigned int r=0; r<numSamples; r++ )
     {
-      for ( unsigned int c=0; c<dimension; c++ )
-	{
-	  S[r][c] = 0.0;
-	  for ( unsigned int d=0; d<numSamples; d++ )
-	    {	      
-	      S[r][c] += (1/double(numSamples))*((valuesVecVec[d])[r] - pcaModel.meanVec[r])*
-		((valuesVecVec[d])[c] - pcaModel.meanVec[c]);
-	    }
-	}
+    for ( unsigned int c=0; c<dimension; c++ )
+      {
+      X[r][c] = (valuesVecVec[r])[c] - (*meanVec)[c];
+      }
     }
 
-  // Now we need to get the eigenvalues and eigenvectors of S
-  vnl_symmetric_eigensystem< double >  eig( S );
-  
-  for ( unsigned int i=0; i<dimension; i++ )
+  if ( numSamples >= dimension )
     {
-      pcaModel.modeVec.push_back( 0.0 );
-      pcaModel.modeVec[i] = eig.get_eigenvalue( dimension-i-1 );
-      
-      pcaModel.numModes++;
+    vnl_svd< double > svd( X );
+
+    for ( unsigned int k=0; k<dimension; k++ )
+      {
+      (*singularValues).push_back( svd.W( k ) );
+
+      vnl_vector< double > v = svd.V().get_column( k );
+      (*singularVectors).push_back( std::vector< double >( v.begin(), v.end() ) );
+      }
     }
- 
-  // Get the eigenvectors
-  for ( unsigned int v=0; v<pcaModel.numModes; v++ )
+  else
     {
-      std::vector< double > modeVec;
-      for ( unsigned int d=0; d<dimension; d++ )
-	{
-	  modeVec.push_back( 0.0 );
-	}
-      
-      for ( unsigned int d=0; d<dimension; d++ )
-        {
-	  modeVec[d] = eig.get_eigenvector( dimension-v-1 )[d];
-        }
-      
-      pcaModel.modeVecVec.push_back( modeVec );
+    vnl_svd< double > svd( X.transpose() );
+
+    for ( unsigned int k=0; k<numSamples; k++ )
+      {
+      (*singularValues).push_back( svd.W( k ) );
+
+      vnl_vector< double > u = svd.U().get_column( k );
+      (*singularVectors).push_back( std::vector< double >( u.begin(), u.end() ) );
+      }
     }
-  
-  return pcaModel;   
 }
 
-PCA GetHighDimensionPCA( std::vector< std::vector< double > > valuesVecVec )
+PCA GetLowDimensionPCA( std::vector< std::vector< double > > valuesVecVec )
 {
   PCA pcaModel;
 
   pcaModel.numModes = 0;
 
-  unsigned int numVecs  = valuesVecVec.size();
-  unsigned int numZvals = (valuesVecVec[0]).size();
+  unsigned int numSamples = valuesVecVec.size();
+  unsigned int dimension  = (valuesVecVec[0]).size();
 
-  // First compute the mean
-  for ( unsigned int z=0; z<numZvals; z++ )
+  std::vector< double > singularValues;
+  std::vector< std::vector< double > > singularVectors;
+  GetCenteredDataSVD( valuesVecVec, &pcaModel.meanVec, &singularValues, &singularVectors );
+
+  // The eigenvalues of the covariance (1/numSamples)X^tX
+  for ( unsigned int i=0; i<singularValues.size(); i++ )
     {
-    double counter = 0.0;
+    pcaModel.modeVec.push_back( singularValues[i]*singularValues[i]/static_cast< double >( numSamples ) );
+    pcaModel.modeVecVec.push_back( singularVectors[i] );
 
-    for ( unsigned int v=0; v<numVecs; v++ )
+    pcaModel.numModes++;
+    }
+
+  // As with the eigensystem of the covariance, there are (dimension)
+  // modes. With fewer samples than that, the SVD only gives the first
+  // (numSamples); the others have a zero eigenvalue, and their vectors
+  // complete the basis: the coordinate axes, made orthonormal to the
+  // modes found so far (twice, for round-off).
+  for ( unsigned int d=0; d<dimension && pcaModel.numModes<dimension; d++ )
+    {
+    std::vector< double > modeVec( dimension, 0.0 );
+    modeVec[d] = 1.0;
+
+    for ( unsigned int pass=0; pass<2; pass++ )
       {
-      counter += (valuesVecVec[v])[z];
+      for ( unsigned int v=0; v<pcaModel.numModes; v++ )
+	{
+	double dot = 0.0;
+	for ( unsigned int k=0; k<dimension; k++ )
+	  {
+	  dot += modeVec[k]*(pcaModel.modeVecVec[v])[k];
+	  }
+	for ( unsigned int k=0; k<dimension; k++ )
+	  {
+	  modeVec[k] -= dot*(pcaModel.modeVecVec[v])[k];
+	  }
+	}
       }
 
-    double meanVal = counter/static_cast< double >( numVecs );
-
-    pcaModel.meanVec.push_back( meanVal );
-    }
+    double norm = 0.0;
+    for ( unsigned int k=0; k<dimension; k++ )
+      {
+      norm += modeVec[k]*modeVec[k];
+      }
+    norm = std::sqrt( norm );
 
-  // Now construct the matrix X, which is a (numVecs) X (numZvals)
-  // matrix, each row of which contains a mean-centered training
-  // sample entry 
-  vnl_matrix< double > X( numVecs, numZvals );
+    // Skip axes (nearly) in the span of the modes found so far
+    if ( norm < 0.5 )
+      {
+      continue;
+      }
 
-  for ( unsigned int r=0; r<numVecs; r++ )
-    {
-    for ( unsigned int c=0; c<numZvals; c++ )
+    for ( unsigned int k=0; k<dimension; k++ )
       {
-      X[r][c] = (valuesVecVec[r])[c] - pcaModel.meanVec[c];
+      modeVec[k] /= norm;
       }
+
+    pcaModel.modeVec.push_back( 0.0 );
+    pcaModel.modeVecVec.push_back( modeVec );
+
+    pcaModel.numModes++;
     }
 
-  // Construct XXt, which is the product of X and the transpose of
-  // X. We need this matrix for computing PCA.
-  vnl_matrix< double > Xt( numZvals, numVecs );
-  Xt = X.transpose();
+  return pcaModel;   
+}
+
+PCA GetHighDimensionPCA( std::vector< std::vector< double > > valuesVecVec )
+{
+  PCA pcaModel;
+
+  pcaModel.numModes = 0;
+
+  unsigned int numVecs  = valuesVecVec.size();
+  unsigned int numZvals = (valuesVecVec[0]).size();
 
-  vnl_matrix< double > XXt( numVecs, numVecs );
-  XXt = X*Xt;
+  std::vector< double > singularValues;
+  std::vector< std::vector< double > > singularVectors;
+  GetCenteredDataSVD( valuesVecVec, &pcaModel.meanVec, &singularValues, &singularVectors );
 
-  // Now we need to get the eigenvalues and eigenvectors of XXt
-  vnl_symmetric_eigensystem< double >  eig( XXt );
+  // Only modes with a non-zero eigenvalue of XXt are kept. Mean centering
+  // always removes at least one, which is only zero up to round-off, so
+  // singular values are compared against a relative tolerance.
+  double tolerance = 0.0;
+  if ( !singularValues.empty() )
+    {
+    tolerance = singularValues[0]*static_cast< double >( numZvals )*std::numeric_limits< double >::epsilon();
+    }
 
   for ( unsigned int i=0; i<numZvals; i++ )
     {
     pcaModel.modeVec.push_back( 0.0 );
 
-    if ( i<numVecs )
+    if ( i<singularValues.size() && singularValues[i] > tolerance )
       {
-      if ( eig.get_eigenvalue( numVecs-i-1 ) > 0.0 )
-        {
-        pcaModel.modeVec[i] = eig.get_eigenvalue( numVecs-i-1 );
+      pcaModel.modeVec[i] = singularValues[i]*singularValues[i];
 
-        pcaModel.numModes++;
-        }
+      pcaModel.numModes++;
       }
     }
 
@@ -621,31 +868,11 @@ PCA GetHighDimensionPCA( std::vector< std::vector< double > > valuesVecVec )
     pcaModel.modeVec[i] = pcaModel.modeVec[i]/static_cast< double >( pcaModel.numModes );
     }
 
-  // Finally, compute the eigenvalues in our (numZVals)-D space
+  // The left singular vectors of X^t are the unit length eigenvectors in
+  // our (numZVals)-D space
   for ( unsigned int v=0; v<pcaModel.numModes; v++ )
     {
-    std::vector< double > modeVec;
-    for ( unsigned int z=0; z<numZvals; z++ )
-      {
-      modeVec.push_back( 0.0 );
-      }
-
-    if ( pcaModel.modeVec[v] > 0.0 )
-      {
-      vnl_vector< double > u( numZvals );
-      
-      u = Xt*eig.get_eigenvector( numVecs-v-1 );
-
-      // Compute u's magnitude
-      double mag = vcl_sqrt( dot_product( u, u ) );
-
-      for ( unsigned int z=0; z<numZvals; z++ )
-        {
-        modeVec[z] = u[z]/mag;
-        }
-      }
-
-    pcaModel.modeVecVec.push_back( modeVec );
+    pcaModel.modeVecVec.push_back( singularVectors[v] );
     }
 
   return pcaModel;
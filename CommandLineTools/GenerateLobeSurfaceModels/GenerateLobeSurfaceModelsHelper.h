@@ -24,6 +24,9 @@
 #include "cipLobeSurfaceModel.h"
 #include "cipLobeSurfaceModelIO.h"
 #include "cipHelper.h"
+#include "itkCIPMultiResolutionAffineRegistration.h"
+#include "itkMultiThreader.h"
+#include "itkSimpleFastMutexLock.h"
 
 typedef itk::Image< unsigned short, 3 >                                             ImageType;
 typedef itk::Image< unsigned short, 2 >                                             ImageSliceType;
@@ -45,6 +48,7 @@ typedef itk::IdentityTransform< double, 3 >
 typedef itk::CIPExtractChestLabelMapImageFilter< 3 >                                LabelMapExtractorType;
 typedef itk::TransformFileReader::TransformListType*                                TransformListType;
 typedef itk::ContinuousIndex< double, 3 >                                           ContinuousIndexType;
+typedef itk::CIPMultiResolutionAffineRegistration< ImageType >                      MultiResolutionRegistrationType;
 
 struct PCA
 {
@@ -57,12 +61,17 @@ struct PCA
 
 void ResampleImage( ImageType::Pointer, ImageType::Pointer, float );
 
-TransformType::Pointer RegisterLungs( ImageType::Pointer, ImageType::Pointer, float, float, float, int );
+TransformType::Pointer RegisterLungs( ImageType::Pointer, ImageType::Pointer, float, float, float, int,
+				      bool, unsigned int, unsigned int );
 
 void WriteTransformToFile( TransformType::Pointer, std::string );
 
+TransformType::Pointer ReadTransformFromFile( const char* );
+
 TransformType::Pointer GetTransformFromFile( const char* );
 
+std::string GetRegistrationCacheFileName( std::string, std::vector< std::string >, std::string );
+
 void ReadFissurePointsFromFile( std::string, std::vector< ImageType::PointType >*,
 				std::vector< ImageType::PointType >*, std::vector< ImageType::PointType >* );
 
@@ -72,6 +81,10 @@ void GetDomainPoints( std::vector< std::vector< ImageType::PointType > >,
 void GetZValuesFromTPS( std::vector< ImageType::PointType >, std::vector< double >*,
 			std::vector< ImageType::PointType >, ImageType::Pointer );
 
+void GetTrainingRangeValues( std::vector< std::string >, std::vector< std::string >, TransformType::Pointer,
+			     std::vector< ImageType::PointType >, std::vector< ImageType::PointType >, ImageType::Pointer,
+			     std::vector< std::vector< double > >*, std::vector< std::vector< double > >*, unsigned int );
+
 PCA GetHighDimensionPCA( std::vector< std::vector< double > > );
 
 PCA GetLowDimensionPCA( std::vector< std::vector< double > > );
@@ -4,14 +4,14 @@
 #include "cipChestConventions.h"
 #include "itkImage.h"
 #include "itkImageRegionIteratorWithIndex.h"
-#include "itkMedianImageFilter.h"
+#include "itkCIPOrderStatisticImageFilter.h"
 
 
 int main( int argc, char * argv[] )
 {
   PARSE_ARGS;
 
-  typedef itk::MedianImageFilter< cip::CTType, cip::CTType > MedianType;
+  typedef itk::CIPOrderStatisticImageFilter< cip::CTType, cip::CTType > MedianType;
 
   // Read the CT image
   cip::CTType::Pointer ctImage = cip::CTType::New();
@@ -45,11 +45,44 @@ int main( int argc, char * argv[] )
     medianRadius[1] = radiusValue;
     medianRadius[2] = radiusValue;
 
+  cip::LabelMapType::Pointer mask;
+  if ( strcmp( maskFileName.c_str(), "NA") != 0 )
+    {
+    std::cout << "Reading mask..." << std::endl;
+    cip::LabelMapReaderType::Pointer maskReader = cip::LabelMapReaderType::New();
+      maskReader->SetFileName( maskFileName );
+    try
+      {
+      maskReader->Update();
+      }
+    catch ( itk::ExceptionObject &excp )
+      {
+      std::cerr << "Exception caught reading mask:";
+      std::cerr << excp << std::endl;
+      return cip::LABELMAPREADFAILURE;
+      }
+    mask = maskReader->GetOutput();
+    }
+
   std::cout << "Executing median filter..." << std::endl;
   MedianType::Pointer median = MedianType::New();
     median->SetInput( ctImage );
     median->SetRadius( medianRadius );
+    median->SetPercentile( percentile );
+  if ( mask.GetPointer() != NULL )
+    {
+    median->SetMaskImage( mask );
+    }
+  try
+    {
     median->Update();
+    }
+  catch ( itk::ExceptionObject &excp )
+    {
+    std::cerr << "Exception caught while filtering:";
+    std::cerr << excp << std::endl;
+    return cip::EXITFAILURE;
+    }
 
   std::cout << "Writing filtered image..." << std::endl;
   cip::CTWriterType::Pointer writer = cip::CTWriterType::New();
@@ -7,18 +7,16 @@
 
 //registration
 
-#include "itkNearestNeighborInterpolateImageFunction.h"
 #include "itkAffineTransform.h"
 #include "itkTransformFactory.h"
 #include "itkTransformFileReader.h"
 #include <itkCompositeTransform.h>
 #include <itkAffineTransform.h>
-#include "itkResampleImageFilter.h"
 
 
 //similarity
 
-#include "itkKappaStatisticImageToImageMetric.h"
+#include "itkCIPRegistrationOverlapCalculator.h"
 
 //xml
 #include <libxml/parser.h>
@@ -169,14 +167,11 @@ int DoIT(int argc, char * argv[])
   typedef itk::ImageFileReader< LabelMapType >  LabelMapReaderType;
   
   //image transformation
-  typedef itk::NearestNeighborInterpolateImageFunction< LabelMapType, double >                         InterpolatorType;
   typedef itk::AffineTransform<double, TDimension >                                                               TransformType;
-  typedef itk::IdentityTransform< double, TDimension >                                                            IdentityType;
   typedef itk::CompositeTransform< double, TDimension > CompositeTransformType;
-  typedef itk::ResampleImageFilter< LabelMapType,LabelMapType >           ResampleType;
   
   //similarity metrics
-  typedef itk::KappaStatisticImageToImageMetric<LabelMapType, LabelMapType >                         metricType;
+  typedef itk::CIPRegistrationOverlapCalculator< TDimension >                                         OverlapCalculatorType;
   //fill out the isInvertTransform vector which is a boolean vector.
   // each entry corresponds to a transform and indicates whether the transform 
   // is to be inverted.
@@ -240,51 +235,55 @@ int DoIT(int argc, char * argv[])
    transform->SetAllTransformsToOptimizeOn();
 
    
-   typename TransformType::Pointer id_transform = TransformType::New();
-     id_transform->SetIdentity();
-   typename CompositeTransformType::Pointer transform_forsim = CompositeTransformType::New();
-     transform_forsim->AddTransform(id_transform);
-     transform_forsim->SetAllTransformsToOptimizeOn();
-
-   typename InterpolatorType::Pointer interpolator = InterpolatorType::New();
-   typename ResampleType::Pointer resampler = ResampleType::New();
-    resampler->SetTransform( transform );
-    resampler->SetInterpolator( interpolator );
-    resampler->SetInput( movingImage);
-    resampler->SetSize( fixedImage->GetLargestPossibleRegion().GetSize() );
-    resampler->SetOutputSpacing( fixedImage->GetSpacing() );
-    resampler->SetOutputOrigin( fixedImage->GetOrigin() );
-    resampler->SetOutputDirection( fixedImage->GetDirection() );
+  // Overlap is evaluated on the fly: the affine chain is composed into a
+  // single mapping and the moving label map is sampled while walking the
+  // fixed grid, so no resampled volume is materialized.
+  typename OverlapCalculatorType::Pointer calculator = OverlapCalculatorType::New();
+    calculator->SetFixedLabelMap( fixedImage );
+    calculator->SetMovingLabelMap( movingImage );
+  for ( unsigned int i=0; i<transform->GetNumberOfTransforms(); i++ )
+    {
+      TransformType* affine = dynamic_cast< TransformType* >( transform->GetNthTransform( i ).GetPointer() );
+      if ( !affine )
+        {
+          std::cerr << "Transform " << i << " is not an affine transform" << std::endl;
+          return cip::EXITFAILURE;
+        }
+      calculator->AddTransform( affine );
+    }
+  if ( labelValues.size() == 0 )
+    {
+      calculator->AddValue( 1 );
+    }
+  for ( unsigned int i=0; i<labelValues.size(); i++ )
+    {
+      calculator->AddValue( (unsigned short)(labelValues[i]) );
+    }
   try
     {
-    resampler->Update();
+    calculator->Compute();
     }
   catch ( itk::ExceptionObject &excp )
     {
-    std::cerr << "Exception caught resampling:";
+    std::cerr << "Exception caught computing overlap:";
     std::cerr << excp << std::endl;
 
     return cip::RESAMPLEFAILURE;
     }
-  
 
   const char* similarity_type;
     similarity_type = "Kappa";
-  typename metricType::Pointer metric = metricType::New();
-  metric->SetForegroundValue( 1 );    
-  metric->SetInterpolator( interpolator );
-  metric->SetTransform(id_transform);
-  metric->SetFixedImage( fixedImage );
-  metric->SetMovingImage( resampler->GetOutput() );
-    
-  typename LabelMapType::RegionType fixedRegion = fixedImage->GetBufferedRegion();
-  metric->SetFixedImageRegion(fixedRegion);
-  metric->Initialize();
 
-  typename metricType::TransformParametersType zero_params(id_transform->GetNumberOfParameters() );
-    zero_params = id_transform->GetParameters();
+  const std::vector< typename OverlapCalculatorType::OVERLAPSTATISTICS >& overlaps = 
+    calculator->GetOverlapStatistics();
+  for ( unsigned int i=0; i<overlaps.size() && labelValues.size() > 0; i++ )
+    {
+      std::cout << "value " << overlaps[i].value << ": kappa = " << overlaps[i].dice
+		<< ", Cohen's kappa = " << overlaps[i].cohenKappa << std::endl;
+    }
+
   double similarityValue;
-    similarityValue = metric->GetValue(zero_params );
+    similarityValue = overlaps[0].dice;
   std::cout<<"the kappa value is: "<<similarityValue<<std::endl;
   
 
@@ -46,6 +46,7 @@
 #include "itkKappaStatisticImageToImageMetric.h"
 #include "itkGradientDifferenceImageToImageMetric.h"
 #include "itkNormalizedCorrelationImageToImageMetric.h"
+#include "itkCIPRegistrationOverlapCalculator.h"
 
 
 //xml
@@ -249,6 +250,7 @@ typedef itk::NormalizedMutualInformationHistogramImageToImageMetric< ShortImageT
 typedef itk::MeanSquaresImageToImageMetric<  ShortImageType, ShortImageType  >                         msqrMetricType;
 typedef itk::NormalizedCorrelationImageToImageMetric<ShortImageType, ShortImageType  >                 ncMetricType;
 typedef itk::GradientDifferenceImageToImageMetric<ShortImageType, ShortImageType  >                  gdMetricType;
+typedef itk::CIPRegistrationOverlapCalculator< TDimension >                                            OverlapCalculatorType;
 
 
 
@@ -384,6 +386,15 @@ if ( strcmp( inputTransformFileName[0].c_str(), "q") != 0 )
     resampler->SetOutputSpacing( ctFixedImage->GetSpacing() );
     resampler->SetOutputOrigin( ctFixedImage->GetOrigin() );
     resampler->SetOutputDirection( ctFixedImage->GetDirection() );
+
+  // NCC and mean squares over the whole image do not need the resampled
+  // moving image: they are accumulated while walking the fixed grid.
+  bool useStreamingMetric = ( similarityMetric == "nc" || similarityMetric == "msqr" ) &&
+    strcmp( movingLabelmapFileName.c_str(), "q") == 0 && 
+    strcmp( fixedLabelmapFileName.c_str(), "q") == 0;
+
+  if ( !useStreamingMetric )
+    {
   try
     {
     resampler->Update();
@@ -395,9 +406,50 @@ if ( strcmp( inputTransformFileName[0].c_str(), "q") != 0 )
 
     return cip::RESAMPLEFAILURE;
     }
+    }
+
+
+ if ( useStreamingMetric )
+      {
+	typename OverlapCalculatorType::Pointer calculator = OverlapCalculatorType::New();
+	  calculator->SetFixedCT( ctFixedImage );
+	  calculator->SetMovingCT( ctMovingImage );
+	for ( unsigned int i=0; i<transform->GetNumberOfTransforms(); i++ )
+	  {
+	    TransformType* affine = dynamic_cast< TransformType* >( transform->GetNthTransform( i ).GetPointer() );
+	    if ( !affine )
+	      {
+		std::cerr << "Transform " << i << " is not an affine transform" << std::endl;
+		return cip::EXITFAILURE;
+	      }
+	    calculator->AddTransform( affine );
+	  }
+	try
+	  {
+	  calculator->Compute();
+	  }
+	catch ( itk::ExceptionObject &excp )
+	  {
+	  std::cerr << "Exception caught computing similarity:";
+	  std::cerr << excp << std::endl;
 
+	  return cip::RESAMPLEFAILURE;
+	  }
 
- if (similarityMetric =="nc")
+	if ( similarityMetric == "nc" )
+	  {
+	    similarityValue = calculator->GetIntensityStatistics()[0].normalizedCorrelation;
+	    std::cout<<"the ncc value is: "<<similarityValue<<std::endl;
+	    similarity_type = "NCC";
+	  }
+	else
+	  {
+	    similarityValue = calculator->GetIntensityStatistics()[0].meanSquares;
+	    std::cout<<"the msqr value is: "<<similarityValue<<std::endl;
+	    similarity_type = "msqr";
+	  }
+      }
+ else if (similarityMetric =="nc")
       {
          typename ncMetricType::Pointer metric = ncMetricType::New();
 	 transform_forsim->SetAllTransformsToOptimizeOn();
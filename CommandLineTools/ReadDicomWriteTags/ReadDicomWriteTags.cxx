@@ -1,7 +1,10 @@
 /** \file
  *  \ingroup commandLineTools 
  *  \details This program reads a CT (DICOM) image, extracts tags of
- *  interest and their values and then prints them file.
+ *  interest and their values and then prints them file. Only the DICOM
+ *  headers are read (up to the pixel data); the directories are
+ *  processed concurrently and the rows of the csv file are written in
+ *  directory order as soon as they are ready.
  *
  *  $Date: 2012-04-24 13:46:21 -0700 (Tue, 24 Apr 2012) $
  *  $Revision: 82 $
@@ -29,6 +32,9 @@
  *   -r \<string\>,  --root \<string\>
  *     (required)  Root directory containing the other dicom directories
  *
+ *   --threads \<int\>
+ *     Number of directories processed concurrently (0 uses all cores)
+ *
  *   --,  --ignore_rest
  *     Ignores the rest of the labeled arguments following this flag.
  *
@@ -40,27 +46,22 @@
  */
 
 #include "cipChestConventions.h"
+#include "cipDICOMSeriesReader.h"
+#include "cipExceptionObject.h"
 
-#include "itkGDCMImageIO.h"
-#include "itkGDCMSeriesFileNames.h"
-#include "itkImageSeriesReader.h"
-#include "itkImageFileReader.h"
+#include "itkMultiThreader.h"
+#include "itkSimpleFastMutexLock.h"
+#include "gdcmReader.h"
+#include "gdcmStringFilter.h"
+#include "gdcmTag.h"
 #include <itksys/SystemTools.hxx>
+#include <fstream>
+#include <set>
 //#include "ReadDicomWriteTags.h"
 #include "ReadDicomWriteTagsCLP.h"
 
 namespace
 {
-typedef itk::Image< short, 3 >                                                   Short3DImageType;
-typedef itk::Image< short, 2 >                                                   Short2DImageType;
-typedef itk::ImageSeriesReader< Short3DImageType >                               SeriesReaderType;
-typedef itk::GDCMImageIO                                                         ImageIOType;
-typedef itk::GDCMSeriesFileNames                                                 NamesGeneratorType;
-typedef itk::MetaDataDictionary                                                  DictionaryType;
-typedef itk::MetaDataObject< std::string >                                       MetaDataStringType;
-typedef itk::ImageFileReader< Short3DImageType >                                 Image3DReaderType;
-typedef itk::ImageFileReader< Short2DImageType >                                 Image2DReaderType;
-
 
 
     
@@ -118,20 +119,45 @@ struct TAGS
   int validTags;
 };
 
-    TAGS GetTagValues( std::string  );
-    std::string GetTagValue( std::string, const DictionaryType &  );
+// Work shared by the threads. Directories are handed out one at a time;
+// the thread that completes the next row to be written flushes every
+// consecutive completed row, so the csv file is written in directory
+// order without holding all the rows in memory.
+struct TAGSTHREADSTRUCT
+{
+  std::vector< std::string >*  directoryList;
+  std::vector< TAGS >          tagsVec;
+  std::vector< bool >          tagsReady;
+  unsigned int                 nextDirectory;
+  unsigned int                 nextRow;
+  unsigned int                 numberOfSeriesThreads;
+  std::ofstream*               csvFile;
+  itk::SimpleFastMutexLock     mutex;
+};
+
+    TAGS GetTagValues( std::string, unsigned int );
+    std::string GetTagValue( std::string, const gdcm::DataSet &, const gdcm::StringFilter & );
     
-TAGS GetTagValues( std::string dicomDir )
+TAGS GetTagValues( std::string dicomDir, unsigned int numberOfThreads )
 {
     TAGS tagValues;
     
-    ImageIOType::Pointer gdcmIO = ImageIOType::New();
-        
     std::cout << dicomDir << std::endl;
-    NamesGeneratorType::Pointer namesGenerator = NamesGeneratorType::New();
-    namesGenerator->SetInputDirectory( dicomDir );
+
+    // Only the headers are scanned to find and sort the series files
+    cip::DICOMSeriesReader seriesReader;
+    seriesReader.SetDirectory( dicomDir );
+    seriesReader.SetNumberOfThreads( numberOfThreads );
+    try
+    {
+        seriesReader.UpdateOutputInformation();
+    }
+    catch ( cip::ExceptionObject & )
+    {
+        // No DICOM images in the directory
+    }
         
-    std::vector< std::string > filenames = namesGenerator->GetInputFileNames();
+    std::vector< std::string > filenames = seriesReader.GetFileNames();
         
     if ( filenames.size() == 0 )
     {
@@ -141,22 +167,24 @@ TAGS GetTagValues( std::string dicomDir )
     {
         tagValues.validTags = 1;
         
-        std::cout << "Reading dicom image..." << std::endl;
-        Image2DReaderType::Pointer reader = Image2DReaderType::New();
+        //
+        // Read the header of the first file up to the pixel data
+        //
+        std::cout << "Reading dicom header..." << std::endl;
         std::cout << filenames[0] << std::endl;
-        reader->SetFileName( filenames[0] );
-        reader->SetImageIO( gdcmIO );
-        try
-        {
-            reader->Update();
-        }
-        catch ( itk::ExceptionObject &excp )
+        std::set< gdcm::Tag > skipTags;
+        gdcm::Reader reader;
+        reader.SetFileName( filenames[0].c_str() );
+        if ( !reader.ReadUpToTag( gdcm::Tag( 0x7fe0, 0x0010 ), skipTags ) )
         {
             std::cerr << "Exception caught reading image:";
-            std::cerr << excp << std::endl;
+            std::cerr << filenames[0] << std::endl;
         }
             
-        const DictionaryType & dictionary = gdcmIO->GetMetaDataDictionary();
+        const gdcm::DataSet & dictionary = reader.GetFile().GetDataSet();
+
+        gdcm::StringFilter stringFilter;
+        stringFilter.SetFile( reader.GetFile() );
         
         //
         //  Define values for specific entries
@@ -210,54 +238,54 @@ TAGS GetTagValues( std::string dicomDir )
         std::string  seriesDateID                  = "0008|0021";
         std::string  modalityID                    = "0008|0060";
         
-        tagValues.patientName              = GetTagValue( patientNameEntryID, dictionary );
-        tagValues.patientID                = GetTagValue( patientIDEntryID, dictionary );
-        tagValues.studyDate                = GetTagValue( studyDateEntryID, dictionary );
-        tagValues.institution              = GetTagValue( institutionEntryID, dictionary );
-        tagValues.ctManufacturer           = GetTagValue( ctManufacturerEntryID, dictionary );
-        tagValues.ctModel                  = GetTagValue( ctModelEntryID, dictionary );
-        tagValues.dateOfLastCalibration    = GetTagValue( dateOfLastCalibrationEntryID, dictionary );
-        tagValues.convolutionKernel        = GetTagValue( convolutionKernelEntryID, dictionary );
-        tagValues.studyDescription         = GetTagValue( studyDescriptionEntryID, dictionary );
-        tagValues.modalitiesInStudy        = GetTagValue( modalitiesInStudyEntryID, dictionary );
-        tagValues.imageComments            = GetTagValue( imageCommentsEntryID, dictionary );
-        tagValues.sliceThickness           = GetTagValue( sliceThicknessEntryID, dictionary );
-        tagValues.exposureTime             = GetTagValue( exposureTimeEntryID, dictionary );
-        tagValues.xRayTubeCurrent          = GetTagValue( xRayTubeCurrentEntryID, dictionary );
-        tagValues.kvp                      = GetTagValue( kvpEntryID, dictionary );
-        tagValues.windowCenter             = GetTagValue( windowCenterEntryID, dictionary );
-        tagValues.contrastBolusAgent       = GetTagValue( contrastBolusAgentID, dictionary );
-        tagValues.dataCollectionDiameter   = GetTagValue( dataCollectionDiameterID, dictionary );
-        tagValues.reconstructionDiameter   = GetTagValue( reconstructionDiameterID, dictionary );
-        tagValues.distanceSourceToDetector = GetTagValue( distanceSourceToDetectorID, dictionary );
-        tagValues.distanceSourceToPatient  = GetTagValue( distanceSourceToPatientID, dictionary );
-        tagValues.gantryDetectorTilt       = GetTagValue( gantryDetectorTiltID, dictionary );
-        tagValues.tableHeight              = GetTagValue( tableHeightID, dictionary );
-        tagValues.exposure                 = GetTagValue( exposureID, dictionary );
-        tagValues.focalSpots               = GetTagValue( focalSpotsID, dictionary );
-        tagValues.imagePositionPatient     = GetTagValue( imagePositionPatientID, dictionary );
-        tagValues.sliceLocation            = GetTagValue( sliceLocationID, dictionary );
-        tagValues.pixelSpacing             = GetTagValue( pixelSpacingID, dictionary );
-        tagValues.rescaleIntercept         = GetTagValue( rescaleInterceptID, dictionary );
-        tagValues.rescaleSlope             = GetTagValue( rescaleSlopeID, dictionary );
-        tagValues.protocolName             = GetTagValue( protocolNameID, dictionary );
-        tagValues.acquisitionData          = GetTagValue( acquisitionDataID, dictionary );
-        tagValues.studyID                  = GetTagValue( studyIDID, dictionary );
-        tagValues.seriesDescription        = GetTagValue( seriesDescriptionID, dictionary );
-        tagValues.seriesTime               = GetTagValue( seriesTimeID, dictionary );
-        tagValues.patientBirthDate         = GetTagValue( patientBirthDateID, dictionary );
-        tagValues.filterType               = GetTagValue( filterTypeID, dictionary );
-        tagValues.stationName              = GetTagValue( stationNameID, dictionary );
-        tagValues.studyTime                = GetTagValue( studyTimeID, dictionary );
-        tagValues.acquisitionTime          = GetTagValue( acquisitionTimeID, dictionary );
-        tagValues.patientPosition          = GetTagValue( patientPositionID, dictionary );
+        tagValues.patientName              = GetTagValue( patientNameEntryID, dictionary, stringFilter );
+        tagValues.patientID                = GetTagValue( patientIDEntryID, dictionary, stringFilter );
+        tagValues.studyDate                = GetTagValue( studyDateEntryID, dictionary, stringFilter );
+        tagValues.institution              = GetTagValue( institutionEntryID, dictionary, stringFilter );
+        tagValues.ctManufacturer           = GetTagValue( ctManufacturerEntryID, dictionary, stringFilter );
+        tagValues.ctModel                  = GetTagValue( ctModelEntryID, dictionary, stringFilter );
+        tagValues.dateOfLastCalibration    = GetTagValue( dateOfLastCalibrationEntryID, dictionary, stringFilter );
+        tagValues.convolutionKernel        = GetTagValue( convolutionKernelEntryID, dictionary, stringFilter );
+        tagValues.studyDescription         = GetTagValue( studyDescriptionEntryID, dictionary, stringFilter );
+        tagValues.modalitiesInStudy        = GetTagValue( modalitiesInStudyEntryID, dictionary, stringFilter );
+        tagValues.imageComments            = GetTagValue( imageCommentsEntryID, dictionary, stringFilter );
+        tagValues.sliceThickness           = GetTagValue( sliceThicknessEntryID, dictionary, stringFilter );
+        tagValues.exposureTime             = GetTagValue( exposureTimeEntryID, dictionary, stringFilter );
+        tagValues.xRayTubeCurrent          = GetTagValue( xRayTubeCurrentEntryID, dictionary, stringFilter );
+        tagValues.kvp                      = GetTagValue( kvpEntryID, dictionary, stringFilter );
+        tagValues.windowCenter             = GetTagValue( windowCenterEntryID, dictionary, stringFilter );
+        tagValues.contrastBolusAgent       = GetTagValue( contrastBolusAgentID, dictionary, stringFilter );
+        tagValues.dataCollectionDiameter   = GetTagValue( dataCollectionDiameterID, dictionary, stringFilter );
+        tagValues.reconstructionDiameter   = GetTagValue( reconstructionDiameterID, dictionary, stringFilter );
+        tagValues.distanceSourceToDetector = GetTagValue( distanceSourceToDetectorID, dictionary, stringFilter );
+        tagValues.distanceSourceToPatient  = GetTagValue( distanceSourceToPatientID, dictionary, stringFilter );
+        tagValues.gantryDetectorTilt       = GetTagValue( gantryDetectorTiltID, dictionary, stringFilter );
+        tagValues.tableHeight              = GetTagValue( tableHeightID, dictionary, stringFilter );
+        tagValues.exposure                 = GetTagValue( exposureID, dictionary, stringFilter );
+        tagValues.focalSpots               = GetTagValue( focalSpotsID, dictionary, stringFilter );
+        tagValues.imagePositionPatient     = GetTagValue( imagePositionPatientID, dictionary, stringFilter );
+        tagValues.sliceLocation            = GetTagValue( sliceLocationID, dictionary, stringFilter );
+        tagValues.pixelSpacing             = GetTagValue( pixelSpacingID, dictionary, stringFilter );
+        tagValues.rescaleIntercept         = GetTagValue( rescaleInterceptID, dictionary, stringFilter );
+        tagValues.rescaleSlope             = GetTagValue( rescaleSlopeID, dictionary, stringFilter );
+        tagValues.protocolName             = GetTagValue( protocolNameID, dictionary, stringFilter );
+        tagValues.acquisitionData          = GetTagValue( acquisitionDataID, dictionary, stringFilter );
+        tagValues.studyID                  = GetTagValue( studyIDID, dictionary, stringFilter );
+        tagValues.seriesDescription        = GetTagValue( seriesDescriptionID, dictionary, stringFilter );
+        tagValues.seriesTime               = GetTagValue( seriesTimeID, dictionary, stringFilter );
+        tagValues.patientBirthDate         = GetTagValue( patientBirthDateID, dictionary, stringFilter );
+        tagValues.filterType               = GetTagValue( filterTypeID, dictionary, stringFilter );
+        tagValues.stationName              = GetTagValue( stationNameID, dictionary, stringFilter );
+        tagValues.studyTime                = GetTagValue( studyTimeID, dictionary, stringFilter );
+        tagValues.acquisitionTime          = GetTagValue( acquisitionTimeID, dictionary, stringFilter );
+        tagValues.patientPosition          = GetTagValue( patientPositionID, dictionary, stringFilter );
         
         //new additions
-        tagValues.studyInstanceUID         = GetTagValue( studyInstanceUIDID, dictionary );
-        tagValues.seriesInstanceUID        = GetTagValue( seriesInstanceUIDID, dictionary );
-        tagValues.acquisitionDate          = GetTagValue( acquisitionDateID, dictionary );
-        tagValues.seriesDate               = GetTagValue( seriesDateID, dictionary );
-        tagValues.modality                 = GetTagValue( modalityID, dictionary );
+        tagValues.studyInstanceUID         = GetTagValue( studyInstanceUIDID, dictionary, stringFilter );
+        tagValues.seriesInstanceUID        = GetTagValue( seriesInstanceUIDID, dictionary, stringFilter );
+        tagValues.acquisitionDate          = GetTagValue( acquisitionDateID, dictionary, stringFilter );
+        tagValues.seriesDate               = GetTagValue( seriesDateID, dictionary, stringFilter );
+        tagValues.modality                 = GetTagValue( modalityID, dictionary, stringFilter );
         
             
     }
@@ -266,16 +294,16 @@ TAGS GetTagValues( std::string dicomDir )
 }
     
     
-std::string GetTagValue( std::string entryID, const DictionaryType & dictionary )
+// Values are converted to strings as itk::GDCMImageIO does for its
+// MetaDataDictionary (which, by default, holds no private tags)
+std::string GetTagValue( std::string entryID, const gdcm::DataSet & dictionary, const gdcm::StringFilter & stringFilter )
 {
     std::string tagValue;
     
-    DictionaryType::ConstIterator tagItr;
-    DictionaryType::ConstIterator end = dictionary.End();
-    
-    tagItr = dictionary.Find( entryID );
+    gdcm::Tag tag;
+    tag.ReadFromPipeSeparatedString( entryID.c_str() );
     
-    if( tagItr == end )
+    if( tag.IsPrivate() || !dictionary.FindDataElement( tag ) )
     {
         std::cerr << "Tag " << entryID;
         std::cerr << " not found in the DICOM header. Returning blank entry." << std::endl;
@@ -283,9 +311,7 @@ std::string GetTagValue( std::string entryID, const DictionaryType & dictionary
         return tagValue;
     }
         
-    MetaDataStringType::ConstPointer entryValue = dynamic_cast<const MetaDataStringType *>( tagItr->second.GetPointer());
-        
-    tagValue = entryValue->GetMetaDataObjectValue();
+    tagValue = stringFilter.ToString( tag );
         
     //
     // Replace commas and new-lines with spaces
@@ -313,10 +339,8 @@ std::string GetTagValue( std::string entryID, const DictionaryType & dictionary
 }
     
     
-void WriteTagsToFile( std::string outputFileName, std::vector< std::string > directoryList, std::vector< TAGS > tagsVec )
+void WriteTagsHeader( std::ofstream & csvFile )
 {
-    std::ofstream csvFile( outputFileName.c_str() );
-        
     csvFile << "Directory,patientName,patientID,studyDate,institution,ctManufacturer,ctModel,dateOfLastCalibration,";
     csvFile << "convolutionKernel,studyDescription,modalitiesInStudy,imageComments,sliceThickness,exposureTime,";
     csvFile << "xRayTubeCurrent,kvp,windowCenter,windowWidth,contrastBolusAgent,";
@@ -325,110 +349,146 @@ void WriteTagsToFile( std::string outputFileName, std::vector< std::string > dir
     csvFile << "rescaleIntercept,rescaleSlope, protocolName, acquisitionData,";
     csvFile << "studyID,seriesDescription,seriesTime,patientBirthDate,filterType,stationName,studyTime,acquisitionTime,";
     csvFile << "patientPosition,studyInstanceUID,seriesInstanceUID,acquisitionDate,seriesDate,modality" << std::endl;
+}
+
+
+void WriteTagsRow( std::ofstream & csvFile, const std::string & directory, const TAGS & tags )
+{
+    csvFile << directory << ",";
+    
+    if ( tags.validTags == 1 )
+    {
+        csvFile << tags.patientName<< ",";
+        csvFile << tags.patientID << ",";
+        csvFile << tags.studyDate << ",";
+        csvFile << tags.institution << ",";
+        csvFile << tags.ctManufacturer << ",";
+        csvFile << tags.ctModel << ",";
+        csvFile << tags.dateOfLastCalibration << ",";
+        csvFile << tags.convolutionKernel << ",";
+        csvFile << tags.studyDescription << ",";
+        csvFile << tags.modalitiesInStudy << ",";
+        csvFile << tags.imageComments << ",";
+        csvFile << tags.sliceThickness << ",";
+        csvFile << tags.exposureTime << ",";
+        csvFile << tags.xRayTubeCurrent << ",";
+        csvFile << tags.kvp << ",";
+        csvFile << tags.windowCenter << ",";
+        csvFile << tags.windowWidth << ",";
+        csvFile << tags.contrastBolusAgent << ",";
+        csvFile << tags.dataCollectionDiameter << ",";
+        csvFile << tags.reconstructionDiameter << ",";
+        csvFile << tags.distanceSourceToDetector << ",";
+        csvFile << tags.distanceSourceToPatient << ",";
+        csvFile << tags.gantryDetectorTilt << ",";
+        csvFile << tags.tableHeight << ",";
+        csvFile << tags.exposure << ",";
+        csvFile << tags.focalSpots << ",";
+        csvFile << tags.imagePositionPatient << ",";
+        csvFile << tags.sliceLocation << ",";
+        csvFile << tags.pixelSpacing << ",";
+        csvFile << tags.rescaleIntercept << ",";
+        csvFile << tags.rescaleSlope << ",";
+        csvFile << tags.protocolName << ",";
+        csvFile << tags.acquisitionData << ",";
+        csvFile << tags.studyID << ",";
+        csvFile << tags.seriesDescription << ",";
+        csvFile << tags.seriesTime << ",";
+        csvFile << tags.patientBirthDate << ",";
+        csvFile << tags.filterType << ",";
+        csvFile << tags.stationName << ",";
+        csvFile << tags.studyTime << ",";
+        csvFile << tags.acquisitionTime << ",";
+        csvFile << tags.patientPosition << ",";
+        // csvFile << tags.patientPosition << std::endl;
         
-    for ( unsigned int i=0; i<directoryList.size(); i++ )
+        //additions
+        csvFile << tags.studyInstanceUID<<"," ;
+        csvFile << tags.seriesInstanceUID << ",";
+        csvFile << tags.acquisitionDate << ",";
+        csvFile << tags.seriesDate <<",";
+        csvFile << tags.modality <<std::endl;
+    }
+    else
     {
-        csvFile << directoryList[i] << ",";
+        csvFile << "NA" << "," << "NA" << ",";
+        csvFile << "NA" << ",";
+        csvFile << "NA" << "," << "NA" << "," << "NA" << ",";
+        csvFile << "NA" << "," << "NA" << ",";
+        csvFile << "NA" << "," << "NA" << ",";
+        csvFile << "NA" << "," << "NA" << ",";
+        csvFile << "NA" << "," << "NA" << "," << "NA" << ",";
+        csvFile << "NA" << "," << "NA" << "," << "NA" << "," << std::endl;
+        csvFile << "NA" << ",";
+        csvFile << "NA" << ",";
+        csvFile << "NA" << ",";
+        csvFile << "NA" << ",";
+        csvFile << "NA" << ",";
+        csvFile << "NA" << ",";
+        csvFile << "NA" << ",";
+        csvFile << "NA" << ",";
+        csvFile << "NA" << ",";
+        csvFile << "NA" << ",";
+        csvFile << "NA" << ",";
+        csvFile << "NA" << ",";
+        csvFile << "NA" << ",";
+        csvFile << "NA" << ",";
+        csvFile << "NA" << ",";
+        csvFile << "NA" << ",";
+        csvFile << "NA" << ",";
+        csvFile << "NA" << ",";
+        csvFile << "NA" << ",";
+        csvFile << "NA" << ",";
+        csvFile << "NA" << ",";
+        csvFile << "NA" << ",";
+        csvFile << "NA" << ",";
+        //5 additions
+        csvFile << "NA" << ",";
+        csvFile << "NA" << ",";
+        csvFile << "NA" << ",";
+        csvFile << "NA" << ",";
+        csvFile << "NA" << ",";
         
-        if ( tagsVec[i].validTags == 1 )
+        //from before
+        csvFile << "NA" << std::endl;
+    }
+}
+
+
+ITK_THREAD_RETURN_TYPE TagsThreaderCallback( void* arg )
+{
+    TAGSTHREADSTRUCT* str = static_cast< TAGSTHREADSTRUCT* >
+        ( static_cast< itk::MultiThreader::ThreadInfoStruct* >( arg )->UserData );
+    
+    unsigned int numDirectories = str->directoryList->size();
+    
+    while ( true )
+    {
+        str->mutex.Lock();
+        unsigned int i = str->nextDirectory++;
+        str->mutex.Unlock();
+        
+        if ( i >= numDirectories )
         {
-            csvFile << tagsVec[i].patientName<< ",";
-            csvFile << tagsVec[i].patientID << ",";
-            csvFile << tagsVec[i].studyDate << ",";
-            csvFile << tagsVec[i].institution << ",";
-            csvFile << tagsVec[i].ctManufacturer << ",";
-            csvFile << tagsVec[i].ctModel << ",";
-            csvFile << tagsVec[i].dateOfLastCalibration << ",";
-            csvFile << tagsVec[i].convolutionKernel << ",";
-            csvFile << tagsVec[i].studyDescription << ",";
-            csvFile << tagsVec[i].modalitiesInStudy << ",";
-            csvFile << tagsVec[i].imageComments << ",";
-            csvFile << tagsVec[i].sliceThickness << ",";
-            csvFile << tagsVec[i].exposureTime << ",";
-            csvFile << tagsVec[i].xRayTubeCurrent << ",";
-            csvFile << tagsVec[i].kvp << ",";
-            csvFile << tagsVec[i].windowCenter << ",";
-            csvFile << tagsVec[i].windowWidth << ",";
-            csvFile << tagsVec[i].contrastBolusAgent << ",";
-            csvFile << tagsVec[i].dataCollectionDiameter << ",";
-            csvFile << tagsVec[i].reconstructionDiameter << ",";
-            csvFile << tagsVec[i].distanceSourceToDetector << ",";
-            csvFile << tagsVec[i].distanceSourceToPatient << ",";
-            csvFile << tagsVec[i].gantryDetectorTilt << ",";
-            csvFile << tagsVec[i].tableHeight << ",";
-            csvFile << tagsVec[i].exposure << ",";
-            csvFile << tagsVec[i].focalSpots << ",";
-            csvFile << tagsVec[i].imagePositionPatient << ",";
-            csvFile << tagsVec[i].sliceLocation << ",";
-            csvFile << tagsVec[i].pixelSpacing << ",";
-            csvFile << tagsVec[i].rescaleIntercept << ",";
-            csvFile << tagsVec[i].rescaleSlope << ",";
-            csvFile << tagsVec[i].protocolName << ",";
-            csvFile << tagsVec[i].acquisitionData << ",";
-            csvFile << tagsVec[i].studyID << ",";
-            csvFile << tagsVec[i].seriesDescription << ",";
-            csvFile << tagsVec[i].seriesTime << ",";
-            csvFile << tagsVec[i].patientBirthDate << ",";
-            csvFile << tagsVec[i].filterType << ",";
-            csvFile << tagsVec[i].stationName << ",";
-            csvFile << tagsVec[i].studyTime << ",";
-            csvFile << tagsVec[i].acquisitionTime << ",";
-            csvFile << tagsVec[i].patientPosition << ",";
-            // csvFile << tagsVec[i].patientPosition << std::endl;
-            
-            //additions
-            csvFile << tagsVec[i].studyInstanceUID<<"," ;
-            csvFile << tagsVec[i].seriesInstanceUID << ",";
-            csvFile << tagsVec[i].acquisitionDate << ",";
-            csvFile << tagsVec[i].seriesDate <<",";
-            csvFile << tagsVec[i].modality <<std::endl;
+            break;
         }
-        else
+        
+        TAGS tempTags = GetTagValues( (*str->directoryList)[i], str->numberOfSeriesThreads );
+        
+        str->mutex.Lock();
+        str->tagsVec[i]   = tempTags;
+        str->tagsReady[i] = true;
+        while ( str->nextRow < numDirectories && str->tagsReady[str->nextRow] )
         {
-            csvFile << "NA" << "," << "NA" << ",";
-            csvFile << "NA" << ",";
-            csvFile << "NA" << "," << "NA" << "," << "NA" << ",";
-            csvFile << "NA" << "," << "NA" << ",";
-            csvFile << "NA" << "," << "NA" << ",";
-            csvFile << "NA" << "," << "NA" << ",";
-            csvFile << "NA" << "," << "NA" << "," << "NA" << ",";
-            csvFile << "NA" << "," << "NA" << "," << "NA" << "," << std::endl;
-            csvFile << "NA" << ",";
-            csvFile << "NA" << ",";
-            csvFile << "NA" << ",";
-            csvFile << "NA" << ",";
-            csvFile << "NA" << ",";
-            csvFile << "NA" << ",";
-            csvFile << "NA" << ",";
-            csvFile << "NA" << ",";
-            csvFile << "NA" << ",";
-            csvFile << "NA" << ",";
-            csvFile << "NA" << ",";
-            csvFile << "NA" << ",";
-            csvFile << "NA" << ",";
-            csvFile << "NA" << ",";
-            csvFile << "NA" << ",";
-            csvFile << "NA" << ",";
-            csvFile << "NA" << ",";
-            csvFile << "NA" << ",";
-            csvFile << "NA" << ",";
-            csvFile << "NA" << ",";
-            csvFile << "NA" << ",";
-            csvFile << "NA" << ",";
-            csvFile << "NA" << ",";
-            //5 additions
-            csvFile << "NA" << ",";
-            csvFile << "NA" << ",";
-            csvFile << "NA" << ",";
-            csvFile << "NA" << ",";
-            csvFile << "NA" << ",";
-            
-            //from before
-            csvFile << "NA" << std::endl;
+            WriteTagsRow( *str->csvFile, (*str->directoryList)[str->nextRow], str->tagsVec[str->nextRow] );
+            str->tagsVec[str->nextRow] = TAGS();
+            str->nextRow++;
         }
+        str->csvFile->flush();
+        str->mutex.Unlock();
     }
-        
-    csvFile.close();
+    
+    return ITK_THREAD_RETURN_VALUE;
 }
     
     
@@ -488,22 +548,39 @@ int main( int argc, char* argv[] )
          directoryList.push_back( directoryListArg[i] );
       }
 
+  std::ofstream csvFile( outputFileName.c_str() );
+  WriteTagsHeader( csvFile );
+
   //
-  // Loop through the directories and get the dicom tags for each
-  // dicom dataset
+  // Get the dicom tags for each dicom dataset. Directories are processed
+  // concurrently and the rows are written as they become available
   //
   std::cout << "Getting tags for each dicom dataset..." << std::endl;
-  std::vector< TAGS > tagsVec;
+  unsigned int numThreads = numberOfThreads > 0 ? numberOfThreads : itk::MultiThreader::GetGlobalDefaultNumberOfThreads();
+  if ( numThreads > directoryList.size() )
+    {
+    numThreads = directoryList.size();
+    }
 
-  for ( unsigned int i=0; i<directoryList.size(); i++ )
-    {    
-    TAGS tempTags = GetTagValues( directoryList[i] );
+  TAGSTHREADSTRUCT str;
+    str.directoryList = &directoryList;
+    str.tagsVec.resize( directoryList.size() );
+    str.tagsReady.resize( directoryList.size(), false );
+    str.nextDirectory = 0;
+    str.nextRow       = 0;
+    str.csvFile       = &csvFile;
+    // With a single directory, scan its files concurrently instead
+    str.numberOfSeriesThreads = directoryList.size() > 1 ? 1 : numberOfThreads;
 
-    tagsVec.push_back( tempTags );
+  if ( numThreads > 0 )
+    {
+    itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+      threader->SetNumberOfThreads( numThreads );
+      threader->SetSingleMethod( TagsThreaderCallback, &str );
+      threader->SingleMethodExecute();
     }
 
-  std::cout << "Writing output file..." << std::endl;
-  WriteTagsToFile( outputFileName, directoryList, tagsVec );
+  csvFile.close();
 
   std::cout << "DONE." << std::endl;
 
@@ -50,6 +50,7 @@
 #include "cipHelper.h"
 #include <sstream>
 #include "cipExceptionObject.h"
+#include "itkCIPMultiResolutionAffineRegistration.h"
 
 namespace
 {
@@ -121,6 +122,63 @@ namespace
     return reader->GetOutput();
   }
   
+  // Coarse-to-fine affine registration of the (intensity shifted) CT
+  // images. The metric is sampled inside the fixed label map if one is
+  // given, and over the whole fixed image otherwise.
+  template <unsigned int TDimension> typename itk::AffineTransform< double, TDimension >::Pointer
+  RegisterMultiResolution( typename itk::Image< short, TDimension >::Pointer fixedCT,
+                           typename itk::Image< short, TDimension >::Pointer movingCT,
+                           std::string fixedLabelmapFileName, int numberOfLevels, int numberOfSamples,
+                           std::string samplingStrategy, int numberOfThreads, float maxStepLength,
+                           float minStepLength, int numberOfIterations, float translationScale )
+  {
+    typedef itk::CIPMultiResolutionAffineRegistration< itk::Image< short, TDimension > > RegistrationType;
+
+    typename RegistrationType::Pointer registration = RegistrationType::New();
+      registration->SetFixedImage( fixedCT );
+      registration->SetMovingImage( movingCT );
+      registration->SetNumberOfLevels( numberOfLevels );
+      registration->SetNumberOfSamples( numberOfSamples );
+      registration->SetMaximumStepLength( maxStepLength );
+      registration->SetMinimumStepLength( minStepLength );
+      registration->SetNumberOfIterations( numberOfIterations );
+      registration->SetTranslationScale( translationScale );
+    if ( numberOfThreads > 0 )
+      {
+	registration->SetNumberOfThreads( numberOfThreads );
+      }
+    if ( samplingStrategy.compare( "Random" ) == 0 )
+      {
+	registration->SetSamplingStrategy( RegistrationType::RANDOM );
+      }
+    else
+      {
+	registration->SetSamplingStrategy( RegistrationType::STRATIFIED );
+      }
+
+    if ( strcmp( fixedLabelmapFileName.c_str(), "NA" ) != 0 )
+      {
+	std::cout << "Reading fixed label map " << fixedLabelmapFileName.c_str() << std::endl;
+	registration->SetFixedMask( ReadLabelMapFromFile< TDimension >( fixedLabelmapFileName ) );
+      }
+
+    std::cout << "Starting multi-resolution CT affine registration..." << std::endl;
+    try
+      {
+	registration->Update();
+      }
+    catch( itk::ExceptionObject &excp )
+      {
+	std::cerr << "Exception caught while executing registration:" << std::endl;
+	std::cerr << excp << std::endl;
+      }
+
+    std::cout << "Final metric value: " << registration->GetFinalMetricValue() << " after "
+	      << registration->GetTotalNumberOfIterations() << " iterations" << std::endl;
+
+    return registration->GetTransform();
+  }
+
   void WriteRegistrationXML(const char *file, REGISTRATION_XML_DATA
 			    &theXMLData)
   {
@@ -334,9 +392,9 @@ int DoIT2(int argc, char * argv[])
   rigidOptimizerScales[3] =  translationScale;
   
   rigidOptimizerScales[0] =  1.0;
-  translationScale = 1.0 / 100.0;
-  rigidOptimizerScales[1] =  translationScale;
-  rigidOptimizerScales[2] =  translationScale;
+  double rigidTranslationScale = 1.0 / 100.0;
+  rigidOptimizerScales[1] =  rigidTranslationScale;
+  rigidOptimizerScales[2] =  rigidTranslationScale;
   
   //create a mask for the body only in order to initialize the registration
   
@@ -375,94 +433,106 @@ int DoIT2(int argc, char * argv[])
       ++movingctIt;
     }
   
-  typename RigidInitializerTypeIntensity::Pointer rigidInitializer = RigidInitializerTypeIntensity::New(); 
-    rigidInitializer->SetTransform( rigidTransform ); 
-    rigidInitializer->SetFixedImage(fixedCT);  
-    rigidInitializer->SetMovingImage(movingCT); 
-    rigidInitializer->MomentsOn(); 
-    rigidInitializer->InitializeTransform();  
-  
-  typename OptimizerType::Pointer rigid_optimizer = OptimizerType::New();
-    rigid_optimizer->SetScales(rigidOptimizerScales);
-    rigid_optimizer->SetMaximumStepLength(0.2);
-    rigid_optimizer->SetMinimumStepLength(0.001);
-    rigid_optimizer->SetNumberOfIterations(1000);
-  
-  typename CTRegistrationType::Pointer registration = CTRegistrationType::New();
-  
-  std::cout<< " setting registration parameters "<<std::endl;
-  typename ShortImageType::RegionType fixedRegion = fixedCT->GetBufferedRegion();
-  
-  registration->SetMetric( nc_metric );
-  registration->SetFixedImage(fixedCT  ); 
-  registration->SetMovingImage(movingCT); 
-  registration->SetOptimizer( rigid_optimizer );
-  registration->SetInterpolator( CTinterpolator );
-  registration->SetTransform( rigidTransform );   
-  registration->SetInitialTransformParameters( rigidTransform->GetParameters());    
-  try
+  typename AffineTransformType::Pointer affineTransform;
+
+  if ( multiResolution )
     {
-      registration->Initialize();
-      registration->Update();
+      affineTransform = RegisterMultiResolution< TDimension >( fixedCT, movingCT, fixedLabelmapFileName, numberOfLevels,
+                                                               numberOfSamples, samplingStrategy, numberOfThreads,
+                                                               maxStepLength, minStepLength, numberOfIterations,
+                                                               translationScale );
     }
-  catch( itk::ExceptionObject &excp )
+  else
     {
-      std::cerr << "Exception caught while executing registration:" << std::endl;
-      std::cerr << excp << std::endl;
-    }
+      typename RigidInitializerTypeIntensity::Pointer rigidInitializer = RigidInitializerTypeIntensity::New(); 
+        rigidInitializer->SetTransform( rigidTransform ); 
+        rigidInitializer->SetFixedImage(fixedCT);  
+        rigidInitializer->SetMovingImage(movingCT); 
+        rigidInitializer->MomentsOn(); 
+        rigidInitializer->InitializeTransform();  
+  
+      typename OptimizerType::Pointer rigid_optimizer = OptimizerType::New();
+        rigid_optimizer->SetScales(rigidOptimizerScales);
+        rigid_optimizer->SetMaximumStepLength(0.2);
+        rigid_optimizer->SetMinimumStepLength(0.001);
+        rigid_optimizer->SetNumberOfIterations(1000);
+  
+      typename CTRegistrationType::Pointer registration = CTRegistrationType::New();
+  
+      std::cout<< " setting registration parameters "<<std::endl;
+      typename ShortImageType::RegionType fixedRegion = fixedCT->GetBufferedRegion();
+  
+      registration->SetMetric( nc_metric );
+      registration->SetFixedImage(fixedCT  ); 
+      registration->SetMovingImage(movingCT); 
+      registration->SetOptimizer( rigid_optimizer );
+      registration->SetInterpolator( CTinterpolator );
+      registration->SetTransform( rigidTransform );   
+      registration->SetInitialTransformParameters( rigidTransform->GetParameters());    
+      try
+        {
+          registration->Initialize();
+          registration->Update();
+        }
+      catch( itk::ExceptionObject &excp )
+        {
+          std::cerr << "Exception caught while executing registration:" << std::endl;
+          std::cerr << excp << std::endl;
+        }
   
-  std::cout << "Optimizer stop condition = "
-	    << registration->GetOptimizer()->GetStopConditionDescription()
-	    << std::endl;
+      std::cout << "Optimizer stop condition = "
+	        << registration->GetOptimizer()->GetStopConditionDescription()
+	        << std::endl;
   
-  rigidTransform->SetParameters( registration->GetLastTransformParameters() );
+      rigidTransform->SetParameters( registration->GetLastTransformParameters() );
    
-  // Now for the affine registration
+      // Now for the affine registration
     
-  typename AffineTransformType::Pointer affineTransform = AffineTransformType::New();  
-    affineTransform->SetCenter( rigidTransform->GetCenter() );  
-    affineTransform->SetTranslation( rigidTransform->GetTranslation() );  
-    affineTransform->SetMatrix( rigidTransform->GetMatrix() );  
-  
-  typename CTRegistrationType::Pointer registration_affine = CTRegistrationType::New();  
-    registration_affine->SetMetric( nc_metric );
-    registration_affine->SetFixedImage(fixedCT  ); 
-    registration_affine->SetMovingImage(movingCT); 
-  
-  OptimizerType::Pointer affine_optimizer = OptimizerType::New();
-  OptimizerScalesType optimizerScales(affineTransform->GetNumberOfParameters());
-  
-  optimizerScales[0] = 1.0;
-  optimizerScales[1] = 1.0;
-  optimizerScales[2] = 1.0;
-  optimizerScales[3] = 1.0;
-  translationScale = 1/1000.0;
-  optimizerScales[4]  = translationScale;
-  optimizerScales[5] = translationScale;
+      affineTransform = AffineTransformType::New();
+        affineTransform->SetCenter( rigidTransform->GetCenter() );  
+        affineTransform->SetTranslation( rigidTransform->GetTranslation() );  
+        affineTransform->SetMatrix( rigidTransform->GetMatrix() );  
+  
+      typename CTRegistrationType::Pointer registration_affine = CTRegistrationType::New();  
+        registration_affine->SetMetric( nc_metric );
+        registration_affine->SetFixedImage(fixedCT  ); 
+        registration_affine->SetMovingImage(movingCT); 
+  
+      OptimizerType::Pointer affine_optimizer = OptimizerType::New();
+      OptimizerScalesType optimizerScales(affineTransform->GetNumberOfParameters());
+  
+      optimizerScales[0] = 1.0;
+      optimizerScales[1] = 1.0;
+      optimizerScales[2] = 1.0;
+      optimizerScales[3] = 1.0;
+      translationScale = 1/1000.0;
+      optimizerScales[4]  = translationScale;
+      optimizerScales[5] = translationScale;
     
-  affine_optimizer->SetScales( optimizerScales );
-  affine_optimizer->SetMaximumStepLength( 0.2000  );
-  affine_optimizer->SetMinimumStepLength( 0.0001 );
-  affine_optimizer->SetNumberOfIterations( 300);
-  registration_affine->SetOptimizer( affine_optimizer );
-  registration_affine->SetInterpolator( CTinterpolator );  
-  registration_affine->SetTransform( affineTransform );
-  registration_affine->SetInitialTransformParameters( affineTransform->GetParameters() );
+      affine_optimizer->SetScales( optimizerScales );
+      affine_optimizer->SetMaximumStepLength( 0.2000  );
+      affine_optimizer->SetMinimumStepLength( 0.0001 );
+      affine_optimizer->SetNumberOfIterations( 300);
+      registration_affine->SetOptimizer( affine_optimizer );
+      registration_affine->SetInterpolator( CTinterpolator );  
+      registration_affine->SetTransform( affineTransform );
+      registration_affine->SetInitialTransformParameters( affineTransform->GetParameters() );
     
-  std::cout << "Starting CT affine registration..." << std::endl;
+      std::cout << "Starting CT affine registration..." << std::endl;
   
-  try
-    {
-      registration_affine->Initialize();
-      registration_affine->Update();
-    }
-  catch( itk::ExceptionObject &excp )
-    {
-      std::cerr << "Exception caught while executing registration:" << std::endl;
-      std::cerr << excp << std::endl;
-    }  
+      try
+        {
+          registration_affine->Initialize();
+          registration_affine->Update();
+        }
+      catch( itk::ExceptionObject &excp )
+        {
+          std::cerr << "Exception caught while executing registration:" << std::endl;
+          std::cerr << excp << std::endl;
+        }  
   
-  affineTransform->SetParameters( registration_affine->GetLastTransformParameters());
+      affineTransform->SetParameters( registration_affine->GetLastTransformParameters());
+    }
   
   std::cout << "Writing final transform..." << std::endl;
   
@@ -713,11 +783,11 @@ int DoIT3(int argc, char * argv[])
       rigidOptimizerScales[i] =  1.0;
     }
   
-  translationScale = 1.0 / 100.0;
+  double rigidTranslationScale = 1.0 / 100.0;
   
   for (int i=9; i< 12; i++)    
     {
-      rigidOptimizerScales[i] = translationScale;      
+      rigidOptimizerScales[i] = rigidTranslationScale;      
     }
     
   std::cout << rigidOptimizerScales <<std::endl;
@@ -760,101 +830,112 @@ int DoIT3(int argc, char * argv[])
       ++movingctIt;
     }
     
-  typename RigidInitializerTypeIntensity::Pointer rigidInitializer = RigidInitializerTypeIntensity::New(); 
-    rigidInitializer->SetTransform( rigidTransform ); 
-    rigidInitializer->SetFixedImage(fixedCT);  
-    rigidInitializer->SetMovingImage(movingCT); 
-    rigidInitializer->MomentsOn();
-    rigidInitializer->InitializeTransform();    
-  
-  typename OptimizerType::Pointer rigid_optimizer = OptimizerType::New();  
-    rigid_optimizer->SetScales(rigidOptimizerScales);   
-    rigid_optimizer->SetMaximumStepLength(0.2);
-    rigid_optimizer->SetMinimumStepLength(0.001);
-    rigid_optimizer->SetNumberOfIterations(1000);  
-  
-  typename ShortImageType::RegionType fixedRegion = fixedCT->GetBufferedRegion();
-  
-  typename CTRegistrationType::Pointer registration = CTRegistrationType::New();
-    registration->SetMetric( nc_metric );
-    registration->SetFixedImage(fixedCT  ); 
-    registration->SetMovingImage(movingCT); 
-    registration->SetOptimizer( rigid_optimizer );
-    registration->SetInterpolator( CTinterpolator );
-    registration->SetTransform( rigidTransform );
-    registration->SetInitialTransformParameters( rigidTransform->GetParameters()); 
-  
-  std::cout<< "  registering "<<std::endl;
-  try
+  typename AffineTransformType::Pointer affineTransform;
+
+  if ( multiResolution )
     {
-      registration->Initialize();
-      registration->Update();
+      affineTransform = RegisterMultiResolution< TDimension >( fixedCT, movingCT, fixedLabelmapFileName, numberOfLevels,
+                                                               numberOfSamples, samplingStrategy, numberOfThreads,
+                                                               maxStepLength, minStepLength, numberOfIterations,
+                                                               translationScale );
     }
-  catch( itk::ExceptionObject &excp )
+  else
     {
-      std::cerr << "ExceptionObject caught while executing registration" <<
-        std::endl;
-      std::cerr << excp << std::endl;
-    }
+      typename RigidInitializerTypeIntensity::Pointer rigidInitializer = RigidInitializerTypeIntensity::New(); 
+        rigidInitializer->SetTransform( rigidTransform ); 
+        rigidInitializer->SetFixedImage(fixedCT);  
+        rigidInitializer->SetMovingImage(movingCT); 
+        rigidInitializer->MomentsOn();
+        rigidInitializer->InitializeTransform();    
+  
+      typename OptimizerType::Pointer rigid_optimizer = OptimizerType::New();  
+        rigid_optimizer->SetScales(rigidOptimizerScales);   
+        rigid_optimizer->SetMaximumStepLength(0.2);
+        rigid_optimizer->SetMinimumStepLength(0.001);
+        rigid_optimizer->SetNumberOfIterations(1000);  
+  
+      typename ShortImageType::RegionType fixedRegion = fixedCT->GetBufferedRegion();
+  
+      typename CTRegistrationType::Pointer registration = CTRegistrationType::New();
+        registration->SetMetric( nc_metric );
+        registration->SetFixedImage(fixedCT  ); 
+        registration->SetMovingImage(movingCT); 
+        registration->SetOptimizer( rigid_optimizer );
+        registration->SetInterpolator( CTinterpolator );
+        registration->SetTransform( rigidTransform );
+        registration->SetInitialTransformParameters( rigidTransform->GetParameters()); 
+  
+      std::cout<< "  registering "<<std::endl;
+      try
+        {
+          registration->Initialize();
+          registration->Update();
+        }
+      catch( itk::ExceptionObject &excp )
+        {
+          std::cerr << "ExceptionObject caught while executing registration" <<
+            std::endl;
+          std::cerr << excp << std::endl;
+        }
   
-  std::cout << "Optimizer stop condition = "
-	    << registration->GetOptimizer()->GetStopConditionDescription()
-	    << std::endl;
+      std::cout << "Optimizer stop condition = "
+	        << registration->GetOptimizer()->GetStopConditionDescription()
+	        << std::endl;
   
-  rigidTransform->SetParameters( registration->GetLastTransformParameters() );
+      rigidTransform->SetParameters( registration->GetLastTransformParameters() );
     
-  // Now for the affine registration
+      // Now for the affine registration
     
-  typename AffineTransformType::Pointer affineTransform = AffineTransformType::New();  
-    affineTransform->SetCenter( rigidTransform->GetCenter() );  
-    affineTransform->SetTranslation( rigidTransform->GetTranslation() );  
-    affineTransform->SetMatrix( rigidTransform->GetMatrix() );  
-  
-  typename CTRegistrationType::Pointer registration_affine = CTRegistrationType::New();  
-    registration_affine->SetMetric( nc_metric );
-    registration_affine->SetFixedImage(fixedCT  ); 
-    registration_affine->SetMovingImage(movingCT); 
-  
-  OptimizerType::Pointer affine_optimizer = OptimizerType::New();
-  OptimizerScalesType optimizerScales(affineTransform->GetNumberOfParameters());    
-  
-  optimizerScales[0] = 1.0;
-  optimizerScales[1] = 1.0;
-  optimizerScales[2] = 1.0;
-  optimizerScales[3] = 1.0;
-  optimizerScales[4] = 1.0;
-  optimizerScales[5] = 1.0;
-  optimizerScales[6] = 1.0;
-  optimizerScales[7] = 1.0;
-  optimizerScales[8] = 1.0;
-  optimizerScales[9]  = translationScale;
-  optimizerScales[10] = translationScale;
-  optimizerScales[11] = translationScale;
-  translationScale = 1/1000.0;  
-  
-  affine_optimizer->SetScales( optimizerScales );
-  affine_optimizer->SetMaximumStepLength( 0.2000  );
-  affine_optimizer->SetMinimumStepLength( 0.0001 );
-  affine_optimizer->SetNumberOfIterations( 300);//300 );
-  registration_affine->SetOptimizer( affine_optimizer );
-  registration_affine->SetInterpolator( CTinterpolator );
-  registration_affine->SetTransform( affineTransform );
-  registration_affine->SetInitialTransformParameters( affineTransform->GetParameters() );
-  
-  std::cout << "Starting CT affine registration..." << std::endl;
-  try
-    {
-      registration_affine->Initialize();
-      registration_affine->Update();
-    }
-  catch( itk::ExceptionObject &excp )
-    {
-      std::cerr << "ExceptionObject caught while executing registration" <<
-        std::endl;
-      std::cerr << excp << std::endl;
-    }
+      affineTransform = AffineTransformType::New();
+        affineTransform->SetCenter( rigidTransform->GetCenter() );  
+        affineTransform->SetTranslation( rigidTransform->GetTranslation() );  
+        affineTransform->SetMatrix( rigidTransform->GetMatrix() );  
+  
+      typename CTRegistrationType::Pointer registration_affine = CTRegistrationType::New();  
+        registration_affine->SetMetric( nc_metric );
+        registration_affine->SetFixedImage(fixedCT  ); 
+        registration_affine->SetMovingImage(movingCT); 
+  
+      OptimizerType::Pointer affine_optimizer = OptimizerType::New();
+      OptimizerScalesType optimizerScales(affineTransform->GetNumberOfParameters());    
+  
+      optimizerScales[0] = 1.0;
+      optimizerScales[1] = 1.0;
+      optimizerScales[2] = 1.0;
+      optimizerScales[3] = 1.0;
+      optimizerScales[4] = 1.0;
+      optimizerScales[5] = 1.0;
+      optimizerScales[6] = 1.0;
+      optimizerScales[7] = 1.0;
+      optimizerScales[8] = 1.0;
+      optimizerScales[9]  = rigidTranslationScale;
+      optimizerScales[10] = rigidTranslationScale;
+      optimizerScales[11] = rigidTranslationScale;
+  
+      affine_optimizer->SetScales( optimizerScales );
+      affine_optimizer->SetMaximumStepLength( 0.2000  );
+      affine_optimizer->SetMinimumStepLength( 0.0001 );
+      affine_optimizer->SetNumberOfIterations( 300);//300 );
+      registration_affine->SetOptimizer( affine_optimizer );
+      registration_affine->SetInterpolator( CTinterpolator );
+      registration_affine->SetTransform( affineTransform );
+      registration_affine->SetInitialTransformParameters( affineTransform->GetParameters() );
+  
+      std::cout << "Starting CT affine registration..." << std::endl;
+      try
+        {
+          registration_affine->Initialize();
+          registration_affine->Update();
+        }
+      catch( itk::ExceptionObject &excp )
+        {
+          std::cerr << "ExceptionObject caught while executing registration" <<
+            std::endl;
+          std::cerr << excp << std::endl;
+        }
     
-  affineTransform->SetParameters( registration_affine->GetLastTransformParameters());
+      affineTransform->SetParameters( registration_affine->GetLastTransformParameters());
+    }
   std::cout << "Writing final transform" << std::endl;
   
   if ( strcmp(outputTransformFileName.c_str(), "NA") != 0 )
@@ -16,6 +16,8 @@
 #include "itkTransformFileWriter.h"
 #include "itkIdentityTransform.h"
 #include "itkCastImageFilter.h"
+#include "itkCIPMultiResolutionAffineRegistration.h"
+#include "itkCIPRegistrationOverlapCalculator.h"
 
 //xml
 #include <libxml/parser.h>
@@ -303,78 +305,130 @@ namespace
     typename MetricType::Pointer metric = MetricType::New();
       metric->SetForegroundValue( 1 ); 
     
-    typename TransformType::Pointer transform = TransformType::New();
+    typename InterpolatorType::Pointer interpolator = InterpolatorType::New();
+    typename TransformType::Pointer finalTransform = TransformType::New();
+    double bestValue;
 
-    std::cout << "Initializing transform..." << std::endl;
-    typename InitializerType::Pointer initializer = InitializerType::New();
-      initializer->SetTransform( transform );
-      initializer->SetFixedImage( subSampledFixedImage );
-      initializer->SetMovingImage( subSampledMovingImage );
-      initializer->MomentsOn();
-    try
-      {
-      initializer->InitializeTransform();
-      }
-    catch ( itk::ExceptionObject &excp )
+    if ( multiResolution )
       {
-      std::cerr << "Exception caught initializing transform:";
-      std::cerr << excp << std::endl;
-      }
+	typedef itk::CIPMultiResolutionAffineRegistration< LabelMapType >  MultiResolutionRegistrationType;
+	typedef itk::CIPRegistrationOverlapCalculator< TDimension >         OverlapCalculatorType;
+
+	std::cout << "Starting multi-resolution registration..." << std::endl;
+	typename MultiResolutionRegistrationType::Pointer mrRegistration = MultiResolutionRegistrationType::New();
+	  mrRegistration->SetFixedImage( subSampledFixedImage );
+	  mrRegistration->SetMovingImage( subSampledMovingImage );
+	  mrRegistration->BinarizeOn();
+	  mrRegistration->SetNumberOfLevels( numberOfLevels );
+	  mrRegistration->SetNumberOfSamples( numberOfSamples );
+	  mrRegistration->SetMaximumStepLength( maxStepLength );
+	  mrRegistration->SetMinimumStepLength( minStepLength );
+	  mrRegistration->SetNumberOfIterations( numberOfIterations );
+	  mrRegistration->SetTranslationScale( translationScale );
+	if ( numberOfThreads > 0 )
+	  {
+	    mrRegistration->SetNumberOfThreads( numberOfThreads );
+	  }
+	if ( samplingStrategy.compare( "Random" ) == 0 )
+	  {
+	    mrRegistration->SetSamplingStrategy( MultiResolutionRegistrationType::RANDOM );
+	  }
+	try
+	  {
+	  mrRegistration->Update();
+	  }
+	catch( itk::ExceptionObject &excp )
+	  {
+	  std::cerr << "ExceptionObject caught while executing registration" << std::endl;
+	  std::cerr << excp << std::endl;
+	  }
 
-    OptimizerScalesType optimizerScales( transform->GetNumberOfParameters());
-      optimizerScales[0]  =  1.0;   
-      optimizerScales[1]  =  1.0;
-      optimizerScales[2]  =  1.0;
-      optimizerScales[3]  =  1.0;   
-      optimizerScales[4]  =  1.0;
-      optimizerScales[5]  =  1.0;
-      optimizerScales[6]  =  1.0;   
-      optimizerScales[7]  =  1.0;
-      optimizerScales[8]  =  1.0;
-      optimizerScales[9]  =  translationScale;
-      optimizerScales[10] =  translationScale;
-      optimizerScales[11] =  translationScale;
+	finalTransform = mrRegistration->GetTransform();
+	numberOfIterations = mrRegistration->GetTotalNumberOfIterations();
 
-    typename OptimizerType::Pointer optimizer = OptimizerType::New();
-      optimizer->SetScales( optimizerScales );
-      optimizer->SetMaximumStepLength( maxStepLength );
-      optimizer->SetMinimumStepLength( minStepLength );
-      optimizer->SetNumberOfIterations( numberOfIterations );
+	// Report the same kappa statistic as the single resolution mode
+	typename OverlapCalculatorType::Pointer overlapCalculator = OverlapCalculatorType::New();
+	  overlapCalculator->SetFixedLabelMap( subSampledFixedImage );
+	  overlapCalculator->SetMovingLabelMap( subSampledMovingImage );
+	  overlapCalculator->AddTransform( finalTransform );
+	  overlapCalculator->AddValue( 1 );
+	  overlapCalculator->Compute();
 
-    typename InterpolatorType::Pointer interpolator = InterpolatorType::New();
-    
-    std::cout << "Starting registration..." << std::endl;
-    typename RegistrationType::Pointer registration = RegistrationType::New();
-      registration->SetMetric( metric );
-      registration->SetOptimizer( optimizer );
-      registration->SetInterpolator( interpolator );
-      registration->SetTransform( transform );          
-      registration->SetFixedImage( subSampledFixedImage );
-      registration->SetMovingImage( subSampledMovingImage );
-      registration->SetFixedImageRegion( subSampledFixedImage->GetBufferedRegion() );
-      registration->SetInitialTransformParameters( transform->GetParameters());      
-    try
-      {
-	registration->Initialize();
-	registration->Update();
+	bestValue = overlapCalculator->GetDice( 1 );
+	std::cout << "Final metric value: " << bestValue << std::endl;
       }
-    catch( itk::ExceptionObject &excp )
+    else
       {
-	std::cerr << "ExceptionObject caught while executing registration" << std::endl;
-	std::cerr << excp << std::endl;
-      }
+      typename TransformType::Pointer transform = TransformType::New();
+
+      std::cout << "Initializing transform..." << std::endl;
+      typename InitializerType::Pointer initializer = InitializerType::New();
+        initializer->SetTransform( transform );
+        initializer->SetFixedImage( subSampledFixedImage );
+        initializer->SetMovingImage( subSampledMovingImage );
+        initializer->MomentsOn();
+      try
+        {
+        initializer->InitializeTransform();
+        }
+      catch ( itk::ExceptionObject &excp )
+        {
+        std::cerr << "Exception caught initializing transform:";
+        std::cerr << excp << std::endl;
+        }
+
+      OptimizerScalesType optimizerScales( transform->GetNumberOfParameters());
+        optimizerScales[0]  =  1.0;   
+        optimizerScales[1]  =  1.0;
+        optimizerScales[2]  =  1.0;
+        optimizerScales[3]  =  1.0;   
+        optimizerScales[4]  =  1.0;
+        optimizerScales[5]  =  1.0;
+        optimizerScales[6]  =  1.0;   
+        optimizerScales[7]  =  1.0;
+        optimizerScales[8]  =  1.0;
+        optimizerScales[9]  =  translationScale;
+        optimizerScales[10] =  translationScale;
+        optimizerScales[11] =  translationScale;
+
+      typename OptimizerType::Pointer optimizer = OptimizerType::New();
+        optimizer->SetScales( optimizerScales );
+        optimizer->SetMaximumStepLength( maxStepLength );
+        optimizer->SetMinimumStepLength( minStepLength );
+        optimizer->SetNumberOfIterations( numberOfIterations );
+
+      std::cout << "Starting registration..." << std::endl;
+      typename RegistrationType::Pointer registration = RegistrationType::New();
+        registration->SetMetric( metric );
+        registration->SetOptimizer( optimizer );
+        registration->SetInterpolator( interpolator );
+        registration->SetTransform( transform );          
+        registration->SetFixedImage( subSampledFixedImage );
+        registration->SetMovingImage( subSampledMovingImage );
+        registration->SetFixedImageRegion( subSampledFixedImage->GetBufferedRegion() );
+        registration->SetInitialTransformParameters( transform->GetParameters());      
+      try
+        {
+	  registration->Initialize();
+	  registration->Update();
+        }
+      catch( itk::ExceptionObject &excp )
+        {
+	  std::cerr << "ExceptionObject caught while executing registration" << std::endl;
+	  std::cerr << excp << std::endl;
+        }
     
-    // Get all params to output to file
-    numberOfIterations = optimizer->GetCurrentIteration();
+      // Get all params to output to file
+      numberOfIterations = optimizer->GetCurrentIteration();
 
-    // The value of the image metric corresponding to the last set of parameters
-    const double bestValue = optimizer->GetValue();
-    std::cout << "Final metric value: " << optimizer->GetValue() << std::endl;
-    typename OptimizerType::ParametersType finalParams = registration->GetLastTransformParameters();
+      // The value of the image metric corresponding to the last set of parameters
+      bestValue = optimizer->GetValue();
+      std::cout << "Final metric value: " << optimizer->GetValue() << std::endl;
+      typename OptimizerType::ParametersType finalParams = registration->GetLastTransformParameters();
     
-    typename TransformType::Pointer finalTransform = TransformType::New();
-      finalTransform->SetParameters( finalParams );
-      finalTransform->SetCenter( transform->GetCenter() );
+        finalTransform->SetParameters( finalParams );
+        finalTransform->SetCenter( transform->GetCenter() );
+      }
     
     if ( strcmp(outputTransformFileName.c_str(), "NA") != 0 )
       {
@@ -0,0 +1,648 @@
+/** \file
+ *  \ingroup commandLineTools
+ *  \details This program runs a pipeline of CIP command line tools in a
+ *  single process. Each tool is loaded from the shared library built
+ *  for it by cipMacroBuildCLI and its ModuleEntryPoint is called with
+ *  the arguments given in the pipeline file. Images passed between
+ *  steps under 'cipmem:' names never leave memory (see
+ *  itk::CIPMemoryImageIO), and steps whose inputs are ready are run
+ *  concurrently.
+ *
+ *  A pipeline file looks like:
+ *
+ *    # Comment
+ *    mask: GenerateSimpleLungMask -i ${CT} -o cipmem:mask
+ *    partial: GeneratePartialLungLabelMap --ct ${CT} -o cipmem:partial
+ *    lobes after mask: SegmentLungLobes -i cipmem:partial ...
+ *
+ *  A step depends on the earlier step that first mentions any of its
+ *  'cipmem:' or 'ciptmp:' names, and on the steps listed after 'after'.
+ *  The tools read and write polydata through VTK readers and writers
+ *  that only know about files, so non-image data is passed through
+ *  'ciptmp:' names, which stand for files in a scratch directory that
+ *  are deleted once every step using them has finished.
+ *
+ *  Steps that run the same tool are never run at the same time, since
+ *  the tools were written to be run once per process.
+ *
+ *  With '--instrumentation' (or the CIP_INSTRUMENTATION environment
+ *  variable) the run time of every step is written to the given file.
+ *  Each tool has its own copy of CIPCommon, so the stages of the filters
+ *  a tool runs go to a report of its own, named after the given file
+ *  with the tool's name added before the extension (see
+ *  cipInstrumentation.h).
+ *
+ *  USAGE:
+ *
+ *  RunCIPPipeline  [--instrumentation <std::string>] [--threads <int>]
+ *                  [--scratchDir <std::string>]
+ *                  [--moduleDir <std::string>] [-s <std::string>] ...
+ *                  [-p <std::string>] [--] [--version] [-h]
+ */
+
+#include "RunCIPPipelineCLP.h"
+#include "cipChestConventions.h"
+#include "cipInstrumentation.h"
+#include "itkCIPBlockCompressedNrrdImageIOFactory.h"
+#include "itkCIPMemoryImageIO.h"
+#include "itkCIPMemoryImageIOFactory.h"
+#include "itkConditionVariable.h"
+#include "itkMultiThreader.h"
+#include "itkMutexLock.h"
+#include "itkSimpleMutexLock.h"
+#include <itksys/DynamicLoader.hxx>
+#include <itksys/SystemTools.hxx>
+
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <set>
+#include <vector>
+
+namespace
+{
+  typedef int (*ModuleEntryPointType)( int, char* [] );
+
+  const char TEMPORARYFILENAMEPREFIX[] = "ciptmp:";
+
+  struct PIPELINESTEP
+  {
+    std::string                  name;
+    std::string                  moduleName;
+    std::vector< std::string >   arguments;
+    std::vector< unsigned int >  dependencies;
+    std::vector< std::string >   inputs;   // Names produced by earlier steps
+  };
+
+  struct MODULE
+  {
+    ModuleEntryPointType     entryPoint;
+    itk::MutexLock::Pointer  lock;
+  };
+
+  enum STEPSTATUS { WAITING, RUNNING, SUCCEEDED, FAILED, SKIPPED };
+
+  struct PIPELINETHREADSTRUCT
+  {
+    std::vector< PIPELINESTEP >             steps;
+    std::map< std::string, MODULE >         modules;
+    std::map< std::string, unsigned int >   numberOfConsumers;
+    std::string                             scratchFilePrefix;
+    std::vector< STEPSTATUS >               status;
+    bool                                    failed;
+    itk::SimpleMutexLock                    mutex;
+    itk::ConditionVariable::Pointer         stepFinished;
+  };
+
+
+  bool IsDataName( const std::string& name )
+  {
+    return itk::CIPMemoryImageIO::IsMemoryFileName( name ) ||
+      name.compare( 0, sizeof( TEMPORARYFILENAMEPREFIX ) - 1, TEMPORARYFILENAMEPREFIX ) == 0;
+  }
+
+
+  // The 'cipmem:' and 'ciptmp:' names in an argument, which may be a
+  // comma-separated list and may be given as 'FLAG=VALUE'
+  std::vector< std::string > GetDataNames( const std::string& argument )
+  {
+    std::vector< std::string > names;
+
+    std::string::size_type start = argument.find( '=' );
+    start = ( start == std::string::npos || IsDataName( argument ) ) ? 0 : start + 1;
+    while ( start <= argument.size() )
+      {
+      std::string::size_type end = argument.find( ',', start );
+      if ( end == std::string::npos )
+        {
+        end = argument.size();
+        }
+      std::string name = argument.substr( start, end - start );
+      if ( IsDataName( name ) )
+        {
+        names.push_back( name );
+        }
+      start = end + 1;
+      }
+
+    return names;
+  }
+
+
+  std::string GetScratchFileName( const PIPELINETHREADSTRUCT& str, const std::string& name )
+  {
+    return str.scratchFilePrefix + name.substr( sizeof( TEMPORARYFILENAMEPREFIX ) - 1 );
+  }
+
+
+  void ReleaseData( const PIPELINETHREADSTRUCT& str, const std::string& name )
+  {
+    if ( itk::CIPMemoryImageIO::IsMemoryFileName( name ) )
+      {
+      itk::CIPMemoryImageIO::RemoveImage( name );
+      }
+    else
+      {
+      itksys::SystemTools::RemoveFile( GetScratchFileName( str, name ).c_str() );
+      }
+  }
+
+
+  // Replace every '${NAME}' in 'line' by its value. Returns false if a
+  // variable has not been set.
+  bool SubstituteVariables( std::string& line, const std::map< std::string, std::string >& variables )
+  {
+    std::string::size_type start = 0;
+    while ( ( start = line.find( "${", start ) ) != std::string::npos )
+      {
+      std::string::size_type end = line.find( '}', start );
+      if ( end == std::string::npos )
+        {
+        std::cerr << "Unterminated variable in: " << line << std::endl;
+        return false;
+        }
+
+      std::string name = line.substr( start + 2, end - start - 2 );
+      std::map< std::string, std::string >::const_iterator it = variables.find( name );
+      if ( it == variables.end() )
+        {
+        std::cerr << "Variable " << name << " has not been set (use --set " << name << "=VALUE)" << std::endl;
+        return false;
+        }
+      line.replace( start, end - start + 1, it->second );
+      start += it->second.size();
+      }
+
+    return true;
+  }
+
+
+  // Split a line into white space separated words. Double quotes group
+  // words containing spaces.
+  std::vector< std::string > GetWords( const std::string& line )
+  {
+    std::vector< std::string > words;
+
+    std::string word;
+    bool inWord   = false;
+    bool inQuotes = false;
+    for ( unsigned int i = 0; i < line.size(); i++ )
+      {
+      char c = line[i];
+      if ( c == '"' )
+        {
+        inQuotes = !inQuotes;
+        inWord   = true;
+        }
+      else if ( !inQuotes && ( c == ' ' || c == '\t' ) )
+        {
+        if ( inWord )
+          {
+          words.push_back( word );
+          word.clear();
+          inWord = false;
+          }
+        }
+      else
+        {
+        word += c;
+        inWord = true;
+        }
+      }
+    if ( inWord )
+      {
+      words.push_back( word );
+      }
+
+    return words;
+  }
+
+
+  bool ReadPipeline( const std::string& fileName, const std::map< std::string, std::string >& variables,
+                     std::vector< PIPELINESTEP >& steps )
+  {
+    std::ifstream file( fileName.c_str() );
+    if ( !file )
+      {
+      std::cerr << "Could not open pipeline file " << fileName << std::endl;
+      return false;
+      }
+
+    std::map< std::string, unsigned int > stepIndices;
+    std::map< std::string, unsigned int > producers;
+
+    std::string line;
+    std::string nextLine;
+    unsigned int lineNumber = 0;
+    while ( std::getline( file, nextLine ) )
+      {
+      lineNumber++;
+
+      if ( !nextLine.empty() && nextLine[nextLine.size() - 1] == '\r' )
+        {
+        nextLine.erase( nextLine.size() - 1 );
+        }
+      if ( !nextLine.empty() && nextLine[nextLine.size() - 1] == '\\' )
+        {
+        line += nextLine.substr( 0, nextLine.size() - 1 ) + " ";
+        continue;
+        }
+      line += nextLine;
+
+      std::string::size_type first = line.find_first_not_of( " \t" );
+      if ( first == std::string::npos || line[first] == '#' )
+        {
+        line.clear();
+        continue;
+        }
+
+      if ( !SubstituteVariables( line, variables ) )
+        {
+        return false;
+        }
+
+      std::string::size_type colon = line.find( ':' );
+      std::vector< std::string > header = GetWords( line.substr( 0, colon ) );
+      std::vector< std::string > words;
+      if ( colon != std::string::npos )
+        {
+        words = GetWords( line.substr( colon + 1 ) );
+        }
+      line.clear();
+
+      if ( header.empty() || words.empty() || ( header.size() > 1 && header[1] != "after" ) )
+        {
+        std::cerr << fileName << ":" << lineNumber << ": expected 'STEPNAME [after STEPNAME...]: MODULE ARGUMENTS...'" << std::endl;
+        return false;
+        }
+      if ( stepIndices.find( header[0] ) != stepIndices.end() )
+        {
+        std::cerr << fileName << ":" << lineNumber << ": step " << header[0] << " is defined twice" << std::endl;
+        return false;
+        }
+
+      unsigned int index = static_cast< unsigned int >( steps.size() );
+
+      PIPELINESTEP step;
+        step.name       = header[0];
+        step.moduleName = words[0];
+        step.arguments.assign( words.begin() + 1, words.end() );
+
+      std::set< unsigned int > dependencies;
+      for ( unsigned int i = 2; i < header.size(); i++ )
+        {
+        std::map< std::string, unsigned int >::const_iterator it = stepIndices.find( header[i] );
+        if ( it == stepIndices.end() )
+          {
+          std::cerr << fileName << ":" << lineNumber << ": step " << header[i] << " must be defined before "
+                    << step.name << std::endl;
+          return false;
+          }
+        dependencies.insert( it->second );
+        }
+
+      // The first step mentioning a name produces it; every later step
+      // mentioning it reads it
+      std::set< std::string > inputs;
+      for ( unsigned int i = 0; i < step.arguments.size(); i++ )
+        {
+        std::vector< std::string > names = GetDataNames( step.arguments[i] );
+        for ( unsigned int j = 0; j < names.size(); j++ )
+          {
+          std::map< std::string, unsigned int >::const_iterator it = producers.find( names[j] );
+          if ( it == producers.end() )
+            {
+            producers[names[j]] = index;
+            }
+          else if ( it->second != index )
+            {
+            dependencies.insert( it->second );
+            inputs.insert( names[j] );
+            }
+          }
+        }
+      step.dependencies.assign( dependencies.begin(), dependencies.end() );
+      step.inputs.assign( inputs.begin(), inputs.end() );
+
+      stepIndices[step.name] = index;
+      steps.push_back( step );
+      }
+
+    if ( steps.empty() )
+      {
+      std::cerr << "Pipeline file " << fileName << " contains no steps" << std::endl;
+      return false;
+      }
+
+    return true;
+  }
+
+
+  bool LoadModules( const std::vector< PIPELINESTEP >& steps, const std::string& moduleDirectory,
+                    std::map< std::string, MODULE >& modules )
+  {
+    for ( unsigned int i = 0; i < steps.size(); i++ )
+      {
+      if ( modules.find( steps[i].moduleName ) != modules.end() )
+        {
+        continue;
+        }
+
+      std::string libraryName = moduleDirectory + "/" + itksys::DynamicLoader::LibPrefix() +
+        steps[i].moduleName + "Lib" + itksys::DynamicLoader::LibExtension();
+
+      // The libraries stay loaded until the process exits: the tools
+      // register ITK and VTK factories that must outlive them
+      itksys::DynamicLoader::LibraryHandle library = itksys::DynamicLoader::OpenLibrary( libraryName.c_str() );
+      if ( !library )
+        {
+        std::cerr << "Could not load " << libraryName << ": " << itksys::DynamicLoader::LastError() << std::endl;
+        return false;
+        }
+
+      MODULE module;
+        module.entryPoint = reinterpret_cast< ModuleEntryPointType >(
+          itksys::DynamicLoader::GetSymbolAddress( library, "ModuleEntryPoint" ) );
+        module.lock = itk::MutexLock::New();
+
+      if ( !module.entryPoint )
+        {
+        std::cerr << libraryName << " has no ModuleEntryPoint" << std::endl;
+        return false;
+        }
+
+      modules[steps[i].moduleName] = module;
+      }
+
+    return true;
+  }
+
+
+  int RunStep( const PIPELINETHREADSTRUCT& str, const PIPELINESTEP& step )
+  {
+    // The tools expect argv[0] to be their name
+    std::vector< std::string > arguments;
+      arguments.push_back( step.moduleName );
+
+    for ( unsigned int i = 0; i < step.arguments.size(); i++ )
+      {
+      std::string argument = step.arguments[i];
+
+      std::vector< std::string > names = GetDataNames( argument );
+      for ( unsigned int j = 0; j < names.size(); j++ )
+        {
+        if ( !itk::CIPMemoryImageIO::IsMemoryFileName( names[j] ) )
+          {
+          argument.replace( argument.find( names[j] ), names[j].size(), GetScratchFileName( str, names[j] ) );
+          }
+        }
+      arguments.push_back( argument );
+      }
+
+    std::vector< std::vector< char > > buffers( arguments.size() );
+    std::vector< char* > argv( arguments.size() + 1, static_cast< char* >( NULL ) );
+    for ( unsigned int i = 0; i < arguments.size(); i++ )
+      {
+      buffers[i].assign( arguments[i].begin(), arguments[i].end() );
+      buffers[i].push_back( '\0' );
+      argv[i] = &buffers[i][0];
+      }
+
+    const MODULE& module = str.modules.find( step.moduleName )->second;
+
+    int returnCode = cip::EXITFAILURE;
+
+    module.lock->Lock();
+    {
+      std::string stageName = step.name + ": " + step.moduleName;
+      cip::ScopedTimer timer( stageName.c_str() );
+
+      try
+        {
+        returnCode = module.entryPoint( static_cast< int >( arguments.size() ), &argv[0] );
+        }
+      catch ( itk::ExceptionObject& excp )
+        {
+        std::cerr << "Exception caught running step " << step.name << ":" << std::endl;
+        std::cerr << excp << std::endl;
+        }
+      catch ( std::exception& excp )
+        {
+        std::cerr << "Exception caught running step " << step.name << ": " << excp.what() << std::endl;
+        }
+      catch ( ... )
+        {
+        std::cerr << "Unknown exception caught running step " << step.name << std::endl;
+        }
+    }
+    module.lock->Unlock();
+
+    return returnCode;
+  }
+
+
+  // Runs whichever step is ready next until no step is left waiting.
+  // Once a step fails, the steps that have not started are skipped.
+  ITK_THREAD_RETURN_TYPE RunStepsThreaderCallback( void* arg )
+  {
+    PIPELINETHREADSTRUCT* str = static_cast< PIPELINETHREADSTRUCT* >(
+      static_cast< itk::MultiThreader::ThreadInfoStruct* >( arg )->UserData );
+
+    str->mutex.Lock();
+    while ( true )
+      {
+      int  nextStep = -1;
+      bool waiting  = false;
+      for ( unsigned int i = 0; i < str->steps.size() && nextStep < 0; i++ )
+        {
+        if ( str->status[i] != WAITING )
+          {
+          continue;
+          }
+        if ( str->failed )
+          {
+          str->status[i] = SKIPPED;
+          std::cout << "Skipping step " << str->steps[i].name << std::endl;
+          continue;
+          }
+
+        bool ready = true;
+        for ( unsigned int j = 0; j < str->steps[i].dependencies.size(); j++ )
+          {
+          ready = ready && ( str->status[str->steps[i].dependencies[j]] == SUCCEEDED );
+          }
+
+        if ( ready )
+          {
+          nextStep = static_cast< int >( i );
+          }
+        waiting = true;
+        }
+
+      if ( nextStep < 0 )
+        {
+        if ( !waiting )
+          {
+          break;
+          }
+        str->stepFinished->Wait( &str->mutex );
+        continue;
+        }
+
+      const PIPELINESTEP& step = str->steps[nextStep];
+
+      str->status[nextStep] = RUNNING;
+      std::cout << "Running step " << step.name << " (" << step.moduleName << ")..." << std::endl;
+      str->mutex.Unlock();
+
+      double startTime = itksys::SystemTools::GetTime();
+      int returnCode = RunStep( *str, step );
+      double elapsedTime = itksys::SystemTools::GetTime() - startTime;
+
+      str->mutex.Lock();
+      if ( returnCode == cip::EXITSUCCESS )
+        {
+        str->status[nextStep] = SUCCEEDED;
+        std::cout << "Step " << step.name << " finished in " << elapsedTime << " s" << std::endl;
+        }
+      else
+        {
+        str->status[nextStep] = FAILED;
+        str->failed = true;
+        std::cerr << "Step " << step.name << " (" << step.moduleName << ") failed with code " << returnCode << std::endl;
+        }
+
+      for ( unsigned int i = 0; i < step.inputs.size(); i++ )
+        {
+        if ( --str->numberOfConsumers[step.inputs[i]] == 0 )
+          {
+          ReleaseData( *str, step.inputs[i] );
+          }
+        }
+
+      str->stepFinished->Broadcast();
+      }
+    str->mutex.Unlock();
+
+    return ITK_THREAD_RETURN_VALUE;
+  }
+} // end anonymous namespace
+
+
+int main( int argc, char *argv[] )
+{
+  PARSE_ARGS;
+
+  if ( instrumentationFileName.compare( "NA" ) != 0 )
+    {
+    cip::Instrumentation::Enable( instrumentationFileName, "" );
+    }
+
+  std::map< std::string, std::string > pipelineVariables;
+  for ( unsigned int i = 0; i < variables.size(); i++ )
+    {
+    std::string::size_type equals = variables[i].find( '=' );
+    if ( equals == std::string::npos || equals == 0 )
+      {
+      std::cerr << "Variables must be given as NAME=VALUE: " << variables[i] << std::endl;
+      return cip::EXITFAILURE;
+      }
+    pipelineVariables[variables[i].substr( 0, equals )] = variables[i].substr( equals + 1 );
+    }
+
+  PIPELINETHREADSTRUCT str;
+    str.failed = false;
+    str.stepFinished = itk::ConditionVariable::New();
+
+  std::cout << "Reading pipeline..." << std::endl;
+  if ( !ReadPipeline( pipelineFileName, pipelineVariables, str.steps ) )
+    {
+    return cip::EXITFAILURE;
+    }
+  str.status.resize( str.steps.size(), WAITING );
+
+  for ( unsigned int i = 0; i < str.steps.size(); i++ )
+    {
+    for ( unsigned int j = 0; j < str.steps[i].inputs.size(); j++ )
+      {
+      str.numberOfConsumers[str.steps[i].inputs[j]]++;
+      }
+    }
+
+  if ( moduleDirectory.compare( "NA" ) == 0 )
+    {
+    std::string errorMessage;
+    std::string programPath;
+    itksys::SystemTools::FindProgramPath( argv[0], programPath, errorMessage );
+    moduleDirectory = itksys::SystemTools::GetFilenamePath( programPath );
+    }
+
+  if ( scratchDirectory.compare( "NA" ) == 0 )
+    {
+    const char* environmentVariables[] = { "TMPDIR", "TEMP", "TMP" };
+    scratchDirectory = ".";
+    for ( unsigned int i = 0; i < 3; i++ )
+      {
+      if ( itksys::SystemTools::GetEnv( environmentVariables[i] ) != NULL )
+        {
+        scratchDirectory = itksys::SystemTools::GetEnv( environmentVariables[i] );
+        break;
+        }
+      }
+    }
+
+  // Scratch files of pipelines run at the same time must not collide
+  char timeStamp[32];
+  std::sprintf( timeStamp, "%.0f", itksys::SystemTools::GetTime() * 1000.0 );
+  str.scratchFilePrefix = scratchDirectory + "/RunCIPPipeline-" + timeStamp + "-";
+
+  std::cout << "Loading modules..." << std::endl;
+  if ( !LoadModules( str.steps, moduleDirectory, str.modules ) )
+    {
+    return cip::EXITFAILURE;
+    }
+
+  // The memory IO must come ahead of the NRRD IO, which would otherwise
+  // claim 'cipmem:' names that end in '.nrrd'
+  itk::CIPBlockCompressedNrrdImageIOFactory::RegisterOneFactory();
+  itk::CIPMemoryImageIOFactory::RegisterOneFactory();
+
+  unsigned int numberOfSteps = static_cast< unsigned int >( str.steps.size() );
+  if ( numberOfThreads <= 0 || static_cast< unsigned int >( numberOfThreads ) > numberOfSteps )
+    {
+    numberOfThreads = numberOfSteps;
+    }
+
+  itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+    threader->SetNumberOfThreads( numberOfThreads );
+    threader->SetSingleMethod( RunStepsThreaderCallback, &str );
+    threader->SingleMethodExecute();
+
+  // Data that no step read (or that was left over by a failed step)
+  std::set< std::string > dataNames;
+  for ( unsigned int i = 0; i < str.steps.size(); i++ )
+    {
+    for ( unsigned int j = 0; j < str.steps[i].arguments.size(); j++ )
+      {
+      std::vector< std::string > names = GetDataNames( str.steps[i].arguments[j] );
+      dataNames.insert( names.begin(), names.end() );
+      }
+    }
+  for ( std::set< std::string >::const_iterator it = dataNames.begin(); it != dataNames.end(); ++it )
+    {
+    std::map< std::string, unsigned int >::const_iterator consumers = str.numberOfConsumers.find( *it );
+    if ( consumers == str.numberOfConsumers.end() || consumers->second > 0 )
+      {
+      ReleaseData( str, *it );
+      }
+    }
+
+  if ( str.failed )
+    {
+    return cip::EXITFAILURE;
+    }
+
+  std::cout << "DONE." << std::endl;
+
+  return cip::EXITSUCCESS;
+}
@@ -273,6 +273,10 @@ int main( int argc, char *argv[] )
     }
 
   std::cout << "Segmenting lobes..." << std::endl;
+  if ( numberOfCenters > 0 )
+    {
+      lobeSegmenter->SetThinPlateSplineSurfaceFromPointsNumberOfKernelCenters( numberOfCenters );
+    }
   if ( loPoints.size() > 2 )
     {
       lobeSegmenter->SetLeftObliqueFissurePoints( loPoints );
@@ -0,0 +1,106 @@
+#include "cipLabelMapDistanceTransform.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+typedef cipLabelMapDistanceTransform::LabelMapType  LabelMapType;
+
+// Squared distance in mm between the voxels at offsets 'a' and 'b'
+double GetSquaredDistance( LabelMapType::Pointer labelMap, unsigned long a, unsigned long b )
+{
+  LabelMapType::SizeType size = labelMap->GetBufferedRegion().GetSize();
+
+  double squaredDistance = 0.0;
+  for ( unsigned int d=0; d<3; d++ )
+    {
+    double distance = ( double(a%size[d]) - double(b%size[d]) )*labelMap->GetSpacing()[d];
+    squaredDistance += distance*distance;
+    a /= size[d];
+    b /= size[d];
+    }
+
+  return squaredDistance;
+}
+
+int main( int argc, char* argv[] )
+{
+  // Anisotropic grid with a few labeled voxels of three structures
+  LabelMapType::SizeType size;
+    size[0] = 19;
+    size[1] = 14;
+    size[2] = 9;
+
+  LabelMapType::SpacingType spacing;
+    spacing[0] = 0.7;
+    spacing[1] = 1.3;
+    spacing[2] = 2.5;
+
+  LabelMapType::Pointer labelMap = LabelMapType::New();
+    labelMap->SetRegions( size );
+    labelMap->SetSpacing( spacing );
+    labelMap->Allocate();
+
+  unsigned int seed = 1;
+  unsigned short* labels = labelMap->GetBufferPointer();
+  unsigned long numVoxels = size[0]*size[1]*size[2];
+  for ( unsigned long v=0; v<numVoxels; v++ )
+    {
+    seed = 1103515245*seed + 12345;
+    labels[v] = ((seed >> 16)%60 == 0) ? 1 + (seed >> 8)%3 : 0;
+    }
+
+  double bandWidth = 4.0;
+
+  cipLabelMapDistanceTransform transform;
+    transform.SetInput( labelMap );
+    transform.SetNumberOfThreads( 3 );
+    transform.SetBandWidth( bandWidth );
+    transform.Update();
+
+  cipLabelMapDistanceTransform::DistanceImageType::Pointer distanceImage = transform.GetDistanceImage();
+  LabelMapType::Pointer nearestLabelMap = transform.GetNearestLabelMap();
+
+  // Compare with the closest labeled voxels found by brute force
+  double maxError = 0.0;
+  unsigned int numLabelMismatches = 0;
+  for ( unsigned long v=0; v<numVoxels; v++ )
+    {
+    double minSquaredDistance = -1.0;
+    for ( unsigned long w=0; w<numVoxels; w++ )
+      {
+      double squaredDistance = GetSquaredDistance( labelMap, v, w );
+      if ( labels[w] != 0 && (minSquaredDistance < 0.0 || squaredDistance < minSquaredDistance) )
+        {
+        minSquaredDistance = squaredDistance;
+        }
+      }
+
+    double expected = std::min( std::sqrt( minSquaredDistance ), bandWidth );
+    maxError = std::max( maxError, std::abs( distanceImage->GetBufferPointer()[v] - expected ) );
+
+    // The nearest label must be the label of one of the closest voxels
+    unsigned short nearestLabel = nearestLabelMap->GetBufferPointer()[v];
+    bool found = ( nearestLabel == 0 && std::sqrt( minSquaredDistance ) > bandWidth );
+    for ( unsigned long w=0; w<numVoxels && !found; w++ )
+      {
+      found = ( labels[w] != 0 && labels[w] == nearestLabel &&
+                std::abs( GetSquaredDistance( labelMap, v, w ) - minSquaredDistance ) < 1e-6 );
+      }
+    if ( !found )
+      {
+      numLabelMismatches++;
+      }
+    }
+
+  std::cout << "Maximum distance error: " << maxError << std::endl;
+  std::cout << "Nearest label mismatches: " << numLabelMismatches << std::endl;
+
+  if ( maxError > 1e-4 || numLabelMismatches > 0 )
+    {
+    std::cout << "FAILED" << std::endl;
+    return 1;
+    }
+
+  std::cout << "PASSED" << std::endl;
+  return 0;
+}
@@ -0,0 +1,104 @@
+#define _USE_MATH_DEFINES
+#include "cipSpectralFilter.h"
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <iostream>
+
+typedef std::complex< double > ComplexType;
+
+// Direct evaluation of the 3D DFT of a real image
+ComplexType GetDFTCoefficient( const std::vector< double >& image, const unsigned int size[3],
+                               unsigned int i, unsigned int j, unsigned int k )
+{
+  ComplexType sum( 0.0, 0.0 );
+  for ( unsigned int z=0; z<size[2]; z++ )
+    {
+    for ( unsigned int y=0; y<size[1]; y++ )
+      {
+      for ( unsigned int x=0; x<size[0]; x++ )
+        {
+        double phase = -2.0*M_PI*( double(i*x)/double(size[0]) + double(j*y)/double(size[1]) +
+                                   double(k*z)/double(size[2]) );
+        sum += image[(z*size[1] + y)*size[0] + x]*ComplexType( std::cos( phase ), std::sin( phase ) );
+        }
+      }
+    }
+
+  return sum;
+}
+
+int main( int argc, char* argv[] )
+{
+  // Even, odd and prime lengths along each axis
+  unsigned int sizes[4][3] = { {8, 6, 5}, {9, 7, 1}, {10, 13, 4}, {16, 1, 1} };
+
+  double maxSpectrumError = 0.0;
+  double maxImageError    = 0.0;
+  for ( unsigned int s=0; s<4; s++ )
+    {
+    const unsigned int* size = sizes[s];
+    unsigned int numVoxels = size[0]*size[1]*size[2];
+
+    std::vector< double > image( numVoxels );
+    for ( unsigned int v=0; v<numVoxels; v++ )
+      {
+      image[v] = std::sin( 0.37*v ) + 0.5*std::cos( 1.3*v );
+      }
+
+    cipSpectralFilter filter;
+      filter.SetNumberOfThreads( 2 );
+      filter.SetSize( size );
+      filter.Forward( &image[0] );
+
+    unsigned int spectrumSize[3];
+    filter.GetSpectrumSize( spectrumSize );
+
+    const std::vector< cipSpectralFilter::ComplexType >& spectrum = filter.GetSpectrum();
+    for ( unsigned int k=0; k<spectrumSize[2]; k++ )
+      {
+      for ( unsigned int j=0; j<spectrumSize[1]; j++ )
+        {
+        for ( unsigned int i=0; i<spectrumSize[0]; i++ )
+          {
+          ComplexType expected = GetDFTCoefficient( image, size, i, j, k );
+          cipSpectralFilter::ComplexType value = spectrum[(k*spectrumSize[1] + j)*spectrumSize[0] + i];
+          double error = std::abs( expected - ComplexType( value.real(), value.imag() ) );
+          maxSpectrumError = std::max( maxSpectrumError, error/double(numVoxels) );
+          }
+        }
+      }
+
+    // Transform a copy of the spectrum back, together with a scaled copy
+    std::vector< cipSpectralFilter::ComplexType > first( spectrum );
+    std::vector< cipSpectralFilter::ComplexType > second( spectrum );
+    for ( unsigned int e=0; e<second.size(); e++ )
+      {
+      second[e] *= 2.0f;
+      }
+    std::vector< cipSpectralFilter::ComplexType* > batch;
+      batch.push_back( &first[0] );
+      batch.push_back( &second[0] );
+
+    std::vector< float > inverse( 2*numVoxels );
+    filter.Inverse( batch, &inverse[0] );
+
+    for ( unsigned int v=0; v<numVoxels; v++ )
+      {
+      maxImageError = std::max( maxImageError, std::abs( inverse[2*v] - image[v] ) );
+      maxImageError = std::max( maxImageError, std::abs( inverse[2*v + 1] - 2.0*image[v] ) );
+      }
+    }
+
+  std::cout << "Maximum spectrum error: " << maxSpectrumError << std::endl;
+  std::cout << "Maximum image error:    " << maxImageError << std::endl;
+
+  if ( maxSpectrumError > 1e-5 || maxImageError > 1e-4 )
+    {
+    std::cout << "FAILED" << std::endl;
+    return 1;
+    }
+
+  std::cout << "PASSED" << std::endl;
+  return 0;
+}
@@ -0,0 +1,116 @@
+#include "cipThinPlateSplineSurface.h"
+#include "cipThinPlateSplineSurfaceDistanceCalculator.h"
+#include "cipThinPlateSplineSurfaceDistanceMap.h"
+#include <cmath>
+#include <iostream>
+#include <algorithm>
+
+int main( int argc, char* argv[] )
+{
+  // A smooth, slightly noisy height field sampled at scattered points
+  // (low discrepancy sequences, so that the test is deterministic)
+  std::vector< cip::PointType > points;
+  for ( unsigned int i=0; i<800; i++ )
+    {
+    double x = 100.0  + 200.0*std::fmod( i*0.6180339887, 1.0 );
+    double y = -330.0 + 160.0*std::fmod( i*0.7548776662, 1.0 );
+
+    cip::PointType point(3);
+      point[0] = x;
+      point[1] = y;
+      point[2] = 20.0*std::sin( x/40.0 ) + 10.0*std::cos( y/30.0 ) + 0.5*(std::fmod( i*0.5698402910, 1.0 ) - 0.5);
+
+    points.push_back( point );
+    }
+
+  double rms, max;
+
+  cipThinPlateSplineSurface tps;
+    tps.SetSurfacePoints( points );
+    tps.SetLambda( 0.1 );
+    tps.GetDifferenceToExactSurface( rms, max );
+
+  if ( tps.GetKernelCenters().size() != points.size() || rms != 0.0 || max != 0.0 )
+    {
+    std::cout << "FAILED" << std::endl;
+    return 1;
+    }
+
+  tps.SetNumberOfKernelCenters( 150 );
+  tps.GetDifferenceToExactSurface( rms, max );
+
+  std::cout << "Low-rank TPS height difference: rms " << rms << ", max " << max << std::endl;
+
+  if ( tps.GetKernelCenters().size() != 150 || tps.GetWVector().size() != 150 || 
+       rms > 0.05 || max > 0.25 )
+    {
+    std::cout << "FAILED" << std::endl;
+    return 1;
+    }
+
+  // Distances of points around the surface, computed from scratch and
+  // looked up in a distance map on a 2 mm grid
+  std::vector< cip::PointType > queries;
+  for ( unsigned int i=0; i<500; i++ )
+    {
+    cip::PointType query(3);
+      query[0] = 110.0  + 180.0*std::fmod( i*0.6180339887, 1.0 );
+      query[1] = -320.0 + 140.0*std::fmod( i*0.7548776662, 1.0 );
+      query[2] = tps.GetSurfaceHeight( query[0], query[1] ) + 16.0*(std::fmod( i*0.5698402910, 1.0 ) - 0.5);
+
+    queries.push_back( query );
+    }
+
+  std::vector< double > distances;
+  cipThinPlateSplineSurfaceDistanceCalculator calculator( tps );
+    calculator.ComputeDistances( queries, distances );
+
+  cipThinPlateSplineSurfaceDistanceMap::DistanceImageType::SizeType size;
+    size[0] = 101; size[1] = 81; size[2] = 41;
+  cipThinPlateSplineSurfaceDistanceMap::DistanceImageType::SpacingType spacing;
+    spacing.Fill( 2.0 );
+  cipThinPlateSplineSurfaceDistanceMap::DistanceImageType::PointType origin;
+    origin[0] = 100.0; origin[1] = -330.0; origin[2] = -40.0;
+
+  cipThinPlateSplineSurfaceDistanceMap::DistanceImageType::Pointer grid = 
+    cipThinPlateSplineSurfaceDistanceMap::DistanceImageType::New();
+    grid->SetRegions( size );
+    grid->SetSpacing( spacing );
+    grid->SetOrigin( origin );
+
+  cipThinPlateSplineSurfaceDistanceMap distanceMap( tps );
+    distanceMap.SetReferenceImage( grid );
+    distanceMap.SetBandWidth( 10.0 );
+    distanceMap.Update();
+
+  double maxLookupDifference = 0.0;
+  double maxRefinedDifference = 0.0;
+  unsigned int numLookups = 0;
+  for ( unsigned int i=0; i<queries.size(); i++ )
+    {
+    double distance;
+
+    distanceMap.SetRefineWithNewton( false );
+    if ( distanceMap.GetSignedDistance( queries[i], distance ) )
+      {
+      numLookups++;
+      maxLookupDifference = std::max( maxLookupDifference, std::abs( std::abs( distance ) - distances[i] ) );
+
+      distanceMap.SetRefineWithNewton( true );
+      distanceMap.GetSignedDistance( queries[i], distance );
+      maxRefinedDifference = std::max( maxRefinedDifference, std::abs( std::abs( distance ) - distances[i] ) );
+      }
+    }
+
+  std::cout << "Distance map lookups: " << numLookups << ", max difference " << maxLookupDifference;
+  std::cout << ", max difference after refinement " << maxRefinedDifference << std::endl;
+
+  if ( numLookups < 400 || maxLookupDifference > 0.3 || maxRefinedDifference > 0.01 )
+    {
+    std::cout << "FAILED" << std::endl;
+    return 1;
+    }
+
+  std::cout << "PASSED" << std::endl;
+  return 0;
+}
@@ -0,0 +1,153 @@
+#include "cipHelper.h"
+#include "itkCIPOrderStatisticImageFilter.h"
+#include "itkMedianImageFilter.h"
+#include "itkImageRegionIteratorWithIndex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+typedef itk::CIPOrderStatisticImageFilter< cip::CTType, cip::CTType >  OrderStatisticType;
+typedef itk::MedianImageFilter< cip::CTType, cip::CTType >             MedianType;
+typedef itk::ImageRegionIteratorWithIndex< cip::CTType >               CTIteratorType;
+typedef itk::ImageRegionIteratorWithIndex< cip::LabelMapType >         LabelMapIteratorType;
+
+// Percentile of the neighborhood of 'index' computed by sorting it
+short GetPercentile( cip::CTType::Pointer image, cip::LabelMapType::Pointer mask, cip::CTType::IndexType index,
+                     const cip::CTType::SizeType& radius, double percentile )
+{
+  cip::CTType::SizeType size = image->GetBufferedRegion().GetSize();
+
+  std::vector< short > values;
+  cip::CTType::IndexType neighbor;
+  for ( long k=-long(radius[2]); k<=long(radius[2]); k++ )
+    {
+    for ( long j=-long(radius[1]); j<=long(radius[1]); j++ )
+      {
+      for ( long i=-long(radius[0]); i<=long(radius[0]); i++ )
+        {
+        neighbor[0] = std::max( 0L, std::min( long(size[0]) - 1, index[0] + i ) );
+        neighbor[1] = std::max( 0L, std::min( long(size[1]) - 1, index[1] + j ) );
+        neighbor[2] = std::max( 0L, std::min( long(size[2]) - 1, index[2] + k ) );
+        if ( mask->GetPixel( neighbor ) != 0 )
+          {
+          values.push_back( image->GetPixel( neighbor ) );
+          }
+        }
+      }
+    }
+
+  std::sort( values.begin(), values.end() );
+  unsigned int rank = std::min( (unsigned int)(values.size()) - 1,
+                                (unsigned int)(std::floor( percentile*values.size()/100.0 )) );
+
+  return values[rank];
+}
+
+int main( int argc, char* argv[] )
+{
+  // Noisy image with a step from air to soft tissue, and a few outliers
+  cip::CTType::SizeType size;
+    size[0] = 23;
+    size[1] = 17;
+    size[2] = 11;
+
+  cip::CTType::Pointer image = cip::CTType::New();
+    image->SetRegions( size );
+    image->Allocate();
+
+  cip::LabelMapType::Pointer mask = cip::LabelMapType::New();
+    mask->SetRegions( size );
+    mask->Allocate();
+
+  unsigned int seed = 1;
+  CTIteratorType it( image, image->GetBufferedRegion() );
+  LabelMapIteratorType mIt( mask, mask->GetBufferedRegion() );
+  for ( it.GoToBegin(), mIt.GoToBegin(); !it.IsAtEnd(); ++it, ++mIt )
+    {
+    seed = 1103515245*seed + 12345;
+    int noise = int((seed >> 16)%200) - 100;
+
+    cip::CTType::IndexType index = it.GetIndex();
+    short value = (index[0] + index[2] < 14) ? -950 + noise : 40 + noise;
+    if ( (seed >> 8)%50 == 0 )
+      {
+      value = ((seed >> 8)%100 == 0) ? -32768 : 32767;
+      }
+    it.Set( value );
+    mIt.Set( (index[0] - 11)*(index[0] - 11) + (index[1] - 8)*(index[1] - 8) < 40 ? 1 : 0 );
+    }
+
+  // The median must be identical to itk::MedianImageFilter's
+  cip::CTType::SizeType radii[3];
+    radii[0].Fill( 1 );
+    radii[1].Fill( 2 );
+    radii[2][0] = 3;
+    radii[2][1] = 1;
+    radii[2][2] = 0;
+
+  unsigned int numMismatches = 0;
+  for ( unsigned int r=0; r<3; r++ )
+    {
+    MedianType::Pointer median = MedianType::New();
+      median->SetInput( image );
+      median->SetRadius( radii[r] );
+      median->Update();
+
+    OrderStatisticType::Pointer orderStatistic = OrderStatisticType::New();
+      orderStatistic->SetInput( image );
+      orderStatistic->SetRadius( radii[r] );
+      orderStatistic->SetNumberOfThreads( 3 );
+      orderStatistic->Update();
+
+    CTIteratorType mdIt( median->GetOutput(), median->GetOutput()->GetBufferedRegion() );
+    CTIteratorType osIt( orderStatistic->GetOutput(), orderStatistic->GetOutput()->GetBufferedRegion() );
+    for ( mdIt.GoToBegin(), osIt.GoToBegin(); !mdIt.IsAtEnd(); ++mdIt, ++osIt )
+      {
+      if ( mdIt.Get() != osIt.Get() )
+        {
+        numMismatches++;
+        }
+      }
+    }
+  std::cout << "Median mismatches: " << numMismatches << std::endl;
+
+  // Masked percentiles
+  unsigned int numMaskedMismatches = 0;
+  double percentiles[3] = { 0.0, 25.0, 100.0 };
+  for ( unsigned int p=0; p<3; p++ )
+    {
+    OrderStatisticType::Pointer orderStatistic = OrderStatisticType::New();
+      orderStatistic->SetInput( image );
+      orderStatistic->SetMaskImage( mask );
+      orderStatistic->SetRadius( radii[1] );
+      orderStatistic->SetPercentile( percentiles[p] );
+      orderStatistic->SetNumberOfThreads( 2 );
+      orderStatistic->Update();
+
+    CTIteratorType osIt( orderStatistic->GetOutput(), orderStatistic->GetOutput()->GetBufferedRegion() );
+    for ( osIt.GoToBegin(); !osIt.IsAtEnd(); ++osIt )
+      {
+      cip::CTType::IndexType index = osIt.GetIndex();
+      short expected = image->GetPixel( index );
+      if ( mask->GetPixel( index ) != 0 )
+        {
+        expected = GetPercentile( image, mask, index, radii[1], percentiles[p] );
+        }
+      if ( osIt.Get() != expected )
+        {
+        numMaskedMismatches++;
+        }
+      }
+    }
+  std::cout << "Masked percentile mismatches: " << numMaskedMismatches << std::endl;
+
+  if ( numMismatches > 0 || numMaskedMismatches > 0 )
+    {
+    std::cout << "FAILED" << std::endl;
+    return 1;
+    }
+
+  std::cout << "PASSED" << std::endl;
+  return 0;
+}
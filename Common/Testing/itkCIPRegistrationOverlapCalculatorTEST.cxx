@@ -0,0 +1,161 @@
+#include "cipChestConventions.h"
+#include "cipHelper.h"
+#include "itkCIPRegistrationOverlapCalculator.h"
+#include "itkAffineTransform.h"
+#include "itkResampleImageFilter.h"
+#include "itkNearestNeighborInterpolateImageFunction.h"
+#include "itkImageRegionConstIterator.h"
+#include <map>
+#include <cmath>
+
+int main( int argc, char* argv[] )
+{
+  typedef itk::CIPRegistrationOverlapCalculator< 3 >                                 CalculatorType;
+  typedef itk::AffineTransform< double, 3 >                                          TransformType;
+  typedef itk::ResampleImageFilter< cip::LabelMapType, cip::LabelMapType >           ResampleType;
+  typedef itk::NearestNeighborInterpolateImageFunction< cip::LabelMapType, double >  InterpolatorType;
+  typedef itk::ImageRegionConstIterator< cip::LabelMapType >                         IteratorType;
+
+  std::cout << "Reading label map..." << std::endl;
+  cip::LabelMapReaderType::Pointer reader = cip::LabelMapReaderType::New();
+    reader->SetFileName( argv[1] );
+  try
+    {
+    reader->Update();
+    }
+  catch ( itk::ExceptionObject &excp )
+    {
+    std::cerr << "Exception caught reading test image:";
+    std::cerr << excp << std::endl;
+    return 1;
+    }
+  cip::LabelMapType::Pointer labelMap = reader->GetOutput();
+
+  // Collect the values present in the label map
+  std::map< unsigned short, unsigned long > valueCounts;
+  IteratorType it( labelMap, labelMap->GetBufferedRegion() );
+  it.GoToBegin();
+  while ( !it.IsAtEnd() )
+    {
+    if ( it.Get() != 0 )
+      {
+      valueCounts[it.Get()]++;
+      }
+    ++it;
+    }
+
+  // First test: with the identity transform every value overlaps
+  // perfectly with itself
+  {
+    TransformType::Pointer identity = TransformType::New();
+      identity->SetIdentity();
+
+    CalculatorType::Pointer calculator = CalculatorType::New();
+      calculator->SetFixedLabelMap( labelMap );
+      calculator->SetMovingLabelMap( labelMap );
+      calculator->AddTransform( identity );
+    std::map< unsigned short, unsigned long >::iterator mIt = valueCounts.begin();
+    while ( mIt != valueCounts.end() )
+      {
+      calculator->AddValue( mIt->first );
+      ++mIt;
+      }
+    calculator->Compute();
+
+    for ( unsigned int i=0; i<calculator->GetOverlapStatistics().size(); i++ )
+      {
+      const CalculatorType::OVERLAPSTATISTICS& overlap = calculator->GetOverlapStatistics()[i];
+      if ( overlap.fixedCount != valueCounts[overlap.value] || overlap.dice != 1.0 ||
+           std::abs( overlap.cohenKappa - 1.0 ) > 1e-12 )
+        {
+        std::cout << "FAILED" << std::endl;
+        return 1;
+        }
+      }
+  }
+
+  // Second test: a translated, scaled chain of two transforms must give the
+  // same overlap as resampling the moving label map and comparing
+  {
+    TransformType::Pointer translation = TransformType::New();
+      translation->SetIdentity();
+    TransformType::OutputVectorType offset;
+      offset[0] = 1.3*labelMap->GetSpacing()[0];
+      offset[1] = -0.6*labelMap->GetSpacing()[1];
+      offset[2] = 0.35*labelMap->GetSpacing()[2];
+      translation->Translate( offset );
+    TransformType::Pointer scaling = TransformType::New();
+      scaling->SetIdentity();
+      scaling->Scale( 1.05 );
+
+    CalculatorType::Pointer calculator = CalculatorType::New();
+      calculator->SetFixedLabelMap( labelMap );
+      calculator->SetMovingLabelMap( labelMap );
+      calculator->AddTransform( translation );
+      calculator->AddTransform( scaling );
+      calculator->SetNumberOfThreads( 3 );
+    std::map< unsigned short, unsigned long >::iterator mIt = valueCounts.begin();
+    while ( mIt != valueCounts.end() )
+      {
+      calculator->AddValue( mIt->first );
+      ++mIt;
+      }
+    calculator->Compute();
+
+    // Reference: translation( scaling( x ) ), as with itk::CompositeTransform
+    TransformType::Pointer composed = TransformType::New();
+      composed->SetIdentity();
+      composed->Scale( 1.05 );
+      composed->Translate( offset );
+
+    ResampleType::Pointer resampler = ResampleType::New();
+      resampler->SetTransform( composed );
+      resampler->SetInterpolator( InterpolatorType::New() );
+      resampler->SetInput( labelMap );
+      resampler->SetSize( labelMap->GetLargestPossibleRegion().GetSize() );
+      resampler->SetOutputSpacing( labelMap->GetSpacing() );
+      resampler->SetOutputOrigin( labelMap->GetOrigin() );
+      resampler->SetOutputDirection( labelMap->GetDirection() );
+      resampler->Update();
+
+    for ( unsigned int i=0; i<calculator->GetOverlapStatistics().size(); i++ )
+      {
+      const CalculatorType::OVERLAPSTATISTICS& overlap = calculator->GetOverlapStatistics()[i];
+
+      unsigned long fixedCount = 0;
+      unsigned long movingCount = 0;
+      unsigned long intersectionCount = 0;
+      IteratorType fIt( labelMap, labelMap->GetBufferedRegion() );
+      IteratorType mIt( resampler->GetOutput(), resampler->GetOutput()->GetBufferedRegion() );
+      fIt.GoToBegin();
+      mIt.GoToBegin();
+      while ( !fIt.IsAtEnd() )
+        {
+        if ( fIt.Get() == overlap.value )
+          {
+          fixedCount++;
+          }
+        if ( mIt.Get() == overlap.value )
+          {
+          movingCount++;
+          if ( fIt.Get() == overlap.value )
+            {
+            intersectionCount++;
+            }
+          }
+        ++fIt;
+        ++mIt;
+        }
+
+      if ( overlap.fixedCount != fixedCount || overlap.movingCount != movingCount ||
+           overlap.intersectionCount != intersectionCount )
+        {
+        std::cout << "FAILED" << std::endl;
+        return 1;
+        }
+      }
+  }
+
+  std::cout << "PASSED" << std::endl;
+  return 0;
+}
@@ -0,0 +1,159 @@
+#include "cipHelper.h"
+#include "itkRegionCompetitionImageFilter.h"
+#include "itkImageRegionIteratorWithIndex.h"
+
+#include <iostream>
+#include <vector>
+
+typedef itk::RegionCompetitionImageFilter< cip::CTType, cip::LabelMapType >  RegionCompetitionType;
+typedef itk::ImageRegionIteratorWithIndex< cip::LabelMapType >               LabelMapIteratorType;
+
+// Reference propagation: at each iteration every unlabeled voxel that is not
+// on the image boundary takes the lowest label among its 26 neighbors, as
+// they were at the start of the iteration. Returns the number of voxels
+// labeled, and sets 'numIterations' to the number of iterations that
+// labeled at least one voxel.
+unsigned int PropagateLabels( std::vector< unsigned short >& labels, const unsigned int size[3],
+                              unsigned int maxIterations, unsigned int& numIterations )
+{
+  unsigned int numChanged = 0;
+  numIterations = 0;
+
+  std::vector< unsigned short > previous;
+  for ( unsigned int n=0; n<maxIterations; n++ )
+    {
+    previous = labels;
+
+    unsigned int numChangedInIteration = 0;
+    for ( unsigned int z=1; z+1<size[2]; z++ )
+      {
+      for ( unsigned int y=1; y+1<size[1]; y++ )
+        {
+        for ( unsigned int x=1; x+1<size[0]; x++ )
+          {
+          unsigned int index = (z*size[1] + y)*size[0] + x;
+          if ( previous[index] != 0 )
+            {
+            continue;
+            }
+
+          unsigned short newLabel = 0;
+          for ( unsigned int k=z-1; k<=z+1; k++ )
+            {
+            for ( unsigned int j=y-1; j<=y+1; j++ )
+              {
+              for ( unsigned int i=x-1; i<=x+1; i++ )
+                {
+                unsigned short value = previous[(k*size[1] + j)*size[0] + i];
+                if ( value != 0 && (newLabel == 0 || value < newLabel) )
+                  {
+                  newLabel = value;
+                  }
+                }
+              }
+            }
+
+          if ( newLabel != 0 )
+            {
+            labels[index] = newLabel;
+            numChangedInIteration++;
+            }
+          }
+        }
+      }
+
+    if ( numChangedInIteration == 0 )
+      {
+      break;
+      }
+    numChanged += numChangedInIteration;
+    numIterations++;
+    }
+
+  return numChanged;
+}
+
+int main( int argc, char* argv[] )
+{
+  // Sparse seeds with five labels, some of them on the boundary of the
+  // image. The initial front is large enough to be split between threads.
+  unsigned int size[3] = { 40, 36, 30 };
+
+  cip::CTType::SizeType itkSize;
+    itkSize[0] = size[0];
+    itkSize[1] = size[1];
+    itkSize[2] = size[2];
+
+  cip::CTType::Pointer image = cip::CTType::New();
+    image->SetRegions( itkSize );
+    image->Allocate();
+    image->FillBuffer( 0 );
+
+  cip::LabelMapType::Pointer seeds = cip::LabelMapType::New();
+    seeds->SetRegions( itkSize );
+    seeds->Allocate();
+
+  std::vector< unsigned short > seedLabels;
+  unsigned int seed = 1;
+  LabelMapIteratorType sIt( seeds, seeds->GetBufferedRegion() );
+  for ( sIt.GoToBegin(); !sIt.IsAtEnd(); ++sIt )
+    {
+    seed = 1103515245*seed + 12345;
+    unsigned short label = ((seed >> 8)%60 == 0) ? (unsigned short)(1 + (seed >> 16)%5) : 0;
+
+    sIt.Set( label );
+    seedLabels.push_back( label );
+    }
+
+  unsigned int maxIterations[3] = { 1, 3, 100 };
+  unsigned int numThreads[2] = { 1, 4 };
+
+  unsigned int numMismatches = 0;
+  unsigned int numCountMismatches = 0;
+  for ( unsigned int m=0; m<3; m++ )
+    {
+    std::vector< unsigned short > expected = seedLabels;
+    unsigned int expectedIterations;
+    unsigned int expectedChanged = PropagateLabels( expected, size, maxIterations[m], expectedIterations );
+
+    for ( unsigned int t=0; t<2; t++ )
+      {
+      RegionCompetitionType::Pointer regionCompetition = RegionCompetitionType::New();
+        regionCompetition->SetInput( image );
+        regionCompetition->SetInputLabels( seeds );
+        regionCompetition->SetMaximumNumberOfIterations( maxIterations[m] );
+        regionCompetition->SetNumberOfThreads( numThreads[t] );
+        regionCompetition->Update();
+
+      unsigned int index = 0;
+      LabelMapIteratorType oIt( regionCompetition->GetOutput(), regionCompetition->GetOutput()->GetBufferedRegion() );
+      for ( oIt.GoToBegin(); !oIt.IsAtEnd(); ++oIt, index++ )
+        {
+        if ( oIt.Get() != expected[index] )
+          {
+          numMismatches++;
+          }
+        }
+
+      if ( regionCompetition->GetTotalNumberOfPixelsChanged() != expectedChanged ||
+           regionCompetition->GetCurrentIterationNumber() != expectedIterations )
+        {
+        numCountMismatches++;
+        }
+
+      std::cout << "Iterations: " << regionCompetition->GetCurrentIterationNumber() << " (expected "
+                << expectedIterations << "), voxels changed: " << regionCompetition->GetTotalNumberOfPixelsChanged()
+                << " (expected " << expectedChanged << ")" << std::endl;
+      }
+    }
+  std::cout << "Label mismatches: " << numMismatches << std::endl;
+
+  if ( numMismatches > 0 || numCountMismatches > 0 )
+    {
+    std::cout << "FAILED" << std::endl;
+    return 1;
+    }
+
+  std::cout << "PASSED" << std::endl;
+  return 0;
+}
@@ -18,7 +18,6 @@ cipCylinderStencil::cipCylinderStencil()
 {
   this->Radius = 1.0;
   this->Height = 1.0;
-  this->Orientation = new double[3];
   this->Orientation[0] = 0;
   this->Orientation[1] = 0;
   this->Orientation[2] = 1;
@@ -27,7 +26,12 @@ cipCylinderStencil::cipCylinderStencil()
 
 cipCylinderStencil::~cipCylinderStencil()
 {
-  delete this->Orientation;
+}
+
+
+cipStencil* cipCylinderStencil::Clone() const
+{
+  return new cipCylinderStencil( *this );
 }
 
 
@@ -78,6 +82,109 @@ bool cipCylinderStencil::IsInsideStencilPattern( double x, double y, double z )
 }
 
 
+//
+// The line is inside the cylinder where it is both between the two
+// end caps (a linear condition on t) and within 'Radius' of the axis
+// (a quadratic condition on t). The span is the intersection of the
+// two intervals.
+//
+bool cipCylinderStencil::GetLineSpan( const double* const point, const double* const direction,
+                                      double* const tMin, double* const tMax ) const
+{
+  double mag = this->GetVectorMagnitude3D( this->Orientation );
+  if ( mag == 0 )
+    {
+    return false;
+    }
+
+  double axis[3];
+    axis[0] = this->Orientation[0]/mag;
+    axis[1] = this->Orientation[1]/mag;
+    axis[2] = this->Orientation[2]/mag;
+
+  double vec[3];
+    vec[0] = point[0] - this->Center[0];
+    vec[1] = point[1] - this->Center[1];
+    vec[2] = point[2] - this->Center[2];
+
+  double vecAlong = vec[0]*axis[0] + vec[1]*axis[1] + vec[2]*axis[2];
+  double dirAlong = direction[0]*axis[0] + direction[1]*axis[1] + direction[2]*axis[2];
+
+  double halfHeight = this->Height/2.0;
+
+  double low  = -DBL_MAX;
+  double high =  DBL_MAX;
+
+  //
+  // Between the end caps
+  //
+  if ( dirAlong == 0 )
+    {
+    if ( fabs( vecAlong ) > halfHeight )
+      {
+      return false;
+      }
+    }
+  else
+    {
+    double t0 = (-halfHeight - vecAlong)/dirAlong;
+    double t1 = ( halfHeight - vecAlong)/dirAlong;
+
+    low  = t0 < t1 ? t0 : t1;
+    high = t0 < t1 ? t1 : t0;
+    }
+
+  //
+  // Within the radius of the axis: the components of the position
+  // and direction vectors perpendicular to the axis
+  //
+  double vecPerp[3];
+  double dirPerp[3];
+  for ( unsigned int i=0; i<3; i++ )
+    {
+    vecPerp[i] = vec[i] - vecAlong*axis[i];
+    dirPerp[i] = direction[i] - dirAlong*axis[i];
+    }
+
+  double a = dirPerp[0]*dirPerp[0] + dirPerp[1]*dirPerp[1] + dirPerp[2]*dirPerp[2];
+  double b = 2.0*(vecPerp[0]*dirPerp[0] + vecPerp[1]*dirPerp[1] + vecPerp[2]*dirPerp[2]);
+  double c = vecPerp[0]*vecPerp[0] + vecPerp[1]*vecPerp[1] + vecPerp[2]*vecPerp[2] - this->Radius*this->Radius;
+
+  if ( a == 0 )
+    {
+    if ( c > 0 )
+      {
+      return false;
+      }
+    }
+  else
+    {
+    double discriminant = b*b - 4.0*a*c;
+    if ( discriminant < 0 )
+      {
+      return false;
+      }
+
+    double root = sqrt( discriminant );
+    double t0 = (-b - root)/(2.0*a);
+    double t1 = (-b + root)/(2.0*a);
+
+    t0 > low  ? low  = t0 : false;
+    t1 < high ? high = t1 : false;
+    }
+
+  if ( low > high )
+    {
+    return false;
+    }
+
+  *tMin = low;
+  *tMax = high;
+
+  return true;
+}
+
+
 void cipCylinderStencil::GetStencilBoundingBox( double* const bbMin, double* const bbMax ) const
 {
   bbMin[0] = this->BoundingBoxMin[0];
@@ -284,19 +391,19 @@ void cipCylinderStencil::SetOrientation( double x, double y, double z )
 }
 
 
-double cipCylinderStencil::GetVectorMagnitude3D( double vec[3] ) const
+double cipCylinderStencil::GetVectorMagnitude3D( const double vec[3] ) const
 {
   return sqrt( pow( vec[0], 2 ) + pow( vec[1], 2 ) + pow( vec[2], 2 ) );
 }
 
 
-double cipCylinderStencil::GetVectorMagnitude2D( double vec[2] ) const
+double cipCylinderStencil::GetVectorMagnitude2D( const double vec[2] ) const
 {
   return sqrt( pow( vec[0], 2 ) + pow( vec[1], 2 ) );  
 }
 
 
-double cipCylinderStencil::GetAngleBetweenVectors( double vec1[3], double vec2[3], bool returnDegrees ) const
+double cipCylinderStencil::GetAngleBetweenVectors( const double vec1[3], const double vec2[3], bool returnDegrees ) const
 {
   double vec1Mag = this->GetVectorMagnitude3D( vec1 );
   double vec2Mag = this->GetVectorMagnitude3D( vec2 );
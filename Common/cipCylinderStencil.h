@@ -37,6 +37,15 @@ public:
    *  method. */
   bool IsInsideStencilPattern( double, double, double ) const; 
 
+  /** Given a line through the physical point 'point' with direction
+   *  'direction', this method computes the range of the line
+   *  parameter t for which point + t*direction is inside the stencil
+   *  pattern. Returns false if the line misses the pattern. */
+  bool GetLineSpan( const double* const, const double* const, double* const, double* const ) const;
+
+  /** Create a copy of this stencil. The caller owns the copy. */
+  cipStencil* Clone() const;
+
   /** Get the bounding box of the stencil. The first argument should
    *  be a 3 element vector to hold the min x, y, and z physical
    *  coordinates of the bounding box. The second argument should be
@@ -60,13 +69,13 @@ public:
 
 private:
   void   ComputeStencilBoundingBox();
-  double GetVectorMagnitude2D( double[2] ) const;
-  double GetVectorMagnitude3D( double[3] ) const;
-  double GetAngleBetweenVectors( double[3], double[3], bool ) const;
+  double GetVectorMagnitude2D( const double[2] ) const;
+  double GetVectorMagnitude3D( const double[3] ) const;
+  double GetAngleBetweenVectors( const double[3], const double[3], bool ) const;
 
   double  Radius;
   double  Height;
-  double* Orientation;
+  double  Orientation[3];
 };
 
 #endif
@@ -0,0 +1,563 @@
+#include "cipDICOMSeriesReader.h"
+#include "cipExceptionObject.h"
+#include "itksys/Directory.hxx"
+#include "itksys/SystemTools.hxx"
+#include "gdcmReader.h"
+#include "gdcmImageReader.h"
+#include "gdcmImage.h"
+#include "gdcmAttribute.h"
+#include "gdcmGlobal.h"
+#include "gdcmDicts.h"
+#include "gdcmStringFilter.h"
+#include "gdcmTag.h"
+#include "itkMetaDataObject.h"
+#include <algorithm>
+#include <exception>
+#include <limits>
+#include <set>
+#include <sstream>
+
+namespace
+{
+// Orders slices along the slice normal; ties (which should not happen in
+// a well formed series) are broken by file name so the order is stable
+struct SliceLess
+{
+  template < class T >
+  bool operator()( const T* a, const T* b ) const
+  {
+    if ( a->normalPosition != b->normalPosition )
+      {
+      return a->normalPosition < b->normalPosition;
+      }
+    return a->fileName < b->fileName;
+  }
+};
+
+// Returns the value of a string element with the padding removed, or an
+// empty string if the element is not present
+std::string GetStringValue( const gdcm::DataSet& dataSet, const gdcm::Tag& tag )
+{
+  if ( !dataSet.FindDataElement( tag ) )
+    {
+    return "";
+    }
+
+  const gdcm::ByteValue* value = dataSet.GetDataElement( tag ).GetByteValue();
+  if ( !value )
+    {
+    return "";
+    }
+
+  std::string str( value->GetPointer(), value->GetLength() );
+  while ( !str.empty() && (str[str.size()-1] == '\0' || str[str.size()-1] == ' ') )
+    {
+    str.erase( str.size()-1 );
+    }
+
+  return str;
+}
+
+// Parses a backslash separated decimal string (VR DS) into 'values'.
+// Returns false if fewer than 'numValues' values are present.
+bool GetDecimalValues( const gdcm::DataSet& dataSet, const gdcm::Tag& tag, double* values, unsigned int numValues )
+{
+  std::string str = GetStringValue( dataSet, tag );
+  std::replace( str.begin(), str.end(), '\\', ' ' );
+
+  std::istringstream stream( str );
+  for ( unsigned int i=0; i<numValues; i++ )
+    {
+    if ( !(stream >> values[i]) )
+      {
+      return false;
+      }
+    }
+
+  return true;
+}
+
+// Value of the low 'bitsStored' bits of 'value', sign extended for
+// signed pixel types. The bits above them may hold overlays.
+template < class TPixel >
+long GetStoredValue( TPixel value, unsigned int bitsStored )
+{
+  unsigned long stored = static_cast< unsigned long >( static_cast< long >( value ) ) & ((1UL << bitsStored) - 1);
+  if ( std::numeric_limits< TPixel >::is_signed && (stored & (1UL << (bitsStored - 1))) )
+    {
+    return static_cast< long >( stored ) - (1L << bitsStored);
+    }
+
+  return static_cast< long >( stored );
+}
+
+template < class TPixel >
+void RescaleSlice( const char* input, short* output, unsigned int numPixels, double slope, double intercept,
+                   unsigned int bitsStored )
+{
+  const TPixel* in = reinterpret_cast< const TPixel* >( input );
+
+  if ( bitsStored < 8*sizeof( TPixel ) )
+    {
+    for ( unsigned int i=0; i<numPixels; i++ )
+      {
+      double value = static_cast< double >( GetStoredValue( in[i], bitsStored ) );
+      output[i] = static_cast< short >( value*slope + intercept );
+      }
+    }
+  else if ( slope == 1.0 && intercept == 0.0 )
+    {
+    for ( unsigned int i=0; i<numPixels; i++ )
+      {
+      output[i] = static_cast< short >( in[i] );
+      }
+    }
+  else
+    {
+    for ( unsigned int i=0; i<numPixels; i++ )
+      {
+      output[i] = static_cast< short >( static_cast< double >( in[i] )*slope + intercept );
+      }
+    }
+}
+} // end anonymous namespace
+
+
+cip::DICOMSeriesReader::DICOMSeriesReader()
+{
+  this->m_NumberOfThreads = 0;
+}
+
+
+cip::DICOMSeriesReader::~DICOMSeriesReader()
+{
+}
+
+
+void cip::DICOMSeriesReader::ScanHeader( SLICEHEADER& header ) const
+{
+  header.isImage = false;
+
+  // Stop at the pixel data; nothing after it is needed for sorting
+  std::set< gdcm::Tag > skipTags;
+
+  gdcm::Reader reader;
+    reader.SetFileName( header.fileName.c_str() );
+  if ( !reader.ReadUpToTag( gdcm::Tag( 0x7fe0, 0x0010 ), skipTags ) )
+    {
+    return;
+    }
+
+  const gdcm::DataSet& dataSet = reader.GetFile().GetDataSet();
+
+  gdcm::Attribute< 0x0028, 0x0010 > rowsAttribute;
+  gdcm::Attribute< 0x0028, 0x0011 > columnsAttribute;
+  if ( !dataSet.FindDataElement( rowsAttribute.GetTag() ) || !dataSet.FindDataElement( columnsAttribute.GetTag() ) )
+    {
+    return;
+    }
+  rowsAttribute.SetFromDataSet( dataSet );
+  columnsAttribute.SetFromDataSet( dataSet );
+
+  header.rows      = rowsAttribute.GetValue();
+  header.columns   = columnsAttribute.GetValue();
+  header.seriesUID = GetStringValue( dataSet, gdcm::Tag( 0x0020, 0x000e ) );
+
+  if ( !GetDecimalValues( dataSet, gdcm::Tag( 0x0020, 0x0032 ), header.position, 3 ) )
+    {
+    header.position[0] = header.position[1] = header.position[2] = 0.0;
+    }
+  if ( !GetDecimalValues( dataSet, gdcm::Tag( 0x0020, 0x0037 ), header.orientation, 6 ) )
+    {
+    header.orientation[0] = 1.0; header.orientation[1] = 0.0; header.orientation[2] = 0.0;
+    header.orientation[3] = 0.0; header.orientation[4] = 1.0; header.orientation[5] = 0.0;
+    }
+  if ( !GetDecimalValues( dataSet, gdcm::Tag( 0x0028, 0x0030 ), header.pixelSpacing, 2 ) )
+    {
+    header.pixelSpacing[0] = header.pixelSpacing[1] = 1.0;
+    }
+
+  // Project the position onto the slice normal (row x column cosines)
+  const double* o = header.orientation;
+  double normal[3];
+    normal[0] = o[1]*o[5] - o[2]*o[4];
+    normal[1] = o[2]*o[3] - o[0]*o[5];
+    normal[2] = o[0]*o[4] - o[1]*o[3];
+
+  header.normalPosition = normal[0]*header.position[0] + normal[1]*header.position[1] + normal[2]*header.position[2];
+  header.isImage        = true;
+}
+
+
+void cip::DICOMSeriesReader::DecodeSlice( unsigned int slice, std::vector< char >& buffer ) const
+{
+  const SLICEHEADER* header = this->m_Slices[slice];
+
+  gdcm::ImageReader reader;
+    reader.SetFileName( header->fileName.c_str() );
+  if ( !reader.Read() )
+    {
+    throw cip::ExceptionObject( __FILE__, __LINE__, "cip::DICOMSeriesReader::DecodeSlice",
+                                "Could not read " + header->fileName );
+    }
+
+  const gdcm::Image& image = reader.GetImage();
+
+  const unsigned int* dims = image.GetDimensions();
+  if ( dims[0] != header->columns || dims[1] != header->rows )
+    {
+    throw cip::ExceptionObject( __FILE__, __LINE__, "cip::DICOMSeriesReader::DecodeSlice",
+                                "Unexpected slice dimensions in " + header->fileName );
+    }
+  if ( image.GetNumberOfDimensions() > 2 && dims[2] > 1 )
+    {
+    throw cip::ExceptionObject( __FILE__, __LINE__, "cip::DICOMSeriesReader::DecodeSlice",
+                                "Multi-frame files are not supported: " + header->fileName );
+    }
+  if ( image.GetPhotometricInterpretation() != gdcm::PhotometricInterpretation::MONOCHROME2 )
+    {
+    throw cip::ExceptionObject( __FILE__, __LINE__, "cip::DICOMSeriesReader::DecodeSlice",
+                                "Only MONOCHROME2 images are supported: " + header->fileName );
+    }
+
+  const gdcm::PixelFormat& pixelFormat = image.GetPixelFormat();
+  if ( pixelFormat.GetSamplesPerPixel() != 1 || pixelFormat.GetHighBit() + 1 != pixelFormat.GetBitsStored() )
+    {
+    throw cip::ExceptionObject( __FILE__, __LINE__, "cip::DICOMSeriesReader::DecodeSlice",
+                                "Unsupported pixel layout in " + header->fileName );
+    }
+  unsigned int bitsStored = pixelFormat.GetBitsStored();
+
+  buffer.resize( image.GetBufferLength() );
+  if ( buffer.empty() || !image.GetBuffer( &buffer[0] ) )
+    {
+    throw cip::ExceptionObject( __FILE__, __LINE__, "cip::DICOMSeriesReader::DecodeSlice",
+                                "Could not decode the pixel data of " + header->fileName );
+    }
+
+  unsigned int numPixels = static_cast< unsigned int >( header->rows )*static_cast< unsigned int >( header->columns );
+  short* output = this->m_Output->GetBufferPointer() + static_cast< size_t >( slice )*numPixels;
+
+  double slope     = image.GetSlope();
+  double intercept = image.GetIntercept();
+
+  switch ( pixelFormat.GetScalarType() )
+    {
+    case gdcm::PixelFormat::INT8:
+      RescaleSlice< signed char >( &buffer[0], output, numPixels, slope, intercept, bitsStored );
+      break;
+    case gdcm::PixelFormat::UINT8:
+      RescaleSlice< unsigned char >( &buffer[0], output, numPixels, slope, intercept, bitsStored );
+      break;
+    case gdcm::PixelFormat::INT16:
+      RescaleSlice< short >( &buffer[0], output, numPixels, slope, intercept, bitsStored );
+      break;
+    case gdcm::PixelFormat::UINT16:
+      RescaleSlice< unsigned short >( &buffer[0], output, numPixels, slope, intercept, bitsStored );
+      break;
+    case gdcm::PixelFormat::INT32:
+      RescaleSlice< int >( &buffer[0], output, numPixels, slope, intercept, bitsStored );
+      break;
+    case gdcm::PixelFormat::UINT32:
+      RescaleSlice< unsigned int >( &buffer[0], output, numPixels, slope, intercept, bitsStored );
+      break;
+    default:
+      throw cip::ExceptionObject( __FILE__, __LINE__, "cip::DICOMSeriesReader::DecodeSlice",
+                                  "Unsupported pixel type in " + header->fileName );
+    }
+}
+
+
+ITK_THREAD_RETURN_TYPE cip::DICOMSeriesReader::ScanHeadersThreaderCallback( void* arg )
+{
+  THREADSTRUCT* str = static_cast< THREADSTRUCT* >
+    ( static_cast< itk::MultiThreader::ThreadInfoStruct* >( arg )->UserData );
+
+  std::vector< SLICEHEADER >& headers = str->reader->m_Headers;
+
+  while ( true )
+    {
+    str->mutex.Lock();
+    unsigned int i = str->nextItem++;
+    str->mutex.Unlock();
+
+    if ( i >= headers.size() )
+      {
+      break;
+      }
+
+    str->reader->ScanHeader( headers[i] );
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+
+ITK_THREAD_RETURN_TYPE cip::DICOMSeriesReader::DecodeSlicesThreaderCallback( void* arg )
+{
+  THREADSTRUCT* str = static_cast< THREADSTRUCT* >
+    ( static_cast< itk::MultiThreader::ThreadInfoStruct* >( arg )->UserData );
+
+  unsigned int numSlices = str->reader->m_Slices.size();
+
+  // Decoded pixel data of the current slice, reused across slices
+  std::vector< char > buffer;
+
+  while ( true )
+    {
+    str->mutex.Lock();
+    unsigned int i = str->nextItem++;
+    bool failed = !str->errorMessage.empty();
+    str->mutex.Unlock();
+
+    if ( i >= numSlices || failed )
+      {
+      break;
+      }
+
+    try
+      {
+      str->reader->DecodeSlice( i, buffer );
+      }
+    catch ( cip::ExceptionObject& excp )
+      {
+      std::ostringstream message;
+      message << excp;
+
+      str->SetErrorMessage( message.str() );
+      }
+    catch ( std::exception& excp )
+      {
+      // E.g. std::bad_alloc from the slice buffer
+      str->SetErrorMessage( std::string( "Could not decode slice: " ) + excp.what() );
+      }
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+
+std::string cip::DICOMSeriesReader::RunThreads( ITK_THREAD_RETURN_TYPE (*callback)( void* ), unsigned int numItems )
+{
+  unsigned int numThreads = this->m_NumberOfThreads;
+  if ( numThreads == 0 )
+    {
+    numThreads = itk::MultiThreader::GetGlobalDefaultNumberOfThreads();
+    }
+  if ( numThreads > numItems )
+    {
+    numThreads = numItems;
+    }
+  if ( numThreads == 0 )
+    {
+    return "";
+    }
+
+  THREADSTRUCT str;
+    str.reader   = this;
+    str.nextItem = 0;
+
+  itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+    threader->SetNumberOfThreads( numThreads );
+    threader->SetSingleMethod( callback, &str );
+    threader->SingleMethodExecute();
+
+  return str.errorMessage;
+}
+
+
+void cip::DICOMSeriesReader::AllocateOutput()
+{
+  const SLICEHEADER* first = this->m_Slices.front();
+  const SLICEHEADER* last  = this->m_Slices.back();
+
+  const double* o = first->orientation;
+  double normal[3];
+    normal[0] = o[1]*o[5] - o[2]*o[4];
+    normal[1] = o[2]*o[3] - o[0]*o[5];
+    normal[2] = o[0]*o[4] - o[1]*o[3];
+
+  unsigned int numSlices = this->m_Slices.size();
+
+  CTType::SpacingType spacing;
+    spacing[0] = first->pixelSpacing[1]; // Column spacing
+    spacing[1] = first->pixelSpacing[0]; // Row spacing
+    spacing[2] = 1.0;
+  if ( numSlices > 1 )
+    {
+    spacing[2] = (last->normalPosition - first->normalPosition)/static_cast< double >( numSlices - 1 );
+    }
+  if ( spacing[2] <= 0.0 )
+    {
+    spacing[2] = 1.0;
+    }
+
+  CTType::PointType origin;
+  CTType::DirectionType direction;
+  for ( unsigned int d=0; d<3; d++ )
+    {
+    origin[d]       = first->position[d];
+    direction[d][0] = o[d];
+    direction[d][1] = o[3+d];
+    direction[d][2] = normal[d];
+    }
+
+  CTType::SizeType size;
+    size[0] = first->columns;
+    size[1] = first->rows;
+    size[2] = numSlices;
+
+  CTType::RegionType region;
+    region.SetSize( size );
+
+  this->m_Output = CTType::New();
+    this->m_Output->SetRegions( region );
+    this->m_Output->SetSpacing( spacing );
+    this->m_Output->SetOrigin( origin );
+    this->m_Output->SetDirection( direction );
+    this->m_Output->Allocate();
+}
+
+
+void cip::DICOMSeriesReader::ReadMetaDataDictionary()
+{
+  const SLICEHEADER* first = this->m_Slices.front();
+
+  std::set< gdcm::Tag > skipTags;
+
+  gdcm::Reader reader;
+    reader.SetFileName( first->fileName.c_str() );
+  if ( !reader.ReadUpToTag( gdcm::Tag( 0x7fe0, 0x0010 ), skipTags ) )
+    {
+    throw cip::ExceptionObject( __FILE__, __LINE__, "cip::DICOMSeriesReader::ReadMetaDataDictionary",
+                                "Could not read " + first->fileName );
+    }
+
+  gdcm::StringFilter stringFilter;
+    stringFilter.SetFile( reader.GetFile() );
+
+  const gdcm::Dicts& dicts = gdcm::Global::GetInstance().GetDicts();
+
+  // Like itk::GDCMImageIO, keep the elements of the first slice that
+  // have a string representation under "gggg|eeee" keys. Binary
+  // elements and sequences are left out.
+  itk::MetaDataDictionary& dictionary = this->m_Output->GetMetaDataDictionary();
+
+  const gdcm::DataSet& dataSet = reader.GetFile().GetDataSet();
+  for ( gdcm::DataSet::ConstIterator it = dataSet.Begin(); it != dataSet.End(); ++it )
+    {
+    const gdcm::Tag& tag = it->GetTag();
+
+    gdcm::VR vr = it->GetVR();
+    if ( vr == gdcm::VR::INVALID || vr == gdcm::VR::UN )
+      {
+      vr = dicts.GetDictEntry( tag ).GetVR();
+      }
+    if ( tag.IsPrivate() || tag.GetGroup() == 0x7fe0 ||
+         (vr & (gdcm::VR::OB | gdcm::VR::OF | gdcm::VR::OW | gdcm::VR::SQ | gdcm::VR::UN)) ||
+         vr == gdcm::VR::INVALID )
+      {
+      continue;
+      }
+
+    itk::EncapsulateMetaData< std::string >( dictionary, tag.PrintAsPipeSeparatedString(),
+                                             stringFilter.ToString( tag ) );
+    }
+}
+
+
+void cip::DICOMSeriesReader::UpdateOutputInformation()
+{
+  this->m_Headers.clear();
+  this->m_Slices.clear();
+  this->m_SeriesUIDs.clear();
+  this->m_FileNames.clear();
+  this->m_Output = NULL;
+
+  itksys::Directory directory;
+  if ( !directory.Load( this->m_Directory.c_str() ) )
+    {
+    throw cip::ExceptionObject( __FILE__, __LINE__, "cip::DICOMSeriesReader::UpdateOutputInformation",
+                                "Could not open directory " + this->m_Directory );
+    }
+
+  for ( unsigned long i=0; i<directory.GetNumberOfFiles(); i++ )
+    {
+    std::string fileName = this->m_Directory + "/" + directory.GetFile( i );
+    if ( !itksys::SystemTools::FileIsDirectory( fileName.c_str() ) )
+      {
+      SLICEHEADER header;
+        header.fileName = fileName;
+        header.isImage  = false;
+
+      this->m_Headers.push_back( header );
+      }
+    }
+
+  // Pass 1: scan the headers and pick out the slices of the series
+  this->RunThreads( ScanHeadersThreaderCallback, this->m_Headers.size() );
+
+  std::set< std::string > uids;
+  for ( unsigned int i=0; i<this->m_Headers.size(); i++ )
+    {
+    if ( this->m_Headers[i].isImage )
+      {
+      uids.insert( this->m_Headers[i].seriesUID );
+      }
+    }
+  this->m_SeriesUIDs.assign( uids.begin(), uids.end() );
+
+  if ( this->m_SeriesUIDs.empty() )
+    {
+    throw cip::ExceptionObject( __FILE__, __LINE__, "cip::DICOMSeriesReader::UpdateOutputInformation",
+                                "No DICOM images found in " + this->m_Directory );
+    }
+
+  std::string seriesUID = this->m_SeriesUID.empty() ? this->m_SeriesUIDs.front() : this->m_SeriesUID;
+
+  for ( unsigned int i=0; i<this->m_Headers.size(); i++ )
+    {
+    if ( this->m_Headers[i].isImage && this->m_Headers[i].seriesUID == seriesUID )
+      {
+      this->m_Slices.push_back( &this->m_Headers[i] );
+      }
+    }
+
+  if ( this->m_Slices.empty() )
+    {
+    throw cip::ExceptionObject( __FILE__, __LINE__, "cip::DICOMSeriesReader::UpdateOutputInformation",
+                                "Series " + seriesUID + " not found in " + this->m_Directory );
+    }
+
+  std::sort( this->m_Slices.begin(), this->m_Slices.end(), SliceLess() );
+
+  for ( unsigned int i=0; i<this->m_Slices.size(); i++ )
+    {
+    if ( this->m_Slices[i]->rows != this->m_Slices[0]->rows ||
+         this->m_Slices[i]->columns != this->m_Slices[0]->columns )
+      {
+      throw cip::ExceptionObject( __FILE__, __LINE__, "cip::DICOMSeriesReader::UpdateOutputInformation",
+                                  "Slices of series " + seriesUID + " differ in size" );
+      }
+
+    this->m_FileNames.push_back( this->m_Slices[i]->fileName );
+    }
+}
+
+
+void cip::DICOMSeriesReader::Update()
+{
+  this->UpdateOutputInformation();
+
+  // Pass 2: decode every slice into its place in the output buffer
+  this->AllocateOutput();
+
+  std::string errorMessage = this->RunThreads( DecodeSlicesThreaderCallback, this->m_Slices.size() );
+  if ( !errorMessage.empty() )
+    {
+    this->m_Output = NULL;
+    throw cip::ExceptionObject( __FILE__, __LINE__, "cip::DICOMSeriesReader::Update", errorMessage );
+    }
+
+  this->ReadMetaDataDictionary();
+}
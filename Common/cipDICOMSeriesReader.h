@@ -0,0 +1,169 @@
+/**
+ *  \class cipDICOMSeriesReader
+ *  \ingroup common
+ *  \brief Reads a CT DICOM series from a directory into a single CT
+ *  volume, scanning and decoding the slices on multiple threads.
+ *
+ *  itk::GDCMSeriesFileNames parses the full header of every file to sort
+ *  the series and itk::ImageSeriesReader then decodes the slices one at a
+ *  time. This reader instead works in two concurrent passes over the
+ *  files of the directory:
+ *
+ *  1) Header scan. Each file is parsed only up to the pixel data element
+ *  to get its SeriesInstanceUID, ImagePositionPatient,
+ *  ImageOrientationPatient, Rows, Columns and PixelSpacing. Files that are
+ *  not DICOM images are ignored. The slices of the requested series (by
+ *  default the series whose UID sorts first, as itk::GDCMSeriesFileNames
+ *  does) are sorted by the projection of ImagePositionPatient onto the
+ *  slice normal, and the output volume is allocated.
+ *
+ *  2) Decode. Each slice's pixel data is decoded (including compressed
+ *  transfer syntaxes such as JPEG-LS and JPEG 2000) and written to its
+ *  slice of the output buffer, applying the rescale slope and intercept
+ *  in the same pass.
+ *
+ *  The output origin is the position of the first slice, the in-plane
+ *  spacing is PixelSpacing and the slice spacing is the distance between
+ *  the first and last slices divided by the number of slices less one.
+ *  The output's meta data dictionary holds the public, non binary
+ *  elements of the first slice under "gggg|eeee" keys, as with
+ *  itk::GDCMImageIO.
+ *
+ *  Only single frame, single sample MONOCHROME2 files are read; other
+ *  files of the series make the read fail. When BitsStored is less than
+ *  BitsAllocated, the bits above it are cleared and signed pixels are
+ *  sign extended from it; a HighBit other than BitsStored-1 is rejected.
+ *
+ *  Errors are reported by throwing cip::ExceptionObject. Allocating the
+ *  output can also throw itk::ExceptionObject.
+ */
+
+#ifndef __cipDICOMSeriesReader_h
+#define __cipDICOMSeriesReader_h
+
+#include <string>
+#include <vector>
+#include "itkImage.h"
+#include "itkMultiThreader.h"
+#include "itkSimpleFastMutexLock.h"
+
+namespace cip {
+  class DICOMSeriesReader
+  {
+  public:
+    DICOMSeriesReader();
+    ~DICOMSeriesReader();
+
+    typedef itk::Image< short, 3 >  CTType;
+
+    /** Directory containing the DICOM files (not searched recursively) */
+    void SetDirectory( const std::string& directory )
+    {
+      m_Directory = directory;
+    }
+
+    /** Read the series with this SeriesInstanceUID. If not set, the
+     *  series whose UID sorts first is read. */
+    void SetSeriesUID( const std::string& uid )
+    {
+      m_SeriesUID = uid;
+    }
+
+    /** Number of threads used to scan and decode. 0 (the default) uses
+     *  itk::MultiThreader::GetGlobalDefaultNumberOfThreads() */
+    void SetNumberOfThreads( unsigned int numberOfThreads )
+    {
+      m_NumberOfThreads = numberOfThreads;
+    }
+
+    unsigned int GetNumberOfThreads() const
+    {
+      return m_NumberOfThreads;
+    }
+
+    /** Scan the headers of the files in the directory and sort the
+     *  slices of the series without decoding any pixel data.
+     *  'GetSeriesUIDs' and 'GetFileNames' are valid afterwards. */
+    void UpdateOutputInformation();
+
+    /** Scan the directory and read the series */
+    void Update();
+
+    CTType::Pointer GetOutput() const
+    {
+      return m_Output;
+    }
+
+    /** UIDs of every series found in the directory, sorted */
+    const std::vector< std::string >& GetSeriesUIDs() const
+    {
+      return m_SeriesUIDs;
+    }
+
+    /** Files of the series that was read, in slice order */
+    const std::vector< std::string >& GetFileNames() const
+    {
+      return m_FileNames;
+    }
+
+  private:
+    /** Header information of one file */
+    struct SLICEHEADER
+    {
+      std::string    fileName;
+      bool           isImage;
+      std::string    seriesUID;
+      double         position[3];
+      double         orientation[6];
+      double         pixelSpacing[2];
+      unsigned short rows;
+      unsigned short columns;
+      double         normalPosition;
+    };
+
+    /** Work shared by the threads. Files (pass 1) or slices (pass 2) are
+     *  handed out one at a time. */
+    struct THREADSTRUCT
+    {
+      DICOMSeriesReader*        reader;
+      unsigned int              nextItem;
+      std::string               errorMessage;
+      itk::SimpleFastMutexLock  mutex;
+
+      /** Keeps the first error reported by a thread */
+      void SetErrorMessage( const std::string& message )
+      {
+        mutex.Lock();
+        if ( errorMessage.empty() )
+          {
+          errorMessage = message;
+          }
+        mutex.Unlock();
+      }
+    };
+
+    static ITK_THREAD_RETURN_TYPE ScanHeadersThreaderCallback( void* );
+    static ITK_THREAD_RETURN_TYPE DecodeSlicesThreaderCallback( void* );
+
+    /** Returns the first error reported by a thread, if any */
+    std::string RunThreads( ITK_THREAD_RETURN_TYPE (*callback)( void* ), unsigned int numItems );
+    void ScanHeader( SLICEHEADER& ) const;
+    void DecodeSlice( unsigned int slice, std::vector< char >& buffer ) const;
+    void AllocateOutput();
+    void ReadMetaDataDictionary();
+
+    std::string   m_Directory;
+    std::string   m_SeriesUID;
+    unsigned int  m_NumberOfThreads;
+
+    std::vector< SLICEHEADER >   m_Headers;
+    std::vector< SLICEHEADER* >  m_Slices;
+    std::vector< std::string >   m_SeriesUIDs;
+    std::vector< std::string >   m_FileNames;
+
+    CTType::Pointer  m_Output;
+  };
+
+} // namespace cip
+
+#endif
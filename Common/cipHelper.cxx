@@ -12,6 +12,7 @@
 #include "cipNewtonOptimizer.h"
 #include "cipParticleToThinPlateSplineSurfaceMetric.h"
 #include "cipExceptionObject.h"
+#include "cipInstrumentation.h"
 #include "itkResampleImageFilter.h"
 #include "itkBSplineInterpolateImageFunction.h"
 #include "itkNearestNeighborInterpolateImageFunction.h"
@@ -20,6 +21,7 @@
 #include "itkBinaryBallStructuringElement.h"
 #include "itkImageRegionIterator.h"
 #include "itkImageRegionIteratorWithIndex.h"
+#include "itkImageRegionConstIterator.h"
 #include "itkRegionOfInterestImageFilter.h"
 #include "vtkGraphToPolyData.h"
 #include "vtkRenderer.h"
@@ -37,45 +39,42 @@
 #include "vtkGlyphSource2D.h"
 #include "vtkPointData.h"
 #include "vtkFloatArray.h"
-#include "itkGDCMImageIO.h"
-#include "itkGDCMSeriesFileNames.h"
+#include "cipDICOMSeriesReader.h"
+#include "itkCIPBlockCompressedNrrdImageIOFactory.h"
+
+#include <algorithm>
+#include <cmath>
 
 
 cip::CTType::Pointer cip::ReadCTFromDirectory( std::string ctDir )
 {
-  
-  
-  typedef itk::GDCMImageIO                      ImageIOType;
-  typedef itk::GDCMSeriesFileNames              NamesGeneratorType;
-  
-  ImageIOType::Pointer gdcmIO = ImageIOType::New();
-  
-  std::cout << "---Getting file names..." << std::endl;
-  NamesGeneratorType::Pointer namesGenerator = NamesGeneratorType::New();
-  namesGenerator->SetInputDirectory( ctDir );
-  
-  const cip::CTSeriesReaderType::FileNamesContainer & filenames = namesGenerator->GetInputFileNames();
-  
   std::cout << "---Reading DICOM image..." << std::endl;
-  cip::CTSeriesReaderType::Pointer dicomReader = cip::CTSeriesReaderType::New();
-  dicomReader->SetImageIO( gdcmIO );
-  dicomReader->SetFileNames( filenames );
+  cip::DICOMSeriesReader dicomReader;
+    dicomReader.SetDirectory( ctDir );
   try
   {
-    dicomReader->Update();
+    dicomReader.Update();
+  }
+  catch ( cip::ExceptionObject &excp )
+  {
+    std::cerr << "Exception caught while reading dicom:";
+    std::cerr << excp << std::endl;
+    return NULL;
   }
-  catch (itk::ExceptionObject &excp)
+  catch ( itk::ExceptionObject &excp )
   {
     std::cerr << "Exception caught while reading dicom:";
     std::cerr << excp << std::endl;
     return NULL;
   }
   
-  return dicomReader->GetOutput();
+  return dicomReader.GetOutput();
 }
 
 cip::CTType::Pointer cip::ReadCTFromFile( std::string fileName )
 {
+  cip::ScopedTimer timer( "cip::ReadCTFromFile" );
+
   cip::CTReaderType::Pointer reader = cip::CTReaderType::New();
   reader->SetFileName( fileName );
   try
@@ -88,10 +87,139 @@ cip::CTType::Pointer cip::ReadCTFromFile( std::string fileName )
     std::cerr << excp << std::endl;
     return NULL;
   }
+
+  timer.AddVoxels( reader->GetOutput()->GetBufferedRegion().GetNumberOfPixels() );
   
   return reader->GetOutput();
 }
 
+namespace
+{
+  template < class TImage >
+  typename TImage::Pointer ReadImageRegionFromFile( std::string fileName, typename TImage::RegionType region )
+  {
+    cip::ScopedTimer timer( "cip::ReadImageRegionFromFile" );
+      timer.AddVoxels( region.GetNumberOfPixels() );
+
+    // Lets the reader load only the requested region of NRRD files
+    itk::CIPBlockCompressedNrrdImageIOFactory::RegisterOneFactory();
+
+    typedef itk::ImageFileReader< TImage > ReaderType;
+
+    typename ReaderType::Pointer reader = ReaderType::New();
+      reader->SetFileName( fileName );
+      reader->SetUseStreaming( true );
+
+    typename TImage::Pointer image;
+    try
+      {
+      reader->UpdateOutputInformation();
+      if ( !region.Crop( reader->GetOutput()->GetLargestPossibleRegion() ) )
+        {
+        std::cerr << "Requested region lies outside the image" << std::endl;
+        return NULL;
+        }
+      reader->GetOutput()->SetRequestedRegion( region );
+      reader->Update();
+
+      image = reader->GetOutput();
+      image->DisconnectPipeline();
+      }
+    catch ( itk::ExceptionObject &excp )
+      {
+      std::cerr << "Exception caught reading image:";
+      std::cerr << excp << std::endl;
+      return NULL;
+      }
+
+    // The reader may have read more than was requested
+    if ( image->GetBufferedRegion() != region )
+      {
+      typename TImage::Pointer cropped = TImage::New();
+        cropped->CopyInformation( image );
+        cropped->SetRegions( region );
+        cropped->Allocate();
+
+      itk::ImageRegionConstIterator< TImage > iIt( image, region );
+      itk::ImageRegionIterator< TImage >      oIt( cropped, region );
+
+      iIt.GoToBegin();
+      oIt.GoToBegin();
+      while ( !oIt.IsAtEnd() )
+        {
+        oIt.Set( iIt.Get() );
+
+        ++iIt;
+        ++oIt;
+        }
+
+      return cropped;
+      }
+
+    image->SetLargestPossibleRegion( region );
+
+    return image;
+  }
+}
+
+cip::CTType::Pointer cip::ReadCTFromFile( std::string fileName, cip::CTType::RegionType region )
+{
+  return ReadImageRegionFromFile< cip::CTType >( fileName, region );
+}
+
+cip::LabelMapType::Pointer cip::ReadLabelMapFromFile( std::string fileName, cip::LabelMapType::RegionType region )
+{
+  return ReadImageRegionFromFile< cip::LabelMapType >( fileName, region );
+}
+
+itk::ImageRegion< 3 > cip::GetRegionFromPhysicalBounds( const itk::ImageBase< 3 >* image, const double lower[3],
+                                                        const double upper[3], unsigned int padding )
+{
+  typedef itk::ContinuousIndex< double, 3 > ContinuousIndexType;
+
+  // The image may be oblique, so bound every corner of the box
+  double minIndex[3];
+  double maxIndex[3];
+  for ( unsigned int c=0; c<8; c++ )
+    {
+    itk::Point< double, 3 > corner;
+    for ( unsigned int d=0; d<3; d++ )
+      {
+      corner[d] = ( c & (1 << d) ) ? upper[d] : lower[d];
+      }
+
+    ContinuousIndexType cIndex;
+    image->TransformPhysicalPointToContinuousIndex( corner, cIndex );
+
+    for ( unsigned int d=0; d<3; d++ )
+      {
+      minIndex[d] = ( c == 0 ) ? cIndex[d] : std::min( minIndex[d], cIndex[d] );
+      maxIndex[d] = ( c == 0 ) ? cIndex[d] : std::max( maxIndex[d], cIndex[d] );
+      }
+    }
+
+  itk::ImageRegion< 3 > region;
+  for ( unsigned int d=0; d<3; d++ )
+    {
+    long first = static_cast< long >( std::floor( minIndex[d] ) ) - long(padding);
+    long last  = static_cast< long >( std::ceil( maxIndex[d] ) ) + long(padding);
+
+    region.SetIndex( d, first );
+    region.SetSize( d, static_cast< itk::SizeValueType >( std::max( last - first + 1, 0L ) ) );
+    }
+
+  // An empty region if the box misses the image
+  if ( !region.Crop( image->GetLargestPossibleRegion() ) )
+    {
+    itk::Size< 3 > zeroSize;
+      zeroSize.Fill( 0 );
+
+    region.SetSize( zeroSize );
+    }
+
+  return region;
+}
+
 // Code modified from //http://www.itk.org/Wiki/ITK/Examples/ImageProcessing/Upsampling
 cip::LabelMapType::Pointer cip::DownsampleLabelMap(short samplingAmount, cip::LabelMapType::Pointer inputLabelMap)
 {
@@ -1093,17 +1221,18 @@ void cip::GraftPointDataArrays( vtkSmartPointer< vtkPolyData > fromPoly, vtkSmar
 
 double cip::GetDistanceToThinPlateSplineSurface( const cipThinPlateSplineSurface& tps, cip::PointType point )
 {
-  cipNewtonOptimizer< 2 >::PointType* domainParams = new cipNewtonOptimizer< 2 >::PointType( 2, 2 );
-  (*domainParams)[0] = point[0]; 
-  (*domainParams)[1] = point[1]; 
+  cipNewtonOptimizer< 2 >::PointType domainParams( 2, 2 );
+  domainParams[0] = point[0]; 
+  domainParams[1] = point[1]; 
   
+  // The metric refers to 'tps' instead of copying it
   cipParticleToThinPlateSplineSurfaceMetric tpsMetric;
-    tpsMetric.SetThinPlateSplineSurface( tps );
+    tpsMetric.SetThinPlateSplineSurfaceReference( &tps );
     tpsMetric.SetParticle( point );
 
   cipNewtonOptimizer< 2 > optimizer;
     optimizer.SetMetric( tpsMetric );
-    optimizer.SetInitialParameters( domainParams );
+    optimizer.SetInitialParameters( &domainParams );
     optimizer.Update();
 
   double distance = vcl_sqrt( optimizer.GetOptimalValue() );
@@ -1111,30 +1240,28 @@ double cip::GetDistanceToThinPlateSplineSurface( const cipThinPlateSplineSurface
   return distance;  
 }
 
-void cip::GetClosestPointOnThinPlateSplineSurface( const cipThinPlateSplineSurface& tps, cip::PointType point, cip::PointType tpsPoint )
+void cip::GetClosestPointOnThinPlateSplineSurface( const cipThinPlateSplineSurface& tps, cip::PointType point, cip::PointType& tpsPoint )
 {
-  cipNewtonOptimizer< 2 >::PointType* optimalParams = new cipNewtonOptimizer< 2 >::PointType( 2, 2 );
+  cipNewtonOptimizer< 2 >::PointType optimalParams( 2, 2 );
 
-  cipNewtonOptimizer< 2 >::PointType* domainParams = new cipNewtonOptimizer< 2 >::PointType( 2, 2 );
-  (*domainParams)[0] = point[0]; 
-  (*domainParams)[1] = point[1]; 
+  cipNewtonOptimizer< 2 >::PointType domainParams( 2, 2 );
+  domainParams[0] = point[0]; 
+  domainParams[1] = point[1]; 
   
   cipParticleToThinPlateSplineSurfaceMetric tpsMetric;
-    tpsMetric.SetThinPlateSplineSurface( tps );
+    tpsMetric.SetThinPlateSplineSurfaceReference( &tps );
     tpsMetric.SetParticle( point );
 
   cipNewtonOptimizer< 2 > optimizer;
     optimizer.SetMetric( tpsMetric );
-    optimizer.SetInitialParameters( domainParams );
+    optimizer.SetInitialParameters( &domainParams );
     optimizer.Update();
-    optimizer.GetOptimalParameters( optimalParams );
+    optimizer.GetOptimalParameters( &optimalParams );
 
-  tpsPoint[0] = (*optimalParams)[0];
-  tpsPoint[1] = (*optimalParams)[1];
+  tpsPoint.resize( 3 );
+  tpsPoint[0] = optimalParams[0];
+  tpsPoint[1] = optimalParams[1];
   tpsPoint[2] = tps.GetSurfaceHeight( tpsPoint[0], tpsPoint[1] );
-
-  delete optimalParams;
-  delete domainParams;
 }
 
 void cip::TransferFieldDataToFromPointData( vtkSmartPointer< vtkPolyData > inPolyData, vtkSmartPointer< vtkPolyData > outPolyData,
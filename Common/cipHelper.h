@@ -46,6 +46,22 @@ namespace cip {
   /** Function to read CT from file */
   cip::CTType::Pointer ReadCTFromFile( std::string fileName );
 
+  /** Function to read only 'region' of the CT in a file. The region is cropped to
+   *  the image, and the returned image's largest possible region is the cropped
+   *  region (indices are those of the full image). NRRD files that are raw or were
+   *  written with block compression are read without loading the rest of the volume. */
+  cip::CTType::Pointer ReadCTFromFile( std::string fileName, cip::CTType::RegionType region );
+
+  /** Function to read only 'region' of the label map in a file. See ReadCTFromFile. */
+  cip::LabelMapType::Pointer ReadLabelMapFromFile( std::string fileName, cip::LabelMapType::RegionType region );
+
+  /** Function that returns the smallest region of 'image' containing the axis-aligned
+   *  box between the physical points 'lower' and 'upper', padded by 'padding' voxels
+   *  and cropped to the image. Only the image information is used, so 'image' may be
+   *  the output of a reader after UpdateOutputInformation(). */
+  itk::ImageRegion< 3 > GetRegionFromPhysicalBounds( const itk::ImageBase< 3 >* image, const double lower[3],
+                                                     const double upper[3], unsigned int padding );
+
   /** Function that downsamples a label map. Takes in as input a value for the downsampling amount and
    * a pointer to a LabelMapType, and returns a pointer to a downsampled LabelMapType. */
   cip::LabelMapType::Pointer DownsampleLabelMap(short samplingAmount, cip::LabelMapType::Pointer inputLabelMap);
@@ -131,7 +147,8 @@ namespace cip {
   void GraftPointDataArrays( vtkSmartPointer< vtkPolyData >, vtkSmartPointer< vtkPolyData > );
   
   /** Given a thin plate spline surface and a point, this function will find the minimum distance
-   *  to the surface */
+   *  to the surface. To compute the distances of many points to the same surface, use
+   *  cipThinPlateSplineSurfaceDistanceCalculator instead. */
   double GetDistanceToThinPlateSplineSurface( const cipThinPlateSplineSurface&, cip::PointType );
 
   /**Transfers the contents of a VTK polydata's field data to point data and vice-versa. 
@@ -145,7 +162,7 @@ namespace cip {
 
   /** Given a thin plate spline surface and some point in 3D space, this function will 
    *  compute the closest point on the surface and set it to tpsPoint. */
-  void GetClosestPointOnThinPlateSplineSurface( const cipThinPlateSplineSurface& tps, cip::PointType point, cip::PointType tpsPoint );
+  void GetClosestPointOnThinPlateSplineSurface( const cipThinPlateSplineSurface& tps, cip::PointType point, cip::PointType& tpsPoint );
 }  
 
 #endif
@@ -0,0 +1,486 @@
+#include "cipInstrumentation.h"
+#include "itkSimpleFastMutexLock.h"
+#include "itksys/SystemTools.hxx"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <vector>
+
+#if defined( _WIN32 )
+#include <windows.h>
+#include <psapi.h>
+#include <process.h>
+#else
+#include <pthread.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+int cip::Instrumentation::m_State = -1;
+
+namespace
+{
+/** One recorded stage */
+struct STAGE
+{
+  std::string                   name;
+  double                        startTime;
+  double                        endTime;
+  cip::Instrumentation::CounterType voxels;
+  cip::Instrumentation::CounterType particles;
+  cip::Instrumentation::CounterType peakResidentSetSize;
+  unsigned int                  threadId;
+};
+
+/** Per-name totals for the JSON summary */
+struct STAGESUMMARY
+{
+  unsigned int                  count;
+  double                        totalTime;
+  double                        maxTime;
+  cip::Instrumentation::CounterType voxels;
+  cip::Instrumentation::CounterType particles;
+  cip::Instrumentation::CounterType peakResidentSetSize;
+};
+
+int GetProcessId()
+{
+#if defined( _WIN32 )
+  return _getpid();
+#else
+  return static_cast< int >( getpid() );
+#endif
+}
+
+/** Every tool links its own copy of CIPCommon, so a program that loads
+ *  tools as libraries (e.g. RunCIPPipeline) has one recorder per tool.
+ *  The first module of the process claims it by setting this environment
+ *  variable to its process id, which the copies loaded later can see. */
+const char* const MODULEPROCESSVARIABLE = "CIP_INSTRUMENTATION_PROCESS";
+
+/** Returns true the first time it is called in the process, across
+ *  every copy of CIPCommon. Called while the program or a library is
+ *  being loaded, before any threads are started. */
+bool ClaimProcess()
+{
+  std::ostringstream pid;
+  pid << GetProcessId();
+
+  const char* owner = std::getenv( MODULEPROCESSVARIABLE );
+  if ( owner != NULL && pid.str() == owner )
+    {
+    return false;
+    }
+
+  std::string variable = std::string( MODULEPROCESSVARIABLE ) + "=" + pid.str();
+  itksys::SystemTools::PutEnv( variable.c_str() );
+
+  return true;
+}
+
+/** Collects the stages of the process and writes the report when the
+ *  process exits. Created on first use, so that it outlives the static
+ *  objects (like cip::ModuleInstrumentation) that record into it. */
+class Recorder
+{
+public:
+  Recorder()
+    : m_Enabled( false ), m_Format( "json" ), m_StartTime( cip::Instrumentation::GetTime() ), m_Dirty( false ),
+      m_LoadedModule( false )
+  {
+    const char* fileName = std::getenv( "CIP_INSTRUMENTATION" );
+    const char* format   = std::getenv( "CIP_INSTRUMENTATION_FORMAT" );
+
+    if ( format != NULL && *format != '\0' )
+      {
+      m_Format = format;
+      }
+    if ( fileName != NULL && *fileName != '\0' && std::string( fileName ) != "0" )
+      {
+      m_Enabled  = true;
+      m_FileName = fileName;
+      }
+  }
+
+  ~Recorder()
+  {
+    if ( m_Dirty )
+      {
+      this->Write();
+      }
+  }
+
+  bool IsEnabled()
+  {
+    m_Lock.Lock();
+    bool enabled = m_Enabled;
+    m_Lock.Unlock();
+
+    return enabled;
+  }
+
+  void Enable( const std::string& fileName, const std::string& format )
+  {
+    m_Lock.Lock();
+    m_Enabled  = true;
+    m_FileName = fileName;
+    if ( !format.empty() )
+      {
+      m_Format = format;
+      }
+    m_Lock.Unlock();
+  }
+
+  void SetModuleName( const std::string& name, bool loadedModule )
+  {
+    m_Lock.Lock();
+    m_ModuleName   = name;
+    m_LoadedModule = loadedModule;
+    m_Lock.Unlock();
+  }
+
+  void Record( const STAGE& stage )
+  {
+    m_Lock.Lock();
+    m_Stages.push_back( stage );
+    m_Stages.back().threadId = this->GetThreadId();
+    m_Dirty = true;
+    m_Lock.Unlock();
+  }
+
+  void Write()
+  {
+    m_Lock.Lock();
+    std::string fileName   = m_FileName;
+    std::string moduleName = m_ModuleName;
+    bool loadedModule      = m_LoadedModule;
+    std::string report     = ( m_Format == "trace" ) ? this->GetTraceReport() : this->GetSummaryReport();
+    m_Dirty = false;
+    m_Lock.Unlock();
+
+    if ( fileName == "1" || fileName == "-" || fileName == "stderr" )
+      {
+      std::cerr << report;
+      return;
+      }
+
+    // A tool loaded into another program writes its own report next to
+    // the program's, with its name added before the extension
+    if ( loadedModule && fileName.find( "%m" ) == std::string::npos )
+      {
+      std::string::size_type dot   = fileName.rfind( '.' );
+      std::string::size_type slash = fileName.find_last_of( "/\\" );
+      if ( dot == std::string::npos || ( slash != std::string::npos && dot < slash ) )
+        {
+        dot = fileName.size();
+        }
+      fileName.insert( dot, "-%m" );
+      }
+
+    std::ostringstream pid;
+    pid << GetProcessId();
+    itksys::SystemTools::ReplaceString( fileName, "%p", pid.str().c_str() );
+    itksys::SystemTools::ReplaceString( fileName, "%m", moduleName.c_str() );
+
+    std::ofstream file( fileName.c_str() );
+    if ( !file )
+      {
+      std::cerr << "Could not write instrumentation report to " << fileName << std::endl;
+      return;
+      }
+    file << report;
+  }
+
+private:
+  /** Small consecutive ids for the threads that recorded stages, so
+   *  that the trace shows one row per thread. Called with the lock held. */
+  unsigned int GetThreadId()
+  {
+#if defined( _WIN32 )
+    DWORD self = GetCurrentThreadId();
+    for ( unsigned int i = 0; i < m_Threads.size(); i++ )
+      {
+      if ( m_Threads[i] == self )
+        {
+        return i;
+        }
+      }
+#else
+    pthread_t self = pthread_self();
+    for ( unsigned int i = 0; i < m_Threads.size(); i++ )
+      {
+      if ( pthread_equal( m_Threads[i], self ) )
+        {
+        return i;
+        }
+      }
+#endif
+    m_Threads.push_back( self );
+
+    return static_cast< unsigned int >( m_Threads.size() - 1 );
+  }
+
+  static std::string Quote( const std::string& value )
+  {
+    std::string quoted = "\"";
+    for ( unsigned int i = 0; i < value.size(); i++ )
+      {
+      char c = value[i];
+      if ( c == '"' || c == '\\' )
+        {
+        quoted += '\\';
+        quoted += c;
+        }
+      else if ( static_cast< unsigned char >( c ) < 0x20 )
+        {
+        char escaped[8];
+        std::sprintf( escaped, "\\u%04x", static_cast< unsigned int >( c ) );
+        quoted += escaped;
+        }
+      else
+        {
+        quoted += c;
+        }
+      }
+    quoted += "\"";
+
+    return quoted;
+  }
+
+  std::string GetSummaryReport() const
+  {
+    // Stages are summarized by name, in the order they first finished
+    std::vector< std::string > names;
+    std::map< std::string, STAGESUMMARY > summaries;
+    for ( unsigned int i = 0; i < m_Stages.size(); i++ )
+      {
+      const STAGE& stage = m_Stages[i];
+      double time = stage.endTime - stage.startTime;
+
+      std::map< std::string, STAGESUMMARY >::iterator it = summaries.find( stage.name );
+      if ( it == summaries.end() )
+        {
+        STAGESUMMARY summary;
+          summary.count               = 0;
+          summary.totalTime           = 0.0;
+          summary.maxTime             = 0.0;
+          summary.voxels              = 0;
+          summary.particles           = 0;
+          summary.peakResidentSetSize = 0;
+
+        names.push_back( stage.name );
+        it = summaries.insert( std::make_pair( stage.name, summary ) ).first;
+        }
+
+      STAGESUMMARY& summary = it->second;
+      summary.count++;
+      summary.totalTime += time;
+      summary.voxels    += stage.voxels;
+      summary.particles += stage.particles;
+      if ( time > summary.maxTime )
+        {
+        summary.maxTime = time;
+        }
+      if ( stage.peakResidentSetSize > summary.peakResidentSetSize )
+        {
+        summary.peakResidentSetSize = stage.peakResidentSetSize;
+        }
+      }
+
+    std::ostringstream report;
+    report << "{" << std::endl;
+    report << "  \"module\": " << Quote( m_ModuleName ) << "," << std::endl;
+    report << "  \"pid\": " << GetProcessId() << "," << std::endl;
+    report << "  \"wallTime\": " << cip::Instrumentation::GetTime() - m_StartTime << "," << std::endl;
+    report << "  \"peakRSS\": " << cip::Instrumentation::GetPeakResidentSetSize() << "," << std::endl;
+    report << "  \"stages\": [";
+    for ( unsigned int i = 0; i < names.size(); i++ )
+      {
+      const STAGESUMMARY& summary = summaries.find( names[i] )->second;
+
+      report << ( i == 0 ? "" : "," ) << std::endl;
+      report << "    { \"name\": " << Quote( names[i] )
+             << ", \"count\": " << summary.count
+             << ", \"totalTime\": " << summary.totalTime
+             << ", \"maxTime\": " << summary.maxTime
+             << ", \"voxels\": " << summary.voxels
+             << ", \"particles\": " << summary.particles;
+      if ( summary.totalTime > 0.0 )
+        {
+        report << ", \"voxelsPerSecond\": " << double( summary.voxels ) / summary.totalTime
+               << ", \"particlesPerSecond\": " << double( summary.particles ) / summary.totalTime;
+        }
+      report << ", \"peakRSS\": " << summary.peakResidentSetSize << " }";
+      }
+    report << std::endl << "  ]" << std::endl;
+    report << "}" << std::endl;
+
+    return report.str();
+  }
+
+  std::string GetTraceReport() const
+  {
+    int pid = GetProcessId();
+
+    std::ostringstream report;
+    report.precision( 15 );
+    report << "{ \"displayTimeUnit\": \"ms\", \"traceEvents\": [" << std::endl;
+    report << "  { \"name\": \"process_name\", \"ph\": \"M\", \"pid\": " << pid
+           << ", \"tid\": 0, \"args\": { \"name\": " << Quote( m_ModuleName ) << " } }";
+    for ( unsigned int i = 0; i < m_Stages.size(); i++ )
+      {
+      const STAGE& stage = m_Stages[i];
+
+      // Times are in microseconds from the start of the process
+      report << "," << std::endl;
+      report << "  { \"name\": " << Quote( stage.name ) << ", \"cat\": \"cip\", \"ph\": \"X\""
+             << ", \"ts\": " << ( stage.startTime - m_StartTime ) * 1e6
+             << ", \"dur\": " << ( stage.endTime - stage.startTime ) * 1e6
+             << ", \"pid\": " << pid << ", \"tid\": " << stage.threadId
+             << ", \"args\": { \"voxels\": " << stage.voxels
+             << ", \"particles\": " << stage.particles
+             << ", \"peakRSS\": " << stage.peakResidentSetSize << " } }";
+      }
+    report << std::endl << "] }" << std::endl;
+
+    return report.str();
+  }
+
+  itk::SimpleFastMutexLock  m_Lock;
+  bool                      m_Enabled;
+  std::string               m_FileName;
+  std::string               m_Format;
+  std::string               m_ModuleName;
+  double                    m_StartTime;
+  bool                      m_Dirty;
+  bool                      m_LoadedModule;
+  std::vector< STAGE >      m_Stages;
+#if defined( _WIN32 )
+  std::vector< DWORD >      m_Threads;
+#else
+  std::vector< pthread_t >  m_Threads;
+#endif
+};
+
+Recorder& GetRecorder()
+{
+  static Recorder recorder;
+
+  return recorder;
+}
+
+// The state is read from the environment while the program (or the
+// library holding this copy of CIPCommon) is loaded, before any threads
+// are started, so that the timers of worker threads only ever read it
+const bool stateInitialized = ( cip::Instrumentation::IsEnabled(), true );
+
+} // end anonymous namespace
+
+
+void cip::Instrumentation::Initialize()
+{
+  m_State = GetRecorder().IsEnabled() ? 1 : 0;
+}
+
+
+void cip::Instrumentation::Enable( const std::string& fileName, const std::string& format )
+{
+  GetRecorder().Enable( fileName, format );
+  m_State = 1;
+
+  // Tools loaded later as libraries have their own recorders, which read
+  // the environment when they are loaded
+  std::string variable = "CIP_INSTRUMENTATION=" + fileName;
+  itksys::SystemTools::PutEnv( variable.c_str() );
+  if ( !format.empty() )
+    {
+    variable = "CIP_INSTRUMENTATION_FORMAT=" + format;
+    itksys::SystemTools::PutEnv( variable.c_str() );
+    }
+}
+
+
+void cip::Instrumentation::SetModuleName( const std::string& name )
+{
+  GetRecorder().SetModuleName( name, false );
+}
+
+
+void cip::Instrumentation::RecordStage( const char* name, double startTime, double endTime,
+                                        CounterType voxels, CounterType particles )
+{
+  STAGE stage;
+    stage.name                = name;
+    stage.startTime           = startTime;
+    stage.endTime             = endTime;
+    stage.voxels              = voxels;
+    stage.particles           = particles;
+    stage.peakResidentSetSize = GetPeakResidentSetSize();
+    stage.threadId            = 0;
+
+  GetRecorder().Record( stage );
+}
+
+
+void cip::Instrumentation::Flush()
+{
+  GetRecorder().Write();
+}
+
+
+double cip::Instrumentation::GetTime()
+{
+  return itksys::SystemTools::GetTime();
+}
+
+
+cip::Instrumentation::CounterType cip::Instrumentation::GetPeakResidentSetSize()
+{
+#if defined( _WIN32 )
+  PROCESS_MEMORY_COUNTERS counters;
+  if ( GetProcessMemoryInfo( GetCurrentProcess(), &counters, sizeof( counters ) ) )
+    {
+    return static_cast< CounterType >( counters.PeakWorkingSetSize );
+    }
+  return 0;
+#else
+  struct rusage usage;
+  if ( getrusage( RUSAGE_SELF, &usage ) != 0 )
+    {
+    return 0;
+    }
+#if defined( __APPLE__ )
+  // Bytes on Mac OS X, kilobytes everywhere else
+  return static_cast< CounterType >( usage.ru_maxrss );
+#else
+  return static_cast< CounterType >( usage.ru_maxrss ) * 1024;
+#endif
+#endif
+}
+
+
+cip::ModuleInstrumentation::ModuleInstrumentation( const char* moduleName )
+  : m_Timer( NULL )
+{
+  // Tools loaded as libraries into another program (e.g. RunCIPPipeline)
+  // are timed by that program, so only the first module of the process
+  // is timed as a whole. The others still record the stages of their
+  // filters, into reports of their own.
+  bool firstModule = ClaimProcess();
+
+  GetRecorder().SetModuleName( moduleName, !firstModule );
+  if ( firstModule && Instrumentation::IsEnabled() )
+    {
+    m_Timer = new ScopedTimer( moduleName );
+    }
+}
+
+
+cip::ModuleInstrumentation::~ModuleInstrumentation()
+{
+  delete m_Timer;
+}
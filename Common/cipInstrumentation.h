@@ -0,0 +1,166 @@
+/**
+ *  \file cipInstrumentation
+ *  \ingroup common
+ *  \brief Lightweight per-stage timing, memory and throughput
+ *  instrumentation for filters and command line tools.
+ *
+ *  Instrumentation is off unless the CIP_INSTRUMENTATION environment
+ *  variable is set (or 'cip::Instrumentation::Enable' is called, e.g.
+ *  from a '--instrumentation' flag). Its value is the file the report is
+ *  written to when the process exits; "1", "-" or "stderr" write to the
+ *  standard error, and "%p" in a file name is replaced by the process
+ *  id, so that several tools can be instrumented at once:
+ *
+ *    CIP_INSTRUMENTATION=/tmp/cip-%p.json GeneratePartialLungLabelMap ...
+ *
+ *  "%m" is replaced by the name of the tool. Every tool links its own
+ *  copy of CIPCommon, so a program that loads tools as libraries (e.g.
+ *  RunCIPPipeline) gets a report for itself and one for each tool it
+ *  loaded, holding the stages of that tool's filters. Unless the file
+ *  name has "%m", the tool's name is added before its extension
+ *  (/tmp/cip-%p.json becomes /tmp/cip-%p-SegmentLungLobes.json).
+ *
+ *  CIP_INSTRUMENTATION_FORMAT selects the report format: "json" (the
+ *  default) writes one summary entry per stage name (call count, total
+ *  and maximum wall time, voxel and particle counts, throughput and the
+ *  peak resident set size at the end of the stage); "trace" writes every
+ *  stage as a complete event in the Chrome trace event format, which
+ *  can be loaded in chrome://tracing or Perfetto.
+ *
+ *  A stage is timed by a 'cip::ScopedTimer' living for the duration of
+ *  the stage:
+ *
+ *    cip::ScopedTimer timer( "CIPPartialLungLabelMap::CloseLabelMap" );
+ *    timer.AddVoxels( region.GetNumberOfPixels() );
+ *
+ *  When instrumentation is disabled a timer only tests a flag, and when
+ *  CIP_DISABLE_INSTRUMENTATION is defined at compile time the test is a
+ *  constant and the timers compile away entirely.
+ */
+
+#ifndef __cipInstrumentation_h
+#define __cipInstrumentation_h
+
+#include <string>
+
+namespace cip
+{
+class Instrumentation
+{
+public:
+  typedef unsigned long long CounterType;
+
+  /** Returns true if stages are being recorded */
+  static bool IsEnabled()
+  {
+#ifdef CIP_DISABLE_INSTRUMENTATION
+    return false;
+#else
+    if ( m_State < 0 )
+      {
+      Initialize();
+      }
+    return m_State > 0;
+#endif
+  }
+
+  /** Turn instrumentation on, overriding the environment. 'fileName'
+   *  and 'format' have the same meaning as the CIP_INSTRUMENTATION and
+   *  CIP_INSTRUMENTATION_FORMAT environment variables, which are set to
+   *  them for the tools loaded afterwards; an empty format keeps the
+   *  current one. Must be called before any threads are started. */
+  static void Enable( const std::string& fileName, const std::string& format );
+
+  /** Name of the command line tool or program being instrumented,
+   *  written at the top of the report */
+  static void SetModuleName( const std::string& name );
+
+  /** Record a stage that started and ended at the given wall times (in
+   *  seconds, as returned by 'GetTime') */
+  static void RecordStage( const char* name, double startTime, double endTime,
+                           CounterType voxels, CounterType particles );
+
+  /** Write the report now. It is also written when the process exits. */
+  static void Flush();
+
+  /** Wall clock time in seconds */
+  static double GetTime();
+
+  /** Peak resident set size of the process so far, in bytes (0 if it
+   *  cannot be determined on this platform) */
+  static CounterType GetPeakResidentSetSize();
+
+private:
+  static void Initialize();
+
+  // -1 until the environment has been read, then 0 (off) or 1 (on). It
+  // is set while the program is loaded and by 'Enable', before any
+  // threads are started, and only read afterwards.
+  static int m_State;
+};
+
+
+/** Times a stage from construction to destruction */
+class ScopedTimer
+{
+public:
+  explicit ScopedTimer( const char* name )
+    : m_Name( name ), m_Enabled( Instrumentation::IsEnabled() ),
+      m_StartTime( 0.0 ), m_Voxels( 0 ), m_Particles( 0 )
+  {
+    if ( m_Enabled )
+      {
+      m_StartTime = Instrumentation::GetTime();
+      }
+  }
+
+  ~ScopedTimer()
+  {
+    if ( m_Enabled )
+      {
+      Instrumentation::RecordStage( m_Name, m_StartTime, Instrumentation::GetTime(), m_Voxels, m_Particles );
+      }
+  }
+
+  /** Number of voxels processed by the stage, used to report throughput */
+  void AddVoxels( Instrumentation::CounterType voxels )
+  {
+    m_Voxels += voxels;
+  }
+
+  /** Number of particles processed by the stage */
+  void AddParticles( Instrumentation::CounterType particles )
+  {
+    m_Particles += particles;
+  }
+
+private:
+  ScopedTimer( const ScopedTimer& );
+  void operator=( const ScopedTimer& );
+
+  const char*                 m_Name;
+  bool                        m_Enabled;
+  double                      m_StartTime;
+  Instrumentation::CounterType m_Voxels;
+  Instrumentation::CounterType m_Particles;
+};
+
+
+/** Times a whole command line tool. One of these is compiled into every
+ *  tool built with cipMacroBuildCLI. */
+class ModuleInstrumentation
+{
+public:
+  explicit ModuleInstrumentation( const char* moduleName );
+  ~ModuleInstrumentation();
+
+private:
+  ModuleInstrumentation( const ModuleInstrumentation& );
+  void operator=( const ModuleInstrumentation& );
+
+  ScopedTimer* m_Timer;
+};
+
+} // end namespace cip
+
+#endif
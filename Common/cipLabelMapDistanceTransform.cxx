@@ -0,0 +1,326 @@
+#include "cipLabelMapDistanceTransform.h"
+#include "cipExceptionObject.h"
+#include "cipInstrumentation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+const unsigned int NOSITE = std::numeric_limits< unsigned int >::max();
+
+/** Allocate an image on the buffered grid of 'reference' */
+template< class TImage >
+typename TImage::Pointer AllocateImage( const itk::ImageBase< 3 >* reference )
+{
+  typename TImage::Pointer image = TImage::New();
+    image->CopyInformation( reference );
+    image->SetRegions( reference->GetBufferedRegion() );
+    image->Allocate();
+
+  return image;
+}
+}
+
+
+cipLabelMapDistanceTransform::cipLabelMapDistanceTransform()
+{
+  this->m_BandWidth       = 0.0;
+  this->m_NumberOfThreads = itk::MultiThreader::GetGlobalDefaultNumberOfThreads();
+
+  for ( unsigned int d=0; d<3; d++ )
+    {
+    this->m_Size[d]    = 0;
+    this->m_Spacing[d] = 1.0;
+    }
+}
+
+
+void cipLabelMapDistanceTransform::SetInput( const LabelMapType* labelMap )
+{
+  this->m_LabelMap = labelMap;
+}
+
+
+void cipLabelMapDistanceTransform::SetNumberOfThreads( unsigned int numberOfThreads )
+{
+  this->m_NumberOfThreads = std::max( numberOfThreads, 1u );
+}
+
+
+void cipLabelMapDistanceTransform::Update()
+{
+  if ( this->m_LabelMap.IsNull() )
+    {
+    throw cip::ExceptionObject( __FILE__, __LINE__, "cipLabelMapDistanceTransform::Update()",
+                                "No label map set" );
+    }
+
+  cip::ScopedTimer timer( "cipLabelMapDistanceTransform::Update" );
+
+  const LabelMapType::RegionType& region = this->m_LabelMap->GetBufferedRegion();
+  for ( unsigned int d=0; d<3; d++ )
+    {
+    this->m_Size[d]    = region.GetSize()[d];
+    this->m_Spacing[d] = this->m_LabelMap->GetSpacing()[d];
+    }
+
+  unsigned long numVoxels = this->m_Size[0]*this->m_Size[1]*this->m_Size[2];
+  if ( numVoxels >= static_cast< unsigned long >( NOSITE ) )
+    {
+    throw cip::ExceptionObject( __FILE__, __LINE__, "cipLabelMapDistanceTransform::Update()",
+                                "The label map is too large" );
+    }
+
+  // Each labeled voxel is its own closest site to begin with
+  const LabelMapType::PixelType* labels = this->m_LabelMap->GetBufferPointer();
+  this->m_Sites.resize( numVoxels );
+  unsigned long numSites = 0;
+  for ( unsigned long v=0; v<numVoxels; v++ )
+    {
+    if ( labels[v] != 0 )
+      {
+      this->m_Sites[v] = static_cast< unsigned int >( v );
+      numSites++;
+      }
+    else
+      {
+      this->m_Sites[v] = NOSITE;
+      }
+    }
+
+  if ( numSites == 0 )
+    {
+    this->m_Sites.clear();
+    throw cip::ExceptionObject( __FILE__, __LINE__, "cipLabelMapDistanceTransform::Update()",
+                                "The label map has no labeled voxels" );
+    }
+
+  THREADSTRUCT str;
+    str.transform = this;
+
+  itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+  for ( unsigned int axis=0; axis<3; axis++ )
+    {
+    unsigned long numLines = numVoxels/this->m_Size[axis];
+
+    str.axis           = axis;
+    str.numberOfBlocks = static_cast< unsigned int >( std::max( std::min(
+      static_cast< unsigned long >( this->m_NumberOfThreads ), numLines ), 1ul ) );
+
+    threader->SetNumberOfThreads( str.numberOfBlocks );
+    threader->SetSingleMethod( TransformThreaderCallback, &str );
+    threader->SingleMethodExecute();
+    }
+
+  timer.AddVoxels( numVoxels );
+}
+
+
+ITK_THREAD_RETURN_TYPE cipLabelMapDistanceTransform::TransformThreaderCallback( void* arg )
+{
+  itk::MultiThreader::ThreadInfoStruct* info = static_cast< itk::MultiThreader::ThreadInfoStruct* >( arg );
+  THREADSTRUCT* str = static_cast< THREADSTRUCT* >( info->UserData );
+
+  // The threader may have been given fewer threads than requested
+  unsigned int numBlocks = std::min( str->numberOfBlocks, static_cast< unsigned int >( info->NumberOfThreads ) );
+  if ( info->ThreadID >= numBlocks )
+    {
+    return ITK_THREAD_RETURN_VALUE;
+    }
+
+  const unsigned long* size = str->transform->m_Size;
+  unsigned long numLines  = size[0]*size[1]*size[2]/size[str->axis];
+  unsigned long firstLine = numLines*info->ThreadID/numBlocks;
+  unsigned long lastLine  = numLines*(info->ThreadID + 1)/numBlocks;
+
+  str->transform->TransformLines( str->axis, firstLine, lastLine );
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+
+void cipLabelMapDistanceTransform::TransformLines( unsigned int axis, unsigned long firstLine,
+                                                   unsigned long lastLine )
+{
+  unsigned long length  = this->m_Size[axis];
+  double        spacing = this->m_Spacing[axis];
+  unsigned long stride  = 1;
+  for ( unsigned int d=0; d<axis; d++ )
+    {
+    stride *= this->m_Size[d];
+    }
+
+  // The closest site of a voxel is one of the closest sites (from the
+  // previous passes) of the voxels of its line. The squared distance to the
+  // closest site of the voxel at position q along the line is the parabola
+  // height[q] + (spacing*(u - q))^2 of the position u of the voxel, and the
+  // lower envelope of these parabolas is made of the parabolas at
+  // 'positions', the k-th one being the lowest from 'boundaries[k]' on.
+  std::vector< unsigned int >   sites( length );
+  std::vector< unsigned long >  positions( length );
+  std::vector< double >         heights( length );
+  std::vector< double >         boundaries( length + 1 );
+
+  for ( unsigned long l=firstLine; l<lastLine; l++ )
+    {
+    // Lines are numbered along the axes other than 'axis', fastest first
+    unsigned long start = (l/stride)*stride*length + l%stride;
+
+    long k = -1;
+    for ( unsigned long q=0; q<length; q++ )
+      {
+      unsigned long voxel = start + q*stride;
+      sites[q] = this->m_Sites[voxel];
+      if ( sites[q] == NOSITE )
+        {
+        continue;
+        }
+
+      double height   = this->GetSquaredDistance( voxel, sites[q] );
+      double position = static_cast< double >( q )*spacing;
+      double boundary = -std::numeric_limits< double >::max();
+      while ( k >= 0 )
+        {
+        double other = static_cast< double >( positions[k] )*spacing;
+        boundary = ( (height + position*position) - (heights[k] + other*other) )/( 2.0*(position - other) );
+        if ( boundary > boundaries[k] )
+          {
+          break;
+          }
+        k--;
+        }
+      if ( k < 0 )
+        {
+        boundary = -std::numeric_limits< double >::max();
+        }
+
+      k++;
+      positions[k]  = q;
+      heights[k]    = height;
+      boundaries[k] = boundary;
+      }
+
+    if ( k < 0 )
+      {
+      continue;
+      }
+    boundaries[k + 1] = std::numeric_limits< double >::max();
+
+    long j = 0;
+    for ( unsigned long u=0; u<length; u++ )
+      {
+      double position = static_cast< double >( u )*spacing;
+      while ( boundaries[j + 1] < position )
+        {
+        j++;
+        }
+      this->m_Sites[start + u*stride] = sites[positions[j]];
+      }
+    }
+}
+
+
+double cipLabelMapDistanceTransform::GetSquaredDistance( unsigned long voxel, unsigned long site ) const
+{
+  double squaredDistance = 0.0;
+  for ( unsigned int d=0; d<3; d++ )
+    {
+    long difference = static_cast< long >( voxel%this->m_Size[d] ) - static_cast< long >( site%this->m_Size[d] );
+    double distance = static_cast< double >( difference )*this->m_Spacing[d];
+    squaredDistance += distance*distance;
+
+    voxel /= this->m_Size[d];
+    site  /= this->m_Size[d];
+    }
+
+  return squaredDistance;
+}
+
+
+double cipLabelMapDistanceTransform::GetDistance( unsigned long voxel ) const
+{
+  double distance = std::sqrt( this->GetSquaredDistance( voxel, this->m_Sites[voxel] ) );
+  if ( this->m_BandWidth > 0.0 && distance > this->m_BandWidth )
+    {
+    return this->m_BandWidth;
+    }
+
+  return distance;
+}
+
+
+cipLabelMapDistanceTransform::DistanceImageType::Pointer cipLabelMapDistanceTransform::GetDistanceImage() const
+{
+  if ( this->m_Sites.empty() )
+    {
+    throw cip::ExceptionObject( __FILE__, __LINE__, "cipLabelMapDistanceTransform::GetDistanceImage()",
+                                "The transform has not been updated" );
+    }
+
+  DistanceImageType::Pointer image = AllocateImage< DistanceImageType >( this->m_LabelMap );
+
+  float* buffer = image->GetBufferPointer();
+  for ( unsigned long v=0; v<this->m_Sites.size(); v++ )
+    {
+    buffer[v] = static_cast< float >( this->GetDistance( v ) );
+    }
+
+  return image;
+}
+
+
+cipLabelMapDistanceTransform::QuantizedDistanceImageType::Pointer
+cipLabelMapDistanceTransform::GetQuantizedDistanceImage( double resolution ) const
+{
+  if ( this->m_Sites.empty() )
+    {
+    throw cip::ExceptionObject( __FILE__, __LINE__, "cipLabelMapDistanceTransform::GetQuantizedDistanceImage()",
+                                "The transform has not been updated" );
+    }
+  if ( resolution <= 0.0 )
+    {
+    throw cip::ExceptionObject( __FILE__, __LINE__, "cipLabelMapDistanceTransform::GetQuantizedDistanceImage()",
+                                "The resolution must be positive" );
+    }
+
+  QuantizedDistanceImageType::Pointer image = AllocateImage< QuantizedDistanceImageType >( this->m_LabelMap );
+
+  const double maximum = static_cast< double >( std::numeric_limits< short >::max() );
+
+  short* buffer = image->GetBufferPointer();
+  for ( unsigned long v=0; v<this->m_Sites.size(); v++ )
+    {
+    double value = std::floor( this->GetDistance( v )/resolution + 0.5 );
+    buffer[v] = static_cast< short >( std::min( value, maximum ) );
+    }
+
+  return image;
+}
+
+
+cipLabelMapDistanceTransform::LabelMapType::Pointer cipLabelMapDistanceTransform::GetNearestLabelMap() const
+{
+  if ( this->m_Sites.empty() )
+    {
+    throw cip::ExceptionObject( __FILE__, __LINE__, "cipLabelMapDistanceTransform::GetNearestLabelMap()",
+                                "The transform has not been updated" );
+    }
+
+  LabelMapType::Pointer image = AllocateImage< LabelMapType >( this->m_LabelMap );
+
+  const LabelMapType::PixelType* labels = this->m_LabelMap->GetBufferPointer();
+  LabelMapType::PixelType* buffer = image->GetBufferPointer();
+  for ( unsigned long v=0; v<this->m_Sites.size(); v++ )
+    {
+    buffer[v] = labels[this->m_Sites[v]];
+    if ( this->m_BandWidth > 0.0 &&
+         this->GetSquaredDistance( v, this->m_Sites[v] ) > this->m_BandWidth*this->m_BandWidth )
+      {
+      buffer[v] = 0;
+      }
+    }
+
+  return image;
+}
@@ -0,0 +1,106 @@
+/**
+ *  \class cipLabelMapDistanceTransform
+ *  \ingroup common
+ *  \brief Exact Euclidean distance to, and label of, the closest labeled
+ *  voxel of a label map.
+ *
+ *  Every nonzero voxel of the label map is a site. The transform finds
+ *  the closest site of every voxel (in mm, taking the spacing into
+ *  account), so a single transform gives both the distance to the closest
+ *  of the labeled structures and which structure that is: the label of the
+ *  site. Running it on the output of itk::CIPExtractChestLabelMapImageFilter
+ *  restricts the sites to a set of chest regions and types. The distance to
+ *  one of the structures is the transform's distance wherever that structure
+ *  is the closest one.
+ *
+ *  The transform is separable. The closest sites along x are found first,
+ *  and are then refined along y and along z by taking, for each line, the
+ *  lower envelope of the parabolas of the candidate sites (Felzenszwalb and
+ *  Huttenlocher). Each pass is linear in the number of voxels, and its
+ *  lines are split across threads.
+ *
+ *  Distances beyond 'BandWidth' are clamped to it, and those voxels get a
+ *  nearest label of 0. Within a band the distances can be written to a 16
+ *  bit image of a given resolution, at half the memory of a float image.
+ *
+ *  The label map's direction is ignored, as it is in the distance map
+ *  filters of ITK.
+ */
+
+#ifndef __cipLabelMapDistanceTransform_h
+#define __cipLabelMapDistanceTransform_h
+
+#include "itkImage.h"
+#include "itkMultiThreader.h"
+
+#include <vector>
+
+class cipLabelMapDistanceTransform
+{
+public:
+  typedef itk::Image< unsigned short, 3 >  LabelMapType;
+  typedef itk::Image< float, 3 >           DistanceImageType;
+  typedef itk::Image< short, 3 >           QuantizedDistanceImageType;
+
+  cipLabelMapDistanceTransform();
+  ~cipLabelMapDistanceTransform() {};
+
+  /** The sites are the nonzero voxels of this label map */
+  void SetInput( const LabelMapType* );
+
+  /** Distances beyond the band width (in mm) are clamped to it, and the
+   *  nearest label there is 0. Defaults to 0, meaning no band. */
+  void SetBandWidth( double bandWidth )
+    {
+      m_BandWidth = bandWidth;
+    }
+  double GetBandWidth() const
+    {
+      return m_BandWidth;
+    }
+
+  /** Defaults to ITK's global default number of threads */
+  void SetNumberOfThreads( unsigned int );
+
+  void Update();
+
+  /** Distance in mm from every voxel to its closest site */
+  DistanceImageType::Pointer GetDistanceImage() const;
+
+  /** Distances in units of 'resolution' mm, rounded and clamped to the
+   *  range of shorts */
+  QuantizedDistanceImageType::Pointer GetQuantizedDistanceImage( double resolution ) const;
+
+  /** Label of the closest site of every voxel */
+  LabelMapType::Pointer GetNearestLabelMap() const;
+
+private:
+  struct THREADSTRUCT
+  {
+    cipLabelMapDistanceTransform*  transform;
+    unsigned int                   axis;
+    unsigned int                   numberOfBlocks;
+  };
+
+  static ITK_THREAD_RETURN_TYPE TransformThreaderCallback( void* );
+
+  /** Refine the closest sites of lines [firstLine, lastLine) along 'axis' */
+  void TransformLines( unsigned int axis, unsigned long firstLine, unsigned long lastLine );
+
+  /** Squared distance in mm between two voxels, given by their offsets */
+  double GetSquaredDistance( unsigned long voxel, unsigned long site ) const;
+
+  /** Distance in mm from 'voxel' to its closest site, clamped to the band */
+  double GetDistance( unsigned long voxel ) const;
+
+  LabelMapType::ConstPointer     m_LabelMap;
+  unsigned long                  m_Size[3];
+  double                         m_Spacing[3];
+  double                         m_BandWidth;
+  unsigned int                   m_NumberOfThreads;
+
+  // Offset of the closest site of every voxel
+  std::vector< unsigned int >    m_Sites;
+};
+
+#endif
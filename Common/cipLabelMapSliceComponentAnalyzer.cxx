@@ -0,0 +1,448 @@
+#include "cipLabelMapSliceComponentAnalyzer.h"
+#include "cipExceptionObject.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+
+namespace
+{
+unsigned int FindRoot( std::vector< unsigned int >& parents, unsigned int label )
+{
+  unsigned int root = label;
+  while ( parents[root] != root )
+    {
+    root = parents[root];
+    }
+
+  // Compress the path
+  while ( parents[label] != root )
+    {
+    unsigned int next = parents[label];
+    parents[label] = root;
+    label = next;
+    }
+
+  return root;
+}
+
+/** Merge the sets of 'a' and 'b', keeping the smaller root */
+unsigned int Union( std::vector< unsigned int >& parents, unsigned int a, unsigned int b )
+{
+  unsigned int rootA = FindRoot( parents, a );
+  unsigned int rootB = FindRoot( parents, b );
+  if ( rootA < rootB )
+    {
+    parents[rootB] = rootA;
+    return rootA;
+    }
+  parents[rootA] = rootB;
+  return rootB;
+}
+
+/** The order of itk::RelabelComponentImageFilter */
+bool CompareComponents( const cip::LabelMapSliceComponentAnalyzer::COMPONENT& a,
+                        const cip::LabelMapSliceComponentAnalyzer::COMPONENT& b )
+{
+  if ( a.size != b.size )
+    {
+    return a.size > b.size;
+    }
+  return a.firstPixel < b.firstPixel;
+}
+
+} // end anonymous namespace
+
+
+cip::LabelMapSliceComponentAnalyzer::LabelMapSliceComponentAnalyzer()
+{
+  this->m_NumberOfThreads = itk::MultiThreader::GetGlobalDefaultNumberOfThreads();
+}
+
+
+void cip::LabelMapSliceComponentAnalyzer::SetLabelMap( const cip::LabelMapType* labelMap )
+{
+  this->m_LabelMap = labelMap;
+
+  SLICE empty;
+    empty.analyzed       = false;
+    empty.foregroundSize = 0;
+
+  this->m_Slices.clear();
+  this->m_Slices.resize( labelMap->GetBufferedRegion().GetSize()[2], empty );
+}
+
+
+void cip::LabelMapSliceComponentAnalyzer::SetNumberOfThreads( unsigned int numberOfThreads )
+{
+  this->m_NumberOfThreads = std::max( numberOfThreads, 1u );
+}
+
+
+unsigned int cip::LabelMapSliceComponentAnalyzer::GetNumberOfThreads() const
+{
+  return this->m_NumberOfThreads;
+}
+
+
+unsigned int cip::LabelMapSliceComponentAnalyzer::GetNumberOfSlices() const
+{
+  return static_cast< unsigned int >( this->m_Slices.size() );
+}
+
+
+const cip::LabelMapSliceComponentAnalyzer::SLICE& cip::LabelMapSliceComponentAnalyzer::GetSlice( unsigned int whichSlice ) const
+{
+  if ( whichSlice >= this->m_Slices.size() || !this->m_Slices[whichSlice].analyzed )
+    {
+    throw cip::ExceptionObject( __FILE__, __LINE__, "cip::LabelMapSliceComponentAnalyzer::GetSlice()",
+                                "Slice has not been analyzed" );
+    }
+
+  return this->m_Slices[whichSlice];
+}
+
+
+void cip::LabelMapSliceComponentAnalyzer::Analyze()
+{
+  this->AnalyzeSlices( 0, this->GetNumberOfSlices() );
+}
+
+
+void cip::LabelMapSliceComponentAnalyzer::AnalyzeSlices( unsigned int firstSlice, unsigned int lastSlice )
+{
+  if ( this->m_LabelMap.IsNull() )
+    {
+    throw cip::ExceptionObject( __FILE__, __LINE__, "cip::LabelMapSliceComponentAnalyzer::AnalyzeSlices()",
+                                "Label map not set" );
+    }
+
+  THREADSTRUCT str;
+    str.analyzer = this;
+    str.nextItem = 0;
+
+  lastSlice = std::min( lastSlice, this->GetNumberOfSlices() );
+  for ( unsigned int i = firstSlice; i < lastSlice; i++ )
+    {
+    if ( !this->m_Slices[i].analyzed )
+      {
+      str.slices.push_back( i );
+      }
+    }
+
+  unsigned int numThreads = std::min( this->m_NumberOfThreads, static_cast< unsigned int >( str.slices.size() ) );
+  if ( numThreads == 0 )
+    {
+    return;
+    }
+
+  itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+    threader->SetNumberOfThreads( numThreads );
+    threader->SetSingleMethod( AnalyzeSlicesThreaderCallback, &str );
+    threader->SingleMethodExecute();
+}
+
+
+ITK_THREAD_RETURN_TYPE cip::LabelMapSliceComponentAnalyzer::AnalyzeSlicesThreaderCallback( void* arg )
+{
+  THREADSTRUCT* str = static_cast< THREADSTRUCT* >
+    ( static_cast< itk::MultiThreader::ThreadInfoStruct* >( arg )->UserData );
+
+  std::vector< unsigned int > labels;
+  std::vector< unsigned int > parents;
+
+  while ( true )
+    {
+    str->mutex.Lock();
+    unsigned int i = str->nextItem++;
+    str->mutex.Unlock();
+
+    if ( i >= str->slices.size() )
+      {
+      break;
+      }
+
+    // Every thread writes to its own slices of the table
+    str->analyzer->AnalyzeSlice( str->slices[i], labels, parents );
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+
+void cip::LabelMapSliceComponentAnalyzer::LabelSlice( unsigned int whichSlice, std::vector< unsigned int >& labels,
+                                                      std::vector< unsigned int >& parents ) const
+{
+  cip::LabelMapType::SizeType size = this->m_LabelMap->GetBufferedRegion().GetSize();
+
+  const itk::SizeValueType sliceSize = size[0]*size[1];
+  const unsigned short* slice = this->m_LabelMap->GetBufferPointer() + whichSlice*sliceSize;
+
+  labels.assign( sliceSize, 0 );
+  parents.assign( 1, 0 );
+
+  for ( itk::SizeValueType y = 0; y < size[1]; y++ )
+    {
+    const unsigned short* row      = slice + y*size[0];
+    unsigned int*         rowLabels = &labels[0] + y*size[0];
+    const unsigned int*   prevRow  = ( y > 0 ) ? rowLabels - size[0] : NULL;
+
+    for ( itk::SizeValueType x = 0; x < size[0]; x++ )
+      {
+      if ( row[x] == 0 )
+        {
+        continue;
+        }
+
+      // The already visited 8-neighbors: left, and the three above
+      unsigned int label = 0;
+      unsigned int neighbors[4] = { 0, 0, 0, 0 };
+      if ( x > 0 )
+        {
+        neighbors[0] = rowLabels[x-1];
+        }
+      if ( prevRow != NULL )
+        {
+        if ( x > 0 )
+          {
+          neighbors[1] = prevRow[x-1];
+          }
+        neighbors[2] = prevRow[x];
+        if ( x + 1 < size[0] )
+          {
+          neighbors[3] = prevRow[x+1];
+          }
+        }
+
+      for ( unsigned int n = 0; n < 4; n++ )
+        {
+        if ( neighbors[n] != 0 )
+          {
+          label = ( label == 0 ) ? FindRoot( parents, neighbors[n] ) : Union( parents, label, neighbors[n] );
+          }
+        }
+
+      if ( label == 0 )
+        {
+        label = static_cast< unsigned int >( parents.size() );
+        parents.push_back( label );
+        }
+
+      rowLabels[x] = label;
+      }
+    }
+}
+
+
+void cip::LabelMapSliceComponentAnalyzer::AnalyzeSlice( unsigned int whichSlice, std::vector< unsigned int >& labels,
+                                                        std::vector< unsigned int >& parents )
+{
+  this->LabelSlice( whichSlice, labels, parents );
+
+  cip::LabelMapType::SizeType size = this->m_LabelMap->GetBufferedRegion().GetSize();
+
+  // Components in the order of their roots, i.e. of their first pixel
+  std::vector< unsigned int > componentOfRoot( parents.size(), 0 );
+  std::vector< COMPONENT >    components;
+  std::vector< double >       sums;
+
+  SLICE& slice = this->m_Slices[whichSlice];
+    slice.foregroundSize = 0;
+
+  itk::SizeValueType offset = 0;
+  for ( itk::SizeValueType y = 0; y < size[1]; y++ )
+    {
+    for ( itk::SizeValueType x = 0; x < size[0]; x++, offset++ )
+      {
+      if ( labels[offset] == 0 )
+        {
+        continue;
+        }
+
+      slice.foregroundSize++;
+
+      unsigned int root = FindRoot( parents, labels[offset] );
+      if ( componentOfRoot[root] == 0 )
+        {
+        COMPONENT component;
+          component.size                = 0;
+          component.firstPixel          = offset;
+          component.boundingBoxStart[0] = x;
+          component.boundingBoxStart[1] = y;
+          component.boundingBoxEnd[0]   = x;
+          component.boundingBoxEnd[1]   = y;
+
+        components.push_back( component );
+        sums.push_back( 0.0 );
+        sums.push_back( 0.0 );
+        componentOfRoot[root] = static_cast< unsigned int >( components.size() );
+        }
+
+      unsigned int c = componentOfRoot[root] - 1;
+      COMPONENT& component = components[c];
+        component.size++;
+        component.boundingBoxStart[0] = std::min( component.boundingBoxStart[0], static_cast< itk::IndexValueType >( x ) );
+        component.boundingBoxEnd[0]   = std::max( component.boundingBoxEnd[0], static_cast< itk::IndexValueType >( x ) );
+        component.boundingBoxEnd[1]   = static_cast< itk::IndexValueType >( y );
+      sums[2*c]   += static_cast< double >( x );
+      sums[2*c+1] += static_cast< double >( y );
+      }
+    }
+
+  for ( unsigned int c = 0; c < components.size(); c++ )
+    {
+    components[c].centroid[0] = sums[2*c]/static_cast< double >( components[c].size );
+    components[c].centroid[1] = sums[2*c+1]/static_cast< double >( components[c].size );
+    }
+
+  std::sort( components.begin(), components.end(), CompareComponents );
+
+  slice.components.swap( components );
+  slice.analyzed = true;
+}
+
+
+void cip::LabelMapSliceComponentAnalyzer::GetComponentIndices( unsigned int whichSlice, unsigned int component,
+                                                               std::vector< cip::LabelMapType::IndexType >& indices ) const
+{
+  const SLICE& slice = this->GetSlice( whichSlice );
+
+  cip::LabelMapType::SizeType  size  = this->m_LabelMap->GetBufferedRegion().GetSize();
+  cip::LabelMapType::IndexType start = this->m_LabelMap->GetBufferedRegion().GetIndex();
+
+  std::vector< unsigned int > labels;
+  std::vector< unsigned int > parents;
+  this->LabelSlice( whichSlice, labels, parents );
+
+  // The component is identified by the label of its first pixel
+  unsigned int root = 0;
+  if ( component > 0 )
+    {
+    if ( component > slice.components.size() )
+      {
+      return;
+      }
+    root = FindRoot( parents, labels[slice.components[component-1].firstPixel] );
+    }
+
+  cip::LabelMapType::IndexType index;
+    index[2] = start[2] + whichSlice;
+
+  itk::SizeValueType offset = 0;
+  for ( itk::SizeValueType y = 0; y < size[1]; y++ )
+    {
+    for ( itk::SizeValueType x = 0; x < size[0]; x++, offset++ )
+      {
+      unsigned int label = ( labels[offset] == 0 ) ? 0 : FindRoot( parents, labels[offset] );
+      if ( label == root )
+        {
+        index[0] = start[0] + x;
+        index[1] = start[1] + y;
+        indices.push_back( index );
+        }
+      }
+    }
+}
+
+
+std::vector< cip::LabelMapType::IndexType > cip::LabelMapSliceComponentAnalyzer::GetAirwaySeeds( bool headFirst )
+{
+  std::vector< cip::LabelMapType::IndexType > seedVec;
+
+  cip::LabelMapType::SizeType    size    = this->m_LabelMap->GetBufferedRegion().GetSize();
+  cip::LabelMapType::SpacingType spacing = this->m_LabelMap->GetSpacing();
+
+  // Get seeds from 15 slices. We don't consider the slice unless the
+  // total area is above a threshold
+  // (foregroundSliceSizeThresholdForSeedSelection). The value is set
+  // to 2000.0 to ensure that the lungs have come into the field of
+  // view before we begin our seed search. If we simply attempt to
+  // find seeds in the first slices that show a foreground region, we
+  // can wind up with a poor airway segmentation due to pinch points
+  // near the apex of the scan. This in turn can produce failure
+  // modes. The number of slices that we consider (15) is somewhat
+  // arbitrary.
+  unsigned int slicesProcessed                              = 0;
+  unsigned int currentSliceOffset                           = 0;
+  unsigned int numberSlicesForSeedSearch                    = 15;
+  double       foregroundSliceSizeThresholdForSeedSelection = 2000.0;
+
+  // Slices are analyzed in slabs, in search order, until enough slices
+  // have been found
+  unsigned int slabSize = std::max( 2*this->m_NumberOfThreads, numberSlicesForSeedSearch );
+
+  while ( slicesProcessed < numberSlicesForSeedSearch && currentSliceOffset < size[2] )
+    {
+    if ( currentSliceOffset % slabSize == 0 )
+      {
+      unsigned int slabEnd = std::min( currentSliceOffset + slabSize, static_cast< unsigned int >( size[2] ) );
+      if ( headFirst )
+        {
+        this->AnalyzeSlices( size[2] - slabEnd, size[2] - currentSliceOffset );
+        }
+      else
+        {
+        this->AnalyzeSlices( currentSliceOffset, slabEnd );
+        }
+      }
+
+    unsigned int whichSlice = headFirst ? size[2] - 1 - currentSliceOffset : currentSliceOffset;
+    const SLICE& slice = this->GetSlice( whichSlice );
+
+    // If the foreground area of the slice is larger than the
+    // threshold, consider the slice for seed selection. The number of
+    // objects present in the slice must also be equal to three
+    // (trachea, left and right lungs)
+    double foregroundArea = static_cast< double >( slice.foregroundSize )*spacing[0]*spacing[1];
+
+    if ( foregroundArea > foregroundSliceSizeThresholdForSeedSelection && slice.components.size() >= 3 )
+      {
+      slicesProcessed++;
+
+      // Identify the object who's centroid (x coordinate) is in the
+      // middle. Objects with the same (truncated) centroid are
+      // represented by the smallest one.
+      std::map< unsigned int, unsigned int > xCentroidMap;
+
+      unsigned int leftmostCentroid  = size[1];
+      unsigned int rightmostCentroid = 0;
+
+      for ( unsigned int i=1; i<=slice.components.size(); i++ )
+        {
+        unsigned int centroidLocation = static_cast< unsigned int >( slice.components[i-1].centroid[0] );
+
+        rightmostCentroid = std::max( rightmostCentroid, centroidLocation );
+        leftmostCentroid  = std::min( leftmostCentroid, centroidLocation );
+
+        xCentroidMap[centroidLocation] = i;
+        }
+
+      unsigned int middleLocation = (rightmostCentroid + leftmostCentroid)/2;
+
+      // Now find the label that corresponds to the centroid that is
+      // closest to the middle location
+      unsigned int minDiff         = size[1];
+      unsigned int bestCenterLabel = 0;
+
+      std::map< unsigned int, unsigned int >::iterator mapIt = xCentroidMap.begin();
+      while ( mapIt != xCentroidMap.end() )
+        {
+        unsigned int diff = static_cast< unsigned int >( std::abs( static_cast< int >( mapIt->first ) -
+                                                                   static_cast< int >( middleLocation ) ) );
+        if ( diff < minDiff )
+          {
+          minDiff = diff;
+          bestCenterLabel = mapIt->second;
+          }
+
+        ++mapIt;
+        }
+
+      this->GetComponentIndices( whichSlice, bestCenterLabel, seedVec );
+      }
+
+    currentSliceOffset++;
+    }
+
+  return seedVec;
+}
@@ -0,0 +1,116 @@
+/**
+ *  \class cipLabelMapSliceComponentAnalyzer
+ *  \ingroup common
+ *  \brief Computes the 8-connected components of the foreground of every
+ *  axial slice of a label map, and their statistics (area, centroid and
+ *  bounding box), directly from the 3D buffer.
+ *
+ *  Slices are labeled in parallel with a two pass union-find, without
+ *  extracting them into 2D images. The components of a slice are
+ *  numbered the way itk::ConnectedComponentImageFilter followed by
+ *  itk::RelabelComponentImageFilter would number them: by decreasing
+ *  size, and components of the same size in the raster order of their
+ *  first pixel. Component 0 is the background.
+ *
+ *  'GetAirwaySeeds' implements the trachea seed search shared by the
+ *  partial lung and whole lung segmentation filters as a scan over the
+ *  slice tables, analyzing slabs of slices only until enough slices
+ *  have been found.
+ */
+
+#ifndef __cipLabelMapSliceComponentAnalyzer_h
+#define __cipLabelMapSliceComponentAnalyzer_h
+
+#include "cipChestConventions.h"
+#include "itkMultiThreader.h"
+#include "itkSimpleFastMutexLock.h"
+
+#include <vector>
+
+namespace cip
+{
+class LabelMapSliceComponentAnalyzer
+{
+public:
+  struct COMPONENT
+  {
+    itk::SizeValueType   size;
+    double               centroid[2];          // In slice index coordinates
+    itk::IndexValueType  boundingBoxStart[2];
+    itk::IndexValueType  boundingBoxEnd[2];    // Inclusive
+    itk::SizeValueType   firstPixel;           // Raster offset within the slice
+  };
+
+  struct SLICE
+  {
+    bool                      analyzed;
+    itk::SizeValueType        foregroundSize;
+    std::vector< COMPONENT >  components;      // components[i] is component i+1
+  };
+
+  LabelMapSliceComponentAnalyzer();
+  ~LabelMapSliceComponentAnalyzer() {}
+
+  /** Set the label map to analyze. Every non-zero voxel is foreground. */
+  void SetLabelMap( const cip::LabelMapType* labelMap );
+
+  /** Number of threads slices are analyzed with. Defaults to ITK's
+   *  global default number of threads. */
+  void SetNumberOfThreads( unsigned int numberOfThreads );
+  unsigned int GetNumberOfThreads() const;
+
+  /** Analyze slices [firstSlice, lastSlice) (relative to the start of the
+   *  buffered region). Slices that were already analyzed are skipped. */
+  void AnalyzeSlices( unsigned int firstSlice, unsigned int lastSlice );
+
+  /** Analyze every slice */
+  void Analyze();
+
+  unsigned int GetNumberOfSlices() const;
+
+  /** The statistics of slice 'whichSlice', which must have been analyzed */
+  const SLICE& GetSlice( unsigned int whichSlice ) const;
+
+  /** Get the indices of the voxels of component 'component' (0 for the
+   *  background) of slice 'whichSlice', in raster order */
+  void GetComponentIndices( unsigned int whichSlice, unsigned int component,
+                            std::vector< cip::LabelMapType::IndexType >& indices ) const;
+
+  /** Find trachea seeds: starting at the top of the lungs ('headFirst'
+   *  tells which end of the volume that is), the first 15 slices whose
+   *  foreground area is above 2000 mm^2 and that have at least three
+   *  components (trachea, left and right lungs) each contribute the
+   *  voxels of the component whose centroid is closest to the middle. */
+  std::vector< cip::LabelMapType::IndexType > GetAirwaySeeds( bool headFirst );
+
+private:
+  /** Work shared by the threads. Slices are handed out one at a time. */
+  struct THREADSTRUCT
+  {
+    LabelMapSliceComponentAnalyzer*  analyzer;
+    std::vector< unsigned int >      slices;
+    unsigned int                     nextItem;
+    itk::SimpleFastMutexLock         mutex;
+  };
+
+  static ITK_THREAD_RETURN_TYPE AnalyzeSlicesThreaderCallback( void* );
+
+  /** Label the foreground of a slice. On return 'labels' holds, for
+   *  every pixel, 0 for the background or the provisional label of the
+   *  pixel, and 'parents' the union-find forest over the provisional
+   *  labels. The root of every component is its smallest provisional
+   *  label, which is the label of its first pixel in raster order. */
+  void LabelSlice( unsigned int whichSlice, std::vector< unsigned int >& labels,
+                   std::vector< unsigned int >& parents ) const;
+
+  void AnalyzeSlice( unsigned int whichSlice, std::vector< unsigned int >& labels,
+                     std::vector< unsigned int >& parents );
+
+  cip::LabelMapType::ConstPointer  m_LabelMap;
+  std::vector< SLICE >             m_Slices;
+  unsigned int                     m_NumberOfThreads;
+};
+
+} // end namespace cip
+
+#endif
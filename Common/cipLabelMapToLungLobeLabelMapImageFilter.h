@@ -106,6 +106,14 @@ public:
   itkSetMacro( ThinPlateSplineSurfaceFromPointsLambda, double );
   itkGetMacro( ThinPlateSplineSurfaceFromPointsLambda, double );
 
+  /** Set/Get the number of kernel centers used when creating the TPS
+   *  surfaces from points (see cipThinPlateSplineSurface). 0 (the default)
+   *  fits the exact TPS, which becomes expensive for dense particle sets.
+   *  Set this before the fissure points / indices so that the exact
+   *  surfaces are never computed. */
+  void SetThinPlateSplineSurfaceFromPointsNumberOfKernelCenters( unsigned int );
+  itkGetMacro( ThinPlateSplineSurfaceFromPointsNumberOfKernelCenters, unsigned int );
+
   /** Thin plate spline model of the boundary between the left upper lobe and
    *  the left lower lobe. If a surface is specified AND a set of left oblique
    *  fissure points (indices) is specified, the surface that interpolates through
@@ -167,6 +175,7 @@ private:
   std::vector< cip::PointType >  RightHorizontalFissurePoints;
 
   double m_ThinPlateSplineSurfaceFromPointsLambda;
+  unsigned int m_ThinPlateSplineSurfaceFromPointsNumberOfKernelCenters;
 
   cipThinPlateSplineSurface* LeftObliqueThinPlateSplineSurface;
   cipThinPlateSplineSurface* RightObliqueThinPlateSplineSurface;
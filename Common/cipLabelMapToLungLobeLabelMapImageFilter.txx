@@ -9,12 +9,14 @@
 #include "itkSignedMaurerDistanceMapImageFilter.h"
 #include "cipLabelMapToLungLobeLabelMapImageFilter.h"
 #include "cipMacro.h"
+#include "cipInstrumentation.h"
 #include "cipChestConventions.h"
 
 cipLabelMapToLungLobeLabelMapImageFilter
 ::cipLabelMapToLungLobeLabelMapImageFilter()
 {
   this->m_ThinPlateSplineSurfaceFromPointsLambda = 0.1;
+  this->m_ThinPlateSplineSurfaceFromPointsNumberOfKernelCenters = 0;
 
   this->LeftObliqueThinPlateSplineSurface     = new cipThinPlateSplineSurface;
   this->RightObliqueThinPlateSplineSurface    = new cipThinPlateSplineSurface;
@@ -51,6 +53,9 @@ cipLabelMapToLungLobeLabelMapImageFilter
       segmentRightLobes = true;
     }
 
+  cip::ScopedTimer timer( "cipLabelMapToLungLobeLabelMapImageFilter" );
+    timer.AddVoxels( this->GetOutput()->GetRequestedRegion().GetNumberOfPixels() );
+
   // Allocate the output buffer
   this->GetOutput()->SetBufferedRegion( this->GetOutput()->GetRequestedRegion() );
   this->GetOutput()->Allocate();
@@ -461,6 +466,20 @@ cipLabelMapToLungLobeLabelMapImageFilter
 }
 
 
+void
+cipLabelMapToLungLobeLabelMapImageFilter
+::SetThinPlateSplineSurfaceFromPointsNumberOfKernelCenters( unsigned int numberOfCenters )
+{
+  this->m_ThinPlateSplineSurfaceFromPointsNumberOfKernelCenters = numberOfCenters;
+
+  this->LeftObliqueThinPlateSplineSurfaceFromPoints->SetNumberOfKernelCenters( numberOfCenters );
+  this->RightObliqueThinPlateSplineSurfaceFromPoints->SetNumberOfKernelCenters( numberOfCenters );
+  this->RightHorizontalThinPlateSplineSurfaceFromPoints->SetNumberOfKernelCenters( numberOfCenters );
+
+  this->Modified();
+}
+
+
 /**
  * Standard "PrintSelf" method
  */
@@ -8,6 +8,7 @@
 
 #include "cipParticleConnectedComponentFilter.h"
 #include "vtkPointData.h"
+#include "cipInstrumentation.h"
 #include "vtkFloatArray.h"
 #include "vtkSmartPointer.h"
 #include <cfloat>
@@ -489,6 +490,9 @@ bool cipParticleConnectedComponentFilter::EvaluateParticleConnectedness( unsigne
 
 void cipParticleConnectedComponentFilter::Update()
 {
+  cip::ScopedTimer timer( "cipParticleConnectedComponentFilter" );
+    timer.AddParticles( this->InternalInputPolyData->GetNumberOfPoints() );
+
   unsigned int componentLabel = 1;
 
   IteratorType it( this->DataStructureImage, this->DataStructureImage->GetBufferedRegion() );
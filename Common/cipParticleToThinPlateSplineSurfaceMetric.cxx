@@ -17,7 +17,14 @@
 //
 void cipParticleToThinPlateSplineSurfaceMetric::SetThinPlateSplineSurface( const cipThinPlateSplineSurface& tpsSurface )
 {
-  this->ThinPlateSplineSurface = tpsSurface;
+  this->ThinPlateSplineSurface         = tpsSurface;
+  this->ExternalThinPlateSplineSurface = NULL;
+}
+
+
+void cipParticleToThinPlateSplineSurfaceMetric::SetThinPlateSplineSurfaceReference( const cipThinPlateSplineSurface* tpsSurface )
+{
+  this->ExternalThinPlateSplineSurface = tpsSurface;
 }
 
 
@@ -38,7 +45,7 @@ double cipParticleToThinPlateSplineSurfaceMetric::GetValue( PointType* params )
   double s[3];
     s[0] = (*params)[0];
     s[1] = (*params)[1];
-    s[2] = this->ThinPlateSplineSurface.GetSurfaceHeight( s[0], s[1] );
+    s[2] = this->GetSurface().GetSurfaceHeight( s[0], s[1] );
 
   double value = std::pow(this->ParticlePosition[0]-s[0],2) + std::pow(this->ParticlePosition[1]-s[1],2) + 
     std::pow(this->ParticlePosition[2]-s[2],2);
@@ -65,12 +72,12 @@ double cipParticleToThinPlateSplineSurfaceMetric::GetValueAndGradient( PointType
   cip::PointType s(3);
     s[0] = (*params)[0];
     s[1] = (*params)[1];
-    s[2] = this->ThinPlateSplineSurface.GetSurfaceHeight( s[0], s[1] );
+    s[2] = this->GetSurface().GetSurfaceHeight( s[0], s[1] );
 
   double value = std::pow(s[0]-p[0],2) + std::pow(s[1]-p[1],2) + std::pow(s[2]-p[2],2);
 
   cip::VectorType n(3);
-  this->ThinPlateSplineSurface.GetNonNormalizedSurfaceNormal( s[0], s[1], n );
+  this->GetSurface().GetNonNormalizedSurfaceNormal( s[0], s[1], n );
 
   (*gradient)[0] = 2.0*(s[0] - p[0] - n[0]*(s[2]-p[2])); 
   (*gradient)[1] = 2.0*(s[1] - p[1] - n[1]*(s[2]-p[2]));  
@@ -97,7 +104,7 @@ double cipParticleToThinPlateSplineSurfaceMetric::GetValueGradientAndHessian( Po
   cip::PointType s(3);
     s[0] = (*params)[0];
     s[1] = (*params)[1];
-    s[2] = this->ThinPlateSplineSurface.GetSurfaceHeight( s[0], s[1] );
+    s[2] = this->GetSurface().GetSurfaceHeight( s[0], s[1] );
 
   double value = std::pow(s[0]-p[0],2) + std::pow(s[1]-p[1],2) + std::pow(s[2]-p[2],2);
 
@@ -105,7 +112,7 @@ double cipParticleToThinPlateSplineSurfaceMetric::GetValueGradientAndHessian( Po
   // Compute the gradient
   //
   cip::VectorType n(3);
-  this->ThinPlateSplineSurface.GetNonNormalizedSurfaceNormal( s[0], s[1], n );
+  this->GetSurface().GetNonNormalizedSurfaceNormal( s[0], s[1], n );
 
   (*gradient)[0] = 2.0*(s[0] - p[0] - n[0]*(s[2]-p[2])); 
   (*gradient)[1] = 2.0*(s[1] - p[1] - n[1]*(s[2]-p[2]));  
@@ -115,8 +122,8 @@ double cipParticleToThinPlateSplineSurfaceMetric::GetValueGradientAndHessian( Po
   // associated with the TPS surface, and they are needed for the
   // Hessian computation
   //
-  const std::vector< double > w = this->ThinPlateSplineSurface.GetWVector();
-  const std::vector< cip::PointType > surfPoints = this->ThinPlateSplineSurface.GetSurfacePoints();
+  const std::vector< double >& w = this->GetSurface().GetWVector();
+  const std::vector< cip::PointType >& surfPoints = this->GetSurface().GetKernelCenters();
 
   double r, drdx, drdy;
   double d3dx   = 0.0;
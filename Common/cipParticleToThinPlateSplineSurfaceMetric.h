@@ -22,7 +22,7 @@
 class cipParticleToThinPlateSplineSurfaceMetric
 {
 public:
-  cipParticleToThinPlateSplineSurfaceMetric() {};
+  cipParticleToThinPlateSplineSurfaceMetric() : ExternalThinPlateSplineSurface( NULL ) {};
   ~cipParticleToThinPlateSplineSurfaceMetric() {};
 
   typedef vnl_vector< double >   VectorType;
@@ -44,16 +44,30 @@ public:
   /** Set the x, y, and z coordinates of the particle */
   void SetParticle( cip::PointType );
 
+  /** Set the TPS surface. The metric keeps its own copy of it. */
   void SetThinPlateSplineSurface( const cipThinPlateSplineSurface& );
 
-  /** Expose the TPS surface so that it can be modified */
+  /** Use 'tpsSurface' without copying it, so that the metric (and the
+   *  optimizers it is copied into) can be set up cheaply for every
+   *  query point. The surface must outlive the metric and its copies. */
+  void SetThinPlateSplineSurfaceReference( const cipThinPlateSplineSurface* tpsSurface );
+
+  /** Expose the TPS surface so that it can be modified. This is the
+   *  metric's own copy, so it is not the surface in use after
+   *  'SetThinPlateSplineSurfaceReference'. */
   cipThinPlateSplineSurface& GetThinPlateSplineSurface()
   {
     return ThinPlateSplineSurface;
   }
 
 private:
-  cipThinPlateSplineSurface ThinPlateSplineSurface;
+  const cipThinPlateSplineSurface& GetSurface() const
+  {
+    return ExternalThinPlateSplineSurface ? *ExternalThinPlateSplineSurface : ThinPlateSplineSurface;
+  }
+
+  cipThinPlateSplineSurface        ThinPlateSplineSurface;
+  const cipThinPlateSplineSurface* ExternalThinPlateSplineSurface;
 
   double GetVectorMagnitude( const double[3] ) const;
   double GetAngleBetweenVectors( const double[3], const double[3] ) const;
@@ -6,6 +6,12 @@
  *  map, but it is only used to retrieve the spacing, origin, and
  *  dimensions needed for the output label map.
  *
+ *  The particles are binned by the slabs of slices that their stencil
+ *  bounding boxes overlap, and the slabs are rasterized concurrently.
+ *  Within a slab, the stretch of each image row that lies inside a
+ *  particle's stencil pattern is computed in closed form (see
+ *  cipStencil::GetLineSpan) and filled.
+ *
  *  $Date: 2012-06-11 17:58:50 -0700 (Mon, 11 Jun 2012) $
  *  $Version$
  *  $Author: jross $
@@ -20,7 +26,10 @@
 
 #include "itkImageToImageFilter.h" 
 #include "itkImageRegionIteratorWithIndex.h"
+#include "itkMultiThreader.h"
+#include "itkSimpleFastMutexLock.h"
 #include "vtkPolyData.h"
+#include "vtkDataArray.h"
 #include "vtkSmartPointer.h"
 #include "cipChestConventions.h"
 #include "cipStencil.h"
@@ -103,6 +112,30 @@ public:
 protected:
   void UpdateLabelMapRegion( vtkIdType );
 
+  /** Work shared by the threads. Tiles are handed out one at a time. */
+  struct THREADSTRUCT
+  {
+    cipParticlesToStenciledLabelMapImageFilter*   filter;
+    vtkDataArray*                                 orientationArray;
+    vtkDataArray*                                 scaleArray;
+    LabelMapPixelType                             foregroundLabel;
+    unsigned int                                  tileThickness;
+    std::vector< OutputImageRegionType >          regions;
+    std::vector< std::vector< vtkIdType > >       tiles;
+    unsigned int                                  nextTile;
+    itk::SimpleFastMutexLock                      mutex;
+  };
+
+  static ITK_THREAD_RETURN_TYPE RasterizeTilesThreaderCallback( void* );
+
+  /** Set the center, orientation and (optionally) radius of 'stencil'
+   *  from particle 'i'. Either array may be NULL. */
+  void SetStencilToParticle( cipStencil* stencil, vtkIdType i, vtkDataArray* orientationArray,
+                             vtkDataArray* scaleArray ) const;
+
+  void RasterizeRegion( const cipStencil* stencil, const OutputImageRegionType& region,
+                        LabelMapPixelType foregroundLabel );
+
 private:
   enum ParticleType {
     RIDGELINE,
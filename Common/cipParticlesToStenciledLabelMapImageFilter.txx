@@ -9,6 +9,11 @@
 #define __cipParticlesToStenciledLabelMapImageFilter_txx
 
 #include "cipParticlesToStenciledLabelMapImageFilter.h"
+#include "vtkPointData.h"
+#include "cipInstrumentation.h"
+#include "vtkDataArray.h"
+
+#include <algorithm>
 
 
 template < class TInputImage >
@@ -49,6 +54,50 @@ cipParticlesToStenciledLabelMapImageFilter< TInputImage >
 }
 
 
+template< class TInputImage >
+void
+cipParticlesToStenciledLabelMapImageFilter< TInputImage >
+::SetStencilToParticle( cipStencil* stencil, vtkIdType i, vtkDataArray* orientationArray, vtkDataArray* scaleArray ) const
+{
+  // The variants that fill a caller's buffer are used because they are
+  // safe to call from several threads at once
+  double point[3];
+  this->ParticlesData->GetPoint( i, point );
+
+  stencil->SetCenter( point[0], point[1], point[2] );
+
+  //
+  // Handling of the stencil pattern is adjusted based on the type
+  // of structure represented (vessel, airway, or fissure). The
+  // orientation call has no effect if the sphere stencil is used, but
+  // is needed in case the cylinder stencil is used
+  //
+  if ( orientationArray != NULL )
+    {
+    double orientation[3];
+    orientationArray->GetTuple( i, orientation );
+
+    stencil->SetOrientation( orientation[0], orientation[1], orientation[2] );
+    }
+
+  //
+  // For vessels, both the cylinder and sphere radii can be scaled
+  // using the particle scale according to an equation that
+  // relates the particle scale and CT point spread function to
+  // the actual vessel radius
+  //
+  //TODO: Need to properly define a function that converts
+  //particle scale to physical airway radius.
+  if ( scaleArray != NULL )
+    {
+    double scale = scaleArray->GetComponent( i, 0 );
+    double tempRadius = vcl_sqrt(2.0)*vcl_sqrt( pow( scale, 2 ) + pow( this->CTPointSpreadFunctionSigma, 2 ) );
+
+    stencil->SetRadius( tempRadius );
+    }
+}
+
+
 template< class TInputImage >
 void
 cipParticlesToStenciledLabelMapImageFilter< TInputImage >
@@ -64,6 +113,10 @@ cipParticlesToStenciledLabelMapImageFilter< TInputImage >
   typename Superclass::InputImageConstPointer inputPtr = this->GetInput();
 
   typename InputImageType::SizeType size = inputPtr->GetBufferedRegion().GetSize();
+
+  cip::ScopedTimer timer( "cipParticlesToStenciledLabelMapImageFilter" );
+    timer.AddVoxels( inputPtr->GetBufferedRegion().GetNumberOfPixels() );
+    timer.AddParticles( this->ParticlesData->GetNumberOfPoints() );
   
   // Allocate space for the output image
   typename Superclass::OutputImagePointer outputPtr = this->GetOutput(0);
@@ -75,84 +128,55 @@ cipParticlesToStenciledLabelMapImageFilter< TInputImage >
     outputPtr->SetSpacing( inputPtr->GetSpacing() );
     outputPtr->SetOrigin( inputPtr->GetOrigin() );
 
-  // Create an ITK region that will be modified for each of our
-  // particles   
-  typename InputImageType::RegionType imageRegion;
-  typename InputImageType::SizeType   regionSize;
-  typename InputImageType::IndexType  regionStartIndex;
-  typename InputImageType::IndexType  regionEndIndex;
-  
+  // Look the particle arrays up once rather than for every particle
+  vtkDataArray* orientationArray = NULL;
+  vtkDataArray* scaleArray       = NULL;
+  if ( this->ChestParticleType == cip::AIRWAY )
+    {
+    orientationArray = this->ParticlesData->GetPointData()->GetArray( "hevec2" );
+    }
+  if ( this->ChestParticleType == cip::FISSURE )
+    {
+    orientationArray = this->ParticlesData->GetPointData()->GetArray( "hevec1" );
+    }
+  if ( this->ChestParticleType == cip::VESSEL )
+    {
+    orientationArray = this->ParticlesData->GetPointData()->GetArray( "hevec0" );
+    if ( this->ScaleStencilPatternByParticleScale )
+      {
+      scaleArray = this->ParticlesData->GetPointData()->GetArray( "scale" );
+      }
+    }
+
   // The bounding box start and end points will be updated using the
   // stencil  
-  double* boundingBoxStartPoint = new double[3];
-  double* boundingBoxEndPoint   = new double[3];
+  double boundingBoxStartPoint[3];
+  double boundingBoxEndPoint[3];
 
   typename InputImageType::PointType itkPoint; //A temp container
-
-  // TODO: Can the following be multithreaded? By what mechanism?
-  for ( unsigned int i=0; i<this->ParticlesData->GetNumberOfPoints(); i++ ) 
+  typename InputImageType::IndexType regionStartIndex;
+  typename InputImageType::IndexType regionEndIndex;
+
+  // First get the region of the image covered by each particle's
+  // stencil bounding box, and bin the particles by the slabs of
+  // slices (tiles) that their regions overlap
+  const unsigned int numParticles = this->ParticlesData->GetNumberOfPoints();
+  const unsigned int tileThickness = 8;
+  const unsigned int numTiles = (size[2] + tileThickness - 1)/tileThickness;
+
+  THREADSTRUCT str;
+    str.filter           = this;
+    str.orientationArray = orientationArray;
+    str.scaleArray       = scaleArray;
+    str.foregroundLabel  = foregroundLabel;
+    str.tileThickness    = tileThickness;
+    str.regions.resize( numParticles );
+    str.tiles.resize( numTiles );
+    str.nextTile         = 0;
+
+  for ( unsigned int i=0; i<numParticles; i++ ) 
     {   
-    //
-    // Get the bounding box for the particle. We will create an ITK region
-    // based on the extent of this bounding box.
-    //
-    this->Stencil->SetCenter( this->ParticlesData->GetPoint(i)[0], this->ParticlesData->GetPoint(i)[1], 
-                              this->ParticlesData->GetPoint(i)[2] );
-
-    //
-    // Handling of the stencil pattern is adjusted based on the type
-    // of structure represented (vessel, airway, or fissure).
-    // 
-    if ( this->ChestParticleType == cip::AIRWAY )
-      {
-      //
-      // Following call has no effect if sphere stencil is used, but
-      // is needed in case cylinder stencil is used
-      //
-      this->Stencil->SetOrientation( this->ParticlesData->GetPointData()->GetArray("hevec2")->GetTuple(i)[0], 
-                                     this->ParticlesData->GetPointData()->GetArray("hevec2")->GetTuple(i)[1], 
-                                     this->ParticlesData->GetPointData()->GetArray("hevec2")->GetTuple(i)[2] );
-
-      if ( this->ScaleStencilPatternByParticleScale )
-        {
-        //TODO: Need to properly define a function that converts
-        //particle scale to physical airway radius.
-        }
-      }
-    if ( this->ChestParticleType == cip::FISSURE )
-      {
-      //
-      // Following call has no effect if sphere stencil is used, but
-      // is needed in case cylinder stencil is used
-      //
-      this->Stencil->SetOrientation( this->ParticlesData->GetPointData()->GetArray("hevec1")->GetTuple(i)[0], 
-                                     this->ParticlesData->GetPointData()->GetArray("hevec1")->GetTuple(i)[1], 
-                                     this->ParticlesData->GetPointData()->GetArray("hevec1")->GetTuple(i)[2] );
-      }
-    if ( this->ChestParticleType == cip::VESSEL )
-      {
-      //
-      // Following call has no effect if sphere stencil is used, but
-      // is needed in case cylinder stencil is used
-      //
-      this->Stencil->SetOrientation( this->ParticlesData->GetPointData()->GetArray("hevec0")->GetTuple(i)[0], 
-                                     this->ParticlesData->GetPointData()->GetArray("hevec0")->GetTuple(i)[1], 
-                                     this->ParticlesData->GetPointData()->GetArray("hevec0")->GetTuple(i)[2] );        
-
-      //
-      // For vessels, both the cylinder and sphere radii can be scaled
-      // using the particle scale according to an equation that
-      // relates the particle scale and CT point spread function to
-      // the actual vessel radius
-      //
-      if ( this->ScaleStencilPatternByParticleScale )
-        {
-        double scale = this->ParticlesData->GetPointData()->GetArray("scale")->GetTuple(i)[0];
-        double tempRadius = vcl_sqrt(2.0)*vcl_sqrt( pow( scale, 2 ) + pow( this->CTPointSpreadFunctionSigma, 2 ) );
-
-        this->Stencil->SetRadius( tempRadius );
-        }
-      }
+    this->SetStencilToParticle( this->Stencil, i, orientationArray, scaleArray );
 
     //
     // Must be AFTER we set the center, orientation, and radius
@@ -174,54 +198,170 @@ cipParticlesToStenciledLabelMapImageFilter< TInputImage >
 
     inputPtr->TransformPhysicalPointToIndex( itkPoint, regionEndIndex ); 
 
-    regionStartIndex[0] >= size[0] ? regionStartIndex[0] = size[0]-1 : false;
-    regionStartIndex[1] >= size[1] ? regionStartIndex[1] = size[1]-1 : false;
-    regionStartIndex[2] >= size[2] ? regionStartIndex[2] = size[2]-1 : false;
+    for ( unsigned int d=0; d<3; d++ )
+      {
+      // The image axes may be flipped relative to the physical axes
+      if ( regionStartIndex[d] > regionEndIndex[d] )
+        {
+        std::swap( regionStartIndex[d], regionEndIndex[d] );
+        }
 
-    regionEndIndex[0] >= size[0] ? regionEndIndex[0] = size[0]-1 : false;
-    regionEndIndex[1] >= size[1] ? regionEndIndex[1] = size[1]-1 : false;
-    regionEndIndex[2] >= size[2] ? regionEndIndex[2] = size[2]-1 : false;
+      regionStartIndex[d] >= long(size[d]) ? regionStartIndex[d] = size[d]-1 : false;
+      regionEndIndex[d]   >= long(size[d]) ? regionEndIndex[d]   = size[d]-1 : false;
 
-    regionStartIndex[0] < 0 ? regionStartIndex[0] = 0 : false;
-    regionStartIndex[1] < 0 ? regionStartIndex[1] = 0 : false;
-    regionStartIndex[2] < 0 ? regionStartIndex[2] = 0 : false;
+      regionStartIndex[d] < 0 ? regionStartIndex[d] = 0 : false;
+      regionEndIndex[d]   < 0 ? regionEndIndex[d]   = 0 : false;
+      }
 
-    regionEndIndex[0] < 0 ? regionEndIndex[0] = 0 : false;
-    regionEndIndex[1] < 0 ? regionEndIndex[1] = 0 : false;
-    regionEndIndex[2] < 0 ? regionEndIndex[2] = 0 : false;
+    str.regions[i].SetIndex( regionStartIndex );
+    for ( unsigned int d=0; d<3; d++ )
+      {
+      str.regions[i].SetSize( d, regionEndIndex[d]-regionStartIndex[d]+1 );
+      }
 
-    //
-    // Set up the ITK region extent and start index
-    //
-    regionSize[0] = regionEndIndex[0]-regionStartIndex[0]+1;
-    regionSize[1] = regionEndIndex[1]-regionStartIndex[1]+1;
-    regionSize[2] = regionEndIndex[2]-regionStartIndex[2]+1;
-
-    // 
-    // Now create the ITK region of interest over which to perform
-    // local segmentation and connected component
-    // identification. We'll need to convert from the bounding box 
-    //
-    imageRegion.SetSize( regionSize );
-    imageRegion.SetIndex( regionStartIndex );
+    for ( unsigned int t=regionStartIndex[2]/tileThickness; t<=regionEndIndex[2]/tileThickness; t++ )
+      {
+      str.tiles[t].push_back( i );
+      }
+    }
 
-    //
-    // Now iterate over the region. If the physical point is inside
-    // the stencil pattern, set the foreground value
-    //
-    IteratorType it( outputPtr, imageRegion );
-
-    it.GoToBegin();
-    while ( !it.IsAtEnd() )
-      {     
-      inputPtr->TransformIndexToPhysicalPoint( it.GetIndex(), itkPoint );
-      
-      if ( this->Stencil->IsInsideStencilPattern( itkPoint[0], itkPoint[1], itkPoint[2] ) )
+  // Now rasterize the tiles concurrently. Each tile only writes to its
+  // own slices.
+  unsigned int numThreads = this->GetNumberOfThreads();
+  if ( numThreads > numTiles )
+    {
+    numThreads = numTiles;
+    }
+  if ( numThreads == 0 )
+    {
+    return;
+    }
+
+  itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+    threader->SetNumberOfThreads( numThreads );
+    threader->SetSingleMethod( RasterizeTilesThreaderCallback, &str );
+    threader->SingleMethodExecute();
+}
+
+
+template< class TInputImage >
+ITK_THREAD_RETURN_TYPE
+cipParticlesToStenciledLabelMapImageFilter< TInputImage >
+::RasterizeTilesThreaderCallback( void* arg )
+{
+  THREADSTRUCT* str = static_cast< THREADSTRUCT* >
+    ( static_cast< itk::MultiThreader::ThreadInfoStruct* >( arg )->UserData );
+
+  // The stencil is set to each particle in turn, so every thread needs
+  // its own
+  cipStencil* stencil = str->filter->Stencil->Clone();
+
+  while ( true )
+    {
+    str->mutex.Lock();
+    unsigned int t = str->nextTile++;
+    str->mutex.Unlock();
+
+    if ( t >= str->tiles.size() )
+      {
+      break;
+      }
+
+    for ( unsigned int p=0; p<str->tiles[t].size(); p++ )
+      {
+      vtkIdType i = str->tiles[t][p];
+
+      str->filter->SetStencilToParticle( stencil, i, str->orientationArray, str->scaleArray );
+
+      // Only the part of the particle's region inside this tile
+      OutputImageRegionType region = str->regions[i];
+
+      long firstSlice = std::max( region.GetIndex( 2 ), long(t*str->tileThickness) );
+      long lastSlice  = std::min( long(region.GetIndex( 2 ) + region.GetSize( 2 )) - 1,
+                                  long((t + 1)*str->tileThickness) - 1 );
+
+      region.SetIndex( 2, firstSlice );
+      region.SetSize( 2, lastSlice - firstSlice + 1 );
+
+      str->filter->RasterizeRegion( stencil, region, str->foregroundLabel );
+      }
+    }
+
+  delete stencil;
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+
+//
+// Set every voxel of 'region' whose physical point is inside the
+// stencil pattern to 'foregroundLabel'. Rather than testing each voxel,
+// the stretch of each image row that lies inside the pattern is
+// computed and filled.
+//
+template< class TInputImage >
+void
+cipParticlesToStenciledLabelMapImageFilter< TInputImage >
+::RasterizeRegion( const cipStencil* stencil, const OutputImageRegionType& region, LabelMapPixelType foregroundLabel )
+{
+  typename Superclass::InputImageConstPointer inputPtr  = this->GetInput();
+  typename Superclass::OutputImagePointer     outputPtr = this->GetOutput(0);
+
+  // The physical step between neighboring voxels along a row
+  double direction[3];
+  for ( unsigned int d=0; d<3; d++ )
+    {
+    direction[d] = inputPtr->GetDirection()[d][0]*inputPtr->GetSpacing()[0];
+    }
+
+  const long firstColumn = region.GetIndex( 0 );
+  const long lastColumn  = region.GetIndex( 0 ) + region.GetSize( 0 ) - 1;
+
+  typename InputImageType::IndexType rowIndex;
+    rowIndex[0] = firstColumn;
+
+  typename InputImageType::PointType rowPoint;
+  double point[3];
+  double tMin, tMax;
+
+  for ( unsigned int z=0; z<region.GetSize( 2 ); z++ )
+    {
+    rowIndex[2] = region.GetIndex( 2 ) + z;
+
+    for ( unsigned int y=0; y<region.GetSize( 1 ); y++ )
+      {
+      rowIndex[1] = region.GetIndex( 1 ) + y;
+
+      inputPtr->TransformIndexToPhysicalPoint( rowIndex, rowPoint );
+      point[0] = rowPoint[0];
+      point[1] = rowPoint[1];
+      point[2] = rowPoint[2];
+
+      if ( !stencil->GetLineSpan( point, direction, &tMin, &tMax ) )
+        {
+        continue;
+        }
+
+      // Columns are offsets from the row start along the line
+      tMin = std::max( tMin, 0.0 );
+      tMax = std::min( tMax, double( lastColumn - firstColumn ) );
+      if ( tMin > tMax )
         {
-        outputPtr->SetPixel( it.GetIndex(), foregroundLabel );
+        continue;
         }
-     
-      ++it;
+
+      long first = firstColumn + long( vcl_ceil( tMin ) );
+      long last  = firstColumn + long( vcl_floor( tMax ) );
+      if ( first > last )
+        {
+        continue;
+        }
+
+      rowIndex[0] = first;
+      LabelMapPixelType* voxel = outputPtr->GetBufferPointer() + outputPtr->ComputeOffset( rowIndex );
+      rowIndex[0] = firstColumn;
+
+      std::fill( voxel, voxel + (last - first + 1), foregroundLabel );
       }
     }
 }
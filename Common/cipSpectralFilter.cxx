@@ -0,0 +1,546 @@
+#include "cipSpectralFilter.h"
+#include "vnl/vnl_math.h"
+
+#include <algorithm>
+#include <cmath>
+
+cipSpectralFilter::cipSpectralFilter()
+{
+  this->m_NumberOfThreads = itk::MultiThreader::GetGlobalDefaultNumberOfThreads();
+
+  for ( unsigned int d=0; d<3; d++ )
+    {
+    this->m_Size[d]         = 0;
+    this->m_SpectrumSize[d] = 0;
+    this->m_Spacing[d]      = 1.0;
+    }
+}
+
+
+void cipSpectralFilter::SetNumberOfThreads( unsigned int numberOfThreads )
+{
+  this->m_NumberOfThreads = std::max( numberOfThreads, 1u );
+}
+
+
+void cipSpectralFilter::SetSize( const unsigned int size[3] )
+{
+  for ( unsigned int d=0; d<3; d++ )
+    {
+    this->m_Size[d]         = std::max( size[d], 1u );
+    this->m_SpectrumSize[d] = this->m_Size[d];
+    }
+  this->m_SpectrumSize[0] = this->m_Size[0]/2 + 1;
+
+  // Even lengths along x are transformed as complex sequences of half the
+  // length (the even samples being the real parts, the odd samples the
+  // imaginary parts)
+  unsigned int nx = this->m_Size[0];
+  if ( nx % 2 == 0 )
+    {
+    Plan( nx/2, this->m_Plans[0] );
+
+    this->m_RealTwiddles.resize( nx/2 + 1 );
+    for ( unsigned int k=0; k<=nx/2; k++ )
+      {
+      double phase = -2.0*vnl_math::pi*static_cast< double >( k )/static_cast< double >( nx );
+      this->m_RealTwiddles[k] = ComplexType( std::cos( phase ), std::sin( phase ) );
+      }
+    }
+  else
+    {
+    Plan( nx, this->m_Plans[0] );
+    this->m_RealTwiddles.clear();
+    }
+  Plan( this->m_Size[1], this->m_Plans[1] );
+  Plan( this->m_Size[2], this->m_Plans[2] );
+
+  this->m_Spectrum.assign( static_cast< unsigned long >( this->m_SpectrumSize[0] )*this->m_SpectrumSize[1]*
+                           this->m_SpectrumSize[2], ComplexType( 0.0f, 0.0f ) );
+
+  this->UpdateFrequencies();
+}
+
+
+void cipSpectralFilter::SetSpacing( const double spacing[3] )
+{
+  for ( unsigned int d=0; d<3; d++ )
+    {
+    this->m_Spacing[d] = spacing[d];
+    }
+
+  this->UpdateFrequencies();
+}
+
+
+void cipSpectralFilter::GetSpectrumSize( unsigned int size[3] ) const
+{
+  for ( unsigned int d=0; d<3; d++ )
+    {
+    size[d] = this->m_SpectrumSize[d];
+    }
+}
+
+
+double cipSpectralFilter::GetFrequency( unsigned int index, unsigned int size, double spacing )
+{
+  // Frequencies past the middle of the transform are the negative ones.
+  // For even sizes the middle element is the negative Nyquist frequency,
+  // as in vtkImageKernelSource's shifted kernels.
+  if ( size <= 1 )
+    {
+    return 0.0;
+    }
+
+  double k = ( index < (size + 1)/2 ) ? static_cast< double >( index ) :
+    static_cast< double >( index ) - static_cast< double >( size );
+
+  return 2.0*vnl_math::pi*k/(static_cast< double >( size )*spacing);
+}
+
+
+void cipSpectralFilter::UpdateFrequencies()
+{
+  for ( unsigned int d=0; d<3; d++ )
+    {
+    this->m_Frequencies[d].resize( this->m_SpectrumSize[d] );
+    for ( unsigned int i=0; i<this->m_SpectrumSize[d]; i++ )
+      {
+      this->m_Frequencies[d][i] = GetFrequency( i, this->m_Size[d], this->m_Spacing[d] );
+      }
+    }
+}
+
+
+void cipSpectralFilter::Plan( unsigned int size, FFTPLAN& plan )
+{
+  plan.size = size;
+
+  // Radix 4 first, then 2, then odd factors (the last of which may be a
+  // large prime)
+  plan.factors.clear();
+  unsigned int n = size;
+  unsigned int p = 4;
+  unsigned int sqrtSize = static_cast< unsigned int >( std::floor( std::sqrt( static_cast< double >( size ) ) ) );
+  while ( n > 1 )
+    {
+    while ( n % p != 0 )
+      {
+      p = ( p == 4 ) ? 2 : ( ( p == 2 ) ? 3 : p + 2 );
+      if ( p > sqrtSize )
+        {
+        p = n;
+        }
+      }
+    n /= p;
+    plan.factors.push_back( p );
+    plan.factors.push_back( n );
+    }
+
+  plan.twiddles.resize( size );
+  for ( unsigned int t=0; t<size; t++ )
+    {
+    double phase = -2.0*vnl_math::pi*static_cast< double >( t )/static_cast< double >( size );
+    plan.twiddles[t] = ComplexType( std::cos( phase ), std::sin( phase ) );
+    }
+}
+
+
+void cipSpectralFilter::Transform( const FFTPLAN& plan, const ComplexType* in, ComplexType* out,
+                                   ComplexType* scratch )
+{
+  if ( plan.size <= 1 )
+    {
+    out[0] = in[0];
+    return;
+    }
+
+  Work( plan, out, in, 1, 0, scratch );
+}
+
+
+void cipSpectralFilter::Work( const FFTPLAN& plan, ComplexType* out, const ComplexType* in, unsigned int fstride,
+                              unsigned int factor, ComplexType* scratch )
+{
+  // Decimation in time: transform the p interleaved subsequences of length
+  // m, then combine them with radix p butterflies
+  const unsigned int p = plan.factors[2*factor];
+  const unsigned int m = plan.factors[2*factor + 1];
+
+  if ( m == 1 )
+    {
+    for ( unsigned int q=0; q<p; q++ )
+      {
+      out[q] = in[q*fstride];
+      }
+    }
+  else
+    {
+    for ( unsigned int q=0; q<p; q++ )
+      {
+      Work( plan, out + q*m, in + q*fstride, fstride*p, factor + 1, scratch );
+      }
+    }
+
+  const ComplexType* tw = &plan.twiddles[0];
+  if ( p == 2 )
+    {
+    for ( unsigned int u=0; u<m; u++ )
+      {
+      ComplexType t = Multiply( out[u + m], tw[u*fstride] );
+      out[u + m] = out[u] - t;
+      out[u]    += t;
+      }
+    }
+  else if ( p == 4 )
+    {
+    for ( unsigned int u=0; u<m; u++ )
+      {
+      ComplexType s0 = Multiply( out[u + m], tw[u*fstride] );
+      ComplexType s1 = Multiply( out[u + 2*m], tw[2*u*fstride] );
+      ComplexType s2 = Multiply( out[u + 3*m], tw[3*u*fstride] );
+      ComplexType s5 = out[u] - s1;
+      ComplexType s3 = s0 + s2;
+      ComplexType s4 = s0 - s2;
+
+      out[u]      += s1;
+      out[u + 2*m] = out[u] - s3;
+      out[u]      += s3;
+      out[u + m]   = ComplexType( s5.real() + s4.imag(), s5.imag() - s4.real() );
+      out[u + 3*m] = ComplexType( s5.real() - s4.imag(), s5.imag() + s4.real() );
+      }
+    }
+  else
+    {
+    const unsigned int size = plan.size;
+    for ( unsigned int u=0; u<m; u++ )
+      {
+      for ( unsigned int q=0; q<p; q++ )
+        {
+        scratch[q] = out[u + q*m];
+        }
+      for ( unsigned int q=0; q<p; q++ )
+        {
+        unsigned int k = u + q*m;
+        unsigned int t = 0;
+        ComplexType sum = scratch[0];
+        for ( unsigned int r=1; r<p; r++ )
+          {
+          t += fstride*k;
+          if ( t >= size )
+            {
+            t -= size;
+            }
+          sum += Multiply( scratch[r], tw[t] );
+          }
+        out[k] = sum;
+        }
+      }
+    }
+}
+
+
+void cipSpectralFilter::TransformSpectrum()
+{
+  std::vector< ComplexType* > spectra( 1, &this->m_Spectrum[0] );
+
+  THREADSTRUCT str;
+    str.filter         = this;
+    str.spectra        = &spectra;
+    str.output         = NULL;
+    str.batch          = NULL;
+    str.radialResponse = NULL;
+    str.dimensionality = 0;
+
+  str.pass = FORWARDX;
+  this->RunPass( str, static_cast< unsigned long >( this->m_Size[1] )*this->m_Size[2] );
+  if ( this->m_Size[1] > 1 )
+    {
+    str.pass = FORWARDY;
+    this->RunPass( str, static_cast< unsigned long >( this->m_SpectrumSize[0] )*this->m_Size[2] );
+    }
+  if ( this->m_Size[2] > 1 )
+    {
+    str.pass = FORWARDZ;
+    this->RunPass( str, static_cast< unsigned long >( this->m_SpectrumSize[0] )*this->m_Size[1] );
+    }
+}
+
+
+void cipSpectralFilter::Inverse( const std::vector< ComplexType* >& spectra, float* output )
+{
+  if ( spectra.empty() )
+    {
+    return;
+    }
+
+  THREADSTRUCT str;
+    str.filter         = this;
+    str.spectra        = &spectra;
+    str.output         = output;
+    str.batch          = NULL;
+    str.radialResponse = NULL;
+    str.dimensionality = 0;
+
+  if ( this->m_Size[2] > 1 )
+    {
+    str.pass = INVERSEZ;
+    this->RunPass( str, static_cast< unsigned long >( this->m_SpectrumSize[0] )*this->m_Size[1] );
+    }
+  if ( this->m_Size[1] > 1 )
+    {
+    str.pass = INVERSEY;
+    this->RunPass( str, static_cast< unsigned long >( this->m_SpectrumSize[0] )*this->m_Size[2] );
+    }
+  str.pass = INVERSEX;
+  this->RunPass( str, static_cast< unsigned long >( this->m_Size[1] )*this->m_Size[2] );
+}
+
+
+void cipSpectralFilter::ApplyQuadratureKernel( const std::vector< float >& radialResponse, unsigned int dimensionality,
+                                               float* monogenic )
+{
+  // One filtered spectrum per Riesz component plus the band passed one.
+  // The buffer is kept so that further scales can reuse it.
+  unsigned long numElements = this->m_Spectrum.size();
+  this->m_Batch.resize( (dimensionality + 1)*numElements );
+
+  std::vector< ComplexType* > spectra( dimensionality + 1 );
+  for ( unsigned int c=0; c<=dimensionality; c++ )
+    {
+    spectra[c] = &this->m_Batch[c*numElements];
+    }
+
+  // The kernel pass reads the image's spectrum and fills every spectrum
+  // of the batch at once
+  std::vector< ComplexType* > source( 1, &this->m_Spectrum[0] );
+
+  THREADSTRUCT str;
+    str.filter         = this;
+    str.pass           = QUADRATURE;
+    str.spectra        = &source;
+    str.output         = NULL;
+    str.batch          = &spectra;
+    str.radialResponse = &radialResponse;
+    str.dimensionality = dimensionality;
+
+  this->RunPass( str, static_cast< unsigned long >( this->m_Size[1] )*this->m_Size[2] );
+
+  this->Inverse( spectra, monogenic );
+}
+
+
+void cipSpectralFilter::RunPass( THREADSTRUCT& str, unsigned long linesPerSpectrum )
+{
+  unsigned long numLines = linesPerSpectrum*str.spectra->size();
+
+  str.linesPerSpectrum = linesPerSpectrum;
+  str.numberOfBlocks   = static_cast< unsigned int >( std::min( static_cast< unsigned long >( this->m_NumberOfThreads ),
+                                                                numLines ) );
+
+  itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+    threader->SetNumberOfThreads( str.numberOfBlocks );
+    threader->SetSingleMethod( PassThreaderCallback, &str );
+    threader->SingleMethodExecute();
+}
+
+
+ITK_THREAD_RETURN_TYPE cipSpectralFilter::PassThreaderCallback( void* arg )
+{
+  itk::MultiThreader::ThreadInfoStruct* info = static_cast< itk::MultiThreader::ThreadInfoStruct* >( arg );
+  THREADSTRUCT* str = static_cast< THREADSTRUCT* >( info->UserData );
+
+  // The threader may have been given fewer threads than requested
+  unsigned int numBlocks = std::min( str->numberOfBlocks, static_cast< unsigned int >( info->NumberOfThreads ) );
+  if ( info->ThreadID >= numBlocks )
+    {
+    return ITK_THREAD_RETURN_VALUE;
+    }
+
+  unsigned long numLines = str->linesPerSpectrum*str->spectra->size();
+  unsigned long start = numLines*info->ThreadID/numBlocks;
+  unsigned long end   = numLines*(info->ThreadID + 1)/numBlocks;
+
+  str->filter->ProcessLines( *str, start, end );
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+
+void cipSpectralFilter::ProcessLines( const THREADSTRUCT& str, unsigned long start, unsigned long end )
+{
+  const unsigned int   nx = this->m_Size[0];
+  const unsigned int   ny = this->m_Size[1];
+  const unsigned int   nz = this->m_Size[2];
+  const unsigned int   hx = this->m_SpectrumSize[0];
+  const unsigned int   numSpectra  = static_cast< unsigned int >( str.spectra->size() );
+
+  unsigned int maxLength = std::max( nx, std::max( ny, nz ) ) + 1;
+  std::vector< ComplexType > lines( GROUPSIZE*maxLength );
+  std::vector< ComplexType > transformed( GROUPSIZE*maxLength );
+  ComplexType* line = &lines[0];
+  std::vector< ComplexType > scratch( maxLength );
+
+  for ( unsigned long l=start; l<end; l++ )
+    {
+    unsigned int b = static_cast< unsigned int >( l/str.linesPerSpectrum );
+    ComplexType* spectrum = (*str.spectra)[b];
+    unsigned long lineIndex = l % str.linesPerSpectrum;
+
+    if ( str.pass == FORWARDY || str.pass == INVERSEY || str.pass == FORWARDZ || str.pass == INVERSEZ )
+      {
+      // Complex transforms along y and z. Inverses are forward transforms
+      // of the complex conjugates. Lines that are next to each other are
+      // gathered and scattered together, which reads whole cache lines.
+      const bool   alongY  = ( str.pass == FORWARDY || str.pass == INVERSEY );
+      const bool   inverse = ( str.pass == INVERSEY || str.pass == INVERSEZ );
+      unsigned int length  = alongY ? ny : nz;
+      unsigned long stride = alongY ? hx : static_cast< unsigned long >( hx )*ny;
+      unsigned long base   = alongY ? (lineIndex/hx)*hx*ny + lineIndex % hx : lineIndex;
+
+      unsigned long numAdjacent = std::min( end - l, str.linesPerSpectrum - lineIndex );
+      if ( alongY )
+        {
+        numAdjacent = std::min( numAdjacent, static_cast< unsigned long >( hx - lineIndex % hx ) );
+        }
+      unsigned int group = static_cast< unsigned int >( std::min( numAdjacent,
+                                                                  static_cast< unsigned long >( GROUPSIZE ) ) );
+
+      ComplexType* ptr = spectrum + base;
+      for ( unsigned int n=0; n<length; n++ )
+        {
+        for ( unsigned int g=0; g<group; g++ )
+          {
+          lines[g*length + n] = inverse ? std::conj( ptr[n*stride + g] ) : ptr[n*stride + g];
+          }
+        }
+      for ( unsigned int g=0; g<group; g++ )
+        {
+        Transform( this->m_Plans[alongY ? 1 : 2], &lines[g*length], &transformed[g*length], &scratch[0] );
+        }
+      for ( unsigned int n=0; n<length; n++ )
+        {
+        for ( unsigned int g=0; g<group; g++ )
+          {
+          ptr[n*stride + g] = inverse ? std::conj( transformed[g*length + n] ) : transformed[g*length + n];
+          }
+        }
+
+      l += group - 1;
+      }
+    else if ( str.pass == FORWARDX )
+      {
+      // The row holds nx real values, to be replaced by their hx
+      // coefficients
+      ComplexType* row  = spectrum + lineIndex*hx;
+      float*       real = reinterpret_cast< float* >( row );
+      if ( nx % 2 == 0 )
+        {
+        // With z[n] = x[2n] + i*x[2n+1], Z = DFT(z), the coefficients are
+        // X[k] = E[k] + W^k O[k], where E[k] = (Z[k] + conj(Z[M-k]))/2 and
+        // O[k] = (Z[k] - conj(Z[M-k]))/2i are the transforms of the even
+        // and odd samples
+        unsigned int M = nx/2;
+        Transform( this->m_Plans[0], row, &transformed[0], &scratch[0] );
+        for ( unsigned int k=0; k<=M; k++ )
+          {
+          ComplexType zk = transformed[k % M];
+          ComplexType zc = std::conj( transformed[(M - k) % M] );
+          ComplexType e  = 0.5f*(zk + zc);
+          ComplexType d  = 0.5f*(zk - zc);
+          ComplexType o( d.imag(), -d.real() );
+          row[k] = e + Multiply( this->m_RealTwiddles[k], o );
+          }
+        }
+      else
+        {
+        for ( unsigned int n=0; n<nx; n++ )
+          {
+          line[n] = ComplexType( real[n], 0.0f );
+          }
+        Transform( this->m_Plans[0], line, &transformed[0], &scratch[0] );
+        for ( unsigned int k=0; k<hx; k++ )
+          {
+          row[k] = transformed[k];
+          }
+        }
+      }
+    else if ( str.pass == INVERSEX )
+      {
+      // Complex-to-real transforms along x, written straight to the output
+      const ComplexType* row = spectrum + lineIndex*hx;
+      float* out = str.output + lineIndex*nx*numSpectra + b;
+      if ( nx % 2 == 0 )
+        {
+        // The reverse of the forward pass: E[k] = (X[k] + conj(X[M-k]))/2,
+        // O[k] = (X[k] - conj(X[M-k]))/(2 W^k) and Z[k] = E[k] + i O[k]
+        unsigned int M = nx/2;
+        float scale = 1.0f/(static_cast< float >( M )*ny*nz);
+        for ( unsigned int k=0; k<M; k++ )
+          {
+          ComplexType xk = row[k];
+          ComplexType xc = std::conj( row[M - k] );
+          ComplexType e  = 0.5f*(xk + xc);
+          ComplexType o  = Multiply( 0.5f*(xk - xc), std::conj( this->m_RealTwiddles[k] ) );
+          line[k] = std::conj( e + ComplexType( -o.imag(), o.real() ) );
+          }
+        Transform( this->m_Plans[0], line, &transformed[0], &scratch[0] );
+        for ( unsigned int n=0; n<M; n++ )
+          {
+          out[(2*n)*numSpectra]     = scale*transformed[n].real();
+          out[(2*n + 1)*numSpectra] = -scale*transformed[n].imag();
+          }
+        }
+      else
+        {
+        float scale = 1.0f/(static_cast< float >( nx )*ny*nz);
+        for ( unsigned int k=0; k<nx; k++ )
+          {
+          line[k] = ( k < hx ) ? std::conj( row[k] ) : row[nx - k];
+          }
+        Transform( this->m_Plans[0], line, &transformed[0], &scratch[0] );
+        for ( unsigned int n=0; n<nx; n++ )
+          {
+          out[n*numSpectra] = scale*transformed[n].real();
+          }
+        }
+      }
+    else if ( str.pass == QUADRATURE )
+      {
+      // Filter one row of the spectrum with every kernel component: the
+      // band passed spectrum is S = F*radial, and Riesz component d is
+      // -i*(u_d/|u|)*S
+      const unsigned int   j      = static_cast< unsigned int >( lineIndex % ny );
+      const unsigned int   k      = static_cast< unsigned int >( lineIndex/ny );
+      const unsigned long  offset = lineIndex*hx;
+      const double         fy     = this->m_Frequencies[1][j];
+      const double         fz     = this->m_Frequencies[2][k];
+      const unsigned int   dim    = str.dimensionality;
+      ComplexType* const*  batch  = &(*str.batch)[0];
+      for ( unsigned int i=0; i<hx; i++ )
+        {
+        const double fx = this->m_Frequencies[0][i];
+        ComplexType s = (*str.radialResponse)[offset + i]*spectrum[offset + i];
+
+        double r = std::sqrt( fx*fx + fy*fy + fz*fz );
+        double u[3];
+        for ( unsigned int c=0; c<3; c++ )
+          {
+          u[c] = 0.0;
+          }
+        if ( r > 0.0 )
+          {
+          u[0] = fx/r;
+          u[1] = fy/r;
+          u[2] = fz/r;
+          }
+        for ( unsigned int c=0; c<dim; c++ )
+          {
+          float uc = static_cast< float >( u[c] );
+          batch[c][offset + i] = ComplexType( uc*s.imag(), -uc*s.real() );
+          }
+        batch[dim][offset + i] = s;
+        }
+      }
+    }
+}
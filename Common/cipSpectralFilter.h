@@ -0,0 +1,183 @@
+/**
+ *  \class cipSpectralFilter
+ *  \ingroup common
+ *  \brief Single precision FFT of real images, for filtering them in the
+ *  Fourier domain.
+ *
+ *  The image is transformed once with a real-to-complex transform that
+ *  only keeps the non-redundant half of its spectrum: (Nx/2+1) x Ny x Nz
+ *  complex floats, x running fastest. Element (i,j,k) of the half spectrum
+ *  is at the frequencies returned by GetFrequency for each axis, i.e. the
+ *  zero frequency is at the origin.
+ *
+ *  Filtered spectra are transformed back to the spatial domain as a batch:
+ *  each pass of the inverse transform processes the lines of all of the
+ *  spectra at once, split across threads. The one dimensional transforms
+ *  (mixed radix, with precomputed twiddle factors) are planned once per
+ *  axis when the size is set, and are reused for every line, spectrum and
+ *  call after that.
+ *
+ *  ApplyQuadratureKernel computes the monogenic signal of the image for a
+ *  spherical quadrature kernel (see vtkGeneralizedQuadratureKernelSource)
+ *  given the kernel's radial frequency response over the half spectrum.
+ */
+
+#ifndef __cipSpectralFilter_h
+#define __cipSpectralFilter_h
+
+#include "itkMultiThreader.h"
+
+#include <complex>
+#include <vector>
+
+class cipSpectralFilter
+{
+public:
+  typedef std::complex< float >  ComplexType;
+
+  cipSpectralFilter();
+  ~cipSpectralFilter() {};
+
+  /** Defaults to ITK's global default number of threads */
+  void SetNumberOfThreads( unsigned int );
+  unsigned int GetNumberOfThreads() const
+    {
+      return m_NumberOfThreads;
+    }
+
+  /** Size of the images to transform. This plans the transforms and
+   *  allocates the spectrum. */
+  void SetSize( const unsigned int size[3] );
+  const unsigned int* GetSize() const
+    {
+      return m_Size;
+    }
+
+  /** Spacing of the images, which only matters for the frequencies of the
+   *  half spectrum. Defaults to 1. */
+  void SetSpacing( const double spacing[3] );
+
+  /** Size of the half spectrum: Nx/2+1, Ny, Nz */
+  void GetSpectrumSize( unsigned int size[3] ) const;
+  unsigned long GetNumberOfSpectrumElements() const
+    {
+      return m_Spectrum.size();
+    }
+
+  /** Frequency (radians per unit of spacing) of element 'index' of a
+   *  transform of length 'size' */
+  static double GetFrequency( unsigned int index, unsigned int size, double spacing );
+
+  /** Forward transform of the first component of 'image', which has
+   *  'numberOfComponents' components per voxel and x running fastest. The
+   *  transform is kept as the spectrum. */
+  template< class TPixel >
+  void Forward( const TPixel* image, unsigned int numberOfComponents = 1 )
+    {
+      // The real rows are laid out in the rows of the spectrum (which have
+      // room for them) and transformed in place
+      float* rows = reinterpret_cast< float* >( &m_Spectrum[0] );
+      unsigned long numRows = static_cast< unsigned long >( m_Size[1] )*m_Size[2];
+      for ( unsigned long r=0; r<numRows; r++ )
+        {
+        float* row = rows + 2*m_SpectrumSize[0]*r;
+        const TPixel* inPtr = image + r*m_Size[0]*numberOfComponents;
+        for ( unsigned int i=0; i<m_Size[0]; i++ )
+          {
+          row[i] = static_cast< float >( *inPtr );
+          inPtr += numberOfComponents;
+          }
+        }
+      this->TransformSpectrum();
+    }
+
+  const std::vector< ComplexType >& GetSpectrum() const
+    {
+      return m_Spectrum;
+    }
+
+  /** Inverse transform of a batch of half spectra, which are overwritten.
+   *  Spectra are taken to be Hermitian, i.e. the transforms of real images.
+   *  The inverse of spectrum b is written to output[v*spectra.size() + b]
+   *  for voxel v. */
+  void Inverse( const std::vector< ComplexType* >& spectra, float* output );
+
+  /** Compute the monogenic signal of the transformed image for a spherical
+   *  quadrature kernel whose radial frequency response over the half
+   *  spectrum is 'radialResponse'. The 'dimensionality' Riesz components
+   *  followed by the band passed image are written to 'monogenic',
+   *  interleaved, so it must have room for (dimensionality+1) values per
+   *  voxel. */
+  void ApplyQuadratureKernel( const std::vector< float >& radialResponse, unsigned int dimensionality,
+                              float* monogenic );
+
+private:
+  struct FFTPLAN
+  {
+    unsigned int                 size;
+    std::vector< unsigned int >  factors;   // Pairs of radix and remaining length
+    std::vector< ComplexType >   twiddles;  // exp(-2*pi*i*t/size)
+  };
+
+  // Number of adjacent lines transformed together along y and z
+  static const unsigned int GROUPSIZE = 8;
+
+  enum PassType
+  {
+    FORWARDX,
+    FORWARDY,
+    FORWARDZ,
+    INVERSEX,
+    INVERSEY,
+    INVERSEZ,
+    QUADRATURE
+  };
+
+  struct THREADSTRUCT
+  {
+    cipSpectralFilter*                   filter;
+    PassType                             pass;
+    const std::vector< ComplexType* >*   spectra;
+    float*                               output;
+    const std::vector< ComplexType* >*   batch;
+    const std::vector< float >*          radialResponse;
+    unsigned int                         dimensionality;
+    unsigned long                        linesPerSpectrum;
+    unsigned int                         numberOfBlocks;
+  };
+
+  static ITK_THREAD_RETURN_TYPE PassThreaderCallback( void* );
+
+  static void Plan( unsigned int size, FFTPLAN& );
+  static ComplexType Multiply( const ComplexType& a, const ComplexType& b )
+    {
+      return ComplexType( a.real()*b.real() - a.imag()*b.imag(), a.real()*b.imag() + a.imag()*b.real() );
+    }
+  static void Transform( const FFTPLAN&, const ComplexType* in, ComplexType* out, ComplexType* scratch );
+  static void Work( const FFTPLAN&, ComplexType* out, const ComplexType* in, unsigned int fstride,
+                    unsigned int factor, ComplexType* scratch );
+
+  void UpdateFrequencies();
+  void TransformSpectrum();
+  void RunPass( THREADSTRUCT&, unsigned long linesPerSpectrum );
+  void ProcessLines( const THREADSTRUCT&, unsigned long start, unsigned long end );
+
+  unsigned int                  m_NumberOfThreads;
+  unsigned int                  m_Size[3];
+  unsigned int                  m_SpectrumSize[3];
+  double                        m_Spacing[3];
+
+  // Plans of the complex transforms along each axis. Even lengths along x
+  // are transformed as complex sequences of half the length, for which
+  // m_RealTwiddles holds exp(-2*pi*i*k/Nx), k=0..Nx/2.
+  FFTPLAN                       m_Plans[3];
+  std::vector< ComplexType >    m_RealTwiddles;
+
+  // Frequencies of the half spectrum's elements along each axis
+  std::vector< double >         m_Frequencies[3];
+
+  std::vector< ComplexType >    m_Spectrum;
+  std::vector< ComplexType >    m_Batch;
+};
+
+#endif
@@ -15,6 +15,18 @@
 cipSphereStencil::cipSphereStencil()
 {
   this->Radius = 1.0;
+
+  this->Center[0] = 0.0;
+  this->Center[1] = 0.0;
+  this->Center[2] = 0.0;
+
+  this->ComputeStencilBoundingBox();
+}
+
+
+cipStencil* cipSphereStencil::Clone() const
+{
+  return new cipSphereStencil( *this );
 }
 
 bool cipSphereStencil::IsInsideBoundingBox( double x, double y, double z ) const
@@ -42,6 +54,41 @@ bool cipSphereStencil::IsInsideStencilPattern( double x, double y, double z ) co
 }
 
 
+//
+// Solve |point + t*direction - center|^2 = radius^2 for t
+//
+bool cipSphereStencil::GetLineSpan( const double* const point, const double* const direction,
+                                    double* const tMin, double* const tMax ) const
+{
+  double vec[3];
+    vec[0] = point[0] - this->Center[0];
+    vec[1] = point[1] - this->Center[1];
+    vec[2] = point[2] - this->Center[2];
+
+  double a = direction[0]*direction[0] + direction[1]*direction[1] + direction[2]*direction[2];
+  double b = 2.0*(vec[0]*direction[0] + vec[1]*direction[1] + vec[2]*direction[2]);
+  double c = vec[0]*vec[0] + vec[1]*vec[1] + vec[2]*vec[2] - this->Radius*this->Radius;
+
+  if ( a == 0 )
+    {
+    return false;
+    }
+
+  double discriminant = b*b - 4.0*a*c;
+  if ( discriminant < 0 )
+    {
+    return false;
+    }
+
+  double root = sqrt( discriminant );
+
+  *tMin = (-b - root)/(2.0*a);
+  *tMax = (-b + root)/(2.0*a);
+
+  return true;
+}
+
+
 void cipSphereStencil::GetStencilBoundingBox( double* const bbMin, double* const bbMax ) const
 {
   bbMin[0] = this->BoundingBoxMin[0];
@@ -36,6 +36,15 @@ public:
    *  method. */
   bool IsInsideStencilPattern( double, double, double ) const; 
 
+  /** Given a line through the physical point 'point' with direction
+   *  'direction', this method computes the range of the line
+   *  parameter t for which point + t*direction is inside the stencil
+   *  pattern. Returns false if the line misses the pattern. */
+  bool GetLineSpan( const double* const, const double* const, double* const, double* const ) const;
+
+  /** Create a copy of this stencil. The caller owns the copy. */
+  cipStencil* Clone() const;
+
   /** Get the bounding box of the stencil. The first argument should
    *  be a 3 element vector to hold the min x, y, and z physical
    *  coordinates of the bounding box. The second argument should be
@@ -57,6 +66,7 @@ public:
   void SetRadius( double r )
     {
       Radius = r;
+      ComputeStencilBoundingBox();
     };
 
 private:
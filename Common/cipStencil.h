@@ -26,9 +26,14 @@
 class cipStencil
 {
 public:
-  ~cipStencil(){};
+  virtual ~cipStencil(){};
   cipStencil(){};
 
+  /** Create a copy of this stencil, including its center,
+   *  orientation and size. The caller owns the copy. Use one copy per
+   *  thread when stenciling concurrently. */
+  virtual cipStencil* Clone() const = 0;
+
   /** Given physical coordinates, x, y, and z, this method will
    *  indicate whether the point is inside the stencil's bounding box
    *  or not. Note that 'SetCenter' must be called before calling this
@@ -41,6 +46,15 @@ public:
    *  method. */
   virtual bool IsInsideStencilPattern( double, double, double ) const = 0;
 
+  /** Given a line through the physical point 'point' with direction
+   *  'direction' (not necessarily of unit length), this method
+   *  computes the range of the line parameter t for which point +
+   *  t*direction is inside the stencil pattern. Returns false if the
+   *  line misses the pattern. Note that 'SetCenter' must be called
+   *  before calling this method. */
+  virtual bool GetLineSpan( const double* const point, const double* const direction,
+                            double* const tMin, double* const tMax ) const = 0;
+
   /** Get the bounding box of the stencil. The first argument should
    *  be a 3 element vector to hold the min x, y, and z physical
    *  coordinates of the bounding box. The second argument should be
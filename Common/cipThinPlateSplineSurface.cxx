@@ -1,11 +1,15 @@
 #include "cipThinPlateSplineSurface.h"
 #include "itkNumericTraits.h"
+#include "cipInstrumentation.h"
+#include "vnl/algo/vnl_svd.h"
+#include <algorithm>
 
 
 cipThinPlateSplineSurface::cipThinPlateSplineSurface()
 {
   this->m_Lambda = 0.0;
   this->m_NumberSurfacePoints = 0;
+  this->m_NumberOfKernelCenters = 0;
 }
 
 
@@ -15,6 +19,8 @@ cipThinPlateSplineSurface::cipThinPlateSplineSurface()
 //
 cipThinPlateSplineSurface::cipThinPlateSplineSurface( const std::vector< cip::PointType >& surfacePointsVec )
 {
+  this->m_Lambda = 0.0;
+  this->m_NumberOfKernelCenters = 0;
   this->m_NumberSurfacePoints = surfacePointsVec.size();
   this->SetSurfacePoints( surfacePointsVec );
   this->ComputeThinPlateSplineVectors();
@@ -31,6 +37,17 @@ void cipThinPlateSplineSurface::SetLambda( double lambda )
 }
 
 
+void cipThinPlateSplineSurface::SetNumberOfKernelCenters( unsigned int numberOfCenters )
+{
+  this->m_NumberOfKernelCenters = numberOfCenters;
+
+  if ( this->m_NumberSurfacePoints > 0 )
+    {
+    this->ComputeThinPlateSplineVectors();
+    }
+}
+
+
 void cipThinPlateSplineSurface::SetSurfacePointWeights( const std::vector< double >*  const surfacePointWeights )
 {
   // Clear any existing surface point weights first
@@ -77,15 +94,27 @@ void cipThinPlateSplineSurface::SetSurfacePoints( const std::vector< cip::PointT
 
 void cipThinPlateSplineSurface::ComputeThinPlateSplineVectors()
 {
+  cip::ScopedTimer timer( "cipThinPlateSplineSurface::ComputeThinPlateSplineVectors" );
+    timer.AddParticles( this->m_SurfacePoints.size() );
+
   // First make sure the TPS vectors are clear
   this->m_a.clear();
   this->m_w.clear();    
 
+  unsigned int numPoints = this->m_SurfacePoints.size();
+
+  if ( this->m_NumberOfKernelCenters > 0 && this->m_NumberOfKernelCenters < numPoints )
+    {
+    this->ComputeLowRankThinPlateSplineVectors();
+    return;
+    }
+
+  // Every surface point is a kernel center for the exact TPS
+  this->m_KernelCenters = this->m_SurfacePoints;
+
   // Create the K matrix
   double rTotal = 0.0; // Will be used to compute alpha for smoothing 
 
-  unsigned int numPoints = this->m_SurfacePoints.size();
-  
   vnl_matrix< double > K( numPoints, numPoints );
   for ( unsigned int i=0; i<numPoints; i++ )
     {
@@ -228,15 +257,239 @@ void cipThinPlateSplineSurface::ComputeThinPlateSplineVectors()
 }
 
 
-double cipThinPlateSplineSurface::GetSurfaceHeight( double x, double y ) const
+//
+// Chooses 'm_NumberOfKernelCenters' of the surface points by farthest
+// point sampling in the x-y plane (the plane in which the surface is
+// parameterized), so that the centers cover the extent of the points
+// evenly regardless of how densely the points are clustered. Points that
+// coincide in x-y with an existing center are never chosen.
+//
+void cipThinPlateSplineSurface::SelectKernelCenters()
 {
+  this->m_KernelCenters.clear();
+
   unsigned int numPoints = this->m_SurfacePoints.size();
 
+  std::vector< double > minSquaredDistance( numPoints, itk::NumericTraits< double >::max() );
+
+  unsigned int next = 0;
+  while ( this->m_KernelCenters.size() < this->m_NumberOfKernelCenters )
+    {
+    double cx = this->m_SurfacePoints[next][0];
+    double cy = this->m_SurfacePoints[next][1];
+
+    this->m_KernelCenters.push_back( this->m_SurfacePoints[next] );
+
+    double farthest = 0.0;
+    for ( unsigned int i=0; i<numPoints; i++ )
+      {
+      double xDiff = this->m_SurfacePoints[i][0] - cx;
+      double yDiff = this->m_SurfacePoints[i][1] - cy;
+
+      minSquaredDistance[i] = std::min( minSquaredDistance[i], xDiff*xDiff + yDiff*yDiff );
+      if ( minSquaredDistance[i] > farthest )
+        {
+        farthest = minSquaredDistance[i];
+        next     = i;
+        }
+      }
+
+    // Every remaining point coincides with a center
+    if ( farthest == 0.0 )
+      {
+      break;
+      }
+    }
+}
+
+
+//
+// Low-rank (subset of centers) TPS. With M centers c_j the surface is
+//   f(x,y) = a0 + a1*x + a2*y + sum_j w_j U(|(x,y) - c_j|)
+// and w, a minimize
+//   sum_i g_i (z_i - f(x_i,y_i))^2 + mu w^T K_cc w,   subject to P_c^T w = 0
+// where K_cc is the kernel matrix among the centers and P_c = [1 x y] at
+// the centers. The exact TPS solved above is the minimizer of the same
+// functional when every point is a center, with g_i = 1 and
+// mu = lambda*alpha^2 (or g_i = 1/weight_i and mu = lambda when point
+// weights are given), so both solvers fit the same smoothing model. The
+// (M+6)x(M+6) KKT system is accumulated one point at a time, so the N x M
+// kernel matrix is never stored.
+//
+// alpha, the mean distance between all pairs of points for the exact TPS,
+// would alone cost O(N^2). It is estimated instead by the mean distance
+// from the points to the centers, from the distances the accumulation
+// computes anyway, so mu (and the fit) can differ slightly from the exact
+// TPS when no point weights are given.
+//
+void cipThinPlateSplineSurface::ComputeLowRankThinPlateSplineVectors()
+{
+  this->SelectKernelCenters();
+
+  unsigned int numPoints  = this->m_SurfacePoints.size();
+  unsigned int numCenters = this->m_KernelCenters.size();
+  unsigned int numBasis   = numCenters + 3;
+  unsigned int dim        = numCenters + 6;
+
+  bool useWeights = ( this->m_SurfacePointWeights.size() == numPoints );
+
+  // A point weight of 0 asks for interpolation at that point; approximate
+  // it with a large (but finite) data term
+  double minWeight = 0.0;
+  if ( useWeights )
+    {
+    minWeight = 1e-6*( *std::max_element( this->m_SurfacePointWeights.begin(), this->m_SurfacePointWeights.end() ) );
+    }
+
+  vnl_matrix< double > A( dim, dim, 0.0 );
+  vnl_vector< double > b( dim, 0.0 );
+  vnl_vector< double > k( numBasis );
+
+  double rTotal = 0.0; // Will be used to estimate alpha for smoothing
+  for ( unsigned int i=0; i<numPoints; i++ )
+    {
+    double x = this->m_SurfacePoints[i][0];
+    double y = this->m_SurfacePoints[i][1];
+    double z = this->m_SurfacePoints[i][2];
+
+    for ( unsigned int j=0; j<numCenters; j++ )
+      {
+      double r = vcl_sqrt( (x-this->m_KernelCenters[j][0])*(x-this->m_KernelCenters[j][0]) +
+                           (y-this->m_KernelCenters[j][1])*(y-this->m_KernelCenters[j][1]) );
+      rTotal += r;
+
+      k[j] = ( r == 0.0 ) ? 0.0 : r*r*vcl_log10( r );
+      }
+    k[numCenters]   = 1.0;
+    k[numCenters+1] = x;
+    k[numCenters+2] = y;
+
+    double g = 1.0;
+    if ( useWeights && minWeight > 0.0 )
+      {
+      g = 1.0/std::max( this->m_SurfacePointWeights[i], minWeight );
+      }
+
+    // Upper triangle only; mirrored below
+    for ( unsigned int j=0; j<numBasis; j++ )
+      {
+      double gk = g*k[j];
+      double* row = A[j];
+      for ( unsigned int l=j; l<numBasis; l++ )
+        {
+        row[l] += gk*k[l];
+        }
+      b[j] += gk*z;
+      }
+    }
+
+  for ( unsigned int j=0; j<numBasis; j++ )
+    {
+    for ( unsigned int l=0; l<j; l++ )
+      {
+      A[j][l] = A[l][j];
+      }
+    }
+
+  double alpha = rTotal/(static_cast< double >( numPoints )*static_cast< double >( numCenters ));
+  double mu    = useWeights ? this->m_Lambda : this->m_Lambda*alpha*alpha;
+
+  // Smoothing term and the side conditions on w
+  for ( unsigned int j=0; j<numCenters; j++ )
+    {
+    for ( unsigned int l=0; l<numCenters; l++ )
+      {
+      double r = vcl_sqrt( (this->m_KernelCenters[j][0]-this->m_KernelCenters[l][0])*(this->m_KernelCenters[j][0]-this->m_KernelCenters[l][0]) +
+                           (this->m_KernelCenters[j][1]-this->m_KernelCenters[l][1])*(this->m_KernelCenters[j][1]-this->m_KernelCenters[l][1]) );
+
+      if ( r != 0.0 )
+        {
+        A[j][l] += mu*r*r*vcl_log10( r );
+        }
+      }
+
+    A[j][numBasis]   = A[numBasis][j]   = 1.0;
+    A[j][numBasis+1] = A[numBasis+1][j] = this->m_KernelCenters[j][0];
+    A[j][numBasis+2] = A[numBasis+2][j] = this->m_KernelCenters[j][1];
+    }
+
+  // The kernel entries are many orders of magnitude larger than the
+  // affine ones, so scale rows and columns to unit diagonal before solving
+  vnl_vector< double > scale( dim, 1.0 );
+  for ( unsigned int j=0; j<numBasis; j++ )
+    {
+    if ( A[j][j] > 0.0 )
+      {
+      scale[j] = 1.0/vcl_sqrt( A[j][j] );
+      }
+    }
+  for ( unsigned int j=0; j<dim; j++ )
+    {
+    for ( unsigned int l=0; l<dim; l++ )
+      {
+      A[j][l] *= scale[j]*scale[l];
+      }
+    b[j] *= scale[j];
+    }
+
+  vnl_svd< double > svd( A );
+    svd.zero_out_relative( 1e-12 );
+
+  vnl_vector< double > x = svd.solve( b );
+
+  for ( unsigned int j=0; j<numCenters; j++ )
+    {
+    this->m_w.push_back( scale[j]*x[j] );
+    }
+
+  this->m_a.push_back( scale[numCenters]*x[numCenters] );
+  this->m_a.push_back( scale[numCenters+1]*x[numCenters+1] );
+  this->m_a.push_back( scale[numCenters+2]*x[numCenters+2] );
+}
+
+
+void cipThinPlateSplineSurface::GetDifferenceToExactSurface( double& rmsDifference, double& maxDifference ) const
+{
+  rmsDifference = 0.0;
+  maxDifference = 0.0;
+
+  if ( this->m_KernelCenters.size() == this->m_SurfacePoints.size() )
+    {
+    return;
+    }
+
+  cipThinPlateSplineSurface exact;
+    exact.m_SurfacePoints       = this->m_SurfacePoints;
+    exact.m_SurfacePointWeights = this->m_SurfacePointWeights;
+    exact.m_Lambda              = this->m_Lambda;
+    exact.m_NumberSurfacePoints = this->m_NumberSurfacePoints;
+    exact.ComputeThinPlateSplineVectors();
+
+  double sumSquares = 0.0;
+  for ( unsigned int i=0; i<this->m_SurfacePoints.size(); i++ )
+    {
+    double x = this->m_SurfacePoints[i][0];
+    double y = this->m_SurfacePoints[i][1];
+
+    double diff = vcl_fabs( this->GetSurfaceHeight( x, y ) - exact.GetSurfaceHeight( x, y ) );
+
+    sumSquares    += diff*diff;
+    maxDifference  = std::max( maxDifference, diff );
+    }
+
+  rmsDifference = vcl_sqrt( sumSquares/static_cast< double >( this->m_SurfacePoints.size() ) );
+}
+
+
+double cipThinPlateSplineSurface::GetSurfaceHeight( double x, double y ) const
+{
+  unsigned int numCenters = this->m_KernelCenters.size();
+
   double total = 0.0;
-  for ( unsigned int n=0; n<numPoints; n++ )
+  for ( unsigned int n=0; n<numCenters; n++ )
     {
-    double x2 = this->m_SurfacePoints[n][0];
-    double y2 = this->m_SurfacePoints[n][1];
+    double x2 = this->m_KernelCenters[n][0];
+    double y2 = this->m_KernelCenters[n][1];
     
     double r = vcl_sqrt( (x-x2)*(x-x2)+(y-y2)*(y-y2) );
 
@@ -276,8 +529,8 @@ void cipThinPlateSplineSurface::GetNonNormalizedSurfaceNormal( double x, double
 
   for ( unsigned int i=0; i<this->m_w.size(); i++ )
     {
-    double xDiff = x - this->m_SurfacePoints[i][0];
-    double yDiff = y - this->m_SurfacePoints[i][1];
+    double xDiff = x - this->m_KernelCenters[i][0];
+    double yDiff = y - this->m_KernelCenters[i][1];
 
     double r = vcl_sqrt( std::pow( xDiff, 2 ) + std::pow( yDiff, 2 ) );
 
@@ -299,24 +552,28 @@ void cipThinPlateSplineSurface::GetNonNormalizedSurfaceNormal( double x, double
 
 double cipThinPlateSplineSurface::GetBendingEnergy() const
 {
-  // Create the K matrix
-  unsigned int numPoints = this->m_SurfacePoints.size();
+  // Create the K matrix (among the kernel centers). Point weights only
+  // apply to the exact TPS, where the centers are the surface points
+  unsigned int numPoints = this->m_KernelCenters.size();
+
+  bool useWeights = ( this->m_SurfacePointWeights.size() > 0 && 
+                      numPoints == this->m_SurfacePoints.size() );
 
   vnl_matrix< double > K( numPoints, numPoints );
   for ( unsigned int i=0; i<numPoints; i++ )
     {
     for ( unsigned int j=0; j<numPoints; j++ )
       {
-      double x1 = this->m_SurfacePoints[i][0];
-      double y1 = this->m_SurfacePoints[i][1];
-      double x2 = this->m_SurfacePoints[j][0];
-      double y2 = this->m_SurfacePoints[j][1];
+      double x1 = this->m_KernelCenters[i][0];
+      double y1 = this->m_KernelCenters[i][1];
+      double x2 = this->m_KernelCenters[j][0];
+      double y2 = this->m_KernelCenters[j][1];
 
       double r = vcl_sqrt( (x1-x2)*(x1-x2) + (y1-y2)*(y1-y2) );
 
       if ( r==0 )
         {
-        if ( this->m_SurfacePointWeights.size() > 0 )
+        if ( useWeights )
           {
           if ( this->m_SurfacePointWeights[i] != 0 )
             {
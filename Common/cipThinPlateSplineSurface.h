@@ -4,6 +4,19 @@
  *  \brief This class is used to define a thin plate spline surface in
  *  3D given a set of 3D points
  *
+ *  By default the exact TPS is computed: every surface point is a kernel
+ *  center and a dense (N+3)x(N+3) system is solved, which is O(N^3) time
+ *  and O(N^2) memory. For dense point clouds (e.g. fissure particles) a
+ *  low-rank solver can be selected with 'SetNumberOfKernelCenters': a
+ *  subset of the points is chosen by farthest point sampling in the x-y
+ *  plane, and the kernel weights at those centers (plus the affine part)
+ *  are fit to all points by regularized least squares. This is O(N*M^2)
+ *  time and O(M^2) memory for M centers, and evaluating the surface
+ *  costs O(M) instead of O(N). Without point weights the smoothing scale
+ *  (the mean distance between points) is estimated from the distances to
+ *  the centers. 'GetDifferenceToExactSurface' reports how far the
+ *  approximation is from the exact TPS; it runs the exact solve.
+ *
  *  $Date: 2012-09-19 21:56:40 -0400 (Wed, 19 Sep 2012) $
  *  $Revision: 282 $
  *  $Author: jross $
@@ -39,6 +52,24 @@ public:
   /**  */
   void ComputeThinPlateSplineVectors();
 
+  /** Number of kernel centers used by the low-rank solver. 0 (the
+   *  default) computes the exact TPS with every surface point as a
+   *  center; the exact TPS is also used whenever there are no more
+   *  surface points than requested centers. */
+  void SetNumberOfKernelCenters( unsigned int );
+
+  /** */
+  unsigned int GetNumberOfKernelCenters() const
+    {
+      return m_NumberOfKernelCenters;
+    }
+
+  /** Compute the exact TPS through the same points (with the same lambda
+   *  and point weights) and compare its heights with the heights of this
+   *  surface at every surface point. Both differences are 0 when the
+   *  exact solver is in use. Note that this performs the dense solve. */
+  void GetDifferenceToExactSurface( double& rmsDifference, double& maxDifference ) const;
+
   /**  */
   void GetSurfaceNormal( double x, double y, cip::VectorType& normal ) const;
 
@@ -78,6 +109,14 @@ public:
       return m_SurfacePoints;
     };
 
+  /** The points at which the kernels weighted by the w vector are
+   *  centered. These are the surface points unless the low-rank solver is
+   *  in use. */
+  const std::vector< cip::PointType >& GetKernelCenters() const
+    {
+      return m_KernelCenters;
+    };
+
   /** */
   const unsigned int GetNumberSurfacePoints() const
     {
@@ -85,12 +124,17 @@ public:
     };
 
 private:
+  void ComputeLowRankThinPlateSplineVectors();
+  void SelectKernelCenters();
+
   std::vector< double >         m_a;
   std::vector< double >         m_w;
   std::vector< cip::PointType > m_SurfacePoints;
+  std::vector< cip::PointType > m_KernelCenters;
   std::vector< double >         m_SurfacePointWeights;
   double m_Lambda;
   unsigned int m_NumberSurfacePoints;
+  unsigned int m_NumberOfKernelCenters;
 };
 
 #endif
@@ -0,0 +1,305 @@
+#include "cipThinPlateSplineSurfaceDistanceCalculator.h"
+#include "cipExceptionObject.h"
+#include "cipInstrumentation.h"
+#include "cipNewtonOptimizer.h"
+#include "cipParticleToThinPlateSplineSurfaceMetric.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+cipThinPlateSplineSurfaceDistanceCalculator::cipThinPlateSplineSurfaceDistanceCalculator( const cipThinPlateSplineSurface& tps )
+  : m_Surface( tps )
+{
+  this->m_NumberOfThreads = itk::MultiThreader::GetGlobalDefaultNumberOfThreads();
+  this->m_UseWarmStarts   = true;
+
+  this->BuildSurfacePointGrid();
+}
+
+
+void cipThinPlateSplineSurfaceDistanceCalculator::SetNumberOfThreads( unsigned int numberOfThreads )
+{
+  this->m_NumberOfThreads = std::max( numberOfThreads, 1u );
+}
+
+
+void cipThinPlateSplineSurfaceDistanceCalculator::BuildSurfacePointGrid()
+{
+  const std::vector< cip::PointType >& surfacePoints = this->m_Surface.GetSurfacePoints();
+
+  this->m_GridCellStarts.clear();
+  this->m_GridPoints.clear();
+  if ( surfacePoints.empty() )
+    {
+    return;
+    }
+
+  double upper[2];
+  for ( unsigned int d=0; d<2; d++ )
+    {
+    this->m_GridOrigin[d] = surfacePoints[0][d];
+    upper[d]              = surfacePoints[0][d];
+    }
+  for ( unsigned int i=1; i<surfacePoints.size(); i++ )
+    {
+    for ( unsigned int d=0; d<2; d++ )
+      {
+      this->m_GridOrigin[d] = std::min( this->m_GridOrigin[d], surfacePoints[i][d] );
+      upper[d]              = std::max( upper[d], surfacePoints[i][d] );
+      }
+    }
+
+  // Aim for a couple of points per cell. The second bound keeps the
+  // number of cells in check when the points are (nearly) collinear.
+  double numPoints = static_cast< double >( surfacePoints.size() );
+  double extent[2];
+    extent[0] = upper[0] - this->m_GridOrigin[0];
+    extent[1] = upper[1] - this->m_GridOrigin[1];
+
+  this->m_GridSpacing = std::max( std::sqrt( 2.0*extent[0]*extent[1]/numPoints ),
+                                  2.0*std::max( extent[0], extent[1] )/numPoints );
+  this->m_GridSpacing = std::max( this->m_GridSpacing, 1e-3 );
+  for ( unsigned int d=0; d<2; d++ )
+    {
+    this->m_GridSize[d] = static_cast< unsigned int >( (upper[d] - this->m_GridOrigin[d])/this->m_GridSpacing ) + 1;
+    }
+
+  // Bucket the points by cell (counting sort)
+  std::vector< unsigned int > cells( surfacePoints.size() );
+  this->m_GridCellStarts.assign( this->m_GridSize[0]*this->m_GridSize[1] + 1, 0 );
+  for ( unsigned int i=0; i<surfacePoints.size(); i++ )
+    {
+    unsigned int cx = static_cast< unsigned int >( (surfacePoints[i][0] - this->m_GridOrigin[0])/this->m_GridSpacing );
+    unsigned int cy = static_cast< unsigned int >( (surfacePoints[i][1] - this->m_GridOrigin[1])/this->m_GridSpacing );
+    cells[i] = std::min( cy, this->m_GridSize[1] - 1 )*this->m_GridSize[0] + std::min( cx, this->m_GridSize[0] - 1 );
+    this->m_GridCellStarts[cells[i]+1]++;
+    }
+  for ( unsigned int c=0; c+1<this->m_GridCellStarts.size(); c++ )
+    {
+    this->m_GridCellStarts[c+1] += this->m_GridCellStarts[c];
+    }
+
+  std::vector< unsigned int > next( this->m_GridCellStarts.begin(), this->m_GridCellStarts.end() - 1 );
+  this->m_GridPoints.resize( surfacePoints.size() );
+  for ( unsigned int i=0; i<surfacePoints.size(); i++ )
+    {
+    this->m_GridPoints[next[cells[i]]++] = i;
+    }
+}
+
+
+unsigned int cipThinPlateSplineSurfaceDistanceCalculator::GetClosestSurfacePoint( const cip::PointType& point ) const
+{
+  const std::vector< cip::PointType >& surfacePoints = this->m_Surface.GetSurfacePoints();
+
+  // The cell of the query, clamped to the grid
+  int cell[2];
+  for ( unsigned int d=0; d<2; d++ )
+    {
+    double c = std::floor( (point[d] - this->m_GridOrigin[d])/this->m_GridSpacing );
+    c = std::max( 0.0, std::min( c, static_cast< double >( this->m_GridSize[d] - 1 ) ) );
+    cell[d] = static_cast< int >( c );
+    }
+
+  // Search rings of cells around the query's cell. The x-y distance to
+  // ring 'ring' is a lower bound on the 3D distance to its points, so the
+  // search stops once it exceeds the best distance found.
+  unsigned int closest  = 0;
+  double       bestDist = DBL_MAX;
+  int          maxRing  = static_cast< int >( std::max( this->m_GridSize[0], this->m_GridSize[1] ) );
+  for ( int ring=0; ring<=maxRing; ring++ )
+    {
+    if ( ring > 1 )
+      {
+      double ringDist = static_cast< double >( ring - 1 )*this->m_GridSpacing;
+      if ( ringDist*ringDist > bestDist )
+        {
+        break;
+        }
+      }
+
+    int cyStart = std::max( cell[1] - ring, 0 );
+    int cyEnd   = std::min( cell[1] + ring, static_cast< int >( this->m_GridSize[1] ) - 1 );
+    for ( int cy=cyStart; cy<=cyEnd; cy++ )
+      {
+      // Only the cells on the ring itself: the whole row at the top and
+      // bottom of the ring, its two ends elsewhere
+      int cxStep = ( std::abs( cy - cell[1] ) == ring ) ? 1 : std::max( 2*ring, 1 );
+      for ( int cx=cell[0]-ring; cx<=cell[0]+ring; cx+=cxStep )
+        {
+        if ( cx < 0 || cx >= static_cast< int >( this->m_GridSize[0] ) )
+          {
+          continue;
+          }
+
+        unsigned int c = cy*this->m_GridSize[0] + cx;
+        for ( unsigned int k=this->m_GridCellStarts[c]; k<this->m_GridCellStarts[c+1]; k++ )
+          {
+          const cip::PointType& s = surfacePoints[this->m_GridPoints[k]];
+          double dist = (s[0]-point[0])*(s[0]-point[0]) + (s[1]-point[1])*(s[1]-point[1]) +
+            (s[2]-point[2])*(s[2]-point[2]);
+          if ( dist < bestDist )
+            {
+            bestDist = dist;
+            closest  = this->m_GridPoints[k];
+            }
+          }
+        }
+      }
+    }
+
+  return closest;
+}
+
+
+void cipThinPlateSplineSurfaceDistanceCalculator::ComputeDistances( const std::vector< cip::PointType >& points,
+                                                                    std::vector< double >& distances,
+                                                                    std::vector< cip::PointType >* closestPoints,
+                                                                    const std::vector< cip::PointType >* startPoints ) const
+{
+  if ( startPoints != NULL && startPoints->size() != points.size() )
+    {
+    throw cip::ExceptionObject( __FILE__, __LINE__, "cipThinPlateSplineSurfaceDistanceCalculator::ComputeDistances()",
+                                "There must be one start point per point" );
+    }
+
+  cip::ScopedTimer timer( "cipThinPlateSplineSurfaceDistanceCalculator::ComputeDistances" );
+    timer.AddParticles( points.size() );
+
+  distances.resize( points.size() );
+  if ( closestPoints != NULL )
+    {
+    closestPoints->assign( points.size(), cip::PointType( 3, 0.0 ) );
+    }
+  if ( points.empty() )
+    {
+    return;
+    }
+
+  // Blocks are contiguous so that consecutive (usually neighboring)
+  // points can warm start each other
+  THREADSTRUCT str;
+    str.calculator     = this;
+    str.points         = &points;
+    str.distances      = &distances;
+    str.closestPoints  = closestPoints;
+    str.startPoints    = startPoints;
+    str.numberOfBlocks = std::min( this->m_NumberOfThreads, static_cast< unsigned int >( points.size() ) );
+
+  itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+    threader->SetNumberOfThreads( str.numberOfBlocks );
+    threader->SetSingleMethod( ComputeDistancesThreaderCallback, &str );
+    threader->SingleMethodExecute();
+}
+
+
+ITK_THREAD_RETURN_TYPE cipThinPlateSplineSurfaceDistanceCalculator::ComputeDistancesThreaderCallback( void* arg )
+{
+  itk::MultiThreader::ThreadInfoStruct* info = static_cast< itk::MultiThreader::ThreadInfoStruct* >( arg );
+  THREADSTRUCT* str = static_cast< THREADSTRUCT* >( info->UserData );
+
+  // The threader may have been given fewer threads than requested
+  unsigned int numBlocks = std::min( str->numberOfBlocks, static_cast< unsigned int >( info->NumberOfThreads ) );
+  if ( info->ThreadID >= numBlocks )
+    {
+    return ITK_THREAD_RETURN_VALUE;
+    }
+
+  std::size_t numPoints = str->points->size();
+  unsigned int start = static_cast< unsigned int >( numPoints*info->ThreadID/numBlocks );
+  unsigned int end   = static_cast< unsigned int >( numPoints*(info->ThreadID + 1)/numBlocks );
+
+  str->calculator->ComputeBlockDistances( *str, start, end );
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+
+void cipThinPlateSplineSurfaceDistanceCalculator::ComputeBlockDistances( const THREADSTRUCT& str, unsigned int start,
+                                                                         unsigned int end ) const
+{
+  const std::vector< cip::PointType >& surfacePoints = this->m_Surface.GetSurfacePoints();
+
+  cipParticleToThinPlateSplineSurfaceMetric metric;
+    metric.SetThinPlateSplineSurfaceReference( &this->m_Surface );
+
+  cipNewtonOptimizer< 2 > optimizer;
+
+  cipNewtonOptimizer< 2 >::PointType domainParams( 2, 2 );
+  cipNewtonOptimizer< 2 >::PointType optimalParams( 2, 2 );
+  cipNewtonOptimizer< 2 >::PointType candidate( 2, 2 );
+
+  bool havePrevious = false;
+  cipNewtonOptimizer< 2 >::PointType previousParams( 2, 2 );
+
+  for ( unsigned int i=start; i<end; i++ )
+    {
+    const cip::PointType& point = (*str.points)[i];
+
+    metric.SetParticle( point );
+
+    domainParams[0] = point[0];
+    domainParams[1] = point[1];
+
+    double bestValue = 0.0;
+    if ( this->m_UseWarmStarts || str.startPoints != NULL )
+      {
+      bestValue = metric.GetValue( &domainParams );
+      }
+
+    if ( str.startPoints != NULL )
+      {
+      candidate[0] = (*str.startPoints)[i][0];
+      candidate[1] = (*str.startPoints)[i][1];
+
+      double value = metric.GetValue( &candidate );
+      if ( value < bestValue )
+        {
+        bestValue    = value;
+        domainParams = candidate;
+        }
+      }
+
+    if ( this->m_UseWarmStarts )
+      {
+      if ( !surfacePoints.empty() )
+        {
+        // Surface points may be kernel centers, where the metric's
+        // derivatives are undefined, so start just off of them
+        const cip::PointType& closest = surfacePoints[this->GetClosestSurfacePoint( point )];
+        candidate[0] = closest[0] + 1e-3;
+        candidate[1] = closest[1] + 1e-3;
+
+        double value = metric.GetValue( &candidate );
+        if ( value < bestValue )
+          {
+          bestValue    = value;
+          domainParams = candidate;
+          }
+        }
+      if ( havePrevious && metric.GetValue( &previousParams ) < bestValue )
+        {
+        domainParams = previousParams;
+        }
+      }
+
+    optimizer.SetMetric( metric );
+    optimizer.SetInitialParameters( &domainParams );
+    optimizer.Update();
+    optimizer.GetOptimalParameters( &optimalParams );
+
+    (*str.distances)[i] = std::sqrt( optimizer.GetOptimalValue() );
+
+    if ( str.closestPoints != NULL )
+      {
+      cip::PointType& tpsPoint = (*str.closestPoints)[i];
+        tpsPoint[0] = optimalParams[0];
+        tpsPoint[1] = optimalParams[1];
+        tpsPoint[2] = this->m_Surface.GetSurfaceHeight( optimalParams[0], optimalParams[1] );
+      }
+
+    previousParams = optimalParams;
+    havePrevious   = true;
+    }
+}
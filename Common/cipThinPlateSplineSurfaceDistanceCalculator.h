@@ -0,0 +1,98 @@
+/**
+ *  \class cipThinPlateSplineSurfaceDistanceCalculator
+ *  \ingroup common
+ *  \brief Computes the distances from many points to one thin plate
+ *  spline (TPS) surface, and the closest points on the surface.
+ *
+ *  Every point is handled like cip::GetDistanceToThinPlateSplineSurface
+ *  does (a Newton search over the surface domain with
+ *  cipParticleToThinPlateSplineSurfaceMetric), but the surface is
+ *  referenced rather than copied for every point, and the points are
+ *  split into contiguous blocks that are processed in parallel.
+ *
+ *  With warm starts (the default) each search starts from the best of
+ *  three candidate domain locations: the point's own x-y location, the
+ *  x-y location of the closest surface point, and the solution found for
+ *  the previous point of the block (neighboring particles usually have
+ *  neighboring solutions). The candidate with the smallest distance to
+ *  the surface is used. Without warm starts every search starts at the
+ *  point's x-y location, exactly as in
+ *  cip::GetDistanceToThinPlateSplineSurface.
+ *
+ *  The surface must outlive the calculator.
+ */
+
+#ifndef __cipThinPlateSplineSurfaceDistanceCalculator_h
+#define __cipThinPlateSplineSurfaceDistanceCalculator_h
+
+#include "cipThinPlateSplineSurface.h"
+#include "cipChestConventions.h"
+#include "itkMultiThreader.h"
+
+#include <vector>
+
+class cipThinPlateSplineSurfaceDistanceCalculator
+{
+public:
+  cipThinPlateSplineSurfaceDistanceCalculator( const cipThinPlateSplineSurface& );
+  ~cipThinPlateSplineSurfaceDistanceCalculator() {};
+
+  /** Defaults to ITK's global default number of threads */
+  void SetNumberOfThreads( unsigned int );
+  unsigned int GetNumberOfThreads() const
+    {
+      return m_NumberOfThreads;
+    }
+
+  /** Defaults to true */
+  void SetUseWarmStarts( bool useWarmStarts )
+    {
+      m_UseWarmStarts = useWarmStarts;
+    }
+  bool GetUseWarmStarts() const
+    {
+      return m_UseWarmStarts;
+    }
+
+  /** Compute the distance from each of 'points' to the surface. If
+   *  'closestPoints' is not NULL, it is set to the closest point on the
+   *  surface for each of 'points'. If 'startPoints' is not NULL, the x-y
+   *  location of each of its points (e.g. a closest point looked up in a
+   *  cipThinPlateSplineSurfaceDistanceMap) is one more candidate start
+   *  for the search of the corresponding point. */
+  void ComputeDistances( const std::vector< cip::PointType >& points, std::vector< double >& distances,
+                         std::vector< cip::PointType >* closestPoints = NULL,
+                         const std::vector< cip::PointType >* startPoints = NULL ) const;
+
+private:
+  struct THREADSTRUCT
+  {
+    const cipThinPlateSplineSurfaceDistanceCalculator*  calculator;
+    const std::vector< cip::PointType >*                points;
+    std::vector< double >*                              distances;
+    std::vector< cip::PointType >*                      closestPoints;
+    const std::vector< cip::PointType >*                startPoints;
+    unsigned int                                        numberOfBlocks;
+  };
+
+  static ITK_THREAD_RETURN_TYPE ComputeDistancesThreaderCallback( void* );
+
+  void ComputeBlockDistances( const THREADSTRUCT&, unsigned int, unsigned int ) const;
+
+  /** Uniform grid over the x-y locations of the surface points, used to
+   *  find the closest surface point to a query point */
+  void BuildSurfacePointGrid();
+  unsigned int GetClosestSurfacePoint( const cip::PointType& ) const;
+
+  const cipThinPlateSplineSurface&   m_Surface;
+  unsigned int                       m_NumberOfThreads;
+  bool                               m_UseWarmStarts;
+
+  double                             m_GridOrigin[2];
+  double                             m_GridSpacing;
+  unsigned int                       m_GridSize[2];
+  std::vector< unsigned int >        m_GridCellStarts;
+  std::vector< unsigned int >        m_GridPoints;
+};
+
+#endif
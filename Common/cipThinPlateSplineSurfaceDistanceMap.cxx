@@ -0,0 +1,561 @@
+#include "cipThinPlateSplineSurfaceDistanceMap.h"
+#include "cipExceptionObject.h"
+#include "cipNewtonOptimizer.h"
+#include "cipParticleToThinPlateSplineSurfaceMetric.h"
+#include "cipInstrumentation.h"
+#include "vnl/vnl_math.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <queue>
+
+namespace
+{
+const unsigned int UNREACHED = std::numeric_limits< unsigned int >::max();
+
+/** A band voxel on the Dijkstra front */
+struct FRONTVOXEL
+{
+  float         squaredDistance;
+  unsigned int  column;
+  long          slice;
+
+  bool operator>( const FRONTVOXEL& other ) const
+  {
+    return squaredDistance > other.squaredDistance;
+  }
+};
+}
+
+
+cipThinPlateSplineSurfaceDistanceMap::cipThinPlateSplineSurfaceDistanceMap( const cipThinPlateSplineSurface& tps )
+  : m_Surface( tps )
+{
+  this->m_HasGrid          = false;
+  this->m_BandWidth        = 10.0;
+  this->m_RefineWithNewton = false;
+  this->m_NumberOfThreads  = itk::MultiThreader::GetGlobalDefaultNumberOfThreads();
+
+  for ( unsigned int d=0; d<3; d++ )
+    {
+    this->m_Origin[d]  = 0.0;
+    this->m_Spacing[d] = 1.0;
+    this->m_Size[d]    = 0;
+    }
+}
+
+
+void cipThinPlateSplineSurfaceDistanceMap::SetReferenceImage( const itk::ImageBase< 3 >* image )
+{
+  itk::ImageBase< 3 >::DirectionType identity;
+    identity.SetIdentity();
+
+  if ( image->GetDirection() != identity )
+    {
+    throw cip::ExceptionObject( __FILE__, __LINE__, "cipThinPlateSplineSurfaceDistanceMap::SetReferenceImage()",
+                                "The reference image must have an identity direction" );
+    }
+
+  const itk::ImageRegion< 3 >& region = image->GetBufferedRegion();
+
+  for ( unsigned int d=0; d<3; d++ )
+    {
+    this->m_Spacing[d] = image->GetSpacing()[d];
+    this->m_Origin[d]  = image->GetOrigin()[d] + static_cast< double >( region.GetIndex()[d] )*this->m_Spacing[d];
+    this->m_Size[d]    = region.GetSize()[d];
+    }
+  this->m_HasGrid = true;
+}
+
+
+void cipThinPlateSplineSurfaceDistanceMap::SetNumberOfThreads( unsigned int numberOfThreads )
+{
+  this->m_NumberOfThreads = std::max( numberOfThreads, 1u );
+}
+
+
+void cipThinPlateSplineSurfaceDistanceMap::Update()
+{
+  if ( !this->m_HasGrid )
+    {
+    throw cip::ExceptionObject( __FILE__, __LINE__, "cipThinPlateSplineSurfaceDistanceMap::Update()",
+                                "No reference image set" );
+    }
+  if ( this->m_Surface.GetNumberSurfacePoints() == 0 )
+    {
+    throw cip::ExceptionObject( __FILE__, __LINE__, "cipThinPlateSplineSurfaceDistanceMap::Update()",
+                                "The surface has no points" );
+    }
+
+  cip::ScopedTimer timer( "cipThinPlateSplineSurfaceDistanceMap::Update" );
+
+  unsigned int numColumns = this->m_Size[0]*this->m_Size[1];
+
+  this->m_Heights.resize( numColumns );
+  this->m_Normals.resize( 3*numColumns );
+
+  // Sampling the surface (two O(number of kernels) evaluations per
+  // column) is the bulk of the work, so it is split over blocks of rows
+  THREADSTRUCT str;
+    str.map            = this;
+    str.numberOfBlocks = std::max( std::min( this->m_NumberOfThreads, this->m_Size[1] ), 1u );
+
+  itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+    threader->SetNumberOfThreads( str.numberOfBlocks );
+    threader->SetSingleMethod( SampleSurfaceThreaderCallback, &str );
+    threader->SingleMethodExecute();
+
+  this->ComputeBandExtents();
+  this->PropagateSamples();
+
+  timer.AddVoxels( this->m_Distances.size() );
+}
+
+
+ITK_THREAD_RETURN_TYPE cipThinPlateSplineSurfaceDistanceMap::SampleSurfaceThreaderCallback( void* arg )
+{
+  itk::MultiThreader::ThreadInfoStruct* info = static_cast< itk::MultiThreader::ThreadInfoStruct* >( arg );
+  THREADSTRUCT* str = static_cast< THREADSTRUCT* >( info->UserData );
+
+  // The threader may have been given fewer threads than requested
+  unsigned int numBlocks = std::min( str->numberOfBlocks, static_cast< unsigned int >( info->NumberOfThreads ) );
+  if ( info->ThreadID >= numBlocks )
+    {
+    return ITK_THREAD_RETURN_VALUE;
+    }
+
+  unsigned int numRows  = str->map->m_Size[1];
+  unsigned int firstRow = numRows*info->ThreadID/numBlocks;
+  unsigned int lastRow  = numRows*(info->ThreadID + 1)/numBlocks;
+
+  str->map->SampleSurface( firstRow, lastRow );
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+
+void cipThinPlateSplineSurfaceDistanceMap::SampleSurface( unsigned int firstRow, unsigned int lastRow )
+{
+  cip::VectorType normal( 3 );
+
+  for ( unsigned int j=firstRow; j<lastRow; j++ )
+    {
+    double y = this->m_Origin[1] + static_cast< double >( j )*this->m_Spacing[1];
+
+    for ( unsigned int i=0; i<this->m_Size[0]; i++ )
+      {
+      double x = this->m_Origin[0] + static_cast< double >( i )*this->m_Spacing[0];
+      unsigned int c = j*this->m_Size[0] + i;
+
+      this->m_Heights[c] = this->m_Surface.GetSurfaceHeight( x, y );
+
+      // The normal is undefined at a kernel center, so step off of it
+      this->m_Surface.GetSurfaceNormal( x, y, normal );
+      if ( !( vnl_math_isfinite( normal[0] ) && vnl_math_isfinite( normal[1] ) ) )
+        {
+        this->m_Surface.GetSurfaceNormal( x + 1e-6*this->m_Spacing[0], y, normal );
+        }
+
+      this->m_Normals[3*c]   = normal[0];
+      this->m_Normals[3*c+1] = normal[1];
+      this->m_Normals[3*c+2] = normal[2];
+      }
+    }
+}
+
+
+void cipThinPlateSplineSurfaceDistanceMap::ComputeBandExtents()
+{
+  // A voxel within the band width of a sample lies between the lowest and
+  // highest samples within the band width horizontally (less and plus the
+  // band width). These are found with a separable min / max filter over
+  // a square window of columns.
+  unsigned int numColumns = this->m_Size[0]*this->m_Size[1];
+  long radius[2];
+  for ( unsigned int d=0; d<2; d++ )
+    {
+    radius[d] = static_cast< long >( std::ceil( this->m_BandWidth/this->m_Spacing[d] ) );
+    }
+
+  std::vector< double > rowMin( numColumns );
+  std::vector< double > rowMax( numColumns );
+  for ( unsigned int j=0; j<this->m_Size[1]; j++ )
+    {
+    for ( long i=0; i<static_cast< long >( this->m_Size[0] ); i++ )
+      {
+      long first = std::max( i - radius[0], 0L );
+      long last  = std::min( i + radius[0], static_cast< long >( this->m_Size[0] ) - 1 );
+
+      double hMin = this->m_Heights[j*this->m_Size[0] + first];
+      double hMax = hMin;
+      for ( long n=first+1; n<=last; n++ )
+        {
+        hMin = std::min( hMin, this->m_Heights[j*this->m_Size[0] + n] );
+        hMax = std::max( hMax, this->m_Heights[j*this->m_Size[0] + n] );
+        }
+      rowMin[j*this->m_Size[0] + i] = hMin;
+      rowMax[j*this->m_Size[0] + i] = hMax;
+      }
+    }
+
+  this->m_ColumnStarts.assign( numColumns + 1, 0 );
+  this->m_FirstSlice.assign( numColumns, 0 );
+  for ( long j=0; j<static_cast< long >( this->m_Size[1] ); j++ )
+    {
+    long first = std::max( j - radius[1], 0L );
+    long last  = std::min( j + radius[1], static_cast< long >( this->m_Size[1] ) - 1 );
+
+    for ( unsigned int i=0; i<this->m_Size[0]; i++ )
+      {
+      double hMin = rowMin[first*this->m_Size[0] + i];
+      double hMax = rowMax[first*this->m_Size[0] + i];
+      for ( long n=first+1; n<=last; n++ )
+        {
+        hMin = std::min( hMin, rowMin[n*this->m_Size[0] + i] );
+        hMax = std::max( hMax, rowMax[n*this->m_Size[0] + i] );
+        }
+
+      double kMin = std::ceil( (hMin - this->m_BandWidth - this->m_Origin[2])/this->m_Spacing[2] );
+      double kMax = std::floor( (hMax + this->m_BandWidth - this->m_Origin[2])/this->m_Spacing[2] );
+      kMin = std::max( kMin, 0.0 );
+      kMax = std::min( kMax, static_cast< double >( this->m_Size[2] ) - 1.0 );
+
+      unsigned int c = j*this->m_Size[0] + i;
+      this->m_FirstSlice[c]     = static_cast< long >( kMin );
+      this->m_ColumnStarts[c+1] = ( kMax >= kMin ) ? static_cast< unsigned int >( kMax - kMin + 1.0 ) : 0;
+      }
+    }
+
+  for ( unsigned int c=0; c<numColumns; c++ )
+    {
+    this->m_ColumnStarts[c+1] += this->m_ColumnStarts[c];
+    }
+}
+
+
+long cipThinPlateSplineSurfaceDistanceMap::GetBandIndex( unsigned int column, long k ) const
+{
+  long offset = k - this->m_FirstSlice[column];
+  if ( offset < 0 || offset >= static_cast< long >( this->m_ColumnStarts[column+1] - this->m_ColumnStarts[column] ) )
+    {
+    return -1;
+    }
+
+  return static_cast< long >( this->m_ColumnStarts[column] ) + offset;
+}
+
+
+void cipThinPlateSplineSurfaceDistanceMap::PropagateSamples()
+{
+  unsigned int numColumns = this->m_Size[0]*this->m_Size[1];
+  unsigned int numVoxels  = this->m_ColumnStarts[numColumns];
+
+  // During the propagation 'm_Distances' holds the squared distance of a
+  // voxel to its closest sample
+  this->m_Distances.assign( numVoxels, std::numeric_limits< float >::max() );
+  this->m_Samples.assign( numVoxels, UNREACHED );
+
+  double maxSquaredDistance = this->m_BandWidth*this->m_BandWidth;
+
+  std::priority_queue< FRONTVOXEL, std::vector< FRONTVOXEL >, std::greater< FRONTVOXEL > > front;
+
+  // Every sample starts the front at the voxel of its column closest to
+  // it
+  for ( unsigned int c=0; c<numColumns; c++ )
+    {
+    double k = std::floor( (this->m_Heights[c] - this->m_Origin[2])/this->m_Spacing[2] + 0.5 );
+    k = std::max( 0.0, std::min( k, static_cast< double >( this->m_Size[2] ) - 1.0 ) );
+
+    long index = this->GetBandIndex( c, static_cast< long >( k ) );
+    double dz  = this->m_Origin[2] + k*this->m_Spacing[2] - this->m_Heights[c];
+    if ( index >= 0 && dz*dz <= maxSquaredDistance )
+      {
+      this->m_Distances[index] = static_cast< float >( dz*dz );
+      this->m_Samples[index]   = c;
+
+      FRONTVOXEL voxel;
+        voxel.squaredDistance = static_cast< float >( dz*dz );
+        voxel.column          = c;
+        voxel.slice           = static_cast< long >( k );
+      front.push( voxel );
+      }
+    }
+
+  // Each voxel taken off the front offers its closest sample to its 26
+  // neighbors
+  while ( !front.empty() )
+    {
+    FRONTVOXEL voxel = front.top();
+    front.pop();
+
+    long index = this->GetBandIndex( voxel.column, voxel.slice );
+    if ( voxel.squaredDistance > this->m_Distances[index] )
+      {
+      continue;
+      }
+
+    unsigned int sample = this->m_Samples[index];
+    double s[3];
+      s[0] = this->m_Origin[0] + static_cast< double >( sample % this->m_Size[0] )*this->m_Spacing[0];
+      s[1] = this->m_Origin[1] + static_cast< double >( sample / this->m_Size[0] )*this->m_Spacing[1];
+      s[2] = this->m_Heights[sample];
+
+    long i = voxel.column % this->m_Size[0];
+    long j = voxel.column / this->m_Size[0];
+
+    for ( long dj=-1; dj<=1; dj++ )
+      {
+      if ( j + dj < 0 || j + dj >= static_cast< long >( this->m_Size[1] ) )
+        {
+        continue;
+        }
+      for ( long di=-1; di<=1; di++ )
+        {
+        if ( i + di < 0 || i + di >= static_cast< long >( this->m_Size[0] ) )
+          {
+          continue;
+          }
+
+        unsigned int column = (j + dj)*this->m_Size[0] + (i + di);
+        double px = this->m_Origin[0] + static_cast< double >( i + di )*this->m_Spacing[0] - s[0];
+        double py = this->m_Origin[1] + static_cast< double >( j + dj )*this->m_Spacing[1] - s[1];
+
+        for ( long dk=-1; dk<=1; dk++ )
+          {
+          long neighbor = this->GetBandIndex( column, voxel.slice + dk );
+          if ( neighbor < 0 || this->m_Samples[neighbor] == sample )
+            {
+            continue;
+            }
+
+          double pz = this->m_Origin[2] + static_cast< double >( voxel.slice + dk )*this->m_Spacing[2] - s[2];
+          double squaredDistance = px*px + py*py + pz*pz;
+          if ( squaredDistance <= maxSquaredDistance && squaredDistance < this->m_Distances[neighbor] )
+            {
+            this->m_Distances[neighbor] = static_cast< float >( squaredDistance );
+            this->m_Samples[neighbor]   = sample;
+
+            FRONTVOXEL next;
+              next.squaredDistance = static_cast< float >( squaredDistance );
+              next.column          = column;
+              next.slice           = voxel.slice + dk;
+            front.push( next );
+            }
+          }
+        }
+      }
+    }
+
+  // The final distance of a voxel is its signed distance to the tangent
+  // plane at its closest sample
+  for ( unsigned int c=0; c<numColumns; c++ )
+    {
+    double px = this->m_Origin[0] + static_cast< double >( c % this->m_Size[0] )*this->m_Spacing[0];
+    double py = this->m_Origin[1] + static_cast< double >( c / this->m_Size[0] )*this->m_Spacing[1];
+
+    for ( unsigned int index=this->m_ColumnStarts[c]; index<this->m_ColumnStarts[c+1]; index++ )
+      {
+      unsigned int sample = this->m_Samples[index];
+      if ( sample == UNREACHED )
+        {
+        continue;
+        }
+
+      long k = this->m_FirstSlice[c] + static_cast< long >( index - this->m_ColumnStarts[c] );
+      double pz = this->m_Origin[2] + static_cast< double >( k )*this->m_Spacing[2];
+
+      double sx = this->m_Origin[0] + static_cast< double >( sample % this->m_Size[0] )*this->m_Spacing[0];
+      double sy = this->m_Origin[1] + static_cast< double >( sample / this->m_Size[0] )*this->m_Spacing[1];
+
+      this->m_Distances[index] = static_cast< float >( (px - sx)*this->m_Normals[3*sample] +
+                                                       (py - sy)*this->m_Normals[3*sample+1] +
+                                                       (pz - this->m_Heights[sample])*this->m_Normals[3*sample+2] );
+      }
+    }
+}
+
+
+bool cipThinPlateSplineSurfaceDistanceMap::GetSignedDistance( const cip::PointType& point, double& distance,
+                                                              cip::VectorType* normal, cip::PointType* closestPoint ) const
+{
+  if ( this->m_Distances.empty() )
+    {
+    return false;
+    }
+
+  // The voxel at the lower corner of the cell containing 'point', and the
+  // interpolation weights
+  long   corner[3];
+  double fraction[3];
+  for ( unsigned int d=0; d<3; d++ )
+    {
+    double index = (point[d] - this->m_Origin[d])/this->m_Spacing[d];
+    if ( index < 0.0 || index > static_cast< double >( this->m_Size[d] - 1 ) )
+      {
+      return false;
+      }
+
+    corner[d]   = std::min( static_cast< long >( index ), std::max( static_cast< long >( this->m_Size[d] ) - 2, 0L ) );
+    fraction[d] = index - static_cast< double >( corner[d] );
+    }
+
+  // Interpolate the distances of 'point' to the tangent planes at the
+  // corners' samples, and the planes' normals
+  double planeDistance = 0.0;
+  double n[3] = { 0.0, 0.0, 0.0 };
+  for ( unsigned int v=0; v<8; v++ )
+    {
+    long   index[3];
+    double weight = 1.0;
+    for ( unsigned int d=0; d<3; d++ )
+      {
+      unsigned int bit = ( v >> d ) & 1;
+      index[d] = corner[d] + bit;
+      weight  *= bit ? fraction[d] : 1.0 - fraction[d];
+      }
+    if ( weight == 0.0 )
+      {
+      continue;
+      }
+
+    long bandIndex = this->GetBandIndex( index[1]*this->m_Size[0] + index[0], index[2] );
+    if ( bandIndex < 0 || this->m_Samples[bandIndex] == UNREACHED )
+      {
+      return false;
+      }
+
+    unsigned int sample = this->m_Samples[bandIndex];
+    double sx = this->m_Origin[0] + static_cast< double >( sample % this->m_Size[0] )*this->m_Spacing[0];
+    double sy = this->m_Origin[1] + static_cast< double >( sample / this->m_Size[0] )*this->m_Spacing[1];
+    const double* sn = &this->m_Normals[3*sample];
+
+    planeDistance += weight*( (point[0] - sx)*sn[0] + (point[1] - sy)*sn[1] + (point[2] - this->m_Heights[sample])*sn[2] );
+    n[0] += weight*sn[0];
+    n[1] += weight*sn[1];
+    n[2] += weight*sn[2];
+    }
+
+  double magnitude = std::sqrt( n[0]*n[0] + n[1]*n[1] + n[2]*n[2] );
+  n[0] /= magnitude;
+  n[1] /= magnitude;
+  n[2] /= magnitude;
+
+  cip::PointType closest( 3 );
+    closest[0] = point[0] - planeDistance*n[0];
+    closest[1] = point[1] - planeDistance*n[1];
+    closest[2] = point[2] - planeDistance*n[2];
+
+  if ( !this->m_RefineWithNewton )
+    {
+    distance = planeDistance;
+    if ( normal != NULL )
+      {
+      normal->resize( 3 );
+      (*normal)[0] = n[0];
+      (*normal)[1] = n[1];
+      (*normal)[2] = n[2];
+      }
+    if ( closestPoint != NULL )
+      {
+      *closestPoint = closest;
+      }
+
+    return true;
+    }
+
+  cipNewtonOptimizer< 2 >::PointType domainParams( 2, 2 );
+    domainParams[0] = closest[0];
+    domainParams[1] = closest[1];
+  cipNewtonOptimizer< 2 >::PointType optimalParams( 2, 2 );
+
+  cipParticleToThinPlateSplineSurfaceMetric metric;
+    metric.SetThinPlateSplineSurfaceReference( &this->m_Surface );
+    metric.SetParticle( point );
+
+  cipNewtonOptimizer< 2 > optimizer;
+    optimizer.SetMetric( metric );
+    optimizer.SetInitialParameters( &domainParams );
+    optimizer.Update();
+    optimizer.GetOptimalParameters( &optimalParams );
+
+  double height = this->m_Surface.GetSurfaceHeight( optimalParams[0], optimalParams[1] );
+
+  distance = std::sqrt( optimizer.GetOptimalValue() );
+  if ( point[2] < height )
+    {
+    distance = -distance;
+    }
+  if ( normal != NULL )
+    {
+    normal->resize( 3 );
+    this->m_Surface.GetSurfaceNormal( optimalParams[0], optimalParams[1], *normal );
+    }
+  if ( closestPoint != NULL )
+    {
+    closestPoint->resize( 3 );
+    (*closestPoint)[0] = optimalParams[0];
+    (*closestPoint)[1] = optimalParams[1];
+    (*closestPoint)[2] = height;
+    }
+
+  return true;
+}
+
+
+cipThinPlateSplineSurfaceDistanceMap::DistanceImageType::Pointer cipThinPlateSplineSurfaceDistanceMap::GetSignedDistanceImage() const
+{
+  DistanceImageType::SizeType size;
+  DistanceImageType::SpacingType spacing;
+  DistanceImageType::PointType origin;
+  for ( unsigned int d=0; d<3; d++ )
+    {
+    size[d]    = this->m_Size[d];
+    spacing[d] = this->m_Spacing[d];
+    origin[d]  = this->m_Origin[d];
+    }
+
+  DistanceImageType::Pointer image = DistanceImageType::New();
+    image->SetRegions( size );
+    image->SetSpacing( spacing );
+    image->SetOrigin( origin );
+    image->Allocate();
+
+  if ( this->m_ColumnStarts.empty() )
+    {
+    image->FillBuffer( 0.0 );
+    return image;
+    }
+
+  float* buffer = image->GetBufferPointer();
+  unsigned int numColumns = this->m_Size[0]*this->m_Size[1];
+  for ( unsigned int c=0; c<numColumns; c++ )
+    {
+    for ( unsigned int k=0; k<this->m_Size[2]; k++ )
+      {
+      float value;
+      long index = this->GetBandIndex( c, k );
+      if ( index >= 0 && this->m_Samples[index] != UNREACHED )
+        {
+        value = this->m_Distances[index];
+        }
+      else
+        {
+        double z = this->m_Origin[2] + static_cast< double >( k )*this->m_Spacing[2];
+        value = static_cast< float >( ( z < this->m_Heights[c] ) ? -this->m_BandWidth : this->m_BandWidth );
+        }
+
+      buffer[k*numColumns + c] = value;
+      }
+    }
+
+  return image;
+}
+
+
+unsigned int cipThinPlateSplineSurfaceDistanceMap::GetNumberOfBandVoxels() const
+{
+  return static_cast< unsigned int >( this->m_Samples.size() -
+                                      std::count( this->m_Samples.begin(), this->m_Samples.end(), UNREACHED ) );
+}
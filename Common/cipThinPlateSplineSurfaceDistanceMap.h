@@ -0,0 +1,137 @@
+/**
+ *  \class cipThinPlateSplineSurfaceDistanceMap
+ *  \ingroup common
+ *  \brief Narrow band signed distance map to a thin plate spline (TPS)
+ *  surface, rasterized on an image grid.
+ *
+ *  The surface is sampled once per x-y column of the grid (its height and
+ *  normal at the column's location). Every voxel within 'BandWidth' mm of
+ *  a sample is then assigned its closest sample by a Dijkstra (fast
+ *  marching) propagation outward from the samples, restricted to the band.
+ *  The distance of a voxel is its distance to the tangent plane of the
+ *  surface at its closest sample. Distances are positive above the surface
+ *  (greater z than the surface height) and negative below it.
+ *
+ *  Point queries interpolate the tangent plane distances of the eight
+ *  surrounding voxels, which costs a lookup instead of a Newton search.
+ *  With 'SetRefineWithNewton' the interpolated closest point is used to
+ *  start a Newton search (see cipParticleToThinPlateSplineSurfaceMetric),
+ *  which then converges in a couple of iterations. Queries outside the band
+ *  fail, and the caller should fall back to
+ *  cipThinPlateSplineSurfaceDistanceCalculator.
+ *
+ *  Voxel (i,j,k) is taken to be at origin + (i,j,k)*spacing, as it is
+ *  elsewhere in the lobe surface code, so the reference image must have
+ *  an identity direction. For many queries, looking them up without
+ *  refinement and passing the closest points as start points to
+ *  cipThinPlateSplineSurfaceDistanceCalculator refines them on all
+ *  threads. The surface must outlive the map.
+ */
+
+#ifndef __cipThinPlateSplineSurfaceDistanceMap_h
+#define __cipThinPlateSplineSurfaceDistanceMap_h
+
+#include "cipThinPlateSplineSurface.h"
+#include "cipChestConventions.h"
+#include "itkImageBase.h"
+#include "itkImage.h"
+#include "itkMultiThreader.h"
+
+#include <vector>
+
+class cipThinPlateSplineSurfaceDistanceMap
+{
+public:
+  typedef itk::Image< float, 3 >  DistanceImageType;
+
+  cipThinPlateSplineSurfaceDistanceMap( const cipThinPlateSplineSurface& );
+  ~cipThinPlateSplineSurfaceDistanceMap() {};
+
+  /** The map is computed on the grid (origin, spacing and buffered
+   *  region) of this image. Throws cip::ExceptionObject if the image's
+   *  direction is not the identity. */
+  void SetReferenceImage( const itk::ImageBase< 3 >* );
+
+  /** Half width in mm of the band around the surface in which distances
+   *  are computed. Defaults to 10 mm. */
+  void SetBandWidth( double bandWidth )
+    {
+      m_BandWidth = bandWidth;
+    }
+  double GetBandWidth() const
+    {
+      return m_BandWidth;
+    }
+
+  /** Refine point queries with a Newton search started at the
+   *  interpolated closest point. Defaults to false. */
+  void SetRefineWithNewton( bool refine )
+    {
+      m_RefineWithNewton = refine;
+    }
+  bool GetRefineWithNewton() const
+    {
+      return m_RefineWithNewton;
+    }
+
+  /** Number of threads the surface is sampled with. Defaults to ITK's
+   *  global default number of threads. */
+  void SetNumberOfThreads( unsigned int );
+
+  void Update();
+
+  /** Get the signed distance from 'point' to the surface. The surface
+   *  normal and the closest point on the surface are also set if
+   *  requested. Returns false, leaving the outputs unchanged, if 'point'
+   *  is outside the band or the grid. Safe to call from several threads. */
+  bool GetSignedDistance( const cip::PointType& point, double& distance, cip::VectorType* normal = NULL,
+                          cip::PointType* closestPoint = NULL ) const;
+
+  /** The signed distance of every voxel of the grid. Voxels outside the
+   *  band are set to plus or minus the band width. */
+  DistanceImageType::Pointer GetSignedDistanceImage() const;
+
+  /** Number of voxels within the band */
+  unsigned int GetNumberOfBandVoxels() const;
+
+private:
+  struct THREADSTRUCT
+  {
+    cipThinPlateSplineSurfaceDistanceMap*  map;
+    unsigned int                           numberOfBlocks;
+  };
+
+  static ITK_THREAD_RETURN_TYPE SampleSurfaceThreaderCallback( void* );
+
+  void SampleSurface( unsigned int firstRow, unsigned int lastRow );
+  void ComputeBandExtents();
+  void PropagateSamples();
+
+  /** Index of voxel (column, k) in the band arrays, or -1 if it is not
+   *  within its column's band extent */
+  long GetBandIndex( unsigned int column, long k ) const;
+
+  const cipThinPlateSplineSurface&   m_Surface;
+  double                             m_Origin[3];
+  double                             m_Spacing[3];
+  unsigned int                       m_Size[3];
+  bool                               m_HasGrid;
+  double                             m_BandWidth;
+  bool                               m_RefineWithNewton;
+  unsigned int                       m_NumberOfThreads;
+
+  // Surface height and unit normal at every column
+  std::vector< double >              m_Heights;
+  std::vector< double >              m_Normals;
+
+  // The band of column c is slices [m_FirstSlice[c], m_FirstSlice[c] +
+  // m_ColumnStarts[c+1] - m_ColumnStarts[c]), stored from m_ColumnStarts[c]
+  std::vector< unsigned int >        m_ColumnStarts;
+  std::vector< long >                m_FirstSlice;
+
+  // Signed distance and closest sample (column) of every band voxel
+  std::vector< float >               m_Distances;
+  std::vector< unsigned int >        m_Samples;
+};
+
+#endif
@@ -10,6 +10,7 @@
 #include "itkCIPAutoThresholdAirwaySegmentationImageFilter.h"
 #include "itkNumericTraits.h"
 #include "cipExceptionObject.h"
+#include "cipInstrumentation.h"
 #include <typeinfo>
 
 namespace itk
@@ -52,6 +53,9 @@ CIPAutoThresholdAirwaySegmentationImageFilter< TInputImage, TOutputImage >
 				  "Unsupported output pixel type. Must be unsigned short or unsigned char." );
     }
 
+  cip::ScopedTimer timer( "CIPAutoThresholdAirwaySegmentationImageFilter" );
+    timer.AddVoxels( this->GetInput()->GetBufferedRegion().GetNumberOfPixels() );
+
   // Allocate space for the output image
   typename Superclass::InputImageConstPointer inputPtr  = this->GetInput();
   typename Superclass::OutputImagePointer     outputPtr = this->GetOutput(0);
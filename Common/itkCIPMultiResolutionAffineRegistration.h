@@ -0,0 +1,181 @@
+/**
+ *  \class CIPMultiResolutionAffineRegistration
+ *  \ingroup common
+ *  \brief Coarse-to-fine affine registration driver shared by the
+ *  registration command line tools.
+ *
+ *  The fixed and moving images are cast to float (optionally binarized:
+ *  every non-zero voxel becomes 1, which is what the label map
+ *  registrations need) and a Gaussian image pyramid is built for each.
+ *  Starting at the coarsest level, an itk::ImageRegistrationMethod with a
+ *  RegularStepGradientDescentOptimizer and a mean squares metric refines
+ *  a single affine transform, and the result seeds the next level.
+ *
+ *  At every level the metric is only evaluated at a subsample of the
+ *  fixed level voxels. Candidate voxels are those that fall inside the
+ *  (optional) fixed mask; 'NumberOfSamples' of them are chosen either
+ *  uniformly at random or stratified (one jittered sample per run of
+ *  equally many candidate voxels in raster order, which spreads the
+ *  samples evenly over the mask). The metric value and derivative are
+ *  computed with multiple threads.
+ *
+ *  If no initial transform is given, the transform is initialized with
+ *  itk::CenteredTransformInitializer (moments mode) on the full
+ *  resolution images, as the single resolution tools do.
+ *
+ *  $Date$
+ *  $Revision$
+ *  $Author$
+ *
+ */
+
+#ifndef __itkCIPMultiResolutionAffineRegistration_h
+#define __itkCIPMultiResolutionAffineRegistration_h
+
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+#include "itkImage.h"
+#include "itkAffineTransform.h"
+#include "itkImageToImageMetric.h"
+
+#include <vector>
+
+namespace itk
+{
+
+template < class TImage > class ITK_EXPORT CIPMultiResolutionAffineRegistration :
+    public Object
+{
+public:
+  /** Standard class typedefs. */
+  typedef CIPMultiResolutionAffineRegistration  Self;
+  typedef Object                                Superclass;
+  typedef SmartPointer<Self>                    Pointer;
+  typedef SmartPointer<const Self>              ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(CIPMultiResolutionAffineRegistration, Object);
+
+  itkStaticConstMacro( ImageDimension, unsigned int, TImage::ImageDimension );
+
+  typedef TImage                                                            ImageType;
+  typedef itk::Image< float, TImage::ImageDimension >                       InternalImageType;
+  typedef itk::Image< unsigned short, TImage::ImageDimension >              MaskType;
+  typedef itk::AffineTransform< double, TImage::ImageDimension >            TransformType;
+  typedef itk::ImageToImageMetric< InternalImageType, InternalImageType >   MetricBaseType;
+  typedef typename MetricBaseType::FixedImageIndexContainer                 IndexContainerType;
+
+  /** RANDOM draws the samples uniformly from the candidate voxels;
+   *  STRATIFIED draws one jittered sample per stratum of candidates */
+  enum SamplingStrategyType { RANDOM, STRATIFIED };
+
+  itkSetConstObjectMacro( FixedImage, ImageType );
+  itkGetConstObjectMacro( FixedImage, ImageType );
+  itkSetConstObjectMacro( MovingImage, ImageType );
+  itkGetConstObjectMacro( MovingImage, ImageType );
+
+  /** Voxels of the fixed image that map to a non-zero mask voxel are
+   *  eligible for sampling. The mask need not share the fixed grid. If
+   *  no mask is set, every fixed voxel is eligible. */
+  itkSetConstObjectMacro( FixedMask, MaskType );
+  itkGetConstObjectMacro( FixedMask, MaskType );
+
+  /** Optional starting transform. It is not modified. */
+  itkSetConstObjectMacro( InitialTransform, TransformType );
+  itkGetConstObjectMacro( InitialTransform, TransformType );
+
+  /** Map every non-zero voxel to 1 before registering (label maps) */
+  itkSetMacro( Binarize, bool );
+  itkGetMacro( Binarize, bool );
+  itkBooleanMacro( Binarize );
+
+  /** Number of pyramid levels. Level shrink factors are 2^(n-1), ..., 1 */
+  itkSetMacro( NumberOfLevels, unsigned int );
+  itkGetMacro( NumberOfLevels, unsigned int );
+
+  /** Number of metric samples per level. 0 uses every candidate voxel. */
+  itkSetMacro( NumberOfSamples, unsigned int );
+  itkGetMacro( NumberOfSamples, unsigned int );
+
+  itkSetEnumMacro( SamplingStrategy, SamplingStrategyType );
+  itkGetEnumMacro( SamplingStrategy, SamplingStrategyType );
+
+  itkSetMacro( RandomSeed, unsigned int );
+  itkGetMacro( RandomSeed, unsigned int );
+
+  /** Optimizer settings. The maximum step length is halved at each finer
+   *  level; the number of iterations applies to every level. */
+  itkSetMacro( MaximumStepLength, double );
+  itkGetMacro( MaximumStepLength, double );
+  itkSetMacro( MinimumStepLength, double );
+  itkGetMacro( MinimumStepLength, double );
+  itkSetMacro( NumberOfIterations, unsigned int );
+  itkGetMacro( NumberOfIterations, unsigned int );
+  itkSetMacro( TranslationScale, double );
+  itkGetMacro( TranslationScale, double );
+
+  itkSetMacro( NumberOfThreads, unsigned int );
+  itkGetMacro( NumberOfThreads, unsigned int );
+
+  /** Run the registration */
+  void Update();
+
+  /** The transform that maps fixed image points to moving image points */
+  typename TransformType::Pointer GetTransform() const
+    {
+      return this->m_Transform;
+    }
+
+  /** Metric value (on the samples of the finest level) at the end of the
+   *  registration */
+  itkGetMacro( FinalMetricValue, double );
+
+  /** Total number of optimizer iterations over all levels */
+  itkGetMacro( TotalNumberOfIterations, unsigned int );
+
+  void PrintSelf( std::ostream& os, Indent indent ) const;
+
+protected:
+  CIPMultiResolutionAffineRegistration();
+  virtual ~CIPMultiResolutionAffineRegistration() {}
+
+  typename InternalImageType::Pointer GetInternalImage( const ImageType* ) const;
+
+  /** Choose the metric sample indices for one fixed pyramid level */
+  void GetSampleIndices( const InternalImageType*, IndexContainerType* ) const;
+
+private:
+  CIPMultiResolutionAffineRegistration(const Self&); //purposely not implemented
+  void operator=(const Self&); //purposely not implemented
+
+  typename ImageType::ConstPointer      m_FixedImage;
+  typename ImageType::ConstPointer      m_MovingImage;
+  typename MaskType::ConstPointer       m_FixedMask;
+  typename TransformType::ConstPointer  m_InitialTransform;
+  typename TransformType::Pointer       m_Transform;
+
+  bool                  m_Binarize;
+  unsigned int          m_NumberOfLevels;
+  unsigned int          m_NumberOfSamples;
+  SamplingStrategyType  m_SamplingStrategy;
+  unsigned int          m_RandomSeed;
+  double                m_MaximumStepLength;
+  double                m_MinimumStepLength;
+  unsigned int          m_NumberOfIterations;
+  double                m_TranslationScale;
+  unsigned int          m_NumberOfThreads;
+
+  double                m_FinalMetricValue;
+  unsigned int          m_TotalNumberOfIterations;
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkCIPMultiResolutionAffineRegistration.txx"
+#endif
+
+#endif
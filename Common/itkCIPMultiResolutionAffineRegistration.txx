@@ -0,0 +1,307 @@
+#ifndef _itkCIPMultiResolutionAffineRegistration_txx
+#define _itkCIPMultiResolutionAffineRegistration_txx
+
+#include "itkCIPMultiResolutionAffineRegistration.h"
+#include "itkMultiResolutionPyramidImageFilter.h"
+#include "itkImageRegistrationMethod.h"
+#include "itkMeanSquaresImageToImageMetric.h"
+#include "itkLinearInterpolateImageFunction.h"
+#include "itkRegularStepGradientDescentOptimizer.h"
+#include "itkCenteredTransformInitializer.h"
+#include "itkImageRegionConstIterator.h"
+#include "itkImageRegionIterator.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkMersenneTwisterRandomVariateGenerator.h"
+#include "itkMultiThreader.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace itk
+{
+
+/** Orders indices so that the slowest axis varies slowest (raster order) */
+template < class TIndex >
+struct CIPMultiResolutionAffineRegistrationIndexLess
+{
+  bool operator()( const TIndex& a, const TIndex& b ) const
+  {
+    for ( int d=int(TIndex::IndexDimension)-1; d>=0; d-- )
+      {
+      if ( a[d] != b[d] )
+        {
+        return a[d] < b[d];
+        }
+      }
+    return false;
+  }
+};
+
+template < class TImage >
+CIPMultiResolutionAffineRegistration< TImage >
+::CIPMultiResolutionAffineRegistration()
+{
+  this->m_Binarize                = false;
+  this->m_NumberOfLevels          = 3;
+  this->m_NumberOfSamples         = 50000;
+  this->m_SamplingStrategy        = STRATIFIED;
+  this->m_RandomSeed              = 0;
+  this->m_MaximumStepLength       = 1.0;
+  this->m_MinimumStepLength       = 0.001;
+  this->m_NumberOfIterations      = 100;
+  this->m_TranslationScale        = 0.001;
+  this->m_NumberOfThreads         = MultiThreader::GetGlobalDefaultNumberOfThreads();
+  this->m_FinalMetricValue        = 0.0;
+  this->m_TotalNumberOfIterations = 0;
+  this->m_Transform               = TransformType::New();
+}
+
+template < class TImage >
+typename CIPMultiResolutionAffineRegistration< TImage >::InternalImageType::Pointer
+CIPMultiResolutionAffineRegistration< TImage >
+::GetInternalImage( const ImageType* image ) const
+{
+  typename InternalImageType::Pointer internalImage = InternalImageType::New();
+    internalImage->CopyInformation( image );
+    internalImage->SetRegions( image->GetBufferedRegion() );
+    internalImage->Allocate();
+
+  ImageRegionConstIterator< ImageType >    iIt( image, image->GetBufferedRegion() );
+  ImageRegionIterator< InternalImageType > oIt( internalImage, internalImage->GetBufferedRegion() );
+
+  iIt.GoToBegin();
+  oIt.GoToBegin();
+  while ( !oIt.IsAtEnd() )
+    {
+    if ( this->m_Binarize )
+      {
+      oIt.Set( iIt.Get() != 0 ? 1.0 : 0.0 );
+      }
+    else
+      {
+      oIt.Set( static_cast< float >( iIt.Get() ) );
+      }
+
+    ++iIt;
+    ++oIt;
+    }
+
+  return internalImage;
+}
+
+template < class TImage >
+void
+CIPMultiResolutionAffineRegistration< TImage >
+::GetSampleIndices( const InternalImageType* image, IndexContainerType* indices ) const
+{
+  typedef typename InternalImageType::IndexType IndexType;
+
+  // Collect the candidate voxels in raster order
+  IndexContainerType candidates;
+
+  typename InternalImageType::PointType point;
+  typename MaskType::IndexType          maskIndex;
+
+  ImageRegionConstIteratorWithIndex< InternalImageType > it( image, image->GetBufferedRegion() );
+
+  it.GoToBegin();
+  while ( !it.IsAtEnd() )
+    {
+    if ( this->m_FixedMask.IsNull() )
+      {
+      candidates.push_back( it.GetIndex() );
+      }
+    else
+      {
+      image->TransformIndexToPhysicalPoint( it.GetIndex(), point );
+      this->m_FixedMask->TransformPhysicalPointToIndex( point, maskIndex );
+
+      if ( this->m_FixedMask->GetBufferedRegion().IsInside( maskIndex ) &&
+           this->m_FixedMask->GetPixel( maskIndex ) != 0 )
+        {
+        candidates.push_back( it.GetIndex() );
+        }
+      }
+
+    ++it;
+    }
+
+  if ( candidates.empty() )
+    {
+    itkExceptionMacro( << "No fixed image voxels fall inside the fixed mask" );
+    }
+
+  indices->clear();
+
+  unsigned int numCandidates = candidates.size();
+  if ( this->m_NumberOfSamples == 0 || this->m_NumberOfSamples >= numCandidates )
+    {
+    indices->swap( candidates );
+    return;
+    }
+
+  typename Statistics::MersenneTwisterRandomVariateGenerator::Pointer generator =
+    Statistics::MersenneTwisterRandomVariateGenerator::New();
+    generator->Initialize( this->m_RandomSeed );
+
+  if ( this->m_SamplingStrategy == RANDOM )
+    {
+    // Partial Fisher-Yates shuffle, then restore raster order so that the
+    // metric walks memory roughly sequentially
+    for ( unsigned int i=0; i<this->m_NumberOfSamples; i++ )
+      {
+      unsigned int j = i + generator->GetIntegerVariate( numCandidates - 1 - i );
+      std::swap( candidates[i], candidates[j] );
+      }
+    candidates.resize( this->m_NumberOfSamples );
+    std::sort( candidates.begin(), candidates.end(), CIPMultiResolutionAffineRegistrationIndexLess< IndexType >() );
+
+    indices->swap( candidates );
+    }
+  else
+    {
+    // One jittered sample per stratum of equally many candidates
+    double stride = static_cast< double >( numCandidates )/static_cast< double >( this->m_NumberOfSamples );
+
+    indices->reserve( this->m_NumberOfSamples );
+    for ( unsigned int k=0; k<this->m_NumberOfSamples; k++ )
+      {
+      unsigned int pos = static_cast< unsigned int >( std::floor( (double(k) + generator->GetUniformVariate( 0.0, 1.0 ))*stride ) );
+      if ( pos >= numCandidates )
+        {
+        pos = numCandidates - 1;
+        }
+      indices->push_back( candidates[pos] );
+      }
+    }
+}
+
+template < class TImage >
+void
+CIPMultiResolutionAffineRegistration< TImage >
+::Update()
+{
+  typedef MultiResolutionPyramidImageFilter< InternalImageType, InternalImageType >      PyramidType;
+  typedef ImageRegistrationMethod< InternalImageType, InternalImageType >                RegistrationType;
+  typedef MeanSquaresImageToImageMetric< InternalImageType, InternalImageType >          MetricType;
+  typedef LinearInterpolateImageFunction< InternalImageType, double >                    InterpolatorType;
+  typedef RegularStepGradientDescentOptimizer                                            OptimizerType;
+  typedef OptimizerType::ScalesType                                                      OptimizerScalesType;
+  typedef CenteredTransformInitializer< TransformType, InternalImageType, InternalImageType > InitializerType;
+
+  if ( this->m_FixedImage.IsNull() || this->m_MovingImage.IsNull() )
+    {
+    itkExceptionMacro( << "Fixed and moving images must be set" );
+    }
+  if ( this->m_NumberOfLevels == 0 )
+    {
+    itkExceptionMacro( << "At least one pyramid level is required" );
+    }
+
+  typename InternalImageType::Pointer fixedImage  = this->GetInternalImage( this->m_FixedImage );
+  typename InternalImageType::Pointer movingImage = this->GetInternalImage( this->m_MovingImage );
+
+  this->m_Transform = TransformType::New();
+  if ( this->m_InitialTransform.IsNotNull() )
+    {
+    this->m_Transform->SetFixedParameters( this->m_InitialTransform->GetFixedParameters() );
+    this->m_Transform->SetParameters( this->m_InitialTransform->GetParameters() );
+    }
+  else
+    {
+    typename InitializerType::Pointer initializer = InitializerType::New();
+      initializer->SetTransform( this->m_Transform );
+      initializer->SetFixedImage( fixedImage );
+      initializer->SetMovingImage( movingImage );
+      initializer->MomentsOn();
+      initializer->InitializeTransform();
+    }
+
+  typename PyramidType::Pointer fixedPyramid = PyramidType::New();
+    fixedPyramid->SetInput( fixedImage );
+    fixedPyramid->SetNumberOfLevels( this->m_NumberOfLevels );
+    fixedPyramid->Update();
+
+  typename PyramidType::Pointer movingPyramid = PyramidType::New();
+    movingPyramid->SetInput( movingImage );
+    movingPyramid->SetNumberOfLevels( this->m_NumberOfLevels );
+    movingPyramid->Update();
+
+  const unsigned int numParams = this->m_Transform->GetNumberOfParameters();
+
+  // Matrix entries come first, the translation last
+  OptimizerScalesType optimizerScales( numParams );
+  for ( unsigned int i=0; i<numParams; i++ )
+    {
+    optimizerScales[i] = (i < numParams - ImageDimension) ? 1.0 : this->m_TranslationScale;
+    }
+
+  double maxStepLength = this->m_MaximumStepLength;
+  this->m_TotalNumberOfIterations = 0;
+
+  for ( unsigned int level=0; level<this->m_NumberOfLevels; level++ )
+    {
+    typename InternalImageType::Pointer fixedLevel  = fixedPyramid->GetOutput( level );
+    typename InternalImageType::Pointer movingLevel = movingPyramid->GetOutput( level );
+
+    IndexContainerType sampleIndices;
+    this->GetSampleIndices( fixedLevel, &sampleIndices );
+
+    itkDebugMacro( << "Level " << level << ": " << sampleIndices.size() << " samples" );
+
+    typename MetricType::Pointer metric = MetricType::New();
+      metric->SetNumberOfThreads( this->m_NumberOfThreads );
+      metric->SetFixedImageIndexes( sampleIndices );
+
+    typename OptimizerType::Pointer optimizer = OptimizerType::New();
+      optimizer->SetScales( optimizerScales );
+      optimizer->SetMaximumStepLength( maxStepLength );
+      optimizer->SetMinimumStepLength( this->m_MinimumStepLength );
+      optimizer->SetNumberOfIterations( this->m_NumberOfIterations );
+
+    typename InterpolatorType::Pointer interpolator = InterpolatorType::New();
+
+    typename RegistrationType::Pointer registration = RegistrationType::New();
+      registration->SetMetric( metric );
+      registration->SetOptimizer( optimizer );
+      registration->SetInterpolator( interpolator );
+      registration->SetTransform( this->m_Transform );
+      registration->SetFixedImage( fixedLevel );
+      registration->SetMovingImage( movingLevel );
+      registration->SetFixedImageRegion( fixedLevel->GetBufferedRegion() );
+      registration->SetInitialTransformParameters( this->m_Transform->GetParameters() );
+      registration->Update();
+
+    this->m_Transform->SetParameters( registration->GetLastTransformParameters() );
+
+    this->m_FinalMetricValue = optimizer->GetValue();
+    this->m_TotalNumberOfIterations += optimizer->GetCurrentIteration();
+
+    maxStepLength = std::max( 0.5*maxStepLength, this->m_MinimumStepLength );
+    }
+}
+
+template < class TImage >
+void
+CIPMultiResolutionAffineRegistration< TImage >
+::PrintSelf( std::ostream& os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+
+  os << indent << "Binarize: " << this->m_Binarize << std::endl;
+  os << indent << "NumberOfLevels: " << this->m_NumberOfLevels << std::endl;
+  os << indent << "NumberOfSamples: " << this->m_NumberOfSamples << std::endl;
+  os << indent << "SamplingStrategy: " << (this->m_SamplingStrategy == RANDOM ? "RANDOM" : "STRATIFIED") << std::endl;
+  os << indent << "RandomSeed: " << this->m_RandomSeed << std::endl;
+  os << indent << "MaximumStepLength: " << this->m_MaximumStepLength << std::endl;
+  os << indent << "MinimumStepLength: " << this->m_MinimumStepLength << std::endl;
+  os << indent << "NumberOfIterations: " << this->m_NumberOfIterations << std::endl;
+  os << indent << "TranslationScale: " << this->m_TranslationScale << std::endl;
+  os << indent << "NumberOfThreads: " << this->m_NumberOfThreads << std::endl;
+  os << indent << "FinalMetricValue: " << this->m_FinalMetricValue << std::endl;
+  os << indent << "TotalNumberOfIterations: " << this->m_TotalNumberOfIterations << std::endl;
+}
+
+} // end namespace itk
+
+#endif
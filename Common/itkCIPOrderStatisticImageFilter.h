@@ -0,0 +1,130 @@
+/** \class CIPOrderStatisticImageFilter
+ *  \brief Median (or any percentile) filter of 3D images with 8 or 16
+ *  bit integer pixels, computed from a sliding histogram.
+ *
+ *  Each output voxel is the k-th smallest value of the box neighborhood
+ *  of radius 'Radius' around it, with k = floor(Percentile*N/100) clamped
+ *  to N-1, N being the number of voxels in the neighborhood. Voxels
+ *  outside the image are replaced by the closest voxel inside it (zero
+ *  flux Neumann boundary condition), so with the default percentile of 50
+ *  the output is identical to itk::MedianImageFilter's.
+ *
+ *  The neighborhood's histogram is kept along each row of the output: a
+ *  step along x removes the plane of voxels leaving the box and adds the
+ *  plane entering it, and the k-th value is tracked from the one of the
+ *  previous voxel. The histogram has a coarse level (counts of blocks of
+ *  256 values) so that the tracked value skips empty ranges of the
+ *  histogram in a few steps. The cost per voxel is thus proportional to
+ *  the area of a plane of the box rather than to its volume. Threads
+ *  process separate slabs of the output.
+ *
+ *  If a mask is set, only the neighborhood voxels that are nonzero in the
+ *  mask are counted, and only the voxels that are nonzero in the mask are
+ *  filtered. The other voxels are copied from the input.
+ */
+
+#ifndef __itkCIPOrderStatisticImageFilter_h
+#define __itkCIPOrderStatisticImageFilter_h
+
+#include "itkImageToImageFilter.h"
+#include "itkImage.h"
+
+#include <vector>
+
+namespace itk
+{
+template < class TInputImage, class TOutputImage = TInputImage >
+class ITK_EXPORT CIPOrderStatisticImageFilter :
+    public ImageToImageFilter< TInputImage, TOutputImage >
+{
+public:
+  /** Extract dimension from input and output image. */
+  itkStaticConstMacro( InputImageDimension, unsigned int, 3 );
+  itkStaticConstMacro( OutputImageDimension, unsigned int, 3 );
+
+  /** Convenient typedefs for simplifying declarations. */
+  typedef TInputImage    InputImageType;
+  typedef TOutputImage   OutputImageType;
+
+  /** Standard class typedefs. */
+  typedef CIPOrderStatisticImageFilter                           Self;
+  typedef ImageToImageFilter< InputImageType, OutputImageType >  Superclass;
+  typedef SmartPointer< Self >                                   Pointer;
+  typedef SmartPointer< const Self >                             ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(CIPOrderStatisticImageFilter, ImageToImageFilter);
+
+  /** Image typedef support. */
+  typedef typename InputImageType::PixelType           InputPixelType;
+  typedef typename OutputImageType::PixelType          OutputPixelType;
+  typedef typename InputImageType::RegionType          InputImageRegionType;
+  typedef typename OutputImageType::RegionType         OutputImageRegionType;
+  typedef typename InputImageType::SizeType            InputSizeType;
+  typedef typename InputImageType::IndexType           InputIndexType;
+  typedef itk::Image< unsigned short, 3 >              MaskImageType;
+
+  /** Radius of the neighborhood along each axis. Defaults to 1. */
+  itkSetMacro( Radius, InputSizeType );
+  itkGetConstReferenceMacro( Radius, InputSizeType );
+
+  /** Percentile of the neighborhood values that is output, between 0 and
+   *  100. Defaults to 50 (the median). */
+  itkSetClampMacro( Percentile, double, 0.0, 100.0 );
+  itkGetConstMacro( Percentile, double );
+
+  /** Optional mask. It must be defined on the same grid as the input. */
+  void SetMaskImage( const MaskImageType* );
+  const MaskImageType* GetMaskImage() const;
+
+  void PrintSelf( std::ostream& os, Indent indent ) const;
+
+protected:
+  CIPOrderStatisticImageFilter();
+  virtual ~CIPOrderStatisticImageFilter() {}
+
+  /** The input (and mask) is padded by the radius */
+  void GenerateInputRequestedRegion();
+
+  void BeforeThreadedGenerateData();
+  void ThreadedGenerateData( const OutputImageRegionType& outputRegionForThread, ThreadIdType threadId );
+
+private:
+  CIPOrderStatisticImageFilter(const Self&); //purposely not implemented
+  void operator=(const Self&); //purposely not implemented
+
+  // Number of fine bins in a coarse bin
+  static const unsigned int COARSEBINSIZE = 256;
+
+  /** Histogram of the neighborhood of a voxel, with the tracked k-th
+   *  smallest value. Bins are the values shifted by the minimum of the
+   *  pixel type. */
+  struct HISTOGRAM
+  {
+    std::vector< unsigned int >  fine;
+    std::vector< unsigned int >  coarse;
+    unsigned int                 count;
+    unsigned int                 bin;      // Tracked bin
+    unsigned int                 below;    // Number of values below it
+  };
+
+  static void AddValue( HISTOGRAM&, unsigned int bin );
+  static void RemoveValue( HISTOGRAM&, unsigned int bin );
+
+  /** Move the tracked bin to the one holding the k-th smallest value */
+  static unsigned int FindBin( HISTOGRAM&, unsigned int k );
+
+  InputSizeType  m_Radius;
+  double         m_Percentile;
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkCIPOrderStatisticImageFilter.txx"
+#endif
+
+#endif
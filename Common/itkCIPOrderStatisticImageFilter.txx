@@ -0,0 +1,328 @@
+/**
+ *
+ */
+#ifndef _itkCIPOrderStatisticImageFilter_txx
+#define _itkCIPOrderStatisticImageFilter_txx
+
+#include "itkCIPOrderStatisticImageFilter.h"
+#include "itkNumericTraits.h"
+#include "itkProgressReporter.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace itk
+{
+
+template < class TInputImage, class TOutputImage >
+CIPOrderStatisticImageFilter< TInputImage, TOutputImage >
+::CIPOrderStatisticImageFilter()
+{
+  this->m_Radius.Fill( 1 );
+  this->m_Percentile = 50.0;
+}
+
+
+template < class TInputImage, class TOutputImage >
+void
+CIPOrderStatisticImageFilter< TInputImage, TOutputImage >
+::SetMaskImage( const MaskImageType* mask )
+{
+  this->ProcessObject::SetNthInput( 1, const_cast< MaskImageType* >( mask ) );
+}
+
+
+template < class TInputImage, class TOutputImage >
+const typename CIPOrderStatisticImageFilter< TInputImage, TOutputImage >::MaskImageType*
+CIPOrderStatisticImageFilter< TInputImage, TOutputImage >
+::GetMaskImage() const
+{
+  return static_cast< const MaskImageType* >( this->ProcessObject::GetInput( 1 ) );
+}
+
+
+template < class TInputImage, class TOutputImage >
+void
+CIPOrderStatisticImageFilter< TInputImage, TOutputImage >
+::GenerateInputRequestedRegion()
+{
+  Superclass::GenerateInputRequestedRegion();
+
+  // The superclass requested the output's region from the input and the
+  // mask. Pad it by the radius.
+  for ( unsigned int i=0; i<this->GetNumberOfIndexedInputs(); i++ )
+    {
+    ImageBase< 3 >* inputPtr = dynamic_cast< ImageBase< 3 >* >( this->ProcessObject::GetInput( i ) );
+    if ( !inputPtr )
+      {
+      continue;
+      }
+
+    InputImageRegionType region = inputPtr->GetRequestedRegion();
+    region.PadByRadius( this->m_Radius );
+    region.Crop( inputPtr->GetLargestPossibleRegion() );
+
+    inputPtr->SetRequestedRegion( region );
+    }
+}
+
+
+template < class TInputImage, class TOutputImage >
+void
+CIPOrderStatisticImageFilter< TInputImage, TOutputImage >
+::BeforeThreadedGenerateData()
+{
+  if ( !NumericTraits< InputPixelType >::is_integer || sizeof( InputPixelType ) > 2 )
+    {
+    itkExceptionMacro( << "Unsupported input pixel type. Must be an 8 or 16 bit integer type." );
+    }
+
+  const MaskImageType* mask = this->GetMaskImage();
+  if ( mask && !mask->GetBufferedRegion().IsInside( this->GetInput()->GetBufferedRegion() ) )
+    {
+    itkExceptionMacro( << "The mask does not cover the input image." );
+    }
+}
+
+
+template < class TInputImage, class TOutputImage >
+void
+CIPOrderStatisticImageFilter< TInputImage, TOutputImage >
+::ThreadedGenerateData( const OutputImageRegionType& outputRegionForThread, ThreadIdType threadId )
+{
+  const InputImageType* input  = this->GetInput();
+  OutputImageType*      output = this->GetOutput();
+  const MaskImageType*  mask   = this->GetMaskImage();
+
+  // Neighborhoods are clamped to the input's buffered region
+  const InputImageRegionType& bufferedRegion = input->GetBufferedRegion();
+  long lower[3];
+  long upper[3];
+  long radius[3];
+  for ( unsigned int i=0; i<3; i++ )
+    {
+    lower[i]  = bufferedRegion.GetIndex()[i];
+    upper[i]  = lower[i] + static_cast< long >( bufferedRegion.GetSize()[i] ) - 1;
+    radius[i] = static_cast< long >( this->m_Radius[i] );
+    }
+
+  // The neighborhood of a voxel is made of lines along x, one for each
+  // of the (2*radius[1]+1)*(2*radius[2]+1) positions along y and z
+  unsigned int numLines     = (2*radius[1] + 1)*(2*radius[2] + 1);
+  unsigned int centerLine   = radius[2]*(2*radius[1] + 1) + radius[1];
+  unsigned int neighborhood = (2*radius[0] + 1)*numLines;
+
+  std::vector< const InputPixelType* >                   lines( numLines );
+  std::vector< const typename MaskImageType::PixelType* >  maskLines( numLines );
+
+  const long minimum = static_cast< long >( NumericTraits< InputPixelType >::NonpositiveMin() );
+
+  HISTOGRAM histogram;
+  histogram.fine.assign( 1 << (8*sizeof( InputPixelType )), 0 );
+  histogram.coarse.assign( (histogram.fine.size() + COARSEBINSIZE - 1)/COARSEBINSIZE, 0 );
+  histogram.count = 0;
+  histogram.bin   = 0;
+  histogram.below = 0;
+
+  unsigned int rank = std::min( neighborhood - 1,
+    static_cast< unsigned int >( std::floor( this->m_Percentile*neighborhood/100.0 ) ) );
+
+  const typename OutputImageRegionType::IndexType& start = outputRegionForThread.GetIndex();
+  const typename OutputImageRegionType::SizeType&  size  = outputRegionForThread.GetSize();
+  long firstX = start[0];
+  long lastX  = start[0] + static_cast< long >( size[0] ) - 1;
+
+  ProgressReporter progress( this, threadId, size[1]*size[2] );
+
+  InputIndexType index;
+  for ( long z=start[2]; z<start[2] + static_cast< long >( size[2] ); z++ )
+    {
+    for ( long y=start[1]; y<start[1] + static_cast< long >( size[1] ); y++ )
+      {
+      unsigned int l = 0;
+      for ( long dz=-radius[2]; dz<=radius[2]; dz++ )
+        {
+        for ( long dy=-radius[1]; dy<=radius[1]; dy++ )
+          {
+          index[0] = lower[0];
+          index[1] = std::max( lower[1], std::min( upper[1], y + dy ) );
+          index[2] = std::max( lower[2], std::min( upper[2], z + dz ) );
+
+          lines[l] = input->GetBufferPointer() + input->ComputeOffset( index );
+          if ( mask )
+            {
+            maskLines[l] = mask->GetBufferPointer() + mask->ComputeOffset( index );
+            }
+          l++;
+          }
+        }
+
+      // Neighborhood of the first voxel of the row
+      for ( long dx=-radius[0]; dx<=radius[0]; dx++ )
+        {
+        long x = std::max( lower[0], std::min( upper[0], firstX + dx ) ) - lower[0];
+        for ( l=0; l<numLines; l++ )
+          {
+          if ( !mask || maskLines[l][x] != 0 )
+            {
+            AddValue( histogram, static_cast< long >( lines[l][x] ) - minimum );
+            }
+          }
+        }
+
+      index[0] = firstX;
+      index[1] = y;
+      index[2] = z;
+      OutputPixelType* outPtr = output->GetBufferPointer() + output->ComputeOffset( index );
+
+      for ( long x=firstX; x<=lastX; x++ )
+        {
+        if ( x > firstX )
+          {
+          long leaving  = std::max( lower[0], x - radius[0] - 1 ) - lower[0];
+          long entering = std::min( upper[0], x + radius[0] ) - lower[0];
+          for ( l=0; l<numLines; l++ )
+            {
+            if ( !mask )
+              {
+              if ( lines[l][leaving] != lines[l][entering] )
+                {
+                RemoveValue( histogram, static_cast< long >( lines[l][leaving] ) - minimum );
+                AddValue( histogram, static_cast< long >( lines[l][entering] ) - minimum );
+                }
+              continue;
+              }
+            if ( maskLines[l][leaving] != 0 )
+              {
+              RemoveValue( histogram, static_cast< long >( lines[l][leaving] ) - minimum );
+              }
+            if ( maskLines[l][entering] != 0 )
+              {
+              AddValue( histogram, static_cast< long >( lines[l][entering] ) - minimum );
+              }
+            }
+          }
+
+        long center = x - lower[0];
+        if ( mask )
+          {
+          if ( maskLines[centerLine][center] == 0 )
+            {
+            *outPtr = static_cast< OutputPixelType >( lines[centerLine][center] );
+            ++outPtr;
+            continue;
+            }
+          rank = std::min( histogram.count - 1,
+            static_cast< unsigned int >( std::floor( this->m_Percentile*histogram.count/100.0 ) ) );
+          }
+
+        long value = static_cast< long >( FindBin( histogram, rank ) ) + minimum;
+        *outPtr = static_cast< OutputPixelType >( static_cast< InputPixelType >( value ) );
+        ++outPtr;
+        }
+
+      // Empty the histogram for the next row
+      for ( long dx=-radius[0]; dx<=radius[0]; dx++ )
+        {
+        long x = std::max( lower[0], std::min( upper[0], lastX + dx ) ) - lower[0];
+        for ( l=0; l<numLines; l++ )
+          {
+          if ( !mask || maskLines[l][x] != 0 )
+            {
+            RemoveValue( histogram, static_cast< long >( lines[l][x] ) - minimum );
+            }
+          }
+        }
+
+      progress.CompletedPixel();
+      }
+    }
+}
+
+
+template < class TInputImage, class TOutputImage >
+void
+CIPOrderStatisticImageFilter< TInputImage, TOutputImage >
+::AddValue( HISTOGRAM& histogram, unsigned int bin )
+{
+  histogram.fine[bin]++;
+  histogram.coarse[bin/COARSEBINSIZE]++;
+  histogram.count++;
+  if ( bin < histogram.bin )
+    {
+    histogram.below++;
+    }
+}
+
+
+template < class TInputImage, class TOutputImage >
+void
+CIPOrderStatisticImageFilter< TInputImage, TOutputImage >
+::RemoveValue( HISTOGRAM& histogram, unsigned int bin )
+{
+  histogram.fine[bin]--;
+  histogram.coarse[bin/COARSEBINSIZE]--;
+  histogram.count--;
+  if ( bin < histogram.bin )
+    {
+    histogram.below--;
+    }
+}
+
+
+template < class TInputImage, class TOutputImage >
+unsigned int
+CIPOrderStatisticImageFilter< TInputImage, TOutputImage >
+::FindBin( HISTOGRAM& histogram, unsigned int k )
+{
+  // The k-th smallest value is in the tracked bin when there are at most
+  // k values below it, and more than k up to it. Whole coarse bins are
+  // skipped when the tracked bin is at one of their ends.
+  while ( histogram.below > k )
+    {
+    if ( histogram.bin%COARSEBINSIZE == 0 &&
+         histogram.below - histogram.coarse[histogram.bin/COARSEBINSIZE - 1] > k )
+      {
+      histogram.bin   -= COARSEBINSIZE;
+      histogram.below -= histogram.coarse[histogram.bin/COARSEBINSIZE];
+      }
+    else
+      {
+      histogram.bin--;
+      histogram.below -= histogram.fine[histogram.bin];
+      }
+    }
+
+  while ( histogram.below + histogram.fine[histogram.bin] <= k )
+    {
+    if ( histogram.bin%COARSEBINSIZE == 0 &&
+         histogram.below + histogram.coarse[histogram.bin/COARSEBINSIZE] <= k )
+      {
+      histogram.below += histogram.coarse[histogram.bin/COARSEBINSIZE];
+      histogram.bin   += COARSEBINSIZE;
+      }
+    else
+      {
+      histogram.below += histogram.fine[histogram.bin];
+      histogram.bin++;
+      }
+    }
+
+  return histogram.bin;
+}
+
+
+template < class TInputImage, class TOutputImage >
+void
+CIPOrderStatisticImageFilter< TInputImage, TOutputImage >
+::PrintSelf( std::ostream& os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+
+  os << indent << "Radius: " << this->m_Radius << std::endl;
+  os << indent << "Percentile: " << this->m_Percentile << std::endl;
+}
+
+} // end namespace itk
+
+#endif
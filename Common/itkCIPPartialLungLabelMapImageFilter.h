@@ -157,7 +157,6 @@ protected:
 
   void GenerateData();
   void ApplyHelperMask();
-  void ExtractLabelMapSlice( LabelMapType::Pointer, LabelMapSliceType::Pointer, int );
   void CloseLabelMap( unsigned short );
   std::vector< OutputImageType::IndexType > GetAirwaySeeds( LabelMapType::Pointer );
 
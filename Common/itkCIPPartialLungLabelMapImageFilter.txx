@@ -4,6 +4,8 @@
 #include "itkCIPPartialLungLabelMapImageFilter.h"
 #include "cipHelper.h"
 #include "cipChestConventions.h"
+#include "cipInstrumentation.h"
+#include "cipLabelMapSliceComponentAnalyzer.h"
 #include "itkImageFileWriter.h" //DEB
 
 namespace itk
@@ -45,6 +47,9 @@ CIPPartialLungLabelMapImageFilter< TInputImage >
 				  "Min airway intensity threshold not set" );
     }
 
+  cip::ScopedTimer timer( "CIPPartialLungLabelMapImageFilter" );
+    timer.AddVoxels( this->GetInput()->GetBufferedRegion().GetNumberOfPixels() );
+
   cip::ChestConventions conventions;
 
   LabelMapType::SpacingType spacing = this->GetInput()->GetSpacing();
@@ -89,6 +94,8 @@ CIPPartialLungLabelMapImageFilter< TInputImage >
 
   std::vector< OutputImageType::IndexType > airwayIndices;
   {
+    cip::ScopedTimer stageTimer( "CIPPartialLungLabelMapImageFilter::RemoveAirways" );
+
     // Identify airways
     std::vector< OutputImageType::IndexType > airwaySeedVec = this->GetAirwaySeeds( this->GetOutput() );
 
@@ -136,6 +143,8 @@ CIPPartialLungLabelMapImageFilter< TInputImage >
   }
 
   {
+    cip::ScopedTimer stageTimer( "CIPPartialLungLabelMapImageFilter::RemoveSmallComponents" );
+
     // It's possible that there are some small disconnected regions that remain
     // after the airways have been removed. Perform connected components analysis
     // and remove all components that collectively make up less than ten percent
@@ -179,6 +188,8 @@ CIPPartialLungLabelMapImageFilter< TInputImage >
   }
 
   {
+    cip::ScopedTimer stageTimer( "CIPPartialLungLabelMapImageFilter::SplitLeftAndRightLungs" );
+
     // Now split label map so that the left and right lungs can be labeled
     typename SplitterType::Pointer splitter = SplitterType::New();
       splitter->SetInput( this->GetInput() );
@@ -200,6 +211,8 @@ CIPPartialLungLabelMapImageFilter< TInputImage >
 
   bool labelingSucess = false;
   {
+    cip::ScopedTimer stageTimer( "CIPPartialLungLabelMapImageFilter::LabelLeftAndRightLungs" );
+
     LungRegionLabelerType::Pointer leftRightLabeler = LungRegionLabelerType::New();
       leftRightLabeler->SetInput( this->GetOutput() );
       leftRightLabeler->SetLabelLeftAndRightLungs( true );
@@ -223,6 +236,8 @@ CIPPartialLungLabelMapImageFilter< TInputImage >
   }
 
   {
+    cip::ScopedTimer stageTimer( "CIPPartialLungLabelMapImageFilter::CloseLabelMap" );
+
     // Perform morphological closing on the left and right lungs
     if ( labelingSucess )
       {
@@ -389,66 +404,6 @@ CIPPartialLungLabelMapImageFilter< TInputImage >
 }
 
 
-/**
- * Extract a slice from the input label map image
- */
-template < class TInputImage >
-void
-CIPPartialLungLabelMapImageFilter< TInputImage >
-::ExtractLabelMapSlice( LabelMapType::Pointer image, LabelMapSliceType::Pointer sliceImage, int whichSlice )
-{
-  LabelMapType::SizeType size = image->GetBufferedRegion().GetSize();
-
-  LabelMapSliceType::SizeType sliceSize;
-    sliceSize[0] = size[0];
-    sliceSize[1] = size[1];
-
-  sliceImage->SetRegions( sliceSize );
-  sliceImage->Allocate();
-
-  LabelMapType::SizeType sliceExtractorSize;
-    sliceExtractorSize[0] = size[0];
-    sliceExtractorSize[1] = size[1];
-    sliceExtractorSize[2] = 0;
-
-  LabelMapType::IndexType sliceStartIndex;
-    sliceStartIndex[0] = 0;
-    sliceStartIndex[1] = 0;
-    sliceStartIndex[2] = whichSlice;
-
-  LabelMapType::RegionType sliceExtractorRegion;
-    sliceExtractorRegion.SetSize( sliceExtractorSize );
-    sliceExtractorRegion.SetIndex( sliceStartIndex );
-
-  SliceExtractorType::Pointer sliceExtractor = SliceExtractorType::New();
-    sliceExtractor->SetInput( image );
-    sliceExtractor->SetDirectionCollapseToIdentity();
-    sliceExtractor->SetExtractionRegion( sliceExtractorRegion );
-  try
-    {   
-    sliceExtractor->Update();
-    }
-  catch ( itk::ExceptionObject &excp )
-    {
-    std::cerr << "Exception caught extracting slice:";
-    std::cerr << excp << std::endl;
-    }   
-
-  LabelMapSliceIteratorType eIt( sliceExtractor->GetOutput(), sliceExtractor->GetOutput()->GetBufferedRegion() );
-  LabelMapSliceIteratorType sIt( sliceImage, sliceImage->GetBufferedRegion() );
-
-  sIt.GoToBegin();
-  eIt.GoToBegin();
-  while ( !sIt.IsAtEnd() )
-    {
-    sIt.Set( eIt.Get() );
-
-    ++sIt;
-    ++eIt;
-    }
-}
-
-
 /**
  * This method gets seeds for subsequent airway segmentation using
  * region growing. For qualified slices, it gets seeds from whatever
@@ -460,185 +415,11 @@ std::vector< itk::Image< unsigned short, 3 >::IndexType >
 CIPPartialLungLabelMapImageFilter< TInputImage >
 ::GetAirwaySeeds( LabelMapType::Pointer labelMap )
 {
-  std::vector< OutputImageType::IndexType > seedVec;
-
-  LabelMapType::SizeType    size    = labelMap->GetBufferedRegion().GetSize();
-  LabelMapType::SpacingType spacing = labelMap->GetSpacing();
-  
-  // Get seeds from 15 slices. We don't consider the slice unless the
-  // total area is above a threshold
-  // (foregroundSliceSizeThresholdForSeedSelection). The value is set
-  // to 2000.0 to ensure that the lungs have come into the field of
-  // view before we begin our seed search. If we simply attempt to
-  // find seeds in the first slices that show a foreground region, we
-  // can wind up with a poor airway segmentation due to pinch points
-  // near the apex of the scan. This in turn can produce failure
-  // modes. The number of slices that we consider (15) is somewhat
-  // arbitrary. 
-  unsigned int slicesProcessed                              = 0;
-  unsigned int currentSliceOffset                           = 0;
-  int          numberSlicesForSeedSearch                    = 15;
-  double       foregroundSliceSizeThresholdForSeedSelection = 2000.0;
-
-  while ( slicesProcessed < numberSlicesForSeedSearch && currentSliceOffset < size[2] )
-    {
-    // Extract a 2D slice from the mask
-    int whichSlice;
-    if ( this->m_HeadFirst )
-      {
-      whichSlice = size[2] - 1 - currentSliceOffset;
-      }
-    else
-      {
-      whichSlice = currentSliceOffset;
-      }
-
-    LabelMapSliceType::Pointer slice = LabelMapSliceType::New();    
-    this->ExtractLabelMapSlice( labelMap, slice, whichSlice );
-
-    // Perform connected component labeling    
-    ConnectedComponent2DType::Pointer connectedComponent = ConnectedComponent2DType::New();
-      connectedComponent->SetInput( slice );
-      connectedComponent->FullyConnectedOn();
-    try
-      {
-      connectedComponent->Update();
-      }
-    catch ( itk::ExceptionObject &excp )
-      {
-      std::cerr << "Exception caught while updating connected component filter:";
-      std::cerr << excp << std::endl;
-      }    
-
-    // Relabel the components    
-    Relabel2DType::Pointer relabeler = Relabel2DType::New();
-      relabeler->SetInput( connectedComponent->GetOutput() );
-    try
-      {
-      relabeler->Update();
-      }
-    catch ( itk::ExceptionObject &excp )
-      {
-      std::cerr << "Exception caught while relabeling:";
-      std::cerr << excp << std::endl;
-      }
-
-    // If the foreground area of the slice is larger than the
-    // threshold, consider the slice for seed selection. The number of
-    // objects present in the slice must also be equal to three
-    // (trachea, left and right lungs)
-    int numVoxels = 0;
-
-    LabelMapSliceIteratorType rIt( relabeler->GetOutput(), relabeler->GetOutput()->GetBufferedRegion() );
-
-    rIt.GoToBegin();
-    while ( !rIt.IsAtEnd() )
-      {
-      if ( rIt.Get() > 0 )
-        {
-        numVoxels++;
-        }
-
-      ++rIt;
-      }
-
-    double foregroundArea = static_cast< double >( numVoxels )*spacing[0]*spacing[1];
-
-    if ( foregroundArea > foregroundSliceSizeThresholdForSeedSelection && relabeler->GetNumberOfObjects() >= 3 )
-      {
-      slicesProcessed++;
-
-      // Identify the object who's centroid (x coordinate) is in the
-      // middle. First get the centroids, then find out which one is
-      // in the middle 
-      std::map< unsigned int, unsigned short > xCentroidMap;
-
-      unsigned short bestCenterLabel = 0;
-
-      unsigned int leftmostCentroid  = size[1];
-      unsigned int rightmostCentroid = 0;
-      
-      // Get the centroids and labels for each object      
-      for ( unsigned int i=1; i<=relabeler->GetNumberOfObjects(); i++ )
-        {
-        int x = 0;
-        int count = 0;
-
-        rIt.GoToBegin();
-        while ( !rIt.IsAtEnd() )
-          {
-          if ( rIt.Get() == i )
-            {
-            x += (rIt.GetIndex())[0];
-            count++;
-            }
-
-          ++rIt;
-          }
-        
-        unsigned int centroidLocation = (unsigned int)( double(x)/double(count) );
-
-        if ( centroidLocation > rightmostCentroid )
-          {
-          rightmostCentroid = centroidLocation;
-          }
-        if ( centroidLocation < leftmostCentroid )
-          {
-          leftmostCentroid = centroidLocation;
-          }
-
-        xCentroidMap[centroidLocation] = i;
-        }
-
-      unsigned int middleLocation = (rightmostCentroid + leftmostCentroid)/2;
-
-      // Now find the label that corresponds to the centroid that is
-      // closest to the middle location
-      unsigned int minDiff = size[1];
-
-      std::map< unsigned int, unsigned short >::iterator mapIt = xCentroidMap.begin();
-      while ( mapIt != xCentroidMap.end() )
-        {
-        int diff = vcl_abs( int((*mapIt).first) - int(middleLocation) );
-
-        if ( diff < minDiff )
-          {                                     
-          minDiff = diff;
-          bestCenterLabel = (*mapIt).second;
-          }
-
-        mapIt++;
-        }
-
-      LabelMapType::IndexType index;
-
-      rIt.GoToBegin();
-      while ( !rIt.IsAtEnd() )
-        {
-        if ( rIt.Get() == bestCenterLabel )
-          {
-          index[0] = (rIt.GetIndex())[0];
-          index[1] = (rIt.GetIndex())[1];
-          if ( this->m_HeadFirst )
-            {
-            index[2] = size[2] - 1 - currentSliceOffset;
-            }
-          else
-            {
-            index[2] = currentSliceOffset;
-            }
-
-          seedVec.push_back( index );
-          }
-
-        ++rIt;
-        }
-      }
-
-    currentSliceOffset++;
-    }
+  cip::LabelMapSliceComponentAnalyzer analyzer;
+    analyzer.SetLabelMap( labelMap );
+    analyzer.SetNumberOfThreads( this->GetNumberOfThreads() );
 
-  return seedVec;
+  return analyzer.GetAirwaySeeds( this->m_HeadFirst );
 }
 
  
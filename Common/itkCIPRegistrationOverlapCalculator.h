@@ -0,0 +1,231 @@
+/**
+ *  \class CIPRegistrationOverlapCalculator
+ *  \ingroup common
+ *  \brief Computes label map overlap statistics (Dice / ITK kappa and
+ *  Cohen's kappa) and CT similarity statistics (NCC, MSE, MI) between a
+ *  fixed image and a moving image mapped through a chain of affine
+ *  transforms, without resampling the moving image.
+ *
+ *  The affine chain is composed into a single matrix and folded together
+ *  with the fixed image index-to-physical and moving image
+ *  physical-to-index mappings, so that every fixed voxel maps to a moving
+ *  continuous index with one incremental add along each scanline. The
+ *  fixed grid is split into slabs that are processed by separate threads
+ *  with private accumulators, which are merged at the end. Statistics for
+ *  several label values are gathered in the same pass.
+ *
+ *  Transforms are added in the same order they are added to an
+ *  itk::CompositeTransform: the last transform added is applied first.
+ *
+ *  Moving label values are sampled with nearest neighbor interpolation and
+ *  moving CT values with linear interpolation, following the conventions
+ *  of itk::ResampleImageFilter (points outside the moving buffer read as
+ *  0 and interpolated CT values are cast to short), so the statistics
+ *  match those computed on a resampled moving image.
+ *
+ *  Label values are compared exactly (e.g. a value of 1 selects voxels
+ *  whose label map value is 1, as the ForegroundValue of
+ *  itk::KappaStatisticImageToImageMetric does).
+ *
+ *  $Date$
+ *  $Revision$
+ *  $Author$
+ *
+ */
+
+#ifndef __itkCIPRegistrationOverlapCalculator_h
+#define __itkCIPRegistrationOverlapCalculator_h
+
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+#include "itkImage.h"
+#include "itkMatrixOffsetTransformBase.h"
+#include "itkMultiThreader.h"
+
+#include <vector>
+
+namespace itk
+{
+
+template <unsigned int TDimension> class ITK_EXPORT CIPRegistrationOverlapCalculator :
+    public Object
+{
+public:
+  /** Standard class typedefs. */
+  typedef CIPRegistrationOverlapCalculator  Self;
+  typedef Object                            Superclass;
+  typedef SmartPointer<Self>                Pointer;
+  typedef SmartPointer<const Self>          ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(CIPRegistrationOverlapCalculator, Object);
+
+  itkStaticConstMacro( ImageDimension, unsigned int, TDimension );
+
+  typedef itk::Image< unsigned short, TDimension >                           LabelMapType;
+  typedef itk::Image< short, TDimension >                                    CTType;
+  typedef itk::MatrixOffsetTransformBase< double, TDimension, TDimension >   AffineTransformType;
+  typedef typename AffineTransformType::MatrixType                          MatrixType;
+  typedef typename AffineTransformType::OutputVectorType                    VectorType;
+  typedef typename LabelMapType::RegionType                                 RegionType;
+
+  /** Overlap between the fixed and the (transformed) moving label maps
+   *  for one label value. 'Dice' is the quantity reported by
+   *  itk::KappaStatisticImageToImageMetric: 2|F&M|/(|F|+|M|). */
+  struct OVERLAPSTATISTICS
+  {
+    unsigned short value;
+    unsigned long  fixedCount;
+    unsigned long  movingCount;
+    unsigned long  intersectionCount;
+    unsigned long  totalCount;
+    double         dice;
+    double         cohenKappa;
+  };
+
+  /** CT similarity inside the fixed label map region with the given
+   *  value. 'normalizedCorrelation' follows the sign and the (non mean
+   *  subtracted) definition of itk::NormalizedCorrelationImageToImageMetric;
+   *  'meanSquares' the definition of itk::MeanSquaresImageToImageMetric.
+   *  'mutualInformation' is computed from the joint histogram. */
+  struct INTENSITYSTATISTICS
+  {
+    unsigned short value;
+    unsigned long  count;
+    double         normalizedCorrelation;
+    double         meanSubtractedNormalizedCorrelation;
+    double         meanSquares;
+    double         mutualInformation;
+  };
+
+  /** Label maps to compare. The moving label map is optional when only
+   *  CT statistics are wanted; the fixed label map defines the regions
+   *  in which CT statistics are accumulated. */
+  itkSetConstObjectMacro( FixedLabelMap, LabelMapType );
+  itkGetConstObjectMacro( FixedLabelMap, LabelMapType );
+  itkSetConstObjectMacro( MovingLabelMap, LabelMapType );
+  itkGetConstObjectMacro( MovingLabelMap, LabelMapType );
+
+  /** CT images to compare (optional) */
+  itkSetConstObjectMacro( FixedCT, CTType );
+  itkGetConstObjectMacro( FixedCT, CTType );
+  itkSetConstObjectMacro( MovingCT, CTType );
+  itkGetConstObjectMacro( MovingCT, CTType );
+
+  /** Append a transform to the chain. The last transform added is
+   *  applied first (itk::CompositeTransform convention). */
+  void AddTransform( const AffineTransformType* );
+  void ClearTransforms();
+
+  /** Label values for which statistics are gathered. If none are set,
+   *  overlap statistics are computed for value 1 and CT statistics over
+   *  the whole fixed image. */
+  void AddValue( unsigned short value );
+  void ClearValues();
+
+  /** Number of bins per axis of the joint histogram used for MI, and the
+   *  intensity range it spans */
+  itkSetMacro( NumberOfHistogramBins, unsigned int );
+  itkGetMacro( NumberOfHistogramBins, unsigned int );
+  itkSetMacro( HistogramMinimum, double );
+  itkGetMacro( HistogramMinimum, double );
+  itkSetMacro( HistogramMaximum, double );
+  itkGetMacro( HistogramMaximum, double );
+
+  itkSetMacro( NumberOfThreads, unsigned int );
+  itkGetMacro( NumberOfThreads, unsigned int );
+
+  /** Walk the fixed grid once and compute all requested statistics */
+  void Compute();
+
+  const std::vector< OVERLAPSTATISTICS >& GetOverlapStatistics() const
+    {
+      return this->m_OverlapStatistics;
+    }
+  const std::vector< INTENSITYSTATISTICS >& GetIntensityStatistics() const
+    {
+      return this->m_IntensityStatistics;
+    }
+
+  /** Convenience accessor: Dice (ITK kappa) for the given value, or -1 if
+   *  the value was not requested */
+  double GetDice( unsigned short value ) const;
+
+  void PrintSelf( std::ostream& os, Indent indent ) const;
+
+  /** Process the fixed image slab [first, last] along the slowest axis.
+   *  Called by the threads. */
+  void ThreadedCompute( long first, long last, unsigned int threadId );
+
+protected:
+  CIPRegistrationOverlapCalculator();
+  virtual ~CIPRegistrationOverlapCalculator() {}
+
+  /** Per thread sums for one value */
+  struct ACCUMULATOR
+  {
+    unsigned long fixedCount;
+    unsigned long movingCount;
+    unsigned long intersectionCount;
+    unsigned long intensityCount;
+    double sumF;
+    double sumM;
+    double sumFF;
+    double sumMM;
+    double sumFM;
+    double sumSquaredDifferences;
+    std::vector< unsigned long > jointHistogram;
+  };
+
+  void InitializeMappings();
+  void ComputeIndexMapping( const ImageBase< TDimension >* movingImage,
+                            MatrixType& indexMatrix, VectorType& indexOffset ) const;
+  void InitializeAccumulator( ACCUMULATOR& ) const;
+  unsigned int GetHistogramBin( double ) const;
+
+  unsigned short SampleMovingLabel( const double* cindex ) const;
+  short SampleMovingCT( const double* cindex ) const;
+
+private:
+  CIPRegistrationOverlapCalculator(const Self&); //purposely not implemented
+  void operator=(const Self&); //purposely not implemented
+
+  typename LabelMapType::ConstPointer  m_FixedLabelMap;
+  typename LabelMapType::ConstPointer  m_MovingLabelMap;
+  typename CTType::ConstPointer        m_FixedCT;
+  typename CTType::ConstPointer        m_MovingCT;
+
+  std::vector< typename AffineTransformType::ConstPointer > m_Transforms;
+  std::vector< unsigned short >                            m_Values;
+
+  unsigned int m_NumberOfHistogramBins;
+  double       m_HistogramMinimum;
+  double       m_HistogramMaximum;
+  unsigned int m_NumberOfThreads;
+
+  // Fixed index -> moving continuous index mappings
+  MatrixType m_LabelIndexMatrix;
+  VectorType m_LabelIndexOffset;
+  MatrixType m_CTIndexMatrix;
+  VectorType m_CTIndexOffset;
+
+  // Fixed grid that is walked (label map grid if set, CT grid otherwise)
+  RegionType m_FixedRegion;
+
+  std::vector< std::vector< ACCUMULATOR > >  m_ThreadAccumulators;
+  std::vector< unsigned long >               m_ThreadTotalCounts;
+
+  std::vector< OVERLAPSTATISTICS >    m_OverlapStatistics;
+  std::vector< INTENSITYSTATISTICS >  m_IntensityStatistics;
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkCIPRegistrationOverlapCalculator.txx"
+#endif
+
+#endif
@@ -0,0 +1,659 @@
+#ifndef _itkCIPRegistrationOverlapCalculator_txx
+#define _itkCIPRegistrationOverlapCalculator_txx
+
+#include "itkCIPRegistrationOverlapCalculator.h"
+#include "itkNumericTraits.h"
+
+#include <cmath>
+#include <limits>
+
+namespace itk
+{
+
+/** Arguments handed to the threads by Compute() */
+template < unsigned int TDimension >
+struct CIPRegistrationOverlapCalculatorThreadStruct
+{
+  CIPRegistrationOverlapCalculator< TDimension >* Calculator;
+  long First;
+  long Last;
+};
+
+template < unsigned int TDimension >
+ITK_THREAD_RETURN_TYPE CIPRegistrationOverlapCalculatorThreaderCallback( void* arg )
+{
+  typedef MultiThreader::ThreadInfoStruct ThreadInfoType;
+
+  unsigned int threadId    = static_cast< ThreadInfoType* >( arg )->ThreadID;
+  unsigned int threadCount = static_cast< ThreadInfoType* >( arg )->NumberOfThreads;
+
+  CIPRegistrationOverlapCalculatorThreadStruct< TDimension >* str =
+    static_cast< CIPRegistrationOverlapCalculatorThreadStruct< TDimension >* >
+    ( static_cast< ThreadInfoType* >( arg )->UserData );
+
+  // Split the slowest axis into contiguous slabs
+  long numSlices = str->Last - str->First + 1;
+  long slicesPerThread = (numSlices + threadCount - 1)/threadCount;
+  long first = str->First + long(threadId)*slicesPerThread;
+  long last  = first + slicesPerThread - 1;
+  if ( last > str->Last )
+    {
+    last = str->Last;
+    }
+
+  if ( first <= last )
+    {
+    str->Calculator->ThreadedCompute( first, last, threadId );
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template < unsigned int TDimension >
+CIPRegistrationOverlapCalculator< TDimension >
+::CIPRegistrationOverlapCalculator()
+{
+  this->m_NumberOfHistogramBins = 64;
+  this->m_HistogramMinimum      = -1024;
+  this->m_HistogramMaximum      = 1024;
+  this->m_NumberOfThreads       = MultiThreader::GetGlobalDefaultNumberOfThreads();
+}
+
+template < unsigned int TDimension >
+void
+CIPRegistrationOverlapCalculator< TDimension >
+::AddTransform( const AffineTransformType* transform )
+{
+  this->m_Transforms.push_back( transform );
+  this->Modified();
+}
+
+template < unsigned int TDimension >
+void
+CIPRegistrationOverlapCalculator< TDimension >
+::ClearTransforms()
+{
+  this->m_Transforms.clear();
+  this->Modified();
+}
+
+template < unsigned int TDimension >
+void
+CIPRegistrationOverlapCalculator< TDimension >
+::AddValue( unsigned short value )
+{
+  this->m_Values.push_back( value );
+  this->Modified();
+}
+
+template < unsigned int TDimension >
+void
+CIPRegistrationOverlapCalculator< TDimension >
+::ClearValues()
+{
+  this->m_Values.clear();
+  this->Modified();
+}
+
+/** Compute the affine map taking a fixed image index to the continuous
+ *  index of the moving image: cindex = indexMatrix*index + indexOffset */
+template < unsigned int TDimension >
+void
+CIPRegistrationOverlapCalculator< TDimension >
+::ComputeIndexMapping( const ImageBase< TDimension >* movingImage,
+                       MatrixType& indexMatrix, VectorType& indexOffset ) const
+{
+  const ImageBase< TDimension >* fixedImage;
+  if ( this->m_FixedLabelMap.IsNotNull() )
+    {
+    fixedImage = this->m_FixedLabelMap.GetPointer();
+    }
+  else
+    {
+    fixedImage = this->m_FixedCT.GetPointer();
+    }
+
+  // Compose the transform chain. The last transform added is applied
+  // first, as in itk::CompositeTransform.
+  MatrixType matrix;
+  matrix.SetIdentity();
+  VectorType offset;
+  offset.Fill( 0.0 );
+  for ( int i = int(this->m_Transforms.size()) - 1; i >= 0; i-- )
+    {
+    matrix = this->m_Transforms[i]->GetMatrix()*matrix;
+    offset = this->m_Transforms[i]->GetMatrix()*offset + this->m_Transforms[i]->GetOffset();
+    }
+
+  VectorType fixedOrigin;
+  VectorType movingOrigin;
+  for ( unsigned int d = 0; d < TDimension; d++ )
+    {
+    fixedOrigin[d]  = fixedImage->GetOrigin()[d];
+    movingOrigin[d] = movingImage->GetOrigin()[d];
+    }
+
+  const MatrixType& fixedIndexToPhysical  = fixedImage->GetIndexToPhysicalPoint();
+  const MatrixType& movingPhysicalToIndex = movingImage->GetPhysicalPointToIndex();
+
+  indexMatrix = movingPhysicalToIndex*matrix*fixedIndexToPhysical;
+  indexOffset = movingPhysicalToIndex*(matrix*fixedOrigin + offset - movingOrigin);
+}
+
+template < unsigned int TDimension >
+void
+CIPRegistrationOverlapCalculator< TDimension >
+::InitializeMappings()
+{
+  if ( this->m_MovingLabelMap.IsNotNull() )
+    {
+    this->ComputeIndexMapping( this->m_MovingLabelMap.GetPointer(),
+                               this->m_LabelIndexMatrix, this->m_LabelIndexOffset );
+    }
+  if ( this->m_MovingCT.IsNotNull() )
+    {
+    this->ComputeIndexMapping( this->m_MovingCT.GetPointer(),
+                               this->m_CTIndexMatrix, this->m_CTIndexOffset );
+    }
+}
+
+template < unsigned int TDimension >
+void
+CIPRegistrationOverlapCalculator< TDimension >
+::InitializeAccumulator( ACCUMULATOR& acc ) const
+{
+  acc.fixedCount            = 0;
+  acc.movingCount           = 0;
+  acc.intersectionCount     = 0;
+  acc.intensityCount        = 0;
+  acc.sumF                  = 0.0;
+  acc.sumM                  = 0.0;
+  acc.sumFF                 = 0.0;
+  acc.sumMM                 = 0.0;
+  acc.sumFM                 = 0.0;
+  acc.sumSquaredDifferences = 0.0;
+  acc.jointHistogram.assign( this->m_NumberOfHistogramBins*this->m_NumberOfHistogramBins, 0 );
+}
+
+template < unsigned int TDimension >
+unsigned int
+CIPRegistrationOverlapCalculator< TDimension >
+::GetHistogramBin( double value ) const
+{
+  double range = this->m_HistogramMaximum - this->m_HistogramMinimum;
+  double bin = (value - this->m_HistogramMinimum)/range*double(this->m_NumberOfHistogramBins);
+  if ( bin < 0.0 )
+    {
+    return 0;
+    }
+  if ( bin >= double(this->m_NumberOfHistogramBins) )
+    {
+    return this->m_NumberOfHistogramBins - 1;
+    }
+  return static_cast< unsigned int >( bin );
+}
+
+/** Nearest neighbor lookup with the buffer limits used by
+ *  itk::NearestNeighborInterpolateImageFunction. Outside reads 0, which is
+ *  the default pixel value of itk::ResampleImageFilter. */
+template < unsigned int TDimension >
+unsigned short
+CIPRegistrationOverlapCalculator< TDimension >
+::SampleMovingLabel( const double* cindex ) const
+{
+  const RegionType& region = this->m_MovingLabelMap->GetBufferedRegion();
+  typename LabelMapType::IndexType index;
+  for ( unsigned int d = 0; d < TDimension; d++ )
+    {
+    double start = double(region.GetIndex()[d]) - 0.5;
+    double end   = double(region.GetIndex()[d] + long(region.GetSize()[d])) - 0.5;
+    if ( !(cindex[d] >= start) || !(cindex[d] < end) )
+      {
+      return 0;
+      }
+    index[d] = static_cast< typename LabelMapType::IndexValueType >( std::floor( cindex[d] + 0.5 ) );
+    if ( index[d] > region.GetIndex()[d] + long(region.GetSize()[d]) - 1 )
+      {
+      index[d] = region.GetIndex()[d] + long(region.GetSize()[d]) - 1;
+      }
+    }
+
+  return this->m_MovingLabelMap->GetPixel( index );
+}
+
+/** Linear interpolation with the edge handling of
+ *  itk::LinearInterpolateImageFunction, followed by the bounds checked cast
+ *  of itk::ResampleImageFilter */
+template < unsigned int TDimension >
+short
+CIPRegistrationOverlapCalculator< TDimension >
+::SampleMovingCT( const double* cindex ) const
+{
+  const RegionType& region = this->m_MovingCT->GetBufferedRegion();
+
+  long   base[TDimension];
+  long   next[TDimension];
+  double dist[TDimension];
+  for ( unsigned int d = 0; d < TDimension; d++ )
+    {
+    long startIndex = region.GetIndex()[d];
+    long endIndex   = startIndex + long(region.GetSize()[d]) - 1;
+    if ( !(cindex[d] >= double(startIndex) - 0.5) || !(cindex[d] < double(endIndex) + 0.5) )
+      {
+      return 0;
+      }
+    base[d] = static_cast< long >( std::floor( cindex[d] ) );
+    if ( base[d] < startIndex )
+      {
+      base[d] = startIndex;
+      }
+    dist[d] = cindex[d] - double(base[d]);
+    if ( dist[d] < 0.0 )
+      {
+      dist[d] = 0.0;
+      }
+    next[d] = (base[d] + 1 > endIndex) ? base[d] : base[d] + 1;
+    }
+
+  double value = 0.0;
+  typename CTType::IndexType index;
+  for ( unsigned int corner = 0; corner < (1u << TDimension); corner++ )
+    {
+    double weight = 1.0;
+    for ( unsigned int d = 0; d < TDimension; d++ )
+      {
+      if ( corner & (1u << d) )
+        {
+        index[d] = next[d];
+        weight  *= dist[d];
+        }
+      else
+        {
+        index[d] = base[d];
+        weight  *= 1.0 - dist[d];
+        }
+      }
+    if ( weight != 0.0 )
+      {
+      value += weight*double(this->m_MovingCT->GetPixel( index ));
+      }
+    }
+
+  if ( value < double(NumericTraits< short >::NonpositiveMin()) )
+    {
+    return NumericTraits< short >::NonpositiveMin();
+    }
+  if ( value > double(NumericTraits< short >::max()) )
+    {
+    return NumericTraits< short >::max();
+    }
+  return static_cast< short >( value );
+}
+
+template < unsigned int TDimension >
+void
+CIPRegistrationOverlapCalculator< TDimension >
+::ThreadedCompute( long first, long last, unsigned int threadId )
+{
+  std::vector< ACCUMULATOR >& accumulators = this->m_ThreadAccumulators[threadId];
+  unsigned int numValues = static_cast< unsigned int >( this->m_Values.size() );
+
+  bool useLabels = this->m_FixedLabelMap.IsNotNull() && this->m_MovingLabelMap.IsNotNull();
+  bool useCT     = this->m_FixedCT.IsNotNull() && this->m_MovingCT.IsNotNull();
+  bool useMask   = this->m_FixedLabelMap.IsNotNull();
+
+  // Sub region handled by this thread
+  RegionType region = this->m_FixedRegion;
+  typename RegionType::IndexType start = region.GetIndex();
+  typename RegionType::SizeType  size  = region.GetSize();
+  start[TDimension-1] = first;
+  size[TDimension-1]  = static_cast< typename RegionType::SizeValueType >( last - first + 1 );
+
+  unsigned long numLines = 1;
+  for ( unsigned int d = 1; d < TDimension; d++ )
+    {
+    numLines *= size[d];
+    }
+
+  typename LabelMapType::IndexType index;
+  double labelCIndex[TDimension];
+  double ctCIndex[TDimension];
+  unsigned long voxelCount = 0;
+
+  for ( unsigned long line = 0; line < numLines; line++ )
+    {
+    // Index of the first voxel of this line
+    unsigned long rem = line;
+    index[0] = start[0];
+    for ( unsigned int d = 1; d < TDimension; d++ )
+      {
+      index[d] = start[d] + long(rem % size[d]);
+      rem /= size[d];
+      }
+
+    // Continuous moving indices at the start of the line
+    for ( unsigned int r = 0; r < TDimension; r++ )
+      {
+      labelCIndex[r] = this->m_LabelIndexOffset[r];
+      ctCIndex[r]    = this->m_CTIndexOffset[r];
+      for ( unsigned int c = 0; c < TDimension; c++ )
+        {
+        labelCIndex[r] += this->m_LabelIndexMatrix[r][c]*double(index[c]);
+        ctCIndex[r]    += this->m_CTIndexMatrix[r][c]*double(index[c]);
+        }
+      }
+
+    const unsigned short* fixedLabelPtr = NULL;
+    const short*          fixedCTPtr    = NULL;
+    if ( useMask )
+      {
+      fixedLabelPtr = this->m_FixedLabelMap->GetBufferPointer() +
+        this->m_FixedLabelMap->ComputeOffset( index );
+      }
+    if ( useCT )
+      {
+      fixedCTPtr = this->m_FixedCT->GetBufferPointer() +
+        this->m_FixedCT->ComputeOffset( index );
+      }
+
+    for ( unsigned long x = 0; x < size[0]; x++ )
+      {
+      unsigned short fixedLabel  = useMask ? fixedLabelPtr[x] : 0;
+      unsigned short movingLabel = useLabels ? this->SampleMovingLabel( labelCIndex ) : 0;
+
+      double fixedValue  = 0.0;
+      double movingValue = 0.0;
+      unsigned int jointBin = 0;
+      if ( useCT )
+        {
+        fixedValue  = double(fixedCTPtr[x]);
+        movingValue = double(this->SampleMovingCT( ctCIndex ));
+        jointBin = this->GetHistogramBin( fixedValue )*this->m_NumberOfHistogramBins +
+          this->GetHistogramBin( movingValue );
+        }
+
+      for ( unsigned int v = 0; v < numValues; v++ )
+        {
+        ACCUMULATOR& acc = accumulators[v];
+        unsigned short value = this->m_Values[v];
+
+        if ( useLabels )
+          {
+          if ( fixedLabel == value )
+            {
+            acc.fixedCount++;
+            }
+          if ( movingLabel == value )
+            {
+            acc.movingCount++;
+            if ( fixedLabel == value )
+              {
+              acc.intersectionCount++;
+              }
+            }
+          }
+
+        if ( useCT && (!useMask || fixedLabel == value) )
+          {
+          acc.intensityCount++;
+          acc.sumF  += fixedValue;
+          acc.sumM  += movingValue;
+          acc.sumFF += fixedValue*fixedValue;
+          acc.sumMM += movingValue*movingValue;
+          acc.sumFM += fixedValue*movingValue;
+          acc.sumSquaredDifferences += (fixedValue - movingValue)*(fixedValue - movingValue);
+          acc.jointHistogram[jointBin]++;
+          }
+        }
+
+      voxelCount++;
+      for ( unsigned int r = 0; r < TDimension; r++ )
+        {
+        labelCIndex[r] += this->m_LabelIndexMatrix[r][0];
+        ctCIndex[r]    += this->m_CTIndexMatrix[r][0];
+        }
+      }
+    }
+
+  this->m_ThreadTotalCounts[threadId] += voxelCount;
+}
+
+template < unsigned int TDimension >
+void
+CIPRegistrationOverlapCalculator< TDimension >
+::Compute()
+{
+  if ( this->m_FixedLabelMap.IsNull() && this->m_FixedCT.IsNull() )
+    {
+    itkExceptionMacro( << "A fixed label map or a fixed CT must be set" );
+    }
+  if ( this->m_FixedCT.IsNotNull() && this->m_FixedLabelMap.IsNotNull() &&
+       this->m_FixedCT->GetBufferedRegion() != this->m_FixedLabelMap->GetBufferedRegion() )
+    {
+    itkExceptionMacro( << "The fixed CT and the fixed label map must share the same grid" );
+    }
+  if ( this->m_NumberOfHistogramBins == 0 || !(this->m_HistogramMaximum > this->m_HistogramMinimum) )
+    {
+    itkExceptionMacro( << "Invalid joint histogram configuration" );
+    }
+
+  // Without a fixed label map CT statistics cover the whole image; value
+  // 0 is used as a placeholder. Overlap defaults to foreground value 1.
+  bool valuesWereEmpty = this->m_Values.empty();
+  if ( valuesWereEmpty )
+    {
+    this->m_Values.push_back( this->m_FixedLabelMap.IsNotNull() ? 1 : 0 );
+    }
+
+  if ( this->m_FixedLabelMap.IsNotNull() )
+    {
+    this->m_FixedRegion = this->m_FixedLabelMap->GetBufferedRegion();
+    }
+  else
+    {
+    this->m_FixedRegion = this->m_FixedCT->GetBufferedRegion();
+    }
+
+  this->m_LabelIndexMatrix.SetIdentity();
+  this->m_LabelIndexOffset.Fill( 0.0 );
+  this->m_CTIndexMatrix.SetIdentity();
+  this->m_CTIndexOffset.Fill( 0.0 );
+  this->InitializeMappings();
+
+  unsigned int numThreads = this->m_NumberOfThreads;
+  if ( numThreads < 1 )
+    {
+    numThreads = 1;
+    }
+  if ( numThreads > this->m_FixedRegion.GetSize()[TDimension-1] )
+    {
+    numThreads = static_cast< unsigned int >( this->m_FixedRegion.GetSize()[TDimension-1] );
+    }
+
+  this->m_ThreadAccumulators.resize( numThreads );
+  this->m_ThreadTotalCounts.assign( numThreads, 0 );
+  for ( unsigned int t = 0; t < numThreads; t++ )
+    {
+    this->m_ThreadAccumulators[t].resize( this->m_Values.size() );
+    for ( unsigned int v = 0; v < this->m_Values.size(); v++ )
+      {
+      this->InitializeAccumulator( this->m_ThreadAccumulators[t][v] );
+      }
+    }
+
+  CIPRegistrationOverlapCalculatorThreadStruct< TDimension > str;
+    str.Calculator = this;
+    str.First      = this->m_FixedRegion.GetIndex()[TDimension-1];
+    str.Last       = str.First + long(this->m_FixedRegion.GetSize()[TDimension-1]) - 1;
+
+  MultiThreader::Pointer threader = MultiThreader::New();
+    threader->SetNumberOfThreads( numThreads );
+    threader->SetSingleMethod( CIPRegistrationOverlapCalculatorThreaderCallback< TDimension >, &str );
+    threader->SingleMethodExecute();
+
+  // Merge the per thread sums
+  unsigned long totalCount = 0;
+  for ( unsigned int t = 0; t < numThreads; t++ )
+    {
+    totalCount += this->m_ThreadTotalCounts[t];
+    }
+
+  this->m_OverlapStatistics.clear();
+  this->m_IntensityStatistics.clear();
+
+  unsigned int numBins = this->m_NumberOfHistogramBins;
+  for ( unsigned int v = 0; v < this->m_Values.size(); v++ )
+    {
+    ACCUMULATOR acc;
+    this->InitializeAccumulator( acc );
+    for ( unsigned int t = 0; t < numThreads; t++ )
+      {
+      const ACCUMULATOR& tacc = this->m_ThreadAccumulators[t][v];
+      acc.fixedCount            += tacc.fixedCount;
+      acc.movingCount           += tacc.movingCount;
+      acc.intersectionCount     += tacc.intersectionCount;
+      acc.intensityCount        += tacc.intensityCount;
+      acc.sumF                  += tacc.sumF;
+      acc.sumM                  += tacc.sumM;
+      acc.sumFF                 += tacc.sumFF;
+      acc.sumMM                 += tacc.sumMM;
+      acc.sumFM                 += tacc.sumFM;
+      acc.sumSquaredDifferences += tacc.sumSquaredDifferences;
+      for ( unsigned int b = 0; b < numBins*numBins; b++ )
+        {
+        acc.jointHistogram[b] += tacc.jointHistogram[b];
+        }
+      }
+
+    if ( this->m_FixedLabelMap.IsNotNull() && this->m_MovingLabelMap.IsNotNull() )
+      {
+      OVERLAPSTATISTICS overlap;
+        overlap.value             = this->m_Values[v];
+        overlap.fixedCount        = acc.fixedCount;
+        overlap.movingCount       = acc.movingCount;
+        overlap.intersectionCount = acc.intersectionCount;
+        overlap.totalCount        = totalCount;
+        overlap.dice              = 0.0;
+        overlap.cohenKappa        = 0.0;
+
+      if ( acc.fixedCount + acc.movingCount > 0 )
+        {
+        overlap.dice = 2.0*double(acc.intersectionCount)/double(acc.fixedCount + acc.movingCount);
+        }
+      if ( totalCount > 0 )
+        {
+        double n  = double(totalCount);
+        double po = (double(acc.intersectionCount) +
+                     (n - double(acc.fixedCount) - double(acc.movingCount) + double(acc.intersectionCount)))/n;
+        double pe = (double(acc.fixedCount)*double(acc.movingCount) +
+                     (n - double(acc.fixedCount))*(n - double(acc.movingCount)))/(n*n);
+        if ( pe < 1.0 )
+          {
+          overlap.cohenKappa = (po - pe)/(1.0 - pe);
+          }
+        }
+
+      this->m_OverlapStatistics.push_back( overlap );
+      }
+
+    if ( this->m_FixedCT.IsNotNull() && this->m_MovingCT.IsNotNull() )
+      {
+      INTENSITYSTATISTICS intensity;
+        intensity.value                               = this->m_Values[v];
+        intensity.count                               = acc.intensityCount;
+        intensity.normalizedCorrelation               = 0.0;
+        intensity.meanSubtractedNormalizedCorrelation = 0.0;
+        intensity.meanSquares                         = 0.0;
+        intensity.mutualInformation                   = 0.0;
+
+      if ( acc.intensityCount > 0 )
+        {
+        double n = double(acc.intensityCount);
+
+        double denom = -1.0*std::sqrt( acc.sumFF*acc.sumMM );
+        if ( denom != 0.0 )
+          {
+          intensity.normalizedCorrelation = acc.sumFM/denom;
+          }
+
+        double sff = acc.sumFF - acc.sumF*acc.sumF/n;
+        double smm = acc.sumMM - acc.sumM*acc.sumM/n;
+        double sfm = acc.sumFM - acc.sumF*acc.sumM/n;
+        denom = -1.0*std::sqrt( sff*smm );
+        if ( denom != 0.0 )
+          {
+          intensity.meanSubtractedNormalizedCorrelation = sfm/denom;
+          }
+
+        intensity.meanSquares = acc.sumSquaredDifferences/n;
+
+        std::vector< double > fixedMarginal( numBins, 0.0 );
+        std::vector< double > movingMarginal( numBins, 0.0 );
+        for ( unsigned int i = 0; i < numBins; i++ )
+          {
+          for ( unsigned int j = 0; j < numBins; j++ )
+            {
+            double p = double(acc.jointHistogram[i*numBins + j])/n;
+            fixedMarginal[i]  += p;
+            movingMarginal[j] += p;
+            }
+          }
+        for ( unsigned int i = 0; i < numBins; i++ )
+          {
+          for ( unsigned int j = 0; j < numBins; j++ )
+            {
+            double p = double(acc.jointHistogram[i*numBins + j])/n;
+            if ( p > 0.0 )
+              {
+              intensity.mutualInformation += p*std::log( p/(fixedMarginal[i]*movingMarginal[j]) );
+              }
+            }
+          }
+        }
+
+      this->m_IntensityStatistics.push_back( intensity );
+      }
+    }
+
+  this->m_ThreadAccumulators.clear();
+
+  if ( valuesWereEmpty )
+    {
+    this->m_Values.clear();
+    }
+}
+
+template < unsigned int TDimension >
+double
+CIPRegistrationOverlapCalculator< TDimension >
+::GetDice( unsigned short value ) const
+{
+  for ( unsigned int i = 0; i < this->m_OverlapStatistics.size(); i++ )
+    {
+    if ( this->m_OverlapStatistics[i].value == value )
+      {
+      return this->m_OverlapStatistics[i].dice;
+      }
+    }
+
+  return -1.0;
+}
+
+/**
+ * Standard "PrintSelf" method
+ */
+template < unsigned int TDimension >
+void
+CIPRegistrationOverlapCalculator< TDimension >
+::PrintSelf( std::ostream& os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+  os << indent << "Number of transforms: " << this->m_Transforms.size() << std::endl;
+  os << indent << "Number of values: " << this->m_Values.size() << std::endl;
+  os << indent << "Number of histogram bins: " << this->m_NumberOfHistogramBins << std::endl;
+  os << indent << "Number of threads: " << this->m_NumberOfThreads << std::endl;
+}
+
+} // end namespace itk
+
+#endif
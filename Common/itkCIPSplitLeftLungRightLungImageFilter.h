@@ -4,6 +4,12 @@
  * itkLungConventions.h. The output of this filter is a lung label map
  * image with the left and right lungs split. No relabeling is
  * performed. 
+ *
+ * Whether the lungs are merged is first tested for every axial slice
+ * concurrently. Merged slices are then grouped into runs: a run ends
+ * once enough unmerged slices follow it that the search region of
+ * the last split is no longer reused. The runs do not depend on each
+ * other and are split concurrently, each one slice after the other.
  */
 
 #ifndef __itkCIPSplitLeftLungRightLungImageFilter_h
@@ -11,9 +17,9 @@
 
 #include "itkImageToImageFilter.h"
 #include "itkImage.h"
-#include "itkConnectedComponentImageFilter.h"
 #include "itkImageRegionIteratorWithIndex.h"
-#include "itkExtractImageFilter.h"
+#include "itkMultiThreader.h"
+#include "itkSimpleFastMutexLock.h"
 #include "cipChestConventions.h"
 #include "itkCIPDijkstraGraphTraits.h"
 #include "itkGraph.h" 
@@ -96,12 +102,9 @@ protected:
   typedef LabelMapSliceType::IndexType               LabelMapSliceIndexType;
 
   typedef itk::Image< InputPixelType, 2 >                                                        InputImageSliceType;
-  typedef itk::ConnectedComponentImageFilter< LabelMapSliceType, LabelMapSliceType >             ConnectedComponent2DType;
   typedef itk::ImageRegionIteratorWithIndex< LabelMapType >                                      LabelMapIteratorType;
   typedef itk::ImageRegionConstIterator< InputImageType >                                        InputIteratorType;
   typedef itk::ImageRegionIteratorWithIndex< LabelMapSliceType >                                 LabelMapSliceIteratorType;
-  typedef itk::ExtractImageFilter< InputImageType, InputImageSliceType >                         InputExtractorType;
-  typedef itk::ExtractImageFilter< LabelMapType, LabelMapSliceType >                             LabelMapExtractorType;
   typedef unsigned long                                                                          GraphTraitsScalarType;
   typedef itk::CIPDijkstraGraphTraits< GraphTraitsScalarType, 2 >                                GraphTraitsType;
   typedef itk::Graph< GraphTraitsType >                                                          GraphType;
@@ -109,26 +112,61 @@ protected:
   typedef itk::CIPDijkstraImageToGraphFunctor< InputSliceType, GraphType >                       FunctorType;
   typedef itk::CIPDijkstraMinCostPathGraphToGraphFilter< GraphType, GraphType >                  MinPathType;
 
+  /** The search region and path of the split being made in a run of
+   *  merged slices. Each run being split has its own. */
+  struct SPLITSTATE
+  {
+    std::vector< LabelMapSliceType::IndexType >  minCostPathIndices;
+    std::vector< LabelMapSliceType::IndexType >  erasedSliceIndices;
+    LabelMapType::IndexType                      startSearchIndex;
+    LabelMapType::IndexType                      endSearchIndex;
+    typename InputImageType::SizeType            graphROISize;
+    typename InputImageType::IndexType           graphROIStartIndex;
+    bool                                         useLocalGraphROI;
+  };
+
+  /** Work shared by the threads. Slices (merge test) or runs of
+   *  slices (splitting) are handed out one at a time. */
+  struct THREADSTRUCT
+  {
+    CIPSplitLeftLungRightLungImageFilter*  filter;
+    std::vector< unsigned char >           merged;
+    std::vector< unsigned int >            runStarts;
+    std::vector< unsigned int >            runEnds;
+    unsigned int                           nextItem;
+    SimpleFastMutexLock                    mutex;
+  };
+
   CIPSplitLeftLungRightLungImageFilter();
   virtual ~CIPSplitLeftLungRightLungImageFilter() {}
 
-  void ExtractLabelMapSlice( LabelMapType::Pointer, LabelMapSliceType::Pointer, int );
+  static ITK_THREAD_RETURN_TYPE TestSlicesThreaderCallback( void* );
+  static ITK_THREAD_RETURN_TYPE SplitRunsThreaderCallback( void* );
+
+  void RunThreads( ThreadFunctionType, THREADSTRUCT*, unsigned int );
 
-  void FindMinCostPath();
+  void FindMinCostPath( SPLITSTATE& );
 
-  bool GetLungsMergedInSliceRegion( int, int, int, int, int );
+  /** Whether a single 8-connected object touches both the left and
+   *  right borders of the region of slice 'whichSlice' starting at
+   *  column 'startX' and 'sizeX' columns wide. 'parents' is work
+   *  space for the union-find. */
+  bool GetLungsMergedInSliceRegion( int startX, int sizeX, int whichSlice, std::vector< unsigned int >& parents );
+
+  /** Split the merged slices from 'firstSlice' to 'lastSlice', in order */
+  void SplitRun( unsigned int firstSlice, unsigned int lastSlice, const std::vector< unsigned char >& mergedSlices );
 
   /** Given a min cost path through a slice, this function will erase
       all pixels that fall on the path (including those with a specified
       radius of each path pixl). The function also records those slice
       indices that were actualy erased for later use. */
-  void EraseConnection( unsigned int );
+  void EraseConnection( SPLITSTATE&, unsigned int );
 
   /** */
-  void SetDefaultGraphROIAndSearchIndices( unsigned int );
+  void SetDefaultGraphROIAndSearchIndices( SPLITSTATE&, unsigned int );
 
   /** */
-  void SetLocalGraphROIAndSearchIndices( unsigned int );
+  void SetLocalGraphROIAndSearchIndices( SPLITSTATE&, unsigned int );
 
   void GenerateData();
 
@@ -141,14 +179,6 @@ private:
   double  m_ExponentialCoefficient;
   double  m_ExponentialTimeConstant;
   int     m_LeftRightLungSplitRadius;
-
-  std::vector< LabelMapSliceType::IndexType >  m_MinCostPathIndices;
-  std::vector< LabelMapSliceType::IndexType >  m_ErasedSliceIndices;
-  LabelMapType::IndexType                      m_StartSearchIndex;
-  LabelMapType::IndexType                      m_EndSearchIndex;
-  typename InputImageType::SizeType            m_GraphROISize;
-  typename InputImageType::IndexType           m_GraphROIStartIndex;
-  bool                                         m_UseLocalGraphROI;
 };
   
 } // end namespace itk
@@ -3,6 +3,10 @@
 
 #include "itkCIPSplitLeftLungRightLungImageFilter.h"
 #include "cipExceptionObject.h"
+#include "cipInstrumentation.h"
+#include "itkImageRegionIterator.h"
+
+#include <algorithm>
 
 namespace itk
 {
@@ -14,7 +18,6 @@ CIPSplitLeftLungRightLungImageFilter< TInputImage >
   this->m_ExponentialCoefficient      = 200;
   this->m_ExponentialTimeConstant     = -700;
   this->m_LeftRightLungSplitRadius    = 1;
-  this->m_UseLocalGraphROI            = true;
 }
 
 
@@ -29,6 +32,9 @@ CIPSplitLeftLungRightLungImageFilter< TInputImage >
       				  "Lung label map not set" );
     }
 
+  cip::ScopedTimer timer( "CIPSplitLeftLungRightLungImageFilter" );
+    timer.AddVoxels( this->GetInput()->GetBufferedRegion().GetNumberOfPixels() );
+
   typename Superclass::InputImageConstPointer inputPtr  = this->GetInput();
   typename Superclass::OutputImagePointer     outputPtr = this->GetOutput(0);
     outputPtr->SetRequestedRegion( inputPtr->GetRequestedRegion() );
@@ -52,10 +58,60 @@ CIPSplitLeftLungRightLungImageFilter< TInputImage >
 
   LabelMapType::SizeType size = this->GetOutput()->GetBufferedRegion().GetSize();
 
-  int minX = size[0]/3;
-  int maxX = size[0]-size[0]/3;
-  int minY = 0;
-  int maxY = size[1]-1;
+  // Test every slice for a connection between the lungs
+  THREADSTRUCT str;
+    str.filter   = this;
+    str.merged.resize( size[2], 0 );
+    str.nextItem = 0;
+
+  this->RunThreads( TestSlicesThreaderCallback, &str, size[2] );
+
+  // Group the merged slices into runs. Splitting a slice only erases
+  // voxels, so slices that are not merged now will not be merged later.
+  // The search region of a split is reused for the following slices
+  // until more than 10 slices in a row are found not to be merged, after
+  // which the next merged slice starts from the default search region
+  // regardless of what came before. Runs separated by that many slices
+  // are therefore independent, and since a split erases voxels at most
+  // one slice away, they do not touch each other's voxels either.
+  const unsigned int minSlicesBetweenRuns = 12;
+
+  unsigned int slicesSinceLastMerged = minSlicesBetweenRuns;
+  for ( unsigned int i=0; i<size[2]; i++ )
+    {
+    if ( !str.merged[i] )
+      {
+      slicesSinceLastMerged++;
+      continue;
+      }
+
+    if ( slicesSinceLastMerged >= minSlicesBetweenRuns )
+      {
+      str.runStarts.push_back( i );
+      str.runEnds.push_back( i );
+      }
+    str.runEnds.back() = i;
+
+    slicesSinceLastMerged = 0;
+    }
+
+  str.nextItem = 0;
+
+  this->RunThreads( SplitRunsThreaderCallback, &str, str.runStarts.size() );
+}
+
+
+template< class TInputImage >
+void
+CIPSplitLeftLungRightLungImageFilter< TInputImage >
+::SplitRun( unsigned int firstSlice, unsigned int lastSlice, const std::vector< unsigned char >& mergedSlices )
+{
+  LabelMapType::SizeType size = this->GetOutput()->GetBufferedRegion().GetSize();
+
+  SPLITSTATE state;
+    state.useLocalGraphROI = false;
+
+  std::vector< unsigned int > parents;
 
   // We will look through each slice, test whether or not there appears to be
   // a connection and, if so, we will split. The region to consider for a given
@@ -64,19 +120,12 @@ CIPSplitLeftLungRightLungImageFilter< TInputImage >
   // a split, we will initiate the min cost path search at the top middle of 
   // the ROI and designate as the endpoint of the path the lower middle of
   // the ROI.
-  typename InputImageSliceType::IndexType searchStartIndex;
-    searchStartIndex[0] = (maxX + minX)/2;
-    searchStartIndex[1] = minY;
-
-  typename InputImageSliceType::IndexType searchEndIndex;        
-    searchEndIndex[0] = (maxX + minX)/2;
-    searchEndIndex[1] = maxY;
-
-  unsigned int slicesSinceLastSplit = size[2];
+  unsigned int slicesSinceLastSplit = 11;
 
-  for ( unsigned int i=0; i<size[2]; i++ )
+  for ( unsigned int i=firstSlice; i<=lastSlice; i++ )
     {
-    bool merged = this->GetLungsMergedInSliceRegion( size[0]/3, 0, size[0]/3, size[1], i ); 
+    // Splitting the previous slice may have erased the connection
+    bool merged = mergedSlices[i] && this->GetLungsMergedInSliceRegion( size[0]/3, size[0]/3, i, parents );
 
     // We will only use the local search region provided that 
     // we're relatively near the slice where we had our last
@@ -85,7 +134,7 @@ CIPSplitLeftLungRightLungImageFilter< TInputImage >
       {
 	if ( slicesSinceLastSplit > 10 )
 	  {
-	    this->m_UseLocalGraphROI = false;
+	    state.useLocalGraphROI = false;
 	  }
 	else
 	  {
@@ -96,27 +145,27 @@ CIPSplitLeftLungRightLungImageFilter< TInputImage >
     // If the current slice is merged and we're not supposed to use the
     // local search region, then set the default search region for
     // this slice.
-    if ( merged && !this->m_UseLocalGraphROI ) 
+    if ( merged && !state.useLocalGraphROI ) 
       {
-	this->SetDefaultGraphROIAndSearchIndices( i );
+	this->SetDefaultGraphROIAndSearchIndices( state, i );
       }
 
     bool attemptSplit = true;
     while ( merged && attemptSplit )
       {
-	this->FindMinCostPath();
-	this->EraseConnection( i );
-	merged = this->GetLungsMergedInSliceRegion( size[0]/3, 0, size[0]/3, size[1], i );
+	this->FindMinCostPath( state );
+	this->EraseConnection( state, i );
+	merged = this->GetLungsMergedInSliceRegion( size[0]/3, size[0]/3, i, parents );
 
 	if ( !merged )
 	  {
 	    // Set the local search region for the next slice
-	    this->SetLocalGraphROIAndSearchIndices( i+1 );
+	    this->SetLocalGraphROIAndSearchIndices( state, i+1 );
 	    slicesSinceLastSplit = 0;
 	  }
-	else if ( merged && this->m_UseLocalGraphROI )
+	else if ( merged && state.useLocalGraphROI )
 	  {
-	    this->SetDefaultGraphROIAndSearchIndices( i );
+	    this->SetDefaultGraphROIAndSearchIndices( state, i );
 	  }
 	else
 	  {
@@ -131,109 +180,213 @@ CIPSplitLeftLungRightLungImageFilter< TInputImage >
 }
 
 
-/**
- * 
- */
 template< class TInputImage >
-bool
+ITK_THREAD_RETURN_TYPE
 CIPSplitLeftLungRightLungImageFilter< TInputImage >
-::GetLungsMergedInSliceRegion( int startX, int startY, int sizeX, int sizeY, int whichSlice )
+::TestSlicesThreaderCallback( void* arg )
 {
-  LabelMapType::SizeType sliceSize;
-    sliceSize[0] = sizeX;
-    sliceSize[1] = sizeY;
-    sliceSize[2] = 0;
-
-  LabelMapType::IndexType sliceStartIndex;
-    sliceStartIndex[0] = startX;
-    sliceStartIndex[1] = startY;
-    sliceStartIndex[2] = whichSlice;
-  
-  LabelMapType::RegionType sliceRegion;
-    sliceRegion.SetSize( sliceSize );
-    sliceRegion.SetIndex( sliceStartIndex );
+  THREADSTRUCT* str = static_cast< THREADSTRUCT* >
+    ( static_cast< MultiThreader::ThreadInfoStruct* >( arg )->UserData );
 
-  LabelMapExtractorType::Pointer sliceROI = LabelMapExtractorType::New();
-    sliceROI->SetInput( this->GetOutput() );
-    sliceROI->SetDirectionCollapseToIdentity();
-    sliceROI->SetExtractionRegion( sliceRegion );
-    sliceROI->Update();
+  LabelMapType::SizeType size = str->filter->GetOutput()->GetBufferedRegion().GetSize();
 
-  LabelMapSliceType::SizeType roiSize = sliceROI->GetOutput()->GetBufferedRegion().GetSize();
+  std::vector< unsigned int > parents;
 
-  LabelMapSliceIteratorType sIt( sliceROI->GetOutput(), sliceROI->GetOutput()->GetBufferedRegion() );
+  while ( true )
+    {
+    str->mutex.Lock();
+    unsigned int i = str->nextItem++;
+    str->mutex.Unlock();
 
-  sIt.GoToBegin();
-  LabelMapSliceType::IndexType startIndex = sIt.GetIndex();
+    if ( i >= str->merged.size() )
+      {
+      break;
+      }
 
-  // Perform connected components on the region
-  ConnectedComponent2DType::Pointer connectedComponent = ConnectedComponent2DType::New();
-    connectedComponent->SetInput( sliceROI->GetOutput() );
-    connectedComponent->FullyConnectedOn();
-    connectedComponent->Update();
+    str->merged[i] = str->filter->GetLungsMergedInSliceRegion( size[0]/3, size[0]/3, i, parents );
+    }
 
-  // If there is an object that touches both the left border and the
-  // right border, then the lungs are merged in this slice.  Test this
-  // condition
-  std::list< unsigned short >  lefthandLabelList;
-  std::list< unsigned short >  righthandLabelList;
+  return ITK_THREAD_RETURN_VALUE;
+}
 
-  LabelMapSliceType::IndexType index;
 
-  for ( unsigned int i=0; i<roiSize[1]; i++ )
-    {
-    index[1] = i;
-    index[0] = startIndex[0];
+template< class TInputImage >
+ITK_THREAD_RETURN_TYPE
+CIPSplitLeftLungRightLungImageFilter< TInputImage >
+::SplitRunsThreaderCallback( void* arg )
+{
+  THREADSTRUCT* str = static_cast< THREADSTRUCT* >
+    ( static_cast< MultiThreader::ThreadInfoStruct* >( arg )->UserData );
 
-    unsigned short value = connectedComponent->GetOutput()->GetPixel( index );
+  while ( true )
+    {
+    str->mutex.Lock();
+    unsigned int i = str->nextItem++;
+    str->mutex.Unlock();
 
-    if ( value != (unsigned short)( 0 ) )
+    if ( i >= str->runStarts.size() )
       {
-      lefthandLabelList.push_back( value );
+      break;
       }
 
-     index[0] = startIndex[0] + roiSize[0] - 1;
+    str->filter->SplitRun( str->runStarts[i], str->runEnds[i], str->merged );
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
 
-     value = connectedComponent->GetOutput()->GetPixel( index );
 
-    if ( value != 0 )
-      {
-      righthandLabelList.push_back( value );
-      }
+template< class TInputImage >
+void
+CIPSplitLeftLungRightLungImageFilter< TInputImage >
+::RunThreads( ThreadFunctionType callback, THREADSTRUCT* str, unsigned int numItems )
+{
+  unsigned int numThreads = this->GetNumberOfThreads();
+  if ( numThreads > numItems )
+    {
+    numThreads = numItems;
+    }
+  if ( numThreads == 0 )
+    {
+    return;
     }
 
-  lefthandLabelList.unique();
-  lefthandLabelList.sort();
-  lefthandLabelList.unique();
+  MultiThreader::Pointer threader = MultiThreader::New();
+    threader->SetNumberOfThreads( numThreads );
+    threader->SetSingleMethod( callback, str );
+    threader->SingleMethodExecute();
+}
 
-  righthandLabelList.unique();
-  righthandLabelList.sort();
-  righthandLabelList.unique();
 
-  std::list< unsigned short >::iterator leftIt   = lefthandLabelList.begin();
-  std::list< unsigned short >::iterator rightIt  = righthandLabelList.begin();
+/**
+ * 
+ */
+template< class TInputImage >
+bool
+CIPSplitLeftLungRightLungImageFilter< TInputImage >
+::GetLungsMergedInSliceRegion( int startX, int sizeX, int whichSlice, std::vector< unsigned int >& parents )
+{
+  LabelMapType::SizeType size = this->GetOutput()->GetBufferedRegion().GetSize();
 
-  for ( unsigned int i=0; i<lefthandLabelList.size(); i++, leftIt++ )
+  const int sizeY = size[1];
+  if ( sizeX <= 0 || sizeY <= 0 )
     {
-    rightIt  = righthandLabelList.begin();
-    for ( unsigned int j=0; j<righthandLabelList.size(); j++, rightIt++ )
+    return false;
+    }
+
+  LabelMapType::IndexType sliceStartIndex = this->GetOutput()->GetBufferedRegion().GetIndex();
+    sliceStartIndex[0] += startX;
+    sliceStartIndex[2] += whichSlice;
+
+  const LabelMapPixelType* slice = this->GetOutput()->GetBufferPointer() +
+    this->GetOutput()->ComputeOffset( sliceStartIndex );
+  const OffsetValueType rowStride = this->GetOutput()->GetOffsetTable()[1];
+
+  // Label the foreground of the region with 8-connected components. Each
+  // foreground pixel is joined to its foreground neighbors in the
+  // previous row and to its left; 'parents' holds the union-find forest
+  // (background pixels are left out of it).
+  const unsigned int background = itk::NumericTraits< unsigned int >::max();
+
+  parents.resize( sizeX*sizeY );
+
+  for ( int y=0; y<sizeY; y++ )
+    {
+    const LabelMapPixelType* row = slice + y*rowStride;
+
+    for ( int x=0; x<sizeX; x++ )
       {
-      if ( *leftIt == *rightIt )
+      unsigned int p = y*sizeX + x;
+
+      if ( row[x] == 0 )
         {
-        return true;
+        parents[p] = background;
+        continue;
+        }
+
+      parents[p] = p;
+
+      int neighbors[4][2] = { {x-1, y}, {x-1, y-1}, {x, y-1}, {x+1, y-1} };
+      for ( unsigned int n=0; n<4; n++ )
+        {
+        int nx = neighbors[n][0];
+        int ny = neighbors[n][1];
+        if ( nx < 0 || ny < 0 || nx >= sizeX || parents[ny*sizeX + nx] == background )
+          {
+          continue;
+          }
+
+        // Join the two trees, halving the paths on the way to the roots
+        unsigned int a = p;
+        unsigned int b = ny*sizeX + nx;
+        while ( parents[a] != a )
+          {
+          parents[a] = parents[parents[a]];
+          a = parents[a];
+          }
+        while ( parents[b] != b )
+          {
+          parents[b] = parents[parents[b]];
+          b = parents[b];
+          }
+        if ( a < b )
+          {
+          parents[b] = a;
+          }
+        else
+          {
+          parents[a] = b;
+          }
         }
       }
     }
-    
+
+  // If there is an object that touches both the left border and the
+  // right border, then the lungs are merged in this slice.  Test this
+  // condition
+  std::vector< unsigned int > lefthandRoots;
+  for ( int y=0; y<sizeY; y++ )
+    {
+    unsigned int p = y*sizeX;
+    if ( parents[p] == background )
+      {
+      continue;
+      }
+    while ( parents[p] != p )
+      {
+      p = parents[p];
+      }
+    lefthandRoots.push_back( p );
+    }
+
+  std::sort( lefthandRoots.begin(), lefthandRoots.end() );
+
+  for ( int y=0; y<sizeY; y++ )
+    {
+    unsigned int p = y*sizeX + sizeX - 1;
+    if ( parents[p] == background )
+      {
+      continue;
+      }
+    while ( parents[p] != p )
+      {
+      p = parents[p];
+      }
+    if ( std::binary_search( lefthandRoots.begin(), lefthandRoots.end(), p ) )
+      {
+      return true;
+      }
+    }
+
   return false;
 }
 
 
 template< class TInputImage >
 void CIPSplitLeftLungRightLungImageFilter< TInputImage >
-::SetDefaultGraphROIAndSearchIndices( unsigned int z )
+::SetDefaultGraphROIAndSearchIndices( SPLITSTATE& state, unsigned int z )
 {
-  this->m_UseLocalGraphROI = false;
+  state.useLocalGraphROI = false;
 
   LabelMapType::SizeType size = this->GetOutput()->GetBufferedRegion().GetSize();
 
@@ -243,81 +396,81 @@ void CIPSplitLeftLungRightLungImageFilter< TInputImage >
   int maxY = size[1]-1;
 
   // Set the start and end search indices
-  this->m_StartSearchIndex[0] = (maxX + minX)/2;
-  this->m_StartSearchIndex[1] = minY;
-  this->m_StartSearchIndex[2] = 0; // Value not used except for assert statements below
+  state.startSearchIndex[0] = (maxX + minX)/2;
+  state.startSearchIndex[1] = minY;
+  state.startSearchIndex[2] = 0; // Value not used except for assert statements below
 
-  this->m_EndSearchIndex[0] = (maxX + minX)/2;
-  this->m_EndSearchIndex[1] = maxY;
-  this->m_EndSearchIndex[2] = 0; // Value not used except for assert statements below
+  state.endSearchIndex[0] = (maxX + minX)/2;
+  state.endSearchIndex[1] = maxY;
+  state.endSearchIndex[2] = 0; // Value not used except for assert statements below
 
   // Set the start index of the graph ROI
   int tmp;
   tmp = minX - 10;
   if ( tmp < 0 )
     {
-      this->m_GraphROIStartIndex[0] = 0;
+      state.graphROIStartIndex[0] = 0;
     }
   else
     {
-      this->m_GraphROIStartIndex[0] = tmp;
+      state.graphROIStartIndex[0] = tmp;
     }
   tmp  = minY - 10;
   if ( tmp < 0 )
     {
-      this->m_GraphROIStartIndex[1] = 0;
+      state.graphROIStartIndex[1] = 0;
     }
   else
     {
-      this->m_GraphROIStartIndex[1] = tmp;
+      state.graphROIStartIndex[1] = tmp;
     }
-  this->m_GraphROIStartIndex[2] = z;
+  state.graphROIStartIndex[2] = z;
 
-  assert( this->GetOutput()->GetBufferedRegion().IsInside( this->m_GraphROIStartIndex ) );
+  assert( this->GetOutput()->GetBufferedRegion().IsInside( state.graphROIStartIndex ) );
 
   // Now set the size of the graph ROI
   tmp  = maxX - minX + 20;
   if ( tmp < 0 )
     {
-      this->m_GraphROISize[0] = 0;
+      state.graphROISize[0] = 0;
     }	  
   else if ( tmp > size[0] )
     {
-      this->m_GraphROISize[0] = size[0];
+      state.graphROISize[0] = size[0];
     }
   else
     {
-      this->m_GraphROISize[0] = tmp;
+      state.graphROISize[0] = tmp;
     }
 
   tmp  = maxY - minY + 20;
   if ( tmp < 0 )
     {
-      this->m_GraphROISize[1] = 0;
+      state.graphROISize[1] = 0;
     }
   else if ( tmp > size[1] )
     {
-      this->m_GraphROISize[1] = size[1];
+      state.graphROISize[1] = size[1];
     }
   else
     {
-      this->m_GraphROISize[1] = tmp;
+      state.graphROISize[1] = tmp;
     }
   
-  assert( this->GetOutput()->GetBufferedRegion().IsInside( this->m_StartSearchIndex ) );
-  assert( this->GetOutput()->GetBufferedRegion().IsInside( this->m_EndSearchIndex ) );
-  assert( this->m_GraphROIStartIndex[0] + this->m_GraphROISize[0] <= size[0] );
-  assert( this->m_GraphROIStartIndex[1] + this->m_GraphROISize[1] <= size[1] );
+  assert( this->GetOutput()->GetBufferedRegion().IsInside( state.startSearchIndex ) );
+  assert( this->GetOutput()->GetBufferedRegion().IsInside( state.endSearchIndex ) );
+  assert( state.graphROIStartIndex[0] + state.graphROISize[0] <= size[0] );
+  assert( state.graphROIStartIndex[1] + state.graphROISize[1] <= size[1] );
 
-  this->m_GraphROISize[2] = 0;        
+  state.graphROISize[2] = 0;        
 }
 
 
 template< class TInputImage >
 void CIPSplitLeftLungRightLungImageFilter< TInputImage >
-::SetLocalGraphROIAndSearchIndices( unsigned int z )
+::SetLocalGraphROIAndSearchIndices( SPLITSTATE& state, unsigned int z )
 {
-  this->m_UseLocalGraphROI = true;
+  state.useLocalGraphROI = true;
 
   LabelMapType::SizeType size = this->GetOutput()->GetBufferedRegion().GetSize();
 
@@ -326,25 +479,25 @@ void CIPSplitLeftLungRightLungImageFilter< TInputImage >
   int minY = size[1];
   int maxY = 0;
 
-  for ( unsigned int i=0; i<this->m_ErasedSliceIndices.size(); i++ )
+  for ( unsigned int i=0; i<state.erasedSliceIndices.size(); i++ )
     {
-      if ( this->m_ErasedSliceIndices[i][0] > maxX )
+      if ( state.erasedSliceIndices[i][0] > maxX )
 	{
-	  maxX = this->m_ErasedSliceIndices[i][0];
+	  maxX = state.erasedSliceIndices[i][0];
 	}
-      if ( this->m_ErasedSliceIndices[i][0] < minX )
+      if ( state.erasedSliceIndices[i][0] < minX )
 	{
-	  minX = this->m_ErasedSliceIndices[i][0];
+	  minX = state.erasedSliceIndices[i][0];
 	}
-      if ( this->m_ErasedSliceIndices[i][1] > maxY )
+      if ( state.erasedSliceIndices[i][1] > maxY )
 	{
-	  maxY = this->m_ErasedSliceIndices[i][1];
-	  this->m_EndSearchIndex[0] = this->m_ErasedSliceIndices[i][0];
+	  maxY = state.erasedSliceIndices[i][1];
+	  state.endSearchIndex[0] = state.erasedSliceIndices[i][0];
 	}
-      if ( this->m_ErasedSliceIndices[i][1] < minY )
+      if ( state.erasedSliceIndices[i][1] < minY )
 	{
-	  minY = this->m_ErasedSliceIndices[i][1];
-	  this->m_StartSearchIndex[0] = this->m_ErasedSliceIndices[i][0];
+	  minY = state.erasedSliceIndices[i][1];
+	  state.startSearchIndex[0] = state.erasedSliceIndices[i][0];
 	}
     }
 
@@ -353,65 +506,65 @@ void CIPSplitLeftLungRightLungImageFilter< TInputImage >
   tmp = minX - 10;
   if ( tmp < 0 )
     {
-      this->m_GraphROIStartIndex[0] = 0;
+      state.graphROIStartIndex[0] = 0;
     }
   else
     {
-      this->m_GraphROIStartIndex[0] = tmp;
+      state.graphROIStartIndex[0] = tmp;
     }
   tmp = minY - 10;
   if ( tmp < 0 )
     {
-      this->m_GraphROIStartIndex[1] = 0;
+      state.graphROIStartIndex[1] = 0;
     }
   else
     {
-      this->m_GraphROIStartIndex[1] = tmp;
+      state.graphROIStartIndex[1] = tmp;
     }
-  this->m_GraphROIStartIndex[2] = z;
+  state.graphROIStartIndex[2] = z;
 
-  assert( this->GetOutput()->GetBufferedRegion().IsInside( this->m_GraphROIStartIndex ) );
+  assert( this->GetOutput()->GetBufferedRegion().IsInside( state.graphROIStartIndex ) );
 
-  this->m_StartSearchIndex[1] = this->m_GraphROIStartIndex[1];
+  state.startSearchIndex[1] = state.graphROIStartIndex[1];
 
   // Now set the size of the graph ROI
-  this->m_GraphROISize[0] = maxX - minX + 20;
+  state.graphROISize[0] = maxX - minX + 20;
   if ( maxX - minX + 20 < 0 )
     {
-      this->m_GraphROISize[0] = 0;
+      state.graphROISize[0] = 0;
     }
-  if ( this->m_GraphROISize[0] >= size[0] )
+  if ( state.graphROISize[0] >= size[0] )
     {
-      this->m_GraphROISize[0] = size[0] - 1;
+      state.graphROISize[0] = size[0] - 1;
     }
   
-  this->m_GraphROISize[1] = maxY - minY + 20;
+  state.graphROISize[1] = maxY - minY + 20;
   if ( maxY - minY + 20 < 0 )
     {
-      this->m_GraphROISize[1] = 0;
+      state.graphROISize[1] = 0;
     }
-  if ( this->m_GraphROISize[1] >= size[1] )
+  if ( state.graphROISize[1] >= size[1] )
     {
-      this->m_GraphROISize[1] = size[1] - 1;
+      state.graphROISize[1] = size[1] - 1;
     }   
-  this->m_EndSearchIndex[1] = this->m_GraphROIStartIndex[1] + this->m_GraphROISize[1] - 1;
+  state.endSearchIndex[1] = state.graphROIStartIndex[1] + state.graphROISize[1] - 1;
 
-  assert( this->GetOutput()->GetBufferedRegion().IsInside( this->m_StartSearchIndex ) );
-  assert( this->GetOutput()->GetBufferedRegion().IsInside( this->m_EndSearchIndex ) );
-  assert( this->m_GraphROIStartIndex[0] + this->m_GraphROISize[0] < size[0] );
-  assert( this->m_GraphROIStartIndex[1] + this->m_GraphROISize[1] < size[1] );
+  assert( this->GetOutput()->GetBufferedRegion().IsInside( state.startSearchIndex ) );
+  assert( this->GetOutput()->GetBufferedRegion().IsInside( state.endSearchIndex ) );
+  assert( state.graphROIStartIndex[0] + state.graphROISize[0] < size[0] );
+  assert( state.graphROIStartIndex[1] + state.graphROISize[1] < size[1] );
 
-  this->m_GraphROISize[2] = 0;
+  state.graphROISize[2] = 0;
 }
 
 
 template< class TInputImage >
 void CIPSplitLeftLungRightLungImageFilter< TInputImage >
-::EraseConnection( unsigned int slice )
+::EraseConnection( SPLITSTATE& state, unsigned int slice )
 {
-  if ( this->m_ErasedSliceIndices.size() > 0 )
+  if ( state.erasedSliceIndices.size() > 0 )
     {
-      this->m_ErasedSliceIndices.clear();
+      state.erasedSliceIndices.clear();
     }
 
   LabelMapSliceType::IndexType erasedIndex;  
@@ -419,17 +572,17 @@ void CIPSplitLeftLungRightLungImageFilter< TInputImage >
   typename OutputImageType::IndexType tmpIndex;
     tmpIndex[2] = slice;
 
-  for ( unsigned int i=0; i<this->m_MinCostPathIndices.size(); i++ )
+  for ( unsigned int i=0; i<state.minCostPathIndices.size(); i++ )
     {
       for ( int y=-this->m_LeftRightLungSplitRadius; y<=this->m_LeftRightLungSplitRadius; y++ )
 	{
-	  tmpIndex[1] = this->m_MinCostPathIndices[i][1] + y;
-	  erasedIndex[1] = this->m_MinCostPathIndices[i][1];
+	  tmpIndex[1] = state.minCostPathIndices[i][1] + y;
+	  erasedIndex[1] = state.minCostPathIndices[i][1];
 	  
 	  for ( int x=-this->m_LeftRightLungSplitRadius; x<=this->m_LeftRightLungSplitRadius; x++ )
 	    {
-	      tmpIndex[0] = this->m_MinCostPathIndices[i][0] + x;
-	      erasedIndex[0] = this->m_MinCostPathIndices[i][0];
+	      tmpIndex[0] = state.minCostPathIndices[i][0] + x;
+	      erasedIndex[0] = state.minCostPathIndices[i][0];
 	      
 	      for ( int z=-1; z<=1; z++ )
 		{
@@ -440,7 +593,7 @@ void CIPSplitLeftLungRightLungImageFilter< TInputImage >
 		      if ( this->GetOutput()->GetPixel( tmpIndex ) != 0 )
 			{
 			  this->GetOutput()->SetPixel( tmpIndex, 0 );
-			  this->m_ErasedSliceIndices.push_back( erasedIndex );	  
+			  state.erasedSliceIndices.push_back( erasedIndex );	  
 			}
 		    }
 		}
@@ -455,22 +608,53 @@ void CIPSplitLeftLungRightLungImageFilter< TInputImage >
  */
 template< class TInputImage >
 void CIPSplitLeftLungRightLungImageFilter< TInputImage >
-::FindMinCostPath()
+::FindMinCostPath( SPLITSTATE& state )
 {
-  if ( this->m_MinCostPathIndices.size() > 0 )
+  if ( state.minCostPathIndices.size() > 0 )
     {
-      this->m_MinCostPathIndices.clear();
+      state.minCostPathIndices.clear();
     }  
 
   typename InputImageType::RegionType roiRegion;
-    roiRegion.SetSize( this->m_GraphROISize );
-    roiRegion.SetIndex( this->m_GraphROIStartIndex );
+    roiRegion.SetSize( state.graphROISize );
+    roiRegion.SetIndex( state.graphROIStartIndex );
+
+  // Copy the region into a slice image of its own (instead of running an
+  // extractor on the input) so that runs can be split concurrently
+  typename InputSliceType::IndexType sliceIndex;
+  typename InputSliceType::SizeType  sliceSize;
+  typename InputSliceType::SpacingType sliceSpacing;
+  typename InputSliceType::PointType   sliceOrigin;
+  for ( unsigned int i=0; i<2; i++ )
+    {
+    sliceIndex[i]   = roiRegion.GetIndex()[i];
+    sliceSize[i]    = roiRegion.GetSize()[i];
+    sliceSpacing[i] = this->GetInput()->GetSpacing()[i];
+    sliceOrigin[i]  = this->GetInput()->GetOrigin()[i];
+    }
+
+  typename InputSliceType::RegionType sliceRegion( sliceIndex, sliceSize );
 
-  typename InputExtractorType::Pointer roiExtractor = InputExtractorType::New();
-    roiExtractor->SetInput( this->GetInput() );
-    roiExtractor->SetDirectionCollapseToIdentity();
-    roiExtractor->SetExtractionRegion( roiRegion );
-    roiExtractor->Update();
+  InputSlicePointerType roiSlice = InputSliceType::New();
+    roiSlice->SetRegions( sliceRegion );
+    roiSlice->SetSpacing( sliceSpacing );
+    roiSlice->SetOrigin( sliceOrigin );
+    roiSlice->Allocate();
+
+  roiRegion.SetSize( 2, 1 );
+
+  InputIteratorType iIt( this->GetInput(), roiRegion );
+  itk::ImageRegionIterator< InputSliceType > sIt( roiSlice, sliceRegion );
+
+  iIt.GoToBegin();
+  sIt.GoToBegin();
+  while ( !sIt.IsAtEnd() )
+    {
+    sIt.Set( iIt.Get() );
+
+    ++iIt;
+    ++sIt;
+    }
 
   InputPixelType lowerThreshold = itk::NumericTraits< InputPixelType >::NonpositiveMin();
   InputPixelType upperThreshold = itk::NumericTraits< InputPixelType >::max();
@@ -484,7 +668,7 @@ void CIPSplitLeftLungRightLungImageFilter< TInputImage >
     graphFunctor->ActivateAllNeighbors();
 
   typename GraphFilterType::Pointer graphFilter = GraphFilterType::New();
-    graphFilter->SetInput( roiExtractor->GetOutput() );
+    graphFilter->SetInput( roiSlice );
     graphFilter->SetImageToGraphFunctor( graphFunctor );
     graphFilter->Update();
 
@@ -500,11 +684,11 @@ void CIPSplitLeftLungRightLungImageFilter< TInputImage >
     {
     index = nIt.Get().ImageIndex;
 
-    if ( index[0] == this->m_StartSearchIndex[0] && index[1] == this->m_StartSearchIndex[1] )
+    if ( index[0] == state.startSearchIndex[0] && index[1] == state.startSearchIndex[1] )
       {
       startNodeID = nIt.Get().Identifier;
       }
-    if ( index[0] == this->m_EndSearchIndex[0] && index[1] == this->m_EndSearchIndex[1] )
+    if ( index[0] == state.endSearchIndex[0] && index[1] == state.endSearchIndex[1] )
       {
       endNodeID = nIt.Get().Identifier;
       }
@@ -523,7 +707,7 @@ void CIPSplitLeftLungRightLungImageFilter< TInputImage >
   onIt.GoToBegin();
   while ( !onIt.IsAtEnd() )
     {
-    this->m_MinCostPathIndices.push_back( onIt.Get().ImageIndex );
+    state.minCostPathIndices.push_back( onIt.Get().ImageIndex );
 
     ++onIt;
     }
@@ -2,6 +2,7 @@
 #define _itkCIPWholeLungVesselAndAirwaySegmentationImageFilter_txx
 
 #include "itkCIPWholeLungVesselAndAirwaySegmentationImageFilter.h"
+#include "cipLabelMapSliceComponentAnalyzer.h"
 
 
 namespace itk
@@ -380,202 +381,11 @@ std::vector< itk::Image< unsigned short, 3 >::IndexType >
 CIPWholeLungVesselAndAirwaySegmentationImageFilter< TInputImage >
 ::GetAirwaySeeds()
 {
-  std::vector< OutputImageType::IndexType > seedVec;
+  cip::LabelMapSliceComponentAnalyzer analyzer;
+    analyzer.SetLabelMap( this->GetOutput() );
+    analyzer.SetNumberOfThreads( this->GetNumberOfThreads() );
 
-  LabelMapType::SizeType    size    = this->GetOutput()->GetBufferedRegion().GetSize();
-  LabelMapType::SpacingType spacing = this->GetOutput()->GetSpacing();
-
-  //
-  // Get seeds from 15 slices. We don't consider the slice unless the
-  // total area is above a threshold
-  // (foregroundSliceSizeThresholdForSeedSelection). The value is set
-  // to 2000.0 to ensure that the lungs have come into the field of
-  // view before we begin our seed search. If we simply attempt to
-  // find seeds in the first slices that show a foreground region, we
-  // can wind up with a poor airway segmentation due to pinch points
-  // near the apex of the scan. This in turn can produce failure
-  // modes. The number of slices that we consider (15) is somewhat
-  // arbitrary. 
-  //
-  unsigned int slicesProcessed                              = 0;
-  unsigned int currentSliceOffset                           = 0;
-  int          numberSlicesForSeedSearch                    = 15;
-  double       foregroundSliceSizeThresholdForSeedSelection = 2000.0;
-
-  while ( slicesProcessed < numberSlicesForSeedSearch && currentSliceOffset < size[2] )
-    {
-    //
-    // Extract a 2D slice from the mask
-    //
-    int whichSlice;
-    if ( this->m_HeadFirst )
-      {
-      whichSlice = size[2] - 1 - currentSliceOffset;
-      }
-    else
-      {
-      whichSlice = currentSliceOffset;
-      }
-
-    LabelMapSliceType::Pointer slice = LabelMapSliceType::New();    
-
-    this->ExtractLabelMapSlice( this->GetOutput(), slice, whichSlice );
-
-    //
-    // Perform connected component labeling
-    //
-    ConnectedComponent2DType::Pointer connectedComponent = ConnectedComponent2DType::New();
-      connectedComponent->SetInput( slice );
-      connectedComponent->FullyConnectedOn();
-    try
-      {
-      connectedComponent->Update();
-      }
-    catch ( itk::ExceptionObject &excp )
-      {
-      std::cerr << "Exception caught while updating connected component filter:";
-      std::cerr << excp << std::endl;
-      }    
-    
-    //
-    // Relabel the components
-    //
-    Relabel2DType::Pointer relabeler = Relabel2DType::New();
-      relabeler->SetInput( connectedComponent->GetOutput() );
-    try
-      {
-      relabeler->Update();
-      }
-    catch ( itk::ExceptionObject &excp )
-      {
-      std::cerr << "Exception caught while relabeling:";
-      std::cerr << excp << std::endl;
-      }
-
-    //
-    // If the foreground area of the slice is larger than the
-    // threshold, consider the slice for seed selection. The number of
-    // objects present in the slice must also be equal to three
-    // (trachea, left and right lungs)
-    //
-    int numVoxels = 0;
-
-    LabelMapSliceIteratorType rIt( relabeler->GetOutput(), relabeler->GetOutput()->GetBufferedRegion() );
-
-    rIt.GoToBegin();
-    while ( !rIt.IsAtEnd() )
-      {
-      if ( rIt.Get() > 0 )
-        {
-        numVoxels++;
-        }
-
-      ++rIt;
-      }
-
-    double foregroundArea = static_cast< double >( numVoxels )*spacing[0]*spacing[1];
-
-    if ( foregroundArea > foregroundSliceSizeThresholdForSeedSelection && relabeler->GetNumberOfObjects() >= 3 )
-      {
-      slicesProcessed++;
-
-      //
-      // Identify the object who's centroid (x coordinate) is in the
-      // middle. First get the centroids, then find out which one is
-      // in the middle 
-      //
-      std::map< unsigned int, unsigned short > xCentroidMap;
-
-      unsigned short bestCenterLabel = 0;
-
-      unsigned int leftmostCentroid  = size[1];
-      unsigned int rightmostCentroid = 0;
-
-      //
-      // Get the centroids and labels for each object
-      //
-      for ( unsigned int i=1; i<=relabeler->GetNumberOfObjects(); i++ )
-        {
-        int x = 0;
-        int count = 0;
-
-        rIt.GoToBegin();
-        while ( !rIt.IsAtEnd() )
-          {
-          if ( rIt.Get() == i )
-            {
-            x += (rIt.GetIndex())[0];
-            count++;
-            }
-
-          ++rIt;
-          }
-        
-        unsigned int centroidLocation = static_cast< unsigned int >( static_cast< double >( x )/static_cast< double >( count ) );
-
-        if ( centroidLocation > rightmostCentroid )
-          {
-          rightmostCentroid = centroidLocation;
-          }
-        if ( centroidLocation < leftmostCentroid )
-          {
-          leftmostCentroid = centroidLocation;
-          }
-
-        xCentroidMap[centroidLocation] = i;
-        }
-     
-      unsigned int middleLocation = (rightmostCentroid + leftmostCentroid)/2;
-
-      //
-      // Now find the label that corresponds to the centroid that is
-      // closest to the middle location
-      //
-      unsigned int minDiff = size[1];
-
-      std::map< unsigned int, unsigned short >::iterator mapIt = xCentroidMap.begin();
-      while ( mapIt != xCentroidMap.end() )
-        {
-        int diff = vcl_abs( static_cast< int >( (*mapIt).first ) - static_cast< int >( middleLocation ) );
-
-        if ( diff < minDiff )
-          {                                     
-          minDiff = diff;
-          bestCenterLabel = (*mapIt).second;
-          }
-
-        mapIt++;
-        }
-
-      LabelMapType::IndexType index;
-
-      rIt.GoToBegin();
-      while ( !rIt.IsAtEnd() )
-        {
-        if ( rIt.Get() == bestCenterLabel )
-          {
-          index[0] = (rIt.GetIndex())[0];
-          index[1] = (rIt.GetIndex())[1];
-          if ( this->m_HeadFirst )
-            {
-            index[2] = size[2] - 1 - currentSliceOffset;
-            }
-          else
-            {
-            index[2] = currentSliceOffset;
-            }
-
-          seedVec.push_back( index );
-          }
-
-        ++rIt;
-        }
-      }
-
-    currentSliceOffset++;
-    }
-
-  return seedVec;
+  return analyzer.GetAirwaySeeds( this->m_HeadFirst );
 }
 
 
@@ -21,7 +21,7 @@
 #include "vtkInformationVector.h"
 #include "vtkStreamingDemandDrivenPipeline.h"
 
-#include "vtkImageReformatAlongRay.h"
+#include "vtkImageReformatAlongRays.h"
 #include "vtkPointData.h"
 #include "vtkMath.h"
 #include "vtkCellArray.h"
@@ -79,6 +79,13 @@ this->StatsMinMax = vtkDoubleArray::New();
 this->InnerContour = vtkPolyData::New();
 this->OuterContour = vtkPolyData::New();
 
+// Scratch arrays for the per ray wall detection
+this->RayValue = vtkDoubleArray::New();
+this->RayFirstDerivative = vtkDoubleArray::New();
+this->RaySecondDerivative = vtkDoubleArray::New();
+this->GradientZeros = vtkDoubleArray::New();
+this->HessianZeros = vtkDoubleArray::New();
+
 this->NumberOfQuantities = 21;
 
 }
@@ -91,6 +98,11 @@ this->StatsMean->Delete();
 this->StatsMinMax->Delete();
 this->InnerContour->Delete();
 this->OuterContour->Delete();
+this->RayValue->Delete();
+this->RayFirstDerivative->Delete();
+this->RaySecondDerivative->Delete();
+this->GradientZeros->Delete();
+this->HessianZeros->Delete();
 }
 
 //----------------------------------------------------------------------------
@@ -150,7 +162,7 @@ void vtkComputeAirwayWall::ExecuteDataWithInformation(vtkDataObject *out,
  vtkDoubleArray *signal;
  //double dth = this->GetThetaSampling();
  vtkCollection *rayCollection = vtkCollection::New();
- vtkCollection *extractCollection = vtkCollection::New();
+ vtkDataArrayCollection *signalArrays = vtkDataArrayCollection::New();
  vtkDataArrayCollection *signalCollection=vtkDataArrayCollection::New();
 
  // Center information
@@ -187,26 +199,32 @@ void vtkComputeAirwayWall::ExecuteDataWithInformation(vtkDataObject *out,
  } 
  */
  
- vtkImageReformatAlongRay *ray;
- vtkImageExtractComponents *extract;
+ // Sample all the rays of the cross section at once, one sampler per kernel.
+ // Each sampler produces a contiguous (radius x theta) buffer with the
+ // value and the first and second derivatives along the ray.
+ vtkImageReformatAlongRays *rays;
+ vtkDoubleArray *raySignal;
 
  for (int i= 0; i<numKernels;i++)
    {
-   ray = vtkImageReformatAlongRay::New();
-   rayCollection->AddItem(ray);
-   extract = vtkImageExtractComponents::New();
-   extract->SetInputData(input);
-   extract->SetComponents(i);
-   extract->Update();
-   ray->SetInputData(extract->GetOutput());
-   //Set ray extraction filter
-   ray->SetCenter(center);
-   ray->SetRMin(this->RMin);
-   ray->SetRMax(this->RMax);
-   ray->SetScale(this->Scale);
-   ray->SetDelta(delta);
-
-   extractCollection->AddItem(extract);
+   rays = vtkImageReformatAlongRays::New();
+   rays->SetInputData(input);
+   rays->SetInputComponent(i);
+   rays->SetNumberOfThetaSamples(this->NumberOfThetaSamples);
+   rays->SetCenter(center);
+   rays->SetRMin(this->RMin);
+   rays->SetRMax(this->RMax);
+   rays->SetScale(this->Scale);
+   rays->SetDelta(delta);
+   rays->Update();
+   rayCollection->AddItem(rays);
+   rays->Delete();
+
+   // The signal arrays wrap the rows of the ray buffer (no copies).
+   raySignal = vtkDoubleArray::New();
+   raySignal->SetNumberOfComponents(3);
+   signalArrays->AddItem(raySignal);
+   raySignal->Delete();
    }
 
  //ray->SetInput(this->GetInput());
@@ -425,11 +443,10 @@ int idx=0;
  for (double th =0 ; th < 2*vtkMath::Pi()-dth/2; th +=dth,idx++) {
     signalCollection->RemoveAllItems();
     for (int i=0; i<numKernels; i++) {
-      ray = static_cast<vtkImageReformatAlongRay*> (rayCollection->GetItemAsObject(i));
-      ray->SetTheta(th);
-      ray->Update();
-      signal = (vtkDoubleArray *)ray->GetOutput()->GetPointData()->GetScalars();
-      ray->GetOutput()->GetSpacing(sp);
+      rays = static_cast<vtkImageReformatAlongRays*> (rayCollection->GetItemAsObject(i));
+      signal = static_cast<vtkDoubleArray*> (signalArrays->GetItem(i));
+      signal->SetArray(rays->GetRayPointer(idx), 3*rays->GetNumberOfRaySamples(idx), 1);
+      sp[0] = rays->GetRaySpacing(idx);
       signalCollection->AddItem(signal);
     }
     
@@ -1364,16 +1381,10 @@ stdPower = sqrt(stdPower/Wsamples - meanPower*meanPower);
  }
  //remove objects
  samples->Delete();
- for (int i=0; i<numKernels; i++) {
-   ray = static_cast<vtkImageReformatAlongRay*> (rayCollection->GetItemAsObject(i));
-   //ray->Delete();
-   extract = static_cast<vtkImageExtractComponents*> (extractCollection->GetItemAsObject(i));
-   //extract->Delete();
- }
 
 signalCollection->Delete();
+signalArrays->Delete();
 rayCollection->Delete();
-extractCollection->Delete();
 lumenA->Delete();
 }
 
@@ -1429,14 +1440,15 @@ void vtkComputeAirwayWall::RemoveOutliers(vtkDoubleArray *r) {
 void vtkComputeAirwayWall::FWHM(vtkDoubleArray *ray,vtkDoubleArray *values) {
 
 double rmin,rmax;
-vtkDoubleArray *c = vtkDoubleArray::New();
-vtkDoubleArray *cp = vtkDoubleArray::New();
-vtkDoubleArray *cpp = vtkDoubleArray::New();
+// Scratch arrays are owned by the filter and reused across rays
+vtkDoubleArray *c = this->RayValue;
+vtkDoubleArray *cp = this->RayFirstDerivative;
+vtkDoubleArray *cpp = this->RaySecondDerivative;
 
 int ntuples = ray->GetNumberOfTuples();
-c->SetNumberOfTuples(ntuples);
-cp->SetNumberOfTuples(ntuples);
-cpp->SetNumberOfTuples(ntuples);
+c->SetNumberOfValues(ntuples);
+cp->SetNumberOfValues(ntuples);
+cpp->SetNumberOfValues(ntuples);
 
 for (int k=0; k<ntuples;k++) {
     c->SetValue(k,ray->GetComponent(k,0));
@@ -1452,9 +1464,6 @@ values->SetNumberOfValues(2);
 values->SetValue(0,rmin);
 values->SetValue(1,rmax);
 
-c->Delete();
-cp->Delete();
-cpp->Delete();
 
 
 }
@@ -1462,8 +1471,7 @@ cpp->Delete();
 void vtkComputeAirwayWall::FWHM(vtkDoubleArray *c,vtkDoubleArray *cp, vtkDoubleArray *cpp, double &rmin, double &rmax) {
 
 
-vtkDoubleArray *gzeros = vtkDoubleArray::New();
-//vtkDoubleArray *hzeros = vtkDoubleArray::New();
+vtkDoubleArray *gzeros = this->GradientZeros;
 
 this->FindZeros(cp,cpp,NULL,gzeros);
 vtkDebugMacro("FWHM: Num zeros: "<<gzeros->GetNumberOfTuples());
@@ -1572,8 +1580,6 @@ for (int k=0; k<nzeros; k++) {
             rmax=this->FindValue(c,(int) loc,(val+val2)/2);
             //cout<<"Find rmax: "<<rmax<<endl;
 	}
-    gzeros->Delete();
-    //hzeros->Delete();
     return;
     }
 }
@@ -1581,16 +1587,15 @@ for (int k=0; k<nzeros; k++) {
 //We did not find a wall
 rmin = -1;
 rmax = -1;
-gzeros->Delete();
-//hzeros->Delete();
 }
 
 void vtkComputeAirwayWall::ZeroCrossing(vtkDoubleArray *ray,vtkDoubleArray *values) {
 
 double rmin,rmax;
-vtkDoubleArray *c = vtkDoubleArray::New();
-vtkDoubleArray *cp = vtkDoubleArray::New();
-vtkDoubleArray *cpp = vtkDoubleArray::New();
+// Scratch arrays are owned by the filter and reused across rays
+vtkDoubleArray *c = this->RayValue;
+vtkDoubleArray *cp = this->RayFirstDerivative;
+vtkDoubleArray *cpp = this->RaySecondDerivative;
 
 int ntuples = ray->GetNumberOfTuples();
 c->SetNumberOfValues(ntuples);
@@ -1611,9 +1616,6 @@ values->SetNumberOfValues(2);
 values->SetValue(0,rmin);
 values->SetValue(1,rmax);
 
-c->Delete();
-cp->Delete();
-cpp->Delete();
 
 
 }
@@ -1621,8 +1623,8 @@ cpp->Delete();
 void vtkComputeAirwayWall::ZeroCrossing(vtkDoubleArray *c,vtkDoubleArray *cp, vtkDoubleArray *cpp, double &rmin, double &rmax) {
 
 
-vtkDoubleArray *gzeros = vtkDoubleArray::New();
-vtkDoubleArray *hzeros = vtkDoubleArray::New();
+vtkDoubleArray *gzeros = this->GradientZeros;
+vtkDoubleArray *hzeros = this->HessianZeros;
 
 this->FindZeros(cp,cpp,NULL,gzeros);
 this->FindZeros(cpp,NULL,NULL,hzeros);
@@ -1674,8 +1676,6 @@ for (int k=0; k<ngzeros; k++) {
         if(loc1<=loc && loc2>=loc && fabs(valg)>=this->GradientThreshold) {
             rmin=loc1;
             rmax=loc2;
-            gzeros->Delete();
-            hzeros->Delete();
             return;
         }
 
@@ -1683,9 +1683,6 @@ for (int k=0; k<ngzeros; k++) {
   }
 }
 
-gzeros->Delete();
-hzeros->Delete();
-
 }
 
 
@@ -2090,7 +2087,8 @@ void vtkComputeAirwayWall::FindZeros(vtkDoubleArray *c, vtkDoubleArray *cp, vtkD
 
 if (zeros == NULL)
     return;
-zeros->Initialize();
+// Reset keeps the allocation so scratch arrays can be reused per ray
+zeros->Reset();
 int np = c->GetNumberOfTuples();
 
 int derivatives =0;
@@ -186,6 +186,14 @@ protected:
   int ActivateSector;
 
   int NumberOfQuantities;
+
+  // Scratch arrays reused by FWHM and ZeroCrossing for every ray
+  vtkDoubleArray *RayValue;
+  vtkDoubleArray *RayFirstDerivative;
+  vtkDoubleArray *RaySecondDerivative;
+  vtkDoubleArray *GradientZeros;
+  vtkDoubleArray *HessianZeros;
+
 private:
   vtkComputeAirwayWall(const vtkComputeAirwayWall&);  // Not implemented.
   void operator=(const vtkComputeAirwayWall&);  // Not implemented.
@@ -26,7 +26,10 @@
 #include "vtkInformationVector.h"
 #include "vtkStreamingDemandDrivenPipeline.h"
 
+#include "cipSpectralFilter.h"
+
 #include <math.h>
+#include <vector>
 
 vtkStandardNewMacro(vtkComputeMonogenicSignal);
 
@@ -124,12 +127,20 @@ int vtkComputeMonogenicSignal::RequestData(vtkInformation *request,
                updateExtent);
   this->AllocateOutputData(outData, outInfo, updateExtent);
   
+  double *direction = this->QuadratureFilter->GetFilterDirection();
+  if (this->InputInFourierDomain == 0 &&
+      direction[0] == 0 && direction[1] == 0 && direction[2] == 0) {
+    // Spherical kernels are applied in the half spectrum of the input
+    this->ComputeFromHalfSpectrum(inData, outData);
+    return 1;
+  }
+
   vtkImageData *fftInput;
-  vtkImageFFT *fft = vtkImageFFT::New();
-  fft->SetDimensionality(this->Dimensionality);
+  vtkImageFFT *fft = NULL;
 
   if (this->InputInFourierDomain == 0) {
-    vtkImageFFT *fft = vtkImageFFT::New();
+    fft = vtkImageFFT::New();
+    fft->SetDimensionality(this->Dimensionality);
     fft->SetInputData(inData);
     fft->Update();
     fftInput = fft->GetOutput();
@@ -174,11 +185,56 @@ int vtkComputeMonogenicSignal::RequestData(vtkInformation *request,
   }
 
   //Delete Objects
-  fft->Delete();
+  if (fft != NULL)
+    fft->Delete();
 
   return 1;
 }
 
+//----------------------------------------------------------------------------
+// The input is transformed once with a single precision real-to-complex
+// FFT, every kernel component is applied in the half spectrum and the
+// components are transformed back as one batch.
+void vtkComputeMonogenicSignal::ComputeFromHalfSpectrum(vtkImageData *inData,
+                                                        vtkImageData *outData)
+{
+  int dims[3];
+  inData->GetDimensions(dims);
+  unsigned int size[3];
+  for (int i = 0; i < 3; i++) {
+    size[i] = dims[i];
+  }
+
+  cipSpectralFilter spectral;
+  spectral.SetSize(size);
+  spectral.SetSpacing(inData->GetSpacing());
+
+  void *inPtr = inData->GetScalarPointer();
+  unsigned int numComps = inData->GetNumberOfScalarComponents();
+  switch (inData->GetScalarType())
+    {
+    vtkTemplateMacro(spectral.Forward(static_cast<VTK_TT *>(inPtr), numComps));
+    default:
+      vtkErrorMacro(<< "ComputeFromHalfSpectrum: unknown scalar type");
+      return;
+    }
+
+  this->QuadratureFilter->SetWholeExtent(inData->GetExtent());
+  this->QuadratureFilter->SetVoxelSpacing(inData->GetSpacing());
+  std::vector<float> radial;
+  this->QuadratureFilter->ComputeHalfSpectrumResponse(radial);
+
+  int numOutComps = this->Dimensionality + 1;
+  vtkIdType numPoints = outData->GetNumberOfPoints();
+  std::vector<float> monogenic(numPoints*numOutComps);
+  spectral.ApplyQuadratureKernel(radial, this->Dimensionality, &monogenic[0]);
+
+  double *outPtr = (double *) outData->GetScalarPointer();
+  for (vtkIdType k = 0; k < numPoints*numOutComps; k++) {
+    outPtr[k] = monogenic[k];
+  }
+}
+
 
 void vtkComputeMonogenicSignal::FillOutput(vtkImageData *out, vtkImageData *in, int comp) {
 
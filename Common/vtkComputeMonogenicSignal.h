@@ -17,6 +17,10 @@
 // vtkComputeMonogenicSignal computes the Monogenic signal of an image.
 // The output of the filter is the monogenic signal in the spatial domain.
 // The computation is performed in the Fourier domain.
+// When the input is in the spatial domain and the kernel is spherical
+// (no FilterDirection), the input is transformed with cipSpectralFilter's
+// single precision real-to-complex FFT and the kernel is applied in the
+// half spectrum. Otherwise the full complex spectrum is used.
 
 #ifndef __vtkComputeMonogenicSignal_h
 #define __vtkComputeMonogenicSignal_h
@@ -66,6 +70,7 @@ protected:
                                  vtkInformationVector *);
 
   void FillOutput(vtkImageData *out, vtkImageData *in, int comp);
+  void ComputeFromHalfSpectrum(vtkImageData *inData, vtkImageData *outData);
 
   int InputInFourierDomain;
   vtkGeneralizedQuadratureKernelSource* QuadratureFilter;
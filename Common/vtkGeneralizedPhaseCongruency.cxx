@@ -18,16 +18,16 @@
 #include "vtkMath.h"
 #include "vtkObjectFactory.h"
 
-#include "vtkImageFFT.h"
 #include "vtkGeneralizedQuadratureKernelSource.h"
-#include "vtkImageExtractComponents.h"
-#include "vtkComputeMonogenicSignal.h"
 #include "vtkDoubleArray.h"
 #include "vtkInformation.h"
 #include "vtkInformationVector.h"
 #include "vtkStreamingDemandDrivenPipeline.h"
 
+#include "cipSpectralFilter.h"
+
 #include <math.h>
+#include <vector>
 
 #define VTK_EPS 1e-15
 
@@ -121,23 +121,48 @@ void vtkGeneralizedPhaseCongruency::ExecuteDataWithInformation(vtkDataObject* ou
 
   vtkImageData *outData = this->AllocateOutputData(out, outInfo);
 
-  vtkImageFFT *fft = vtkImageFFT::New();
- 
-  fft->SetInputData(input);
-  fft->Update();
-
-  if (!this->GetUsePhysicalUnits()) {
-    fft->GetOutput()->SetSpacing(1,1,1);
+  // The input is transformed once (single precision, half spectrum) and
+  // every scale is filtered from the same spectrum
+  int dims[3];
+  input->GetDimensions(dims);
+  unsigned int size[3];
+  for (int i = 0; i < 3; i++) {
+    size[i] = dims[i];
+  }
+  double spacing[3] = {1, 1, 1};
+  if (this->GetUsePhysicalUnits()) {
+    input->GetSpacing(spacing);
   }
 
-  //Set monogenic signal to get dimensionality of the output
-  vtkComputeMonogenicSignal *mono = vtkComputeMonogenicSignal::New();
-  mono->SetInputData(fft->GetOutput());
-  mono->InputInFourierDomainOn();
-  mono->UpdateInformation();
+  cipSpectralFilter spectral;
+  spectral.SetSize(size);
+  spectral.SetSpacing(spacing);
+
+  void *inPtr = input->GetScalarPointer();
+  unsigned int numComps = input->GetNumberOfScalarComponents();
+  switch (input->GetScalarType())
+    {
+    vtkTemplateMacro(spectral.Forward(static_cast<VTK_TT *>(inPtr), numComps));
+    default:
+      vtkErrorMacro(<< "ExecuteData: Unknown scalar type");
+      return;
+    }
+
+  // Dimensionality of the monogenic signal, as in vtkComputeMonogenicSignal
   int dimensionality;
-  dimensionality = mono->GetDimensionality();
-  mono->Delete();
+  if (dims[2] == 1) {
+    if (dims[1] == 1) {
+      dimensionality = 1;
+    } else {
+      dimensionality = 2;
+    }
+  } else {
+    dimensionality = 3;
+  }
+
+  // Monogenic signal of the current scale
+  std::vector<float> monogenic(input->GetNumberOfPoints()*(dimensionality+1));
+  std::vector<float> radial;
   
   //cout<<"Number of input points"<<this->GetInput()->GetNumberOfPoints()<<endl;
   //Allocate working DataArrays
@@ -163,7 +188,7 @@ void vtkGeneralizedPhaseCongruency::ExecuteDataWithInformation(vtkDataObject* ou
 
   // Loop through scale space and fill F and A arrays
   double freq,tmp;
-  double *monoPtr;
+  float *monoPtr;
   double wavelength = this->MinimumWavelength;
   double weight = 1;
   for (int k = 0 ; k < this->NumberOfScales; k++) {
@@ -181,26 +206,21 @@ void vtkGeneralizedPhaseCongruency::ExecuteDataWithInformation(vtkDataObject* ou
     }
 
     vtkGeneralizedQuadratureKernelSource *quad = vtkGeneralizedQuadratureKernelSource::New();
-    vtkComputeMonogenicSignal *mono = vtkComputeMonogenicSignal::New();
  
     // Set params of Quadrature kernel that we know
     quad->SetRelativeBandwidth(this->RelativeBandwidth);
     quad->SetZeroFrequencyLocationToOrigin();
     quad->SetCenterFrequency(freq);
+    quad->SetWholeExtent(input->GetExtent());
+    quad->SetVoxelSpacing(spacing);
+    quad->ComputeHalfSpectrumResponse(radial);
 
-    mono->SetInputData(fft->GetOutput());
-    mono->InputInFourierDomainOn();
-    mono->SetQuadratureFilter(quad);
-    mono->Update();
-    //dimensionality = mono->GetDimensionality();
+    spectral.ApplyQuadratureKernel(radial, dimensionality, &monogenic[0]);
     wavelength *= this->MultiplicativeFactor;
-    //if (k == 0) 
-    //  this->FillOutput(this->GetOutput(),mono->GetOutput(),1);
     fPtr = (double *) F->GetVoidPointer(0);
     aPtr = (double *) A->GetVoidPointer(0);
 
-    //monoPtr = (double *) mono->GetOutput()->GetPointData()->GetScalars()->GetVoidPointer(0);
-    monoPtr = (double *) mono->GetOutput()->GetScalarPointer();
+    monoPtr = &monogenic[0];
 
     for (int ii = 0 ; ii < F->GetNumberOfTuples() ; ii++) {
          tmp = 0.0;
@@ -213,7 +233,6 @@ void vtkGeneralizedPhaseCongruency::ExecuteDataWithInformation(vtkDataObject* ou
         *aPtr += sqrt(tmp);
         aPtr++;
     }
-   mono->Delete();
    quad->Delete();
   }
 
@@ -339,7 +358,6 @@ void vtkGeneralizedPhaseCongruency::ExecuteDataWithInformation(vtkDataObject* ou
 
 
   //Delete Objects
-  fft->Delete();
   F->Delete();
   A->Delete();
   //mono->Delete();
@@ -1,6 +1,7 @@
 #include <math.h>
 
 #include "vtkGeneralizedQuadratureKernelSource.h"
+#include "cipSpectralFilter.h"
 #include "vtkObjectFactory.h"
 #include "vtkMath.h"
 #include "vtkImageFourierCenter.h"
@@ -8,6 +9,11 @@
 #include "vtkInformation.h"
 #include "vtkInformationVector.h"
 #include "vtkStreamingDemandDrivenPipeline.h"
+#include "vtkCriticalSection.h"
+
+#include <algorithm>
+#include <list>
+#include <map>
 
 vtkStandardNewMacro(vtkGeneralizedQuadratureKernelSource);
 
@@ -278,29 +284,11 @@ void vtkGeneralizedQuadratureKernelSource::ThreadedExecute(vtkImageData *inData,
   unsigned long target;
   // set up local variables, with same names as C-F's
   // original code for consistency
-  long loop;
   double max_x, max_y, max_z;
   double k_dx, k_dy, k_dz;
   double x_pos, y_pos, z_pos;
-  double dx = this->VoxelSpacing[0];
-  double dy = this->VoxelSpacing[1];
-  double dz = this->VoxelSpacing[2];
-  double r_abs, r_dot, tmp, radial;
-  double dir_x = this->FilterDirection[0];
-  double dir_y = this->FilterDirection[1];
-  double dir_z = this->FilterDirection[2];
-  double B = this->RelativeBandwidth;
-  double logB = log(B);
-  double ri = this->CenterFrequency;
-  double A = this->AngularExponent;
+  double r_abs, radial;
   int dimensionality = this->Dimensionality;
-  // additional variables
-  int complex = this->ComplexOutput;
-  double w;	//Window function
-  double PI = vtkMath::Pi();
-  double hp_cut = 0.8*PI;
-  double n = this->WindowNExponent;
-  double k = this->WindowKExponent;
 
   vtkInformation* outInfo = outData->GetInformation();
   outInfo->Get(vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(), wholeExt);
@@ -321,22 +309,24 @@ void vtkGeneralizedQuadratureKernelSource::ThreadedExecute(vtkImageData *inData,
   target = (unsigned long)((maxZ+1)*(maxY+1)/50.0);
   target++;
 
-  // normalize filter direction
-  r_abs=sqrt(dir_x*dir_x+dir_y*dir_y+dir_z*dir_z);
-  if (r_abs > 0) {
-    dir_x /= r_abs;
-    dir_y /= r_abs;
-    dir_z /= r_abs;
-  }
-  
   // calculate centered coordinate system 
   this->CalculateFourierCoordinates(&max_x,&max_y,&max_z, 
 				    &k_dx,&k_dy,&k_dz);
 
+  // The x frequencies and their window factors are the same for every
+  // row, so they are tabulated once
+  std::vector<double> xPos(maxX+1), xWindow(maxX+1), radialRow(maxX+1);
+  for (idxX = 0; idxX <= maxX; idxX++)
+    {
+      xPos[idxX] = -max_x + k_dx * (outExt[0] - wholeExt[0] + idxX);
+      xWindow[idxX] = this->EvaluateWindowFactor(xPos[idxX], this->VoxelSpacing[0]);
+    }
+
   // Loop through output pixels
   z_pos=-max_z+k_dz * (outExt[4]-wholeExt[4]);
   for (idxZ = 0; idxZ <= maxZ; idxZ++)
     {
+      double zWindow = this->EvaluateWindowFactor(z_pos, this->VoxelSpacing[2]);
       y_pos=-max_y + k_dy * (outExt[2] - wholeExt[2]);
       for (idxY = 0; !this->AbortExecute && idxY <= maxY; idxY++)
 	{
@@ -348,58 +338,14 @@ void vtkGeneralizedQuadratureKernelSource::ThreadedExecute(vtkImageData *inData,
 	        }
 	      count++;
             }
-	  x_pos=-max_x + k_dx * (outExt[0] - wholeExt[0]);
+	  double yzWindow = this->EvaluateWindowFactor(y_pos, this->VoxelSpacing[1])*zWindow;
+	  this->EvaluateRadialRow(maxX+1, &xPos[0], &xWindow[0], y_pos, z_pos, yzWindow, &radialRow[0]);
 	  for (idxX = 0; idxX <= maxX; idxX++)
 	    {
 	     // Pixel operation
-             if (dir_x == 0 && dir_y == 0 && dir_z == 0) {
-               //Spherical filter
-               r_dot = 1;
-             } else {  
-               r_dot=dir_x*x_pos+dir_y*y_pos+dir_z*z_pos;
-	     }
-	     //Original code:
+	     x_pos = xPos[idxX];
+	     radial = radialRow[idxX];
 	     r_abs=sqrt(x_pos*x_pos+y_pos*y_pos+z_pos*z_pos);
-	      
-	     // need to check that the -4 and 2 in the filter
-	     // fcn are ok
-	    if (r_abs > 0 && r_dot >= 0 ) 
-            {
-                radial = 1;
-                // Direction Filter
-                if (!(dir_x == 0 && dir_y == 0 && dir_z == 0)) {
-                    tmp=r_dot/r_abs;
-                    for (loop=0; loop<A; loop++)
-                        radial *= tmp*tmp;
-                }
-                tmp=log(r_abs/ri);
-		radial *=
-		    exp( -tmp*tmp*(1 / (2* logB*logB)));
-		  
-		    if (this->WindowFunction) {
-		        // we are using a window function 
-		        // to make sure that filter goes down
-		        // to zero at PI.
-		        //RAUL: Method uses by C-F cos^2 technique
-		        //if (r_abs <= hp_cut) {
-		        //  w=1.0;
-		      //} else if (hp_cut<r_abs && r_abs<=PI) {
-		      //tmp=cos(PI*(r_abs-hp_cut)/(2*(PI-hp_cut)));
-		      //w=tmp*tmp;
-		      //} else {
-		      //  w=0.0;
-		      //}
-                        //NEW approach
-                        w =  pow(cos(PI/2*pow(fabs(x_pos*dx/PI),n)),k);
-                        w *= pow(cos(PI/2*pow(fabs(y_pos*dy/PI),n)),k); 
-                        w *= pow(cos(PI/2*pow(fabs(z_pos*dz/PI),n)),k);
-		        radial *=w;
-		    }
-		} 
-	    else
-		{
-		  radial = 0;
-		}
         //if (idxY == 64 && idxZ == 0) {
         //    cout<<x_pos<<" "<<y_pos<<" "<<radial<<"   "<<tmp<<" "<<logB<<" "<<r_abs<<endl;
         //}
@@ -479,7 +425,6 @@ void vtkGeneralizedQuadratureKernelSource::ThreadedExecute(vtkImageData *inData,
             *outPtr = 0;
         }
 
-	    x_pos += k_dx;	  
 	    outPtr++;
 	  }
 	  y_pos += k_dy;
@@ -490,6 +435,214 @@ void vtkGeneralizedQuadratureKernelSource::ThreadedExecute(vtkImageData *inData,
   }
 }
 
+//----------------------------------------------------------------------------
+// Window factor of one axis: cos(pi/2 |pos*spacing/pi|^N)^K, which makes
+// sure that the filter goes down to zero at PI.
+double vtkGeneralizedQuadratureKernelSource::EvaluateWindowFactor(double pos, double spacing)
+{
+  if (!this->WindowFunction) {
+    return 1.0;
+  }
+  double PI = vtkMath::Pi();
+  return pow(cos(PI/2*pow(fabs(pos*spacing/PI),this->WindowNExponent)),this->WindowKExponent);
+}
+
+//----------------------------------------------------------------------------
+// Radial part of the kernel along a row of x frequencies. The window is
+// separable, so its factors are passed in: one per x frequency and the
+// product of the y and z factors.
+void vtkGeneralizedQuadratureKernelSource::EvaluateRadialRow(int numberOfSamples,
+                                                             const double *x_pos,
+                                                             const double *x_window,
+                                                             double y_pos,
+                                                             double z_pos,
+                                                             double yz_window,
+                                                             double *radial)
+{
+  double dir_x = this->FilterDirection[0];
+  double dir_y = this->FilterDirection[1];
+  double dir_z = this->FilterDirection[2];
+  double A = this->AngularExponent;
+  double logB = log(this->RelativeBandwidth);
+  double logri = log(this->CenterFrequency);
+  double c = 1 / (2* logB*logB);
+
+  // normalize filter direction
+  double r_abs=sqrt(dir_x*dir_x+dir_y*dir_y+dir_z*dir_z);
+  int spherical = (r_abs == 0);
+  if (!spherical) {
+    dir_x /= r_abs;
+    dir_y /= r_abs;
+    dir_z /= r_abs;
+  }
+
+  double yz2 = y_pos*y_pos + z_pos*z_pos;
+  double yz_dot = dir_y*y_pos + dir_z*z_pos;
+  for (int i = 0; i < numberOfSamples; i++) {
+    double r2 = x_pos[i]*x_pos[i] + yz2;
+    double r_dot = spherical ? 1 : dir_x*x_pos[i] + yz_dot;
+    if (r2 <= 0 || r_dot < 0) {
+      radial[i] = 0;
+      continue;
+    }
+
+    // log-Gabor term, with log(r/ri) = log(r^2)/2 - log(ri)
+    double tmp = 0.5*log(r2) - logri;
+    double value = exp(-tmp*tmp*c);
+
+    // Direction Filter
+    if (!spherical) {
+      tmp = r_dot*r_dot/r2;
+      for (long loop=0; loop<A; loop++)
+        value *= tmp;
+    }
+
+    radial[i] = value*x_window[i]*yz_window;
+  }
+}
+
+//----------------------------------------------------------------------------
+double vtkGeneralizedQuadratureKernelSource::EvaluateRadialResponse(double x_pos,
+                                                                    double y_pos,
+                                                                    double z_pos)
+{
+  double x_window = this->EvaluateWindowFactor(x_pos, this->VoxelSpacing[0]);
+  double yz_window = this->EvaluateWindowFactor(y_pos, this->VoxelSpacing[1])*
+    this->EvaluateWindowFactor(z_pos, this->VoxelSpacing[2]);
+
+  double radial;
+  this->EvaluateRadialRow(1, &x_pos, &x_window, y_pos, z_pos, yz_window, &radial);
+  return radial;
+}
+
+//----------------------------------------------------------------------------
+// Kernel bank: the half spectrum responses computed so far, keyed by
+// everything they depend on and evicted least recently used first once
+// they take more than the bank's capacity.
+namespace
+{
+typedef std::vector<double> KernelBankKeyType;
+
+struct KernelBankEntry
+{
+  std::vector<float> Response;
+  std::list<KernelBankKeyType>::iterator Use;
+};
+
+typedef std::map<KernelBankKeyType, KernelBankEntry> KernelBankType;
+
+vtkSimpleCriticalSection KernelBankLock;
+KernelBankType KernelBank;
+std::list<KernelBankKeyType> KernelBankUses;
+unsigned long KernelBankSize = 0;
+unsigned long KernelBankCapacity = 128*1024*1024;
+
+void TrimKernelBank()
+{
+  while (KernelBankSize > KernelBankCapacity && !KernelBankUses.empty()) {
+    KernelBankType::iterator it = KernelBank.find(KernelBankUses.front());
+    KernelBankSize -= it->second.Response.size()*sizeof(float);
+    KernelBank.erase(it);
+    KernelBankUses.pop_front();
+  }
+}
+}
+
+//----------------------------------------------------------------------------
+void vtkGeneralizedQuadratureKernelSource::SetKernelBankCapacity(unsigned long bytes)
+{
+  KernelBankLock.Lock();
+  KernelBankCapacity = bytes;
+  TrimKernelBank();
+  KernelBankLock.Unlock();
+}
+
+//----------------------------------------------------------------------------
+unsigned long vtkGeneralizedQuadratureKernelSource::GetKernelBankCapacity()
+{
+  return KernelBankCapacity;
+}
+
+//----------------------------------------------------------------------------
+void vtkGeneralizedQuadratureKernelSource::ClearKernelBank()
+{
+  KernelBankLock.Lock();
+  KernelBank.clear();
+  KernelBankUses.clear();
+  KernelBankSize = 0;
+  KernelBankLock.Unlock();
+}
+
+//----------------------------------------------------------------------------
+void vtkGeneralizedQuadratureKernelSource::ComputeHalfSpectrumResponse(std::vector<float>& response)
+{
+  unsigned int size[3], spectrumSize[3];
+  for (int i = 0; i < 3; i++) {
+    size[i] = this->WholeExtent[2*i+1] - this->WholeExtent[2*i] + 1;
+    spectrumSize[i] = size[i];
+  }
+  spectrumSize[0] = size[0]/2 + 1;
+
+  KernelBankKeyType key;
+  for (int i = 0; i < 3; i++) {
+    key.push_back(size[i]);
+    key.push_back(this->VoxelSpacing[i]);
+    key.push_back(this->FilterDirection[i]);
+  }
+  key.push_back(this->CenterFrequency);
+  key.push_back(this->RelativeBandwidth);
+  key.push_back(this->AngularExponent);
+  key.push_back(this->WindowFunction);
+  key.push_back(this->WindowNExponent);
+  key.push_back(this->WindowKExponent);
+
+  KernelBankLock.Lock();
+  KernelBankType::iterator it = KernelBank.find(key);
+  if (it != KernelBank.end()) {
+    KernelBankUses.splice(KernelBankUses.end(), KernelBankUses, it->second.Use);
+    response = it->second.Response;
+    KernelBankLock.Unlock();
+    return;
+  }
+  KernelBankLock.Unlock();
+
+  // Window factors and frequencies along each axis, then one pass over
+  // the rows of the half spectrum
+  std::vector<double> pos[3], window[3];
+  for (int i = 0; i < 3; i++) {
+    pos[i].resize(spectrumSize[i]);
+    window[i].resize(spectrumSize[i]);
+    for (unsigned int idx = 0; idx < spectrumSize[i]; idx++) {
+      pos[i][idx] = cipSpectralFilter::GetFrequency(idx, size[i], this->VoxelSpacing[i]);
+      window[i][idx] = this->EvaluateWindowFactor(pos[i][idx], this->VoxelSpacing[i]);
+    }
+  }
+
+  response.resize(static_cast<size_t>(spectrumSize[0])*spectrumSize[1]*spectrumSize[2]);
+  std::vector<double> radialRow(spectrumSize[0]);
+  std::vector<float>::iterator out = response.begin();
+  for (unsigned int idxZ = 0; idxZ < spectrumSize[2]; idxZ++)
+    {
+    for (unsigned int idxY = 0; idxY < spectrumSize[1]; idxY++)
+      {
+      this->EvaluateRadialRow(spectrumSize[0], &pos[0][0], &window[0][0], pos[1][idxY], pos[2][idxZ],
+                              window[1][idxY]*window[2][idxZ], &radialRow[0]);
+      out = std::copy(radialRow.begin(), radialRow.end(), out);
+      }
+    }
+
+  unsigned long bytes = response.size()*sizeof(float);
+  KernelBankLock.Lock();
+  if (bytes <= KernelBankCapacity && KernelBank.find(key) == KernelBank.end()) {
+    KernelBankEntry& entry = KernelBank[key];
+    entry.Response = response;
+    entry.Use = KernelBankUses.insert(KernelBankUses.end(), key);
+    KernelBankSize += bytes;
+    TrimKernelBank();
+  }
+  KernelBankLock.Unlock();
+}
+
 void vtkGeneralizedQuadratureKernelSource::PrintSelf(ostream& os, vtkIndent indent)
 {
   int i;
@@ -13,6 +13,8 @@
 #include "vtkImageKernelSource.h"
 #include "vtkCIPCommonConfigure.h"
 
+#include <vector>
+
 class VTK_CIP_COMMON_EXPORT vtkGeneralizedQuadratureKernelSource : public vtkImageKernelSource
 {
 public:
@@ -74,6 +76,29 @@ public:
     {vtkErrorMacro("This filter only outputs kernels in the fourier domain.");
     this->SetOutputDomain(VTK_KERNEL_OUTPUT_FOURIER_DOMAIN);}
 
+  // Description:
+  // Evaluate the radial part of the kernel (its last component) at
+  // the frequency (x_pos, y_pos, z_pos). The Riesz components are
+  // -j U_i/|U| times this value.
+  double EvaluateRadialResponse(double x_pos, double y_pos, double z_pos);
+
+  // Description:
+  // Compute the radial part of the kernel over the half spectrum of a
+  // real image with this source's WholeExtent and VoxelSpacing, in the
+  // layout and at the frequencies of cipSpectralFilter. Only spherical
+  // kernels (FilterDirection of 0,0,0) are Hermitian and can be applied
+  // in the half spectrum. Responses are kept in a kernel bank shared by
+  // all sources, so that kernels with the same extent, spacing and
+  // parameters are only computed once.
+  void ComputeHalfSpectrumResponse(std::vector<float>& response);
+
+  // Description:
+  // Maximum memory, in bytes, taken by the kernel bank. Least recently
+  // used kernels are dropped beyond it. Defaults to 128 MB.
+  static void SetKernelBankCapacity(unsigned long bytes);
+  static unsigned long GetKernelBankCapacity();
+  static void ClearKernelBank();
+
   void ThreadedExecute(vtkImageData *inData,
                        vtkImageData *outData,
                        int outExt[6], int id);
@@ -93,6 +118,18 @@ protected:
 
   int Dimensionality;
 
+  // Description:
+  // Window factor of one axis, 1 if there is no window function
+  double EvaluateWindowFactor(double pos, double spacing);
+
+  // Description:
+  // Radial part of the kernel along a row of x frequencies, given the
+  // window factors of the x frequencies and the product of the y and z
+  // window factors
+  void EvaluateRadialRow(int numberOfSamples, const double *x_pos,
+                         const double *x_window, double y_pos, double z_pos,
+                         double yz_window, double *radial);
+
   void CalculateFourierCoordinates(double *max_x, double *max_y,
 				   double *max_z, double *k_dx,
 				   double *k_dy,  double *k_dz);
@@ -0,0 +1,393 @@
+/*=========================================================================
+
+  Program:   Visualization Toolkit
+  Module:    $RCSfile: vtkImageReformatAlongRays.cxx,v $
+
+  Copyright (c) Ken Martin, Will Schroeder, Bill Lorensen
+  All rights reserved.
+  See Copyright.txt or http://www.kitware.com/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+#include "vtkImageReformatAlongRays.h"
+
+#include "vtkImageData.h"
+#include "vtkImageExtractComponents.h"
+#include "vtkMath.h"
+#include "vtkObjectFactory.h"
+#include "vtkInformation.h"
+#include "vtkInformationVector.h"
+#include "vtkStreamingDemandDrivenPipeline.h"
+
+#include "teem/ell.h"
+
+#include <math.h>
+
+vtkStandardNewMacro(vtkImageReformatAlongRays);
+
+//----------------------------------------------------------------------------
+vtkImageReformatAlongRays::vtkImageReformatAlongRays()
+{
+ this->NumberOfThetaSamples = 128;
+ this->RMin = 0;
+ this->RMax = 12.7;
+ this->Center[0] = 32;
+ this->Center[1] = 32;
+ this->Center[2] = 0;
+ this->Delta = 1;
+ this->Scale = 3;
+ this->InputComponent = 0;
+ this->MaximumNumberOfRaySamples = 0;
+
+ this->Threader = vtkMultiThreader::New();
+ this->NumberOfThreads = this->Threader->GetNumberOfThreads();
+}
+
+//----------------------------------------------------------------------------
+vtkImageReformatAlongRays::~vtkImageReformatAlongRays()
+{
+ this->Threader->Delete();
+}
+
+//----------------------------------------------------------------------------
+// Angles are generated with the same accumulation used by
+// vtkComputeAirwayWall so that ray j is sampled at exactly the same theta.
+void vtkImageReformatAlongRays::ComputeRayGeometry(double *insp)
+{
+  this->Thetas.clear();
+  this->NumberOfRaySamples.clear();
+  this->RaySpacings.clear();
+  this->MaximumNumberOfRaySamples = 0;
+
+  if (this->NumberOfThetaSamples < 1)
+    {
+    return;
+    }
+
+  double dth = 2*vtkMath::Pi()/this->NumberOfThetaSamples;
+  for (double th = 0; th < 2*vtkMath::Pi()-dth/2; th += dth)
+    {
+    double sp = sqrt(insp[0]*insp[0] * cos(th) * cos(th) +
+                     insp[1]*insp[1] * sin(th) * sin(th));
+    int nsamples = int ((this->RMax/sp - this->RMin/sp + 1)/this->Delta);
+    if (nsamples < 0)
+      {
+      nsamples = 0;
+      }
+
+    this->Thetas.push_back(th);
+    this->NumberOfRaySamples.push_back(nsamples);
+    this->RaySpacings.push_back(this->Delta*sp);
+    if (nsamples > this->MaximumNumberOfRaySamples)
+      {
+      this->MaximumNumberOfRaySamples = nsamples;
+      }
+    }
+}
+
+//----------------------------------------------------------------------------
+int vtkImageReformatAlongRays::RequestInformation (
+  vtkInformation       *  request,
+  vtkInformationVector ** inputVector,
+  vtkInformationVector *  outputVector)
+{
+  this->Superclass::RequestInformation( request, inputVector, outputVector );
+
+  vtkInformation* outInfo = outputVector->GetInformationObject(0);
+
+  // 3 components in the output:
+  // Comp 0: interpolated ray
+  // Comp 1: first order derivative
+  // Comp 2: second order derivative
+  vtkDataObject::SetPointDataActiveScalarInfo(outInfo, VTK_DOUBLE, 3);
+
+  vtkImageData* input = vtkImageData::GetData(inputVector[0]);
+  this->ComputeRayGeometry(input->GetSpacing());
+
+  int nrays = static_cast<int>(this->Thetas.size());
+  int nsamples = this->MaximumNumberOfRaySamples;
+  outInfo->Set(vtkDataObject::SPACING(), 1, 1, 1);
+  outInfo->Set(vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(),
+               0, nsamples-1, 0, nrays-1, 0, 0);
+
+  return 1;
+}
+
+//----------------------------------------------------------------------------
+double *vtkImageReformatAlongRays::GetRayPointer(int idx)
+{
+  double *base = static_cast<double *>(this->GetOutput()->GetScalarPointer());
+  return base + 3*static_cast<vtkIdType>(idx)*this->MaximumNumberOfRaySamples;
+}
+
+//----------------------------------------------------------------------------
+void vtkImageReformatAlongRays::ThreadedSampleRays(gageContext *gtx,
+                                                   int firstRay, int lastRay)
+{
+  gagePerVolume *pvl = gtx->pvl[0];
+  const double *valu = gageAnswerPointer(gtx, pvl, gageSclValue);
+  const double *grad = gageAnswerPointer(gtx, pvl, gageSclGradVec);
+  const double *hess = gageAnswerPointer(gtx, pvl, gageSclHessian);
+
+  double dp[3], vp[3], xp[3], hessvp[3];
+  for (int r = firstRay; r <= lastRay; r++)
+    {
+    double th = this->Thetas[r];
+    vp[0] = cos(th);
+    vp[1] = sin(th);
+    vp[2] = 0;
+    for (int i = 0; i < 3; i++)
+      {
+      dp[i] = this->Delta * vp[i];
+      xp[i] = this->Center[i] + vp[i] * this->RMin;
+      }
+
+    double *outPtr = this->GetRayPointer(r);
+    int nsamples = this->NumberOfRaySamples[r];
+    for (int k = 0; k < nsamples; k++)
+      {
+      gageProbe(gtx, xp[0], xp[1], xp[2]);
+      *outPtr++ = valu[0];
+      *outPtr++ = vp[0]*grad[0] + vp[1]*grad[1] + vp[2]*grad[2];
+      ELL_3MV_MUL(hessvp, hess, vp);
+      *outPtr++ = hessvp[0]*vp[0] + hessvp[1]*vp[1] + hessvp[2]*vp[2];
+      for (int i = 0; i < 3; i++)
+        {
+        xp[i] = xp[i] + dp[i];
+        }
+      }
+    // Pad the unused tail of the row so the buffer is fully defined
+    for (int k = nsamples; k < this->MaximumNumberOfRaySamples; k++)
+      {
+      *outPtr++ = 0;
+      *outPtr++ = 0;
+      *outPtr++ = 0;
+      }
+    }
+}
+
+//----------------------------------------------------------------------------
+struct vtkImageReformatAlongRaysThreadStruct
+{
+  vtkImageReformatAlongRays *Filter;
+  gageContext **Contexts;
+  int NumberOfRays;
+};
+
+//----------------------------------------------------------------------------
+// Each thread gets a contiguous block of rays and its own copy of the
+// gage context (gage contexts hold per-probe state and cannot be shared).
+VTK_THREAD_RETURN_TYPE vtkImageReformatAlongRaysThreadedExecute( void *arg )
+{
+  int threadId = ((ThreadInfoStruct *)(arg))->ThreadID;
+  int threadCount = ((ThreadInfoStruct *)(arg))->NumberOfThreads;
+  vtkImageReformatAlongRaysThreadStruct *str =
+    (vtkImageReformatAlongRaysThreadStruct *)(((ThreadInfoStruct *)(arg))->UserData);
+
+  int raysPerThread = (str->NumberOfRays + threadCount - 1)/threadCount;
+  int firstRay = threadId*raysPerThread;
+  int lastRay = firstRay + raysPerThread - 1;
+  if (lastRay >= str->NumberOfRays)
+    {
+    lastRay = str->NumberOfRays - 1;
+    }
+
+  if (firstRay <= lastRay)
+    {
+    str->Filter->ThreadedSampleRays(str->Contexts[threadId], firstRay, lastRay);
+    }
+
+  return VTK_THREAD_RETURN_VALUE;
+}
+
+//----------------------------------------------------------------------------
+void vtkImageReformatAlongRays::ExecuteDataWithInformation(vtkDataObject *out,
+  vtkInformation* outInfo)
+{
+  vtkImageData *input = vtkImageData::SafeDownCast(this->GetInput());
+
+  // Make sure the Input has been set.
+  if ( input == NULL )
+    {
+    vtkErrorMacro(<< "ExecuteData: Input is not set.");
+    return;
+    }
+
+  this->ComputeRayGeometry(input->GetSpacing());
+  int nrays = static_cast<int>(this->Thetas.size());
+  if (nrays == 0 || this->MaximumNumberOfRaySamples == 0)
+    {
+    return;
+    }
+
+  vtkImageData *output = this->GetOutput();
+  output->SetExtent(0, this->MaximumNumberOfRaySamples-1, 0, nrays-1, 0, 0);
+  output->AllocateScalars(outInfo);
+
+  // gage needs a single component volume. Multicomponent inputs (one
+  // component per reconstruction kernel) are split once here instead of
+  // once per ray.
+  vtkImageExtractComponents *extract = NULL;
+  vtkImageData *scalarInput = input;
+  if (input->GetNumberOfScalarComponents() > 1)
+    {
+    extract = vtkImageExtractComponents::New();
+    extract->SetInputData(input);
+    extract->SetComponents(this->InputComponent);
+    extract->Update();
+    scalarInput = extract->GetOutput();
+    }
+
+  // Convert input to nrrd
+  int dims[3];
+  double Spacing[3];
+  scalarInput->GetDimensions(dims);
+  scalarInput->GetSpacing(Spacing);
+  void *data = (void *) scalarInput->GetScalarPointer();
+  if (data == NULL)
+    {
+    vtkErrorMacro("Input does not have Scalars");
+    if (extract != NULL)
+      {
+      extract->Delete();
+      }
+    return;
+    }
+
+  size_t size[3];
+  size[0] = dims[0];
+  size[1] = dims[1];
+  size[2] = dims[2];
+
+  Nrrd *nin = nrrdNew();
+  const int type = this->VTKToNrrdPixelType(scalarInput->GetScalarType());
+  if (nrrdWrap_nva(nin, data, type, 3, size))
+    {
+    vtkErrorMacro("Error with nrrdWrap");
+    nrrdNix(nin);
+    if (extract != NULL)
+      {
+      extract->Delete();
+      }
+    return;
+    }
+  nrrdAxisInfoSet_nva(nin, nrrdAxisInfoSpacing, Spacing);
+  nin->axis[0].center = nrrdCenterCell;
+  nin->axis[1].center = nrrdCenterCell;
+  nin->axis[2].center = nrrdCenterCell;
+
+  // Create and configure the gage context once for all rays
+  int E = 0;
+  gageContext *gtx = gageContextNew();
+  gageParmSet(gtx, gageParmRenormalize, AIR_TRUE);
+  gagePerVolume *pvl = NULL;
+  if (!E) E |= !(pvl = gagePerVolumeNew(gtx, nin, gageKindScl));
+  if (!E) E |= gagePerVolumeAttach(gtx, pvl);
+
+  double kparm[3];
+  kparm[0] = this->Scale;
+  kparm[1] = 0.5;
+  kparm[2] = 0.25;
+
+  if (!E) E |= gageKernelSet(gtx, gageKernel00, nrrdKernelBCCubic, kparm);
+  if (!E) E |= gageKernelSet(gtx, gageKernel11, nrrdKernelBCCubicD, kparm);
+  if (!E) E |= gageKernelSet(gtx, gageKernel22, nrrdKernelBCCubicDD, kparm);
+  if (!E) E |= gageQueryItemOn(gtx, pvl, gageSclValue);
+  if (!E) E |= gageQueryItemOn(gtx, pvl, gageSclGradVec);
+  if (!E) E |= gageQueryItemOn(gtx, pvl, gageSclHessian);
+  if (!E) E |= gageUpdate(gtx);
+  if (E)
+    {
+    vtkErrorMacro(<< "trouble setting up gage: " << biffGetDone(GAGE));
+    gageContextNix(gtx);
+    nrrdNix(nin);
+    if (extract != NULL)
+      {
+      extract->Delete();
+      }
+    return;
+    }
+
+  int numThreads = this->NumberOfThreads;
+  if (numThreads > nrays)
+    {
+    numThreads = nrays;
+    }
+
+  std::vector<gageContext *> contexts(numThreads, (gageContext *)NULL);
+  contexts[0] = gtx;
+  for (int t = 1; t < numThreads; t++)
+    {
+    contexts[t] = gageContextCopy(gtx);
+    if (contexts[t] == NULL)
+      {
+      // Fall back to the threads we could set up
+      numThreads = t;
+      break;
+      }
+    }
+
+  vtkImageReformatAlongRaysThreadStruct str;
+  str.Filter = this;
+  str.Contexts = &contexts[0];
+  str.NumberOfRays = nrays;
+
+  this->Threader->SetNumberOfThreads(numThreads);
+  this->Threader->SetSingleMethod(vtkImageReformatAlongRaysThreadedExecute, &str);
+  this->Threader->SingleMethodExecute();
+
+  for (int t = 1; t < numThreads; t++)
+    {
+    gageContextNix(contexts[t]);
+    }
+  gageContextNix(gtx);
+  nrrdNix(nin);
+  if (extract != NULL)
+    {
+    extract->Delete();
+    }
+}
+
+//----------------------------------------------------------------------------
+int vtkImageReformatAlongRays::VTKToNrrdPixelType( const int vtkPixelType )
+{
+  switch( vtkPixelType )
+    {
+    default:
+    case VTK_VOID:
+      return nrrdTypeDefault;
+    case VTK_CHAR:
+      return nrrdTypeChar;
+    case VTK_UNSIGNED_CHAR:
+      return nrrdTypeUChar;
+    case VTK_SHORT:
+      return nrrdTypeShort;
+    case VTK_UNSIGNED_SHORT:
+      return nrrdTypeUShort;
+    case VTK_INT:
+      return nrrdTypeInt;
+    case VTK_UNSIGNED_INT:
+      return nrrdTypeUInt;
+    case VTK_FLOAT:
+      return nrrdTypeFloat;
+    case VTK_DOUBLE:
+      return nrrdTypeDouble;
+    }
+}
+
+//----------------------------------------------------------------------------
+void vtkImageReformatAlongRays::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+
+  os << indent << "Number of theta samples: " << this->NumberOfThetaSamples << "\n";
+  os << indent << "RMin: " << this->RMin << "\n";
+  os << indent << "RMax: " << this->RMax << "\n";
+  os << indent << "Delta: " << this->Delta << "\n";
+  os << indent << "Scale: " << this->Scale << "\n";
+  os << indent << "Input component: " << this->InputComponent << "\n";
+  os << indent << "Number of threads: " << this->NumberOfThreads << "\n";
+}
@@ -0,0 +1,147 @@
+/*=========================================================================
+
+  Program:   Visualization Toolkit
+  Module:    $RCSfile: vtkImageReformatAlongRays.h,v $
+
+  Copyright (c) Ken Martin, Will Schroeder, Bill Lorensen
+  All rights reserved.
+  See Copyright.txt or http://www.kitware.com/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+// .NAME vtkImageReformatAlongRays - sample a fan of radial rays in one pass
+// .SECTION Description
+// vtkImageReformatAlongRays samples NumberOfThetaSamples radial rays
+// that leave Center in the xy plane, all in a single execution. The
+// output is a (radius x theta) image with 3 double components per
+// sample: the interpolated value, the first derivative along the ray and
+// the second derivative along the ray. Row j of the output holds the ray
+// at angle theta_j; only the first GetNumberOfRaySamples(j) samples of
+// each row are valid, because the physical sample spacing (and therefore
+// the number of samples) depends on the ray direction when the in-plane
+// spacing is anisotropic.
+//
+// The interpolation kernels are the same BC-cubic kernels used by
+// vtkImageReformatAlongRay, so each row of the output is identical to the
+// output of vtkImageReformatAlongRay for the same theta. The input is
+// wrapped and the gage context is configured once per execution, and the
+// rays are distributed across threads.
+// .SECTION See Also
+// vtkImageReformatAlongRay vtkComputeAirwayWall
+
+#ifndef __vtkImageReformatAlongRays_h
+#define __vtkImageReformatAlongRays_h
+
+#include "vtkImageAlgorithm.h"
+#include "vtkCIPCommonConfigure.h"
+#include "vtkMultiThreader.h"
+
+#include "teem/nrrd.h"
+#include "teem/gage.h"
+
+#include <vector>
+
+class VTK_CIP_COMMON_EXPORT vtkImageReformatAlongRays : public vtkImageAlgorithm
+{
+public:
+  static vtkImageReformatAlongRays *New();
+  vtkTypeMacro(vtkImageReformatAlongRays, vtkImageAlgorithm);
+  void PrintSelf(ostream& os, vtkIndent indent);
+
+  // Description:
+  // Number of rays. Angles are 0, dth, 2*dth, ... with dth = 2*pi/N
+  vtkSetMacro(NumberOfThetaSamples,int);
+  vtkGetMacro(NumberOfThetaSamples,int);
+
+  // Description:
+  // Minimum radius in mm
+  vtkSetMacro(RMin,double);
+  vtkGetMacro(RMin,double);
+
+  // Description:
+  // Maximum radius in mm
+  vtkSetMacro(RMax,double);
+  vtkGetMacro(RMax,double);
+
+  // Description:
+  // Center for the ray tracing (in ijk space)
+  vtkSetVectorMacro(Center,double,3);
+  vtkGetVectorMacro(Center,double,3);
+
+  // Description:
+  // Spacing along ray in pixel units
+  vtkSetMacro(Delta,double);
+  vtkGetMacro(Delta,double);
+
+  // Description:
+  // Scale for derivative computations
+  vtkSetMacro(Scale,double);
+  vtkGetMacro(Scale,double);
+
+  // Description:
+  // Scalar component of the input that is sampled
+  vtkSetMacro(InputComponent,int);
+  vtkGetMacro(InputComponent,int);
+
+  // Description:
+  // Number of threads used to sample the rays
+  vtkSetClampMacro( NumberOfThreads, int, 1, VTK_MAX_THREADS );
+  vtkGetMacro( NumberOfThreads, int );
+
+  // Description:
+  // Angle, number of valid samples and physical sample spacing of
+  // ray idx. Valid after the filter has been updated.
+  double GetTheta(int idx)
+    { return this->Thetas[idx]; }
+  int GetNumberOfRaySamples(int idx)
+    { return this->NumberOfRaySamples[idx]; }
+  double GetRaySpacing(int idx)
+    { return this->RaySpacings[idx]; }
+
+  // Description:
+  // Pointer to the first (value, d/dr, d2/dr2) triplet of ray idx.
+  double *GetRayPointer(int idx);
+
+  // Description:
+  // Sample the rays with index in [firstRay,lastRay] using the given
+  // gage context. Called by the threads.
+  void ThreadedSampleRays(gageContext *gtx, int firstRay, int lastRay);
+
+protected:
+  vtkImageReformatAlongRays();
+  ~vtkImageReformatAlongRays();
+
+  virtual void ExecuteDataWithInformation(vtkDataObject *output,
+                                          vtkInformation* outInfo);
+
+  virtual int RequestInformation(vtkInformation *, vtkInformationVector**,
+                                 vtkInformationVector *);
+
+  void ComputeRayGeometry(double *inputSpacing);
+  int VTKToNrrdPixelType( const int vtkPixelType );
+
+  int NumberOfThetaSamples;
+  double RMin;
+  double RMax;
+  double Center[3];
+  double Delta;
+  double Scale;
+  int InputComponent;
+
+  std::vector<double> Thetas;
+  std::vector<int> NumberOfRaySamples;
+  std::vector<double> RaySpacings;
+  int MaximumNumberOfRaySamples;
+
+  vtkMultiThreader *Threader;
+  int NumberOfThreads;
+
+private:
+  vtkImageReformatAlongRays(const vtkImageReformatAlongRays&);  // Not implemented.
+  void operator=(const vtkImageReformatAlongRays&);  // Not implemented.
+};
+
+#endif
@@ -21,8 +21,12 @@
 #include "vtkObjectFactory.h"
 #include "vtkInformation.h"
 #include "vtkExecutive.h"
+#include "vtkMultiThreader.h"
+#include "vtkStreamingDemandDrivenPipeline.h"
 
 #include <math.h>
+#include <string.h>
+#include <vector>
 
 vtkStandardNewMacro(vtkLungIntensityCorrection);
 
@@ -139,372 +143,377 @@ void vtkLungIntensityCorrection::ExecuteInformation(vtkImageData *input,
 */
 
 
+//----------------------------------------------------------------------------
+// The rows of the output extent are processed in two passes. The first
+// gathers, for each row, the mean intensity inside the stencil (the mean of
+// the means of its stencil segments) and the number of segments. The line
+// of each slice is then fitted in closed form from sums over its rows, and
+// the second pass applies the correction. Rows are split in contiguous
+// blocks across threads, so every row belongs to a single thread.
+enum vtkLungIntensityCorrectionPass
+{
+  VTK_LUNG_INTENSITY_GATHER,
+  VTK_LUNG_INTENSITY_CORRECT
+};
+
+struct vtkLungIntensityCorrectionThreadStruct
+{
+  vtkLungIntensityCorrection *Filter;
+  vtkImageData *InData;
+  vtkImageData *OutData;
+  int *Extent;
+  int Pass;
+  int NumberOfRows;
+  int NumberOfBlocks;
+  double *RowValues;
+  double *RowSegments;
+  double *Slopes;
+  double *Intercepts;
+  double *DCValues;
+};
+
+//----------------------------------------------------------------------------
+// Get the next segment [r1,r2] of row (idY,idZ) of the stencil, with 'iter'
+// as in vtkImageStencilData::GetNextExtent. Without stencil the whole row is
+// a single segment if 'inside' is set, and there is none otherwise.
+static int vtkLungIntensityCorrectionNextSegment(vtkImageStencilData *stencil,
+                                                 int ext[6], int idY, int idZ,
+                                                 int inside, int &iter,
+                                                 int &r1, int &r2)
+{
+  r1 = ext[1] + 1;
+  r2 = ext[1];
+  if (stencil)
+    {
+    return stencil->GetNextExtent(r1, r2, ext[0], ext[1], idY, idZ, iter);
+    }
+
+  if (!inside || iter == 1)
+    {
+    return 0;
+    }
+  r1 = ext[0];
+  r2 = ext[1];
+  iter = 1;
+  return 1;
+}
+
 //----------------------------------------------------------------------------
 template <class T>
-void vtkLungIntensityCorrectionExecute(vtkLungIntensityCorrection *self,
-                            vtkImageData *inData, T *inPtr,
-                            vtkImageData *outData, T *outPtr,
-                            int outExt[6], int id)
+void vtkLungIntensityCorrectionGatherRows(vtkLungIntensityCorrection *self,
+                                          vtkImageData *inData, T *inPtr,
+                                          int ext[6], int firstRow, int lastRow,
+                                          double *rowValues, double *rowSegments)
 {
-  int numscalars;
-  int idX, idY, idZ;
-  int r1, r2, cr1, cr2, iter, rval;
-  vtkIdType outIncX, outIncY, outIncZ;
-  int inExt[6];
-  vtkIdType inInc[3], outInc[3];
-  unsigned long count = 0;
-  int idx;
-  unsigned long target;
-  T *tempPtr, *outtempPtr;
-  double value,tmpvalue;
-  double nvalue;
-  double dcvalue;
-  int minY,maxY;
- 
-  // get the clipping extents
   vtkImageStencilData *stencil = self->GetStencil();
 
- // get parameters array
-  vtkDoubleArray *parameters = self->GetParameters();
-
-  // find maximum input range
+  int inExt[6];
+  vtkIdType inInc[3];
   inData->GetExtent(inExt);
   inData->GetIncrements(inInc);
+  int numscalars = inData->GetNumberOfScalarComponents();
+  int numY = ext[3] - ext[2] + 1;
 
-  // Get Increments to march through data 
-  outData->GetContinuousIncrements(outExt, outIncX, outIncY, outIncZ);
-  outData->GetIncrements(outInc);
-  numscalars = inData->GetNumberOfScalarComponents();
-
-  target = (unsigned long)
-    ((outExt[5]-outExt[4]+1)*(outExt[3]-outExt[2]+1)/50.0);
-  target++;  
-  
-
-  // Allocate matrices for LS problem
-    double **xt;
-    double **yt;
-    double **Mt;
-    double *w;
-    int numdimY = inExt[3]-inExt[2]+1;
-    xt = new double* [numdimY];
-    yt = new double* [numdimY];
-    for (int i=0;i<numdimY;i++)
-       {
-        xt[i] = new double [2];
-        yt[i] = new double [1];
-        }
-    Mt = new double* [2];
-    double m,n;
-    Mt[0] = &m;
-    Mt[1] = &n;
-    
-    if (self->GetUseWeightedLS()) 
+  for (int row = firstRow; row <= lastRow; row++)
+    {
+    int idZ = ext[4] + row/numY;
+    int idY = ext[2] + row%numY;
+
+    // The stencil's own extents are wanted here, or their complement
+    // when the stencil is reversed
+    int iter = self->GetReverseStencil() ? -1 : 0;
+    int r1, r2;
+    double value = 0.0;
+    double nvalue = 0.0;
+    while (vtkLungIntensityCorrectionNextSegment(stencil, ext, idY, idZ, 1,
+                                                 iter, r1, r2))
       {
-       w = new double [numdimY];
+      T *tempPtr = inPtr + (inInc[2]*(idZ - inExt[4]) +
+                            inInc[1]*(idY - inExt[2]) +
+                            numscalars*(r1 - inExt[0]));
+      double tmpvalue = 0.0;
+      for (int idX = r1; idX <= r2; idX++)
+        {
+        tmpvalue += (double) *tempPtr;
+        tempPtr++;
+        }
+      value += tmpvalue/(r2-r1+1);
+      nvalue = nvalue+1;
       }
-      
 
-  //Init minY maxY
-  minY = outExt[3];
-  maxY = outExt[2];
+    rowValues[row] = nvalue > 0 ? value/nvalue : 0.0;
+    rowSegments[row] = nvalue;
+    }
+}
+
+//----------------------------------------------------------------------------
+template <class T>
+void vtkLungIntensityCorrectionCorrectRows(vtkLungIntensityCorrection *self,
+                                           vtkImageData *inData, T *inPtr,
+                                           vtkImageData *outData, T *outPtr,
+                                           int ext[6], int firstRow, int lastRow,
+                                           double *slopes, double *intercepts,
+                                           double *dcvalues)
+{
+  vtkImageStencilData *stencil = self->GetStencil();
 
-  // Loop through output pixels
-  for (idZ = outExt[4]; idZ <= outExt[5]; idZ++)
+  int inExt[6];
+  vtkIdType inInc[3], outInc[3];
+  inData->GetExtent(inExt);
+  inData->GetIncrements(inInc);
+  outData->GetIncrements(outInc);
+  int numscalars = inData->GetNumberOfScalarComponents();
+  int numY = ext[3] - ext[2] + 1;
+  int clamp = (self->GetClampNegativeValues() == 1);
+
+  for (int row = firstRow; row <= lastRow; row++)
     {
-    idx = 0;
-    cout<<"Slice "<<idZ<<endl;
-    for (idY = outExt[2]; idY <= outExt[3]; idY++)
+    int slice = row/numY;
+    int idZ = ext[4] + slice;
+    int idY = ext[2] + row%numY;
+
+    // The correction is constant along the row
+    T correction = (T)(idY*slopes[slice] + intercepts[slice] - dcvalues[slice]);
+
+    // Correct the data inside the stencil, and copy the input data
+    // outside of it
+    for (int inside = 1; inside >= 0; inside--)
       {
-      if (!id) 
+      int iter = (inside != 0) == (self->GetReverseStencil() == 0) ? 0 : -1;
+      int r1, r2;
+      while (vtkLungIntensityCorrectionNextSegment(stencil, ext, idY, idZ, inside,
+                                                   iter, r1, r2))
         {
-        if (!(count%target)) 
+        T *tempPtr = inPtr + (inInc[2]*(idZ - inExt[4]) +
+                              inInc[1]*(idY - inExt[2]) +
+                              numscalars*(r1 - inExt[0]));
+        T *outtempPtr = outPtr + (outInc[2]*(idZ - ext[4]) +
+                                  outInc[1]*(idY - ext[2]) +
+                                  numscalars*(r1 - ext[0]));
+        int n = r2 - r1 + 1;
+        if (!inside)
           {
-          self->UpdateProgress(count/(50.0*target));
+          memcpy(outtempPtr, tempPtr, n*sizeof(T));
           }
-        count++;
-        }
-
-      iter = 0;
-      if (self->GetReverseStencil())
-        { // flag that we want the complementary extents
-        iter = -1;
-        }
-
-      cr1 = outExt[0];
-      value = 0.0;
-      nvalue = 0;
-      rval = 0;
-      for (;;)
-        {
-
-        r1 = outExt[1] + 1;
-        r2 = outExt[1];
-        if (stencil)
+        else if (clamp)
           {
-          rval = stencil->GetNextExtent(r1, r2, outExt[0], outExt[1],
-                                        idY, idZ, iter);
-          if (rval == 0)
+          for (int i = 0; i < n; i++)
             {
-             break;
+            T value = tempPtr[i] - correction;
+            outtempPtr[i] = value < 0 ? 0 : value;
             }
           }
         else
           {
-	      
-          r1 = outExt[0];
-          r2 = outExt[1];
-          if (rval == 1)
+          for (int i = 0; i < n; i++)
             {
-             break;
+            outtempPtr[i] = tempPtr[i] - correction;
             }
-          rval = 1;
           }
+        }
+      }
+    }
+}
 
-	if (idY < minY)
-	  minY = idY;
-	if (idY > maxY)
-	  maxY = idY;
-  
+//----------------------------------------------------------------------------
+static VTK_THREAD_RETURN_TYPE vtkLungIntensityCorrectionThreadedExecute( void *arg )
+{
+  int threadId = ((ThreadInfoStruct *)(arg))->ThreadID;
+  vtkLungIntensityCorrectionThreadStruct *str =
+    (vtkLungIntensityCorrectionThreadStruct *)(((ThreadInfoStruct *)(arg))->UserData);
 
-        cr1 = r1;
-        cr2 = r2;
-        tempPtr = inPtr + (inInc[2]*(idZ - inExt[4]) +
-                           inInc[1]*(idY - inExt[2]) +
-                           numscalars*(r1 - inExt[0]));
+  if (threadId >= str->NumberOfBlocks)
+    {
+    return VTK_THREAD_RETURN_VALUE;
+    }
 
-        //Loop through region gathering data
-        tmpvalue =0;
-        for (idX = r1; idX<= r2; idX++)
-          {
-          // gather mean pixel value
-          tmpvalue += (double) *tempPtr;
-          tempPtr++;  
-          } 
-        value += tmpvalue/(r2-r1+1);
-        nvalue = nvalue+1;
+  int rowsPerThread = (str->NumberOfRows + str->NumberOfBlocks - 1)/str->NumberOfBlocks;
+  int firstRow = threadId*rowsPerThread;
+  int lastRow = firstRow + rowsPerThread - 1;
+  if (lastRow >= str->NumberOfRows)
+    {
+    lastRow = str->NumberOfRows - 1;
+    }
+  if (firstRow > lastRow)
+    {
+    return VTK_THREAD_RETURN_VALUE;
+    }
 
-        } //end of loop along x stencil
+  void *inPtr = str->InData->GetScalarPointer();
+  void *outPtr = str->OutData->GetScalarPointerForExtent(str->Extent);
 
-        if (nvalue > 0)
-          {
-           value = value/nvalue;
-           //cout <<"Value: "<<value<<endl;
-
-           //Fill matrices to solve LS problem
-           xt[idx][0] = idY;
-           xt[idx][1] = 1.0;
-           yt[idx][0] = value;
-	   
-	   if (self->GetUseWeightedLS())
-	     {
-	     w[idx] = nvalue/(outExt[1]-outExt[0]+1);
-	     }
-           idx++;
-           }
-        }
-      
-   
-    //Solve LS problem
-    if (idx > 0) 
+  if (str->Pass == VTK_LUNG_INTENSITY_GATHER)
+    {
+    switch (str->InData->GetScalarType())
       {
-      
-      if (self->GetUseWeightedLS())
-        {
-	 vtkLungIntensityCorrection::SolveWeightedLeastSquares(idx,xt,2,yt,1,w,Mt);
-	}
-      else 
-        {	 
-         vtkMath::SolveLeastSquares(idx,xt,2,yt,1,Mt);
-        }
-      parameters->SetComponent(idZ,0,m);
-      parameters->SetComponent(idZ,1,n);
+      vtkTemplateMacro(
+        vtkLungIntensityCorrectionGatherRows(
+          str->Filter, str->InData, (VTK_TT *)(inPtr), str->Extent,
+          firstRow, lastRow, str->RowValues, str->RowSegments
+        )
+      );
       }
-    else {
-      //Nothing to do. Flat line
-      m = 0;
-      n = 0;
-      parameters->SetComponent(idZ,0,m);
-      parameters->SetComponent(idZ,1,n);
+    }
+  else
+    {
+    switch (str->InData->GetScalarType())
+      {
+      vtkTemplateMacro(
+        vtkLungIntensityCorrectionCorrectRows(
+          str->Filter, str->InData, (VTK_TT *)(inPtr), str->OutData,
+          (VTK_TT *)(outPtr), str->Extent, firstRow, lastRow,
+          str->Slopes, str->Intercepts, str->DCValues
+        )
+      );
       }
+    }
 
+  return VTK_THREAD_RETURN_VALUE;
+}
 
-    // Update Output
+//----------------------------------------------------------------------------
+// Runs the two passes on blocks of whole rows, and fits the line of each
+// slice between them from the rows of all the blocks
+int vtkLungIntensityCorrection::RequestData(vtkInformation *vtkNotUsed(request),
+  vtkInformationVector** inputVector,
+  vtkInformationVector* outputVector)
+{
+  vtkImageData* inData = vtkImageData::GetData(inputVector[0]);
+  vtkImageData* outData = vtkImageData::GetData(outputVector);
+  vtkInformation* outInfo = outputVector->GetInformationObject(0);
 
-    //Compute dc value
-    switch (self->GetDCValue())
-      {
-      case DCLOW: 
-         if (m>0)
-           dcvalue = (m*minY+n);
-         else
-           dcvalue = (m*maxY+n);
-         break;
-      case DCMEAN:
-         dcvalue = (m*(maxY+minY) + 2*n)/2.0;
-         break;
-      case DCHIGH:
-         if (m>0)
-           dcvalue = (m*maxY+n);
-         else
-           dcvalue = (m*minY+n);
-         break;
-      }
-    cout<<"parameters (m,n): "<<m<<" "<<n<<endl;  
-    cout<<"dcvalue: "<<dcvalue<<" minY: "<<minY<<" maxY:"<<maxY<<endl;
+  if (inData == NULL)
+    {
+    vtkErrorMacro(<< "RequestData: input is not set.");
+    return 0;
+    }
 
-    for (idY = outExt[2]; idY <= outExt[3]; idY++)
-      {
-      if (!id) 
-        {
-        if (!(count%target)) 
-          {
-          self->UpdateProgress(count/(50.0*target));
-          }
-        count++;
-        }
+  int ext[6];
+  outInfo->Get(vtkStreamingDemandDrivenPipeline::UPDATE_EXTENT(), ext);
+  this->AllocateOutputData(outData, outInfo, ext);
 
-      iter = 0;
-      if (self->GetReverseStencil())
-        { // flag that we want the complementary extents
-        iter = -1;
-        }
+  if (inData->GetScalarType() != outData->GetScalarType())
+    {
+    vtkErrorMacro(<< "RequestData: output scalar type " << outData->GetScalarType()
+                  << " must match input scalar type " << inData->GetScalarType());
+    return 0;
+    }
+
+  int numY = ext[3] - ext[2] + 1;
+  int numZ = ext[5] - ext[4] + 1;
+  if (numY <= 0 || numZ <= 0 || ext[1] < ext[0])
+    {
+    return 1;
+    }
+  int numberOfRows = numY*numZ;
+
+  std::vector<double> rowValues(numberOfRows);
+  std::vector<double> rowSegments(numberOfRows);
+  std::vector<double> slopes(numZ);
+  std::vector<double> intercepts(numZ);
+  std::vector<double> dcvalues(numZ);
+
+  vtkLungIntensityCorrectionThreadStruct str;
+  str.Filter = this;
+  str.InData = inData;
+  str.OutData = outData;
+  str.Extent = ext;
+  str.NumberOfRows = numberOfRows;
+  str.NumberOfBlocks = this->NumberOfThreads < numberOfRows ? this->NumberOfThreads : numberOfRows;
+  str.RowValues = &rowValues[0];
+  str.RowSegments = &rowSegments[0];
+  str.Slopes = &slopes[0];
+  str.Intercepts = &intercepts[0];
+  str.DCValues = &dcvalues[0];
+
+  this->Threader->SetNumberOfThreads(str.NumberOfBlocks);
+  this->Threader->SetSingleMethod(vtkLungIntensityCorrectionThreadedExecute, &str);
+
+  str.Pass = VTK_LUNG_INTENSITY_GATHER;
+  this->Threader->SingleMethodExecute();
+  this->UpdateProgress(0.5);
+
+  // Fit a line to the mean row intensities of each slice: the weighted
+  // least squares fit of value = m*y + n. The weight of a row is the number
+  // of stencil segments in the row divided by the row's width (or 1), and
+  // enters the sums squared, as in SolveWeightedLeastSquares.
+  if (this->Parameters->GetNumberOfTuples() < numZ)
+    {
+    this->Parameters->SetNumberOfComponents(2);
+    this->Parameters->SetNumberOfTuples(numZ);
+    }
 
-      rval = 0;
-      for (;;)
+  double width = ext[1] - ext[0] + 1;
+  for (int slice = 0; slice < numZ; slice++)
+    {
+    double s = 0.0, sy = 0.0, syy = 0.0, sv = 0.0, syv = 0.0;
+    int minY = ext[3];
+    int maxY = ext[2];
+    for (int j = 0; j < numY; j++)
+      {
+      int row = slice*numY + j;
+      if (rowSegments[row] == 0)
         {
+        continue;
+        }
+      double y = ext[2] + j;
+      double w = this->UseWeightedLS ? rowSegments[row]/width : 1.0;
+      double ww = w*w;
+      s += ww;
+      sy += ww*y;
+      syy += ww*y*y;
+      sv += ww*rowValues[row];
+      syv += ww*y*rowValues[row];
+      minY = (ext[2] + j < minY) ? ext[2] + j : minY;
+      maxY = (ext[2] + j > maxY) ? ext[2] + j : maxY;
+      }
 
-        r1 = outExt[1] + 1;
-        r2 = outExt[1];
-        if (stencil)
-          {
-          rval = stencil->GetNextExtent(r1, r2, outExt[0], outExt[1],
-                                        idY, idZ, iter);
-          if (rval == 0)
-            {
-             break;
-            }
-          }
-        else
-          {
-          r1 = outExt[0];
-          r2 = outExt[1];
-          if (rval == 1)
-            {
-             break;
-            }
-          rval = 1;
-          }
-        tempPtr = inPtr + (inInc[2]*(idZ - inExt[4]) +
-                           inInc[1]*(idY - inExt[2]) +
-                           numscalars*(r1 - inExt[0]));
-        outtempPtr = outPtr + (outInc[2]*(idZ - outExt[4]) +
-                           outInc[1]*(idY - outExt[2]) +
-                           numscalars*(r1 - outExt[0]));
-
-        for (idX = r1; idX<= r2; idX++)
-          {
-          //Correction
-	  *outtempPtr = *tempPtr - (T)(idY*m + n - dcvalue);
-	  if (self->GetClampNegativeValues()==1)
-	    {
-	     if (*outtempPtr<0)
-	       *outtempPtr = 0;
-	    }
-           outtempPtr++;
-           tempPtr++;
-           }
-        
-         }
-   
-      // Copy input data into output in the areas outside the stencil
-      iter = -1;
-      if (self->GetReverseStencil())
-        { // flag that we want the complementary extents
-        iter = 0;
-        }     
-      rval = 0;
-      for (;;)
+    // Nothing to do without samples: flat line. A single row gives a
+    // flat line through it.
+    double m = 0.0;
+    double n = 0.0;
+    if (s > 0.0)
+      {
+      double meanY = sy/s;
+      double meanV = sv/s;
+      double varY = syy/s - meanY*meanY;
+      if (maxY > minY && varY > 0.0)
         {
+        m = (syv/s - meanY*meanV)/varY;
+        }
+      n = meanV - m*meanY;
+      }
 
-        r1 = outExt[1] + 1;
-        r2 = outExt[1];
-        if (stencil)
-          {
-          rval = stencil->GetNextExtent(r1, r2, outExt[0], outExt[1],
-                                        idY, idZ, iter);
-          if (rval == 0)
-            {
-             break;
-            }
-          }
-        else
-          {
-            //Data has been already copied to the output in the previous pass.
-	    break;
-          }
-        tempPtr = inPtr + (inInc[2]*(idZ - inExt[4]) +
-                           inInc[1]*(idY - inExt[2]) +
-                           numscalars*(r1 - inExt[0]));
-        outtempPtr = outPtr + (outInc[2]*(idZ - outExt[4]) +
-                           outInc[1]*(idY - outExt[2]) +
-                           numscalars*(r1 - outExt[0]));
-
-        for (idX = r1; idX<= r2; idX++)
-          {
-          //Correction
-          *outtempPtr = *tempPtr;
-           outtempPtr++;
-           tempPtr++;
-           }
-        
-         }      
-   
-    //outPtr += outIncY;
-   }
-
-    // Jump to next slices
-    //outPtr += outIncZ;
-   }
-
-//free data
-for (int i=0;i<numdimY;i++)
- {
-  delete xt[i];
-  delete yt[i];
- }
- delete xt;
- delete yt;
- delete Mt;
-}
+    double dcvalue;
+    switch (this->DCValue)
+      {
+      case DCLOW:
+         dcvalue = (m > 0) ? (m*minY+n) : (m*maxY+n);
+         break;
+      case DCHIGH:
+         dcvalue = (m > 0) ? (m*maxY+n) : (m*minY+n);
+         break;
+      case DCMEAN:
+      default:
+         dcvalue = (m*(maxY+minY) + 2*n)/2.0;
+         break;
+      }
 
+    slopes[slice] = m;
+    intercepts[slice] = n;
+    dcvalues[slice] = dcvalue;
+    this->Parameters->SetComponent(slice, 0, m);
+    this->Parameters->SetComponent(slice, 1, n);
 
-//----------------------------------------------------------------------------
-// VTK6 migration note:
-// - changed vtkTemplateMacro7 to vtkTemplateMacro
-void vtkLungIntensityCorrection::ThreadedExecute(vtkImageData *inData, 
-                                      vtkImageData *outData,
-                                      int outExt[6], int id)
-{
-  void *inPtr;
-  void *outPtr;
+    vtkDebugMacro(<< "Slice " << ext[4] + slice << " parameters (m,n): " << m << " " << n
+                  << " dcvalue: " << dcvalue << " minY: " << minY << " maxY: " << maxY);
+    }
 
-  vtkDebugMacro("Execute: inData = " << inData << ", outData = " << outData);
-  
-  inPtr = inData->GetScalarPointer();
-  outPtr = outData->GetScalarPointerForExtent(outExt);
+  str.Pass = VTK_LUNG_INTENSITY_CORRECT;
+  this->Threader->SingleMethodExecute();
+  this->UpdateProgress(1.0);
 
-  switch (inData->GetScalarType())
-    {
-    vtkTemplateMacro(
-      vtkLungIntensityCorrectionExecute(
-        this, inData, (VTK_TT *)(inPtr), outData, (VTK_TT *)(outPtr), outExt, id
-      )
-    );
-    default:
-      vtkErrorMacro("Execute: Unknown ScalarType");
-      return;
-    }
+  return 1;
 }
 
 // Solves for the weighted least squares best fit matrix for the equation X'M' =  Y' with weights W=diag(w).
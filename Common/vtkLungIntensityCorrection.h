@@ -82,6 +82,9 @@ public:
      this->SetDCValue(DCHIGH);
   };
 
+  // Description:
+  // Get the parameters (m,n) of the line m*y + n fitted to each slice of
+  // the last output extent.
   vtkGetObjectMacro(Parameters,vtkDoubleArray);
 
   //Descrition:
@@ -113,8 +116,8 @@ protected:
 
   virtual int RequestInformation(vtkInformation *, vtkInformationVector**,
                                  vtkInformationVector *);
-  void ThreadedExecute(vtkImageData *inData, vtkImageData *outData,
-                       int extent[6], int id);
+  virtual int RequestData(vtkInformation *, vtkInformationVector**,
+                          vtkInformationVector *);
 
   int ReverseStencil;
   int ClampNegativeValues;
@@ -0,0 +1,1081 @@
+#include "itkCIPBlockCompressedNrrdImageIO.h"
+#include "itkMetaDataObject.h"
+#include "itkByteSwapper.h"
+#include "itkMultiThreader.h"
+#include "itkSimpleFastMutexLock.h"
+#include "itk_zlib.h"
+#include <itksys/SystemTools.hxx>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+namespace itk
+{
+
+namespace
+{
+
+// A gzip member header with an extra field holding a single 'CP'
+// subfield: the total length of the member in bytes (little endian)
+const unsigned int  GZIPHEADERSIZE  = 20;
+const unsigned int  GZIPTRAILERSIZE = 8;
+const unsigned char GZIPFLAGEXTRA   = 4;
+
+void PutUInt32( unsigned char* p, unsigned int value )
+{
+  p[0] = static_cast< unsigned char >( value & 0xff );
+  p[1] = static_cast< unsigned char >( (value >> 8) & 0xff );
+  p[2] = static_cast< unsigned char >( (value >> 16) & 0xff );
+  p[3] = static_cast< unsigned char >( (value >> 24) & 0xff );
+}
+
+unsigned int GetUInt32( const unsigned char* p )
+{
+  return static_cast< unsigned int >( p[0] ) | ( static_cast< unsigned int >( p[1] ) << 8 ) |
+    ( static_cast< unsigned int >( p[2] ) << 16 ) | ( static_cast< unsigned int >( p[3] ) << 24 );
+}
+
+/** Whether 'header' starts a gzip member written by CompressBlock */
+bool HasMemberSize( const unsigned char* header, SizeValueType available )
+{
+  return ( available >= GZIPHEADERSIZE + GZIPTRAILERSIZE &&
+           header[0] == 0x1f && header[1] == 0x8b && header[2] == Z_DEFLATED &&
+           header[3] == GZIPFLAGEXTRA && header[10] == 8 && header[11] == 0 &&
+           header[12] == 'C' && header[13] == 'P' && header[14] == 4 && header[15] == 0 );
+}
+
+/** Location of one gzip member in the data file, and of its
+ *  decompressed bytes in the uncompressed data */
+struct GZIPMEMBER
+{
+  SizeValueType  offset;
+  unsigned int   size;
+  SizeValueType  outputOffset;
+  unsigned int   outputSize;
+};
+
+/** Where and how the voxel data of a NRRD file is stored */
+struct NRRDDATALAYOUT
+{
+  std::string                dataFileName;
+  SizeValueType              dataOffset;
+  bool                       isRaw;
+  std::vector< GZIPMEMBER >  members;        // Block-compressed data only
+  SizeValueType              numberOfBytes;  // Block-compressed data only
+};
+
+struct COMPRESSTHREADSTRUCT
+{
+  const unsigned char*                       data;
+  SizeValueType                              numberOfBytes;
+  unsigned int                               blockSize;
+  int                                        level;
+  std::vector< std::vector< unsigned char > >  members;
+  unsigned int                               nextBlock;
+  bool                                       failed;
+  SimpleFastMutexLock                        mutex;
+};
+
+struct DECOMPRESSTHREADSTRUCT
+{
+  const NRRDDATALAYOUT*                 layout;
+  std::vector< unsigned int >           blocks;
+  const std::vector< SizeValueType >*   runStarts;
+  SizeValueType                         runLength;
+  unsigned char*                        output;
+  unsigned int                          nextBlock;
+  std::string                           errorMessage;
+  SimpleFastMutexLock                   mutex;
+};
+
+/** Compress 'numBytes' bytes at 'data' into a complete gzip member */
+bool CompressBlock( const unsigned char* data, unsigned int numBytes, int level,
+                    std::vector< unsigned char >& member )
+{
+  z_stream stream;
+  std::memset( &stream, 0, sizeof( stream ) );
+
+  // Negative window bits produce raw deflate data; the gzip header and
+  // trailer are written here so that the extra field can be added
+  if ( deflateInit2( &stream, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY ) != Z_OK )
+    {
+    return false;
+    }
+
+  uLong bound = deflateBound( &stream, numBytes );
+  member.resize( GZIPHEADERSIZE + bound + GZIPTRAILERSIZE );
+
+  stream.next_in   = const_cast< Bytef* >( data );
+  stream.avail_in  = numBytes;
+  stream.next_out  = &member[GZIPHEADERSIZE];
+  stream.avail_out = bound;
+
+  int status = deflate( &stream, Z_FINISH );
+  unsigned int deflatedSize = stream.total_out;
+  deflateEnd( &stream );
+
+  if ( status != Z_STREAM_END )
+    {
+    return false;
+    }
+
+  unsigned int size = GZIPHEADERSIZE + deflatedSize + GZIPTRAILERSIZE;
+  member.resize( size );
+
+  unsigned char* header = &member[0];
+    header[0] = 0x1f;
+    header[1] = 0x8b;
+    header[2] = Z_DEFLATED;
+    header[3] = GZIPFLAGEXTRA;
+    PutUInt32( &header[4], 0 );  // No modification time
+    header[8] = 0;
+    header[9] = 255;             // Unknown operating system
+    header[10] = 8;              // Length of the extra field
+    header[11] = 0;
+    header[12] = 'C';
+    header[13] = 'P';
+    header[14] = 4;              // Length of the subfield data
+    header[15] = 0;
+    PutUInt32( &header[16], size );
+
+  unsigned long crc = crc32( crc32( 0L, Z_NULL, 0 ), data, numBytes );
+  PutUInt32( &member[size - 8], static_cast< unsigned int >( crc ) );
+  PutUInt32( &member[size - 4], numBytes );
+
+  return true;
+}
+
+/** Inflate a complete gzip member into 'output' */
+bool DecompressBlock( const unsigned char* member, unsigned int memberSize,
+                      unsigned char* output, unsigned int outputSize )
+{
+  z_stream stream;
+  std::memset( &stream, 0, sizeof( stream ) );
+
+  if ( inflateInit2( &stream, -MAX_WBITS ) != Z_OK )
+    {
+    return false;
+    }
+
+  stream.next_in   = const_cast< Bytef* >( member + GZIPHEADERSIZE );
+  stream.avail_in  = memberSize - GZIPHEADERSIZE - GZIPTRAILERSIZE;
+  stream.next_out  = output;
+  stream.avail_out = outputSize;
+
+  int status = inflate( &stream, Z_FINISH );
+  bool complete = ( status == Z_STREAM_END && stream.total_out == outputSize );
+  inflateEnd( &stream );
+
+  if ( !complete )
+    {
+    return false;
+    }
+
+  unsigned long crc = crc32( crc32( 0L, Z_NULL, 0 ), output, outputSize );
+
+  return static_cast< unsigned int >( crc ) == GetUInt32( member + memberSize - 8 );
+}
+
+/** Index of the first run that ends after 'offset' */
+unsigned int GetFirstRun( const std::vector< SizeValueType >& runStarts, SizeValueType runLength, SizeValueType offset )
+{
+  unsigned int r = std::upper_bound( runStarts.begin(), runStarts.end(), offset ) - runStarts.begin();
+  if ( r > 0 && runStarts[r - 1] + runLength > offset )
+    {
+    r--;
+    }
+
+  return r;
+}
+
+ITK_THREAD_RETURN_TYPE CompressThreaderCallback( void* arg )
+{
+  COMPRESSTHREADSTRUCT* str = static_cast< COMPRESSTHREADSTRUCT* >
+    ( static_cast< MultiThreader::ThreadInfoStruct* >( arg )->UserData );
+
+  unsigned int numBlocks = str->members.size();
+
+  while ( true )
+    {
+    str->mutex.Lock();
+    unsigned int i = str->nextBlock++;
+    bool failed = str->failed;
+    str->mutex.Unlock();
+
+    if ( i >= numBlocks || failed )
+      {
+      break;
+      }
+
+    SizeValueType offset = static_cast< SizeValueType >( i )*str->blockSize;
+    SizeValueType numBytes = str->numberOfBytes - offset;
+    if ( numBytes > str->blockSize )
+      {
+      numBytes = str->blockSize;
+      }
+
+    if ( !CompressBlock( str->data + offset, static_cast< unsigned int >( numBytes ), str->level, str->members[i] ) )
+      {
+      str->mutex.Lock();
+      str->failed = true;
+      str->mutex.Unlock();
+      }
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+ITK_THREAD_RETURN_TYPE DecompressThreaderCallback( void* arg )
+{
+  DECOMPRESSTHREADSTRUCT* str = static_cast< DECOMPRESSTHREADSTRUCT* >
+    ( static_cast< MultiThreader::ThreadInfoStruct* >( arg )->UserData );
+
+  const NRRDDATALAYOUT&               layout    = *str->layout;
+  const std::vector< SizeValueType >& runStarts = *str->runStarts;
+  const SizeValueType                 runLength = str->runLength;
+
+  std::ifstream file( layout.dataFileName.c_str(), std::ios::in | std::ios::binary );
+
+  // The compressed member, and the decompressed block when it has to be
+  // split over several runs
+  std::vector< unsigned char > member;
+  std::vector< unsigned char > block;
+
+  while ( true )
+    {
+    str->mutex.Lock();
+    unsigned int i = str->nextBlock++;
+    bool failed = !str->errorMessage.empty();
+    str->mutex.Unlock();
+
+    if ( i >= str->blocks.size() || failed )
+      {
+      break;
+      }
+
+    const GZIPMEMBER& m = layout.members[str->blocks[i]];
+
+    member.resize( m.size );
+    file.seekg( m.offset );
+    file.read( reinterpret_cast< char* >( &member[0] ), m.size );
+    bool ok = !file.fail();
+
+    SizeValueType blockStart = m.outputOffset;
+    SizeValueType blockEnd   = m.outputOffset + m.outputSize;
+
+    unsigned int r = GetFirstRun( runStarts, runLength, blockStart );
+
+    if ( ok && runStarts[r] <= blockStart && blockEnd <= runStarts[r] + runLength )
+      {
+      // The block lies inside a single run: decompress it in place
+      ok = DecompressBlock( &member[0], m.size, str->output + r*runLength + (blockStart - runStarts[r]), m.outputSize );
+      }
+    else if ( ok )
+      {
+      block.resize( m.outputSize );
+      ok = DecompressBlock( &member[0], m.size, &block[0], m.outputSize );
+
+      for ( ; ok && r < runStarts.size() && runStarts[r] < blockEnd; r++ )
+        {
+        SizeValueType start = std::max( blockStart, runStarts[r] );
+        SizeValueType end   = std::min( blockEnd, runStarts[r] + runLength );
+
+        std::memcpy( str->output + r*runLength + (start - runStarts[r]), &block[start - blockStart], end - start );
+        }
+      }
+
+    if ( !ok )
+      {
+      str->mutex.Lock();
+      if ( str->errorMessage.empty() )
+        {
+        str->errorMessage = "Error decompressing the data of " + layout.dataFileName;
+        }
+      str->mutex.Unlock();
+      }
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+void RunThreads( ThreadFunctionType callback, void* str, unsigned int numBlocks, unsigned int numThreads )
+{
+  if ( numThreads == 0 )
+    {
+    numThreads = MultiThreader::GetGlobalDefaultNumberOfThreads();
+    }
+  if ( numThreads > numBlocks )
+    {
+    numThreads = numBlocks;
+    }
+  if ( numThreads == 0 )
+    {
+    return;
+    }
+
+  MultiThreader::Pointer threader = MultiThreader::New();
+    threader->SetNumberOfThreads( numThreads );
+    threader->SetSingleMethod( callback, str );
+    threader->SingleMethodExecute();
+}
+
+/** Teem's name for the NRRD type of a component type, or an empty
+ *  string if there is none */
+std::string GetNrrdTypeName( ImageIOBase::IOComponentType componentType )
+{
+  switch ( componentType )
+    {
+    case ImageIOBase::UCHAR:
+      return "unsigned char";
+    case ImageIOBase::CHAR:
+      return "signed char";
+    case ImageIOBase::USHORT:
+      return "unsigned short";
+    case ImageIOBase::SHORT:
+      return "short";
+    case ImageIOBase::UINT:
+      return "unsigned int";
+    case ImageIOBase::INT:
+      return "int";
+    case ImageIOBase::ULONG:
+      return sizeof( unsigned long ) == 8 ? "unsigned long long int" : "unsigned int";
+    case ImageIOBase::LONG:
+      return sizeof( long ) == 8 ? "long long int" : "int";
+    case ImageIOBase::FLOAT:
+      return "float";
+    case ImageIOBase::DOUBLE:
+      return "double";
+    default:
+      return "";
+    }
+}
+
+/** Escape a key/value string the way Teem writes it */
+std::string EscapeNrrdString( const std::string& value )
+{
+  std::string escaped;
+  for ( unsigned int i=0; i<value.size(); i++ )
+    {
+    if ( value[i] == '\\' )
+      {
+      escaped += "\\\\";
+      }
+    else if ( value[i] == '\n' )
+      {
+      escaped += "\\n";
+      }
+    else
+      {
+      escaped += value[i];
+      }
+    }
+
+  return escaped;
+}
+
+/** Parse the header of the NRRD file 'fileName', whose data is
+ *  'numberOfBytes' long, and locate the data. Returns false unless the
+ *  data is either raw or block compressed, in a single file and in the
+ *  native byte order. Throws if block-compressed data is corrupt. */
+bool GetDataLayout( const std::string& fileName, SizeValueType numberOfBytes, NRRDDATALAYOUT& layout )
+{
+  std::ifstream header( fileName.c_str(), std::ios::in | std::ios::binary );
+  if ( !header )
+    {
+    return false;
+    }
+
+  std::string line;
+  std::getline( header, line );
+  if ( line.compare( 0, 7, "NRRD000" ) != 0 )
+    {
+    return false;
+    }
+
+  // An attached header ends with a blank line, after which the data starts
+  std::string encoding;
+  std::string endian;
+  std::string dataFile;
+  long        byteSkip = 0;
+  bool        foundBlankLine = false;
+
+  while ( std::getline( header, line ) )
+    {
+    if ( !line.empty() && line[line.size() - 1] == '\r' )
+      {
+      line.erase( line.size() - 1 );
+      }
+    if ( line.empty() )
+      {
+      foundBlankLine = true;
+      break;
+      }
+    if ( line[0] == '#' || line.find( ":=" ) != std::string::npos )
+      {
+      continue;
+      }
+
+    std::string::size_type colon = line.find( ": " );
+    if ( colon == std::string::npos )
+      {
+      continue;
+      }
+
+    std::string field = line.substr( 0, colon );
+    std::string value = line.substr( colon + 2 );
+
+    if ( field == "encoding" )
+      {
+      encoding = value;
+      }
+    else if ( field == "endian" )
+      {
+      endian = value;
+      }
+    else if ( field == "data file" || field == "datafile" )
+      {
+      dataFile = value;
+      }
+    else if ( field == "byte skip" || field == "byteskip" )
+      {
+      byteSkip = std::atol( value.c_str() );
+      }
+    else if ( (field == "line skip" || field == "lineskip") && std::atol( value.c_str() ) != 0 )
+      {
+      return false;
+      }
+    }
+
+  if ( !endian.empty() && endian != (ByteSwapper< int >::SystemIsBigEndian() ? "big" : "little") )
+    {
+    return false;
+    }
+
+  if ( dataFile.empty() )
+    {
+    if ( !foundBlankLine )
+      {
+      return false;
+      }
+    layout.dataFileName = fileName;
+    layout.dataOffset   = static_cast< SizeValueType >( header.tellg() );
+    }
+  else
+    {
+    // Lists of data files and file name patterns are not handled
+    if ( dataFile == "LIST" || dataFile.find( ' ' ) != std::string::npos || dataFile.find( '%' ) != std::string::npos )
+      {
+      return false;
+      }
+
+    std::string path = itksys::SystemTools::GetFilenamePath( fileName );
+    if ( path.empty() || itksys::SystemTools::FileIsFullPath( dataFile.c_str() ) )
+      {
+      layout.dataFileName = dataFile;
+      }
+    else
+      {
+      layout.dataFileName = path + "/" + dataFile;
+      }
+    layout.dataOffset = 0;
+    }
+
+  std::ifstream data( layout.dataFileName.c_str(), std::ios::in | std::ios::binary );
+  if ( !data )
+    {
+    return false;
+    }
+  data.seekg( 0, std::ios::end );
+  SizeValueType dataFileSize = static_cast< SizeValueType >( data.tellg() );
+
+  if ( encoding == "raw" )
+    {
+    // A byte skip of -1 means that the data is at the end of the file
+    if ( byteSkip == -1 && dataFileSize >= numberOfBytes )
+      {
+      layout.dataOffset = dataFileSize - numberOfBytes;
+      }
+    else if ( byteSkip >= 0 )
+      {
+      layout.dataOffset += byteSkip;
+      }
+    else
+      {
+      return false;
+      }
+
+    layout.isRaw = true;
+
+    return layout.dataOffset + numberOfBytes <= dataFileSize;
+    }
+
+  // For compressed data the byte skip applies to the decompressed bytes
+  if ( (encoding != "gzip" && encoding != "gz") || byteSkip != 0 )
+    {
+    return false;
+    }
+
+  layout.isRaw = false;
+  layout.members.clear();
+
+  // Locate the members from their extra fields and trailers
+  SizeValueType offset = layout.dataOffset;
+  SizeValueType outputOffset = 0;
+  while ( offset < dataFileSize )
+    {
+    unsigned char memberHeader[GZIPHEADERSIZE];
+
+    data.seekg( offset );
+    data.read( reinterpret_cast< char* >( memberHeader ), GZIPHEADERSIZE );
+    if ( data.fail() || !HasMemberSize( memberHeader, dataFileSize - offset ) )
+      {
+      if ( layout.members.empty() )
+        {
+        // A standard gzip stream
+        return false;
+        }
+      itkGenericExceptionMacro( << "Corrupt compressed data in " << layout.dataFileName );
+      }
+
+    GZIPMEMBER member;
+      member.offset       = offset;
+      member.size         = GetUInt32( &memberHeader[16] );
+      member.outputOffset = outputOffset;
+
+    if ( member.size < GZIPHEADERSIZE + GZIPTRAILERSIZE || member.size > dataFileSize - offset )
+      {
+      itkGenericExceptionMacro( << "Corrupt compressed data in " << layout.dataFileName );
+      }
+
+    unsigned char trailer[4];
+
+    data.seekg( offset + member.size - 4 );
+    data.read( reinterpret_cast< char* >( trailer ), 4 );
+    if ( data.fail() )
+      {
+      itkGenericExceptionMacro( << "Error reading " << layout.dataFileName );
+      }
+
+    member.outputSize = GetUInt32( trailer );
+    layout.members.push_back( member );
+
+    offset       += member.size;
+    outputOffset += member.outputSize;
+    }
+
+  layout.numberOfBytes = outputOffset;
+
+  return !layout.members.empty();
+}
+
+/** Split 'region' of an image with the given dimensions and pixel size
+ *  into runs of voxels that are contiguous in the file. The runs span
+ *  the leading dimensions that the region covers completely, and the
+ *  first one that it does not. Returns the length of the runs in bytes. */
+SizeValueType GetRegionRuns( const ImageIORegion& region, const std::vector< SizeValueType >& dimensions,
+                             SizeValueType pixelSize, std::vector< SizeValueType >& runStarts )
+{
+  unsigned int numDimensions = dimensions.size();
+
+  SizeValueType runLength = pixelSize;
+  unsigned int  firstOuterDimension = numDimensions;
+  for ( unsigned int d=0; d<numDimensions; d++ )
+    {
+    runLength *= region.GetSize( d );
+    if ( region.GetSize( d ) != dimensions[d] )
+      {
+      firstOuterDimension = d + 1;
+      break;
+      }
+    }
+
+  std::vector< SizeValueType > strides( numDimensions );
+  SizeValueType start = 0;
+  for ( unsigned int d=0; d<numDimensions; d++ )
+    {
+    strides[d] = (d == 0) ? pixelSize : strides[d - 1]*dimensions[d - 1];
+    start += region.GetIndex( d )*strides[d];
+    }
+
+  SizeValueType numRuns = 1;
+  for ( unsigned int d=firstOuterDimension; d<numDimensions; d++ )
+    {
+    numRuns *= region.GetSize( d );
+    }
+
+  // Step through the runs in file order
+  std::vector< SizeValueType > position( numDimensions, 0 );
+
+  runStarts.resize( numRuns );
+  for ( SizeValueType r=0; r<numRuns; r++ )
+    {
+    runStarts[r] = start;
+
+    for ( unsigned int d=firstOuterDimension; d<numDimensions; d++ )
+      {
+      start += strides[d];
+      if ( ++position[d] < region.GetSize( d ) )
+        {
+        break;
+        }
+      start -= position[d]*strides[d];
+      position[d] = 0;
+      }
+    }
+
+  return runLength;
+}
+
+/** Read the runs of bytes of the uncompressed data that start at
+ *  'runStarts' into consecutive parts of 'output'. Block-compressed
+ *  members that overlap a run are read and decompressed concurrently;
+ *  the others are skipped. */
+void ReadRuns( const NRRDDATALAYOUT& layout, const std::vector< SizeValueType >& runStarts, SizeValueType runLength,
+               unsigned char* output, unsigned int numberOfThreads )
+{
+  if ( layout.isRaw )
+    {
+    std::ifstream file( layout.dataFileName.c_str(), std::ios::in | std::ios::binary );
+    for ( SizeValueType r=0; r<runStarts.size() && file; r++ )
+      {
+      file.seekg( layout.dataOffset + runStarts[r] );
+      file.read( reinterpret_cast< char* >( output + r*runLength ), runLength );
+      }
+    if ( !file )
+      {
+      itkGenericExceptionMacro( << "Error reading " << layout.dataFileName );
+      }
+    return;
+    }
+
+  DECOMPRESSTHREADSTRUCT str;
+    str.layout    = &layout;
+    str.runStarts = &runStarts;
+    str.runLength = runLength;
+    str.output    = output;
+    str.nextBlock = 0;
+
+  for ( unsigned int b=0; b<layout.members.size(); b++ )
+    {
+    const GZIPMEMBER& member = layout.members[b];
+
+    unsigned int r = GetFirstRun( runStarts, runLength, member.outputOffset );
+    if ( r < runStarts.size() && runStarts[r] < member.outputOffset + member.outputSize )
+      {
+      str.blocks.push_back( b );
+      }
+    }
+
+  RunThreads( DecompressThreaderCallback, &str, str.blocks.size(), numberOfThreads );
+
+  if ( !str.errorMessage.empty() )
+    {
+    itkGenericExceptionMacro( << str.errorMessage );
+    }
+}
+
+/** The meta data entry 'key' as a NRRD field value: strings as they are,
+ *  doubles in full precision. Returns false if there is no such entry. */
+bool GetNrrdFieldValue( const MetaDataDictionary& dictionary, const std::string& key, std::string& value )
+{
+  if ( ExposeMetaData< std::string >( dictionary, key, value ) )
+    {
+    return true;
+    }
+
+  double number;
+  if ( ExposeMetaData< double >( dictionary, key, number ) )
+    {
+    std::ostringstream stream;
+    stream.precision( 17 );
+    stream << number;
+    value = stream.str();
+    return true;
+    }
+
+  return false;
+}
+
+/** The header line of a per-axis NRRD field kept by itk::NrrdImageIO as
+ *  "NRRD_<name>[<axis>]" entries, or an empty string if no axis has one
+ *  (unless 'missing' is "domain", the default kind). Axes without an entry
+ *  get 'missing'. */
+std::string GetNrrdAxisField( const MetaDataDictionary& dictionary, const std::string& name,
+                              unsigned int numDimensions, const std::string& missing, bool quote )
+{
+  std::ostringstream line;
+  line << name << ":";
+
+  bool found = ( missing == "domain" );
+  for ( unsigned int i=0; i<numDimensions; i++ )
+    {
+    std::ostringstream key;
+    key << "NRRD_" << name << "[" << i << "]";
+
+    std::string value = missing;
+    if ( GetNrrdFieldValue( dictionary, key.str(), value ) )
+      {
+      found = true;
+      }
+    line << " " << (quote ? "\"" : "") << value << (quote ? "\"" : "");
+    }
+
+  return found ? line.str() : "";
+}
+
+} // end anonymous namespace
+
+
+CIPBlockCompressedNrrdImageIO::CIPBlockCompressedNrrdImageIO()
+{
+  this->m_BlockSize        = 1 << 20;
+  this->m_CompressionLevel = 6;
+  this->m_NumberOfThreads  = MultiThreader::GetGlobalDefaultNumberOfThreads();
+  this->m_CanStreamRead    = false;
+}
+
+
+bool CIPBlockCompressedNrrdImageIO::CanWriteBlockCompressed() const
+{
+  if ( !this->GetUseCompression() )
+    {
+    return false;
+    }
+  if ( this->GetPixelType() != SCALAR || this->GetNumberOfComponents() != 1 )
+    {
+    return false;
+    }
+  if ( GetNrrdTypeName( this->GetComponentType() ).empty() )
+    {
+    return false;
+    }
+  if ( this->GetNumberOfDimensions() == 0 || this->GetImageSizeInBytes() == 0 )
+    {
+    return false;
+    }
+
+  std::string extension = itksys::SystemTools::LowerCase(
+    itksys::SystemTools::GetFilenameLastExtension( this->GetFileName() ) );
+
+  return extension == ".nrrd";
+}
+
+
+std::string CIPBlockCompressedNrrdImageIO::GetHeader() const
+{
+  unsigned int numDimensions = this->GetNumberOfDimensions();
+
+  const MetaDataDictionary& dictionary = this->GetMetaDataDictionary();
+
+  std::ostringstream header;
+  header.precision( 17 );
+
+  header << "NRRD0004" << std::endl;
+  header << "# Complete NRRD file format specification at:" << std::endl;
+  header << "# http://teem.sourceforge.net/nrrd/format.html" << std::endl;
+  header << "type: " << GetNrrdTypeName( this->GetComponentType() ) << std::endl;
+  header << "dimension: " << numDimensions << std::endl;
+
+  // ITK is LPS in 3-D, as in itk::NrrdImageIO. The space of the file the
+  // image was read from ("NRRD_space") is kept if it is RAS or LAS, by
+  // flipping the geometry back to it.
+  double flip[3] = { 1.0, 1.0, 1.0 };
+  if ( numDimensions == 3 )
+    {
+    std::string space;
+    ExposeMetaData< std::string >( dictionary, "NRRD_space", space );
+    if ( space == "right-anterior-superior" )
+      {
+      flip[0] = flip[1] = -1.0;
+      }
+    else if ( space == "left-anterior-superior" )
+      {
+      flip[1] = -1.0;
+      }
+    else
+      {
+      space = "left-posterior-superior";
+      }
+
+    header << "space: " << space << std::endl;
+    }
+  else
+    {
+    header << "space dimension: " << numDimensions << std::endl;
+    }
+
+  header << "sizes:";
+  for ( unsigned int i=0; i<numDimensions; i++ )
+    {
+    header << " " << this->GetDimensions( i );
+    }
+  header << std::endl;
+
+  header << "space directions:";
+  for ( unsigned int i=0; i<numDimensions; i++ )
+    {
+    std::vector< double > direction = this->GetDirection( i );
+
+    header << " (";
+    for ( unsigned int j=0; j<numDimensions; j++ )
+      {
+      header << (j > 0 ? "," : "") << ( j < 3 ? flip[j] : 1.0 )*this->GetSpacing( i )*direction[j];
+      }
+    header << ")";
+    }
+  header << std::endl;
+
+  header << GetNrrdAxisField( dictionary, "kinds", numDimensions, "domain", false ) << std::endl;
+
+  // The other NRRD fields itk::NrrdImageIO keeps in the meta data
+  const char* axisFields[3]    = { "centers", "thicknesses", "labels" };
+  const char* missingValues[3] = { "???", "nan", "" };
+  for ( unsigned int f=0; f<3; f++ )
+    {
+    std::string line = GetNrrdAxisField( dictionary, axisFields[f], numDimensions, missingValues[f], f == 2 );
+    if ( !line.empty() )
+      {
+      header << line << std::endl;
+      }
+    }
+
+  const char* fields[3] = { "content", "old min", "old max" };
+  for ( unsigned int f=0; f<3; f++ )
+    {
+    std::string value;
+    if ( GetNrrdFieldValue( dictionary, std::string( "NRRD_" ) + fields[f], value ) )
+      {
+      header << fields[f] << ": " << EscapeNrrdString( value ) << std::endl;
+      }
+    }
+
+  header << "endian: " << (ByteSwapper< int >::SystemIsBigEndian() ? "big" : "little") << std::endl;
+  header << "encoding: gzip" << std::endl;
+
+  header << "space origin: (";
+  for ( unsigned int i=0; i<numDimensions; i++ )
+    {
+    header << (i > 0 ? "," : "") << ( i < 3 ? flip[i] : 1.0 )*this->GetOrigin( i );
+    }
+  header << ")" << std::endl;
+
+  // Missing entries of the measurement frame are 0, as in itk::NrrdImageIO
+  std::vector< std::vector< double > > measurementFrame;
+  if ( ExposeMetaData< std::vector< std::vector< double > > >( dictionary, "NRRD_measurement frame", measurementFrame ) )
+    {
+    header << "measurement frame:";
+    for ( unsigned int i=0; i<numDimensions; i++ )
+      {
+      header << " (";
+      for ( unsigned int j=0; j<numDimensions; j++ )
+        {
+        double value = ( i < measurementFrame.size() && j < measurementFrame[i].size() ) ? measurementFrame[i][j] : 0.0;
+        header << (j > 0 ? "," : "") << value;
+        }
+      header << ")";
+      }
+    header << std::endl;
+    }
+
+  // String meta data is written as key/value pairs. Keys that start with
+  // "NRRD_" describe NRRD fields, which are written above.
+  for ( MetaDataDictionary::ConstIterator it = dictionary.Begin(); it != dictionary.End(); ++it )
+    {
+    std::string value;
+    if ( it->first.compare( 0, 5, "NRRD_" ) == 0 || it->first.find( ":=" ) != std::string::npos ||
+         !ExposeMetaData< std::string >( dictionary, it->first, value ) )
+      {
+      continue;
+      }
+
+    header << it->first << ":=" << EscapeNrrdString( value ) << std::endl;
+    }
+
+  return header.str();
+}
+
+
+void CIPBlockCompressedNrrdImageIO::Write( const void* buffer )
+{
+  if ( !this->CanWriteBlockCompressed() )
+    {
+    Superclass::Write( buffer );
+    return;
+    }
+
+  SizeValueType numberOfBytes = this->GetImageSizeInBytes();
+  unsigned int numBlocks = static_cast< unsigned int >( (numberOfBytes + this->m_BlockSize - 1)/this->m_BlockSize );
+
+  COMPRESSTHREADSTRUCT str;
+    str.data          = static_cast< const unsigned char* >( buffer );
+    str.numberOfBytes = numberOfBytes;
+    str.blockSize     = this->m_BlockSize;
+    str.level         = this->m_CompressionLevel;
+    str.members.resize( numBlocks );
+    str.nextBlock     = 0;
+    str.failed        = false;
+
+  RunThreads( CompressThreaderCallback, &str, numBlocks, this->m_NumberOfThreads );
+
+  if ( str.failed )
+    {
+    itkExceptionMacro( << "Error compressing the data for " << this->GetFileName() );
+    }
+
+  std::ofstream file( this->GetFileName(), std::ios::out | std::ios::binary );
+  if ( !file )
+    {
+    itkExceptionMacro( << "Could not open " << this->GetFileName() << " for writing" );
+    }
+
+  // The header ends with a blank line
+  file << this->GetHeader() << std::endl;
+
+  for ( unsigned int i=0; i<numBlocks; i++ )
+    {
+    file.write( reinterpret_cast< const char* >( &str.members[i][0] ), str.members[i].size() );
+    }
+
+  if ( !file )
+    {
+    itkExceptionMacro( << "Error writing " << this->GetFileName() );
+    }
+}
+
+
+void CIPBlockCompressedNrrdImageIO::ReadImageInformation()
+{
+  Superclass::ReadImageInformation();
+
+  // Raw and block-compressed scalar data can be read a region at a time
+  this->m_CanStreamRead = false;
+  if ( this->GetPixelType() == SCALAR && this->GetNumberOfComponents() == 1 )
+    {
+    NRRDDATALAYOUT layout;
+    try
+      {
+      this->m_CanStreamRead = GetDataLayout( this->GetFileName(), this->GetImageSizeInBytes(), layout ) &&
+        ( layout.isRaw || layout.numberOfBytes == this->GetImageSizeInBytes() );
+      }
+    catch ( ExceptionObject& )
+      {
+      // Corrupt data is reported when the image is read
+      this->m_CanStreamRead = false;
+      }
+    }
+}
+
+
+ImageIORegion CIPBlockCompressedNrrdImageIO::GenerateStreamableReadRegionFromRequestedRegion( const ImageIORegion& requested ) const
+{
+  unsigned int numDimensions = this->GetNumberOfDimensions();
+
+  if ( this->m_CanStreamRead && this->GetUseStreamedReading() && requested.GetImageDimension() == numDimensions )
+    {
+    return requested;
+    }
+
+  ImageIORegion largest( numDimensions );
+  for ( unsigned int i=0; i<numDimensions; i++ )
+    {
+    largest.SetIndex( i, 0 );
+    largest.SetSize( i, this->GetDimensions( i ) );
+    }
+
+  return largest;
+}
+
+
+void CIPBlockCompressedNrrdImageIO::Read( void* buffer )
+{
+  const ImageIORegion& region = this->GetIORegion();
+
+  bool isLargestRegion = true;
+  if ( region.GetImageDimension() == this->GetNumberOfDimensions() )
+    {
+    for ( unsigned int i=0; i<this->GetNumberOfDimensions(); i++ )
+      {
+      if ( region.GetIndex( i ) != 0 || region.GetSize( i ) != this->GetDimensions( i ) )
+        {
+        isLargestRegion = false;
+        }
+      }
+    }
+
+  if ( !isLargestRegion )
+    {
+    this->ReadRegion( buffer );
+    return;
+    }
+
+  bool isBlockCompressed = false;
+  if ( this->GetPixelType() == SCALAR && this->GetNumberOfComponents() == 1 )
+    {
+    isBlockCompressed = ReadBlockCompressedData( this->GetFileName(), buffer, this->GetImageSizeInBytes(),
+                                                 this->m_NumberOfThreads );
+    }
+
+  if ( !isBlockCompressed )
+    {
+    Superclass::Read( buffer );
+    }
+}
+
+
+void CIPBlockCompressedNrrdImageIO::ReadRegion( void* buffer )
+{
+  NRRDDATALAYOUT layout;
+  if ( !this->m_CanStreamRead || !GetDataLayout( this->GetFileName(), this->GetImageSizeInBytes(), layout ) )
+    {
+    itkExceptionMacro( << "Cannot read a region of " << this->GetFileName() );
+    }
+
+  std::vector< SizeValueType > dimensions( this->GetNumberOfDimensions() );
+  for ( unsigned int i=0; i<dimensions.size(); i++ )
+    {
+    dimensions[i] = this->GetDimensions( i );
+    }
+
+  std::vector< SizeValueType > runStarts;
+  SizeValueType runLength = GetRegionRuns( this->GetIORegion(), dimensions, this->GetComponentSize(), runStarts );
+
+  ReadRuns( layout, runStarts, runLength, static_cast< unsigned char* >( buffer ), this->m_NumberOfThreads );
+}
+
+
+bool CIPBlockCompressedNrrdImageIO::ReadBlockCompressedData( const std::string& fileName, void* buffer,
+                                                             SizeValueType numberOfBytes, unsigned int numberOfThreads )
+{
+  NRRDDATALAYOUT layout;
+  if ( !GetDataLayout( fileName, numberOfBytes, layout ) || layout.isRaw )
+    {
+    return false;
+    }
+
+  if ( layout.numberOfBytes != numberOfBytes )
+    {
+    itkGenericExceptionMacro( << fileName << " does not contain the amount of data its header describes" );
+    }
+
+  std::vector< SizeValueType > runStarts( 1, 0 );
+  ReadRuns( layout, runStarts, numberOfBytes, static_cast< unsigned char* >( buffer ), numberOfThreads );
+
+  return true;
+}
+
+
+void CIPBlockCompressedNrrdImageIO::PrintSelf( std::ostream& os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+
+  os << indent << "BlockSize: " << this->m_BlockSize << std::endl;
+  os << indent << "CompressionLevel: " << this->m_CompressionLevel << std::endl;
+  os << indent << "NumberOfThreads: " << this->m_NumberOfThreads << std::endl;
+  os << indent << "CanStreamRead: " << this->m_CanStreamRead << std::endl;
+}
+
+} // end namespace itk
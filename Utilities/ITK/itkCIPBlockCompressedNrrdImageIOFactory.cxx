@@ -0,0 +1,30 @@
+#include "itkCIPBlockCompressedNrrdImageIOFactory.h"
+#include "itkCIPBlockCompressedNrrdImageIO.h"
+#include "itkCreateObjectFunction.h"
+#include "itkVersion.h"
+
+namespace itk
+{
+
+CIPBlockCompressedNrrdImageIOFactory::CIPBlockCompressedNrrdImageIOFactory()
+{
+  this->RegisterOverride( "itkImageIOBase",
+                          "itkCIPBlockCompressedNrrdImageIO",
+                          "NRRD Image IO with multithreaded block compression",
+                          1,
+                          CreateObjectFunction< CIPBlockCompressedNrrdImageIO >::New() );
+}
+
+
+const char* CIPBlockCompressedNrrdImageIOFactory::GetITKSourceVersion() const
+{
+  return ITK_SOURCE_VERSION;
+}
+
+
+const char* CIPBlockCompressedNrrdImageIOFactory::GetDescription() const
+{
+  return "NRRD ImageIO Factory, allows the loading of NRRD images into insight, compressing and decompressing on multiple threads";
+}
+
+} // end namespace itk
@@ -0,0 +1,66 @@
+/**
+ *  \class CIPBlockCompressedNrrdImageIOFactory
+ *  \brief Creates instances of CIPBlockCompressedNrrdImageIO.
+ *
+ *  RegisterOneFactory() registers the factory ahead of every other
+ *  image IO factory, so that NRRD files read and written through
+ *  itk::ImageFileReader and itk::ImageFileWriter use
+ *  CIPBlockCompressedNrrdImageIO instead of itk::NrrdImageIO.
+ */
+
+#ifndef __itkCIPBlockCompressedNrrdImageIOFactory_h
+#define __itkCIPBlockCompressedNrrdImageIOFactory_h
+
+#include "itkObjectFactoryBase.h"
+
+namespace itk
+{
+
+class CIPBlockCompressedNrrdImageIOFactory : public ObjectFactoryBase
+{
+public:
+  /** Standard class typedefs. */
+  typedef CIPBlockCompressedNrrdImageIOFactory  Self;
+  typedef ObjectFactoryBase                     Superclass;
+  typedef SmartPointer<Self>                    Pointer;
+  typedef SmartPointer<const Self>              ConstPointer;
+
+  /** Class methods used to interface with the registered factories. */
+  virtual const char* GetITKSourceVersion() const;
+  virtual const char* GetDescription() const;
+
+  /** Method for class instantiation. */
+  itkFactorylessNewMacro(Self);
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(CIPBlockCompressedNrrdImageIOFactory, ObjectFactoryBase);
+
+  /** Register one factory of this type, in front of the others. Does
+   *  nothing if one is already registered. */
+  static void RegisterOneFactory()
+    {
+      std::list< ObjectFactoryBase* > factories = ObjectFactoryBase::GetRegisteredFactories();
+      for ( std::list< ObjectFactoryBase* >::iterator it = factories.begin(); it != factories.end(); ++it )
+        {
+        if ( dynamic_cast< CIPBlockCompressedNrrdImageIOFactory* >( *it ) != NULL )
+          {
+          return;
+          }
+        }
+
+      CIPBlockCompressedNrrdImageIOFactory::Pointer factory = CIPBlockCompressedNrrdImageIOFactory::New();
+      ObjectFactoryBase::RegisterFactory( factory, ObjectFactoryBase::INSERT_AT_FRONT );
+    }
+
+protected:
+  CIPBlockCompressedNrrdImageIOFactory();
+  ~CIPBlockCompressedNrrdImageIOFactory() {}
+
+private:
+  CIPBlockCompressedNrrdImageIOFactory(const Self&); //purposely not implemented
+  void operator=(const Self&); //purposely not implemented
+};
+
+} // end namespace itk
+
+#endif
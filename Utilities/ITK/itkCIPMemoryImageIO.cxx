@@ -0,0 +1,209 @@
+#include "itkCIPMemoryImageIO.h"
+#include "itkImportImageContainer.h"
+#include "itkSimpleFastMutexLock.h"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <vector>
+
+namespace itk
+{
+
+namespace
+{
+
+typedef ImportImageContainer< SizeValueType, char > BufferType;
+
+/** A copy of an image written to a "cipmem:" name */
+struct MEMORYIMAGE
+{
+  std::vector< SizeValueType >          dimensions;
+  std::vector< double >                 spacing;
+  std::vector< double >                 origin;
+  std::vector< std::vector< double > >  direction;
+  ImageIOBase::IOComponentType          componentType;
+  ImageIOBase::IOPixelType              pixelType;
+  unsigned int                          numberOfComponents;
+  MetaDataDictionary                    dictionary;
+  SizeValueType                         numberOfBytes;
+  BufferType::Pointer                   buffer;
+};
+
+typedef std::map< std::string, MEMORYIMAGE > MemoryImageMapType;
+
+// The buffers are reference counted: a reader holds on to the buffer it
+// is copying from, so that the lock is only held while the table itself
+// is looked up or changed.
+MemoryImageMapType   memoryImages;
+SimpleFastMutexLock  memoryImagesLock;
+
+const char MEMORYFILENAMEPREFIX[] = "cipmem:";
+
+/** Look up 'fileName', returning false if nothing was written to it */
+bool GetMemoryImage( const std::string& fileName, MEMORYIMAGE& image )
+{
+  memoryImagesLock.Lock();
+  MemoryImageMapType::const_iterator it = memoryImages.find( fileName );
+  bool found = ( it != memoryImages.end() );
+  if ( found )
+    {
+    image = it->second;
+    }
+  memoryImagesLock.Unlock();
+
+  return found;
+}
+
+} // end anonymous namespace
+
+
+CIPMemoryImageIO::CIPMemoryImageIO()
+{
+  this->SetNumberOfDimensions( 3 );
+}
+
+
+const char* CIPMemoryImageIO::GetFileNamePrefix()
+{
+  return MEMORYFILENAMEPREFIX;
+}
+
+
+bool CIPMemoryImageIO::IsMemoryFileName( const std::string& fileName )
+{
+  return fileName.compare( 0, std::strlen( MEMORYFILENAMEPREFIX ), MEMORYFILENAMEPREFIX ) == 0;
+}
+
+
+bool CIPMemoryImageIO::HasImage( const std::string& fileName )
+{
+  MEMORYIMAGE image;
+
+  return GetMemoryImage( fileName, image );
+}
+
+
+void CIPMemoryImageIO::RemoveImage( const std::string& fileName )
+{
+  // The buffer is released outside of the lock, once 'removed' goes out
+  // of scope (or later, if a reader is still copying from it)
+  MEMORYIMAGE removed;
+
+  memoryImagesLock.Lock();
+  MemoryImageMapType::iterator it = memoryImages.find( fileName );
+  if ( it != memoryImages.end() )
+    {
+    removed = it->second;
+    memoryImages.erase( it );
+    }
+  memoryImagesLock.Unlock();
+}
+
+
+void CIPMemoryImageIO::RemoveAllImages()
+{
+  MemoryImageMapType removed;
+
+  memoryImagesLock.Lock();
+  removed.swap( memoryImages );
+  memoryImagesLock.Unlock();
+}
+
+
+bool CIPMemoryImageIO::CanReadFile( const char* fileName )
+{
+  return fileName != NULL && IsMemoryFileName( fileName ) && HasImage( fileName );
+}
+
+
+bool CIPMemoryImageIO::CanWriteFile( const char* fileName )
+{
+  return fileName != NULL && IsMemoryFileName( fileName );
+}
+
+
+void CIPMemoryImageIO::ReadImageInformation()
+{
+  MEMORYIMAGE image;
+  if ( !GetMemoryImage( this->GetFileName(), image ) )
+    {
+    itkExceptionMacro( "No image has been written to " << this->GetFileName() );
+    }
+
+  this->SetNumberOfDimensions( static_cast< unsigned int >( image.dimensions.size() ) );
+  for ( unsigned int i = 0; i < image.dimensions.size(); i++ )
+    {
+    this->SetDimensions( i, image.dimensions[i] );
+    this->SetSpacing( i, image.spacing[i] );
+    this->SetOrigin( i, image.origin[i] );
+    this->SetDirection( i, image.direction[i] );
+    }
+
+  this->SetComponentType( image.componentType );
+  this->SetPixelType( image.pixelType );
+  this->SetNumberOfComponents( image.numberOfComponents );
+  this->SetMetaDataDictionary( image.dictionary );
+}
+
+
+void CIPMemoryImageIO::Read( void* buffer )
+{
+  MEMORYIMAGE image;
+  if ( !GetMemoryImage( this->GetFileName(), image ) )
+    {
+    itkExceptionMacro( "No image has been written to " << this->GetFileName() );
+    }
+  if ( image.numberOfBytes != this->GetImageSizeInBytes() )
+    {
+    itkExceptionMacro( "The image in " << this->GetFileName() << " has changed since its information was read" );
+    }
+
+  std::memcpy( buffer, image.buffer->GetBufferPointer(), image.numberOfBytes );
+}
+
+
+void CIPMemoryImageIO::Write( const void* buffer )
+{
+  unsigned int numDimensions = this->GetNumberOfDimensions();
+
+  MEMORYIMAGE image;
+    image.dimensions.resize( numDimensions );
+    image.spacing.resize( numDimensions );
+    image.origin.resize( numDimensions );
+    image.direction.resize( numDimensions );
+
+  for ( unsigned int i = 0; i < numDimensions; i++ )
+    {
+    image.dimensions[i] = this->GetDimensions( i );
+    image.spacing[i]    = this->GetSpacing( i );
+    image.origin[i]     = this->GetOrigin( i );
+    image.direction[i]  = this->GetDirection( i );
+    }
+
+  image.componentType      = this->GetComponentType();
+  image.pixelType          = this->GetPixelType();
+  image.numberOfComponents = this->GetNumberOfComponents();
+  image.dictionary         = this->GetMetaDataDictionary();
+  image.numberOfBytes      = this->GetImageSizeInBytes();
+
+  image.buffer = BufferType::New();
+  image.buffer->Reserve( image.numberOfBytes );
+  std::memcpy( image.buffer->GetBufferPointer(), buffer, image.numberOfBytes );
+
+  // An image previously written to the same name is released once
+  // 'image' goes out of scope
+  memoryImagesLock.Lock();
+  std::swap( memoryImages[this->GetFileName()], image );
+  memoryImagesLock.Unlock();
+}
+
+
+void CIPMemoryImageIO::PrintSelf( std::ostream& os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+
+  os << indent << "FileNamePrefix: " << MEMORYFILENAMEPREFIX << std::endl;
+}
+
+} // end namespace itk
@@ -0,0 +1,82 @@
+/**
+ *  \class CIPMemoryImageIO
+ *  \brief Image IO that keeps images in memory instead of writing them
+ *  to disk.
+ *
+ *  File names that start with "cipmem:" (e.g. "cipmem:lungMask") do not
+ *  refer to files. Writing an image to such a name stores a copy of its
+ *  voxels, geometry and meta data dictionary in a process-wide table;
+ *  reading the name copies them back. This lets tools that are run in
+ *  the same process (see RunCIPPipeline) hand images to one another
+ *  through itk::ImageFileReader and itk::ImageFileWriter without
+ *  encoding, compressing or touching the disk.
+ *
+ *  Names should not end in a file extension such as ".nrrd": other IOs
+ *  registered ahead of this one would otherwise claim them for writing.
+ *
+ *  Use CIPMemoryImageIOFactory::RegisterOneFactory() to have the readers
+ *  and writers pick this IO. The table is safe to use from several
+ *  threads at once.
+ */
+
+#ifndef __itkCIPMemoryImageIO_h
+#define __itkCIPMemoryImageIO_h
+
+#include "itkImageIOBase.h"
+
+#include <string>
+
+namespace itk
+{
+
+class CIPMemoryImageIO : public ImageIOBase
+{
+public:
+  /** Standard class typedefs. */
+  typedef CIPMemoryImageIO    Self;
+  typedef ImageIOBase         Superclass;
+  typedef SmartPointer<Self>  Pointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(CIPMemoryImageIO, ImageIOBase);
+
+  /** The prefix that marks a file name as an in-memory image */
+  static const char* GetFileNamePrefix();
+
+  /** Whether 'fileName' starts with the in-memory prefix */
+  static bool IsMemoryFileName( const std::string& fileName );
+
+  /** Whether an image has been written to 'fileName' */
+  static bool HasImage( const std::string& fileName );
+
+  /** Free the image written to 'fileName', if any */
+  static void RemoveImage( const std::string& fileName );
+
+  /** Free every in-memory image */
+  static void RemoveAllImages();
+
+  virtual bool CanReadFile( const char* fileName );
+  virtual void ReadImageInformation();
+  virtual void Read( void* buffer );
+
+  virtual bool CanWriteFile( const char* fileName );
+  virtual void WriteImageInformation() {}
+  virtual void Write( const void* buffer );
+
+protected:
+  CIPMemoryImageIO();
+  virtual ~CIPMemoryImageIO() {}
+
+  void PrintSelf( std::ostream& os, Indent indent ) const;
+
+private:
+  CIPMemoryImageIO(const Self&); //purposely not implemented
+  void operator=(const Self&); //purposely not implemented
+};
+
+} // end namespace itk
+
+#endif
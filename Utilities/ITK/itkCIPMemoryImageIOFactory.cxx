@@ -0,0 +1,30 @@
+#include "itkCIPMemoryImageIOFactory.h"
+#include "itkCIPMemoryImageIO.h"
+#include "itkCreateObjectFunction.h"
+#include "itkVersion.h"
+
+namespace itk
+{
+
+CIPMemoryImageIOFactory::CIPMemoryImageIOFactory()
+{
+  this->RegisterOverride( "itkImageIOBase",
+                          "itkCIPMemoryImageIO",
+                          "Image IO that keeps images in memory",
+                          1,
+                          CreateObjectFunction< CIPMemoryImageIO >::New() );
+}
+
+
+const char* CIPMemoryImageIOFactory::GetITKSourceVersion() const
+{
+  return ITK_SOURCE_VERSION;
+}
+
+
+const char* CIPMemoryImageIOFactory::GetDescription() const
+{
+  return "Memory ImageIO Factory, allows images to be passed between tools in the same process without files";
+}
+
+} // end namespace itk
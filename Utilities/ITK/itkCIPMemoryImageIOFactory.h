@@ -0,0 +1,65 @@
+/**
+ *  \class CIPMemoryImageIOFactory
+ *  \brief Creates instances of CIPMemoryImageIO.
+ *
+ *  RegisterOneFactory() registers the factory ahead of every other
+ *  image IO factory, so that "cipmem:" names read and written through
+ *  itk::ImageFileReader and itk::ImageFileWriter use CIPMemoryImageIO.
+ */
+
+#ifndef __itkCIPMemoryImageIOFactory_h
+#define __itkCIPMemoryImageIOFactory_h
+
+#include "itkObjectFactoryBase.h"
+
+namespace itk
+{
+
+class CIPMemoryImageIOFactory : public ObjectFactoryBase
+{
+public:
+  /** Standard class typedefs. */
+  typedef CIPMemoryImageIOFactory   Self;
+  typedef ObjectFactoryBase         Superclass;
+  typedef SmartPointer<Self>        Pointer;
+  typedef SmartPointer<const Self>  ConstPointer;
+
+  /** Class methods used to interface with the registered factories. */
+  virtual const char* GetITKSourceVersion() const;
+  virtual const char* GetDescription() const;
+
+  /** Method for class instantiation. */
+  itkFactorylessNewMacro(Self);
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(CIPMemoryImageIOFactory, ObjectFactoryBase);
+
+  /** Register one factory of this type, in front of the others. Does
+   *  nothing if one is already registered. */
+  static void RegisterOneFactory()
+    {
+      std::list< ObjectFactoryBase* > factories = ObjectFactoryBase::GetRegisteredFactories();
+      for ( std::list< ObjectFactoryBase* >::iterator it = factories.begin(); it != factories.end(); ++it )
+        {
+        if ( dynamic_cast< CIPMemoryImageIOFactory* >( *it ) != NULL )
+          {
+          return;
+          }
+        }
+
+      CIPMemoryImageIOFactory::Pointer factory = CIPMemoryImageIOFactory::New();
+      ObjectFactoryBase::RegisterFactory( factory, ObjectFactoryBase::INSERT_AT_FRONT );
+    }
+
+protected:
+  CIPMemoryImageIOFactory();
+  ~CIPMemoryImageIOFactory() {}
+
+private:
+  CIPMemoryImageIOFactory(const Self&); //purposely not implemented
+  void operator=(const Self&); //purposely not implemented
+};
+
+} // end namespace itk
+
+#endif
@@ -124,6 +124,10 @@ CannyEdgesFeatureGenerator<NDimension>
   this->m_CannyFilter->SetLowerThreshold( this->m_LowerThreshold );
   this->m_CannyFilter->SetOutsideValue(NumericTraits<InternalPixelType>::Zero);
 
+  this->m_CastFilter->SetNumberOfThreads( this->GetNumberOfThreads() );
+  this->m_CannyFilter->SetNumberOfThreads( this->GetNumberOfThreads() );
+  this->m_RescaleFilter->SetNumberOfThreads( this->GetNumberOfThreads() );
+
   this->m_RescaleFilter->Update();
 
   typename OutputImageType::Pointer outputImage = this->m_RescaleFilter->GetOutput();
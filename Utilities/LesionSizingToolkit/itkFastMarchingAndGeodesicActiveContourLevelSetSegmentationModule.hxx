@@ -79,6 +79,9 @@ FastMarchingAndGeodesicActiveContourLevelSetSegmentationModule<NDimension>
   progress->RegisterInternalFilter( 
       this->m_GeodesicActiveContourLevelSetModule, 0.7 );
 
+  this->m_FastMarchingModule->SetNumberOfThreads( this->GetNumberOfThreads() );
+  this->m_GeodesicActiveContourLevelSetModule->SetNumberOfThreads( this->GetNumberOfThreads() );
+
   this->m_FastMarchingModule->SetInput( this->GetInput() );
   this->m_FastMarchingModule->SetFeature( this->GetFeature() );
   this->m_FastMarchingModule->Update();
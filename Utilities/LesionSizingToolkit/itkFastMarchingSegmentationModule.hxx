@@ -88,6 +88,7 @@ FastMarchingSegmentationModule<NDimension>
   filter->SetInput( featureImage );
 
   filter->SetStoppingValue( this->m_StoppingValue );
+  filter->SetNumberOfThreads( this->GetNumberOfThreads() );
 
   // Progress reporting - forward events from the fast marching filter.
   ProgressAccumulator::Pointer progress = ProgressAccumulator::New();
@@ -140,6 +141,7 @@ FastMarchingSegmentationModule<NDimension>
   windowing->SetOutputMinimum( -4.0 );
   windowing->SetOutputMaximum(  4.0 );
   windowing->InPlaceOn();
+  windowing->SetNumberOfThreads( this->GetNumberOfThreads() );
   progress->RegisterInternalFilter( windowing, 0.1 );  
   windowing->Update();
 
@@ -80,6 +80,7 @@ GeodesicActiveContourLevelSetSegmentationModule<NDimension>
   filter->SetCurvatureScaling( this->GetCurvatureScaling() );
   filter->SetAdvectionScaling( this->GetAdvectionScaling() );
   filter->UseImageSpacingOn();
+  filter->SetNumberOfThreads( this->GetNumberOfThreads() );
 
   // Progress reporting - forward events from the fast marching filter.
   ProgressAccumulator::Pointer progress = ProgressAccumulator::New();
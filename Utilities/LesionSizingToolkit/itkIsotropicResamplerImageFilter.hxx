@@ -138,6 +138,7 @@ IsotropicResamplerImageFilter< TInputImage, TOutputImage >
   this->m_ResampleFilter->SetOutputDirection( inputImage->GetDirection() );
   this->m_ResampleFilter->SetSize( finalSize );
   this->m_ResampleFilter->SetInput( inputImage );
+  this->m_ResampleFilter->SetNumberOfThreads( this->GetNumberOfThreads() );
 
   progress->RegisterInternalFilter( this->m_ResampleFilter, 1.0 );  
 
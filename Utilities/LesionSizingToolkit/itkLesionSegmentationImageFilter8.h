@@ -134,6 +134,14 @@ public:
   void SetSeeds( PointListType p ) { this->m_Seeds = p; }
   PointListType GetSeeds() { return m_Seeds; }
 
+  typedef typename LungWallFeatureGenerator< ImageDimension >::FeatureImageType
+                                                          LungWallFeatureImageType;
+
+  /** Use a lung wall feature computed beforehand (see
+   * LungWallFeatureGenerator) instead of computing it from the ROI. This
+   * saves computing it again for each lesion of a scan. */
+  virtual void SetLungWallFeature( const LungWallFeatureImageType * );
+
   /** Report progress */
   void ProgressUpdate( Object * caller, const EventObject & event );
 
@@ -126,6 +126,15 @@ LesionSegmentationImageFilter8<TInputImage,TOutputImage>
   m_CannyEdgesFeatureGenerator->SetSigmaArray(s);
 }
 
+template <class TInputImage, class TOutputImage>
+void
+LesionSegmentationImageFilter8<TInputImage,TOutputImage>
+::SetLungWallFeature( const LungWallFeatureImageType * feature )
+{
+  m_LungWallFeatureGenerator->SetPrecomputedFeature( feature );
+  this->Modified();
+}
+
 template <class TInputImage, class TOutputImage>
 void
 LesionSegmentationImageFilter8<TInputImage,TOutputImage>
@@ -186,6 +195,19 @@ LesionSegmentationImageFilter8< TInputImage, TOutputImage >
   m_SegmentationModule->SetDistanceFromSeeds(m_FastMarchingDistanceFromSeeds);
   m_SegmentationModule->SetStoppingValue(m_FastMarchingStoppingTime);
 
+  // The internal filters and modules use the number of threads of this
+  // filter, which passes it on to their own internal filters
+  const ThreadIdType numberOfThreads = this->GetNumberOfThreads();
+  m_CropFilter->SetNumberOfThreads( numberOfThreads );
+  m_IsotropicResampler->SetNumberOfThreads( numberOfThreads );
+  m_CannyEdgesFeatureGenerator->SetNumberOfThreads( numberOfThreads );
+  m_LungWallFeatureGenerator->SetNumberOfThreads( numberOfThreads );
+  m_VesselnessFeatureGenerator->SetNumberOfThreads( numberOfThreads );
+  m_SigmoidFeatureGenerator->SetNumberOfThreads( numberOfThreads );
+  m_FeatureAggregator->SetNumberOfThreads( numberOfThreads );
+  m_SegmentationModule->SetNumberOfThreads( numberOfThreads );
+  m_LesionSegmentationMethod->SetNumberOfThreads( numberOfThreads );
+
   // Allocate the output
   this->GetOutput()->SetBufferedRegion( this->GetOutput()->GetRequestedRegion() );
   this->GetOutput()->Allocate();
@@ -79,6 +79,16 @@ public:
   itkSetMacro( LungThreshold, InputPixelType );
   itkGetMacro( LungThreshold, InputPixelType );
 
+  /** Type of the feature image. */
+  typedef Image< float, Dimension >                         FeatureImageType;
+
+  /** Feature computed beforehand over a region that contains the input,
+   * typically the whole scan. When set, the feature is interpolated on the
+   * grid of the input instead of being computed, which lets all the lesions
+   * of a scan share it. */
+  itkSetConstObjectMacro( PrecomputedFeature, FeatureImageType );
+  itkGetConstObjectMacro( PrecomputedFeature, FeatureImageType );
+
 protected:
   LungWallFeatureGenerator();
   virtual ~LungWallFeatureGenerator();
@@ -112,6 +122,8 @@ private:
   VotingHoleFillingFilterPointer        m_VotingHoleFillingFilter;
 
   InputPixelType                        m_LungThreshold;
+
+  typename FeatureImageType::ConstPointer m_PrecomputedFeature;
 };
 
 } // end namespace itk
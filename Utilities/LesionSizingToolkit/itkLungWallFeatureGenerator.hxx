@@ -19,6 +19,9 @@
 
 #include "itkLungWallFeatureGenerator.h"
 #include "itkProgressAccumulator.h"
+#include "itkImageRegionConstIterator.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include "itkLinearInterpolateImageFunction.h"
 
 
 namespace itk
@@ -91,6 +94,7 @@ LungWallFeatureGenerator<NDimension>
 {
   Superclass::PrintSelf( os, indent );
   os << indent << "Lung threshold " << this->m_ThresholdFilter << std::endl;
+  os << indent << "Precomputed feature " << this->m_PrecomputedFeature.GetPointer() << std::endl;
 }
 
 
@@ -117,6 +121,46 @@ LungWallFeatureGenerator<NDimension>
     itkExceptionMacro("Missing input image");
     }
 
+  OutputImageSpatialObjectType * outputObject =
+    dynamic_cast< OutputImageSpatialObjectType * >(this->ProcessObject::GetOutput(0));
+
+  if( this->m_PrecomputedFeature )
+    {
+    // The precomputed feature is only read, through a const interpolator,
+    // so that generators running in several threads can share it. Voxels
+    // outside of it are thresholded.
+    typename OutputImageType::Pointer outputImage = OutputImageType::New();
+    outputImage->CopyInformation( inputImage );
+    outputImage->SetRegions( inputImage->GetBufferedRegion() );
+    outputImage->Allocate();
+
+    typedef LinearInterpolateImageFunction< FeatureImageType, double > InterpolatorType;
+    typename InterpolatorType::Pointer interpolator = InterpolatorType::New();
+    interpolator->SetInputImage( this->m_PrecomputedFeature );
+
+    ImageRegionConstIterator< InputImageType > iti( inputImage, inputImage->GetBufferedRegion() );
+    ImageRegionIteratorWithIndex< OutputImageType > ito( outputImage, outputImage->GetBufferedRegion() );
+
+    typename OutputImageType::PointType point;
+    typename InterpolatorType::ContinuousIndexType index;
+    for( iti.GoToBegin(), ito.GoToBegin(); !ito.IsAtEnd(); ++iti, ++ito )
+      {
+      outputImage->TransformIndexToPhysicalPoint( ito.GetIndex(), point );
+      this->m_PrecomputedFeature->TransformPhysicalPointToContinuousIndex( point, index );
+      if( interpolator->IsInsideBuffer( index ) )
+        {
+        ito.Set( interpolator->EvaluateAtContinuousIndex( index ) );
+        }
+      else
+        {
+        ito.Set( ( iti.Get() >= this->m_LungThreshold && iti.Get() <= 3000 ) ? 0.0 : 1.0 );
+        }
+      }
+
+    outputObject->SetImage( outputImage );
+    return;
+    }
+
   // Report progress.
   ProgressAccumulator::Pointer progress = ProgressAccumulator::New();
   progress->SetMiniPipelineFilter(this);
@@ -142,6 +186,9 @@ LungWallFeatureGenerator<NDimension>
   this->m_VotingHoleFillingFilter->SetMajorityThreshold( 1 );
   this->m_VotingHoleFillingFilter->SetMaximumNumberOfIterations( 1000 );
 
+  this->m_ThresholdFilter->SetNumberOfThreads( this->GetNumberOfThreads() );
+  this->m_VotingHoleFillingFilter->SetNumberOfThreads( this->GetNumberOfThreads() );
+
   this->m_VotingHoleFillingFilter->Update();
 
   std::cout << "Used " << this->m_VotingHoleFillingFilter->GetCurrentIterationNumber() << " iterations " << std::endl;
@@ -151,9 +198,6 @@ LungWallFeatureGenerator<NDimension>
 
   outputImage->DisconnectPipeline();
 
-  OutputImageSpatialObjectType * outputObject =
-    dynamic_cast< OutputImageSpatialObjectType * >(this->ProcessObject::GetOutput(0));
-
   outputObject->SetImage( outputImage );
 }
 
@@ -19,6 +19,7 @@
 
 #include "itkImage.h"
 #include "itkImageToImageFilter.h"
+#include "itkMultiThreader.h"
 
 #include <vector>
 
@@ -34,6 +35,15 @@ namespace itk
  * propagated until they collide with other labeled regions. Each labeled front
  * will compete for pixels against other labels.
  *
+ * The fronts are tracked explicitly: at each iteration only the unlabeled
+ * pixels next to the pixels labeled in the previous iteration are visited,
+ * so that an iteration costs in proportion to the size of the front rather
+ * than of the image. Every pixel of the front takes the lowest label among
+ * its neighbors at the start of the iteration, which makes the result
+ * independent of the order in which the front is visited. Large fronts are
+ * split across threads. Pixels on the boundary of the image keep their
+ * input labels and are not grown into.
+ *
  * \ingroup RegionGrowingSegmentation 
  * \ingroup LesionSizingToolkit
  */
@@ -113,52 +123,59 @@ private:
 
   void AllocateOutputImageWorkingMemory();
 
-  void AllocateFrontsWorkingMemory();
-
-  void ComputeNumberOfInputLabels();
-
   void InitializeNeighborhood();
 
   void FindAllPixelsInTheBoundaryAndAddThemAsSeeds();
 
   void IterateFrontPropagations();
 
-  void VisitAllSeedsAndTransitionTheirState();
-
-  void PasteNewSeedValuesToOutputImage();
+  void ComputeArrayOfNeighborhoodBufferOffsets();
 
-  void SwapSeedArrays();
+  /** Phases of an iteration, run on contiguous blocks of the front */
+  enum FrontPhaseType
+    {
+    COMPUTE_NEW_LABELS,
+    PASTE_NEW_LABELS
+    };
 
-  void ClearSecondSeedArray();
+  struct FrontThreadStruct
+    {
+    RegionCompetitionImageFilter * Filter;
+    FrontPhaseType                 Phase;
+    unsigned int                   NumberOfBlocks;
+    };
 
-  bool TestForAvailabilityAtCurrentPixel() const;
- 
-  void PutCurrentPixelNeighborsIntoSeedArray();
+  static ITK_THREAD_RETURN_TYPE FrontThreaderCallback( void * arg );
 
-  void ComputeArrayOfNeighborhoodBufferOffsets();
+  void RunFrontPhase( FrontPhaseType phase );
 
-  void ComputeBirthThreshold();
+  /** Label each pixel of the front [first,last) would take */
+  void ComputeNewLabels( SizeValueType first, SizeValueType last );
 
-  itkSetMacro( CurrentPixelIndex, IndexType );
-  itkGetConstReferenceMacro( CurrentPixelIndex, IndexType );
+  /** Paste the new labels of the front [first,last) into the output and
+   * collect the unlabeled neighbors of those pixels in 'candidates' */
+  void PasteNewLabels( SizeValueType first, SizeValueType last,
+                       std::vector< OffsetValueType > & candidates );
 
-  typedef std::vector<IndexType>    SeedArrayType;
+  /** Pixels of the front, as offsets in the buffers of the output image
+   * and of the seeds mask, which share their buffered region */
+  typedef std::vector< OffsetValueType >    SeedArrayType;
 
-  SeedArrayType *                   m_SeedArray1;
-  SeedArrayType *                   m_SeedArray2;
+  SeedArrayType                     m_SeedArray;
 
-  InputImageRegionType              m_InternalRegion;
-  
   typedef std::vector<OutputImagePixelType> SeedNewValuesArrayType;
 
-  SeedNewValuesArrayType *          m_SeedsNewValues;
+  SeedNewValuesArrayType            m_SeedsNewValues;
+
+  /** Neighbors collected by each block of the front */
+  std::vector< SeedArrayType >      m_CandidateSeedArrays;
+
+  InputImageRegionType              m_InternalRegion;
 
   unsigned int                      m_CurrentIterationNumber;
   unsigned int                      m_MaximumNumberOfIterations;
   unsigned int                      m_NumberOfPixelsChangedInLastIteration;
   unsigned int                      m_TotalNumberOfPixelsChanged;
-  
-  IndexType                         m_CurrentPixelIndex;
 
   //
   // Variables used for addressing the Neighbors.
@@ -186,8 +203,6 @@ private:
   typedef itk::Neighborhood< InputImagePixelType, InputImageDimension >  NeighborhoodType;
 
   NeighborhoodType                  m_Neighborhood;
-
-  mutable unsigned int              m_NumberOfLabels;
 };
 
 } // end namespace itk
@@ -19,11 +19,14 @@
 
 #include "itkRegionCompetitionImageFilter.h"
 #include "itkConstNeighborhoodIterator.h"
+#include "itkImageRegionConstIterator.h"
 #include "itkImageRegionIterator.h"
 #include "itkImageRegionExclusionIteratorWithIndex.h"
 #include "itkNeighborhoodAlgorithm.h"
 #include "itkOffset.h"
 
+#include <algorithm>
+
 namespace itk
 {
 
@@ -42,15 +45,8 @@ RegionCompetitionImageFilter<TInputImage, TOutputImage>
   this->m_NumberOfPixelsChangedInLastIteration = 0;
   this->m_TotalNumberOfPixelsChanged = 0;
 
-  this->m_SeedArray1 = NULL;
-  this->m_SeedArray2 = NULL;
-  this->m_SeedsNewValues = NULL;
-
-  this->m_CurrentPixelIndex.Fill( 0 );
-
   this->m_OutputImage = NULL;
   
-  this->m_NumberOfLabels = 0;
  this->m_inputLabelsImage = NULL;
 }
 
@@ -61,23 +57,6 @@ template <class TInputImage, class TOutputImage>
 RegionCompetitionImageFilter<TInputImage, TOutputImage>
 ::~RegionCompetitionImageFilter()
 {
-  if( this->m_SeedArray1 )
-    {
-    delete [] this->m_SeedArray1;
-    this->m_SeedArray1 = NULL;
-    }
-
-  if( this->m_SeedArray2 )
-    {
-    delete [] this->m_SeedArray2;
-    this->m_SeedArray2 = NULL;
-    }
-
-  if( this->m_SeedsNewValues )
-    {
-    delete [] this->m_SeedsNewValues;
-    this->m_SeedsNewValues = NULL;
-    }
 }
 
 
@@ -111,12 +90,16 @@ RegionCompetitionImageFilter<TInputImage,TOutputImage>
 ::GenerateData()
 {
   this->AllocateOutputImageWorkingMemory();
-  this->ComputeNumberOfInputLabels();
-  this->AllocateFrontsWorkingMemory();
   this->InitializeNeighborhood();
   this->ComputeArrayOfNeighborhoodBufferOffsets();
   this->FindAllPixelsInTheBoundaryAndAddThemAsSeeds();
   this->IterateFrontPropagations();
+
+  // Release the working memory
+  this->m_SeedArray = SeedArrayType();
+  this->m_SeedsNewValues = SeedNewValuesArrayType();
+  this->m_CandidateSeedArrays.clear();
+  this->m_SeedsMask = NULL;
 }
 
 
@@ -129,13 +112,37 @@ RegionCompetitionImageFilter<TInputImage,TOutputImage>
   this->m_TotalNumberOfPixelsChanged = 0;
   this->m_NumberOfPixelsChangedInLastIteration = 0;
 
-  while( this->m_CurrentIterationNumber < this->m_MaximumNumberOfIterations ) 
+  unsigned char * mask = this->m_SeedsMask->GetBufferPointer();
+
+  while( this->m_CurrentIterationNumber < this->m_MaximumNumberOfIterations &&
+         !this->m_SeedArray.empty() ) 
     {
-    this->VisitAllSeedsAndTransitionTheirState();
+    // The new labels are all computed before any of them is pasted, so
+    // that they only depend on the labels at the start of the iteration
+    this->m_SeedsNewValues.resize( this->m_SeedArray.size() );
+    this->RunFrontPhase( COMPUTE_NEW_LABELS );
+    this->RunFrontPhase( PASTE_NEW_LABELS );
+
+    this->m_NumberOfPixelsChangedInLastIteration = this->m_SeedArray.size();
+    this->m_TotalNumberOfPixelsChanged += this->m_NumberOfPixelsChangedInLastIteration;
     this->m_CurrentIterationNumber++;
-    if( this->m_NumberOfPixelsChangedInLastIteration ==  0 )
+
+    // The next front is made of the unlabeled neighbors of the pixels that
+    // were just labeled. Blocks are merged in order and the mask removes
+    // the pixels collected by several blocks, so the front is the same
+    // whatever the number of threads.
+    this->m_SeedArray.clear();
+    for( unsigned int b = 0; b < this->m_CandidateSeedArrays.size(); b++ )
       {
-      break;
+      const SeedArrayType & candidates = this->m_CandidateSeedArrays[b];
+      for( SizeValueType k = 0; k < candidates.size(); k++ )
+        {
+        if( mask[ candidates[k] ] == 0 )
+          {
+          mask[ candidates[k] ] = 255;
+          this->m_SeedArray.push_back( candidates[k] );
+          }
+        }
       }
     }
 }
@@ -144,57 +151,160 @@ RegionCompetitionImageFilter<TInputImage,TOutputImage>
 template <class TInputImage, class TOutputImage>
 void 
 RegionCompetitionImageFilter<TInputImage,TOutputImage>
-::AllocateOutputImageWorkingMemory()
+::RunFrontPhase( FrontPhaseType phase )
 {
-  this->m_OutputImage  = this->GetOutput();
-  OutputImageRegionType region =  this->m_OutputImage->GetRequestedRegion();
+  // Small fronts are not worth starting threads for
+  const SizeValueType minimumBlockSize = 4096;
 
-  // Allocate memory for the output image itself.
-  this->m_OutputImage->SetBufferedRegion( region );
-  this->m_OutputImage->Allocate();
-  this->m_OutputImage->FillBuffer( 0 );
+  SizeValueType numberOfBlocks = this->m_SeedArray.size() / minimumBlockSize;
+  numberOfBlocks = std::min( numberOfBlocks, static_cast< SizeValueType >( this->GetNumberOfThreads() ) );
+  numberOfBlocks = std::max( numberOfBlocks, static_cast< SizeValueType >( 1 ) );
 
-  this->m_SeedsMask = SeedMaskImageType::New();
-  this->m_SeedsMask->SetRegions( region );
-  this->m_SeedsMask->Allocate();
-  this->m_SeedsMask->FillBuffer( 0 );
+  if( phase == PASTE_NEW_LABELS )
+    {
+    this->m_CandidateSeedArrays.resize( numberOfBlocks );
+    }
+
+  if( numberOfBlocks == 1 )
+    {
+    if( phase == COMPUTE_NEW_LABELS )
+      {
+      this->ComputeNewLabels( 0, this->m_SeedArray.size() );
+      }
+    else
+      {
+      this->PasteNewLabels( 0, this->m_SeedArray.size(), this->m_CandidateSeedArrays[0] );
+      }
+    return;
+    }
+
+  FrontThreadStruct str;
+  str.Filter = this;
+  str.Phase = phase;
+  str.NumberOfBlocks = static_cast< unsigned int >( numberOfBlocks );
+
+  this->GetMultiThreader()->SetNumberOfThreads( str.NumberOfBlocks );
+  this->GetMultiThreader()->SetSingleMethod( this->FrontThreaderCallback, &str );
+  this->GetMultiThreader()->SingleMethodExecute();
 }
 
-  
+
 template <class TInputImage, class TOutputImage>
-void
+ITK_THREAD_RETURN_TYPE
 RegionCompetitionImageFilter<TInputImage,TOutputImage>
-::ComputeNumberOfInputLabels()
+::FrontThreaderCallback( void * arg )
 {
+  const unsigned int threadId =
+    ((MultiThreader::ThreadInfoStruct *)(arg))->ThreadID;
 
-  typedef itk::ImageRegionConstIterator< TOutputImage >  IteratorType;
+  FrontThreadStruct * str =
+    (FrontThreadStruct *)(((MultiThreader::ThreadInfoStruct *)(arg))->UserData);
 
-  IteratorType  itr( m_inputLabelsImage,m_inputLabelsImage->GetBufferedRegion() );
+  if( threadId >= str->NumberOfBlocks )
+    {
+    return ITK_THREAD_RETURN_VALUE;
+    }
 
-  itr.GoToBegin();
+  const SizeValueType frontSize = str->Filter->m_SeedArray.size();
+  const SizeValueType first = ( frontSize * threadId ) / str->NumberOfBlocks;
+  const SizeValueType last  = ( frontSize * ( threadId + 1 ) ) / str->NumberOfBlocks;
 
-  this->m_NumberOfLabels = 0;
+  if( str->Phase == COMPUTE_NEW_LABELS )
+    {
+    str->Filter->ComputeNewLabels( first, last );
+    }
+  else
+    {
+    str->Filter->PasteNewLabels( first, last, str->Filter->m_CandidateSeedArrays[threadId] );
+    }
 
-  while( !itr.IsAtEnd() )
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+
+template <class TInputImage, class TOutputImage>
+void 
+RegionCompetitionImageFilter<TInputImage,TOutputImage>
+::ComputeNewLabels( SizeValueType first, SizeValueType last )
+{
+  const OutputImagePixelType * buffer = this->m_OutputImage->GetBufferPointer();
+
+  const OutputImagePixelType backgroundValue = 0;  // no-label value.
+
+  const unsigned int neighborhoodSize = this->m_NeighborBufferOffset.size();
+
+  for( SizeValueType k = first; k < last; k++ )
+    {
+    const OutputImagePixelType * currentPixelPointer = buffer + this->m_SeedArray[k];
+
+    OutputImagePixelType newValue = backgroundValue;
+    for( unsigned int i = 0; i < neighborhoodSize; ++i )
+      {
+      const OutputImagePixelType value = *( currentPixelPointer + this->m_NeighborBufferOffset[i] );
+      if( value != backgroundValue && ( newValue == backgroundValue || value < newValue ) )
+        {
+        newValue = value;
+        }
+      }
+
+    this->m_SeedsNewValues[k] = newValue;
+    }
+}
+
+
+template <class TInputImage, class TOutputImage>
+void 
+RegionCompetitionImageFilter<TInputImage,TOutputImage>
+::PasteNewLabels( SizeValueType first, SizeValueType last, SeedArrayType & candidates )
+{
+  OutputImagePixelType * buffer = this->m_OutputImage->GetBufferPointer();
+
+  const unsigned char * mask = this->m_SeedsMask->GetBufferPointer();
+
+  const unsigned int neighborhoodSize = this->m_NeighborBufferOffset.size();
+
+  candidates.clear();
+
+  for( SizeValueType k = first; k < last; k++ )
     {
-    if( itr.Get() > this->m_NumberOfLabels )
+    const OffsetValueType pixelOffset = this->m_SeedArray[k];
+
+    buffer[ pixelOffset ] = this->m_SeedsNewValues[k];
+
+    // Pixels that are labeled, on the front or on the boundary of the
+    // image are marked in the mask, which is not written in this phase
+    for( unsigned int i = 0; i < neighborhoodSize; ++i )
       {
-      this->m_NumberOfLabels = itr.Get();
+      const OffsetValueType neighborOffset = pixelOffset + this->m_NeighborBufferOffset[i];
+      if( mask[ neighborOffset ] == 0 )
+        {
+        candidates.push_back( neighborOffset );
+        }
       }
-    ++itr;
     }
 }
 
+
 template <class TInputImage, class TOutputImage>
 void 
 RegionCompetitionImageFilter<TInputImage,TOutputImage>
-::AllocateFrontsWorkingMemory()
+::AllocateOutputImageWorkingMemory()
 {
-  this->m_SeedArray1 = new SeedArrayType[ this->m_NumberOfLabels ];
-  this->m_SeedArray2 = new SeedArrayType[ this->m_NumberOfLabels ];
-  this->m_SeedsNewValues = new SeedNewValuesArrayType[ this->m_NumberOfLabels ];
+  this->m_OutputImage  = this->GetOutput();
+  OutputImageRegionType region =  this->m_OutputImage->GetRequestedRegion();
+
+  // Allocate memory for the output image itself.
+  this->m_OutputImage->SetBufferedRegion( region );
+  this->m_OutputImage->Allocate();
+  this->m_OutputImage->FillBuffer( 0 );
+
+  this->m_SeedsMask = SeedMaskImageType::New();
+  this->m_SeedsMask->SetRegions( region );
+  this->m_SeedsMask->Allocate();
+  this->m_SeedsMask->FillBuffer( 0 );
 }
 
+
 template <class TInputImage, class TOutputImage>
 void 
 RegionCompetitionImageFilter<TInputImage,TOutputImage>
@@ -212,7 +322,7 @@ RegionCompetitionImageFilter<TInputImage,TOutputImage>
 ::FindAllPixelsInTheBoundaryAndAddThemAsSeeds()
 {
 
-  OutputImageRegionType region = m_inputLabelsImage->GetRequestedRegion();
+  OutputImageRegionType region = this->m_OutputImage->GetBufferedRegion();
 
   ConstNeighborhoodIterator< TOutputImage >   bit;
   ImageRegionIterator< TOutputImage >        itr;
@@ -234,7 +344,15 @@ RegionCompetitionImageFilter<TInputImage,TOutputImage>
   
   this->m_InternalRegion = *fit;
 
-  // Mark all the pixels in the boundary of the seed image as visited
+  // The pixels in the boundary of the image keep their labels, and are
+  // marked as visited so that the fronts never grow into them
+  ImageRegionConstIterator< TOutputImage > lit( m_inputLabelsImage, region );
+  itr = ImageRegionIterator<TOutputImage>( this->m_OutputImage, region );
+  for( lit.GoToBegin(), itr.GoToBegin(); !itr.IsAtEnd(); ++lit, ++itr )
+    {
+    itr.Set( lit.Get() );
+    }
+
   typedef itk::ImageRegionExclusionIteratorWithIndex< SeedMaskImageType > ExclusionIteratorType;
 
   ExclusionIteratorType exIt( this->m_SeedsMask, region );
@@ -250,223 +368,40 @@ RegionCompetitionImageFilter<TInputImage,TOutputImage>
     }
 
   bit = ConstNeighborhoodIterator<TOutputImage>( radius, m_inputLabelsImage, this->m_InternalRegion );
-  itr  = ImageRegionIterator<TOutputImage>(    this->m_OutputImage, this->m_InternalRegion );
   mtr  = ImageRegionIterator<SeedMaskImageType>(  this->m_SeedsMask,   this->m_InternalRegion );
 
   bit.GoToBegin();
-  itr.GoToBegin();
   mtr.GoToBegin();
   
   unsigned int neighborhoodSize = bit.Size();
 
   const OutputImagePixelType backgroundValue = 0;  // no-label value.
   
-  for( unsigned int lb = 0; lb < this->m_NumberOfLabels; lb++ )
-    {
-    this->m_SeedArray1[ lb ].clear();
-    this->m_SeedsNewValues[ lb ].clear();
-    }
-
+  this->m_SeedArray.clear();
 
+  // The initial front: unlabeled pixels with a labeled neighbor
   while ( ! bit.IsAtEnd() )
     {
     if( bit.GetCenterPixel() != backgroundValue )
       {
-      itr.Set( bit.GetCenterPixel() );
       mtr.Set( 255 );
       }
     else
       {
-      itr.Set( backgroundValue );
-      mtr.Set( 0 );
-      
       // Search for foreground pixels in the neighborhood
       for (unsigned int i = 0; i < neighborhoodSize; ++i)
         {
-        OutputImagePixelType value = bit.GetPixel(i);
-        if( value != backgroundValue )
+        if( bit.GetPixel(i) != backgroundValue )
           {
-          this->m_SeedArray1[value-1].push_back( bit.GetIndex() );
+          this->m_SeedArray.push_back( this->m_OutputImage->ComputeOffset( bit.GetIndex() ) );
+          mtr.Set( 255 );
           break;
           }
         }
       }   
     ++bit;
-    ++itr;
     ++mtr;
     }
-
-
-  for( unsigned int lb = 0; lb < this->m_NumberOfLabels; lb++ )
-    {
-    this->m_SeedsNewValues[lb].reserve( this->m_SeedArray1[lb].size() ); 
-    }
-}
-
-
-template <class TInputImage, class TOutputImage>
-void 
-RegionCompetitionImageFilter<TInputImage,TOutputImage>
-::VisitAllSeedsAndTransitionTheirState()
-{
-  for( unsigned int lb = 0; lb < this->m_NumberOfLabels; lb++ )
-    {
-    typedef typename SeedArrayType::const_iterator   SeedIterator;
-
-    SeedIterator seedItr = this->m_SeedArray1[lb].begin();
-
-    this->m_NumberOfPixelsChangedInLastIteration = 0;
-
-    // Clear the array of new values
-    this->m_SeedsNewValues[lb].clear();
-
-    while( seedItr != this->m_SeedArray1[lb].end() )
-      {
-      this->SetCurrentPixelIndex( *seedItr );
-
-      if( this->TestForAvailabilityAtCurrentPixel() )
-        {
-        this->m_SeedsNewValues[lb].push_back( 255 ); // FIXME: Use label value here
-        this->PutCurrentPixelNeighborsIntoSeedArray();
-        this->m_NumberOfPixelsChangedInLastIteration++;
-        }
-      else
-        {
-        this->m_SeedsNewValues[lb].push_back( 0 ); // FIXME: Use No-label value here 
-        // Keep the seed to try again in the next iteration.
-        this->m_SeedArray2->push_back( this->GetCurrentPixelIndex() );
-        }
-
-      ++seedItr;
-      }
-
-    this->PasteNewSeedValuesToOutputImage();
-     
-    this->m_TotalNumberOfPixelsChanged += this->m_NumberOfPixelsChangedInLastIteration;
-
-    // Now that the values have been copied to the output image, we can empty the
-    // array in preparation for the next iteration
-    this->m_SeedsNewValues[lb].clear();
-
-    }
-
-  this->SwapSeedArrays();
-  this->ClearSecondSeedArray();
-}
-
-
-template <class TInputImage, class TOutputImage>
-void 
-RegionCompetitionImageFilter<TInputImage,TOutputImage>
-::PasteNewSeedValuesToOutputImage()
-{
-  //
-  // For each one of the label values
-  //
-  for( unsigned int lb = 0; lb < this->m_NumberOfLabels; lb++ )
-    {
-    //
-    //  Paste new values into the output image
-    //
-    typedef typename SeedArrayType::const_iterator   SeedIterator;
-
-    SeedIterator seedItr = this->m_SeedArray1[lb].begin();
-
-    typedef typename SeedNewValuesArrayType::const_iterator   SeedsNewValuesIterator;
-
-    SeedsNewValuesIterator newValueItr = this->m_SeedsNewValues[lb].begin();
-
-    while (seedItr != this->m_SeedArray1[lb].end() )
-      {
-      this->m_OutputImage->SetPixel( *seedItr, *newValueItr );
-      ++seedItr;
-      ++newValueItr;
-      }
-    }
-}
-
-template <class TInputImage, class TOutputImage>
-void 
-RegionCompetitionImageFilter<TInputImage,TOutputImage>
-::SwapSeedArrays()
-{
-  SeedArrayType * temporary = this->m_SeedArray1;
-  this->m_SeedArray1 = this->m_SeedArray2;
-  this->m_SeedArray2 = temporary;
-}
-
-
-template <class TInputImage, class TOutputImage>
-void 
-RegionCompetitionImageFilter<TInputImage,TOutputImage>
-::ClearSecondSeedArray()
-{
-  if( this->m_SeedArray2 )
-    {
-    delete [] this->m_SeedArray2;
-    }
-  this->m_SeedArray2 = new SeedArrayType[ this->m_NumberOfLabels ];
-}
-
-
-template <class TInputImage, class TOutputImage>
-bool 
-RegionCompetitionImageFilter<TInputImage,TOutputImage>
-::TestForAvailabilityAtCurrentPixel() const
-{
-  return true; // FIXME
-}
-
-
-template <class TInputImage, class TOutputImage>
-void 
-RegionCompetitionImageFilter<TInputImage,TOutputImage>
-::PutCurrentPixelNeighborsIntoSeedArray()
-{
-  //
-  // Find the location of the current pixel in the image memory buffer
-  //
-  const OffsetValueType pixelOffset = this->m_OutputImage->ComputeOffset( this->GetCurrentPixelIndex() );
-
-  const OutputImagePixelType * buffer = this->m_OutputImage->GetBufferPointer();
-
-  const OutputImagePixelType * currentPixelPointer = buffer + pixelOffset;
-
-
-  const unsigned int neighborhoodSize = this->m_Neighborhood.Size();
-
-  //
-  // Visit the offset of each neighbor in Index as well as buffer space
-  // and if they are backgroundValue then insert them as new seeds
-  //
-  typedef typename NeighborhoodType::OffsetType    NeighborOffsetType;
-
-  typedef typename NeighborOffsetArrayType::const_iterator   NeigborOffsetIterator;
-
-  NeigborOffsetIterator neighborItr = this->m_NeighborBufferOffset.begin();
-
-  const OutputImagePixelType backgroundValue = 0;  // FIXME: replace with NO-Label.
-
-  for( unsigned int i = 0; i < neighborhoodSize; ++i, ++neighborItr )
-    {
-    const OutputImagePixelType * neighborPixelPointer = currentPixelPointer + *neighborItr;
-
-    if( *neighborPixelPointer == backgroundValue )
-      {
-      NeighborOffsetType neighborOffset = this->m_Neighborhood.GetOffset(i);
-      IndexType neighborIndex = this->GetCurrentPixelIndex() + neighborOffset;
-
-      //if( this->m_InternalRegion.IsInside( neighborIndex ) )
-        {
-        if( this->m_SeedsMask->GetPixel( neighborIndex ) == 0 )
-          {
-          this->m_SeedArray2->push_back( neighborIndex );
-          this->m_SeedsMask->SetPixel( neighborIndex, 255 );
-          }
-        }
-      }
-    }
-
 }
 
 
@@ -479,7 +414,7 @@ RegionCompetitionImageFilter<TInputImage,TOutputImage>
   // Copy the offsets from the Input image.
   // We assume that they are the same for the output image.
   //
-  const size_t sizeOfOffsetTableInBytes = (InputImageDimension+1)*sizeof(unsigned long);
+  const size_t sizeOfOffsetTableInBytes = (InputImageDimension+1)*sizeof(OffsetValueType);
 
   memcpy( this->m_OffsetTable, this->m_OutputImage->GetOffsetTable(), sizeOfOffsetTableInBytes );
 
@@ -502,7 +437,7 @@ RegionCompetitionImageFilter<TInputImage,TOutputImage>
     {
     NeighborOffsetType offset = this->m_Neighborhood.GetOffset(i);
 
-    signed int bufferOffset = 0; // must be a signed number
+    OffsetValueType bufferOffset = 0; // must be a signed number
 
     for( unsigned int d = 0; d < InputImageDimension; d++ )
       {
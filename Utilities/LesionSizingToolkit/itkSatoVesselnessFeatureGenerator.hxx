@@ -176,6 +176,10 @@ SatoVesselnessFeatureGenerator<NDimension>
   this->m_VesselnessFilter->SetAlpha1( this->m_Alpha1 );
   this->m_VesselnessFilter->SetAlpha2( this->m_Alpha2 );
 
+  this->m_VesselEnhancingDiffusionFilter->SetNumberOfThreads( this->GetNumberOfThreads() );
+  this->m_HessianFilter->SetNumberOfThreads( this->GetNumberOfThreads() );
+  this->m_VesselnessFilter->SetNumberOfThreads( this->GetNumberOfThreads() );
+
   this->m_VesselnessFilter->Update();
 
   typename OutputImageType::Pointer outputImage = this->m_VesselnessFilter->GetOutput();
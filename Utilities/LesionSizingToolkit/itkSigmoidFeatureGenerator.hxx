@@ -119,6 +119,8 @@ SigmoidFeatureGenerator<NDimension>
   this->m_SigmoidFilter->SetOutputMinimum( 0.0 );
   this->m_SigmoidFilter->SetOutputMaximum( 1.0 );
 
+  this->m_SigmoidFilter->SetNumberOfThreads( this->GetNumberOfThreads() );
+
   this->m_SigmoidFilter->Update();
 
   typename OutputImageType::Pointer outputImage = this->m_SigmoidFilter->GetOutput();
@@ -146,6 +146,7 @@ SinglePhaseLevelSetSegmentationModule<NDimension>
     rescaler->SetOutputMinimum(  4.0 ); // Note that the values must be [4:-4] here to 
     rescaler->SetOutputMaximum( -4.0 ); // make sure that we invert and not just rescale.
     rescaler->InPlaceOn();
+    rescaler->SetNumberOfThreads( this->GetNumberOfThreads() );
     rescaler->Update();
     outputImage = rescaler->GetOutput();
     }
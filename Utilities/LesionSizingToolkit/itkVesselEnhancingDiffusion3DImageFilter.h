@@ -18,6 +18,7 @@
 #define __itkVesselEnhancingDiffusion3DImageFilter_h
 
 #include "itkImageToImageFilter.h"
+#include "itkMultiThreader.h"
 #include <vector>
 
 namespace itk
@@ -50,6 +51,16 @@ namespace itk
  *   on vnl datatypes and its eigensystem calculations
  * - note: most of computation time is spent at calculation of vesselness
  *   response
+ * - the diffusion can be restricted to a region of interest, either set
+ *   directly or taken as the bounding box of the nonzero voxels of a mask,
+ *   padded by RegionOfInterestPadding voxels. The hessian is then only
+ *   computed over the diffusion region padded by three times the largest
+ *   scale, voxels outside of the diffusion region are held at their input
+ *   values, and the rest of the output is a copy of the input. All images
+ *   (and so the memory consumption) are restricted to the padded region.
+ * - the current image and the result of an iteration are double buffered,
+ *   and the diffusion stencil is multithreaded over slabs of the diffusion
+ *   region
  *
  *   9 feb 2009
  *      changed imagetype to precisionimage type of function call,
@@ -60,7 +71,7 @@ namespace itk
  *
  *
  * - todo
- *   - using parallelism/threading eg over scales
+ *   - using parallelism/threading over scales
  *   - completely itk-fying, eg eigenvalues calculation
  *   - possibly embedding within itk-diffusion framework
  *   - itk expert to have a look at use of iterators
@@ -80,6 +91,8 @@ public:
   typedef float                                           Precision;
   typedef Image<PixelType, NDimension>                    ImageType;
   typedef Image<Precision,NDimension>                     PrecisionImageType;
+  typedef Image<unsigned char,NDimension>                 MaskImageType;
+  typedef typename ImageType::RegionType                  RegionType;
 
   typedef VesselEnhancingDiffusion3DImageFilter           Self;
   typedef ImageToImageFilter<ImageType,ImageType>         Superclass;
@@ -110,6 +123,27 @@ public:
   itkBooleanMacro(Verbose);
   itkSetMacro(Verbose,bool);
 
+  // restricts the diffusion to a region of the input (see above)
+  void SetRegionOfInterest(const RegionType & region)
+    {
+    m_RegionOfInterest = region;
+    m_UseRegionOfInterest = true;
+    this->Modified();
+    }
+  itkGetConstReferenceMacro(RegionOfInterest, RegionType);
+  itkBooleanMacro(UseRegionOfInterest);
+  itkSetMacro(UseRegionOfInterest,bool);
+  itkGetMacro(UseRegionOfInterest,bool);
+
+  // alternatively, restricts the diffusion to the bounding box of the
+  // nonzero voxels of a mask on the grid of the input
+  itkSetConstObjectMacro(MaskImage, MaskImageType);
+  itkGetConstObjectMacro(MaskImage, MaskImageType);
+
+  // voxels added on each side of the region of interest, defaults to 2
+  itkSetMacro(RegionOfInterestPadding, unsigned int);
+  itkGetMacro(RegionOfInterestPadding, unsigned int);
+
   // some defaults for lowdose example
   // used in the paper
   void SetDefaultPars()
@@ -160,6 +194,16 @@ private:
   bool                      m_Verbose;
   unsigned int              m_CurrentIteration;
 
+  RegionType                m_RegionOfInterest;
+  bool                      m_UseRegionOfInterest;
+  typename MaskImageType::ConstPointer m_MaskImage;
+  unsigned int              m_RegionOfInterestPadding;
+
+  // voxels updated by the diffusion, and those for which the diffusion
+  // tensor is needed (the diffusion region padded by the stencil)
+  RegionType                m_DiffusionRegion;
+  RegionType                m_TensorRegion;
+
   // current hessian for which we have max vesselresponse
   typename PrecisionImageType::Pointer m_Dxx;
   typename PrecisionImageType::Pointer m_Dxy;
@@ -168,7 +212,29 @@ private:
   typename PrecisionImageType::Pointer m_Dyz;
   typename PrecisionImageType::Pointer m_Dzz;
 
-  void VED3DSingleIteration (typename PrecisionImageType::Pointer );
+  // one diffusion step of ci, written to d over the diffusion region
+  void VED3DSingleIteration (typename PrecisionImageType::Pointer ci,
+                             typename PrecisionImageType::Pointer d);
+
+  struct VEDThreadStruct
+    {
+    Self *               Filter;
+    PrecisionImageType * Current;
+    PrecisionImageType * Next;
+    };
+
+  static ITK_THREAD_RETURN_TYPE DiffusionThreaderCallback( void * arg );
+
+  // splits the diffusion region into slabs along its outermost dimension,
+  // returns the number of slabs
+  unsigned int SplitDiffusionRegion (unsigned int i, unsigned int num,
+                                     RegionType & splitRegion) const;
+
+  void ThreadedDiffusion (const RegionType &, const PrecisionImageType * ci,
+                          PrecisionImageType * d);
+
+  // region updated by the diffusion, from the region of interest or mask
+  RegionType ComputeDiffusionRegion () const;
 
   // Calculates maxvessel response of the range
   // of scales and stores the hessian of each voxel
@@ -19,11 +19,12 @@
 
 #include "itkVesselEnhancingDiffusion3DImageFilter.h"
 
-#include "itkCastImageFilter.h"
 #include "itkConstShapedNeighborhoodIterator.h"
 #include "itkHessianRecursiveGaussianImageFilter.h"
 #include "itkImageRegionConstIterator.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
 #include "itkImageRegionIterator.h"
+#include "itkMath.h"
 #include "itkMinimumMaximumImageFilter.h"
 #include "itkNeighborhoodAlgorithm.h"
 #include "itkNumericTraits.h"
@@ -33,6 +34,7 @@
 #include <vnl/vnl_matrix.h>
 #include <vnl/algo/vnl_symmetric_eigensystem.h>
 
+#include <algorithm>
 #include<iostream>
 
 namespace itk
@@ -48,7 +50,9 @@ VesselEnhancingDiffusion3DImageFilter<PixelType, NDimension>
     m_Epsilon(0.0),
     m_Omega(0.0),
     m_Sensitivity(0.0),
-    m_DarkObjectLightBackground(false)
+    m_DarkObjectLightBackground(false),
+    m_UseRegionOfInterest(false),
+    m_RegionOfInterestPadding(2)
 {
   this->SetNumberOfRequiredInputs(1);
 }
@@ -72,11 +76,80 @@ void VesselEnhancingDiffusion3DImageFilter<PixelType, NDimension>
   os << indent << "Omega                   : " << m_Omega << std::endl;
   os << indent << "Sensitivity             : " << m_Sensitivity << std::endl;
  os << indent << "DarkObjectLightBackground  : " << m_DarkObjectLightBackground << std::endl;
+  os << indent << "UseRegionOfInterest     : " << m_UseRegionOfInterest << std::endl;
+  os << indent << "RegionOfInterest        : " << m_RegionOfInterest << std::endl;
+  os << indent << "MaskImage               : " << m_MaskImage.GetPointer() << std::endl;
+  os << indent << "RegionOfInterestPadding : " << m_RegionOfInterestPadding << std::endl;
 }
+
+// diffusionregion
+template <class PixelType, unsigned int NDimension>
+typename VesselEnhancingDiffusion3DImageFilter<PixelType, NDimension>::RegionType
+VesselEnhancingDiffusion3DImageFilter<PixelType, NDimension>
+::ComputeDiffusionRegion() const
+{
+  const RegionType largest = this->GetInput()->GetLargestPossibleRegion();
+
+  RegionType region = largest;
+  if (m_MaskImage)
+    {
+    // bounding box of the nonzero voxels
+    typename RegionType::IndexType lower;
+    typename RegionType::IndexType upper;
+    lower.Fill(NumericTraits<IndexValueType>::max());
+    upper.Fill(NumericTraits<IndexValueType>::NonpositiveMin());
+
+    ImageRegionConstIteratorWithIndex<MaskImageType>
+      mit(m_MaskImage, m_MaskImage->GetBufferedRegion());
+    for (mit.GoToBegin(); !mit.IsAtEnd(); ++mit)
+      {
+      if (mit.Get() != NumericTraits<typename MaskImageType::PixelType>::Zero)
+        {
+        const typename RegionType::IndexType index = mit.GetIndex();
+        for (unsigned int i=0; i<NDimension; ++i)
+          {
+          lower[i] = std::min(lower[i], index[i]);
+          upper[i] = std::max(upper[i], index[i]);
+          }
+        }
+      }
+    if (lower[0] > upper[0])
+      {
+      itkExceptionMacro("The mask image has no nonzero voxels");
+      }
+
+    typename RegionType::SizeType size;
+    for (unsigned int i=0; i<NDimension; ++i)
+      {
+      size[i] = upper[i] - lower[i] + 1;
+      }
+    region.SetIndex(lower);
+    region.SetSize(size);
+    }
+  else if (m_UseRegionOfInterest)
+    {
+    region = m_RegionOfInterest;
+    }
+  else
+    {
+    return largest;
+    }
+
+  region.PadByRadius(m_RegionOfInterestPadding);
+  if (!region.Crop(largest))
+    {
+    itkExceptionMacro("The region of interest " << region
+                      << " does not overlap the input " << largest);
+    }
+
+  return region;
+}
+
 // singleiter
 template <class PixelType, unsigned int NDimension>
 void VesselEnhancingDiffusion3DImageFilter<PixelType, NDimension>
-::VED3DSingleIteration(typename PrecisionImageType::Pointer ci)
+::VED3DSingleIteration(typename PrecisionImageType::Pointer ci,
+                       typename PrecisionImageType::Pointer d)
 {
   bool rec(false);
   if (    (m_CurrentIteration == 1) ||
@@ -102,18 +175,95 @@ void VesselEnhancingDiffusion3DImageFilter<PixelType, NDimension>
       }
     }
 
+  // calculate d = nonlineardiffusion(ci) over the diffusion region
+  // using 3x3x3 stencil, split over threads
+  VEDThreadStruct str;
+  str.Filter  = this;
+  str.Current = ci.GetPointer();
+  str.Next    = d.GetPointer();
 
-  // calculate d = nonlineardiffusion(ci)
-  // using 3x3x3 stencil, afterwards copy
-  // result from d back to ci
-  typename PrecisionImageType::Pointer d = PrecisionImageType::New();
-  d->SetOrigin(ci->GetOrigin());
-  d->SetSpacing(ci->GetSpacing());
-  d->SetDirection(ci->GetDirection());
-  d->SetRegions(ci->GetLargestPossibleRegion());
-  d->Allocate();
-  d->FillBuffer(NumericTraits<Precision>::Zero);
+  this->GetMultiThreader()->SetNumberOfThreads(this->GetNumberOfThreads());
+  this->GetMultiThreader()->SetSingleMethod(this->DiffusionThreaderCallback, &str);
+  this->GetMultiThreader()->SingleMethodExecute();
+}
+
+template <class PixelType, unsigned int NDimension>
+ITK_THREAD_RETURN_TYPE
+VesselEnhancingDiffusion3DImageFilter<PixelType, NDimension>
+::DiffusionThreaderCallback( void * arg )
+{
+  const unsigned int threadId =
+    ((MultiThreader::ThreadInfoStruct *)(arg))->ThreadID;
+  const unsigned int threadCount =
+    ((MultiThreader::ThreadInfoStruct *)(arg))->NumberOfThreads;
+
+  VEDThreadStruct * str =
+    (VEDThreadStruct *)(((MultiThreader::ThreadInfoStruct *)(arg))->UserData);
+
+  RegionType splitRegion;
+  const unsigned int total =
+    str->Filter->SplitDiffusionRegion(threadId, threadCount, splitRegion);
+
+  if (threadId < total)
+    {
+    str->Filter->ThreadedDiffusion(splitRegion, str->Current, str->Next);
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+// same splitting as ImageSource::SplitRequestedRegion, but of the
+// diffusion region
+template <class PixelType, unsigned int NDimension>
+unsigned int VesselEnhancingDiffusion3DImageFilter<PixelType, NDimension>
+::SplitDiffusionRegion(unsigned int i, unsigned int num,
+                       RegionType & splitRegion) const
+{
+  splitRegion = m_DiffusionRegion;
+
+  typename RegionType::IndexType splitIndex = splitRegion.GetIndex();
+  typename RegionType::SizeType  splitSize  = splitRegion.GetSize();
+
+  // split on the outermost dimension available
+  int splitAxis = NDimension - 1;
+  while (splitSize[splitAxis] == 1)
+    {
+    --splitAxis;
+    if (splitAxis < 0)
+      {
+      return 1;
+      }
+    }
+
+  const unsigned int range = splitSize[splitAxis];
+  const unsigned int valuesPerThread =
+    Math::Ceil<unsigned int>(range / static_cast<double>(num));
+  const unsigned int maxThreadIdUsed =
+    Math::Ceil<unsigned int>(range / static_cast<double>(valuesPerThread)) - 1;
+
+  if (i < maxThreadIdUsed)
+    {
+    splitIndex[splitAxis] += i * valuesPerThread;
+    splitSize[splitAxis] = valuesPerThread;
+    }
+  if (i == maxThreadIdUsed)
+    {
+    splitIndex[splitAxis] += i * valuesPerThread;
+    splitSize[splitAxis] = splitSize[splitAxis] - i * valuesPerThread;
+    }
+
+  splitRegion.SetIndex(splitIndex);
+  splitRegion.SetSize(splitSize);
+
+  return maxThreadIdUsed + 1;
+}
 
+// diffusion of one slab
+template <class PixelType, unsigned int NDimension>
+void VesselEnhancingDiffusion3DImageFilter<PixelType, NDimension>
+::ThreadedDiffusion(const RegionType & region, const PrecisionImageType * ci,
+                    PrecisionImageType * d)
+{
   // shapedneighborhood iter, zeroflux boundary condition
   // division into faces and inner region
   typedef ZeroFluxNeumannBoundaryCondition<PrecisionImageType>    BT;
@@ -148,6 +298,12 @@ void VesselEnhancingDiffusion3DImageFilter<PixelType, NDimension>
   const typename NT::OffsetType oypzm = {{0,1,-1}};
   const typename NT::OffsetType oymzp = {{0,-1,1}};
 
+  const typename NT::OffsetType offsets[18] =
+    { oxp, oxm, oyp, oym, ozp, ozm,
+      oxpyp, oxmym, oxpym, oxmyp,
+      oxpzp, oxmzm, oxpzm, oxmzp,
+      oypzp, oymzm, oypzm, oymzp };
+
   // fixed weights (timers)
   const typename PrecisionImageType::SpacingType ispacing = ci->GetSpacing();
   const Precision rxx = m_TimeStep / (2.0 * ispacing[0] * ispacing[0]);
@@ -157,197 +313,36 @@ void VesselEnhancingDiffusion3DImageFilter<PixelType, NDimension>
   const Precision rxz = m_TimeStep / (4.0 * ispacing[0] * ispacing[2]);
   const Precision ryz = m_TimeStep / (4.0 * ispacing[1] * ispacing[2]);
 
-  // faces
+  // faces, the same for all images since they share their buffered region
   FT                            fc;
-  typename FT::FaceListType     fci = fc(ci,d->GetLargestPossibleRegion(),r);
-  typename FT::FaceListType     fxx = fc(m_Dxx,d->GetLargestPossibleRegion(),r);
-  typename FT::FaceListType     fxy = fc(m_Dxy,d->GetLargestPossibleRegion(),r);
-  typename FT::FaceListType     fxz = fc(m_Dxz,d->GetLargestPossibleRegion(),r);
-  typename FT::FaceListType     fyy = fc(m_Dyy,d->GetLargestPossibleRegion(),r);
-  typename FT::FaceListType     fyz = fc(m_Dyz,d->GetLargestPossibleRegion(),r);
-  typename FT::FaceListType     fzz = fc(m_Dzz,d->GetLargestPossibleRegion(),r);
-
-  typename FT::FaceListType::iterator fitci,fitxx,fitxy,fitxz,fityy,fityz,fitzz;
-
-  for ( fitci = fci.begin(),
-        fitxx = fxx.begin(), fitxy = fxy.begin(), fitxz = fxz.begin(),
-        fityy = fyy.begin(), fityz = fyz.begin(), fitzz = fzz.begin();
-        fitci != fci.end();
-        ++fitci, ++fitxx, ++fitxy, ++fitxz, ++fityy, ++fityz, ++fitzz)
+  typename FT::FaceListType     fci = fc(ci,region,r);
+
+  typename FT::FaceListType::iterator fitci;
+
+  for ( fitci = fci.begin(); fitci != fci.end(); ++fitci )
     {
     // output iter
     ImageRegionIterator<PrecisionImageType> dit(d,*fitci);
 
     // input iters
     NT itci (r,ci,*fitci);
-    NT itxx (r,m_Dxx,*fitxx);
-    NT itxy (r,m_Dxy,*fitxy);
-    NT itxz (r,m_Dxz,*fitxz);
-    NT ityy (r,m_Dyy,*fityy);
-    NT ityz (r,m_Dyz,*fityz);
-    NT itzz (r,m_Dzz,*fitzz);
-
-    itci.OverrideBoundaryCondition(&b);
-    itxx.OverrideBoundaryCondition(&b);
-    itxy.OverrideBoundaryCondition(&b);
-    itxz.OverrideBoundaryCondition(&b);
-    ityy.OverrideBoundaryCondition(&b);
-    ityz.OverrideBoundaryCondition(&b);
-    itzz.OverrideBoundaryCondition(&b);
-
-    // setting active offsets (yeah there must
-    // be some smarter way of doing this)
-    itci.ClearActiveList();
-    itxx.ClearActiveList();
-    itxy.ClearActiveList();
-    itxz.ClearActiveList();
-    ityy.ClearActiveList();
-    ityz.ClearActiveList();
-    itzz.ClearActiveList();
-
-    itci.ActivateOffset(oxp);
-    itxx.ActivateOffset(oxp);
-    itxy.ActivateOffset(oxp);
-    itxz.ActivateOffset(oxp);
-    ityy.ActivateOffset(oxp);
-    ityz.ActivateOffset(oxp);
-    itzz.ActivateOffset(oxp);
-
-    itci.ActivateOffset(oxm);
-    itxx.ActivateOffset(oxm);
-    itxy.ActivateOffset(oxm);
-    itxz.ActivateOffset(oxm);
-    ityy.ActivateOffset(oxm);
-    ityz.ActivateOffset(oxm);
-    itzz.ActivateOffset(oxm);
-
-    itci.ActivateOffset(oyp);
-    itxx.ActivateOffset(oyp);
-    itxy.ActivateOffset(oyp);
-    itxz.ActivateOffset(oyp);
-    ityy.ActivateOffset(oyp);
-    ityz.ActivateOffset(oyp);
-    itzz.ActivateOffset(oyp);
-
-    itci.ActivateOffset(oym);
-    itxx.ActivateOffset(oym);
-    itxy.ActivateOffset(oym);
-    itxz.ActivateOffset(oym);
-    ityy.ActivateOffset(oym);
-    ityz.ActivateOffset(oym);
-    itzz.ActivateOffset(oym);
-
-    itci.ActivateOffset(ozp);
-    itxx.ActivateOffset(ozp);
-    itxy.ActivateOffset(ozp);
-    itxz.ActivateOffset(ozp);
-    ityy.ActivateOffset(ozp);
-    ityz.ActivateOffset(ozp);
-    itzz.ActivateOffset(ozp);
-
-    itci.ActivateOffset(ozm);
-    itxx.ActivateOffset(ozm);
-    itxy.ActivateOffset(ozm);
-    itxz.ActivateOffset(ozm);
-    ityy.ActivateOffset(ozm);
-    ityz.ActivateOffset(ozm);
-    itzz.ActivateOffset(ozm);
-
-    itci.ActivateOffset(oxpyp);
-    itxx.ActivateOffset(oxpyp);
-    itxy.ActivateOffset(oxpyp);
-    itxz.ActivateOffset(oxpyp);
-    ityy.ActivateOffset(oxpyp);
-    ityz.ActivateOffset(oxpyp);
-    itzz.ActivateOffset(oxpyp);
-
-    itci.ActivateOffset(oxmym);
-    itxx.ActivateOffset(oxmym);
-    itxy.ActivateOffset(oxmym);
-    itxz.ActivateOffset(oxmym);
-    ityy.ActivateOffset(oxmym);
-    ityz.ActivateOffset(oxmym);
-    itzz.ActivateOffset(oxmym);
-
-    itci.ActivateOffset(oxpym);
-    itxx.ActivateOffset(oxpym);
-    itxy.ActivateOffset(oxpym);
-    itxz.ActivateOffset(oxpym);
-    ityy.ActivateOffset(oxpym);
-    ityz.ActivateOffset(oxpym);
-    itzz.ActivateOffset(oxpym);
-
-    itci.ActivateOffset(oxmyp);
-    itxx.ActivateOffset(oxmyp);
-    itxy.ActivateOffset(oxmyp);
-    itxz.ActivateOffset(oxmyp);
-    ityy.ActivateOffset(oxmyp);
-    ityz.ActivateOffset(oxmyp);
-    itzz.ActivateOffset(oxmyp);
-
-    itci.ActivateOffset(oxpzp);
-    itxx.ActivateOffset(oxpzp);
-    itxy.ActivateOffset(oxpzp);
-    itxz.ActivateOffset(oxpzp);
-    ityy.ActivateOffset(oxpzp);
-    ityz.ActivateOffset(oxpzp);
-    itzz.ActivateOffset(oxpzp);
-
-    itci.ActivateOffset(oxmzm);
-    itxx.ActivateOffset(oxmzm);
-    itxy.ActivateOffset(oxmzm);
-    itxz.ActivateOffset(oxmzm);
-    ityy.ActivateOffset(oxmzm);
-    ityz.ActivateOffset(oxmzm);
-    itzz.ActivateOffset(oxmzm);
-
-    itci.ActivateOffset(oxpzm);
-    itxx.ActivateOffset(oxpzm);
-    itxy.ActivateOffset(oxpzm);
-    itxz.ActivateOffset(oxpzm);
-    ityy.ActivateOffset(oxpzm);
-    ityz.ActivateOffset(oxpzm);
-    itzz.ActivateOffset(oxpzm);
-
-    itci.ActivateOffset(oxmzp);
-    itxx.ActivateOffset(oxmzp);
-    itxy.ActivateOffset(oxmzp);
-    itxz.ActivateOffset(oxmzp);
-    ityy.ActivateOffset(oxmzp);
-    ityz.ActivateOffset(oxmzp);
-    itzz.ActivateOffset(oxmzp);
-
-    itci.ActivateOffset(oypzp);
-    itxx.ActivateOffset(oypzp);
-    itxy.ActivateOffset(oypzp);
-    itxz.ActivateOffset(oypzp);
-    ityy.ActivateOffset(oypzp);
-    ityz.ActivateOffset(oypzp);
-    itzz.ActivateOffset(oypzp);
-
-    itci.ActivateOffset(oymzm);
-    itxx.ActivateOffset(oymzm);
-    itxy.ActivateOffset(oymzm);
-    itxz.ActivateOffset(oymzm);
-    ityy.ActivateOffset(oymzm);
-    ityz.ActivateOffset(oymzm);
-    itzz.ActivateOffset(oymzm);
-
-    itci.ActivateOffset(oypzm);
-    itxx.ActivateOffset(oypzm);
-    itxy.ActivateOffset(oypzm);
-    itxz.ActivateOffset(oypzm);
-    ityy.ActivateOffset(oypzm);
-    ityz.ActivateOffset(oypzm);
-    itzz.ActivateOffset(oypzm);
-
-    itci.ActivateOffset(oymzp);
-    itxx.ActivateOffset(oymzp);
-    itxy.ActivateOffset(oymzp);
-    itxz.ActivateOffset(oymzp);
-    ityy.ActivateOffset(oymzp);
-    ityz.ActivateOffset(oymzp);
-    itzz.ActivateOffset(oymzp);
+    NT itxx (r,m_Dxx,*fitci);
+    NT itxy (r,m_Dxy,*fitci);
+    NT itxz (r,m_Dxz,*fitci);
+    NT ityy (r,m_Dyy,*fitci);
+    NT ityz (r,m_Dyz,*fitci);
+    NT itzz (r,m_Dzz,*fitci);
+
+    NT * its[7] = { &itci, &itxx, &itxy, &itxz, &ityy, &ityz, &itzz };
+    for (unsigned int i=0; i<7; ++i)
+      {
+      its[i]->OverrideBoundaryCondition(&b);
+      its[i]->ClearActiveList();
+      for (unsigned int o=0; o<18; ++o)
+        {
+        its[i]->ActivateOffset(offsets[o]);
+        }
+      }
 
     // run for each face diffusion
     for (itci.GoToBegin(), dit.GoToBegin(),
@@ -403,14 +398,6 @@ void VesselEnhancingDiffusion3DImageFilter<PixelType, NDimension>
 
       }
     }
-
-  // copying
-  ImageRegionConstIterator<PrecisionImageType> iti (d,d->GetLargestPossibleRegion());
-  ImageRegionIterator<PrecisionImageType>      ito (ci,ci->GetLargestPossibleRegion());
-  for (iti.GoToBegin(), ito.GoToBegin(); !iti.IsAtEnd(); ++iti,++ito)
-    {
-    ito.Value() = iti.Value();
-    }
 }
 
 // maxvesselresponse
@@ -469,7 +456,8 @@ void VesselEnhancingDiffusion3DImageFilter<PixelType, NDimension>
   m_Dzz->FillBuffer(NumericTraits<Precision>::One);
 
 
-  // create temp vesselness image to store maxvessel
+  // create temp vesselness image to store maxvessel, the eigensystems
+  // are only needed over the tensor region
   typename PrecisionImageType::Pointer vi = PrecisionImageType::New();
 
   vi->SetOrigin(im->GetOrigin());
@@ -487,18 +475,19 @@ void VesselEnhancingDiffusion3DImageFilter<PixelType, NDimension>
     hessian->SetInput(im);
     hessian->SetNormalizeAcrossScale(true);
     hessian->SetSigma(m_Scales[i]);
+    hessian->SetNumberOfThreads(this->GetNumberOfThreads());
     hessian->Update();
 
-    ImageRegionIterator<PrecisionImageType> itxx (m_Dxx, m_Dxx->GetLargestPossibleRegion());
-    ImageRegionIterator<PrecisionImageType> itxy (m_Dxy, m_Dxy->GetLargestPossibleRegion());
-    ImageRegionIterator<PrecisionImageType> itxz (m_Dxz, m_Dxz->GetLargestPossibleRegion());
-    ImageRegionIterator<PrecisionImageType> ityy (m_Dyy, m_Dyy->GetLargestPossibleRegion());
-    ImageRegionIterator<PrecisionImageType> ityz (m_Dyz, m_Dyz->GetLargestPossibleRegion());
-    ImageRegionIterator<PrecisionImageType> itzz (m_Dzz, m_Dzz->GetLargestPossibleRegion());
-    ImageRegionIterator<PrecisionImageType> vit(vi, vi->GetLargestPossibleRegion());
+    ImageRegionIterator<PrecisionImageType> itxx (m_Dxx, m_TensorRegion);
+    ImageRegionIterator<PrecisionImageType> itxy (m_Dxy, m_TensorRegion);
+    ImageRegionIterator<PrecisionImageType> itxz (m_Dxz, m_TensorRegion);
+    ImageRegionIterator<PrecisionImageType> ityy (m_Dyy, m_TensorRegion);
+    ImageRegionIterator<PrecisionImageType> ityz (m_Dyz, m_TensorRegion);
+    ImageRegionIterator<PrecisionImageType> itzz (m_Dzz, m_TensorRegion);
+    ImageRegionIterator<PrecisionImageType> vit(vi, m_TensorRegion);
 
     ImageRegionConstIterator<typename HessianType::OutputImageType> hit
-        (hessian->GetOutput(), hessian->GetOutput()->GetLargestPossibleRegion());
+        (hessian->GetOutput(), m_TensorRegion);
 
     for (itxx.GoToBegin(), itxy.GoToBegin(), itxz.GoToBegin(),
             ityy.GoToBegin(), ityz.GoToBegin(), itzz.GoToBegin(),
@@ -583,12 +572,12 @@ template <class PixelType, unsigned int NDimension>
 void VesselEnhancingDiffusion3DImageFilter<PixelType, NDimension>
 ::DiffusionTensor()
 {
-  ImageRegionIterator<PrecisionImageType> itxx (m_Dxx, m_Dxx->GetLargestPossibleRegion());
-  ImageRegionIterator<PrecisionImageType> itxy (m_Dxy, m_Dxy->GetLargestPossibleRegion());
-  ImageRegionIterator<PrecisionImageType> itxz (m_Dxz, m_Dxz->GetLargestPossibleRegion());
-  ImageRegionIterator<PrecisionImageType> ityy (m_Dyy, m_Dyy->GetLargestPossibleRegion());
-  ImageRegionIterator<PrecisionImageType> ityz (m_Dyz, m_Dyz->GetLargestPossibleRegion());
-  ImageRegionIterator<PrecisionImageType> itzz (m_Dzz, m_Dzz->GetLargestPossibleRegion());
+  ImageRegionIterator<PrecisionImageType> itxx (m_Dxx, m_TensorRegion);
+  ImageRegionIterator<PrecisionImageType> itxy (m_Dxy, m_TensorRegion);
+  ImageRegionIterator<PrecisionImageType> itxz (m_Dxz, m_TensorRegion);
+  ImageRegionIterator<PrecisionImageType> ityy (m_Dyy, m_TensorRegion);
+  ImageRegionIterator<PrecisionImageType> ityz (m_Dyz, m_TensorRegion);
+  ImageRegionIterator<PrecisionImageType> itzz (m_Dzz, m_TensorRegion);
 
   for  ( itxx.GoToBegin(), itxy.GoToBegin(), itxz.GoToBegin(),
           ityy.GoToBegin(), ityz.GoToBegin(), itzz.GoToBegin();
@@ -655,12 +644,6 @@ void VesselEnhancingDiffusion3DImageFilter<PixelType, NDimension>
     std::cout << std::endl << "begin vesselenhancingdiffusion3Dimagefilter ... " << std::endl;
     }
 
-  typedef MinimumMaximumImageFilter<ImageType> MinMaxType;
-  typename MinMaxType::Pointer minmax = MinMaxType::New();
-
-  minmax->SetInput(this->GetInput());
-  minmax->Update();
-
   const typename ImageType::SpacingType ispacing = this->GetInput()->GetSpacing();
   const Precision htmax = 0.5 /
         (  1.0 / (ispacing[0] * ispacing[0])
@@ -681,6 +664,11 @@ void VesselEnhancingDiffusion3DImageFilter<PixelType, NDimension>
 
   if (m_Verbose)
     {
+    typedef MinimumMaximumImageFilter<ImageType> MinMaxType;
+    typename MinMaxType::Pointer minmax = MinMaxType::New();
+    minmax->SetInput(this->GetInput());
+    minmax->Update();
+
     std::cout << "min/max             \t" << minmax->GetMinimum() << " " << minmax->GetMaximum() << std::endl;
     std::cout << "iterations/timestep \t" << m_Iterations << " " << m_TimeStep << std::endl;
     std::cout << "recalc v            \t" << m_RecalculateVesselness << std::endl;
@@ -694,13 +682,59 @@ void VesselEnhancingDiffusion3DImageFilter<PixelType, NDimension>
     std::cout << "eps/omega/sens      \t" << m_Epsilon <<  " " << m_Omega << " " << m_Sensitivity << std::endl;
     }
 
-  // cast to precision
-  typedef CastImageFilter<ImageType,PrecisionImageType> CT;
-  typename CT::Pointer cast = CT::New();
-  cast->SetInput(this->GetInput());
-  cast->Update();
+  // the diffusion region, and the region the hessian of it depends on:
+  // the recursive gaussians are in effect truncated at about three sigma
+  m_DiffusionRegion = ComputeDiffusionRegion();
+
+  Precision maxScale = NumericTraits<Precision>::Zero;
+  for (unsigned int i=0; i<m_Scales.size(); ++i)
+    {
+    maxScale = std::max(maxScale, m_Scales[i]);
+    }
+
+  const RegionType largest = this->GetInput()->GetLargestPossibleRegion();
+  RegionType hessianRegion = m_DiffusionRegion;
+  typename RegionType::SizeType hessianPadding;
+  for (unsigned int i=0; i<NDimension; ++i)
+    {
+    hessianPadding[i] = Math::Ceil<SizeValueType>(3.0 * maxScale / ispacing[i]) + 1;
+    }
+  hessianRegion.PadByRadius(hessianPadding);
+  hessianRegion.Crop(largest);
 
-  typename PrecisionImageType::Pointer ci = cast->GetOutput();
+  m_TensorRegion = m_DiffusionRegion;
+  m_TensorRegion.PadByRadius(1);
+  m_TensorRegion.Crop(hessianRegion);
+
+  if (m_Verbose && m_DiffusionRegion != largest)
+    {
+    std::cout << "diffusion region    \t" << m_DiffusionRegion.GetIndex()
+              << " " << m_DiffusionRegion.GetSize() << std::endl;
+    }
+
+  // cast to precision, double buffered: ci is the current image and
+  // d receives the next iteration. voxels outside of the diffusion
+  // region are never written, so they keep their input values in both.
+  typename PrecisionImageType::Pointer ci = PrecisionImageType::New();
+  ci->SetOrigin(this->GetInput()->GetOrigin());
+  ci->SetSpacing(this->GetInput()->GetSpacing());
+  ci->SetDirection(this->GetInput()->GetDirection());
+  ci->SetRegions(hessianRegion);
+  ci->Allocate();
+
+  typename PrecisionImageType::Pointer d = PrecisionImageType::New();
+  d->CopyInformation(ci);
+  d->SetRegions(hessianRegion);
+  d->Allocate();
+
+  ImageRegionConstIterator<ImageType>     iti (this->GetInput(), hessianRegion);
+  ImageRegionIterator<PrecisionImageType> itc (ci, hessianRegion);
+  ImageRegionIterator<PrecisionImageType> itd (d, hessianRegion);
+  for (iti.GoToBegin(), itc.GoToBegin(), itd.GoToBegin(); !iti.IsAtEnd();
+       ++iti, ++itc, ++itd)
+    {
+    itc.Value() = itd.Value() = static_cast<Precision>(iti.Get());
+    }
 
 
   if (m_Verbose)
@@ -710,29 +744,57 @@ void VesselEnhancingDiffusion3DImageFilter<PixelType, NDimension>
 
   for (m_CurrentIteration=1; m_CurrentIteration<=m_Iterations; m_CurrentIteration++)
     {
-    VED3DSingleIteration (ci);
+    VED3DSingleIteration (ci, d);
+    std::swap(ci, d);
     }
 
-  typedef MinimumMaximumImageFilter<PrecisionImageType> MMT;
-  typename MMT::Pointer mm = MMT::New();
-  mm->SetInput(ci);
-  mm->Update();
+  // the hessian/tensor is not needed anymore
+  m_Dxx = NULL;
+  m_Dxy = NULL;
+  m_Dxz = NULL;
+  m_Dyy = NULL;
+  m_Dyz = NULL;
+  m_Dzz = NULL;
+  d = NULL;
 
   if (m_Verbose)
     {
+    typedef MinimumMaximumImageFilter<PrecisionImageType> MMT;
+    typename MMT::Pointer mm = MMT::New();
+    mm->SetInput(ci);
+    mm->Update();
+
     std::cout << std::endl;
     std::cout << "min/max             \t" << mm->GetMinimum() << " " << mm->GetMaximum() << std::endl;
     std::cout << "end vesselenhancingdiffusion3Dimagefilter" << std::endl;
     }
 
-  // cast back to pixeltype
+  // cast back to pixeltype over the diffusion region, the rest of
+  // the output is a copy of the input
   this->AllocateOutputs();
-  typedef CastImageFilter<PrecisionImageType,ImageType> CTI;
-  typename CTI::Pointer casti = CTI::New();
-  casti->SetInput(ci);
-  casti->GraftOutput(this->GetOutput());
-  casti->Update();
-  this->GraftOutput(casti->GetOutput());
+  typename ImageType::Pointer output = this->GetOutput();
+  if (m_DiffusionRegion != output->GetBufferedRegion())
+    {
+    ImageRegionConstIterator<ImageType> iti (this->GetInput(), output->GetBufferedRegion());
+    ImageRegionIterator<ImageType>      ito (output, output->GetBufferedRegion());
+    for (iti.GoToBegin(), ito.GoToBegin(); !iti.IsAtEnd(); ++iti, ++ito)
+      {
+      ito.Set(iti.Get());
+      }
+    }
+
+  RegionType outputRegion = m_DiffusionRegion;
+  if (!outputRegion.Crop(output->GetBufferedRegion()))
+    {
+    return;
+    }
+
+  ImageRegionConstIterator<PrecisionImageType> itc (ci, outputRegion);
+  ImageRegionIterator<ImageType>               ito (output, outputRegion);
+  for (itc.GoToBegin(), ito.GoToBegin(); !itc.IsAtEnd(); ++itc, ++ito)
+    {
+    ito.Set(static_cast<PixelType>(itc.Get()));
+    }
 }
 
 
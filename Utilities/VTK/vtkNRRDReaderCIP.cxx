@@ -51,6 +51,9 @@
 // Teem includes
 #include "teem/ten.h"
 
+// CIP includes
+#include "itkCIPBlockCompressedNrrdImageIO.h"
+
 vtkStandardNewMacro(vtkNRRDReaderCIP);
 
 vtkNRRDReaderCIP::vtkNRRDReaderCIP()
@@ -894,22 +897,6 @@ void vtkNRRDReaderCIP::ExecuteDataWithInformation(vtkDataObject *output, vtkInfo
     }
 
 
-  // Read in the nrrd.  Yes, this means that the header is being read
-  // twice: once by ExecuteInformation, and once here
-  if ( nrrdLoad(this->nrrd, this->GetFileName(), NULL) != 0 )
-    {
-    char *err =  biffGetDone(NRRD); // would be nice to free(err)
-    vtkErrorMacro("Read: Error reading "
-                      << this->GetFileName() << ":\n" << err);
-     return;
-    }
-
-
-  if (this->nrrd->data == NULL)
-    {
-    vtkErrorMacro(<< "data is null.");
-    return;
-    }
   void *ptr = NULL;
   switch(PointDataType) {
     case vtkDataSetAttributes::SCALARS:
@@ -933,6 +920,49 @@ void vtkNRRDReaderCIP::ExecuteDataWithInformation(vtkDataObject *output, vtkInfo
    }
   this->ComputeDataIncrements();
 
+  // Files written by itk::CIPBlockCompressedNrrdImageIO are decompressed
+  // on multiple threads straight into the output, unless the data has to
+  // be rearranged below (range axis not first, or symmetric matrices)
+  unsigned int headerRangeAxisIdx[NRRD_DIM_MAX];
+  unsigned int headerRangeAxisNum = nrrdRangeAxesGet(this->nrrd, headerRangeAxisIdx);
+  bool isPlainLayout = ( headerRangeAxisNum == 0 ||
+                         ( headerRangeAxisNum == 1 && headerRangeAxisIdx[0] == 0 &&
+                           nrrdKind3DMaskedSymMatrix != this->nrrd->axis[0].kind &&
+                           nrrdKind3DSymMatrix != this->nrrd->axis[0].kind ) );
+  if ( ptr != NULL && isPlainLayout )
+    {
+    try
+      {
+      if ( itk::CIPBlockCompressedNrrdImageIO::ReadBlockCompressedData( this->GetFileName(), ptr,
+             nrrdElementSize(this->nrrd)*nrrdElementNumber(this->nrrd), 0 ) )
+        {
+        return;
+        }
+      }
+    catch ( itk::ExceptionObject& excp )
+      {
+      vtkErrorMacro("Read: Error reading " << this->GetFileName() << ":\n" << excp.GetDescription());
+      return;
+      }
+    }
+
+  // Read in the nrrd.  Yes, this means that the header is being read
+  // twice: once by ExecuteInformation, and once here
+  if ( nrrdLoad(this->nrrd, this->GetFileName(), NULL) != 0 )
+    {
+    char *err =  biffGetDone(NRRD); // would be nice to free(err)
+    vtkErrorMacro("Read: Error reading "
+                      << this->GetFileName() << ":\n" << err);
+     return;
+    }
+
+
+  if (this->nrrd->data == NULL)
+    {
+    vtkErrorMacro(<< "data is null.");
+    return;
+    }
+
   int dims[3];
   data->GetDimensions(dims);
 